@@ -588,6 +588,11 @@
 /** Internal processing error in the PGM physial page mapping code dealing
  * with MMIO2 pages. */
 #define VERR_PGM_PHYS_PAGE_MAP_MMIO2_IPE        (-1684)
+/** An incremental saved state was requested, but the page changes are not
+ * being tracked relative to any earlier saved state. */
+#define VERR_PGM_NO_INCREMENTAL_BASE            (-1685)
+/** The chain of incremental saved states is too long. */
+#define VERR_PGM_INCREMENTAL_CHAIN_TOO_LONG     (-1686)
 /** @} */
 
 
@@ -143,6 +143,8 @@ typedef enum LOGGROUP
     LOG_GROUP_DEV_VGA,
     /** Virtio PCI Device group. */
     LOG_GROUP_DEV_VIRTIO,
+    /** Virtio Block Device group. */
+    LOG_GROUP_DEV_VIRTIO_BLK,
     /** Virtio Network Device group. */
     LOG_GROUP_DEV_VIRTIO_NET,
     /** VMM Device group. */
@@ -816,6 +818,7 @@ typedef enum LOGGROUP
     "DEV_SMC",      \
     "DEV_VGA",      \
     "DEV_VIRTIO",   \
+    "DEV_VIRTIO_BLK", \
     "DEV_VIRTIO_NET", \
     "DEV_VMM",      \
     "DEV_VMM_BACKDOOR", \
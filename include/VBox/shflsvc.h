@@ -119,6 +119,10 @@
 #define SHFL_FN_SET_STATUS_LED      (3)
 /** Allow the guest to create symbolic links (as of VBox 4.0) */
 #define SHFL_FN_ALLOW_SYMLINKS_CREATE (4)
+/** Set the number of worker threads executing guest requests (0 = synchronous). */
+#define SHFL_FN_SET_WORKER_THREADS  (5)
+/** Set the time to live of the host side metadata cache in milliseconds (0 = disabled). */
+#define SHFL_FN_SET_CACHE_TTL       (6)
 /** @} */
 
 /** Root handle for a mapping. Root handles are unique.
@@ -1412,6 +1416,28 @@ typedef struct _VBoxSFSymlink
 
 #define SHFL_CPARMS_SET_STATUS_LED (1)
 
+
+/**
+ * SHFL_FN_SET_WORKER_THREADS
+ * Host call, no guest structure is used.
+ */
+
+/** Upper limit for the number of worker threads. */
+#define SHFL_MAX_WORKER_THREADS (64)
+
+#define SHFL_CPARMS_SET_WORKER_THREADS (1)
+
+
+/**
+ * SHFL_FN_SET_CACHE_TTL
+ * Host call, no guest structure is used.
+ */
+
+/** Upper limit for the cache time to live (one hour). */
+#define SHFL_MAX_CACHE_TTL (3600000)
+
+#define SHFL_CPARMS_SET_CACHE_TTL (1)
+
 /** @} */
 
 #endif
@@ -985,6 +985,17 @@ VBOXDDU_DECL(int) VDFlush(PVBOXHDD pDisk);
  */
 VBOXDDU_DECL(unsigned) VDGetCount(PVBOXHDD pDisk);
 
+/**
+ * Sets the number of worker threads used when copying or merging images
+ * of the HDD container.
+ *
+ * @return  VBox status code.
+ * @return  VERR_INVALID_PARAMETER if cThreads exceeds the supported maximum.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   cThreads        Number of worker threads, 0 selects the default.
+ */
+VBOXDDU_DECL(int) VDSetCopyThreads(PVBOXHDD pDisk, unsigned cThreads);
+
 /**
  * Get read/write mode of HDD container.
  *
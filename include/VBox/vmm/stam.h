@@ -27,6 +27,7 @@
 #define ___VBox_vmm_stam_h
 
 #include <VBox/types.h>
+#include <iprt/asm.h>
 #include <iprt/stdarg.h>
 #ifdef _MSC_VER
 # if _MSC_VER >= 1400
@@ -156,6 +157,8 @@ typedef enum STAMTYPE
     STAMTYPE_BOOL,
     /** Generic boolean value. Reset to false. */
     STAMTYPE_BOOL_RESET,
+    /** Log-linear histogram (STAMHISTOGRAM). Reset to empty. */
+    STAMTYPE_HISTOGRAM,
     /** The end (exclusive). */
     STAMTYPE_END
 } STAMTYPE;
@@ -803,6 +806,130 @@ typedef STAMPROFILEADV *PSTAMPROFILEADV;
 typedef const STAMPROFILEADV *PCSTAMPROFILEADV;
 
 
+/** @name Histogram bucket layout.
+ * Values below STAM_HISTOGRAM_SUB_BUCKETS get a bucket each, above that every
+ * power of two is split into STAM_HISTOGRAM_SUB_BUCKETS linear buckets.  This
+ * keeps the relative bucket width at or below 1/STAM_HISTOGRAM_SUB_BUCKETS
+ * across the whole range.
+ * @{ */
+/** Log2 of the number of linear sub-buckets per power of two. */
+#define STAM_HISTOGRAM_SUB_SHIFT        3
+/** The number of linear sub-buckets per power of two. */
+#define STAM_HISTOGRAM_SUB_BUCKETS      (1 << STAM_HISTOGRAM_SUB_SHIFT)
+/** Values of 2^STAM_HISTOGRAM_MAX_SHIFT and above end up in the last bucket. */
+#define STAM_HISTOGRAM_MAX_SHIFT        40
+/** The number of buckets. */
+#define STAM_HISTOGRAM_BUCKETS          ((STAM_HISTOGRAM_MAX_SHIFT - STAM_HISTOGRAM_SUB_SHIFT + 1) * STAM_HISTOGRAM_SUB_BUCKETS)
+/** @} */
+
+/**
+ * Log-linear histogram sample, typically of latencies.
+ *
+ * The core is maintained like a STAMPROFILE (count, sum, min, max) so
+ * consumers which don't know histograms can treat it as a profile.  Recording
+ * is lock-free and can be done in any context, see STAMHistogramAdd.
+ */
+typedef struct STAMHISTOGRAM
+{
+    /** The STAMPROFILE core: samples, sum, max and min. */
+    STAMPROFILE         Core;
+    /** The buckets, see STAMHistogramIndex. */
+    volatile uint64_t   aBuckets[STAM_HISTOGRAM_BUCKETS];
+} STAMHISTOGRAM;
+/** Pointer to a histogram sample. */
+typedef STAMHISTOGRAM *PSTAMHISTOGRAM;
+/** Pointer to a const histogram sample. */
+typedef const STAMHISTOGRAM *PCSTAMHISTOGRAM;
+
+
+/**
+ * Calculates the histogram bucket index of a value.
+ *
+ * @returns Bucket index.
+ * @param   uValue      The value.
+ */
+DECLINLINE(unsigned) STAMHistogramIndex(uint64_t uValue)
+{
+    unsigned iBit;
+    if (uValue < STAM_HISTOGRAM_SUB_BUCKETS)
+        return (unsigned)uValue;
+    if (uValue >> 32)
+        iBit = ASMBitLastSetU32((uint32_t)(uValue >> 32)) + 31;
+    else
+        iBit = ASMBitLastSetU32((uint32_t)uValue) - 1;
+    if (iBit >= STAM_HISTOGRAM_MAX_SHIFT)
+        return STAM_HISTOGRAM_BUCKETS - 1;
+    return ((iBit - STAM_HISTOGRAM_SUB_SHIFT + 1) << STAM_HISTOGRAM_SUB_SHIFT)
+         | (unsigned)((uValue >> (iBit - STAM_HISTOGRAM_SUB_SHIFT)) & (STAM_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+/**
+ * Gets the smallest value falling into a histogram bucket.
+ *
+ * @returns The lower bound.
+ * @param   iBucket     The bucket index.
+ */
+DECLINLINE(uint64_t) STAMHistogramBucketLow(unsigned iBucket)
+{
+    unsigned const iGroup = iBucket >> STAM_HISTOGRAM_SUB_SHIFT;
+    unsigned const iSub   = iBucket & (STAM_HISTOGRAM_SUB_BUCKETS - 1);
+    if (!iGroup)
+        return iSub;
+    return (uint64_t)(STAM_HISTOGRAM_SUB_BUCKETS + iSub) << (iGroup - 1);
+}
+
+
+/**
+ * Records a value in a histogram.
+ *
+ * This only uses atomic operations and can be used concurrently from any
+ * context.
+ *
+ * @param   pHist       The histogram.
+ * @param   uValue      The value, typically a latency in nanoseconds.
+ */
+DECLINLINE(void) STAMHistogramAdd(PSTAMHISTOGRAM pHist, uint64_t uValue)
+{
+    uint64_t u64;
+
+    ASMAtomicIncU64(&pHist->aBuckets[STAMHistogramIndex(uValue)]);
+    ASMAtomicIncU64(&pHist->Core.cPeriods);
+    ASMAtomicAddU64(&pHist->Core.cTicks, uValue);
+
+    u64 = ASMAtomicUoReadU64(&pHist->Core.cTicksMax);
+    while (u64 < uValue && !ASMAtomicCmpXchgU64(&pHist->Core.cTicksMax, uValue, u64))
+        u64 = ASMAtomicUoReadU64(&pHist->Core.cTicksMax);
+    u64 = ASMAtomicUoReadU64(&pHist->Core.cTicksMin);
+    while (u64 > uValue && !ASMAtomicCmpXchgU64(&pHist->Core.cTicksMin, uValue, u64))
+        u64 = ASMAtomicUoReadU64(&pHist->Core.cTicksMin);
+}
+
+
+/** @def STAM_REL_HISTOGRAM_ADD
+ * Records a value in a histogram sample.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   uValue      The value to record.
+ */
+#ifndef VBOX_WITHOUT_RELEASE_STATISTICS
+# define STAM_REL_HISTOGRAM_ADD(pHist, uValue)  STAMHistogramAdd(pHist, uValue)
+#else
+# define STAM_REL_HISTOGRAM_ADD(pHist, uValue)  do { } while (0)
+#endif
+/** @def STAM_HISTOGRAM_ADD
+ * Records a value in a histogram sample.
+ *
+ * @param   pHist       Pointer to the STAMHISTOGRAM structure to operate on.
+ * @param   uValue      The value to record.
+ */
+#ifdef VBOX_WITH_STATISTICS
+# define STAM_HISTOGRAM_ADD(pHist, uValue)      STAM_REL_HISTOGRAM_ADD(pHist, uValue)
+#else
+# define STAM_HISTOGRAM_ADD(pHist, uValue)      do { } while (0)
+#endif
+
+
 /** @def STAM_REL_PROFILE_ADV_START
  * Samples the start time of a profiling period.
  *
@@ -1102,6 +1229,7 @@ typedef const STAMRATIOU32 *PCSTAMRATIOU32;
 
 VMMR3DECL(int)  STAMR3InitUVM(PUVM pUVM);
 VMMR3DECL(void) STAMR3TermUVM(PUVM pUVM);
+VMMR3_INT_DECL(void) STAMR3InitCompleted(PVM pVM);
 VMMR3DECL(int)  STAMR3RegisterU(PUVM pUVM, void *pvSample, STAMTYPE enmType, STAMVISIBILITY enmVisibility,
                                 const char *pszName, STAMUNIT enmUnit, const char *pszDesc);
 VMMR3DECL(int)  STAMR3Register(PVM pVM, void *pvSample, STAMTYPE enmType, STAMVISIBILITY enmVisibility,
@@ -1232,6 +1360,89 @@ typedef FNSTAMR3ENUM *PFNSTAMR3ENUM;
 VMMR3DECL(int)  STAMR3Enum(PUVM pUVM, const char *pszPat, PFNSTAMR3ENUM pfnEnum, void *pvUser);
 VMMR3DECL(const char *) STAMR3GetUnit(STAMUNIT enmUnit);
 
+
+/** @defgroup grp_stam_r3_bin   Binary Snapshots
+ *
+ * A binary snapshot stream is a sequence of frames, each starting with a
+ * STAMBINHDR.  The header is followed by STAMBINHDR::cSchemas schema records
+ * and then STAMBINHDR::cValues value records.  All integers in the records
+ * are unsigned LEB128 varints unless noted otherwise.
+ *
+ * Every sample has a numeric ID which is assigned at registration time and
+ * stays the same for as long as the sample is registered.  A schema record
+ * describes an ID the first time it appears in the stream:
+ *      - varint    ID
+ *      - uint8_t   STAMTYPE
+ *      - uint8_t   STAMUNIT
+ *      - uint8_t   STAMVISIBILITY
+ *      - varint    name length, followed by the name (no terminator)
+ *      - varint    description length, followed by the description.
+ *
+ * A value record is the varint ID followed by the sample values, each
+ * encoded as the zigzag varint of the difference to the value the previous
+ * frame had for that ID (zero for IDs new to the reader).  Counters, integer
+ * and boolean samples have one value, ratios have two (A, B) and profiles
+ * four (cPeriods, cTicks, cTicksMin, cTicksMax).  Histograms have the four
+ * profile values followed by the varint number of changed buckets and, for
+ * each of those, the varint distance to the previous changed bucket index
+ * (the first is relative to zero) and the zigzag varint bucket delta.
+ * Callback samples carry a varint length and the text returned by the print
+ * callback instead.
+ * Samples which did not change since the previous frame are omitted.
+ *
+ * A key frame (STAMBIN_F_KEYFRAME) resets the reader: it describes every
+ * sample matching the pattern and its values are relative to zero.  A key
+ * frame is forced after samples have been deregistered.
+ *
+ * @{
+ */
+
+/** Magic value of STAMBINHDR::u32Magic ('STAB'). */
+#define STAMBIN_MAGIC               UINT32_C(0x42415453)
+/** The current binary snapshot format version. */
+#define STAMBIN_VERSION             1
+/** Key frame, the reader shall discard its schema and values. */
+#define STAMBIN_F_KEYFRAME          UINT16_C(0x0001)
+
+/**
+ * Binary snapshot frame header (host byte order).
+ */
+typedef struct STAMBINHDR
+{
+    /** Magic value (STAMBIN_MAGIC). */
+    uint32_t    u32Magic;
+    /** The format version (STAMBIN_VERSION). */
+    uint16_t    uVersion;
+    /** STAMBIN_F_XXX. */
+    uint16_t    fFlags;
+    /** The size of the frame including this header. */
+    uint32_t    cbFrame;
+    /** Frame number within the stream, starting at zero. */
+    uint32_t    iFrame;
+    /** RTTimeNanoTS() at the time the snapshot was taken. */
+    uint64_t    u64NanoTS;
+    /** The number of schema records following the header. */
+    uint32_t    cSchemas;
+    /** The number of value records following the schema records. */
+    uint32_t    cValues;
+} STAMBINHDR;
+/** Pointer to a binary snapshot frame header. */
+typedef STAMBINHDR *PSTAMBINHDR;
+/** Pointer to a const binary snapshot frame header. */
+typedef STAMBINHDR const *PCSTAMBINHDR;
+
+/** Binary snapshot context (opaque). */
+typedef struct STAMR3BINCTX *PSTAMR3BINCTX;
+
+VMMR3DECL(int)  STAMR3BinCtxCreate(PUVM pUVM, const char *pszPat, PSTAMR3BINCTX *ppCtx);
+VMMR3DECL(void) STAMR3BinCtxDestroy(PSTAMR3BINCTX pCtx);
+VMMR3DECL(int)  STAMR3SnapshotBinary(PUVM pUVM, PSTAMR3BINCTX pCtx, bool fKeyFrame, const void **ppvFrame, size_t *pcbFrame);
+VMMR3DECL(int)  STAMR3SamplerStart(PUVM pUVM, const char *pszFilename, const char *pszPat, uint32_t cMsInterval,
+                                   uint32_t cKeyFrameInterval);
+VMMR3DECL(int)  STAMR3SamplerStop(PUVM pUVM);
+
+/** @} */
+
 /** @} */
 
 /** @} */
@@ -0,0 +1,245 @@
+/** @file
+ * IPRT - Binary (deferred format) log stream.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+#ifndef ___iprt_formats_logbin_h
+#define ___iprt_formats_logbin_h
+
+#include <iprt/types.h>
+#include <iprt/assert.h>
+
+
+/** @defgroup grp_rt_formats_logbin    Binary log stream
+ * @ingroup grp_rt_formats
+ *
+ * The binary log stream is written by a logger running in asynchronous mode
+ * (RTLOGFLAGS_ASYNC) with the RTLOGDEST_BINFILE destination.  Instead of the
+ * formatted text it contains the format strings (once) and the raw arguments
+ * of each log statement, packed by RTLogBinPackV.  The RTLogBinDump tool
+ * turns it back into text using RTLogBinFormat.
+ *
+ * The stream starts with a RTLOGBINHDR, followed by records which all start
+ * with a RTLOGBINREC and are 8 byte aligned.  Everything is stored in host
+ * endian, the header magic tells which one.
+ *
+ * @{
+ */
+
+/**
+ * Binary log stream header.
+ */
+typedef struct RTLOGBINHDR
+{
+    /** The magic (RTLOGBINHDR_MAGIC). */
+    char        szMagic[8];
+    /** The stream version (RTLOGBINHDR_VERSION). */
+    uint32_t    uVersion;
+    /** The size of this header. */
+    uint32_t    cbHdr;
+    /** Endian indicator, RTLOGBINHDR_ENDIAN in the writer's byte order. */
+    uint32_t    u32Endian;
+    /** The logger flags (RTLOGFLAGS_XXX) when the stream was opened. */
+    uint32_t    fLogFlags;
+    /** RTTimeNanoTS() value at program start, for the msprog and timeprog
+     * prefixes. */
+    uint64_t    u64NanoTSProgStart;
+    /** RTTimeNanoTS() value when the stream was opened. */
+    uint64_t    u64NanoTSStart;
+    /** The wall clock time (RTTimeSpecGetNano) matching u64NanoTSStart. */
+    int64_t     i64WallNanoStart;
+    /** The process ID. */
+    uint64_t    u64ProcessId;
+} RTLOGBINHDR;
+AssertCompileSize(RTLOGBINHDR, 56);
+/** Pointer to a binary log stream header. */
+typedef RTLOGBINHDR *PRTLOGBINHDR;
+/** Pointer to a const binary log stream header. */
+typedef RTLOGBINHDR const *PCRTLOGBINHDR;
+
+/** The binary log stream magic. */
+#define RTLOGBINHDR_MAGIC           "IPRTLOG"
+/** The current stream version. */
+#define RTLOGBINHDR_VERSION         UINT32_C(0x00010000)
+/** The endian indicator value. */
+#define RTLOGBINHDR_ENDIAN          UINT32_C(0x01020304)
+
+
+/**
+ * Common record header.
+ */
+typedef struct RTLOGBINREC
+{
+    /** The total record size, including this header and the alignment
+     * padding.  Always a multiple of 8. */
+    uint32_t    cbRec;
+    /** The record type (RTLOGBINREC_TYPE_XXX). */
+    uint16_t    uType;
+    /** Reserved, MBZ. */
+    uint16_t    u16Reserved;
+} RTLOGBINREC;
+AssertCompileSize(RTLOGBINREC, 8);
+/** Pointer to a record header. */
+typedef RTLOGBINREC *PRTLOGBINREC;
+/** Pointer to a const record header. */
+typedef RTLOGBINREC const *PCRTLOGBINREC;
+
+/** @name Record types.
+ * @{ */
+/** Format string definition, RTLOGBINFMT. */
+#define RTLOGBINREC_TYPE_FORMAT     UINT16_C(1)
+/** Group name definition, RTLOGBINGROUP. */
+#define RTLOGBINREC_TYPE_GROUP      UINT16_C(2)
+/** Thread definition, RTLOGBINTHREAD. */
+#define RTLOGBINREC_TYPE_THREAD     UINT16_C(3)
+/** Log statement with packed arguments, RTLOGBINMSG. */
+#define RTLOGBINREC_TYPE_MSG        UINT16_C(4)
+/** Log statement formatted by the caller, RTLOGBINMSG followed by the text. */
+#define RTLOGBINREC_TYPE_TEXT       UINT16_C(5)
+/** Records were dropped because a thread buffer was full, RTLOGBINDROPPED. */
+#define RTLOGBINREC_TYPE_DROPPED    UINT16_C(6)
+/** @} */
+
+
+/**
+ * Format string definition (RTLOGBINREC_TYPE_FORMAT).
+ *
+ * Emitted the first time a format string is seen, the zero terminated string
+ * follows the structure.
+ */
+typedef struct RTLOGBINFMT
+{
+    /** The record header. */
+    RTLOGBINREC Hdr;
+    /** The format ID used by the RTLOGBINMSG records. */
+    uint32_t    idFormat;
+    /** The length of the format string (excluding the terminator). */
+    uint32_t    cchFormat;
+} RTLOGBINFMT;
+AssertCompileSize(RTLOGBINFMT, 16);
+
+/**
+ * Group name definition (RTLOGBINREC_TYPE_GROUP).
+ *
+ * The zero terminated group name follows the structure.
+ */
+typedef struct RTLOGBINGROUP
+{
+    /** The record header. */
+    RTLOGBINREC Hdr;
+    /** The group number. */
+    uint32_t    iGroup;
+    /** The length of the name (excluding the terminator). */
+    uint32_t    cchName;
+} RTLOGBINGROUP;
+AssertCompileSize(RTLOGBINGROUP, 16);
+
+/**
+ * Thread definition (RTLOGBINREC_TYPE_THREAD).
+ *
+ * The zero terminated thread name follows the structure.
+ */
+typedef struct RTLOGBINTHREAD
+{
+    /** The record header. */
+    RTLOGBINREC Hdr;
+    /** The thread ID used by the RTLOGBINMSG records. */
+    uint32_t    idThread;
+    /** The length of the name (excluding the terminator). */
+    uint32_t    cchName;
+    /** The native thread handle. */
+    uint64_t    u64NativeThread;
+} RTLOGBINTHREAD;
+AssertCompileSize(RTLOGBINTHREAD, 24);
+
+/**
+ * Log statement (RTLOGBINREC_TYPE_MSG and RTLOGBINREC_TYPE_TEXT).
+ *
+ * For RTLOGBINREC_TYPE_MSG the arguments packed by RTLogBinPackV follow,
+ * for RTLOGBINREC_TYPE_TEXT the formatted text (cbData bytes, no
+ * terminator).
+ */
+typedef struct RTLOGBINMSG
+{
+    /** The record header. */
+    RTLOGBINREC Hdr;
+    /** The format ID, UINT32_MAX for RTLOGBINREC_TYPE_TEXT. */
+    uint32_t    idFormat;
+    /** The thread ID. */
+    uint32_t    idThread;
+    /** The group, ~0U if none. */
+    uint32_t    iGroup;
+    /** The group flags of the log statement (RTLOGGRPFLAGS_XXX). */
+    uint32_t    fGrpFlags;
+    /** RTTimeNanoTS() when the statement was logged. */
+    uint64_t    u64NanoTS;
+    /** The TSC when the statement was logged (RTTimeNanoTS on non-x86). */
+    uint64_t    u64Tsc;
+    /** The CPU (APIC) ID the statement was logged on. */
+    uint32_t    idCpu;
+    /** The size of the data following the structure. */
+    uint32_t    cbData;
+} RTLOGBINMSG;
+AssertCompileSize(RTLOGBINMSG, 48);
+
+/**
+ * Dropped records (RTLOGBINREC_TYPE_DROPPED).
+ */
+typedef struct RTLOGBINDROPPED
+{
+    /** The record header. */
+    RTLOGBINREC Hdr;
+    /** The thread ID. */
+    uint32_t    idThread;
+    /** The number of records dropped. */
+    uint32_t    cDropped;
+} RTLOGBINDROPPED;
+AssertCompileSize(RTLOGBINDROPPED, 16);
+
+
+/** @name Packed arguments.
+ *
+ * The arguments are stored in the order the format string consumes them,
+ * each entry 8 byte aligned:
+ *      - Integers, characters, pointers, '*' widths and precisions and the
+ *        scalar IPRT types are stored as a 64-bit value, sign extended when
+ *        the type is signed.
+ *      - Strings are stored as a 32-bit length, followed by the string and a
+ *        terminator, padded to 8 bytes.  Strings longer than
+ *        RTLOGBIN_MAX_STR make RTLogBinPackV fail with VERR_BUFFER_OVERFLOW.
+ *
+ * Format specifiers which cannot be captured by value (%M, %N, %R[type],
+ * %ls and the IPRT types dereferencing pointers) make RTLogBinPackV fail
+ * with VERR_NOT_SUPPORTED.
+ * @{ */
+/** The max string length stored for a %s argument. */
+#define RTLOGBIN_MAX_STR            1024
+/** Alignment of the packed argument entries. */
+#define RTLOGBIN_ARG_ALIGN          8
+/** @} */
+
+/** @} */
+
+#endif
+
@@ -360,6 +360,16 @@ typedef enum RTLOGFLAGS
     RTLOGFLAGS_FLUSH                = 0x00000200,
     /** Restrict the number of log entries per group. */
     RTLOGFLAGS_RESTRICT_GROUPS      = 0x00000400,
+    /** Defer the formatting and output to a background thread (ring-3 only).
+     * Each logging thread gets a private buffer for the raw arguments.  Since
+     * only the format string pointer is recorded, the logger must be flushed
+     * before a module is unloaded.  RTLdrClose does this for the default
+     * loggers, other loggers are up to their owner.  The per-thread buffers
+     * are limited in number, further threads log synchronously. */
+    RTLOGFLAGS_ASYNC                = 0x00000800,
+    /** Drop log records instead of waiting when the asynchronous buffer of
+     * the logging thread is full. */
+    RTLOGFLAGS_ASYNC_LOSSY          = 0x00001000,
     /** New lines should be prefixed with the write and read lock counts. */
     RTLOGFLAGS_PREFIX_LOCK_COUNTS   = 0x00008000,
     /** New lines should be prefixed with the CPU id (ApicID on intel/amd). */
@@ -459,6 +469,8 @@ typedef enum RTLOGDEST
     RTLOGDEST_COM           = 0x00000010,
     /** Log a memory ring buffer. */
     RTLOGDEST_RINGBUF       = 0x00000020,
+    /** Write a binary log stream (needs RTLOGFLAGS_ASYNC, ring-3 only). */
+    RTLOGDEST_BINFILE       = 0x00000040,
     /** Just a dummy flag to be used when no other flag applies. */
     RTLOGDEST_DUMMY         = 0x20000000,
     /** Log to a user defined output stream. */
@@ -2050,6 +2062,38 @@ typedef FNRTSTROUTPUT *PFNRTSTROUTPUT;
  */
 RTDECL(size_t) RTLogFormatV(PFNRTSTROUTPUT pfnOutput, void *pvArg, const char *pszFormat, va_list args);
 
+#ifdef IN_RING3
+/**
+ * Packs the arguments of a log statement for deferred formatting.
+ *
+ * See @ref grp_rt_formats_logbin for the layout of the packed arguments.
+ *
+ * @returns IPRT status code.
+ * @retval  VERR_NOT_SUPPORTED if the format string uses a specifier which
+ *          cannot be captured by value.
+ * @retval  VERR_BUFFER_OVERFLOW if the arguments don't fit into the buffer
+ *          or a string argument is longer than RTLOGBIN_MAX_STR.
+ * @param   pvBuf       Where to store the packed arguments.
+ * @param   cbBuf       The size of the buffer.
+ * @param   pcbPacked   Where to return the number of bytes used.
+ * @param   pszFormat   Format string.
+ * @param   args        Format arguments.
+ */
+RTDECL(int) RTLogBinPackV(void *pvBuf, size_t cbBuf, size_t *pcbPacked, const char *pszFormat, va_list args);
+
+/**
+ * Formats arguments packed by RTLogBinPackV.
+ *
+ * @returns number of bytes formatted.
+ * @param   pfnOutput   Output worker, see RTLogFormatV.
+ * @param   pvArg       Argument to output worker.
+ * @param   pszFormat   The format string the arguments were packed with.
+ * @param   pvArgs      The packed arguments.
+ * @param   cbArgs      The size of the packed arguments.
+ */
+RTDECL(size_t) RTLogBinFormat(PFNRTSTROUTPUT pfnOutput, void *pvArg, const char *pszFormat, const void *pvArgs, size_t cbArgs);
+#endif /* IN_RING3 */
+
 /**
  * Write log buffer to COM port.
  *
@@ -777,6 +777,8 @@
 # define RTLockValidatorWriteLockInc                    RT_MANGLER(RTLockValidatorWriteLockInc)
 # define RTLogBackdoorPrintf                            RT_MANGLER(RTLogBackdoorPrintf) /* r0drv-guest */
 # define RTLogBackdoorPrintfV                           RT_MANGLER(RTLogBackdoorPrintfV) /* r0drv-guest */
+# define RTLogBinFormat                                 RT_MANGLER(RTLogBinFormat)
+# define RTLogBinPackV                                  RT_MANGLER(RTLogBinPackV)
 # define RTLogCalcSizeForR0                             RT_MANGLER(RTLogCalcSizeForR0)
 # define RTLogCloneRC                                   RT_MANGLER(RTLogCloneRC)
 # define RTLogComPrintf                                 RT_MANGLER(RTLogComPrintf)
@@ -1056,6 +1056,7 @@ VBoxDbgStatsModel::initNode(PDBGGUISTATSNODE pNode, STAMTYPE enmType, void *pvSa
 
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             pNode->Data.Profile = *(PSTAMPROFILE)pvSample;
             break;
 
@@ -1154,6 +1155,7 @@ VBoxDbgStatsModel::updateNode(PDBGGUISTATSNODE pNode, STAMTYPE enmType, void *pv
 
             case STAMTYPE_PROFILE:
             case STAMTYPE_PROFILE_ADV:
+            case STAMTYPE_HISTOGRAM:
             {
                 uint64_t cPrevPeriods = pNode->Data.Profile.cPeriods;
                 pNode->Data.Profile = *(PSTAMPROFILE)pvSample;
@@ -2159,6 +2161,7 @@ VBoxDbgStatsModel::strValueTimes(PCDBGGUISTATSNODE pNode)
 
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             return formatNumber(sz, pNode->Data.Profile.cPeriods);
@@ -2229,6 +2232,7 @@ VBoxDbgStatsModel::strMinValue(PCDBGGUISTATSNODE pNode)
     {
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             return formatNumber(sz, pNode->Data.Profile.cTicksMin);
@@ -2247,6 +2251,7 @@ VBoxDbgStatsModel::strAvgValue(PCDBGGUISTATSNODE pNode)
     {
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             return formatNumber(sz, pNode->Data.Profile.cTicks / pNode->Data.Profile.cPeriods);
@@ -2265,6 +2270,7 @@ VBoxDbgStatsModel::strMaxValue(PCDBGGUISTATSNODE pNode)
     {
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             return formatNumber(sz, pNode->Data.Profile.cTicksMax);
@@ -2283,6 +2289,7 @@ VBoxDbgStatsModel::strTotalValue(PCDBGGUISTATSNODE pNode)
     {
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             return formatNumber(sz, pNode->Data.Profile.cTicks);
@@ -2301,6 +2308,7 @@ VBoxDbgStatsModel::strDeltaValue(PCDBGGUISTATSNODE pNode)
     {
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             if (!pNode->Data.Profile.cPeriods)
                 return "0";
             /* fall thru */
@@ -2425,6 +2433,7 @@ VBoxDbgStatsModel::stringifyNodeNoRecursion(PDBGGUISTATSNODE a_pNode, QString &a
 
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
         {
             uint64_t u64 = a_pNode->Data.Profile.cPeriods ? a_pNode->Data.Profile.cPeriods : 1;
             RTStrPrintf(szBuf, sizeof(szBuf),
@@ -49,6 +49,7 @@
 
 #define VNET_PCI_SUBSYSTEM_ID        1 + VIRTIO_NET_ID
 #define VNET_PCI_CLASS               0x0200
+/** Number of queues without multiqueue support (RX, TX and CTL). */
 #define VNET_N_QUEUES                3
 #define VNET_NAME_FMT                "VNet%d"
 
@@ -65,10 +66,11 @@
 #endif /* VBOX_DEVICE_STRUCT_TESTCASE */
 
 
-#define VNET_TX_DELAY           150   /**< 150 microseconds */
 #define VNET_MAX_FRAME_SIZE     65535 + 18  /**< Max IP packet size + Ethernet header with VLAN tag */
 #define VNET_MAC_FILTER_LEN     32
 #define VNET_MAX_VID            (1 << 12)
+#define VNET_MAX_QUEUE_PAIRS    8     /**< (VIRTIO_MAX_NQUEUES - 1) / 2 */
+#define VNET_FLOW_TABLE_SIZE    256   /**< Number of flow hash buckets used for RX steering */
 
 /** @name Virtio net features
  * @{  */
@@ -89,6 +91,7 @@
 #define VNET_F_CTRL_VQ    0x00020000  /**< Control channel available */
 #define VNET_F_CTRL_RX    0x00040000  /**< Control channel RX mode support */
 #define VNET_F_CTRL_VLAN  0x00080000  /**< Control channel VLAN filtering */
+#define VNET_F_MQ         0x00400000  /**< Multiple queue pairs with automatic RX steering */
 /** @} */
 
 #define VNET_S_LINK_UP    1
@@ -105,8 +108,42 @@ struct __attribute__ ((__packed__)) VNetPCIConfig /** @todo r=bird: Use #pragma
 {
     RTMAC    mac;
     uint16_t uStatus;
+    uint16_t uMaxVirtqueuePairs;
 };
 AssertCompileMemberOffset(struct VNetPCIConfig, uStatus, 6);
+AssertCompileMemberOffset(struct VNetPCIConfig, uMaxVirtqueuePairs, 8);
+
+/**
+ * Queue pair state.
+ *
+ * Each pair has its own transmit worker thread so that guests spreading their
+ * traffic over several queues do not serialize on a single transmitter.
+ */
+typedef struct VNetQueuePair_st
+{
+    /** @name Statistic
+     * @{ */
+    STAMCOUNTER             StatReceivePackets;
+    STAMCOUNTER             StatReceiveBytes;
+    STAMCOUNTER             StatTransmitPackets;
+    STAMCOUNTER             StatTransmitBytes;
+    STAMCOUNTER             StatTransmitKicks;
+    /** @}  */
+
+    R3PTRTYPE(PVQUEUE)      pRxQueue;
+    R3PTRTYPE(PVQUEUE)      pTxQueue;
+    /** The transmit worker thread. */
+    R3PTRTYPE(PPDMTHREAD)   pTxThread;
+    /** Signalled when there is work for the transmit worker. */
+    RTSEMEVENT              hEventTx;
+    /** Indicates transmission in progress -- only one thread is allowed. */
+    uint32_t volatile       uIsTransmitting;
+    /** Set when the transmit worker has to look at the TX queue. */
+    bool volatile           fTxPending;
+    bool                    afAlignment[3];
+} VNETQUEUEPAIR;
+/** Pointer to a queue pair. */
+typedef VNETQUEUEPAIR *PVNETQUEUEPAIR;
 
 /**
  * Device state structure. Holds the current state of device.
@@ -136,29 +173,10 @@ typedef struct VNetState_st
 
     /**< Link Up(/Restore) Timer. */
     PTMTIMERR3              pLinkUpTimer;
-
-#ifdef VNET_TX_DELAY
-    /**< Transmit Delay Timer - R3. */
-    PTMTIMERR3              pTxTimerR3;
-    /**< Transmit Delay Timer - R0. */
-    PTMTIMERR0              pTxTimerR0;
-    /**< Transmit Delay Timer - GC. */
-    PTMTIMERRC              pTxTimerRC;
-
-# if HC_ARCH_BITS == 64
+# if HC_ARCH_BITS != 64
     uint32_t                padding2;
 # endif
 
-    uint32_t                u32i;
-    uint32_t                u32AvgDiff;
-    uint32_t                u32MinDiff;
-    uint32_t                u32MaxDiff;
-    uint64_t                u64NanoTS;
-#endif /* VNET_TX_DELAY */
-
-    /** Indicates transmission in progress -- only one thread is allowed. */
-    uint32_t                uIsTransmitting;
-
     /** PCI config area holding MAC address as well as TBD. */
     struct VNetPCIConfig    config;
     /** MAC address obtained from the configuration. */
@@ -187,13 +205,26 @@ typedef struct VNetState_st
     /** Bit array of VLAN filter, one bit per VLAN ID. */
     uint8_t                 aVlanFilter[VNET_MAX_VID / sizeof(uint8_t)];
 
-    R3PTRTYPE(PVQUEUE)      pRxQueue;
-    R3PTRTYPE(PVQUEUE)      pTxQueue;
-    R3PTRTYPE(PVQUEUE)      pCtlQueue;
+    /** Number of queue pairs the device offers (from the configuration). */
+    uint16_t                cMaxQueuePairs;
+    /** Number of queue pairs enabled by the guest. */
+    uint16_t volatile       cCurQueuePairs;
+    /** Maps flow hashes to the queue pair the flow was last transmitted on. */
+    uint8_t                 au8FlowToPair[VNET_FLOW_TABLE_SIZE];
+    /** Bitmap of the queue pairs whose transmit worker found the driver busy
+     * and waits for the current transmitter to finish. */
+    uint32_t volatile       fTxWaitingPairs;
+
     /* Receive-blocking-related fields ***************************************/
 
     /** EMT: Gets signalled when more RX descriptors become available. */
     RTSEMEVENT              hEventMoreRxDescAvail;
+# if HC_ARCH_BITS != 64
+    uint32_t                padding3;
+# endif
+
+    /** The RX/TX queue pairs. */
+    VNETQUEUEPAIR           aQueuePairs[VNET_MAX_QUEUE_PAIRS];
 
     /** @name Statistic
      * @{ */
@@ -265,6 +296,9 @@ typedef uint8_t VNETCTLACK;
 #define VNET_CTRL_CMD_VLAN_ADD         0
 #define VNET_CTRL_CMD_VLAN_DEL         1
 
+#define VNET_CTRL_CLS_MQ               4
+#define VNET_CTRL_CMD_MQ_VQ_PAIRS_SET  0
+
 
 struct VNetCtlHdr
 {
@@ -281,6 +315,55 @@ DECLINLINE(bool) vnetMergeableRxBuffers(PVNETSTATE pThis)
     return !!(pThis->VPCI.uGuestFeatures & VNET_F_MRG_RXBUF);
 }
 
+/** Returns true if the guest has negotiated multiple queue pairs. */
+DECLINLINE(bool) vnetMultiQueue(PVNETSTATE pThis)
+{
+    return !!(pThis->VPCI.uGuestFeatures & VNET_F_MQ);
+}
+
+/**
+ * Returns the control queue.
+ *
+ * The queues are laid out as RX0, TX0, RX1, TX1, ... and the control queue
+ * follows the last pair, see vnetGuestQueueIndex for guests which did not
+ * negotiate VNET_F_MQ.
+ */
+DECLINLINE(PVQUEUE) vnetCtlQueue(PVNETSTATE pThis)
+{
+    return &pThis->VPCI.Queues[2 * pThis->cMaxQueuePairs];
+}
+
+/**
+ * Translates a queue index between the guest and the device view.
+ *
+ * Guests which did not negotiate VNET_F_MQ only know about the first pair and
+ * expect the control queue to be the third queue. It lives behind the last
+ * pair however, so the third and the last queue swap places for them. The
+ * mapping is its own inverse.
+ *
+ * @returns The translated queue index.
+ * @param   pThis      The device state structure.
+ * @param   uQueue     The queue index to translate.
+ */
+DECLINLINE(uint32_t) vnetGuestQueueIndex(PVNETSTATE pThis, uint32_t uQueue)
+{
+    if (   pThis->cMaxQueuePairs > 1
+        && !vnetMultiQueue(pThis))
+    {
+        if (uQueue == 2)
+            return 2 * pThis->cMaxQueuePairs;
+        if (uQueue == 2U * pThis->cMaxQueuePairs)
+            return 2;
+    }
+    return uQueue;
+}
+
+/** Returns the queue pair the given RX or TX queue belongs to. */
+DECLINLINE(PVNETQUEUEPAIR) vnetQueuePair(PVNETSTATE pThis, PVQUEUE pQueue)
+{
+    return &pThis->aQueuePairs[(pQueue - &pThis->VPCI.Queues[0]) / 2];
+}
+
 DECLINLINE(int) vnetCsEnter(PVNETSTATE pThis, int rcBusy)
 {
     return vpciCsEnter(&pThis->VPCI, rcBusy);
@@ -354,7 +437,10 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
         { VNET_F_STATUS,     "virtio_net_config.status available" },
         { VNET_F_CTRL_VQ,    "control channel available" },
         { VNET_F_CTRL_RX,    "control channel RX mode support" },
-        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" }
+        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" },
+        { VNET_F_MQ,         "multiple queue pairs" },
+        { VPCI_F_RING_INDIRECT_DESC, "indirect descriptors" },
+        { VPCI_F_RING_EVENT_IDX,     "event index notification suppression" }
     };
 
     Log3(("%s %s:\n", INSTANCE(pThis), pcszText));
@@ -368,6 +454,8 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
 
 static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
 {
+    PVNETSTATE pThis = (PVNETSTATE)pvState;
+
     /* We support:
      * - Host-provided MAC address
      * - Link status reporting in config space
@@ -375,8 +463,10 @@ static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
      * - RX mode setting
      * - MAC filter table
      * - VLAN filter
+     * - Multiple queue pairs, if configured
      */
-    return VNET_F_MAC
+    return (pThis->cMaxQueuePairs > 1 ? VNET_F_MQ : 0)
+        | VNET_F_MAC
         | VNET_F_STATUS
         | VNET_F_CTRL_VQ
         | VNET_F_CTRL_RX
@@ -472,7 +562,12 @@ static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
     pThis->nMacFilterEntries = 0;
     memset(pThis->aMacFilter,  0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
     memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
-    pThis->uIsTransmitting   = 0;
+
+    /* Only the first queue pair is used until the guest asks for more. */
+    pThis->cCurQueuePairs    = 1;
+    memset(pThis->au8FlowToPair, 0xFF, sizeof(pThis->au8FlowToPair));
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+        pThis->aQueuePairs[i].uIsTransmitting = 0;
 #ifndef IN_RING3
     return VINF_IOM_R3_IOPORT_WRITE;
 #else
@@ -595,7 +690,12 @@ static const VPCIIOCALLBACKS g_IOCallbacks =
  */
 PDMBOTHCBDECL(int) vnetIOPortIn(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port, uint32_t *pu32, unsigned cb)
 {
-    return vpciIOPortIn(pDevIns, pvUser, port, pu32, cb, &g_IOCallbacks);
+    PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    int rc = vpciIOPortIn(pDevIns, pvUser, port, pu32, cb, &g_IOCallbacks);
+    if (   rc == VINF_SUCCESS
+        && port - pThis->VPCI.IOPortBase == VPCI_QUEUE_SEL)
+        *(uint16_t *)pu32 = (uint16_t)vnetGuestQueueIndex(pThis, *(uint16_t *)pu32);
+    return rc;
 }
 
 
@@ -604,6 +704,11 @@ PDMBOTHCBDECL(int) vnetIOPortIn(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port,
  */
 PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port, uint32_t u32, unsigned cb)
 {
+    PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    RTIOPORT   offPort = port - pThis->VPCI.IOPortBase;
+    if (   offPort == VPCI_QUEUE_SEL
+        || offPort == VPCI_QUEUE_NOTIFY)
+        u32 = vnetGuestQueueIndex(pThis, u32 & 0xffff);
     return vpciIOPortOut(pDevIns, pvUser, port, u32, cb, &g_IOCallbacks);
 }
 
@@ -619,27 +724,28 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port
  *          It disables notification if it can receive.
  *
  * @returns VERR_NET_NO_BUFFER_SPACE if it cannot.
- * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+ * @param   pThis           The device state structure.
+ * @param   pRxQueue        The receive queue to check.
  * @thread  RX
  */
-static int vnetCanReceive(PVNETSTATE pThis)
+static int vnetCanReceive(PVNETSTATE pThis, PVQUEUE pRxQueue)
 {
     int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
     AssertRCReturn(rc, rc);
 
-    LogFlow(("%s vnetCanReceive\n", INSTANCE(pThis)));
+    LogFlow(("%s vnetCanReceive: %s\n", INSTANCE(pThis), pRxQueue->pcszName));
     if (!(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (!vqueueIsReady(&pThis->VPCI, pThis->pRxQueue))
+    else if (!vqueueIsReady(&pThis->VPCI, pRxQueue))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (vqueueIsEmpty(&pThis->VPCI, pThis->pRxQueue))
+    else if (vqueueIsEmpty(&pThis->VPCI, pRxQueue))
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, true);
+        vqueueSetNotification(&pThis->VPCI, pRxQueue, true);
         rc = VERR_NET_NO_BUFFER_SPACE;
     }
     else
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, false);
+        vqueueSetNotification(&pThis->VPCI, pRxQueue, false);
         rc = VINF_SUCCESS;
     }
 
@@ -648,6 +754,22 @@ static int vnetCanReceive(PVNETSTATE pThis)
     return rc;
 }
 
+/**
+ * Check if any of the enabled receive queues can take a packet now.
+ *
+ * @returns VERR_NET_NO_BUFFER_SPACE if none can.
+ * @param   pThis           The device state structure.
+ * @thread  RX
+ */
+static int vnetCanReceiveAny(PVNETSTATE pThis)
+{
+    int      rc     = VERR_NET_NO_BUFFER_SPACE;
+    unsigned cPairs = pThis->cCurQueuePairs;
+    for (unsigned i = 0; i < cPairs && RT_FAILURE(rc); i++)
+        rc = vnetCanReceive(pThis, pThis->aQueuePairs[i].pRxQueue);
+    return rc;
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnWaitReceiveAvail}
  */
@@ -655,7 +777,7 @@ static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInte
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
     LogFlow(("%s vnetNetworkDown_WaitReceiveAvail(cMillies=%u)\n", INSTANCE(pThis), cMillies));
-    int rc = vnetCanReceive(pThis);
+    int rc = vnetCanReceiveAny(pThis);
 
     if (RT_SUCCESS(rc))
         return VINF_SUCCESS;
@@ -670,7 +792,7 @@ static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInte
     while (RT_LIKELY(   (enmVMState = PDMDevHlpVMState(pThis->VPCI.CTX_SUFF(pDevIns))) == VMSTATE_RUNNING
                      ||  enmVMState == VMSTATE_RUNNING_LS))
     {
-        int rc2 = vnetCanReceive(pThis);
+        int rc2 = vnetCanReceiveAny(pThis);
         if (RT_SUCCESS(rc2))
         {
             rc = VINF_SUCCESS;
@@ -769,6 +891,112 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
     return false;
 }
 
+/**
+ * Calculates a hash identifying the flow an ethernet frame belongs to.
+ *
+ * The hash is symmetric, i.e. both directions of a connection produce the
+ * same value, so frames received for a flow can be steered to the queue pair
+ * the guest transmits the flow on.
+ *
+ * @returns The flow hash, 0 if the frame carries neither IPv4 nor IPv6.
+ * @param   pvBuf           The ethernet frame.
+ * @param   cb              Number of bytes available in the frame.
+ */
+static uint32_t vnetFlowHash(const void *pvBuf, size_t cb)
+{
+    const uint8_t *pbFrame = (const uint8_t *)pvBuf;
+    size_t         off     = sizeof(RTNETETHERHDR);
+    uint32_t       uHash   = 0;
+    uint8_t        bProto;
+
+    if (cb < off)
+        return 0;
+    uint16_t uEtherType = RT_BE2H_U16(((PCRTNETETHERHDR)pbFrame)->EtherType);
+    if (uEtherType == RTNET_ETHERTYPE_VLAN)
+    {
+        if (cb < off + 4)
+            return 0;
+        uEtherType = RT_BE2H_U16(*(uint16_t const *)(pbFrame + off + 2));
+        off += 4;
+    }
+
+    if (uEtherType == RTNET_ETHERTYPE_IPV4)
+    {
+        if (cb < off + RTNETIPV4_MIN_LEN)
+            return 0;
+        PCRTNETIPV4 pIpHdr = (PCRTNETIPV4)(pbFrame + off);
+        uHash  = pIpHdr->ip_src.u ^ pIpHdr->ip_dst.u;
+        bProto = pIpHdr->ip_p;
+        /* Only the first fragment has the ports, keep all fragments together. */
+        if (RT_BE2H_U16(pIpHdr->ip_off) & (RTNETIPV4_FLAGS_MF | 0x1fff))
+            bProto = 0;
+        off += pIpHdr->ip_hl * 4;
+    }
+    else if (uEtherType == RTNET_ETHERTYPE_IPV6)
+    {
+        if (cb < off + RTNETIPV6_MIN_LEN)
+            return 0;
+        PCRTNETIPV6 pIpHdr = (PCRTNETIPV6)(pbFrame + off);
+        for (unsigned i = 0; i < RT_ELEMENTS(pIpHdr->ip6_src.au32); i++)
+            uHash ^= pIpHdr->ip6_src.au32[i] ^ pIpHdr->ip6_dst.au32[i];
+        bProto = pIpHdr->ip6_nxt;
+        off += RTNETIPV6_MIN_LEN;
+    }
+    else
+        return 0;
+
+    if (   (bProto == RTNETIPV4_PROT_TCP || bProto == RTNETIPV4_PROT_UDP)
+        && cb >= off + 2 * sizeof(uint16_t))
+    {
+        /* The source and destination ports come first in both TCP and UDP headers. */
+        uint16_t const *pu16Ports = (uint16_t const *)(pbFrame + off);
+        uHash ^= (uint32_t)(pu16Ports[0] ^ pu16Ports[1]) * UINT32_C(0x10001);
+    }
+    uHash ^= bProto;
+
+    /* Spread the entropy over the low bits used for indexing. */
+    uHash *= UINT32_C(0x9e3779b1);
+    return (uHash >> 16) | 1;
+}
+
+/**
+ * Selects the queue pair a received frame is delivered to.
+ *
+ * Frames of a flow go to the queue pair the guest last transmitted the flow
+ * on, or to a pair picked by the flow hash if the flow is not known yet. If
+ * that pair has no receive buffers any other enabled pair will do.
+ *
+ * @returns Pointer to the queue pair, NULL if no receive queue has buffers.
+ * @param   pThis           The device state structure.
+ * @param   pvBuf           The ethernet frame.
+ * @param   cb              Number of bytes available in the frame.
+ * @thread  RX
+ */
+static PVNETQUEUEPAIR vnetRxSelectQueuePair(PVNETSTATE pThis, const void *pvBuf, size_t cb)
+{
+    unsigned cPairs = pThis->cCurQueuePairs;
+    unsigned iPair  = 0;
+
+    if (cPairs > 1)
+    {
+        uint32_t uHash = vnetFlowHash(pvBuf, cb);
+        if (uHash)
+        {
+            iPair = pThis->au8FlowToPair[uHash % VNET_FLOW_TABLE_SIZE];
+            if (iPair >= cPairs)
+                iPair = uHash % cPairs;
+        }
+    }
+
+    for (unsigned i = 0; i < cPairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[(iPair + i) % cPairs];
+        if (RT_SUCCESS(vnetCanReceive(pThis, pPair->pRxQueue)))
+            return pPair;
+    }
+    return NULL;
+}
+
 /**
  * Pad and store received packet.
  *
@@ -777,11 +1005,12 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
  *
  * @returns VBox status code.
  * @param   pThis          The device state structure.
+ * @param   pRxQueue        The receive queue to store the packet in.
  * @param   pvBuf           The available data.
  * @param   cb              Number of bytes available in the buffer.
  * @thread  RX
  */
-static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
+static int vnetHandleRxPacket(PVNETSTATE pThis, PVQUEUE pRxQueue, const void *pvBuf, size_t cb,
                               PCPDMNETWORKGSO pGso)
 {
     VNETHDRMRX   Hdr;
@@ -836,7 +1065,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
         VQUEUEELEM elem;
         unsigned int nSeg = 0, uElemSize = 0, cbReserved = 0;
 
-        if (!vqueueGet(&pThis->VPCI, pThis->pRxQueue, &elem))
+        if (!vqueueGet(&pThis->VPCI, pRxQueue, &elem))
         {
             /*
              * @todo: It is possible to run out of RX buffers if only a few
@@ -880,7 +1109,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             uElemSize += uSize;
         }
         STAM_PROFILE_START(&pThis->StatReceiveStore, a);
-        vqueuePut(&pThis->VPCI, pThis->pRxQueue, &elem, uElemSize, cbReserved);
+        vqueuePut(&pThis->VPCI, pRxQueue, &elem, uElemSize, cbReserved);
         STAM_PROFILE_STOP(&pThis->StatReceiveStore, a);
         if (!vnetMergeableRxBuffers(pThis))
             break;
@@ -898,7 +1127,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             return rc;
         }
     }
-    vqueueSync(&pThis->VPCI, pThis->pRxQueue);
+    vqueueSync(&pThis->VPCI, pRxQueue);
     if (uOffset < cb)
     {
         Log(("%s vnetHandleRxPacket: Packet did not fit into RX queue (packet size=%u)!\n",
@@ -948,9 +1177,10 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
 
     Log2(("%s vnetNetworkDown_ReceiveGso: pvBuf=%p cb=%u pGso=%p\n",
           INSTANCE(pThis), pvBuf, cb, pGso));
-    int rc = vnetCanReceive(pThis);
-    if (RT_FAILURE(rc))
-        return rc;
+    PVNETQUEUEPAIR pPair = vnetRxSelectQueuePair(pThis, pvBuf, cb);
+    if (!pPair)
+        return VERR_NET_NO_BUFFER_SPACE;
+    int rc = VINF_SUCCESS;
 
     /* Drop packets if VM is not running or cable is disconnected. */
     VMSTATE enmVMState = PDMDevHlpVMState(pThis->VPCI.CTX_SUFF(pDevIns));
@@ -966,8 +1196,10 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
         rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
         if (RT_SUCCESS(rc))
         {
-            rc = vnetHandleRxPacket(pThis, pvBuf, cb, pGso);
+            rc = vnetHandleRxPacket(pThis, pPair->pRxQueue, pvBuf, cb, pGso);
             STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
+            STAM_REL_COUNTER_INC(&pPair->StatReceivePackets);
+            STAM_REL_COUNTER_ADD(&pPair->StatReceiveBytes, cb);
             vnetCsRxLeave(pThis);
         }
     }
@@ -1067,7 +1299,7 @@ static DECLCALLBACK(int) vnetSetLinkState(PPDMINETWORKCONFIG pInterface, PDMNETW
 static DECLCALLBACK(void) vnetQueueReceive(void *pvState, PVQUEUE pQueue)
 {
     PVNETSTATE pThis = (PVNETSTATE)pvState;
-    Log(("%s Receive buffers has been added, waking up receive thread.\n", INSTANCE(pThis)));
+    Log(("%s Receive buffers has been added to %s, waking up receive thread.\n", INSTANCE(pThis), pQueue->pcszName));
     vnetWakeupReceive(pThis->VPCI.CTX_SUFF(pDevIns));
 }
 
@@ -1138,21 +1370,49 @@ DECLINLINE(void) vnetCompleteChecksum(uint8_t *pBuf, unsigned cbSize, uint16_t u
     *(uint16_t*)(pBuf + uStart + uOffset) = vnetCSum16(pBuf + uStart, cbSize - uStart);
 }
 
-static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fOnWorkerThread)
+/**
+ * Wakes up the transmit worker of a queue pair.
+ *
+ * @param   pPair           The queue pair.
+ */
+static void vnetTxWakeup(PVNETQUEUEPAIR pPair)
+{
+    if (!ASMAtomicXchgBool(&pPair->fTxPending, true))
+        RTSemEventSignal(pPair->hEventTx);
+}
+
+/**
+ * Transmits the frames pending in the TX queue of a queue pair.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_SUCCESS if the TX queue has been drained.
+ * @retval  VERR_TRY_AGAIN if the driver is busy transmitting for another
+ *          queue pair, the pair is woken up once that one is done.
+ * @retval  VERR_NET_NO_BUFFER_SPACE if the driver ran out of buffers, it
+ *          calls pfnXmitPending once it has more.
+ * @retval  VERR_INVALID_PARAMETER if the guest queued a malformed frame.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair.
+ * @param   fOnWorkerThread Whether we're on a worker thread or an EMT.
+ */
+static int vnetTransmitPendingPackets(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
 {
+    PVQUEUE pQueue = pPair->pTxQueue;
+
     /*
      * Only one thread is allowed to transmit at a time, others should skip
      * transmission as the packets will be picked up by the transmitting
      * thread.
      */
-    if (!ASMAtomicCmpXchgU32(&pThis->uIsTransmitting, 1, 0))
-        return;
+    if (!ASMAtomicCmpXchgU32(&pPair->uIsTransmitting, 1, 0))
+        return VINF_SUCCESS;
 
     if ((pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0)
     {
         Log(("%s Ignoring transmit requests from non-existent driver (status=0x%x).\n",
              INSTANCE(pThis), pThis->VPCI.uStatus));
-        return;
+        ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+        return VINF_SUCCESS;
     }
 
     PPDMINETWORKUP pDrv = pThis->pDrv;
@@ -1162,8 +1422,19 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
         if (rc == VERR_TRY_AGAIN)
         {
-            ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
-            return;
+            /*
+             * Ask the current transmitter to wake us up when it is done. Retry
+             * once after that because it might have finished before it could
+             * have seen our bit.
+             */
+            ASMAtomicOrU32(&pThis->fTxWaitingPairs, RT_BIT_32(pPair - &pThis->aQueuePairs[0]));
+            rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
+            Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
+            if (rc == VERR_TRY_AGAIN)
+            {
+                ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+                return rc;
+            }
         }
     }
 
@@ -1173,11 +1444,13 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
     else
         uHdrLen = sizeof(VNETHDR);
 
-    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets\n", INSTANCE(pThis),
-          vringReadAvailIndex(&pThis->VPCI, &pThis->pTxQueue->VRing) - pThis->pTxQueue->uNextAvailIndex));
+    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets on %s\n", INSTANCE(pThis),
+          vringReadAvailIndex(&pThis->VPCI, &pQueue->VRing) - pQueue->uNextAvailIndex, pQueue->pcszName));
 
     vpciSetWriteLed(&pThis->VPCI, true);
 
+    int        rc         = VINF_SUCCESS;
+    unsigned   cCompleted = 0;
     VQUEUEELEM elem;
     /*
      * Do not remove descriptors from available ring yet, try to allocate the
@@ -1190,6 +1463,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
         {
             Log(("%s vnetQueueTransmit: The first segment is not the header! (%u < 2 || %u != %u).\n",
                  INSTANCE(pThis), elem.nOut, elem.aSegsOut[0].cb, uHdrLen));
+            rc = VERR_INVALID_PARAMETER;
             break; /* For now we simply ignore the header, but it must be there anyway! */
         }
         else
@@ -1211,13 +1485,14 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                                   &Hdr, sizeof(Hdr));
 
                 STAM_REL_COUNTER_INC(&pThis->StatTransmitPackets);
+                STAM_REL_COUNTER_INC(&pPair->StatTransmitPackets);
 
                 STAM_PROFILE_START(&pThis->StatTransmitSend, a);
 
                 pGso = vnetSetupGsoCtx(&Gso, &Hdr);
                 /** @todo Optimize away the extra copying! (lazy bird) */
                 PPDMSCATTERGATHER pSgBuf;
-                int rc = pThis->pDrv->pfnAllocBuf(pThis->pDrv, uSize, pGso, &pSgBuf);
+                rc = pThis->pDrv->pfnAllocBuf(pThis->pDrv, uSize, pGso, &pSgBuf);
                 if (RT_SUCCESS(rc))
                 {
                     Assert(pSgBuf->cSegs == 1);
@@ -1231,6 +1506,13 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                     }
                     pSgBuf->cbUsed = uSize;
                     vnetPacketDump(pThis, (uint8_t*)pSgBuf->aSegs[0].pvSeg, uSize, "--> Outgoing");
+                    if (pThis->cCurQueuePairs > 1)
+                    {
+                        /* Remember the pair so that replies for this flow are received on it too. */
+                        uint32_t uHash = vnetFlowHash(pSgBuf->aSegs[0].pvSeg, uSize);
+                        if (uHash)
+                            pThis->au8FlowToPair[uHash % VNET_FLOW_TABLE_SIZE] = (uint8_t)(pPair - &pThis->aQueuePairs[0]);
+                    }
                     if (pGso)
                     {
                         /* Some guests (RHEL) may report HdrLen excluding transport layer header! */
@@ -1276,7 +1558,9 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                                              Hdr.u16CSumStart, Hdr.u16CSumOffset);
                     }
 
-                    rc = pThis->pDrv->pfnSendBuf(pThis->pDrv, pSgBuf, false);
+                    int rc2 = pThis->pDrv->pfnSendBuf(pThis->pDrv, pSgBuf, fOnWorkerThread);
+                    if (RT_FAILURE(rc2))
+                        Log4(("%s vnetTransmitPendingPackets: failed to send frame: rc=%Rrc\n", INSTANCE(pThis), rc2));
                 }
                 else
                 {
@@ -1284,24 +1568,41 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                     STAM_PROFILE_STOP(&pThis->StatTransmitSend, a);
                     STAM_PROFILE_ADV_STOP(&pThis->StatTransmit, a);
                     /* Stop trying to fetch TX descriptors until we get more bandwidth. */
+                    rc = VERR_NET_NO_BUFFER_SPACE;
                     break;
                 }
 
                 STAM_PROFILE_STOP(&pThis->StatTransmitSend, a);
                 STAM_REL_COUNTER_ADD(&pThis->StatTransmitBytes, uOffset);
+                STAM_REL_COUNTER_ADD(&pPair->StatTransmitBytes, uOffset);
             }
         }
         /* Remove this descriptor chain from the available ring */
         vqueueSkip(&pThis->VPCI, pQueue);
         vqueuePut(&pThis->VPCI, pQueue, &elem, sizeof(VNETHDR) + uOffset);
-        vqueueSync(&pThis->VPCI, pQueue);
+        cCompleted++;
         STAM_PROFILE_ADV_STOP(&pThis->StatTransmit, a);
     }
+    /* Hand all transmitted buffers back to the guest at once. */
+    if (cCompleted)
+        vqueueSync(&pThis->VPCI, pQueue);
     vpciSetWriteLed(&pThis->VPCI, false);
 
     if (pDrv)
+    {
         pDrv->pfnEndXmit(pDrv);
-    ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
+
+        /* Let the queue pairs which found the driver busy have their go. */
+        uint32_t fWaiting = ASMAtomicXchgU32(&pThis->fTxWaitingPairs, 0);
+        while (fWaiting)
+        {
+            unsigned iPair = ASMBitFirstSetU32(fWaiting) - 1;
+            fWaiting &= ~RT_BIT_32(iPair);
+            vnetTxWakeup(&pThis->aQueuePairs[iPair]);
+        }
+    }
+    ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+    return rc;
 }
 
 /**
@@ -1310,81 +1611,94 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
 static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterface)
 {
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
+    unsigned   cPairs = pThis->cCurQueuePairs;
+    for (unsigned i = 0; i < cPairs; i++)
+        vnetTxWakeup(&pThis->aQueuePairs[i]);
 }
 
-#ifdef VNET_TX_DELAY
-
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
+    PVNETSTATE     pThis = (PVNETSTATE)pvState;
+    PVNETQUEUEPAIR pPair = vnetQueuePair(pThis, pQueue);
 
-    if (TMTimerIsActive(pThis->CTX_SUFF(pTxTimer)))
-    {
-        int rc = TMTimerStop(pThis->CTX_SUFF(pTxTimer));
-        Log3(("%s vnetQueueTransmit: Got kicked with notification disabled, "
-              "re-enable notification and flush TX queue\n", INSTANCE(pThis)));
-        vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
-        if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
-        else
-        {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
-            vnetCsLeave(pThis);
-        }
-    }
+    STAM_REL_COUNTER_INC(&pPair->StatTransmitKicks);
+    /* No more kicks needed until the worker has drained the queue. */
+    if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
+        LogRel(("vnetQueueTransmit: Failed to enter critical section!\n"));
     else
     {
-        if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
-        else
-        {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, false);
-            TMTimerSetMicro(pThis->CTX_SUFF(pTxTimer), VNET_TX_DELAY);
-            pThis->u64NanoTS = RTTimeNanoTS();
-            vnetCsLeave(pThis);
-        }
+        vqueueSetNotification(&pThis->VPCI, pQueue, false);
+        vnetCsLeave(pThis);
     }
+    vnetTxWakeup(pPair);
 }
 
 /**
- * @callback_method_impl{FNTMTIMERDEV, Transmit Delay Timer handler.}
+ * Transmit worker thread of a queue pair.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The thread, pvUser points to the queue pair.
  */
-static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pvUser)
+static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvUser;
+    PVNETSTATE     pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
 
-    uint32_t u32MicroDiff = (uint32_t)((RTTimeNanoTS() - pThis->u64NanoTS)/1000);
-    if (u32MicroDiff < pThis->u32MinDiff)
-        pThis->u32MinDiff = u32MicroDiff;
-    if (u32MicroDiff > pThis->u32MaxDiff)
-        pThis->u32MaxDiff = u32MicroDiff;
-    pThis->u32AvgDiff = (pThis->u32AvgDiff * pThis->u32i + u32MicroDiff) / (pThis->u32i + 1);
-    pThis->u32i++;
-    Log3(("vnetTxTimer: Expired, diff %9d usec, avg %9d usec, min %9d usec, max %9d usec\n",
-            u32MicroDiff, pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
-
-//    Log3(("%s vnetTxTimer: Expired\n", INSTANCE(pThis)));
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
-    if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
     {
-        LogRel(("vnetTxTimer: Failed to enter critical section!/n"));
-        return;
-    }
-    vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
-    vnetCsLeave(pThis);
-}
+        if (!ASMAtomicXchgBool(&pPair->fTxPending, false))
+        {
+            int rc = RTSemEventWait(pPair->hEventTx, RT_INDEFINITE_WAIT);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
+            continue;
+        }
 
-#else /* !VNET_TX_DELAY */
+        PVQUEUE pQueue = pPair->pTxQueue;
+        if (   !(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK)
+            || !vqueueIsReady(&pThis->VPCI, pQueue))
+            continue;
 
-static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
-{
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
+        int rc = vnetTransmitPendingPackets(pThis, pPair, true /*fOnWorkerThread*/);
 
-    vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
+        /*
+         * Re-enable notifications and check for frames queued by the guest
+         * while they were off, those would not be followed by a kick.
+         */
+        if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
+        {
+            LogRel(("vnetTxThread: Failed to enter critical section!\n"));
+            continue;
+        }
+        vqueueSetNotification(&pThis->VPCI, pQueue, true);
+        vnetCsLeave(pThis);
+
+        /*
+         * On VERR_TRY_AGAIN the pair holding the driver wakes us up when it is
+         * done, on VERR_NET_NO_BUFFER_SPACE the driver does (pfnXmitPending).
+         */
+        if (RT_SUCCESS(rc) && !vqueueIsEmpty(&pThis->VPCI, pQueue))
+            ASMAtomicWriteBool(&pPair->fTxPending, true);
+    }
+
+    return VINF_SUCCESS;
 }
 
-#endif /* !VNET_TX_DELAY */
+/**
+ * Unblocks the transmit worker so it can respond to a state change.
+ *
+ * @returns VBox status code.
+ * @param   pDevIns     The device instance.
+ * @param   pThread     The transmit thread.
+ */
+static DECLCALLBACK(int) vnetTxThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    return RTSemEventSignal(pPair->hEventTx);
+}
 
 static uint8_t vnetControlRx(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
 {
@@ -1539,6 +1853,39 @@ static uint8_t vnetControlVlan(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELE
     return u8Ack;
 }
 
+static uint8_t vnetControlMq(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
+{
+    uint16_t cPairs;
+
+    if (   !vnetMultiQueue(pThis)
+        || pCtlHdr->u8Command != VNET_CTRL_CMD_MQ_VQ_PAIRS_SET
+        || pElem->nOut != 2
+        || pElem->aSegsOut[1].cb != sizeof(cPairs))
+    {
+        Log(("%s vnetControlMq: Unexpected request "
+             "(u8Command=%u nOut=%u cb=%u)\n", INSTANCE(pThis),
+             pCtlHdr->u8Command, pElem->nOut, pElem->aSegsOut[1].cb));
+        return VNET_ERROR;
+    }
+
+    PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns),
+                      pElem->aSegsOut[1].addr,
+                      &cPairs, sizeof(cPairs));
+
+    if (cPairs < 1 || cPairs > pThis->cMaxQueuePairs)
+    {
+        Log(("%s vnetControlMq: Number of queue pairs is out of range "
+             "(cPairs=%u max=%u)\n", INSTANCE(pThis), cPairs, pThis->cMaxQueuePairs));
+        return VNET_ERROR;
+    }
+
+    Log(("%s vnetControlMq: Using %u queue pairs\n", INSTANCE(pThis), cPairs));
+    ASMAtomicWriteU16(&pThis->cCurQueuePairs, cPairs);
+    /* The receive thread may be waiting for buffers in a queue which is no longer used. */
+    vnetWakeupReceive(pThis->VPCI.CTX_SUFF(pDevIns));
+    return VNET_OK;
+}
+
 
 static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 {
@@ -1581,6 +1928,9 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                 case VNET_CTRL_CLS_VLAN:
                     u8Ack = vnetControlVlan(pThis, &CtlHdr, &elem);
                     break;
+                case VNET_CTRL_CLS_MQ:
+                    u8Ack = vnetControlMq(pThis, &CtlHdr, &elem);
+                    break;
                 default:
                     u8Ack = VNET_ERROR;
             }
@@ -1607,6 +1957,7 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 static void vnetSaveConfig(PVNETSTATE pThis, PSSMHANDLE pSSM)
 {
     SSMR3PutMem(pSSM, &pThis->macConfigured, sizeof(pThis->macConfigured));
+    SSMR3PutU16(pSSM, pThis->cMaxQueuePairs);
 }
 
 
@@ -1663,6 +2014,8 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutMem( pSSM, pThis->aVlanFilter, sizeof(pThis->aVlanFilter));
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU16( pSSM, pThis->cCurQueuePairs);
+    AssertRCReturn(rc, rc);
     Log(("%s State has been saved\n", INSTANCE(pThis)));
     return VINF_SUCCESS;
 }
@@ -1699,9 +2052,53 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
     if (memcmp(&macConfigured, &pThis->macConfigured, sizeof(macConfigured))
         && (uPass == 0 || !PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns)))
         LogRel(("%s: The mac address differs: config=%RTmac saved=%RTmac\n", INSTANCE(pThis), &pThis->macConfigured, &macConfigured));
+    if (uVersion > VIRTIO_SAVEDSTATE_VERSION_NO_NET_MQ)
+    {
+        uint16_t cMaxQueuePairs;
+        rc = SSMR3GetU16(pSSM, &cMaxQueuePairs);
+        AssertRCReturn(rc, rc);
+        if (cMaxQueuePairs != pThis->cMaxQueuePairs)
+            return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Config mismatch - saved QueuePairs=%u config=%u"),
+                                    cMaxQueuePairs, pThis->cMaxQueuePairs);
+    }
 
+    /*
+     * Older saved states only have the queues of a single pair. The queues
+     * of the other pairs keep their initial state, the guest did not know
+     * about them.
+     */
+    uint32_t nQueues = pThis->VPCI.nQueues;
+    VQUEUE   QueueRx1 = pThis->VPCI.Queues[2];
     rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VNET_N_QUEUES);
     AssertRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pThis->VPCI.nQueues <= nQueues,
+                          ("%s nQueues=%u config=%u\n", INSTANCE(pThis), pThis->VPCI.nQueues, nQueues),
+                          VERR_SSM_LOAD_CONFIG_MISMATCH);
+
+    /*
+     * The third queue of an older saved state is the control queue, which
+     * lives behind the last pair now.  Move it there and give RX1 back its
+     * initial state.
+     */
+    if (   uPass == SSM_PASS_FINAL
+        && uVersion <= VIRTIO_SAVEDSTATE_VERSION_NO_NET_MQ
+        && pThis->cMaxQueuePairs > 1
+        && pThis->VPCI.nQueues > 2)
+    {
+        PVQUEUE pCtlQueue = vnetCtlQueue(pThis);
+        PVQUEUE pOldQueue = &pThis->VPCI.Queues[2];
+        pCtlQueue->VRing               = pOldQueue->VRing;
+        pCtlQueue->uNextAvailIndex     = pOldQueue->uNextAvailIndex;
+        pCtlQueue->uNextUsedIndex      = pOldQueue->uNextUsedIndex;
+        pCtlQueue->uPageNumber         = pOldQueue->uPageNumber;
+        pCtlQueue->uSignalledUsedIndex = pOldQueue->uSignalledUsedIndex;
+        pCtlQueue->fSignalledUsedValid = pOldQueue->fSignalledUsedValid;
+        pCtlQueue->fNoNotify           = pOldQueue->fNoNotify;
+        *pOldQueue = QueueRx1;
+        if (pThis->VPCI.uQueueSelector == 2)
+            pThis->VPCI.uQueueSelector = (uint16_t)(2 * pThis->cMaxQueuePairs);
+    }
+    pThis->VPCI.nQueues = nQueues;
 
     if (uPass == SSM_PASS_FINAL)
     {
@@ -1740,6 +2137,20 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             if (pThis->pDrv)
                 pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv, true);
         }
+
+        if (uVersion > VIRTIO_SAVEDSTATE_VERSION_NO_NET_MQ)
+        {
+            uint16_t cCurQueuePairs;
+            rc = SSMR3GetU16(pSSM, &cCurQueuePairs);
+            AssertRCReturn(rc, rc);
+            AssertLogRelMsgReturn(cCurQueuePairs >= 1 && cCurQueuePairs <= pThis->cMaxQueuePairs,
+                                  ("%s cCurQueuePairs=%u\n", INSTANCE(pThis), cCurQueuePairs),
+                                  VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+            pThis->cCurQueuePairs = cCurQueuePairs;
+        }
+        else
+            pThis->cCurQueuePairs = 1;
+        memset(pThis->au8FlowToPair, 0xFF, sizeof(pThis->au8FlowToPair));
     }
 
     return rc;
@@ -1764,6 +2175,13 @@ static DECLCALLBACK(int) vnetLoadDone(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     if (!PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns))
         vnetTempLinkDown(pThis);
 
+    /*
+     * Notifications may have been disabled for a TX queue when the state
+     * was saved, so have the workers look at the queues once the VM runs.
+     */
+    for (unsigned i = 0; i < pThis->cCurQueuePairs; i++)
+        vnetTxWakeup(&pThis->aQueuePairs[i]);
+
     return VINF_SUCCESS;
 }
 
@@ -1921,9 +2339,6 @@ static DECLCALLBACK(void) vnetRelocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta)
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
     vpciRelocate(pDevIns, offDelta);
     pThis->pCanRxQueueRC = PDMQueueRCPtr(pThis->pCanRxQueueR3);
-#ifdef VNET_TX_DELAY
-    pThis->pTxTimerRC    = TMTimerRCPtr(pThis->pTxTimerR3);
-#endif /* VNET_TX_DELAY */
     // TBD
 }
 
@@ -1936,8 +2351,6 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
     PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
 
-    LogRel(("TxTimer stats (avg/min/max): %7d usec %7d usec %7d usec\n",
-            pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
     Log(("%s Destroying instance\n", INSTANCE(pThis)));
     if (pThis->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
     {
@@ -1946,6 +2359,16 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
         pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
     }
 
+    /* The TX worker threads are destroyed by PDM after we return. */
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+    {
+        if (pThis->aQueuePairs[i].hEventTx != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pThis->aQueuePairs[i].hEventTx);
+            pThis->aQueuePairs[i].hEventTx = NIL_RTSEMEVENT;
+        }
+    }
+
     // if (PDMCritSectIsInitialized(&pThis->csRx))
     //     PDMR3CritSectDelete(&pThis->csRx);
 
@@ -1964,26 +2387,54 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
 
     /* Initialize the instance data suffiencently for the destructor not to blow up. */
     pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+    for (unsigned i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+        pThis->aQueuePairs[i].hEventTx = NIL_RTSEMEVENT;
 
     /* Do our own locking. */
     rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
     AssertRCReturn(rc, rc);
 
+    /*
+     * The number of queue pairs determines the number of queues, so it has
+     * to be known before the PCI part is initialized. Multiqueue is opt-in,
+     * set VBoxInternal/Devices/virtio-net/N/Config/QueuePairs to enable it.
+     */
+    rc = CFGMR3QueryU16Def(pCfg, "QueuePairs", &pThis->cMaxQueuePairs, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'QueuePairs'"));
+    if (pThis->cMaxQueuePairs < 1)
+        return PDMDEV_SET_ERROR(pDevIns, VERR_INVALID_PARAMETER,
+                                N_("Configuration error: 'QueuePairs' must be at least 1"));
+    if (pThis->cMaxQueuePairs > VNET_MAX_QUEUE_PAIRS)
+    {
+        LogRel(("VNet#%d: Limiting the number of queue pairs from %u to %u\n",
+                iInstance, pThis->cMaxQueuePairs, VNET_MAX_QUEUE_PAIRS));
+        pThis->cMaxQueuePairs = VNET_MAX_QUEUE_PAIRS;
+    }
+
     /* Initialize PCI part. */
     pThis->VPCI.IBase.pfnQueryInterface    = vnetQueryInterface;
     rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance,
                        VNET_NAME_FMT, VNET_PCI_SUBSYSTEM_ID,
-                       VNET_PCI_CLASS, VNET_N_QUEUES);
-    pThis->pRxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  "RX ");
-    pThis->pTxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, "TX ");
-    pThis->pCtlQueue = vpciAddQueue(&pThis->VPCI, 16,  vnetQueueControl,  "CTL");
+                       VNET_PCI_CLASS, 2 * pThis->cMaxQueuePairs + 1);
+    static const char * const s_apszRxNames[VNET_MAX_QUEUE_PAIRS] =
+        { "RX0", "RX1", "RX2", "RX3", "RX4", "RX5", "RX6", "RX7" };
+    static const char * const s_apszTxNames[VNET_MAX_QUEUE_PAIRS] =
+        { "TX0", "TX1", "TX2", "TX3", "TX4", "TX5", "TX6", "TX7" };
+    for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        pThis->aQueuePairs[i].pRxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  s_apszRxNames[i]);
+        pThis->aQueuePairs[i].pTxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, s_apszTxNames[i]);
+    }
+    vpciAddQueue(&pThis->VPCI, 16, vnetQueueControl, "CTL");
 
     Log(("%s Constructing new instance\n", INSTANCE(pThis)));
 
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0" "QueuePairs\0"))
                     return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
                                             N_("Invalid configuration for VirtioNet device"));
 
@@ -2016,6 +2467,7 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     /* Initialize PCI config space */
     memcpy(pThis->config.mac.au8, pThis->macConfigured.au8, sizeof(pThis->config.mac.au8));
     pThis->config.uStatus = 0;
+    pThis->config.uMaxVirtqueuePairs = pThis->cMaxQueuePairs;
 
     /* Initialize state structure */
     pThis->u32PktNo     = 1;
@@ -2068,19 +2520,22 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return rc;
 
-#ifdef VNET_TX_DELAY
-    /* Create Transmit Delay Timer */
-    rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetTxTimer, pThis,
-                                TMTIMER_FLAGS_NO_CRIT_SECT,
-                                "VirtioNet TX Delay Timer", &pThis->pTxTimerR3);
-    if (RT_FAILURE(rc))
-        return rc;
-    pThis->pTxTimerR0 = TMTimerR0Ptr(pThis->pTxTimerR3);
-    pThis->pTxTimerRC = TMTimerRCPtr(pThis->pTxTimerR3);
+    /* Create the transmit worker threads, one per queue pair. */
+    for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        rc = RTSemEventCreate(&pPair->hEventTx);
+        if (RT_FAILURE(rc))
+            return rc;
 
-    pThis->u32i = pThis->u32AvgDiff = pThis->u32MaxDiff = 0;
-    pThis->u32MinDiff = ~0;
-#endif /* VNET_TX_DELAY */
+        char szName[24];
+        RTStrPrintf(szName, sizeof(szName), "%sTx%u", INSTANCE(pThis), i);
+        rc = PDMDevHlpThreadCreate(pDevIns, &pPair->pTxThread, pPair, vnetTxThread,
+                                   vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, szName);
+        if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc,
+                                    N_("VirtioNet: Failed to create the transmit worker thread"));
+    }
 
     rc = PDMDevHlpDriverAttach(pDevIns, 0, &pThis->VPCI.IBase, &pThis->pDrvBase, "Network Port");
     if (RT_SUCCESS(rc))
@@ -2119,6 +2574,15 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitPackets,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of sent packets",             "/Devices/VNet%d/Packets/Transmit", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitGSO,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of sent GSO packets",         "/Devices/VNet%d/Packets/Transmit-Gso", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitCSum,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of completed TX checksums",   "/Devices/VNet%d/Packets/Transmit-Csum", iInstance);
+    for (unsigned i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatReceivePackets,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of packets received",         "/Devices/VNet%d/Queue%u/ReceivePackets", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatReceiveBytes,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,          "Amount of data received",            "/Devices/VNet%d/Queue%u/ReceiveBytes", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitPackets, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of packets transmitted",      "/Devices/VNet%d/Queue%u/TransmitPackets", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitBytes,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,          "Amount of data transmitted",         "/Devices/VNet%d/Queue%u/TransmitBytes", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitKicks,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of TX queue notifications",   "/Devices/VNet%d/Queue%u/TransmitKicks", iInstance, i);
+    }
 #if defined(VBOX_WITH_STATISTICS)
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReceive,            STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling receive",                  "/Devices/VNet%d/Receive/Total", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReceiveStore,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling receive storing",          "/Devices/VNet%d/Receive/Store", iInstance);
@@ -150,6 +150,22 @@ typedef struct DRVINTNET
         PDMSCATTERGATHER            Sg;
         uint8_t                     padding[8 * sizeof(RTUINTPTR)];
     }                               u;
+    /** The maximum number of frames committed to the send ring before they
+     * are pushed thru the switch (XmitBatchFrames).  The rest is pushed by
+     * pfnEndXmit, so this only limits the latency of long bursts.  Ring-3
+     * only, ring-0 pushes every frame. */
+    uint32_t                        cXmitBatchMax;
+    /** The number of frames committed to the send ring but not yet pushed
+     * thru the switch.  Only accessed while owning the XmitLock. */
+    uint32_t                        cXmitPending;
+    /** How long the receive thread waits for more frames before blocking in
+     * ring-0 after a burst, in microseconds (RecvCoalesceMicros).  0 disables
+     * the delay. */
+    uint32_t                        cRecvCoalesceUs;
+    /** The status of a failed push by pfnEndXmit, returned by the next
+     * pfnSendBuf unless a later push succeeds.  Only accessed while owning the
+     * XmitLock. */
+    int32_t                         rcXmitFlush;
     /** The network name. */
     char                            szNetwork[INTNET_MAX_NETWORK_NAME];
 
@@ -167,6 +183,17 @@ typedef struct DRVINTNET
     STAMCOUNTER                     StatXmitWakeupR3;
     /** The times the xmit thread has been told to process the ring. */
     STAMCOUNTER                     StatXmitProcessRing;
+    /** Profiling the pushing of the send ring thru the switch, one period per
+     * ring-0 call.  Divide by StatXmitFrames for the cost per frame. */
+    STAMPROFILE                     StatXmitFlush;
+    /** Number of frames committed to the send ring. */
+    STAMCOUNTER                     StatXmitFrames;
+    /** Number of frames passed up the driver chain by the receive thread. */
+    STAMCOUNTER                     StatRecvFrames;
+    /** Number of times the receive thread blocked in ring-0. */
+    STAMCOUNTER                     StatRecvWaits;
+    /** Number of times the delay after a burst found more frames, saving a wait. */
+    STAMCOUNTER                     StatRecvCoalesced;
 #ifdef VBOX_WITH_STATISTICS
     /** Profiling packet transmit runs. */
     STAMPROFILE                     StatTransmit;
@@ -290,6 +317,10 @@ DECLINLINE(int) drvIntNetProcessXmit(PDRVINTNET pThis)
 {
     Assert(PDMCritSectIsOwner(&pThis->XmitLock));
 
+    /* This pushes all committed frames, including the batched ones. */
+    pThis->cXmitPending = 0;
+    STAM_REL_PROFILE_START(&pThis->StatXmitFlush, a);
+
 #ifdef IN_RING3
     INTNETIFSENDREQ SendReq;
     SendReq.Hdr.u32Magic = SUPVMMR0REQHDR_MAGIC;
@@ -306,6 +337,9 @@ DECLINLINE(int) drvIntNetProcessXmit(PDRVINTNET pThis)
         rc = VINF_SUCCESS;
     }
 #endif
+    STAM_REL_PROFILE_STOP(&pThis->StatXmitFlush, a);
+    if (RT_SUCCESS(rc))
+        pThis->rcXmitFlush = VINF_SUCCESS;
     return rc;
 }
 
@@ -385,7 +419,8 @@ PDMBOTHCBDECL(int) drvIntNetUp_AllocBuf(PPDMINETWORKUP pInterface, size_t cbMin,
      *
      * In ring-3 we may have to process the xmit ring before there is
      * sufficient buffer space since we might have stacked up a few frames to the
-     * trunk while in ring-0.  (There is not point of doing this in ring-0.)
+     * trunk while in ring-0.  In both contexts frames batched by pfnSendBuf are
+     * pushed thru the switch before giving up, they may be what fills the ring.
      */
     PINTNETHDR pHdr = NULL;             /* gcc silliness */
     if (pGso)
@@ -394,9 +429,12 @@ PDMBOTHCBDECL(int) drvIntNetUp_AllocBuf(PPDMINETWORKUP pInterface, size_t cbMin,
     else
         rc = IntNetRingAllocateFrame(&pThis->CTX_SUFF(pBuf)->Send, (uint32_t)cbMin,
                                      &pHdr, &pSgBuf->aSegs[0].pvSeg);
-#ifdef IN_RING3
     if (    RT_FAILURE(rc)
-        &&  pThis->CTX_SUFF(pBuf)->cbSend >= cbMin * 2 + sizeof(INTNETHDR))
+        &&  (   pThis->cXmitPending
+#ifdef IN_RING3
+             || pThis->CTX_SUFF(pBuf)->cbSend >= cbMin * 2 + sizeof(INTNETHDR)
+#endif
+            ))
     {
         drvIntNetProcessXmit(pThis);
         if (pGso)
@@ -406,7 +444,6 @@ PDMBOTHCBDECL(int) drvIntNetUp_AllocBuf(PPDMINETWORKUP pInterface, size_t cbMin,
             rc = IntNetRingAllocateFrame(&pThis->CTX_SUFF(pBuf)->Send, (uint32_t)cbMin,
                                          &pHdr, &pSgBuf->aSegs[0].pvSeg);
     }
-#endif
     if (RT_SUCCESS(rc))
     {
         /*
@@ -499,11 +536,28 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
     PDMDrvHlpFTSetCheckpoint(pThis->CTX_SUFF(pDrvIns), FTMCHECKPOINTTYPE_NETWORK);
 
     /*
-     * Commit the frame and push it thru the switch.
+     * Commit the frame and push it thru the switch.  Ring-3 does this once
+     * the batch is full and pfnEndXmit takes care of the remainder, which
+     * saves a ring-0 call per frame when the device sends a burst.  Ring-0
+     * pushes right away: there is no call to save and a few GSO frames fill
+     * the default send ring, which would bounce the rest to the xmit thread.
      */
     PINTNETHDR pHdr = (PINTNETHDR)pSgBuf->pvAllocator;
     IntNetRingCommitFrameEx(&pThis->CTX_SUFF(pBuf)->Send, pHdr, pSgBuf->cbUsed);
-    int rc = drvIntNetProcessXmit(pThis);
+    STAM_REL_COUNTER_INC(&pThis->StatXmitFrames);
+    int rc = VINF_SUCCESS;
+#ifdef IN_RING3
+    if (++pThis->cXmitPending >= pThis->cXmitBatchMax)
+        rc = drvIntNetProcessXmit(pThis);
+#else
+    rc = drvIntNetProcessXmit(pThis);
+#endif
+    if (RT_UNLIKELY(RT_SUCCESS(rc) && pThis->rcXmitFlush != VINF_SUCCESS))
+    {
+        /* An earlier pfnEndXmit failed to push the ring, report it now. */
+        rc = pThis->rcXmitFlush;
+        pThis->rcXmitFlush = VINF_SUCCESS;
+    }
     STAM_PROFILE_STOP(&pThis->StatTransmit, a);
 
     /*
@@ -525,6 +579,18 @@ PDMBOTHCBDECL(int) drvIntNetUp_SendBuf(PPDMINETWORKUP pInterface, PPDMSCATTERGAT
 PDMBOTHCBDECL(void) drvIntNetUp_EndXmit(PPDMINETWORKUP pInterface)
 {
     PDRVINTNET pThis = RT_FROM_MEMBER(pInterface, DRVINTNET, CTX_SUFF(INetworkUp));
+    if (pThis->cXmitPending)
+    {
+        int rc = drvIntNetProcessXmit(pThis);
+        if (RT_FAILURE(rc))
+        {
+            /* We cannot fail here.  The frames are still in the ring, so have
+               the xmit thread retry and report the status from pfnSendBuf. */
+            pThis->rcXmitFlush = rc;
+            ASMAtomicUoWriteBool(&pThis->fXmitProcessRing, true);
+            drvIntNetSignalXmit(pThis);
+        }
+    }
     ASMAtomicUoWriteBool(&pThis->fXmitOnXmitThread, false);
     PDMCritSectLeave(&pThis->XmitLock);
 }
@@ -688,6 +754,7 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
         /*
          * Process the receive buffer.
          */
+        uint32_t   cFrames = 0;
         PINTNETHDR pHdr;
         while ((pHdr = IntNetRingGetNextFrameToRead(pRingBuf)) != NULL)
         {
@@ -702,6 +769,8 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
             }
 
             Log2(("pHdr=%p offRead=%#x: %.8Rhxs\n", pHdr, pRingBuf->offReadX, pHdr));
+            cFrames++;
+            STAM_REL_COUNTER_INC(&pThis->StatRecvFrames);
             uint8_t u8Type = pHdr->u8Type;
             if (    (   u8Type == INTNETHDR_TYPE_FRAME
                      || u8Type == INTNETHDR_TYPE_GSO)
@@ -836,6 +905,26 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
             }
         } /* while more received data */
 
+        /*
+         * After a burst, give the ring a little while to fill up again before
+         * blocking so back-to-back frames don't cost a ring-0 wait and wakeup
+         * each.  hRecvEvt is only signalled on state changes, so this returns
+         * early when we're being suspended or destroyed.
+         */
+        if (   cFrames > 1
+            && pThis->cRecvCoalesceUs)
+        {
+            if (!IntNetRingHasMoreToRead(pRingBuf))
+                RTSemEventWaitEx(pThis->hRecvEvt,
+                                 RTSEMWAIT_FLAGS_RELATIVE | RTSEMWAIT_FLAGS_NANOSECS | RTSEMWAIT_FLAGS_NORESUME,
+                                 (uint64_t)pThis->cRecvCoalesceUs * RT_NS_1US);
+            if (IntNetRingHasMoreToRead(pRingBuf))
+            {
+                STAM_REL_COUNTER_INC(&pThis->StatRecvCoalesced);
+                continue;
+            }
+        }
+
         /*
          * Wait for data, checking the state before we block.
          */
@@ -852,6 +941,7 @@ static int drvR3IntNetRecvRun(PDRVINTNET pThis)
         WaitReq.hIf          = pThis->hIf;
         WaitReq.cMillies     = 30000; /* 30s - don't wait forever, timeout now and then. */
         STAM_PROFILE_ADV_STOP(&pThis->StatReceive, a);
+        STAM_REL_COUNTER_INC(&pThis->StatRecvWaits);
         int rc = PDMDrvHlpSUPCallVMMR0Ex(pDrvIns, VMMR0_DO_INTNET_IF_WAIT, &WaitReq, sizeof(WaitReq));
         if (    RT_FAILURE(rc)
             &&  rc != VERR_TIMEOUT
@@ -1224,6 +1314,11 @@ static DECLCALLBACK(void) drvR3IntNetDestruct(PPDMDRVINS pDrvIns)
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->pBufR3->StatRecv2);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceivedGso);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatSentGso);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatXmitFlush);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatXmitFrames);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvFrames);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvWaits);
+        PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatRecvCoalesced);
 #ifdef VBOX_WITH_STATISTICS
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReceive);
         PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatTransmit);
@@ -1394,6 +1489,8 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
                                   "|TrunkPolicyHost"
                                   "|TrunkPolicyWire"
                                   "|IsService"
+                                  "|XmitBatchFrames"
+                                  "|RecvCoalesceMicros"
                                   "|IgnoreConnectFailure"
                                   "|Workaround1",
                                   "");
@@ -1652,6 +1749,33 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
         return PDMDRV_SET_ERROR(pDrvIns, rc,
                                 N_("Configuration error: Failed to get the \"IsService\" value"));
 
+    /** @cfgm{XmitBatchFrames, uint32_t, 32}
+     * The maximum number of frames committed to the send ring before pushing
+     * them thru the switch.  The remainder of a burst is pushed when the device
+     * is done transmitting.  1 pushes every frame individually.  Only applies
+     * to frames sent from ring-3.
+     */
+    rc = CFGMR3QueryU32Def(pCfg, "XmitBatchFrames", &pThis->cXmitBatchMax, 32);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"XmitBatchFrames\" value"));
+    if (!pThis->cXmitBatchMax || pThis->cXmitBatchMax > 1024)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: \"XmitBatchFrames\" must be between 1 and 1024"));
+
+    /** @cfgm{RecvCoalesceMicros, uint32_t, 0}
+     * How long the receive thread waits for more frames to arrive after a burst
+     * before blocking in ring-0.  This trades some latency for fewer ring-0
+     * waits under small packet load.  0 disables the delay.
+     */
+    rc = CFGMR3QueryU32Def(pCfg, "RecvCoalesceMicros", &pThis->cRecvCoalesceUs, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc,
+                                N_("Configuration error: Failed to get the \"RecvCoalesceMicros\" value"));
+    if (pThis->cRecvCoalesceUs > RT_US_1SEC)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: \"RecvCoalesceMicros\" must not exceed one second"));
+
 
     /** @cfgm{IgnoreConnectFailure, boolean, false}
      * When set only raise a runtime error if we cannot connect to the internal
@@ -1804,6 +1928,11 @@ static DECLCALLBACK(int) drvR3IntNetConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitWakeupR0,           "XmitWakeup-R0",        "Xmit thread wakeups from ring-0.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitWakeupR3,           "XmitWakeup-R3",        "Xmit thread wakeups from ring-3.");
     PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitProcessRing,        "XmitProcessRing",      "Time xmit thread was told to process the ring.");
+    PDMDrvHlpSTAMRegProfile(pDrvIns, &pThis->StatXmitFlush,              "XmitFlush",            "Profiling pushing the send ring thru the switch (one period per ring-0 call).");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatXmitFrames,             "XmitFrames",           "Frames committed to the send ring, XmitFlush ticks / XmitFrames is the cost per frame.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatRecvFrames,             "RecvFrames",           "Frames taken from the receive ring.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatRecvWaits,              "RecvWaits",            "Times the receive thread blocked in ring-0.");
+    PDMDrvHlpSTAMRegCounter(pDrvIns, &pThis->StatRecvCoalesced,          "RecvCoalesced",        "Times the delay after a burst found more frames and saved a wait.");
 
     /*
      * Create the async I/O threads.
@@ -65,6 +65,11 @@
 /** The wakeup bit in the INTNETIF::cBusy and INTNETRUNKIF::cBusy counters. */
 #define INTNET_BUSY_WAKEUP_MASK     RT_BIT_32(30)
 
+/** The number of hash buckets in the MAC address table, power of two. */
+#define INTNET_MACTAB_HASH_SIZE     256
+/** NIL index for the MAC address table hash and special chains. */
+#define INTNET_MACTAB_NIL           UINT32_MAX
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -87,6 +92,11 @@ typedef struct INTNETMACTABENTRY
     bool                    fActive;
     /** Pointer to the network interface. */
     struct INTNETIF        *pIf;
+    /** Index of the next entry in the same hash bucket (INTNET_MACTAB_NIL). */
+    uint32_t                iHashNext;
+    /** Index of the next entry on the special chain (INTNET_MACTAB_NIL), see
+     * INTNETMACTAB::iSpecialHead. */
+    uint32_t                iSpecialNext;
 } INTNETMACTABENTRY;
 /** Pointer to a MAC address lookup table entry. */
 typedef INTNETMACTABENTRY *PINTNETMACTABENTRY;
@@ -105,6 +115,14 @@ typedef struct INTNETMACTAB
     uint32_t                cEntriesAllocated;
     /** Table entries. */
     PINTNETMACTABENTRY      paEntries;
+    /** Hash buckets indexing paEntries by MAC address, chained thru
+     * INTNETMACTABENTRY::iHashNext.  Rebuilt by intnetR0MacTabRehash whenever
+     * entries are added or removed or change address or promiscuity. */
+    uint32_t                aiHashHeads[INTNET_MACTAB_HASH_SIZE];
+    /** Head of the chain of entries which may receive frames not addressed
+     * to them, i.e. those in promiscuous mode or with a dummy MAC address.
+     * Chained thru INTNETMACTABENTRY::iSpecialNext. */
+    uint32_t                iSpecialHead;
 
     /** The number of interface entries currently in promicuous mode. */
     uint32_t                cPromiscuousEntries;
@@ -1467,6 +1485,57 @@ DECL_FORCE_INLINE(bool) intnetR0AreMacAddrsEqual(PCRTMAC pDstAddr1, PCRTMAC pDst
 }
 
 
+/**
+ * Calculates the MAC address table hash bucket of an address.
+ *
+ * @returns Bucket index.
+ * @param   pMacAddr            The address.
+ */
+DECL_FORCE_INLINE(uint32_t) intnetR0MacTabHash(PCRTMAC pMacAddr)
+{
+    /* The last three bytes are the NIC specific part, the vendor prefix is
+       usually the same for all interfaces. */
+    uint32_t uHash = pMacAddr->au8[5] ^ ((uint32_t)pMacAddr->au8[4] << 3) ^ ((uint32_t)pMacAddr->au8[3] << 5);
+    return (uHash ^ (uHash >> 8)) & (INTNET_MACTAB_HASH_SIZE - 1);
+}
+
+
+/**
+ * Rebuilds the MAC address hash and the special chain of the MAC table.
+ *
+ * This is only done when entries are added, removed or change their address
+ * or promiscuity, so the O(n) cost is fine.  The caller owns the MAC address
+ * table spinlock.
+ *
+ * @param   pTab                The MAC address table.
+ */
+static void intnetR0MacTabRehash(PINTNETMACTAB pTab)
+{
+    for (uint32_t iBucket = 0; iBucket < RT_ELEMENTS(pTab->aiHashHeads); iBucket++)
+        pTab->aiHashHeads[iBucket] = INTNET_MACTAB_NIL;
+    pTab->iSpecialHead = INTNET_MACTAB_NIL;
+
+    /* Walk backwards so the chains are in table order. */
+    uint32_t iEntry = pTab->cEntries;
+    while (iEntry-- > 0)
+    {
+        PINTNETMACTABENTRY pEntry  = &pTab->paEntries[iEntry];
+        uint32_t const     iBucket = intnetR0MacTabHash(&pEntry->MacAddr);
+        pEntry->iHashNext          = pTab->aiHashHeads[iBucket];
+        pTab->aiHashHeads[iBucket] = iEntry;
+
+        if (   pEntry->fPromiscuousEff
+            || intnetR0IsMacAddrDummy(&pEntry->MacAddr))
+        {
+            pEntry->iSpecialNext = pTab->iSpecialHead;
+            pTab->iSpecialHead   = iEntry;
+        }
+        else
+            pEntry->iSpecialNext = INTNET_MACTAB_NIL;
+    }
+}
+
+
 /**
  * Switch a unicast frame based on the network layer address (OSI level 3) and
  * return a destination table.
@@ -1659,32 +1728,52 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
     pDstTab->pTrunk     = 0;
     pDstTab->cIfs       = 0;
 
-    /* Find exactly matching or promiscuous interfaces. */
+    /* Find exactly matching interfaces using the hash. */
     uint32_t cExactHits = 0;
-    uint32_t iIfMac     = pTab->cEntries;
-    while (iIfMac-- > 0)
+    uint32_t iIfMac     = pTab->aiHashHeads[intnetR0MacTabHash(pDstAddr)];
+    while (iIfMac != INTNET_MACTAB_NIL)
     {
-        if (pTab->paEntries[iIfMac].fActive)
+        PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+        if (   pEntry->fActive
+            && intnetR0AreMacAddrsEqual(&pEntry->MacAddr, pDstAddr))
         {
-            bool fExact = intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr);
-            if (   fExact
-                || intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr)
-                || (   pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                    || (!fSrc && pTab->paEntries[iIfMac].fPromiscuousEff) )
-               )
+            cExactHits++;
+
+            PINTNETIF pIf = pEntry->pIf;                            AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+            if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
             {
-                cExactHits += fExact;
+                uint32_t iIfDst = pDstTab->cIfs++;
+                pDstTab->aIfs[iIfDst].pIf            = pIf;
+                pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                intnetR0BusyIncIf(pIf);
+            }
+        }
+        iIfMac = pEntry->iHashNext;
+    }
 
-                PINTNETIF pIf = pTab->paEntries[iIfMac].pIf;        AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
-                if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
-                {
-                    uint32_t iIfDst = pDstTab->cIfs++;
-                    pDstTab->aIfs[iIfDst].pIf            = pIf;
-                    pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
-                    intnetR0BusyIncIf(pIf);
-                }
+    /* Add the promiscuous and dummy MAC interfaces, the exact matches are
+       already taken care of. */
+    iIfMac = pTab->iSpecialHead;
+    while (iIfMac != INTNET_MACTAB_NIL)
+    {
+        PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+        if (   pEntry->fActive
+            && !intnetR0AreMacAddrsEqual(&pEntry->MacAddr, pDstAddr)
+            && (   intnetR0IsMacAddrDummy(&pEntry->MacAddr)
+                || pEntry->fPromiscuousSeeTrunk
+                || (!fSrc && pEntry->fPromiscuousEff) )
+           )
+        {
+            PINTNETIF pIf = pEntry->pIf;                            AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+            if (RT_LIKELY(pIf != pIfSender)) /* paranoia */
+            {
+                uint32_t iIfDst = pDstTab->cIfs++;
+                pDstTab->aIfs[iIfDst].pIf            = pIf;
+                pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
+                intnetR0BusyIncIf(pIf);
             }
         }
+        iIfMac = pEntry->iSpecialNext;
     }
 
     /* Network only promicuous mode ifs should see related trunk traffic. */
@@ -1692,21 +1781,23 @@ static INTNETSWDECISION intnetR0NetworkSwitchUnicast(PINTNETNETWORK pNetwork, ui
         && fSrc
         && pNetwork->MacTab.cPromiscuousNoTrunkEntries)
     {
-        iIfMac = pTab->cEntries;
-        while (iIfMac-- > 0)
+        iIfMac = pTab->iSpecialHead;
+        while (iIfMac != INTNET_MACTAB_NIL)
         {
-            if (   pTab->paEntries[iIfMac].fPromiscuousEff
-                && !pTab->paEntries[iIfMac].fPromiscuousSeeTrunk
-                && pTab->paEntries[iIfMac].fActive
-                && !intnetR0AreMacAddrsEqual(&pTab->paEntries[iIfMac].MacAddr, pDstAddr)
-                && !intnetR0IsMacAddrDummy(&pTab->paEntries[iIfMac].MacAddr) )
+            PINTNETMACTABENTRY pEntry = &pTab->paEntries[iIfMac];
+            if (   pEntry->fPromiscuousEff
+                && !pEntry->fPromiscuousSeeTrunk
+                && pEntry->fActive
+                && !intnetR0AreMacAddrsEqual(&pEntry->MacAddr, pDstAddr)
+                && !intnetR0IsMacAddrDummy(&pEntry->MacAddr) )
             {
-                PINTNETIF pIf    = pTab->paEntries[iIfMac].pIf;     AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
+                PINTNETIF pIf    = pEntry->pIf;                     AssertPtr(pIf); Assert(pIf->pNetwork == pNetwork);
                 uint32_t  iIfDst = pDstTab->cIfs++;
                 pDstTab->aIfs[iIfDst].pIf            = pIf;
                 pDstTab->aIfs[iIfDst].fReplaceDstMac = false;
                 intnetR0BusyIncIf(pIf);
             }
+            iIfMac = pEntry->iSpecialNext;
         }
     }
 
@@ -3775,7 +3866,10 @@ static INTNETSWDECISION intnetR0NetworkSend(PINTNETNETWORK pNetwork, PINTNETIF p
 
         PINTNETMACTABENTRY pIfEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIfSender);
         if (pIfEntry)
+        {
             pIfEntry->MacAddr = EthHdr.SrcMac;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
+        }
         pIfSender->MacAddr    = EthHdr.SrcMac;
 
         RTSpinlockRelease(pNetwork->hAddrSpinlock);
@@ -4146,6 +4240,8 @@ INTNETR0DECL(int) IntNetR0IfSetPromiscuousMode(INTNETIFHANDLE hIf, PSUPDRVSESSIO
                 }
                 Assert(pNetwork->MacTab.cPromiscuousEntries        <= pNetwork->MacTab.cEntries);
                 Assert(pNetwork->MacTab.cPromiscuousNoTrunkEntries <= pNetwork->MacTab.cEntries);
+
+                intnetR0MacTabRehash(&pNetwork->MacTab);
             }
         }
 
@@ -4223,7 +4319,10 @@ INTNETR0DECL(int) IntNetR0IfSetMacAddress(INTNETIFHANDLE hIf, PSUPDRVSESSION pSe
             /* Update the two copies. */
             PINTNETMACTABENTRY pEntry = intnetR0NetworkFindMacAddrEntry(pNetwork, pIf); Assert(pEntry);
             if (RT_LIKELY(pEntry))
+            {
                 pEntry->MacAddr = *pMac;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
+            }
             pIf->MacAddr        = *pMac;
             pIf->fMacSet        = true;
 
@@ -4717,6 +4816,7 @@ static DECLCALLBACK(void) intnetR0IfDestruct(void *pvObj, void *pvUser1, void *p
                             &pNetwork->MacTab.paEntries[iIf + 1],
                             (pNetwork->MacTab.cEntries - iIf - 1) * sizeof(pNetwork->MacTab.paEntries[0]));
                 pNetwork->MacTab.cEntries--;
+                intnetR0MacTabRehash(&pNetwork->MacTab);
                 break;
             }
 
@@ -4953,6 +5053,7 @@ static int intnetR0NetworkCreateIf(PINTNETNETWORK pNetwork, PSUPDRVSESSION pSess
                     pNetwork->MacTab.paEntries[iIf].pIf                  = pIf;
 
                     pNetwork->MacTab.cEntries = iIf + 1;
+                    intnetR0MacTabRehash(&pNetwork->MacTab);
                     pIf->pNetwork = pNetwork;
 
                     /*
@@ -5686,6 +5787,7 @@ static DECLCALLBACK(void) intnetR0NetworkDestruct(void *pvObj, void *pvUser1, vo
         {
             pIf->pNetwork = NULL;
             pNetwork->MacTab.cEntries--;
+            intnetR0MacTabRehash(&pNetwork->MacTab);
         }
     }
 
@@ -5885,6 +5987,8 @@ static int intnetR0AdaptOpenNetworkFlags(PINTNETNETWORK pNetwork, uint32_t fFlag
                     }
                 }
             }
+
+            intnetR0MacTabRehash(&pNetwork->MacTab);
         }
 
         RTSpinlockRelease(pNetwork->hAddrSpinlock);
@@ -6071,6 +6175,7 @@ static int intnetR0CreateNetwork(PINTNET pIntNet, PSUPDRVSESSION pSession, const
     //pNetwork->MacTab.cPromiscuousEntries  = 0;
     //pNetwork->MacTab.cPromiscuousNoTrunkEntries = 0;
     pNetwork->MacTab.paEntries              = NULL;
+    intnetR0MacTabRehash(&pNetwork->MacTab);
     pNetwork->MacTab.fHostPromiscuousReal   = false;
     pNetwork->MacTab.fHostPromiscuousEff    = false;
     pNetwork->MacTab.fHostActive            = false;
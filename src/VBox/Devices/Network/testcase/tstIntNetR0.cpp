@@ -101,6 +101,10 @@ static RTTEST           g_hTest      = NIL_RTTEST;
 static uint32_t         g_cbTransfer = _1M * 384;
 /** Fake session handle. */
 const PSUPDRVSESSION    g_pSession   = (PSUPDRVSESSION)0xdeadface;
+/** The number of interfaces for the switching benchmark. */
+static uint32_t         g_cSwitchIfs    = 256;
+/** The number of frames to switch in the switching benchmark. */
+static uint32_t         g_cSwitchFrames = _1M * 4;
 
 
 INTNETR3DECL(void *) SUPR0ObjRegister(PSUPDRVSESSION pSession, SUPDRVOBJTYPE enmType,
@@ -731,6 +735,113 @@ static void doTest(PTSTSTATE pThis, uint32_t cbRecv, uint32_t cbSend)
 }
 
 
+/**
+ * Unicast switching benchmark with many interfaces on one network.
+ *
+ * This calls the switching code directly to measure the cost of the
+ * destination lookup without the ring buffer and delivery overhead.
+ *
+ * @param   cIfs                The number of interfaces.
+ * @param   cFrames             The number of frames to switch.
+ * @param   cbRecv              The receive buffer size.
+ * @param   cbSend              The send buffer size.
+ */
+static void doSwitchBenchmark(uint32_t cIfs, uint32_t cFrames, uint32_t cbRecv, uint32_t cbSend)
+{
+    RTTestISubF("unicast switching benchmark, cIfs=%u, cFrames=%u", cIfs, cFrames);
+    if (cIfs < 2 || cIfs > INTNET_MAX_IFS)
+    {
+        RTTestIFailed("Invalid interface count %u\n", cIfs);
+        return;
+    }
+    RTTESTI_CHECK_RC_RETV(IntNetR0Init(), VINF_SUCCESS);
+
+    INTNETIFHANDLE *pahIfs  = (INTNETIFHANDLE *)RTMemAllocZ(sizeof(INTNETIFHANDLE) * cIfs);
+    PRTMAC          paMacs  = (PRTMAC)RTMemAllocZ(sizeof(RTMAC) * cIfs);
+    PINTNETDSTTAB   pDstTab = NULL;
+    uint32_t        cOpened = 0;
+    if (pahIfs && paMacs)
+    {
+        /*
+         * Open the interfaces, give them MAC addresses and activate them.
+         */
+        for (; cOpened < cIfs; cOpened++)
+        {
+            pahIfs[cOpened] = INTNET_HANDLE_INVALID;
+            int rc = IntNetR0Open(g_pSession, "switch", kIntNetTrunkType_None, "", 0 /*fFlags*/, cbSend, cbRecv,
+                                  &pahIfs[cOpened]);
+            if (RT_FAILURE(rc))
+            {
+                RTTestIFailed("IntNetR0Open #%u failed: %Rrc\n", cOpened, rc);
+                break;
+            }
+
+            paMacs[cOpened].au8[0] = 0x08;
+            paMacs[cOpened].au8[1] = 0x00;
+            paMacs[cOpened].au8[2] = 0x27;
+            paMacs[cOpened].au8[3] = (uint8_t)(cOpened >> 16);
+            paMacs[cOpened].au8[4] = (uint8_t)(cOpened >> 8);
+            paMacs[cOpened].au8[5] = (uint8_t)cOpened;
+            RTTESTI_CHECK_RC(IntNetR0IfSetMacAddress(pahIfs[cOpened], g_pSession, &paMacs[cOpened]), VINF_SUCCESS);
+            RTTESTI_CHECK_RC(IntNetR0IfSetActive(pahIfs[cOpened], g_pSession, true), VINF_SUCCESS);
+        }
+
+        /*
+         * Switch frames from the first interface to random destinations.
+         */
+        PINTNETIF pIfSender = NULL;
+        if (cOpened == cIfs && !RTTestIErrorCount())
+            pIfSender = (PINTNETIF)RTHandleTableLookupWithCtx(g_pIntNet->hHtIfs, pahIfs[0], g_pSession);
+        if (pIfSender)
+        {
+            PINTNETNETWORK pNetwork = pIfSender->pNetwork;
+            RTTESTI_CHECK_RC_OK(intnetR0AllocDstTab(pNetwork->MacTab.cEntriesAllocated, &pDstTab));
+            if (pDstTab)
+            {
+                uint32_t cMisrouted = 0;
+                uint32_t uSeed      = 0x12345678;
+                uint64_t nsStart    = RTTimeNanoTS();
+                for (uint32_t iFrame = 0; iFrame < cFrames; iFrame++)
+                {
+                    uSeed = uSeed * 1103515245 + 12345;
+                    uint32_t const iDst = 1 + (uSeed >> 8) % (cIfs - 1);
+
+                    INTNETSWDECISION enmSwDecision = intnetR0NetworkSwitchUnicast(pNetwork, 0 /*fSrc*/, pIfSender,
+                                                                                  &paMacs[iDst], pDstTab);
+                    if (RT_UNLIKELY(   enmSwDecision != INTNETSWDECISION_INTNET
+                                    || pDstTab->cIfs != 1
+                                    || pDstTab->aIfs[0].pIf->hIf != pahIfs[iDst]))
+                        cMisrouted++;
+                    intnetR0NetworkReleaseDstTab(pNetwork, pDstTab);
+                }
+                uint64_t cNsElapsed = RTTimeNanoTS() - nsStart;
+
+                if (cMisrouted)
+                    RTTestIFailed("%u of %u frames were misrouted\n", cMisrouted, cFrames);
+                RTTestIValue("Switching", cNsElapsed / cFrames, RTTESTUNIT_NS_PER_CALL);
+                RTTestIValue("Frame rate", (uint64_t)(cFrames * 1000000000.0 / RT_MAX(cNsElapsed, 1)),
+                             RTTESTUNIT_PACKETS_PER_SEC);
+                RTMemFree(pDstTab);
+            }
+            intnetR0IfRelease(pIfSender, g_pSession);
+        }
+
+        /*
+         * Close the interfaces.
+         */
+        while (cOpened-- > 0)
+            RTTESTI_CHECK_RC_OK(IntNetR0IfClose(pahIfs[cOpened], g_pSession));
+        RTTESTI_CHECK(IntNetR0GetNetworkCount() == 0);
+    }
+    else
+        RTTestIFailed("Out of memory\n");
+
+    RTMemFree(paMacs);
+    RTMemFree(pahIfs);
+    IntNetR0Term();
+}
+
+
 int main(int argc, char **argv)
 {
     int rc = RTTestInitAndCreate("tstIntNetR0", &g_hTest);
@@ -745,6 +856,8 @@ int main(int argc, char **argv)
         { "--recv-buffer",   'r', RTGETOPT_REQ_UINT32 },
         { "--send-buffer",   's', RTGETOPT_REQ_UINT32 },
         { "--transfer-size", 'l', RTGETOPT_REQ_UINT32 },
+        { "--switch-ifs",    'i', RTGETOPT_REQ_UINT32 },
+        { "--switch-frames", 'f', RTGETOPT_REQ_UINT32 },
     };
 
     uint32_t cbSend = 1536*2 + 4;
@@ -769,6 +882,14 @@ int main(int argc, char **argv)
                 cbSend = Value.u32;
                 break;
 
+            case 'i':
+                g_cSwitchIfs = Value.u32;
+                break;
+
+            case 'f':
+                g_cSwitchFrames = Value.u32;
+                break;
+
             default:
                 return RTGetOptPrintError(ch, &Value);
         }
@@ -779,6 +900,8 @@ int main(int argc, char **argv)
     TSTSTATE This;
     RT_ZERO(This);
     doTest(&This, cbRecv, cbSend);
+    if (!RTTestErrorCount(g_hTest))
+        doSwitchBenchmark(g_cSwitchIfs, g_cSwitchFrames, cbRecv, cbSend);
 
     return RTTestSummaryAndDestroy(g_hTest);
 }
@@ -0,0 +1,1315 @@
+/* $Id$ */
+/** @file
+ * DevVirtioBlk - Virtio Block Device
+ */
+
+/*
+ * Copyright (C) 2014 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_DEV_VIRTIO_BLK
+#define VBLK_GC_SUPPORT
+
+#include <VBox/vmm/pdmdev.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#ifdef IN_RING3
+# include <iprt/mem.h>
+# include <iprt/time.h>
+#endif /* IN_RING3 */
+#include "VBoxDD.h"
+#include "../VirtIO/Virtio.h"
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+#ifndef VBOX_DEVICE_STRUCT_TESTCASE
+
+#define INSTANCE(pThis) pThis->VPCI.szInstance
+
+#ifdef IN_RING3
+
+#define VBLK_PCI_SUBSYSTEM_ID        (1 + VIRTIO_BLK_ID)
+#define VBLK_PCI_CLASS               0x0180
+#define VBLK_N_QUEUES                1
+#define VBLK_NAME_FMT                "VBlk%d"
+
+#endif /* IN_RING3 */
+
+#endif /* VBOX_DEVICE_STRUCT_TESTCASE */
+
+
+/** Size of the request queue, i.e. the maximum number of requests in flight. */
+#define VBLK_QUEUE_SIZE              256
+/** Sector size the guest uses to address the device, independent of blk_size. */
+#define VBLK_SECTOR_SIZE             512
+/** Maximum number of data segments in a single request (queue size minus header and status). */
+#define VBLK_MAX_SEGS                (VBLK_QUEUE_SIZE - 2)
+/** Maximum size of a single read or write request, anything larger fails with an I/O error. */
+#define VBLK_MAX_XFER_SIZE           (32 * _1M)
+/** Maximum size of a single data segment, advertised in size_max.  Together with
+ * seg_max this keeps requests of guests honoring both below VBLK_MAX_XFER_SIZE. */
+#define VBLK_MAX_SEG_SIZE            _128K
+AssertCompile(VBLK_MAX_SEG_SIZE * VBLK_MAX_SEGS <= VBLK_MAX_XFER_SIZE);
+/** Maximum number of sectors a single discard range may cover. */
+#define VBLK_MAX_DISCARD_SECTORS     (_4M - 1)
+/** Maximum number of ranges in a single discard request. */
+#define VBLK_MAX_DISCARD_SEGS        16
+
+/** @name Virtio block features
+ * @{  */
+#define VBLK_F_SIZE_MAX   0x00000002  /**< Maximum size of any single segment is in size_max. */
+#define VBLK_F_SEG_MAX    0x00000004  /**< Maximum number of segments in a request is in seg_max. */
+#define VBLK_F_GEOMETRY   0x00000010  /**< Disk-style geometry specified in geometry. */
+#define VBLK_F_RO         0x00000020  /**< Device is read-only. */
+#define VBLK_F_BLK_SIZE   0x00000040  /**< Block size of disk is in blk_size. */
+#define VBLK_F_FLUSH      0x00000200  /**< Cache flush command support. */
+#define VBLK_F_TOPOLOGY   0x00000400  /**< Device exports information on optimal I/O alignment. */
+#define VBLK_F_DISCARD    0x00002000  /**< Device can support discard command. */
+/** @} */
+
+/** @name Virtio block request types
+ * @{  */
+#define VBLK_T_IN         0
+#define VBLK_T_OUT        1
+#define VBLK_T_FLUSH      4
+#define VBLK_T_GET_ID     8
+#define VBLK_T_DISCARD    11
+/** @} */
+
+/** @name Virtio block request status codes
+ * @{  */
+#define VBLK_S_OK         0
+#define VBLK_S_IOERR      1
+#define VBLK_S_UNSUPP     2
+/** @} */
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+#pragma pack(1)
+struct VBlkPCIConfig
+{
+    uint64_t u64Capacity;           /**< Capacity in 512 byte sectors. */
+    uint32_t u32SizeMax;
+    uint32_t u32SegMax;
+    uint16_t u16Cylinders;
+    uint8_t  u8Heads;
+    uint8_t  u8Sectors;
+    uint32_t u32BlkSize;
+    uint8_t  u8PhysBlkExp;
+    uint8_t  u8AlignmentOffset;
+    uint16_t u16MinIoSize;
+    uint32_t u32OptIoSize;
+    uint8_t  u8Writeback;
+    uint8_t  au8Unused0[3];
+    uint32_t u32MaxDiscardSectors;
+    uint32_t u32MaxDiscardSeg;
+    uint32_t u32DiscardSectorAlignment;
+};
+#pragma pack()
+AssertCompileMemberOffset(struct VBlkPCIConfig, u32BlkSize, 20);
+AssertCompileMemberOffset(struct VBlkPCIConfig, u8Writeback, 32);
+AssertCompileSize(struct VBlkPCIConfig, 48);
+
+/**
+ * Device state structure. Holds the current state of device.
+ *
+ * @extends     VPCISTATE
+ * @implements  PDMIBLOCKPORT
+ * @implements  PDMIBLOCKASYNCPORT
+ */
+typedef struct VBlkState_st
+{
+    /* VPCISTATE must be the first member! */
+    VPCISTATE               VPCI;
+
+    /** The block port interface. */
+    PDMIBLOCKPORT           IPort;
+    /** The asynchronous block port interface. */
+    PDMIBLOCKASYNCPORT      IPortAsync;
+    /** Attached block driver - base interface. */
+    R3PTRTYPE(PPDMIBASE)    pDrvBase;
+    /** Attached block driver - block interface. */
+    R3PTRTYPE(PPDMIBLOCK)   pDrvBlock;
+    /** Attached block driver - asynchronous block interface, NULL if not supported. */
+    R3PTRTYPE(PPDMIBLOCKASYNC) pDrvBlockAsync;
+    /** The request queue. */
+    R3PTRTYPE(PVQUEUE)      pReqQueue;
+
+    /** PCI config area holding the disk parameters. */
+    struct VBlkPCIConfig    config;
+
+    /** Size of the medium in bytes. */
+    uint64_t                cbSize;
+    /** Logical sector size of the medium. */
+    uint32_t                cbSector;
+    /** Flag whether the medium is read-only. */
+    bool                    fReadOnly;
+    /** Flag whether the attached driver supports discarding ranges. */
+    bool                    fDiscard;
+    /** Indicates that PDMDevHlpAsyncNotificationCompleted should be called when
+     * the number of active requests drops to zero. */
+    bool volatile           fSignalIdle;
+    bool                    afPadding[1];
+    /** Number of requests submitted to the driver and not completed yet. */
+    volatile uint32_t       cReqsActive;
+    /** Incremented on every device reset, completions of requests submitted
+     * before the reset are not reported to the guest. */
+    volatile uint32_t       uGeneration;
+
+    /** @name Statistic
+     * @{ */
+    STAMCOUNTER             StatReadBytes;
+    STAMCOUNTER             StatWriteBytes;
+    STAMCOUNTER             StatReqsRead;
+    STAMCOUNTER             StatReqsWrite;
+    STAMCOUNTER             StatReqsFlush;
+    STAMCOUNTER             StatReqsDiscard;
+    STAMCOUNTER             StatReqsFailed;
+    STAMCOUNTER             StatReqsUnsupported;
+    STAMPROFILE             StatLatencyRead;
+    STAMPROFILE             StatLatencyWrite;
+    STAMPROFILE             StatLatencyFlush;
+#if defined(VBOX_WITH_STATISTICS)
+    STAMPROFILE             StatQueueNotify;
+#endif /* VBOX_WITH_STATISTICS */
+    /** @}  */
+} VBLKSTATE;
+/** Pointer to a virtual I/O block device state. */
+typedef VBLKSTATE *PVBLKSTATE;
+
+#ifndef VBOX_DEVICE_STRUCT_TESTCASE
+
+AssertCompileMemberOffset(VBLKSTATE, VPCI, 0);
+AssertCompileMemberAlignment(VBLKSTATE, StatReadBytes, 8);
+
+/**
+ * The request header the guest puts into the first descriptor of a chain.
+ */
+struct VBlkReqHdr
+{
+    uint32_t u32Type;
+    uint32_t u32IoPrio;
+    uint64_t u64Sector;
+};
+typedef struct VBlkReqHdr VBLKREQHDR;
+AssertCompileSize(VBLKREQHDR, 16);
+
+/**
+ * One range of a discard request.
+ */
+struct VBlkDiscardSeg
+{
+    uint64_t u64Sector;
+    uint32_t u32NumSectors;
+    uint32_t u32Flags;
+};
+typedef struct VBlkDiscardSeg VBLKDISCARDSEG;
+AssertCompileSize(VBLKDISCARDSEG, 16);
+
+/**
+ * A request in flight.
+ *
+ * Only the guest addresses of the data segments are kept instead of a full
+ * VQUEUEELEM, which is far too big to allocate for every request.
+ */
+typedef struct VBLKREQ
+{
+    /** The device state. */
+    PVBLKSTATE      pThis;
+    /** Index of the head descriptor, returned to the guest on completion. */
+    uint32_t        uIndex;
+    /** Device generation the request was submitted in. */
+    uint32_t        uGeneration;
+    /** Request type (VBLK_T_XXX). */
+    uint32_t        u32Type;
+    /** Status to report if the request is not passed to the driver (VBLK_S_XXX). */
+    uint8_t         u8Status;
+    /** Guest physical address of the status byte. */
+    RTGCPHYS        GCPhysStatus;
+    /** Start offset on the medium in bytes. */
+    uint64_t        off;
+    /** Number of bytes to transfer. */
+    size_t          cbXfer;
+    /** The bounce buffer. */
+    void           *pvBuf;
+    /** Size of the bounce buffer. */
+    size_t          cbBuf;
+    /** The S/G segment describing the bounce buffer. */
+    RTSGSEG         Seg;
+    /** Array of ranges for discard requests. */
+    PRTRANGE        paRanges;
+    /** Number of ranges in the array. */
+    unsigned        cRanges;
+    /** Timestamp when the request was submitted. */
+    uint64_t        tsStart;
+    /** Number of guest data segments. */
+    uint32_t        cSegs;
+    /** The guest data segments. */
+    VQUEUESEG       aSegs[1];
+} VBLKREQ;
+/** Pointer to a request in flight. */
+typedef VBLKREQ *PVBLKREQ;
+
+#define PDMIBLOCKPORT_2_VBLKSTATE(pInterface)       ( (PVBLKSTATE)((uintptr_t)(pInterface) - RT_OFFSETOF(VBLKSTATE, IPort)) )
+#define PDMIBLOCKASYNCPORT_2_VBLKSTATE(pInterface)  ( (PVBLKSTATE)((uintptr_t)(pInterface) - RT_OFFSETOF(VBLKSTATE, IPortAsync)) )
+
+DECLINLINE(int) vblkCsEnter(PVBLKSTATE pThis, int rcBusy)
+{
+    return vpciCsEnter(&pThis->VPCI, rcBusy);
+}
+
+DECLINLINE(void) vblkCsLeave(PVBLKSTATE pThis)
+{
+    vpciCsLeave(&pThis->VPCI);
+}
+
+
+static DECLCALLBACK(uint32_t) vblkIoCb_GetHostFeatures(void *pvState)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+
+    /* We support:
+     * - Maximum number of segments per request and maximum segment size
+     * - Logical block size reporting
+     * - Cache flushes
+     * - Physical block size (topology) reporting
+     * - Read-only media
+     * - Discarding ranges if the driver below supports it
+     */
+    return VBLK_F_SEG_MAX
+        | VBLK_F_SIZE_MAX
+        | VBLK_F_BLK_SIZE
+        | VBLK_F_FLUSH
+        | VBLK_F_TOPOLOGY
+        | (pThis->fReadOnly ? VBLK_F_RO : 0)
+        | (pThis->fDiscard ? VBLK_F_DISCARD : 0);
+}
+
+static DECLCALLBACK(uint32_t) vblkIoCb_GetHostMinimalFeatures(void *pvState)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    return pThis->fReadOnly ? VBLK_F_RO : 0;
+}
+
+static DECLCALLBACK(void) vblkIoCb_SetHostFeatures(void *pvState, uint32_t fFeatures)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    LogFlow(("%s vblkIoCb_SetHostFeatures: uFeatures=%x\n", INSTANCE(pThis), fFeatures));
+}
+
+static DECLCALLBACK(int) vblkIoCb_GetConfig(void *pvState, uint32_t offCfg, uint32_t cb, void *data)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    if (offCfg + cb > sizeof(struct VBlkPCIConfig))
+    {
+        Log(("%s vblkIoCb_GetConfig: Read beyond the config structure is attempted (offCfg=%#x cb=%x).\n", INSTANCE(pThis), offCfg, cb));
+        return VERR_IOM_IOPORT_UNUSED;
+    }
+    memcpy(data, (uint8_t *)&pThis->config + offCfg, cb);
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) vblkIoCb_SetConfig(void *pvState, uint32_t offCfg, uint32_t cb, void *data)
+{
+    /* The disk parameters are read-only for the guest. */
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    Log(("%s vblkIoCb_SetConfig: Ignoring write to the config structure (offCfg=%#x cb=%x).\n", INSTANCE(pThis), offCfg, cb));
+    return VINF_SUCCESS;
+}
+
+/**
+ * Hardware reset. Revert all registers to initial values.
+ *
+ * Requests still in flight when the guest resets the device are completed by
+ * the driver later on but are not reported to the guest anymore because the
+ * rings they came from are gone. A VM reset waits for them, see vblkReset.
+ * The device critical section keeps vblkR3ReqComplete out while the rings are
+ * torn down.
+ *
+ * @param   pThis      The device state structure.
+ */
+static DECLCALLBACK(int) vblkIoCb_Reset(void *pvState)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    Log(("%s Reset triggered\n", INSTANCE(pThis)));
+
+#ifndef IN_RING3
+    return VINF_IOM_R3_IOPORT_WRITE;
+#else
+    int rc = vblkCsEnter(pThis, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+    {
+        LogRel(("vblkIoCb_Reset failed to enter critical section!\n"));
+        return rc;
+    }
+    ASMAtomicIncU32(&pThis->uGeneration);
+    vpciReset(&pThis->VPCI);
+    vblkCsLeave(pThis);
+    return VINF_SUCCESS;
+#endif
+}
+
+/**
+ * This function is called when the driver becomes ready.
+ *
+ * @param   pThis      The device state structure.
+ */
+static DECLCALLBACK(void) vblkIoCb_Ready(void *pvState)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    Log(("%s Driver became ready\n", INSTANCE(pThis)));
+}
+
+
+/**
+ * I/O port callbacks.
+ */
+static const VPCIIOCALLBACKS g_IOCallbacks =
+{
+     vblkIoCb_GetHostFeatures,
+     vblkIoCb_GetHostMinimalFeatures,
+     vblkIoCb_SetHostFeatures,
+     vblkIoCb_GetConfig,
+     vblkIoCb_SetConfig,
+     vblkIoCb_Reset,
+     vblkIoCb_Ready,
+};
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTIN}
+ */
+PDMBOTHCBDECL(int) vblkIOPortIn(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port, uint32_t *pu32, unsigned cb)
+{
+    return vpciIOPortIn(pDevIns, pvUser, port, pu32, cb, &g_IOCallbacks);
+}
+
+
+/**
+ * @callback_method_impl{FNIOMIOPORTOUT}
+ */
+PDMBOTHCBDECL(int) vblkIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port, uint32_t u32, unsigned cb)
+{
+    return vpciIOPortOut(pDevIns, pvUser, port, u32, cb, &g_IOCallbacks);
+}
+
+
+#ifdef IN_RING3
+
+/**
+ * Frees a request and signals the suspend/power off code if it was the last
+ * one in flight.
+ *
+ * @param   pThis      The device state structure.
+ * @param   pReq       The request to free.
+ */
+static void vblkR3ReqFree(PVBLKSTATE pThis, PVBLKREQ pReq)
+{
+    if (pReq->pvBuf)
+        pThis->pDrvBlock->pfnIoBufFree(pThis->pDrvBlock, pReq->pvBuf, pReq->cbBuf);
+    if (pReq->paRanges)
+        RTMemFree(pReq->paRanges);
+    RTMemFree(pReq);
+
+    uint32_t cReqsActive = ASMAtomicDecU32(&pThis->cReqsActive);
+    if (!cReqsActive && pThis->fSignalIdle)
+        PDMDevHlpAsyncNotificationCompleted(pThis->VPCI.pDevInsR3);
+}
+
+/**
+ * Completes a request, copying read data and the status to the guest and
+ * returning the descriptor chain.
+ *
+ * @param   pThis      The device state structure.
+ * @param   pReq       The request to complete.
+ * @param   rcReq      Status code of the driver for the request.
+ * @thread  Any thread.
+ */
+static void vblkR3ReqComplete(PVBLKSTATE pThis, PVBLKREQ pReq, int rcReq)
+{
+    PPDMDEVINS pDevIns = pThis->VPCI.pDevInsR3;
+    uint8_t    u8Status = pReq->u8Status;
+    uint32_t   cbWritten = sizeof(u8Status);
+    uint64_t   cNsElapsed = RTTimeNanoTS() - pReq->tsStart;
+
+    if (u8Status == VBLK_S_OK && RT_FAILURE(rcReq))
+    {
+        LogRel(("%s: %s request at offset %llu (%zu bytes) failed with %Rrc\n", INSTANCE(pThis),
+                pReq->u32Type == VBLK_T_IN ? "Read" : pReq->u32Type == VBLK_T_OUT ? "Write" : "Flush/discard",
+                pReq->off, pReq->cbXfer, rcReq));
+        u8Status = VBLK_S_IOERR;
+    }
+
+    switch (pReq->u32Type)
+    {
+        case VBLK_T_IN:
+            vpciSetReadLed(&pThis->VPCI, false);
+            STAM_REL_PROFILE_ADD_PERIOD(&pThis->StatLatencyRead, cNsElapsed);
+            if (u8Status == VBLK_S_OK)
+            {
+                cbWritten += (uint32_t)pReq->cbXfer;
+                STAM_REL_COUNTER_ADD(&pThis->StatReadBytes, pReq->cbXfer);
+            }
+            break;
+        case VBLK_T_OUT:
+            vpciSetWriteLed(&pThis->VPCI, false);
+            STAM_REL_PROFILE_ADD_PERIOD(&pThis->StatLatencyWrite, cNsElapsed);
+            if (u8Status == VBLK_S_OK)
+                STAM_REL_COUNTER_ADD(&pThis->StatWriteBytes, pReq->cbXfer);
+            break;
+        case VBLK_T_FLUSH:
+            STAM_REL_PROFILE_ADD_PERIOD(&pThis->StatLatencyFlush, cNsElapsed);
+            break;
+        default:
+            break;
+    }
+
+    if (u8Status == VBLK_S_IOERR)
+        STAM_REL_COUNTER_INC(&pThis->StatReqsFailed);
+
+    /*
+     * Report the request to the guest unless the device was reset while it was
+     * in flight, the guest might have reused the buffers and the queue might
+     * live somewhere else by now. The check and all guest memory accesses must
+     * happen with the device lock held so a reset can't sneak in between.
+     */
+    int rc = vblkCsEnter(pThis, VERR_SEM_BUSY);
+    if (RT_SUCCESS(rc))
+    {
+        if (   pReq->uGeneration == ASMAtomicReadU32(&pThis->uGeneration)
+            && vqueueIsReady(&pThis->VPCI, pThis->pReqQueue))
+        {
+            if (   pReq->u32Type == VBLK_T_IN
+                && u8Status == VBLK_S_OK)
+            {
+                uint8_t *pbBuf = (uint8_t *)pReq->pvBuf;
+                for (uint32_t i = 0; i < pReq->cSegs; i++)
+                {
+                    PDMDevHlpPCIPhysWrite(pDevIns, pReq->aSegs[i].addr, pbBuf, pReq->aSegs[i].cb);
+                    pbBuf += pReq->aSegs[i].cb;
+                }
+            }
+            PDMDevHlpPCIPhysWrite(pDevIns, pReq->GCPhysStatus, &u8Status, sizeof(u8Status));
+            vqueuePutIndex(&pThis->VPCI, pThis->pReqQueue, pReq->uIndex, cbWritten);
+            vqueueSync(&pThis->VPCI, pThis->pReqQueue);
+        }
+        else
+            Log(("%s vblkR3ReqComplete: Dropping completion of request submitted before the last reset\n", INSTANCE(pThis)));
+        vblkCsLeave(pThis);
+    }
+    else
+        AssertRC(rc);
+
+    vblkR3ReqFree(pThis, pReq);
+}
+
+/**
+ * Submits a request to the attached driver, either asynchronously or
+ * synchronously on the EMT if the driver has no asynchronous interface.
+ *
+ * @param   pThis      The device state structure.
+ * @param   pReq       The request to submit.
+ */
+static void vblkR3ReqSubmit(PVBLKSTATE pThis, PVBLKREQ pReq)
+{
+    int rc = VINF_SUCCESS;
+
+    pReq->tsStart = RTTimeNanoTS();
+
+    /* Failed and zero-length requests complete right away. */
+    if (   pReq->u8Status != VBLK_S_OK
+        || (   (pReq->u32Type == VBLK_T_IN || pReq->u32Type == VBLK_T_OUT)
+            && !pReq->cbXfer))
+    {
+        vblkR3ReqComplete(pThis, pReq, VINF_SUCCESS);
+        return;
+    }
+
+    if (pThis->pDrvBlockAsync)
+    {
+        switch (pReq->u32Type)
+        {
+            case VBLK_T_IN:
+                rc = pThis->pDrvBlockAsync->pfnStartRead(pThis->pDrvBlockAsync, pReq->off, &pReq->Seg, 1,
+                                                         pReq->cbXfer, pReq);
+                break;
+            case VBLK_T_OUT:
+                rc = pThis->pDrvBlockAsync->pfnStartWrite(pThis->pDrvBlockAsync, pReq->off, &pReq->Seg, 1,
+                                                          pReq->cbXfer, pReq);
+                break;
+            case VBLK_T_FLUSH:
+                rc = pThis->pDrvBlockAsync->pfnStartFlush(pThis->pDrvBlockAsync, pReq);
+                break;
+            case VBLK_T_DISCARD:
+                if (pThis->pDrvBlockAsync->pfnStartDiscard)
+                    rc = pThis->pDrvBlockAsync->pfnStartDiscard(pThis->pDrvBlockAsync, pReq->paRanges,
+                                                                pReq->cRanges, pReq);
+                else
+                    rc = pThis->pDrvBlock->pfnDiscard(pThis->pDrvBlock, pReq->paRanges, pReq->cRanges);
+                break;
+            default:
+                AssertMsgFailed(("Invalid request type %u\n", pReq->u32Type));
+                rc = VERR_INVALID_PARAMETER;
+        }
+
+        if (rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+            return;
+        if (rc == VINF_VD_ASYNC_IO_FINISHED)
+            rc = VINF_SUCCESS;
+    }
+    else
+    {
+        switch (pReq->u32Type)
+        {
+            case VBLK_T_IN:
+                rc = pThis->pDrvBlock->pfnRead(pThis->pDrvBlock, pReq->off, pReq->pvBuf, pReq->cbXfer);
+                break;
+            case VBLK_T_OUT:
+                rc = pThis->pDrvBlock->pfnWrite(pThis->pDrvBlock, pReq->off, pReq->pvBuf, pReq->cbXfer);
+                break;
+            case VBLK_T_FLUSH:
+                rc = pThis->pDrvBlock->pfnFlush(pThis->pDrvBlock);
+                break;
+            case VBLK_T_DISCARD:
+                rc = pThis->pDrvBlock->pfnDiscard(pThis->pDrvBlock, pReq->paRanges, pReq->cRanges);
+                break;
+            default:
+                AssertMsgFailed(("Invalid request type %u\n", pReq->u32Type));
+                rc = VERR_INVALID_PARAMETER;
+        }
+    }
+
+    vblkR3ReqComplete(pThis, pReq, rc);
+}
+
+/**
+ * Parses a descriptor chain into a request and fetches the data the guest
+ * wants written.
+ *
+ * Malformed requests are turned into requests which complete with an error
+ * status right away. NULL is only returned for chains which are too broken to
+ * even report a status to the guest.
+ *
+ * @returns Pointer to the new request or NULL.
+ * @param   pThis      The device state structure.
+ * @param   pElem      The descriptor chain.
+ */
+static PVBLKREQ vblkR3ReqCreate(PVBLKSTATE pThis, PVQUEUEELEM pElem)
+{
+    PPDMDEVINS  pDevIns = pThis->VPCI.pDevInsR3;
+    VBLKREQHDR  Hdr;
+
+    if (   pElem->nOut < 1
+        || pElem->aSegsOut[0].cb < sizeof(Hdr)
+        || pElem->nIn < 1
+        || pElem->aSegsIn[pElem->nIn - 1].cb < 1)
+    {
+        LogRel(("%s: Malformed request (nOut=%u nIn=%u), dropping it\n", INSTANCE(pThis), pElem->nOut, pElem->nIn));
+        return NULL;
+    }
+
+    PDMDevHlpPhysRead(pDevIns, pElem->aSegsOut[0].addr, &Hdr, sizeof(Hdr));
+
+    /* The data segments, the status byte is the last byte of the last IN segment. */
+    bool       fRead = Hdr.u32Type == VBLK_T_IN;
+    uint32_t   cSegs = fRead ? pElem->nIn : pElem->nOut - 1;
+    VQUEUESEG *paSegs = fRead ? &pElem->aSegsIn[0] : &pElem->aSegsOut[1];
+
+    PVBLKREQ pReq = (PVBLKREQ)RTMemAllocZ(RT_OFFSETOF(VBLKREQ, aSegs[RT_MAX(cSegs, 1)]));
+    if (!pReq)
+        return NULL;
+
+    pReq->pThis        = pThis;
+    pReq->uIndex       = pElem->uIndex;
+    pReq->uGeneration  = pThis->uGeneration;
+    pReq->u32Type      = Hdr.u32Type;
+    pReq->u8Status     = VBLK_S_OK;
+    pReq->GCPhysStatus = pElem->aSegsIn[pElem->nIn - 1].addr + pElem->aSegsIn[pElem->nIn - 1].cb - 1;
+    pReq->off          = Hdr.u64Sector * VBLK_SECTOR_SIZE;
+    pReq->cSegs        = cSegs;
+
+    size_t cbData = 0;
+    for (uint32_t i = 0; i < cSegs; i++)
+    {
+        pReq->aSegs[i] = paSegs[i];
+        cbData += paSegs[i].cb;
+    }
+    /* The status byte is not part of the read data. */
+    if (fRead)
+    {
+        pReq->aSegs[cSegs - 1].cb--;
+        cbData--;
+    }
+
+    switch (Hdr.u32Type)
+    {
+        case VBLK_T_IN:
+        case VBLK_T_OUT:
+        {
+            STAM_REL_COUNTER_INC(fRead ? &pThis->StatReqsRead : &pThis->StatReqsWrite);
+            if (   cbData % VBLK_SECTOR_SIZE
+                || cbData > VBLK_MAX_XFER_SIZE
+                || pReq->off > pThis->cbSize
+                || cbData > pThis->cbSize - pReq->off
+                || (!fRead && pThis->fReadOnly))
+            {
+                Log(("%s vblkR3ReqCreate: Invalid %s request off=%llu cb=%zu\n", INSTANCE(pThis),
+                     fRead ? "read" : "write", pReq->off, cbData));
+                pReq->u8Status = VBLK_S_IOERR;
+                break;
+            }
+
+            pReq->cbXfer = cbData;
+            if (!cbData)
+                break;
+
+            pReq->cbBuf = cbData;
+            int rc = pThis->pDrvBlock->pfnIoBufAlloc(pThis->pDrvBlock, pReq->cbBuf, &pReq->pvBuf);
+            if (RT_FAILURE(rc))
+            {
+                pReq->pvBuf    = NULL;
+                pReq->u8Status = VBLK_S_IOERR;
+                break;
+            }
+            pReq->Seg.pvSeg = pReq->pvBuf;
+            pReq->Seg.cbSeg = pReq->cbBuf;
+
+            if (!fRead)
+            {
+                uint8_t *pbBuf = (uint8_t *)pReq->pvBuf;
+                for (uint32_t i = 0; i < cSegs; i++)
+                {
+                    PDMDevHlpPhysRead(pDevIns, pReq->aSegs[i].addr, pbBuf, pReq->aSegs[i].cb);
+                    pbBuf += pReq->aSegs[i].cb;
+                }
+                vpciSetWriteLed(&pThis->VPCI, true);
+            }
+            else
+                vpciSetReadLed(&pThis->VPCI, true);
+            break;
+        }
+        case VBLK_T_FLUSH:
+            STAM_REL_COUNTER_INC(&pThis->StatReqsFlush);
+            break;
+        case VBLK_T_DISCARD:
+        {
+            STAM_REL_COUNTER_INC(&pThis->StatReqsDiscard);
+            unsigned cRanges = (unsigned)(cbData / sizeof(VBLKDISCARDSEG));
+            if (   !pThis->fDiscard
+                || pThis->fReadOnly
+                || !cRanges
+                || cRanges > VBLK_MAX_DISCARD_SEGS)
+            {
+                pReq->u8Status = pThis->fDiscard ? VBLK_S_IOERR : VBLK_S_UNSUPP;
+                break;
+            }
+
+            VBLKDISCARDSEG aDiscardSegs[VBLK_MAX_DISCARD_SEGS];
+            uint8_t *pbDst = (uint8_t *)&aDiscardSegs[0];
+            size_t   cbLeft = cRanges * sizeof(VBLKDISCARDSEG);
+            for (uint32_t i = 0; i < cSegs && cbLeft; i++)
+            {
+                size_t cbThis = RT_MIN(cbLeft, pReq->aSegs[i].cb);
+                PDMDevHlpPhysRead(pDevIns, pReq->aSegs[i].addr, pbDst, cbThis);
+                pbDst  += cbThis;
+                cbLeft -= cbThis;
+            }
+
+            pReq->paRanges = (PRTRANGE)RTMemAllocZ(cRanges * sizeof(RTRANGE));
+            if (!pReq->paRanges)
+            {
+                pReq->u8Status = VBLK_S_IOERR;
+                break;
+            }
+            pReq->cRanges = cRanges;
+            for (unsigned i = 0; i < cRanges; i++)
+            {
+                uint64_t offStart = aDiscardSegs[i].u64Sector * VBLK_SECTOR_SIZE;
+                size_t   cbRange  = (size_t)aDiscardSegs[i].u32NumSectors * VBLK_SECTOR_SIZE;
+                if (   aDiscardSegs[i].u32NumSectors > VBLK_MAX_DISCARD_SECTORS
+                    || offStart > pThis->cbSize
+                    || cbRange > pThis->cbSize - offStart)
+                {
+                    pReq->u8Status = VBLK_S_IOERR;
+                    break;
+                }
+                pReq->paRanges[i].offStart = offStart;
+                pReq->paRanges[i].cbRange  = cbRange;
+            }
+            break;
+        }
+        default:
+            /* VBLK_T_GET_ID and anything we don't know about. */
+            Log(("%s vblkR3ReqCreate: Unsupported request type %u\n", INSTANCE(pThis), Hdr.u32Type));
+            STAM_REL_COUNTER_INC(&pThis->StatReqsUnsupported);
+            pReq->u8Status = VBLK_S_UNSUPP;
+            break;
+    }
+
+    return pReq;
+}
+
+/**
+ * Queue notification callback, fetches all available requests and submits
+ * them to the driver.
+ *
+ * @param   pvState     The device state structure.
+ * @param   pQueue      The request queue.
+ * @thread  EMT
+ */
+static DECLCALLBACK(void) vblkQueueRequest(void *pvState, PVQUEUE pQueue)
+{
+    PVBLKSTATE pThis = (PVBLKSTATE)pvState;
+    VQUEUEELEM elem;
+
+    if (!pThis->pDrvBlock)
+    {
+        Log(("%s vblkQueueRequest: No medium attached, ignoring notification\n", INSTANCE(pThis)));
+        return;
+    }
+
+    STAM_PROFILE_START(&pThis->StatQueueNotify, a);
+    for (;;)
+    {
+        int rc = vblkCsEnter(pThis, VERR_SEM_BUSY);
+        if (RT_FAILURE(rc))
+            break;
+        bool fHaveElem = vqueueGet(&pThis->VPCI, pQueue, &elem);
+        vblkCsLeave(pThis);
+        if (!fHaveElem)
+            break;
+
+        PVBLKREQ pReq = vblkR3ReqCreate(pThis, &elem);
+        if (!pReq)
+            continue;
+
+        ASMAtomicIncU32(&pThis->cReqsActive);
+        vblkR3ReqSubmit(pThis, pReq);
+    }
+    STAM_PROFILE_STOP(&pThis->StatQueueNotify, a);
+}
+
+
+/* -=-=-=-=- IBlockPort -=-=-=-=- */
+
+/**
+ * @interface_method_impl{PDMIBLOCKPORT,pfnQueryDeviceLocation}
+ */
+static DECLCALLBACK(int) vblkR3QueryDeviceLocation(PPDMIBLOCKPORT pInterface, const char **ppcszController,
+                                                   uint32_t *piInstance, uint32_t *piLUN)
+{
+    PVBLKSTATE pThis = PDMIBLOCKPORT_2_VBLKSTATE(pInterface);
+    PPDMDEVINS pDevIns = pThis->VPCI.pDevInsR3;
+
+    AssertPtrReturn(ppcszController, VERR_INVALID_POINTER);
+    AssertPtrReturn(piInstance, VERR_INVALID_POINTER);
+    AssertPtrReturn(piLUN, VERR_INVALID_POINTER);
+
+    *ppcszController = pDevIns->pReg->szName;
+    *piInstance = pDevIns->iInstance;
+    *piLUN = 0;
+
+    return VINF_SUCCESS;
+}
+
+
+/* -=-=-=-=- IBlockAsyncPort -=-=-=-=- */
+
+/**
+ * @interface_method_impl{PDMIBLOCKASYNCPORT,pfnTransferCompleteNotify}
+ */
+static DECLCALLBACK(int) vblkR3TransferCompleteNotify(PPDMIBLOCKASYNCPORT pInterface, void *pvUser, int rcReq)
+{
+    PVBLKSTATE pThis = PDMIBLOCKASYNCPORT_2_VBLKSTATE(pInterface);
+    PVBLKREQ   pReq  = (PVBLKREQ)pvUser;
+
+    Assert(pReq->pThis == pThis);
+    vblkR3ReqComplete(pThis, pReq, rcReq);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface}
+ */
+static DECLCALLBACK(void *) vblkQueryInterface(struct PDMIBASE *pInterface, const char *pszIID)
+{
+    PVBLKSTATE pThis = RT_FROM_MEMBER(pInterface, VBLKSTATE, VPCI.IBase);
+    Assert(&pThis->VPCI.IBase == pInterface);
+
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBLOCKPORT, &pThis->IPort);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBLOCKASYNCPORT, &pThis->IPortAsync);
+    return vpciQueryInterface(pInterface, pszIID);
+}
+
+
+/* -=-=-=-=- Saved state -=-=-=-=- */
+
+/**
+ * Checks whether all requests completed.
+ *
+ * @returns true if quiesced, false if busy.
+ * @param   pThis      The device state structure.
+ */
+static bool vblkR3AllAsyncIOIsFinished(PVBLKSTATE pThis)
+{
+    return ASMAtomicReadU32(&pThis->cReqsActive) == 0;
+}
+
+/**
+ * Saves the configuration.
+ *
+ * @param   pThis      The VBLK state.
+ * @param   pSSM        The handle to the saved state.
+ */
+static void vblkSaveConfig(PVBLKSTATE pThis, PSSMHANDLE pSSM)
+{
+    SSMR3PutU64(pSSM, pThis->cbSize);
+    SSMR3PutU32(pSSM, pThis->cbSector);
+}
+
+
+/**
+ * @callback_method_impl{FNSSMDEVLIVEEXEC}
+ */
+static DECLCALLBACK(int) vblkLiveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uPass)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    vblkSaveConfig(pThis, pSSM);
+    return VINF_SSM_DONT_CALL_AGAIN;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMDEVSAVEPREP}
+ */
+static DECLCALLBACK(int) vblkSavePrep(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    Assert(vblkR3AllAsyncIOIsFinished(pThis));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMDEVSAVEEXEC}
+ */
+static DECLCALLBACK(int) vblkSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+
+    /* Save config first */
+    vblkSaveConfig(pThis, pSSM);
+
+    /* Save the common part */
+    int rc = vpciSaveExec(&pThis->VPCI, pSSM);
+    AssertRCReturn(rc, rc);
+    Log(("%s State has been saved\n", INSTANCE(pThis)));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMDEVLOADPREP}
+ */
+static DECLCALLBACK(int) vblkLoadPrep(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    Assert(vblkR3AllAsyncIOIsFinished(pThis));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMDEVLOADEXEC}
+ */
+static DECLCALLBACK(int) vblkLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    int        rc;
+
+    /* config checks */
+    uint64_t cbSize;
+    uint32_t cbSector;
+    rc = SSMR3GetU64(pSSM, &cbSize);
+    AssertRCReturn(rc, rc);
+    rc = SSMR3GetU32(pSSM, &cbSector);
+    AssertRCReturn(rc, rc);
+    if (   cbSize != pThis->cbSize
+        && (uPass == 0 || !PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns)))
+        LogRel(("%s: The medium size differs: config=%llu saved=%llu\n", INSTANCE(pThis), pThis->cbSize, cbSize));
+    if (cbSector != pThis->cbSector)
+        return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("Config mismatch - saved cbSector=%u config=%u"),
+                                cbSector, pThis->cbSector);
+
+    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VBLK_N_QUEUES);
+    AssertRCReturn(rc, rc);
+
+    return rc;
+}
+
+
+/* -=-=-=-=- PCI Device -=-=-=-=- */
+
+/**
+ * @callback_method_impl{FNPCIIOREGIONMAP}
+ */
+static DECLCALLBACK(int) vblkMap(PPCIDEVICE pPciDev, int iRegion,
+                                 RTGCPHYS GCPhysAddress, uint32_t cb, PCIADDRESSSPACE enmType)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pPciDev->pDevIns, PVBLKSTATE);
+    int        rc;
+
+    if (enmType != PCI_ADDRESS_SPACE_IO)
+    {
+        /* We should never get here */
+        AssertMsgFailed(("Invalid PCI address space param in map callback"));
+        return VERR_INTERNAL_ERROR;
+    }
+
+    pThis->VPCI.IOPortBase = (RTIOPORT)GCPhysAddress;
+    rc = PDMDevHlpIOPortRegister(pPciDev->pDevIns, pThis->VPCI.IOPortBase,
+                                 cb, 0, vblkIOPortOut, vblkIOPortIn,
+                                 NULL, NULL, "VirtioBlk");
+#ifdef VBLK_GC_SUPPORT
+    AssertRCReturn(rc, rc);
+    rc = PDMDevHlpIOPortRegisterR0(pPciDev->pDevIns, pThis->VPCI.IOPortBase,
+                                   cb, 0, "vblkIOPortOut", "vblkIOPortIn",
+                                   NULL, NULL, "VirtioBlk");
+    AssertRCReturn(rc, rc);
+    rc = PDMDevHlpIOPortRegisterRC(pPciDev->pDevIns, pThis->VPCI.IOPortBase,
+                                   cb, 0, "vblkIOPortOut", "vblkIOPortIn",
+                                   NULL, NULL, "VirtioBlk");
+#endif
+    AssertRC(rc);
+    return rc;
+}
+
+
+/* -=-=-=-=- PDMDEVREG -=-=-=-=- */
+
+/**
+ * Callback employed by vblkSuspend and vblkPowerOff.
+ *
+ * @returns true if we've quiesced, false if we're still working.
+ * @param   pDevIns     The device instance.
+ */
+static DECLCALLBACK(bool) vblkIsAsyncSuspendOrPowerOffDone(PPDMDEVINS pDevIns)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    if (!vblkR3AllAsyncIOIsFinished(pThis))
+        return false;
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+    return true;
+}
+
+/**
+ * Resets the device state, the caller made sure that no requests are in flight.
+ *
+ * @param   pThis      The device state structure.
+ */
+static void vblkR3ResetCommon(PVBLKSTATE pThis)
+{
+    int rc = vblkCsEnter(pThis, VERR_SEM_BUSY);
+    AssertRCReturnVoid(rc);
+    vblkIoCb_Reset(pThis);
+    vblkCsLeave(pThis);
+}
+
+/**
+ * Callback employed by vblkReset.
+ *
+ * @returns true if we've quiesced and reset the device, false if we're still
+ *          working.
+ * @param   pDevIns     The device instance.
+ */
+static DECLCALLBACK(bool) vblkIsAsyncResetDone(PPDMDEVINS pDevIns)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    if (!vblkR3AllAsyncIOIsFinished(pThis))
+        return false;
+    ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+
+    vblkR3ResetCommon(pThis);
+    return true;
+}
+
+/**
+ * Common worker for vblkSuspend and vblkPowerOff.
+ */
+static void vblkSuspendOrPowerOff(PPDMDEVINS pDevIns)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!vblkR3AllAsyncIOIsFinished(pThis))
+        PDMDevHlpSetAsyncNotification(pDevIns, vblkIsAsyncSuspendOrPowerOffDone);
+    else
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnSuspend}
+ */
+static DECLCALLBACK(void) vblkSuspend(PPDMDEVINS pDevIns)
+{
+    Log(("vblkSuspend\n"));
+    vblkSuspendOrPowerOff(pDevIns);
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnPowerOff}
+ */
+static DECLCALLBACK(void) vblkPowerOff(PPDMDEVINS pDevIns)
+{
+    Log(("vblkPowerOff\n"));
+    vblkSuspendOrPowerOff(pDevIns);
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnReset}
+ */
+static DECLCALLBACK(void) vblkReset(PPDMDEVINS pDevIns)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+
+    ASMAtomicWriteBool(&pThis->fSignalIdle, true);
+    if (!vblkR3AllAsyncIOIsFinished(pThis))
+        PDMDevHlpSetAsyncNotification(pDevIns, vblkIsAsyncResetDone);
+    else
+    {
+        ASMAtomicWriteBool(&pThis->fSignalIdle, false);
+        vblkR3ResetCommon(pThis);
+    }
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnRelocate}
+ */
+static DECLCALLBACK(void) vblkRelocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta)
+{
+    vpciRelocate(pDevIns, offDelta);
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnDestruct}
+ */
+static DECLCALLBACK(int) vblkDestruct(PPDMDEVINS pDevIns)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
+
+    Log(("%s Destroying instance\n", INSTANCE(pThis)));
+    return vpciDestruct(&pThis->VPCI);
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnConstruct}
+ */
+static DECLCALLBACK(int) vblkConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMNODE pCfg)
+{
+    PVBLKSTATE pThis = PDMINS_2_DATA(pDevIns, PVBLKSTATE);
+    int        rc;
+    PDMDEV_CHECK_VERSIONS_RETURN(pDevIns);
+
+    /* Do our own locking. */
+    rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
+    AssertRCReturn(rc, rc);
+
+    /* Initialize PCI part. */
+    pThis->VPCI.IBase.pfnQueryInterface    = vblkQueryInterface;
+    rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance,
+                       VBLK_NAME_FMT, VBLK_PCI_SUBSYSTEM_ID,
+                       VBLK_PCI_CLASS, VBLK_N_QUEUES);
+    if (RT_FAILURE(rc))
+        return rc;
+    pThis->pReqQueue = vpciAddQueue(&pThis->VPCI, VBLK_QUEUE_SIZE, vblkQueueRequest, "REQ");
+
+    Log(("%s Constructing new instance\n", INSTANCE(pThis)));
+
+    /*
+     * Validate configuration.
+     */
+    if (!CFGMR3AreValuesValid(pCfg, "\0"))
+        return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
+                                N_("Invalid configuration for VirtioBlk device"));
+
+    /* Interfaces */
+    pThis->IPort.pfnQueryDeviceLocation          = vblkR3QueryDeviceLocation;
+    pThis->IPortAsync.pfnTransferCompleteNotify  = vblkR3TransferCompleteNotify;
+
+    /* Attach the medium. */
+    rc = PDMDevHlpDriverAttach(pDevIns, 0, &pThis->VPCI.IBase, &pThis->pDrvBase, "Disk");
+    if (RT_SUCCESS(rc))
+    {
+        pThis->pDrvBlock = PDMIBASE_QUERY_INTERFACE(pThis->pDrvBase, PDMIBLOCK);
+        AssertMsgReturn(pThis->pDrvBlock, ("Failed to obtain the PDMIBLOCK interface!\n"),
+                        VERR_PDM_MISSING_INTERFACE_BELOW);
+        pThis->pDrvBlockAsync = PDMIBASE_QUERY_INTERFACE(pThis->pDrvBase, PDMIBLOCKASYNC);
+
+        if (pThis->pDrvBlock->pfnGetType(pThis->pDrvBlock) != PDMBLOCKTYPE_HARD_DISK)
+            return PDMDevHlpVMSetError(pDevIns, VERR_PDM_UNSUPPORTED_BLOCK_TYPE, RT_SRC_POS,
+                                       N_("VirtioBlk: Only hard disks are supported"));
+
+        pThis->cbSize    = pThis->pDrvBlock->pfnGetSize(pThis->pDrvBlock);
+        pThis->cbSector  = pThis->pDrvBlock->pfnGetSectorSize(pThis->pDrvBlock);
+        pThis->fReadOnly = pThis->pDrvBlock->pfnIsReadOnly(pThis->pDrvBlock);
+        pThis->fDiscard  =    pThis->pDrvBlock->pfnDiscard
+                           || (pThis->pDrvBlockAsync && pThis->pDrvBlockAsync->pfnStartDiscard);
+        if (!pThis->cbSector)
+            pThis->cbSector = VBLK_SECTOR_SIZE;
+
+        LogRel(("%s: %llu bytes, %u byte sectors%s%s%s\n", INSTANCE(pThis), pThis->cbSize, pThis->cbSector,
+                pThis->pDrvBlockAsync ? ", async I/O" : "", pThis->fDiscard ? ", discard" : "",
+                pThis->fReadOnly ? ", read-only" : ""));
+    }
+    else if (   rc == VERR_PDM_NO_ATTACHED_DRIVER
+             || rc == VERR_PDM_CFG_MISSING_DRIVER_NAME)
+    {
+        /* No error, the device just reports an empty disk. */
+        Log(("%s No medium attached!\n", INSTANCE(pThis)));
+        pThis->pDrvBase = NULL;
+        pThis->cbSector = VBLK_SECTOR_SIZE;
+    }
+    else
+        return PDMDEV_SET_ERROR(pDevIns, rc, N_("VirtioBlk: Failed to attach the disk LUN"));
+
+    /* Initialize PCI config space */
+    pThis->config.u64Capacity               = pThis->cbSize / VBLK_SECTOR_SIZE;
+    pThis->config.u32SizeMax                = VBLK_MAX_SEG_SIZE;
+    pThis->config.u32SegMax                 = VBLK_MAX_SEGS;
+    pThis->config.u32BlkSize                = pThis->cbSector;
+    pThis->config.u8PhysBlkExp              = 0;
+    pThis->config.u16MinIoSize              = 1;
+    pThis->config.u32OptIoSize              = 0;
+    pThis->config.u32MaxDiscardSectors      = VBLK_MAX_DISCARD_SECTORS;
+    pThis->config.u32MaxDiscardSeg          = VBLK_MAX_DISCARD_SEGS;
+    pThis->config.u32DiscardSectorAlignment = pThis->cbSector / VBLK_SECTOR_SIZE;
+
+    /* Map our ports to IO space. */
+    rc = PDMDevHlpPCIIORegionRegister(pDevIns, 0,
+                                      VPCI_CONFIG + sizeof(VBlkPCIConfig),
+                                      PCI_ADDRESS_SPACE_IO, vblkMap);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* Register save/restore state handlers. */
+    rc = PDMDevHlpSSMRegisterEx(pDevIns, VIRTIO_SAVEDSTATE_VERSION, sizeof(VBLKSTATE), NULL,
+                                NULL,         vblkLiveExec, NULL,
+                                vblkSavePrep, vblkSaveExec, NULL,
+                                vblkLoadPrep, vblkLoadExec, NULL);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    rc = vblkIoCb_Reset(pThis);
+    AssertRC(rc);
+
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReadBytes,          STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,          "Amount of data read",                "/Public/Storage/VBlk%u/BytesRead", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatWriteBytes,         STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,          "Amount of data written",             "/Public/Storage/VBlk%u/BytesWritten", iInstance);
+
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsRead,           STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of read requests",            "/Devices/VBlk%d/Reqs/Read", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsWrite,          STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of write requests",           "/Devices/VBlk%d/Reqs/Write", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsFlush,          STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of flush requests",           "/Devices/VBlk%d/Reqs/Flush", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsDiscard,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of discard requests",         "/Devices/VBlk%d/Reqs/Discard", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsFailed,         STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of failed requests",          "/Devices/VBlk%d/Reqs/Failed", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatReqsUnsupported,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of unsupported requests",     "/Devices/VBlk%d/Reqs/Unsupported", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatLatencyRead,        STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL,    "Read request latency",               "/Devices/VBlk%d/Latency/Read", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatLatencyWrite,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL,    "Write request latency",              "/Devices/VBlk%d/Latency/Write", iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatLatencyFlush,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_NS_PER_CALL,    "Flush request latency",              "/Devices/VBlk%d/Latency/Flush", iInstance);
+#if defined(VBOX_WITH_STATISTICS)
+    PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatQueueNotify,        STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling queue notifications",      "/Devices/VBlk%d/QueueNotify", iInstance);
+#endif /* VBOX_WITH_STATISTICS */
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * The device registration structure.
+ */
+const PDMDEVREG g_DeviceVirtioBlk =
+{
+    /* Structure version. PDM_DEVREG_VERSION defines the current version. */
+    PDM_DEVREG_VERSION,
+    /* Device name. */
+    "virtio-blk",
+    /* Name of guest context module (no path).
+     * Only evalutated if PDM_DEVREG_FLAGS_RC is set. */
+    "VBoxDDGC.gc",
+    /* Name of ring-0 module (no path).
+     * Only evalutated if PDM_DEVREG_FLAGS_RC is set. */
+    "VBoxDDR0.r0",
+    /* The description of the device. The UTF-8 string pointed to shall, like this structure,
+     * remain unchanged from registration till VM destruction. */
+    "Virtio Block Device.\n",
+
+    /* Flags, combination of the PDM_DEVREG_FLAGS_* \#defines. */
+#ifdef VBLK_GC_SUPPORT
+    PDM_DEVREG_FLAGS_DEFAULT_BITS | PDM_DEVREG_FLAGS_RC | PDM_DEVREG_FLAGS_R0,
+#else
+    PDM_DEVREG_FLAGS_DEFAULT_BITS,
+#endif
+    /* Device class(es), combination of the PDM_DEVREG_CLASS_* \#defines. */
+    PDM_DEVREG_CLASS_STORAGE,
+    /* Maximum number of instances (per VM). */
+    ~0U,
+    /* Size of the instance data. */
+    sizeof(VBLKSTATE),
+
+    /* pfnConstruct */
+    vblkConstruct,
+    /* pfnDestruct */
+    vblkDestruct,
+    /* pfnRelocate */
+    vblkRelocate,
+    /* pfnMemSetup. */
+    NULL,
+    /* pfnPowerOn */
+    NULL,
+    /* pfnReset */
+    vblkReset,
+    /* pfnSuspend */
+    vblkSuspend,
+    /* pfnResume */
+    NULL,
+    /* pfnAttach */
+    NULL,
+    /* pfnDetach */
+    NULL,
+    /* pfnQueryInterface */
+    NULL,
+    /* pfnInitComplete */
+    NULL,
+    /* pfnPowerOff */
+    vblkPowerOff,
+    /* pfnSoftReset */
+    NULL,
+
+    /* u32VersionEnd */
+    PDM_DEVREG_VERSION
+};
+
+#endif /* IN_RING3 */
+#endif /* !VBOX_DEVICE_STRUCT_TESTCASE */
@@ -37,6 +37,8 @@
 #include <iprt/pipe.h>
 #include <iprt/system.h>
 #include <iprt/memsafer.h>
+#include <iprt/memcache.h>
+#include <iprt/time.h>
 
 #ifdef VBOX_WITH_INIP
 /* All lwip header files are not C++ safe. So hack around this. */
@@ -187,6 +189,18 @@ typedef struct VBOXDISK
     /** The block cache handle if configured. */
     PPDMBLKCACHE             pBlkCache;
 
+    /** Statistics.
+     * @{ */
+    /** Cache for the async request latency tracking records. */
+    RTMEMCACHE               hIoReqCache;
+    /** Read request latency. */
+    STAMHISTOGRAM            StatReadLatency;
+    /** Write request latency. */
+    STAMHISTOGRAM            StatWriteLatency;
+    /** Flush request latency. */
+    STAMHISTOGRAM            StatFlushLatency;
+    /** @} */
+
     /** Cryptographic support
      * @{ */
     /** Pointer to the CFGM node containing the config of the crypto filter
@@ -204,6 +218,25 @@ typedef struct VBOXDISK
 } VBOXDISK, *PVBOXDISK;
 
 
+/**
+ * Tracks an async request for the latency statistics.
+ *
+ * Passed down instead of the caller's request handle and unwrapped again
+ * on completion.
+ */
+typedef struct DRVVDIOREQ
+{
+    /** The caller's request handle. */
+    void                    *pvUser;
+    /** The histogram to record the latency in, NULL for none. */
+    PSTAMHISTOGRAM           pStatLatency;
+    /** RTTimeNanoTS() at submission. */
+    uint64_t                 tsStart;
+} DRVVDIOREQ;
+/** Pointer to an async request tracking record. */
+typedef DRVVDIOREQ *PDRVVDIOREQ;
+
+
 /*******************************************************************************
 *   Internal Functions                                                         *
 *******************************************************************************/
@@ -1582,6 +1615,7 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
     if (RT_FAILURE(rc))
         return rc;
 
+    uint64_t const tsStart = RTTimeNanoTS();
     if (!pThis->fBootAccelActive)
         rc = VDRead(pThis->pDisk, off, pvBuf, cbRead);
     else
@@ -1615,6 +1649,7 @@ static DECLCALLBACK(int) drvvdRead(PPDMIMEDIA pInterface,
             pThis->fBootAccelActive = false; /* Deactiviate */
         }
     }
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatReadLatency, RTTimeNanoTS() - tsStart);
 
     if (RT_SUCCESS(rc))
         Log2(("%s: off=%#llx pvBuf=%p cbRead=%d\n%.*Rhxd\n", __FUNCTION__,
@@ -1699,7 +1734,9 @@ static DECLCALLBACK(int) drvvdWrite(PPDMIMEDIA pInterface,
         pThis->offDisk     = 0;
     }
 
+    uint64_t const tsStart = RTTimeNanoTS();
     rc = VDWrite(pThis->pDisk, off, pvBuf, cbWrite);
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatWriteLatency, RTTimeNanoTS() - tsStart);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1709,7 +1746,9 @@ static DECLCALLBACK(int) drvvdFlush(PPDMIMEDIA pInterface)
 {
     LogFlowFunc(("\n"));
     PVBOXDISK pThis = PDMIMEDIA_2_VBOXDISK(pInterface);
+    uint64_t const tsStart = RTTimeNanoTS();
     int rc = VDFlush(pThis->pDisk);
+    STAM_REL_HISTOGRAM_ADD(&pThis->StatFlushLatency, RTTimeNanoTS() - tsStart);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -1983,6 +2022,61 @@ static DECLCALLBACK(int) drvvdIoBufFree(PPDMIMEDIA pInterface, void *pv, size_t
 *   Async Media interface methods                                              *
 *******************************************************************************/
 
+/**
+ * Allocates a tracking record for an async request.
+ *
+ * @returns Pointer to the record, NULL if out of memory.
+ * @param   pThis           The disk instance.
+ * @param   pStatLatency    The histogram to record the latency in, optional.
+ * @param   pvUser          The caller's request handle.
+ */
+static PDRVVDIOREQ drvvdIoReqAlloc(PVBOXDISK pThis, PSTAMHISTOGRAM pStatLatency, void *pvUser)
+{
+    PDRVVDIOREQ pIoReq = (PDRVVDIOREQ)RTMemCacheAlloc(pThis->hIoReqCache);
+    if (pIoReq)
+    {
+        pIoReq->pvUser       = pvUser;
+        pIoReq->pStatLatency = pStatLatency;
+        pIoReq->tsStart      = RTTimeNanoTS();
+    }
+    return pIoReq;
+}
+
+/**
+ * Records the latency of a completed async request and frees the tracking
+ * record.
+ *
+ * @returns The caller's request handle.
+ * @param   pThis           The disk instance.
+ * @param   pIoReq          The tracking record.
+ */
+static void *drvvdIoReqComplete(PVBOXDISK pThis, PDRVVDIOREQ pIoReq)
+{
+    void *pvUser = pIoReq->pvUser;
+    if (pIoReq->pStatLatency)
+        STAM_REL_HISTOGRAM_ADD(pIoReq->pStatLatency, RTTimeNanoTS() - pIoReq->tsStart);
+    RTMemCacheFree(pThis->hIoReqCache, pIoReq);
+    return pvUser;
+}
+
+/**
+ * Deals with the tracking record after submitting an async request.
+ *
+ * @returns rc.
+ * @param   pThis           The disk instance.
+ * @param   pIoReq          The tracking record.
+ * @param   rc              The status of the submission.  Unless the request
+ *                          is pending, the completion callback won't be called.
+ */
+static int drvvdIoReqSubmitted(PVBOXDISK pThis, PDRVVDIOREQ pIoReq, int rc)
+{
+    if (rc == VINF_VD_ASYNC_IO_FINISHED)
+        drvvdIoReqComplete(pThis, pIoReq);
+    else if (rc != VERR_VD_ASYNC_IO_IN_PROGRESS)
+        RTMemCacheFree(pThis->hIoReqCache, pIoReq);
+    return rc;
+}
+
 static void drvvdAsyncReqComplete(void *pvUser1, void *pvUser2, int rcReq)
 {
     PVBOXDISK pThis = (PVBOXDISK)pvUser1;
@@ -1990,7 +2084,8 @@ static void drvvdAsyncReqComplete(void *pvUser1, void *pvUser2, int rcReq)
     if (!pThis->pBlkCache)
     {
         int rc = pThis->pDrvMediaAsyncPort->pfnTransferCompleteNotify(pThis->pDrvMediaAsyncPort,
-                                                                      pvUser2, rcReq);
+                                                                      drvvdIoReqComplete(pThis, (PDRVVDIOREQ)pvUser2),
+                                                                      rcReq);
         AssertRC(rc);
     }
     else
@@ -2012,19 +2107,24 @@ static DECLCALLBACK(int) drvvdStartRead(PPDMIMEDIAASYNC pInterface, uint64_t uOf
 
     pThis->fBootAccelActive = false;
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, &pThis->StatReadLatency, pvUser);
+    if (!pIoReq)
+        return VERR_NO_MEMORY;
+
     RTSGBUF SgBuf;
     RTSgBufInit(&SgBuf, paSeg, cSeg);
     if (!pThis->pBlkCache)
         rc = VDAsyncRead(pThis->pDisk, uOffset, cbRead, &SgBuf,
-                         drvvdAsyncReqComplete, pThis, pvUser);
+                         drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheRead(pThis->pBlkCache, uOffset, &SgBuf, cbRead, pvUser);
+        rc = PDMR3BlkCacheRead(pThis->pBlkCache, uOffset, &SgBuf, cbRead, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    rc = drvvdIoReqSubmitted(pThis, pIoReq, rc);
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -2045,20 +2145,25 @@ static DECLCALLBACK(int) drvvdStartWrite(PPDMIMEDIAASYNC pInterface, uint64_t uO
 
     pThis->fBootAccelActive = false;
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, &pThis->StatWriteLatency, pvUser);
+    if (!pIoReq)
+        return VERR_NO_MEMORY;
+
     RTSGBUF SgBuf;
     RTSgBufInit(&SgBuf, paSeg, cSeg);
 
     if (!pThis->pBlkCache)
         rc = VDAsyncWrite(pThis->pDisk, uOffset, cbWrite, &SgBuf,
-                          drvvdAsyncReqComplete, pThis, pvUser);
+                          drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheWrite(pThis->pBlkCache, uOffset, &SgBuf, cbWrite, pvUser);
+        rc = PDMR3BlkCacheWrite(pThis->pBlkCache, uOffset, &SgBuf, cbWrite, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    rc = drvvdIoReqSubmitted(pThis, pIoReq, rc);
 
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
@@ -2070,16 +2175,21 @@ static DECLCALLBACK(int) drvvdStartFlush(PPDMIMEDIAASYNC pInterface, void *pvUse
     int rc = VINF_SUCCESS;
     PVBOXDISK pThis = PDMIMEDIAASYNC_2_VBOXDISK(pInterface);
 
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, &pThis->StatFlushLatency, pvUser);
+    if (!pIoReq)
+        return VERR_NO_MEMORY;
+
     if (!pThis->pBlkCache)
-        rc = VDAsyncFlush(pThis->pDisk, drvvdAsyncReqComplete, pThis, pvUser);
+        rc = VDAsyncFlush(pThis->pDisk, drvvdAsyncReqComplete, pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheFlush(pThis->pBlkCache, pvUser);
+        rc = PDMR3BlkCacheFlush(pThis->pBlkCache, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    rc = drvvdIoReqSubmitted(pThis, pIoReq, rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -2093,17 +2203,23 @@ static DECLCALLBACK(int) drvvdStartDiscard(PPDMIMEDIAASYNC pInterface, PCRTRANGE
     LogFlowFunc(("paRanges=%#p cRanges=%u pvUser=%#p\n",
                  paRanges, cRanges, pvUser));
 
+    /* Not timed, but the completion path expects a tracking record. */
+    PDRVVDIOREQ pIoReq = drvvdIoReqAlloc(pThis, NULL, pvUser);
+    if (!pIoReq)
+        return VERR_NO_MEMORY;
+
     if (!pThis->pBlkCache)
         rc = VDAsyncDiscardRanges(pThis->pDisk, paRanges, cRanges, drvvdAsyncReqComplete,
-                                  pThis, pvUser);
+                                  pThis, pIoReq);
     else
     {
-        rc = PDMR3BlkCacheDiscard(pThis->pBlkCache, paRanges, cRanges, pvUser);
+        rc = PDMR3BlkCacheDiscard(pThis->pBlkCache, paRanges, cRanges, pIoReq);
         if (rc == VINF_AIO_TASK_PENDING)
             rc = VERR_VD_ASYNC_IO_IN_PROGRESS;
         else if (rc == VINF_SUCCESS)
             rc = VINF_VD_ASYNC_IO_FINISHED;
     }
+    rc = drvvdIoReqSubmitted(pThis, pIoReq, rc);
     LogFlowFunc(("returns %Rrc\n", rc));
     return rc;
 }
@@ -2114,7 +2230,8 @@ static void drvvdBlkCacheXferComplete(PPDMDRVINS pDrvIns, void *pvUser, int rcRe
     PVBOXDISK pThis = PDMINS_2_DATA(pDrvIns, PVBOXDISK);
 
     int rc = pThis->pDrvMediaAsyncPort->pfnTransferCompleteNotify(pThis->pDrvMediaAsyncPort,
-                                                                  pvUser, rcReq);
+                                                                  drvvdIoReqComplete(pThis, (PDRVVDIOREQ)pvUser),
+                                                                  rcReq);
     AssertRC(rc);
 }
 
@@ -2446,6 +2563,14 @@ static DECLCALLBACK(void) drvvdDestruct(PPDMDRVINS pDrvIns)
         MMR3HeapFree(pThis->pszBwGroup);
         pThis->pszBwGroup = NULL;
     }
+    if (pThis->hIoReqCache != NIL_RTMEMCACHE)
+    {
+        RTMemCacheDestroy(pThis->hIoReqCache);
+        pThis->hIoReqCache = NIL_RTMEMCACHE;
+    }
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatReadLatency);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatWriteLatency);
+    PDMDrvHlpSTAMDeregister(pDrvIns, &pThis->StatFlushLatency);
 }
 
 /**
@@ -2483,6 +2608,7 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     pThis->uMergeTarget                 = VD_LAST_IMAGE;
     pThis->pCfgCrypto                   = NULL;
     pThis->pIfSecKey                    = NULL;
+    pThis->hIoReqCache                  = NIL_RTMEMCACHE;
 
     /* IMedia */
     pThis->IMedia.pfnRead               = drvvdRead;
@@ -2509,6 +2635,14 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     pThis->IMediaAsync.pfnStartFlush      = drvvdStartFlush;
     pThis->IMediaAsync.pfnStartDiscard    = drvvdStartDiscard;
 
+    /* Statistics, registered up front so drvvdDestruct can always deregister them. */
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatReadLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                           "Read request latency.", "/Drivers/VD%d/ReadLatency", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatWriteLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                           "Write request latency.", "/Drivers/VD%d/WriteLatency", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatFlushLatency, STAMTYPE_HISTOGRAM, STAMVISIBILITY_USED, STAMUNIT_NS,
+                           "Flush request latency.", "/Drivers/VD%d/FlushLatency", pDrvIns->iInstance);
+
     /* Initialize supported VD interfaces. */
     pThis->pVDIfsDisk = NULL;
 
@@ -3201,6 +3335,16 @@ static DECLCALLBACK(int) drvvdConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfg, uint
     if (RT_SUCCESS(rc))
         rc = drvvdSetupFilters(pThis, pCfg);
 
+    /* Async requests need a tracking record each for the latency statistics. */
+    if (RT_SUCCESS(rc) && pThis->fAsyncIOSupported)
+    {
+        rc = RTMemCacheCreate(&pThis->hIoReqCache, sizeof(DRVVDIOREQ), 0, UINT32_MAX,
+                              NULL, NULL, NULL, 0);
+        if (RT_FAILURE(rc))
+            rc = PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
+                                     N_("DrvVD: Failed to create the I/O request cache"));
+    }
+
     /*
      * Register a load-done callback so we can undo TempReadOnly config before
      * we get to drvvdResume.  Autoamtically deregistered upon destruction.
@@ -21,6 +21,7 @@
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_DEV_VIRTIO
 
+#include <iprt/asm.h>
 #include <iprt/param.h>
 #include <iprt/uuid.h>
 #include <VBox/vmm/pdmdev.h>
@@ -49,6 +50,8 @@ static void vqueueReset(PVQUEUE pQueue)
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
     pQueue->uPageNumber           = 0;
+    pQueue->fSignalledUsedValid   = false;
+    pQueue->fNoNotify             = false;
 }
 
 static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
@@ -56,11 +59,14 @@ static void vqueueInit(PVQUEUE pQueue, uint32_t uPageNumber)
     pQueue->VRing.addrDescriptors = (uint64_t)uPageNumber << PAGE_SHIFT;
     pQueue->VRing.addrAvail       = pQueue->VRing.addrDescriptors
         + sizeof(VRINGDESC) * pQueue->VRing.uSize;
+    /* The avail ring is followed by the used_event field (VPCI_F_RING_EVENT_IDX). */
     pQueue->VRing.addrUsed        = RT_ALIGN(
-        pQueue->VRing.addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pQueue->VRing.uSize]),
+        pQueue->VRing.addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pQueue->VRing.uSize]) + sizeof(uint16_t),
         PAGE_SIZE); /* The used ring must start from the next page. */
     pQueue->uNextAvailIndex       = 0;
     pQueue->uNextUsedIndex        = 0;
+    pQueue->fSignalledUsedValid   = false;
+    pQueue->fNoNotify             = false;
 }
 
 // void vqueueElemFree(PVQUEUEELEM pElem)
@@ -75,6 +81,24 @@ void vringReadDesc(PVPCISTATE pState, PVRING pVRing, uint32_t uIndex, PVRINGDESC
                       pDesc, sizeof(VRINGDESC));
 }
 
+/**
+ * Reads a descriptor from an indirect descriptor table.
+ *
+ * @param   pState      The device state structure.
+ * @param   GCPhysTable Guest physical address of the table.
+ * @param   cEntries    Number of descriptors in the table.
+ * @param   uIndex      Index of the descriptor to read, must be below cEntries.
+ * @param   pDesc       Where to store the descriptor.
+ */
+static void vringReadIndirectDesc(PVPCISTATE pState, RTGCPHYS GCPhysTable, uint32_t cEntries,
+                                  uint32_t uIndex, PVRINGDESC pDesc)
+{
+    Assert(uIndex < cEntries); NOREF(cEntries);
+    PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns),
+                      GCPhysTable + sizeof(VRINGDESC) * uIndex,
+                      pDesc, sizeof(VRINGDESC));
+}
+
 uint16_t vringReadAvail(PVPCISTATE pState, PVRING pVRing, uint32_t uIndex)
 {
     uint16_t tmp;
@@ -95,6 +119,29 @@ uint16_t vringReadAvailFlags(PVPCISTATE pState, PVRING pVRing)
     return tmp;
 }
 
+/**
+ * Reads the used_event field following the avail ring (VPCI_F_RING_EVENT_IDX).
+ */
+static uint16_t vringReadUsedEvent(PVPCISTATE pState, PVRING pVRing)
+{
+    uint16_t tmp;
+
+    PDMDevHlpPhysRead(pState->CTX_SUFF(pDevIns),
+                      pVRing->addrAvail + RT_OFFSETOF(VRINGAVAIL, auRing[pVRing->uSize]),
+                      &tmp, sizeof(tmp));
+    return tmp;
+}
+
+/**
+ * Writes the avail_event field following the used ring (VPCI_F_RING_EVENT_IDX).
+ */
+static void vringWriteAvailEvent(PVPCISTATE pState, PVRING pVRing, uint16_t u16Value)
+{
+    PDMDevHlpPCIPhysWrite(pState->CTX_SUFF(pDevIns),
+                          pVRing->addrUsed + RT_OFFSETOF(VRINGUSED, aRing[pVRing->uSize]),
+                          &u16Value, sizeof(u16Value));
+}
+
 void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled)
 {
     uint16_t tmp;
@@ -113,6 +160,55 @@ void vringSetNotification(PVPCISTATE pState, PVRING pVRing, bool fEnabled)
                           &tmp, sizeof(tmp));
 }
 
+/**
+ * Enables or disables guest notifications (kicks) for a queue.
+ *
+ * Without VPCI_F_RING_EVENT_IDX this toggles VRINGUSED_F_NO_NOTIFY. With it
+ * the guest ignores the flag and kicks only when it makes the descriptor at
+ * avail_event available, so enabling notifications asks for a kick on the
+ * next buffer and disabling them simply leaves avail_event behind.
+ *
+ * Notifications are enabled by default, devices which never call this get a
+ * kick for every new buffer either way, see vqueueAdvanceAvail.
+ *
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue.
+ * @param   fEnabled    Whether the guest should notify us.
+ */
+void vqueueSetNotification(PVPCISTATE pState, PVQUEUE pQueue, bool fEnabled)
+{
+    pQueue->fNoNotify = !fEnabled;
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+    {
+        if (fEnabled)
+            vringWriteAvailEvent(pState, &pQueue->VRing, pQueue->uNextAvailIndex);
+    }
+    else
+        vringSetNotification(pState, &pQueue->VRing, fEnabled);
+}
+
+/**
+ * Consumes the next available ring entry.
+ *
+ * With VPCI_F_RING_EVENT_IDX avail_event follows the consumed entries unless
+ * the device disabled notifications, so the guest keeps kicking for new
+ * buffers without the device having to maintain avail_event itself.
+ *
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue.
+ */
+static void vqueueAdvanceAvail(PVPCISTATE pState, PVQUEUE pQueue)
+{
+    pQueue->uNextAvailIndex++;
+    if (   (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+        && !pQueue->fNoNotify)
+    {
+        vringWriteAvailEvent(pState, &pQueue->VRing, pQueue->uNextAvailIndex);
+        /* avail_event must be visible before the next emptiness check reads the avail index. */
+        ASMMemoryFence();
+    }
+}
+
 bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue)
 {
     if (vqueueIsEmpty(pState, pQueue))
@@ -120,7 +216,7 @@ bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue)
 
     Log2(("%s vqueueSkip: %s avail_idx=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), pQueue->uNextAvailIndex));
-    pQueue->uNextAvailIndex++;
+    vqueueAdvanceAvail(pState, pQueue);
     return true;
 }
 
@@ -136,14 +232,53 @@ bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemov
 
     VRINGDESC desc;
     uint16_t  idx = vringReadAvail(pState, &pQueue->VRing, pQueue->uNextAvailIndex);
+    RTGCPHYS  GCPhysTable = NIL_RTGCPHYS; /* Indirect descriptor table being walked. */
+    uint32_t  cTableEntries = 0;
     if (fRemove)
-        pQueue->uNextAvailIndex++;
+        vqueueAdvanceAvail(pState, pQueue);
     pElem->uIndex = idx;
     do
     {
         VQUEUESEG *pSeg;
 
-        vringReadDesc(pState, &pQueue->VRing, idx, &desc);
+        if (GCPhysTable != NIL_RTGCPHYS)
+        {
+            /* A next index pointing outside the table means a malformed chain. */
+            if (idx >= cTableEntries)
+            {
+                Log(("%s vqueueGet: %s invalid indirect descriptor index %u (table has %u entries)\n",
+                     INSTANCE(pState), QUEUENAME(pState, pQueue), idx, cTableEntries));
+                break;
+            }
+            vringReadIndirectDesc(pState, GCPhysTable, cTableEntries, idx, &desc);
+        }
+        else
+            vringReadDesc(pState, &pQueue->VRing, idx, &desc);
+
+        if (desc.u16Flags & VRINGDESC_F_INDIRECT)
+        {
+            /*
+             * The chain continues in a table of descriptors. Only the ring may
+             * refer to one and the table replaces the rest of the chain.
+             */
+            if (   GCPhysTable != NIL_RTGCPHYS
+                || !(pState->uGuestFeatures & VPCI_F_RING_INDIRECT_DESC)
+                || desc.uLen < sizeof(VRINGDESC))
+            {
+                Log(("%s vqueueGet: %s invalid indirect descriptor idx=%u len=%u\n", INSTANCE(pState),
+                     QUEUENAME(pState, pQueue), idx, desc.uLen));
+                break;
+            }
+            Log2(("%s vqueueGet: %s indirect table addr=%RGp entries=%u\n", INSTANCE(pState),
+                  QUEUENAME(pState, pQueue), desc.u64Addr, desc.uLen / sizeof(VRINGDESC)));
+            STAM_COUNTER_INC(&pState->StatIndirectDesc);
+            GCPhysTable   = desc.u64Addr;
+            cTableEntries = RT_MIN(desc.uLen / sizeof(VRINGDESC), VRING_MAX_SIZE);
+            idx           = 0;
+            desc.u16Flags = VRINGDESC_F_NEXT;
+            continue;
+        }
+
         if (desc.u16Flags & VRINGDESC_F_WRITE)
         {
             Log2(("%s vqueueGet: %s IN  seg=%u desc_idx=%u addr=%p cb=%u\n", INSTANCE(pState),
@@ -162,7 +297,9 @@ bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemov
         pSeg->pv   = NULL;
 
         idx = desc.u16Next;
-    } while (desc.u16Flags & VRINGDESC_F_NEXT);
+    } while (   (desc.u16Flags & VRINGDESC_F_NEXT)
+             && pElem->nIn < VRING_MAX_SIZE
+             && pElem->nOut < VRING_MAX_SIZE);
 
     Log2(("%s vqueueGet: %s head_desc_idx=%u nIn=%u nOut=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), pElem->uIndex, pElem->nIn, pElem->nOut));
@@ -217,18 +354,66 @@ void vqueuePut(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, uint32_t uL
     }
 
     Assert((uReserved + uOffset) == uLen || pElem->nIn == 0);
+    STAM_COUNTER_INC(&pState->StatElemsUsed);
     Log2(("%s vqueuePut: %s used_idx=%u guest_used_idx=%u id=%u len=%u\n", INSTANCE(pState),
           QUEUENAME(pState, pQueue), pQueue->uNextUsedIndex, vringReadUsedIndex(pState, &pQueue->VRing), pElem->uIndex, uLen));
     vringWriteUsedElem(pState, &pQueue->VRing, pQueue->uNextUsedIndex++, pElem->uIndex, uLen);
 }
 
+/**
+ * Returns the descriptor chain starting at uIndex to the guest without copying
+ * any data, for devices which have already transferred the payload themselves.
+ *
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue the descriptor chain was taken from.
+ * @param   uIndex      Index of the head descriptor of the chain.
+ * @param   uLen        Number of bytes written into the device-writable part.
+ */
+void vqueuePutIndex(PVPCISTATE pState, PVQUEUE pQueue, uint32_t uIndex, uint32_t uLen)
+{
+    Log2(("%s vqueuePutIndex: %s used_idx=%u id=%u len=%u\n", INSTANCE(pState),
+          QUEUENAME(pState, pQueue), pQueue->uNextUsedIndex, uIndex, uLen));
+    STAM_COUNTER_INC(&pState->StatElemsUsed);
+    vringWriteUsedElem(pState, &pQueue->VRing, pQueue->uNextUsedIndex++, uIndex, uLen);
+}
+
+/**
+ * Checks whether the guest wants an interrupt for the used ring entries added
+ * since the last one, according to its used_event (VPCI_F_RING_EVENT_IDX).
+ *
+ * @returns true if the guest has to be interrupted.
+ * @param   pState      The device state structure.
+ * @param   pQueue      The queue.
+ */
+static bool vqueueNeedEvent(PVPCISTATE pState, PVQUEUE pQueue)
+{
+    uint16_t uOld   = pQueue->uSignalledUsedIndex;
+    uint16_t uNew   = pQueue->uNextUsedIndex;
+    bool     fValid = pQueue->fSignalledUsedValid;
+
+    pQueue->uSignalledUsedIndex = uNew;
+    pQueue->fSignalledUsedValid = true;
+    if (!fValid)
+        return true;
+
+    /* The used index must be visible before the guest's used_event is read. */
+    ASMMemoryFence();
+    uint16_t uEvent = vringReadUsedEvent(pState, &pQueue->VRing);
+    return (uint16_t)(uNew - uEvent - 1) < (uint16_t)(uNew - uOld);
+}
+
 void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue)
 {
     LogFlow(("%s vqueueNotify: %s availFlags=%x guestFeatures=%x vqueue is %sempty\n",
              INSTANCE(pState), QUEUENAME(pState, pQueue),
              vringReadAvailFlags(pState, &pQueue->VRing),
              pState->uGuestFeatures, vqueueIsEmpty(pState, pQueue)?"":"not "));
-    if (!(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT)
+    bool fNotify;
+    if (pState->uGuestFeatures & VPCI_F_RING_EVENT_IDX)
+        fNotify = vqueueNeedEvent(pState, pQueue);
+    else
+        fNotify = !(vringReadAvailFlags(pState, &pQueue->VRing) & VRINGAVAIL_F_NO_INTERRUPT);
+    if (   fNotify
         || ((pState->uGuestFeatures & VPCI_F_NOTIFY_ON_EMPTY) && vqueueIsEmpty(pState, pQueue)))
     {
         int rc = vpciRaiseInterrupt(pState, VERR_INTERNAL_ERROR, VPCI_ISR_QUEUE);
@@ -271,9 +456,14 @@ void vpciReset(PVPCISTATE pState)
  */
 int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
 {
-    // int rc = vpciCsEnter(pState, rcBusy);
-    // if (RT_UNLIKELY(rc != VINF_SUCCESS))
-    //     return rc;
+    /*
+     * The transmit workers of the network device and the request completion
+     * of the block device raise interrupts from their own threads, so the ISR
+     * update must not race the read-and-clear in vpciIOPortIn.
+     */
+    int rc = vpciCsEnter(pState, rcBusy);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        return rc;
 
     STAM_COUNTER_INC(&pState->StatIntsRaised);
     LogFlow(("%s vpciRaiseInterrupt: u8IntCause=%x\n",
@@ -281,7 +471,7 @@ int vpciRaiseInterrupt(VPCISTATE *pState, int rcBusy, uint8_t u8IntCause)
 
     pState->uISR |= u8IntCause;
     PDMDevHlpPCISetIrq(pState->CTX_SUFF(pDevIns), 0, 1);
-    // vpciCsLeave(pState);
+    vpciCsLeave(pState);
     return VINF_SUCCESS;
 }
 
@@ -300,7 +490,9 @@ DECLINLINE(uint32_t) vpciGetHostFeatures(PVPCISTATE pState,
                                          PFNGETHOSTFEATURES pfnGetHostFeatures)
 {
     return pfnGetHostFeatures(pState)
-        | VPCI_F_NOTIFY_ON_EMPTY;
+        | VPCI_F_NOTIFY_ON_EMPTY
+        | VPCI_F_RING_INDIRECT_DESC
+        | VPCI_F_RING_EVENT_IDX;
 }
 
 /**
@@ -479,6 +671,7 @@ int vpciIOPortOut(PPDMDEVINS                pDevIns,
 #ifdef IN_RING3
             Assert(cb == 2);
             u32 &= 0xFFFF;
+            STAM_COUNTER_INC(&pState->StatQueueNotify);
             if (u32 < pState->nQueues)
                 if (pState->Queues[u32].VRing.addrDescriptors)
                 {
@@ -742,6 +935,9 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
         }
         else
             pState->nQueues = nQueues;
+        AssertLogRelMsgReturn(pState->nQueues <= RT_ELEMENTS(pState->Queues),
+                              ("%s nQueues=%u\n", INSTANCE(pState), pState->nQueues),
+                              VERR_SSM_LOAD_CONFIG_MISMATCH);
         for (unsigned i = 0; i < pState->nQueues; i++)
         {
             rc = SSMR3GetU16(pSSM, &pState->Queues[i].VRing.uSize);
@@ -749,6 +945,7 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             rc = SSMR3GetU32(pSSM, &pState->Queues[i].uPageNumber);
             AssertRCReturn(rc, rc);
 
+            /* Clears fSignalledUsedValid, costing at most one extra interrupt. */
             if (pState->Queues[i].uPageNumber)
                 vqueueInit(&pState->Queues[i], pState->Queues[i].uPageNumber);
 
@@ -870,6 +1067,9 @@ DECLCALLBACK(int) vpciConstruct(PPDMDEVINS pDevIns, VPCISTATE *pState,
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIOWriteHC,          STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling IO writes in HC",     vpciCounter(pcszNameFmt, "IO/WriteHC"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIntsRaised,         STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of raised interrupts",   vpciCounter(pcszNameFmt, "Interrupts/Raised"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIntsSkipped,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of skipped interrupts",   vpciCounter(pcszNameFmt, "Interrupts/Skipped"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatQueueNotify,        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of queue notifications (exits)", vpciCounter(pcszNameFmt, "Queue/Notify"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatElemsUsed,          STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of completed descriptor chains", vpciCounter(pcszNameFmt, "Queue/ElemsUsed"), iInstance);
+    PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatIndirectDesc,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Number of indirect descriptor tables", vpciCounter(pcszNameFmt, "Queue/IndirectDesc"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatCsGC,               STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling CS wait in GC",      vpciCounter(pcszNameFmt, "Cs/CsGC"), iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pState->StatCsHC,               STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling CS wait in HC",      vpciCounter(pcszNameFmt, "Cs/CsHC"), iInstance);
 #endif /* VBOX_WITH_STATISTICS */
@@ -28,14 +28,16 @@
  * for example.
  */
 #define VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1 1
-#define VIRTIO_SAVEDSTATE_VERSION           2
+#define VIRTIO_SAVEDSTATE_VERSION_NO_NET_MQ 2
+#define VIRTIO_SAVEDSTATE_VERSION           3
 /** @} */
 
 #define DEVICE_PCI_VENDOR_ID                0x1AF4
 #define DEVICE_PCI_DEVICE_ID                0x1000
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 
-#define VIRTIO_MAX_NQUEUES                  3
+/** Enough for a network device with 8 queue pairs plus the control queue. */
+#define VIRTIO_MAX_NQUEUES                  17
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
@@ -56,11 +58,14 @@
 #define VPCI_STATUS_FAILED                  0x80
 
 #define VPCI_F_NOTIFY_ON_EMPTY              0x01000000
+#define VPCI_F_RING_INDIRECT_DESC           0x10000000
+#define VPCI_F_RING_EVENT_IDX               0x20000000
 #define VPCI_F_BAD_FEATURE                  0x40000000
 
 #define VRINGDESC_MAX_SIZE                  (2 * 1024 * 1024)
 #define VRINGDESC_F_NEXT                    0x01
 #define VRINGDESC_F_WRITE                   0x02
+#define VRINGDESC_F_INDIRECT                0x04
 
 typedef struct VRingDesc
 {
@@ -124,6 +129,14 @@ typedef struct VQueue
     uint16_t uNextAvailIndex;
     uint16_t uNextUsedIndex;
     uint32_t uPageNumber;
+    /** The used index the guest was last interrupted for (VPCI_F_RING_EVENT_IDX). */
+    uint16_t uSignalledUsedIndex;
+    /** Whether uSignalledUsedIndex is valid, cleared on (re)initialization. */
+    bool     fSignalledUsedValid;
+    /** Set while the device does not want to be notified about new buffers,
+     * keeps vqueueGet from moving avail_event (VPCI_F_RING_EVENT_IDX). */
+    bool     fNoNotify;
+    uint8_t  padding[4];
     R3PTRTYPE(PFNVPCIQUEUECALLBACK) pfnCallback;
     R3PTRTYPE(const char *)         pcszName;
 } VQUEUE;
@@ -213,6 +226,9 @@ typedef struct VPCIState_st
     STAMPROFILEADV         StatIOWriteHC;
     STAMCOUNTER            StatIntsRaised;
     STAMCOUNTER            StatIntsSkipped;
+    STAMCOUNTER            StatQueueNotify;
+    STAMCOUNTER            StatElemsUsed;
+    STAMCOUNTER            StatIndirectDesc;
     STAMPROFILE            StatCsGC;
     STAMPROFILE            StatCsHC;
 #endif /* VBOX_WITH_STATISTICS */
@@ -301,8 +317,10 @@ DECLINLINE(uint16_t) vringReadAvailIndex(PVPCISTATE pState, PVRING pVRing)
 bool vqueueSkip(PVPCISTATE pState, PVQUEUE pQueue);
 bool vqueueGet(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, bool fRemove = true);
 void vqueuePut(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem, uint32_t uLen, uint32_t uReserved = 0);
+void vqueuePutIndex(PVPCISTATE pState, PVQUEUE pQueue, uint32_t uIndex, uint32_t uLen);
 void vqueueNotify(PVPCISTATE pState, PVQUEUE pQueue);
 void vqueueSync(PVPCISTATE pState, PVQUEUE pQueue);
+void vqueueSetNotification(PVPCISTATE pState, PVQUEUE pQueue, bool fEnabled);
 
 DECLINLINE(bool) vqueuePeek(PVPCISTATE pState, PVQUEUE pQueue, PVQUEUEELEM pElem)
 {
@@ -47,6 +47,8 @@
 #ifdef VBOX_WITH_VIRTIO
 # undef LOG_GROUP
 # include "../Network/DevVirtioNet.cpp"
+# undef LOG_GROUP
+# include "../Storage/DevVirtioBlk.cpp"
 #endif
 #undef LOG_GROUP
 #include "../PC/DevACPI.cpp"
@@ -295,6 +297,8 @@ int main()
 #endif
 #ifdef VBOX_WITH_VIRTIO
     CHECK_MEMBER_ALIGNMENT(VNETSTATE, StatReceiveBytes, 8);
+    CHECK_MEMBER_ALIGNMENT(VNETSTATE, aQueuePairs, 8);
+    CHECK_MEMBER_ALIGNMENT(VBLKSTATE, StatReadBytes, 8);
 #endif
     //CHECK_MEMBER_ALIGNMENT(E1KSTATE, csTx, 8);
 #ifdef VBOX_WITH_USB
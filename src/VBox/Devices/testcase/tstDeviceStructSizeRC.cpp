@@ -94,6 +94,8 @@
 #ifdef VBOX_WITH_VIRTIO
 # undef LOG_GROUP
 # include "../Network/DevVirtioNet.cpp"
+# undef LOG_GROUP
+# include "../Storage/DevVirtioBlk.cpp"
 #endif
 #ifdef VBOX_WITH_BUSLOGIC
 # undef LOG_GROUP
@@ -1550,22 +1552,43 @@ int main()
     GEN_CHECK_OFF(VNETSTATE, pCanRxQueueR0);
     GEN_CHECK_OFF(VNETSTATE, pCanRxQueueRC);
     GEN_CHECK_OFF(VNETSTATE, pLinkUpTimer);
-# ifdef VNET_TX_DELAY
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerR3);
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerR0);
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerRC);
-# endif /* VNET_TX_DELAY */
     GEN_CHECK_OFF(VNETSTATE, config);
     GEN_CHECK_OFF(VNETSTATE, macConfigured);
     GEN_CHECK_OFF(VNETSTATE, fCableConnected);
     GEN_CHECK_OFF(VNETSTATE, u32PktNo);
     GEN_CHECK_OFF(VNETSTATE, fPromiscuous);
     GEN_CHECK_OFF(VNETSTATE, fAllMulti);
-    GEN_CHECK_OFF(VNETSTATE, pRxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pTxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
     GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
+    GEN_CHECK_OFF(VNETSTATE, cMaxQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, cCurQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, au8FlowToPair);
+    GEN_CHECK_OFF(VNETSTATE, fTxWaitingPairs);
     GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[VNET_MAX_QUEUE_PAIRS]);
+    GEN_CHECK_SIZE(VNETQUEUEPAIR);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, StatReceivePackets);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pRxQueue);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pTxQueue);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pTxThread);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, hEventTx);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, uIsTransmitting);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, fTxPending);
+    GEN_CHECK_OFF(VBLKSTATE, VPCI);
+    GEN_CHECK_OFF(VBLKSTATE, IPort);
+    GEN_CHECK_OFF(VBLKSTATE, IPortAsync);
+    GEN_CHECK_OFF(VBLKSTATE, pDrvBase);
+    GEN_CHECK_OFF(VBLKSTATE, pDrvBlock);
+    GEN_CHECK_OFF(VBLKSTATE, pDrvBlockAsync);
+    GEN_CHECK_OFF(VBLKSTATE, pReqQueue);
+    GEN_CHECK_OFF(VBLKSTATE, config);
+    GEN_CHECK_OFF(VBLKSTATE, cbSize);
+    GEN_CHECK_OFF(VBLKSTATE, cbSector);
+    GEN_CHECK_OFF(VBLKSTATE, fReadOnly);
+    GEN_CHECK_OFF(VBLKSTATE, fDiscard);
+    GEN_CHECK_OFF(VBLKSTATE, fSignalIdle);
+    GEN_CHECK_OFF(VBLKSTATE, cReqsActive);
+    GEN_CHECK_OFF(VBLKSTATE, uGeneration);
 #endif /* VBOX_WITH_VIRTIO */
 
 #ifdef VBOX_WITH_SCSI
@@ -20,10 +20,15 @@
 #include "shfl.h"
 #include "mappings.h"
 #include "shflhandle.h"
+#include "shflcache.h"
 #include "vbsf.h"
 #include <iprt/alloc.h>
+#include <iprt/asm.h>
 #include <iprt/string.h>
 #include <iprt/assert.h>
+#include <iprt/req.h>
+#include <iprt/semaphore.h>
+#include <iprt/thread.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmifs.h>
 
@@ -72,12 +77,299 @@
 PVBOXHGCMSVCHELPERS g_pHelpers;
 static PPDMLED      pStatusLed = NULL;
 
+
+/* Worker pool.
+ *
+ * By default every guest request is executed synchronously on the HGCM
+ * service thread.  When the host configures worker threads (see
+ * SHFL_FN_SET_WORKER_THREADS) the requests doing actual file system I/O are
+ * handed to one of the workers and completed asynchronously.
+ *
+ * Each worker owns a FIFO request queue.  Requests referring to the same
+ * handle (or, for path based requests, the same path) always go to the same
+ * worker, so they are executed in the order the guest issued them.
+ *
+ * All other requests, host calls and state changes (disconnect, saved state)
+ * are executed on the HGCM thread after the pool has been drained.  Thus the
+ * mapping table and the client structures are never modified while a worker
+ * is using them and need no extra locking.
+ */
+
+/** A guest request queued for a worker. */
+typedef struct SHFLWORKREQ
+{
+    VBOXHGCMCALLHANDLE  callHandle;
+    uint32_t            u32ClientID;
+    void               *pvClient;
+    uint32_t            u32Function;
+    uint32_t            cParms;
+    VBOXHGCMSVCPARM    *paParms;
+} SHFLWORKREQ, *PSHFLWORKREQ;
+
+/** A worker thread with its request queue. */
+typedef struct SHFLWORKER
+{
+    RTTHREAD            hThread;
+    RTREQQUEUE          hQueue;
+} SHFLWORKER, *PSHFLWORKER;
+
+/** Number of active workers, 0 if requests are executed synchronously. */
+static uint32_t         g_cWorkers = 0;
+/** The workers. */
+static PSHFLWORKER      g_paWorkers = NULL;
+/** Set when the workers must terminate. */
+static bool volatile    g_fWorkersShutdown = false;
+/** Number of requests queued or being executed by the workers. */
+static uint32_t volatile g_cWorkReqs = 0;
+/** Signalled by a worker when g_cWorkReqs drops to zero. */
+static RTSEMEVENT       g_hEvtWorkIdle = NIL_RTSEMEVENT;
+
+static void svcCallExec (VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[]);
+
+/**
+ * Executes a queued request on a worker thread.
+ *
+ * @param   pReq    The request, freed on return.
+ */
+static DECLCALLBACK(void) svcWorkerExec (PSHFLWORKREQ pReq)
+{
+    svcCallExec (pReq->callHandle, pReq->u32ClientID, pReq->pvClient, pReq->u32Function, pReq->cParms, pReq->paParms);
+    RTMemFree (pReq);
+
+    if (ASMAtomicDecU32 (&g_cWorkReqs) == 0)
+        RTSemEventSignal (g_hEvtWorkIdle);
+}
+
+/**
+ * Dummy request making the worker leave RTReqQueueProcess.
+ *
+ * @returns VWRN_STATE_CHANGED.
+ */
+static DECLCALLBACK(int) svcWorkerWakeup (void)
+{
+    return VWRN_STATE_CHANGED;
+}
+
+static DECLCALLBACK(int) svcWorkerThread (RTTHREAD hThreadSelf, void *pvUser)
+{
+    PSHFLWORKER pWorker = (PSHFLWORKER)pvUser;
+
+    NOREF(hThreadSelf);
+
+    while (!ASMAtomicReadBool (&g_fWorkersShutdown))
+        RTReqQueueProcess (pWorker->hQueue, RT_INDEFINITE_WAIT);
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Waits until all queued requests have been completed.
+ *
+ * Must be called on the HGCM thread, which is the only one queueing requests.
+ */
+static void svcWorkersDrain (void)
+{
+    while (ASMAtomicReadU32 (&g_cWorkReqs) != 0)
+        RTSemEventWait (g_hEvtWorkIdle, RT_INDEFINITE_WAIT);
+}
+
+/**
+ * Stops and destroys all workers, any queued requests are completed first.
+ */
+static void svcWorkersTerm (void)
+{
+    if (!g_paWorkers)
+        return;
+
+    svcWorkersDrain ();
+
+    ASMAtomicWriteBool (&g_fWorkersShutdown, true);
+    for (uint32_t i = 0; i < g_cWorkers; i++)
+    {
+        PSHFLWORKER pWorker = &g_paWorkers[i];
+
+        if (pWorker->hThread != NIL_RTTHREAD)
+        {
+            int rc = RTReqQueueCallEx (pWorker->hQueue, NULL, 0, RTREQFLAGS_NO_WAIT,
+                                       (PFNRT)svcWorkerWakeup, 0);
+            AssertRC(rc);
+            rc = RTThreadWait (pWorker->hThread, RT_INDEFINITE_WAIT, NULL);
+            AssertRC(rc);
+        }
+        if (pWorker->hQueue != NIL_RTREQQUEUE)
+            RTReqQueueDestroy (pWorker->hQueue);
+    }
+
+    RTMemFree (g_paWorkers);
+    g_paWorkers = NULL;
+    g_cWorkers = 0;
+
+    RTSemEventDestroy (g_hEvtWorkIdle);
+    g_hEvtWorkIdle = NIL_RTSEMEVENT;
+}
+
+/**
+ * Replaces the current workers with a new set.
+ *
+ * @returns VBox status code.
+ * @param   cWorkers    Number of worker threads, 0 for synchronous execution.
+ */
+static int svcWorkersInit (uint32_t cWorkers)
+{
+    svcWorkersTerm ();
+
+    if (cWorkers == 0)
+        return VINF_SUCCESS;
+
+    int rc = RTSemEventCreate (&g_hEvtWorkIdle);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    g_paWorkers = (PSHFLWORKER)RTMemAllocZ (cWorkers * sizeof (SHFLWORKER));
+    if (!g_paWorkers)
+    {
+        RTSemEventDestroy (g_hEvtWorkIdle);
+        g_hEvtWorkIdle = NIL_RTSEMEVENT;
+        return VERR_NO_MEMORY;
+    }
+
+    ASMAtomicWriteBool (&g_fWorkersShutdown, false);
+    g_cWorkers = cWorkers;
+    for (uint32_t i = 0; i < cWorkers; i++)
+    {
+        g_paWorkers[i].hThread = NIL_RTTHREAD;
+        g_paWorkers[i].hQueue  = NIL_RTREQQUEUE;
+    }
+
+    for (uint32_t i = 0; i < cWorkers && RT_SUCCESS(rc); i++)
+    {
+        PSHFLWORKER pWorker = &g_paWorkers[i];
+
+        rc = RTReqQueueCreate (&pWorker->hQueue);
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreateF (&pWorker->hThread, svcWorkerThread, pWorker, 0,
+                                  RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "ShFlWrk%u", i);
+    }
+
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("SharedFolders host service: failed to create %u worker threads, rc=%Rrc\n", cWorkers, rc));
+        svcWorkersTerm ();
+    }
+    return rc;
+}
+
+/**
+ * Checks whether a guest function may be executed by a worker.
+ */
+static bool svcWorkerIsQueueable (uint32_t u32Function)
+{
+    switch (u32Function)
+    {
+        case SHFL_FN_CREATE:
+        case SHFL_FN_CLOSE:
+        case SHFL_FN_READ:
+        case SHFL_FN_WRITE:
+        case SHFL_FN_LIST:
+        case SHFL_FN_INFORMATION:
+        case SHFL_FN_REMOVE:
+        case SHFL_FN_RENAME:
+        case SHFL_FN_FLUSH:
+        case SHFL_FN_READLINK:
+        case SHFL_FN_SYMLINK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Picks the worker for a request.
+ *
+ * Handle based requests are distributed by client and handle, path based
+ * requests by client and the bytes of the path.  Parameters are not validated
+ * here, a malformed request just ends up on some worker which fails it.
+ */
+static PSHFLWORKER svcWorkerSelect (uint32_t u32ClientID, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+{
+    uint32_t uHash = u32ClientID * UINT32_C(0x9e3779b1);
+
+    if (cParms >= 2)
+    {
+        switch (u32Function)
+        {
+            case SHFL_FN_CREATE:
+            case SHFL_FN_REMOVE:
+            case SHFL_FN_RENAME:
+            case SHFL_FN_READLINK:
+            case SHFL_FN_SYMLINK:
+                if (   paParms[1].type == VBOX_HGCM_SVC_PARM_PTR
+                    && paParms[1].u.pointer.addr
+                    && paParms[1].u.pointer.size >= SHFLSTRING_HEADER_SIZE)
+                {
+                    /* FNV-1a over the characters of the path, leaving out the buffer
+                       size and whatever follows the string in the buffer.  The request
+                       handler validates the string, here it is only clipped to the buffer. */
+                    PCSHFLSTRING   pPath = (PCSHFLSTRING)paParms[1].u.pointer.addr;
+                    const uint8_t *pb    = (const uint8_t *)&pPath->String;
+                    uint32_t const cb    = RT_MIN(pPath->u16Length, paParms[1].u.pointer.size - SHFLSTRING_HEADER_SIZE);
+
+                    uHash ^= UINT32_C(0x811c9dc5);
+                    for (uint32_t i = 0; i < cb; i++)
+                        uHash = (uHash ^ pb[i]) * UINT32_C(0x01000193);
+                }
+                break;
+
+            default:
+                if (paParms[1].type == VBOX_HGCM_SVC_PARM_64BIT)
+                    uHash ^= (uint32_t)paParms[1].u.uint64 * UINT32_C(0x85ebca6b);
+                break;
+        }
+    }
+
+    return &g_paWorkers[(uHash ^ (uHash >> 16)) % g_cWorkers];
+}
+
+/**
+ * Hands a guest request to a worker.
+ *
+ * @returns VBox status code.  On failure the caller must execute the request.
+ */
+static int svcWorkerQueue (VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+{
+    PSHFLWORKREQ pReq = (PSHFLWORKREQ)RTMemAlloc (sizeof (SHFLWORKREQ));
+    if (!pReq)
+        return VERR_NO_MEMORY;
+
+    pReq->callHandle  = callHandle;
+    pReq->u32ClientID = u32ClientID;
+    pReq->pvClient    = pvClient;
+    pReq->u32Function = u32Function;
+    pReq->cParms      = cParms;
+    pReq->paParms     = paParms;
+
+    PSHFLWORKER pWorker = svcWorkerSelect (u32ClientID, u32Function, cParms, paParms);
+
+    ASMAtomicIncU32 (&g_cWorkReqs);
+    int rc = RTReqQueueCallEx (pWorker->hQueue, NULL, 0, RTREQFLAGS_VOID | RTREQFLAGS_NO_WAIT,
+                               (PFNRT)svcWorkerExec, 1, pReq);
+    if (RT_FAILURE(rc))
+    {
+        ASMAtomicDecU32 (&g_cWorkReqs);
+        RTMemFree (pReq);
+    }
+    return rc;
+}
+
 static DECLCALLBACK(int) svcUnload (void *)
 {
     int rc = VINF_SUCCESS;
 
     Log(("svcUnload\n"));
 
+    svcWorkersTerm ();
+    vbsfCacheTerm ();
+
     return rc;
 }
 
@@ -100,6 +392,9 @@ static DECLCALLBACK(int) svcDisconnect (void *, uint32_t u32ClientID, void *pvCl
 
     Log(("SharedFolders host service: disconnected, u32ClientID = %u\n", u32ClientID));
 
+    /* The workers might still be using the client's handles. */
+    svcWorkersDrain ();
+
     vbsfDisconnect(pClient);
     return rc;
 }
@@ -112,6 +407,8 @@ static DECLCALLBACK(int) svcDisconnect (void *, uint32_t u32ClientID, void *pvCl
  */
 static DECLCALLBACK(int) svcSaveState(void *, uint32_t u32ClientID, void *pvClient, PSSMHANDLE pSSM)
 {
+    svcWorkersDrain ();
+
 #ifndef UNITTEST  /* Read this as not yet tested */
     SHFLCLIENTDATA *pClient = (SHFLCLIENTDATA *)pvClient;
 
@@ -124,10 +421,10 @@ static DECLCALLBACK(int) svcSaveState(void *, uint32_t u32ClientID, void *pvClie
     AssertRCReturn(rc, rc);
 
     /* Save client structure length & contents */
-    rc = SSMR3PutU32(pSSM, sizeof(*pClient));
+    rc = SSMR3PutU32(pSSM, SHFLCLIENTDATA_SAVED_SIZE);
     AssertRCReturn(rc, rc);
 
-    rc = SSMR3PutMem(pSSM, pClient, sizeof(*pClient));
+    rc = SSMR3PutMem(pSSM, pClient, SHFLCLIENTDATA_SAVED_SIZE);
     AssertRCReturn(rc, rc);
 
     /* Save all the active mappings. */
@@ -174,6 +471,8 @@ static DECLCALLBACK(int) svcSaveState(void *, uint32_t u32ClientID, void *pvClie
 
 static DECLCALLBACK(int) svcLoadState(void *, uint32_t u32ClientID, void *pvClient, PSSMHANDLE pSSM)
 {
+    svcWorkersDrain ();
+
 #ifndef UNITTEST  /* Read this as not yet tested */
     uint32_t        nrMappings;
     SHFLCLIENTDATA *pClient = (SHFLCLIENTDATA *)pvClient;
@@ -197,10 +496,10 @@ static DECLCALLBACK(int) svcLoadState(void *, uint32_t u32ClientID, void *pvClie
     rc = SSMR3GetU32(pSSM, &len);
     AssertRCReturn(rc, rc);
 
-    if (len != sizeof(*pClient))
+    if (len != SHFLCLIENTDATA_SAVED_SIZE)
         return VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
 
-    rc = SSMR3GetMem(pSSM, pClient, sizeof(*pClient));
+    rc = SSMR3GetMem(pSSM, pClient, SHFLCLIENTDATA_SAVED_SIZE);
     AssertRCReturn(rc, rc);
 
     /* We don't actually (fully) restore the state; we simply check if the current state is as we it expect it to be. */
@@ -289,7 +588,11 @@ static DECLCALLBACK(int) svcLoadState(void *, uint32_t u32ClientID, void *pvClie
     return VINF_SUCCESS;
 }
 
-static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+/**
+ * Executes a guest request and completes the call, either on the HGCM thread
+ * or on a worker.
+ */
+static void svcCallExec (VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
 {
     int rc = VINF_SUCCESS;
 
@@ -1275,6 +1578,21 @@ static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32
     LogFlow(("\n"));        /* Add a new line to differentiate between calls more easily. */
 }
 
+static DECLCALLBACK(void) svcCall (void *, VBOXHGCMCALLHANDLE callHandle, uint32_t u32ClientID, void *pvClient, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM paParms[])
+{
+    if (g_cWorkers)
+    {
+        if (   svcWorkerIsQueueable (u32Function)
+            && RT_SUCCESS(svcWorkerQueue (callHandle, u32ClientID, pvClient, u32Function, cParms, paParms)))
+            return;
+
+        /* Everything else sees the results of all previously queued requests. */
+        svcWorkersDrain ();
+    }
+
+    svcCallExec (callHandle, u32ClientID, pvClient, u32Function, cParms, paParms);
+}
+
 /*
  * We differentiate between a function handler for the guest (svcCall) and one
  * for the host. The guest is not allowed to add or remove mappings for obvious
@@ -1296,6 +1614,9 @@ static DECLCALLBACK(int) svcHostCall (void *, uint32_t u32Function, uint32_t cPa
     }
 #endif
 
+    /* Mappings must not change while the workers are using them. */
+    svcWorkersDrain ();
+
     switch (u32Function)
     {
     case SHFL_FN_ADD_MAPPING:
@@ -1391,7 +1712,7 @@ static DECLCALLBACK(int) svcHostCall (void *, uint32_t u32Function, uint32_t cPa
                 if (RT_SUCCESS(rc))
                 {
                     /* Update parameters.*/
-                    ; /* none */
+                    vbsfCacheInvalidateAll ();
                 }
             }
         }
@@ -1436,6 +1757,76 @@ static DECLCALLBACK(int) svcHostCall (void *, uint32_t u32Function, uint32_t cPa
         break;
     }
 
+    case SHFL_FN_SET_WORKER_THREADS:
+    {
+        Log(("SharedFolders host service: svcCall: SHFL_FN_SET_WORKER_THREADS\n"));
+
+        /* Verify parameter count and types. */
+        if (cParms != SHFL_CPARMS_SET_WORKER_THREADS)
+        {
+            rc = VERR_INVALID_PARAMETER;
+        }
+        else if (   paParms[0].type != VBOX_HGCM_SVC_PARM_32BIT   /* cWorkers */
+                )
+        {
+            rc = VERR_INVALID_PARAMETER;
+        }
+        else
+        {
+            /* Fetch parameters. */
+            uint32_t cWorkers = paParms[0].u.uint32;
+
+            /* Verify parameters values. */
+            if (cWorkers > SHFL_MAX_WORKER_THREADS)
+            {
+                rc = VERR_INVALID_PARAMETER;
+            }
+            else
+            {
+                /* Execute the function. */
+                rc = svcWorkersInit (cWorkers);
+                if (RT_SUCCESS(rc))
+                    LogRel(("SharedFolders host service: %u worker threads\n", cWorkers));
+            }
+        }
+        break;
+    }
+
+    case SHFL_FN_SET_CACHE_TTL:
+    {
+        Log(("SharedFolders host service: svcCall: SHFL_FN_SET_CACHE_TTL\n"));
+
+        /* Verify parameter count and types. */
+        if (cParms != SHFL_CPARMS_SET_CACHE_TTL)
+        {
+            rc = VERR_INVALID_PARAMETER;
+        }
+        else if (   paParms[0].type != VBOX_HGCM_SVC_PARM_32BIT   /* cMsTtl */
+                )
+        {
+            rc = VERR_INVALID_PARAMETER;
+        }
+        else
+        {
+            /* Fetch parameters. */
+            uint32_t cMsTtl = paParms[0].u.uint32;
+
+            /* Verify parameters values. */
+            if (cMsTtl > SHFL_MAX_CACHE_TTL)
+            {
+                rc = VERR_INVALID_PARAMETER;
+            }
+            else
+            {
+                /* Execute the function. */
+                rc = vbsfCacheSetTtl (cMsTtl);
+                if (RT_SUCCESS(rc))
+                    LogRel(("SharedFolders host service: metadata cache time to live %u ms\n", cMsTtl));
+            }
+        }
+        break;
+    }
+
     default:
         rc = VERR_NOT_IMPLEMENTED;
         break;
@@ -1484,8 +1875,8 @@ extern "C" DECLCALLBACK(DECLEXPORT(int)) VBoxHGCMSvcLoad (VBOXHGCMSVCFNTABLE *pt
             ptable->pvService     = NULL;
         }
 
-        /* Init handle table */
-        rc = vbsfInitHandleTable();
+        /* Init the metadata cache, disabled until the host sets a time to live. */
+        rc = vbsfCacheInit();
         AssertRC(rc);
 
         vbsfMappingInit();
@@ -50,9 +50,14 @@ typedef struct _SHFLCLIENTDATA
     uint32_t fu32Flags;
     /** Path delimiter. */
     RTUTF16  PathDelimiter;
+    /** The client's handle table, created on the first handle allocation.
+     *  This and everything following it is not saved. */
+    struct SHFLHANDLETABLE * volatile pHandleTable;
 } SHFLCLIENTDATA;
 /** Pointer to a SHFLCLIENTDATA structure. */
 typedef SHFLCLIENTDATA *PSHFLCLIENTDATA;
+/** The part of SHFLCLIENTDATA which goes into the saved state. */
+#define SHFLCLIENTDATA_SAVED_SIZE RT_UOFFSETOF(SHFLCLIENTDATA, pHandleTable)
 
 #endif /* !___SHFL_H */
 
@@ -0,0 +1,1055 @@
+/* $Id$ */
+/** @file
+ * Shared Folders: Host side metadata and casing cache.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#include "shflcache.h"
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/err.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+#ifdef RT_OS_LINUX
+# include <sys/inotify.h>
+# include <errno.h>
+# include <poll.h>
+# include <unistd.h>
+#endif
+
+
+/*
+ * The cache keeps three kinds of entries, all keyed by host paths as produced
+ * by vbsfBuildFullPath:
+ *
+ *   - INFO: the result of RTPathQueryInfoEx for a path, including "file/path
+ *     not found" so that failing lookups (include paths!) are cheap as well.
+ *   - NAME: the real spelling of a directory entry, keyed by the directory and
+ *     the lower cased name.  Used to answer case corrections without scanning
+ *     the directory again.
+ *   - DIR_COMPLETE: marks a directory whose names are all present as NAME
+ *     entries, so a failed case correction does not need a scan either.
+ *
+ * INFO entries are hashed by their path, NAME and DIR_COMPLETE entries by their
+ * directory so a directory can be invalidated by walking a single chain.
+ *
+ * Every entry expires after the configured time to live.  The service
+ * invalidates entries itself for all changes made by the guest.  On Linux hosts
+ * the directories holding cached entries are watched with inotify, so changes
+ * made on the host are seen immediately and not only after the entries expire.
+ * If a directory does not exist (yet), its closest existing ancestor is watched
+ * instead, the creation of a subdirectory there drops everything cached below
+ * it.  Other hosts rely on the time to live for that.
+ *
+ * Every invalidation bumps a generation counter.  Callers read it before
+ * querying the host and pass it to the insert functions, which drop the
+ * result if anything was invalidated in the meantime, as the result may
+ * predate the change.
+ *
+ * The cache is disabled (time to live 0) unless the host enables it.
+ */
+
+/** Number of hash chains. */
+#define SHFLCACHE_HASH_SIZE         4096
+/** Maximum number of entries before the least recently used ones are evicted. */
+#define SHFLCACHE_MAX_ENTRIES       32768
+/** Maximum number of watched host directories. */
+#define SHFLCACHE_MAX_WATCHES       4096
+
+/** @name Cache entry types.
+ * @{ */
+#define SHFLCACHE_TYPE_INFO         1
+#define SHFLCACHE_TYPE_NAME         2
+#define SHFLCACHE_TYPE_DIR_COMPLETE 3
+/** @} */
+
+typedef struct SHFLCACHEENTRY
+{
+    /** Next entry in the hash chain. */
+    struct SHFLCACHEENTRY  *pNext;
+    /** Node in the LRU list, most recently used at the tail. */
+    RTLISTNODE              NodeLru;
+    /** RTTimeMilliTS at which the entry becomes stale. */
+    uint64_t                u64Expire;
+    /** Hash of the path (INFO) or of the directory (NAME, DIR_COMPLETE). */
+    uint32_t                uHash;
+    /** SHFLCACHE_TYPE_XXX. */
+    uint32_t                uType;
+    /** INFO: The RTPATH_F_XXX flags of the query. */
+    uint32_t                fFlags;
+    /** INFO: The status of the query. */
+    int32_t                 rc;
+    /** INFO: The object information if rc is VINF_SUCCESS. */
+    RTFSOBJINFO             Info;
+    /** NAME: The real spelling of the name, stored after szKey. */
+    const char             *pszName;
+    /** Length of the directory part of szKey. */
+    size_t                  cchDir;
+    /** Length of szKey. */
+    size_t                  cchKey;
+    /** The key: the path (INFO), the directory followed by a delimiter and the
+     *  lower cased name (NAME) or the directory (DIR_COMPLETE). */
+    char                    szKey[1];
+} SHFLCACHEENTRY, *PSHFLCACHEENTRY;
+
+#ifdef RT_OS_LINUX
+/** A watched host directory. */
+typedef struct SHFLCACHEWATCH
+{
+    /** String space core, keyed by szDir. */
+    RTSTRSPACECORE          Core;
+    /** The inotify watch descriptor. */
+    int                     iWd;
+    /** The directory. */
+    char                    szDir[1];
+} SHFLCACHEWATCH, *PSHFLCACHEWATCH;
+#endif
+
+
+/** Protects everything below. */
+static RTCRITSECT           g_CacheCritSect;
+/** The hash chains. */
+static PSHFLCACHEENTRY      g_apCacheHash[SHFLCACHE_HASH_SIZE];
+/** All entries, least recently used first. */
+static RTLISTANCHOR         g_CacheLru;
+/** The time to live of an entry in milliseconds, 0 if the cache is disabled. */
+static uint32_t volatile    g_cMsCacheTtl = 0;
+/** Incremented whenever entries are invalidated or NAME entries are dropped,
+ * see vbsfCacheGeneration. */
+static uint32_t volatile    g_uCacheGen = 0;
+/** Statistics. */
+static SHFLCACHESTATS       g_CacheStats;
+
+#ifdef RT_OS_LINUX
+/** The inotify descriptor, -1 if not watching. */
+static int                  g_iCacheInotify = -1;
+/** Pipe for waking up the notification thread. */
+static int                  g_aiCacheWakeup[2] = { -1, -1 };
+/** The notification thread. */
+static RTTHREAD             g_hCacheNotifyThread = NIL_RTTHREAD;
+/** The watched directories by name. */
+static RTSTRSPACE           g_CacheWatchSpace = NULL;
+/** The watched directories by watch descriptor. */
+static PSHFLCACHEWATCH     *g_papCacheWatches = NULL;
+/** Number of entries in g_papCacheWatches. */
+static uint32_t             g_cCacheWatchSlots = 0;
+#endif
+
+
+/**
+ * Hashes a path (FNV-1a).
+ */
+uint32_t vbsfCacheHashPath(const char *pszPath, size_t cchPath)
+{
+    uint32_t uHash = UINT32_C(0x811c9dc5);
+    for (size_t i = 0; i < cchPath; i++)
+        uHash = (uHash ^ (uint8_t)pszPath[i]) * UINT32_C(0x01000193);
+    return uHash;
+}
+
+/**
+ * Returns the length of the directory part of a path, without the trailing
+ * delimiter.
+ */
+static size_t vbsfCacheDirLength(const char *pszPath, size_t cchPath)
+{
+    while (cchPath > 0 && pszPath[cchPath - 1] != RTPATH_DELIMITER)
+        cchPath--;
+    return cchPath ? cchPath - 1 : 0;
+}
+
+static void vbsfCacheEntryRemove(PSHFLCACHEENTRY *ppEntry)
+{
+    PSHFLCACHEENTRY pEntry = *ppEntry;
+
+    *ppEntry = pEntry->pNext;
+    RTListNodeRemove(&pEntry->NodeLru);
+    if (pEntry->uType != SHFLCACHE_TYPE_INFO)
+        ASMAtomicIncU32(&g_uCacheGen);
+    g_CacheStats.cEntries--;
+    RTMemFree(pEntry);
+}
+
+/**
+ * Drops the NAME and DIR_COMPLETE entries of a directory.
+ */
+static void vbsfCacheInvalidateDirLocked(const char *pszDir, size_t cchDir)
+{
+    uint32_t const   uHash   = vbsfCacheHashPath(pszDir, cchDir);
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[uHash % SHFLCACHE_HASH_SIZE];
+
+    ASMAtomicIncU32(&g_uCacheGen);
+    while (*ppEntry)
+    {
+        PSHFLCACHEENTRY pEntry = *ppEntry;
+        if (   pEntry->uType != SHFLCACHE_TYPE_INFO
+            && pEntry->uHash == uHash
+            && pEntry->cchDir == cchDir
+            && !memcmp(pEntry->szKey, pszDir, cchDir))
+        {
+            vbsfCacheEntryRemove(ppEntry);
+            g_CacheStats.cInvalidations++;
+        }
+        else
+            ppEntry = &pEntry->pNext;
+    }
+}
+
+/**
+ * Drops the INFO entries of a path, regardless of the query flags.
+ */
+static void vbsfCacheInvalidateInfoLocked(const char *pszPath, size_t cchPath)
+{
+    uint32_t const   uHash   = vbsfCacheHashPath(pszPath, cchPath);
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[uHash % SHFLCACHE_HASH_SIZE];
+
+    ASMAtomicIncU32(&g_uCacheGen);
+    while (*ppEntry)
+    {
+        PSHFLCACHEENTRY pEntry = *ppEntry;
+        if (   pEntry->uType == SHFLCACHE_TYPE_INFO
+            && pEntry->uHash == uHash
+            && pEntry->cchKey == cchPath
+            && !memcmp(pEntry->szKey, pszPath, cchPath))
+        {
+            vbsfCacheEntryRemove(ppEntry);
+            g_CacheStats.cInvalidations++;
+        }
+        else
+            ppEntry = &pEntry->pNext;
+    }
+}
+
+static void vbsfCacheInvalidateAllLocked(void)
+{
+    for (unsigned i = 0; i < RT_ELEMENTS(g_apCacheHash); i++)
+        while (g_apCacheHash[i])
+        {
+            vbsfCacheEntryRemove(&g_apCacheHash[i]);
+            g_CacheStats.cInvalidations++;
+        }
+    ASMAtomicIncU32(&g_uCacheGen);
+}
+
+#ifdef RT_OS_LINUX
+/**
+ * Drops all entries for paths below a directory.
+ */
+static void vbsfCacheInvalidateTreeLocked(const char *pszDir, size_t cchDir)
+{
+    ASMAtomicIncU32(&g_uCacheGen);
+    for (unsigned i = 0; i < RT_ELEMENTS(g_apCacheHash); i++)
+    {
+        PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[i];
+        while (*ppEntry)
+        {
+            PSHFLCACHEENTRY pEntry = *ppEntry;
+            if (   pEntry->cchKey >= cchDir
+                && !memcmp(pEntry->szKey, pszDir, cchDir)
+                && (   pEntry->szKey[cchDir] == RTPATH_DELIMITER
+                    || pEntry->cchKey == cchDir))
+            {
+                vbsfCacheEntryRemove(ppEntry);
+                g_CacheStats.cInvalidations++;
+            }
+            else
+                ppEntry = &pEntry->pNext;
+        }
+    }
+}
+#endif
+
+/**
+ * Links a new entry into the cache, evicting old entries if full.
+ */
+static void vbsfCacheEntryInsertLocked(PSHFLCACHEENTRY pEntry)
+{
+    while (g_CacheStats.cEntries >= SHFLCACHE_MAX_ENTRIES)
+    {
+        PSHFLCACHEENTRY pOldest = RTListGetFirst(&g_CacheLru, SHFLCACHEENTRY, NodeLru);
+        g_CacheStats.cEvictions++;
+        if (pOldest->uType != SHFLCACHE_TYPE_INFO)
+        {
+            /* The directory would no longer be complete, drop it as a whole. */
+            vbsfCacheInvalidateDirLocked(pOldest->szKey, pOldest->cchDir);
+        }
+        else
+        {
+            PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[pOldest->uHash % SHFLCACHE_HASH_SIZE];
+            while (*ppEntry != pOldest)
+                ppEntry = &(*ppEntry)->pNext;
+            vbsfCacheEntryRemove(ppEntry);
+        }
+    }
+
+    PSHFLCACHEENTRY *ppHead = &g_apCacheHash[pEntry->uHash % SHFLCACHE_HASH_SIZE];
+    pEntry->u64Expire = RTTimeMilliTS() + ASMAtomicReadU32(&g_cMsCacheTtl);
+    pEntry->pNext     = *ppHead;
+    *ppHead           = pEntry;
+    RTListAppend(&g_CacheLru, &pEntry->NodeLru);
+    g_CacheStats.cEntries++;
+}
+
+static void vbsfCacheEntryTouchLocked(PSHFLCACHEENTRY pEntry)
+{
+    RTListNodeRemove(&pEntry->NodeLru);
+    RTListAppend(&g_CacheLru, &pEntry->NodeLru);
+}
+
+
+#ifdef RT_OS_LINUX
+
+/**
+ * Makes sure changes to the entries of a host directory are noticed.
+ *
+ * If the directory doesn't exist, its closest existing ancestor is watched
+ * instead, see vbsfCacheNotifyEventLocked.
+ *
+ * @returns true if the directory was already covered by a watch, false if a
+ *          watch was added just now or cannot be added.  In the latter cases,
+ *          a result queried before the call may have missed a change and must
+ *          not be cached.  Always true if the host isn't watched at all.
+ * @param   pszDir      The host directory, not terminated.
+ * @param   cchDir      The length of the directory, without the trailing
+ *                      delimiter.
+ */
+static bool vbsfCacheWatchDirLocked(const char *pszDir, size_t cchDir)
+{
+    char szDir[RTPATH_MAX];
+
+    if (g_iCacheInotify < 0)
+        return true;
+    if (   cchDir == 0
+        || cchDir >= sizeof(szDir))
+        return false;
+    memcpy(szDir, pszDir, cchDir);
+    szDir[cchDir] = '\0';
+
+    int iWd;
+    for (;;)
+    {
+        if (RTStrSpaceGet(&g_CacheWatchSpace, szDir))
+            return true;
+        if (g_CacheStats.cWatches >= SHFLCACHE_MAX_WATCHES)
+            return false;
+
+        iWd = inotify_add_watch(g_iCacheInotify, szDir,
+                                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB
+                                | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+        if (iWd >= 0)
+            break;
+        if (errno != ENOENT && errno != ENOTDIR)
+            return false;
+
+        /* Doesn't exist (yet), watch the parent for it being created. */
+        cchDir = vbsfCacheDirLength(szDir, cchDir);
+        if (cchDir == 0)
+            return false;
+        szDir[cchDir] = '\0';
+    }
+
+    if ((uint32_t)iWd >= g_cCacheWatchSlots)
+    {
+        uint32_t cSlots = RT_MAX(RT_MAX(g_cCacheWatchSlots * 2, 64), (uint32_t)iWd + 1);
+        PSHFLCACHEWATCH *papWatches = (PSHFLCACHEWATCH *)RTMemRealloc(g_papCacheWatches, cSlots * sizeof(PSHFLCACHEWATCH));
+        if (!papWatches)
+        {
+            inotify_rm_watch(g_iCacheInotify, iWd);
+            return false;
+        }
+        RT_BZERO(&papWatches[g_cCacheWatchSlots], (cSlots - g_cCacheWatchSlots) * sizeof(PSHFLCACHEWATCH));
+        g_papCacheWatches  = papWatches;
+        g_cCacheWatchSlots = cSlots;
+    }
+
+    /* The same directory under a different name (symlinks); events are
+       reported for the first name only, so the time to live has to do. */
+    if (g_papCacheWatches[iWd])
+        return false;
+
+    PSHFLCACHEWATCH pWatch = (PSHFLCACHEWATCH)RTMemAlloc(RT_UOFFSETOF(SHFLCACHEWATCH, szDir) + cchDir + 1);
+    if (!pWatch)
+    {
+        inotify_rm_watch(g_iCacheInotify, iWd);
+        return false;
+    }
+    memcpy(pWatch->szDir, szDir, cchDir + 1);
+    pWatch->Core.pszString = pWatch->szDir;
+    pWatch->Core.cchString = cchDir;
+    pWatch->iWd            = iWd;
+    RTStrSpaceInsert(&g_CacheWatchSpace, &pWatch->Core);
+    g_papCacheWatches[iWd] = pWatch;
+    g_CacheStats.cWatches++;
+    return false;
+}
+
+/**
+ * Processes a single inotify event.
+ */
+static void vbsfCacheNotifyEventLocked(const struct inotify_event *pEvt)
+{
+    g_CacheStats.cNotifications++;
+
+    if (pEvt->mask & IN_Q_OVERFLOW)
+    {
+        vbsfCacheInvalidateAllLocked();
+        return;
+    }
+
+    if (pEvt->wd < 0 || (uint32_t)pEvt->wd >= g_cCacheWatchSlots)
+        return;
+    PSHFLCACHEWATCH pWatch = g_papCacheWatches[pEvt->wd];
+    if (!pWatch)
+        return;
+
+    if (pEvt->mask & IN_IGNORED)
+    {
+        /* The watch is gone (directory removed or unmounted). */
+        RTStrSpaceRemove(&g_CacheWatchSpace, pWatch->szDir);
+        g_papCacheWatches[pEvt->wd] = NULL;
+        g_CacheStats.cWatches--;
+        RTMemFree(pWatch);
+        return;
+    }
+
+    /* A new directory, possibly one a cached path didn't find. */
+    if (   (pEvt->mask & (IN_ISDIR | IN_CREATE)) == (IN_ISDIR | IN_CREATE)
+        && pEvt->len && pEvt->name[0])
+    {
+        char   szPath[RTPATH_MAX];
+        size_t cchDir  = pWatch->Core.cchString;
+        size_t cchName = strlen(pEvt->name);
+        if (cchDir + 1 + cchName < sizeof(szPath))
+        {
+            memcpy(szPath, pWatch->szDir, cchDir);
+            szPath[cchDir] = RTPATH_DELIMITER;
+            memcpy(&szPath[cchDir + 1], pEvt->name, cchName + 1);
+            vbsfCacheInvalidateTreeLocked(szPath, cchDir + 1 + cchName);
+        }
+        else
+            vbsfCacheInvalidateAllLocked();
+    }
+
+    /* A directory with everything below it changed its name. */
+    if (   (pEvt->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+        || (   (pEvt->mask & IN_ISDIR)
+            && (pEvt->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))))
+    {
+        vbsfCacheInvalidateAllLocked();
+        return;
+    }
+
+    if (pEvt->len && pEvt->name[0])
+    {
+        char   szPath[RTPATH_MAX];
+        size_t cchDir  = pWatch->Core.cchString;
+        size_t cchName = strlen(pEvt->name);
+        if (cchDir + 1 + cchName < sizeof(szPath))
+        {
+            memcpy(szPath, pWatch->szDir, cchDir);
+            szPath[cchDir] = RTPATH_DELIMITER;
+            memcpy(&szPath[cchDir + 1], pEvt->name, cchName + 1);
+            vbsfCacheInvalidateInfoLocked(szPath, cchDir + 1 + cchName);
+        }
+        else
+            vbsfCacheInvalidateAllLocked();
+
+        if (pEvt->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))
+            vbsfCacheInvalidateDirLocked(pWatch->szDir, cchDir);
+    }
+}
+
+static DECLCALLBACK(int) vbsfCacheNotifyThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    union
+    {
+        struct inotify_event Evt;
+        char ab[16384];
+    } Buf;
+
+    NOREF(hThreadSelf); NOREF(pvUser);
+
+    for (;;)
+    {
+        struct pollfd aFds[2];
+        aFds[0].fd      = g_iCacheInotify;
+        aFds[0].events  = POLLIN;
+        aFds[0].revents = 0;
+        aFds[1].fd      = g_aiCacheWakeup[0];
+        aFds[1].events  = POLLIN;
+        aFds[1].revents = 0;
+        int rc = poll(aFds, RT_ELEMENTS(aFds), -1);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (aFds[1].revents)
+            break;
+
+        ssize_t cb = read(g_iCacheInotify, &Buf, sizeof(Buf));
+        if (cb <= 0)
+            continue;
+
+        RTCritSectEnter(&g_CacheCritSect);
+        size_t off = 0;
+        while (off + sizeof(struct inotify_event) <= (size_t)cb)
+        {
+            const struct inotify_event *pEvt = (const struct inotify_event *)&Buf.ab[off];
+            vbsfCacheNotifyEventLocked(pEvt);
+            off += sizeof(struct inotify_event) + pEvt->len;
+        }
+        RTCritSectLeave(&g_CacheCritSect);
+    }
+
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) vbsfCacheWatchFree(PRTSTRSPACECORE pStr, void *pvUser)
+{
+    NOREF(pvUser);
+    RTMemFree(RT_FROM_MEMBER(pStr, SHFLCACHEWATCH, Core));
+    return VINF_SUCCESS;
+}
+
+static void vbsfCacheNotifyStop(void)
+{
+    if (g_hCacheNotifyThread != NIL_RTTHREAD)
+    {
+        char ch = 0;
+        if (write(g_aiCacheWakeup[1], &ch, 1) == 1)
+            RTThreadWait(g_hCacheNotifyThread, RT_INDEFINITE_WAIT, NULL);
+        g_hCacheNotifyThread = NIL_RTTHREAD;
+    }
+
+    RTCritSectEnter(&g_CacheCritSect);
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aiCacheWakeup); i++)
+        if (g_aiCacheWakeup[i] >= 0)
+        {
+            close(g_aiCacheWakeup[i]);
+            g_aiCacheWakeup[i] = -1;
+        }
+    if (g_iCacheInotify >= 0)
+    {
+        close(g_iCacheInotify);
+        g_iCacheInotify = -1;
+    }
+    RTStrSpaceDestroy(&g_CacheWatchSpace, vbsfCacheWatchFree, NULL);
+    RTMemFree(g_papCacheWatches);
+    g_papCacheWatches  = NULL;
+    g_cCacheWatchSlots = 0;
+    g_CacheStats.cWatches = 0;
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+static int vbsfCacheNotifyStart(void)
+{
+    int rc = VINF_SUCCESS;
+
+    g_iCacheInotify = inotify_init1(IN_CLOEXEC);
+    if (g_iCacheInotify < 0 || pipe(g_aiCacheWakeup) != 0)
+        rc = RTErrConvertFromErrno(errno);
+    else
+        rc = RTThreadCreate(&g_hCacheNotifyThread, vbsfCacheNotifyThread, NULL, 0,
+                            RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "ShFlNotify");
+    if (RT_FAILURE(rc))
+    {
+        g_hCacheNotifyThread = NIL_RTTHREAD;
+        vbsfCacheNotifyStop();
+    }
+    return rc;
+}
+
+#else  /* !RT_OS_LINUX */
+
+static bool vbsfCacheWatchDirLocked(const char *pszDir, size_t cchDir)
+{
+    NOREF(pszDir); NOREF(cchDir);
+    return true;
+}
+
+#endif /* !RT_OS_LINUX */
+
+
+int vbsfCacheInit(void)
+{
+    RTListInit(&g_CacheLru);
+    RT_ZERO(g_CacheStats);
+    return RTCritSectInit(&g_CacheCritSect);
+}
+
+void vbsfCacheTerm(void)
+{
+    vbsfCacheSetTtl(0);
+    if (RTCritSectIsInitialized(&g_CacheCritSect))
+        RTCritSectDelete(&g_CacheCritSect);
+}
+
+/**
+ * Enables, reconfigures or disables the cache.
+ *
+ * Must not be called while other threads are using the cache.
+ *
+ * @returns VBox status code.
+ * @param   cMsTtl      The time to live of an entry in milliseconds, 0 to
+ *                      disable and flush the cache.
+ */
+int vbsfCacheSetTtl(uint32_t cMsTtl)
+{
+    uint32_t cMsOld = ASMAtomicXchgU32(&g_cMsCacheTtl, cMsTtl);
+
+    if (!cMsTtl)
+    {
+        if (cMsOld)
+        {
+            LogRel(("SharedFolders: cache statistics: info hits=%RU64 misses=%RU64, name hits=%RU64 misses=%RU64, "
+                    "invalidations=%RU64 evictions=%RU64 notifications=%RU64\n",
+                    g_CacheStats.cInfoHits, g_CacheStats.cInfoMisses, g_CacheStats.cNameHits, g_CacheStats.cNameMisses,
+                    g_CacheStats.cInvalidations, g_CacheStats.cEvictions, g_CacheStats.cNotifications));
+#ifdef RT_OS_LINUX
+            vbsfCacheNotifyStop();
+#endif
+            RTCritSectEnter(&g_CacheCritSect);
+            vbsfCacheInvalidateAllLocked();
+            RTCritSectLeave(&g_CacheCritSect);
+        }
+        return VINF_SUCCESS;
+    }
+
+#ifdef RT_OS_LINUX
+    if (!cMsOld)
+    {
+        int rc = vbsfCacheNotifyStart();
+        if (RT_FAILURE(rc))
+            LogRel(("SharedFolders: cannot watch host directories (%Rrc), relying on the cache time to live\n", rc));
+    }
+#endif
+    return VINF_SUCCESS;
+}
+
+/**
+ * Looks up the cached result of RTPathQueryInfoEx.
+ *
+ * @returns true if found, false if the host has to be asked.
+ * @param   pszPath     The host path.
+ * @param   fFlags      RTPATH_F_XXX.
+ * @param   pInfo       Where to return the information if *prc is VINF_SUCCESS.
+ * @param   prc         Where to return the status of the query.
+ */
+bool vbsfCacheLookupInfo(const char *pszPath, uint32_t fFlags, PRTFSOBJINFO pInfo, int *prc)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return false;
+
+    size_t const    cchPath = strlen(pszPath);
+    uint32_t const  uHash   = vbsfCacheHashPath(pszPath, cchPath);
+    bool            fHit    = false;
+
+    RTCritSectEnter(&g_CacheCritSect);
+
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[uHash % SHFLCACHE_HASH_SIZE];
+    for (; *ppEntry; ppEntry = &(*ppEntry)->pNext)
+    {
+        PSHFLCACHEENTRY pEntry = *ppEntry;
+        if (   pEntry->uType == SHFLCACHE_TYPE_INFO
+            && pEntry->uHash == uHash
+            && pEntry->fFlags == fFlags
+            && pEntry->cchKey == cchPath
+            && !memcmp(pEntry->szKey, pszPath, cchPath))
+        {
+            if (pEntry->u64Expire > RTTimeMilliTS())
+            {
+                *pInfo = pEntry->Info;
+                *prc   = pEntry->rc;
+                vbsfCacheEntryTouchLocked(pEntry);
+                fHit = true;
+            }
+            else
+                vbsfCacheEntryRemove(ppEntry);
+            break;
+        }
+    }
+
+    if (fHit)
+        g_CacheStats.cInfoHits++;
+    else
+        g_CacheStats.cInfoMisses++;
+
+    RTCritSectLeave(&g_CacheCritSect);
+    return fHit;
+}
+
+/**
+ * Remembers the result of RTPathQueryInfoEx.
+ *
+ * Only success and "not found" results are cached.
+ *
+ * @param   pszPath     The host path.
+ * @param   fFlags      RTPATH_F_XXX.
+ * @param   rc          The status of the query.
+ * @param   pInfo       The information if @a rc is VINF_SUCCESS.
+ * @param   uGen        What vbsfCacheGeneration returned before the query.
+ *                      Nothing is done if entries were invalidated meanwhile.
+ */
+void vbsfCacheInsertInfo(const char *pszPath, uint32_t fFlags, int rc, PCRTFSOBJINFO pInfo, uint32_t uGen)
+{
+    if (   !ASMAtomicReadU32(&g_cMsCacheTtl)
+        || (   rc != VINF_SUCCESS
+            && rc != VERR_FILE_NOT_FOUND
+            && rc != VERR_PATH_NOT_FOUND))
+        return;
+
+    size_t const    cchPath = strlen(pszPath);
+    PSHFLCACHEENTRY pEntry  = (PSHFLCACHEENTRY)RTMemAlloc(RT_UOFFSETOF(SHFLCACHEENTRY, szKey) + cchPath + 1);
+    if (!pEntry)
+        return;
+
+    pEntry->uHash   = vbsfCacheHashPath(pszPath, cchPath);
+    pEntry->uType   = SHFLCACHE_TYPE_INFO;
+    pEntry->fFlags  = fFlags;
+    pEntry->rc      = rc;
+    if (rc == VINF_SUCCESS)
+        pEntry->Info = *pInfo;
+    else
+        RT_ZERO(pEntry->Info);
+    pEntry->pszName = NULL;
+    pEntry->cchDir  = vbsfCacheDirLength(pszPath, cchPath);
+    pEntry->cchKey  = cchPath;
+    memcpy(pEntry->szKey, pszPath, cchPath + 1);
+
+    RTCritSectEnter(&g_CacheCritSect);
+
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[pEntry->uHash % SHFLCACHE_HASH_SIZE];
+    while (*ppEntry)
+    {
+        PSHFLCACHEENTRY pCur = *ppEntry;
+        if (   pCur->uType == SHFLCACHE_TYPE_INFO
+            && pCur->uHash == pEntry->uHash
+            && pCur->fFlags == fFlags
+            && pCur->cchKey == cchPath
+            && !memcmp(pCur->szKey, pszPath, cchPath))
+            vbsfCacheEntryRemove(ppEntry);
+        else
+            ppEntry = &pCur->pNext;
+    }
+
+    if (   ASMAtomicReadU32(&g_uCacheGen) == uGen
+        && vbsfCacheWatchDirLocked(pszPath, pEntry->cchDir))
+        vbsfCacheEntryInsertLocked(pEntry);
+    else
+        RTMemFree(pEntry);
+
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+/**
+ * Remembers the object information of a directory entry returned by a listing.
+ *
+ * @param   uGen        What vbsfCacheGeneration returned before reading the
+ *                      entry.
+ */
+void vbsfCacheInsertDirEntry(const char *pszDir, const char *pszName, uint32_t fFlags, PCRTFSOBJINFO pInfo, uint32_t uGen)
+{
+    char   szPath[RTPATH_MAX];
+    size_t cchDir  = strlen(pszDir);
+    size_t cchName = strlen(pszName);
+
+    if (   !ASMAtomicReadU32(&g_cMsCacheTtl)
+        || cchDir + 1 + cchName >= sizeof(szPath)
+        || (pszName[0] == '.' && (pszName[1] == '\0' || (pszName[1] == '.' && pszName[2] == '\0'))))
+        return;
+
+    memcpy(szPath, pszDir, cchDir);
+    szPath[cchDir] = RTPATH_DELIMITER;
+    memcpy(&szPath[cchDir + 1], pszName, cchName + 1);
+    vbsfCacheInsertInfo(szPath, fFlags, VINF_SUCCESS, pInfo, uGen);
+    vbsfCacheInsertName(pszDir, cchDir, pszName, uGen);
+}
+
+/**
+ * Returns the generation to pass to the insert functions and
+ * vbsfCacheSetDirComplete.  To be called before querying the host.
+ */
+uint32_t vbsfCacheGeneration(void)
+{
+    return ASMAtomicReadU32(&g_uCacheGen);
+}
+
+/**
+ * Looks up the real spelling of a directory entry.
+ *
+ * @returns VINF_SUCCESS and the name in pszName if found.
+ * @returns VERR_FILE_NOT_FOUND if the directory is known not to contain a
+ *          matching entry.
+ * @returns VERR_NOT_FOUND if the cache doesn't know, i.e. the directory has to
+ *          be scanned.
+ * @param   pszDir          The host directory, not terminated.
+ * @param   cchDir          The length of the directory, without the trailing
+ *                          delimiter.
+ * @param   pszComponent    The name as given by the guest.
+ * @param   pszName         Where to return the real name.  Can be the same
+ *                          buffer as pszComponent.
+ * @param   cbName          The size of the buffer.  Only names with the same
+ *                          length as pszComponent are returned.
+ */
+int vbsfCacheLookupName(const char *pszDir, size_t cchDir, const char *pszComponent, char *pszName, size_t cbName)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return VERR_NOT_FOUND;
+
+    char         szKey[RTPATH_MAX];
+    size_t const cchComponent = strlen(pszComponent);
+    if (cchDir + 1 + cchComponent >= sizeof(szKey))
+        return VERR_NOT_FOUND;
+    memcpy(szKey, pszDir, cchDir);
+    szKey[cchDir] = RTPATH_DELIMITER;
+    memcpy(&szKey[cchDir + 1], pszComponent, cchComponent + 1);
+    RTStrToLower(&szKey[cchDir + 1]);
+    size_t const   cchKey = cchDir + 1 + strlen(&szKey[cchDir + 1]);
+    uint32_t const uHash  = vbsfCacheHashPath(pszDir, cchDir);
+    uint64_t const u64Now = RTTimeMilliTS();
+    bool           fComplete = false;
+    int            rc     = VERR_NOT_FOUND;
+
+    RTCritSectEnter(&g_CacheCritSect);
+
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[uHash % SHFLCACHE_HASH_SIZE];
+    while (*ppEntry)
+    {
+        PSHFLCACHEENTRY pEntry = *ppEntry;
+        if (   pEntry->uType != SHFLCACHE_TYPE_INFO
+            && pEntry->uHash == uHash
+            && pEntry->cchDir == cchDir
+            && !memcmp(pEntry->szKey, pszDir, cchDir))
+        {
+            if (pEntry->u64Expire <= u64Now)
+            {
+                /* Part of the directory is stale, forget all of it. */
+                vbsfCacheInvalidateDirLocked(pszDir, cchDir);
+                fComplete = false;
+                rc = VERR_NOT_FOUND;
+                break;
+            }
+            if (pEntry->uType == SHFLCACHE_TYPE_DIR_COMPLETE)
+                fComplete = true;
+            else if (   rc == VERR_NOT_FOUND
+                     && pEntry->cchKey == cchKey
+                     && !memcmp(pEntry->szKey, szKey, cchKey)
+                     && strlen(pEntry->pszName) == cchComponent)
+            {
+                if (cchComponent < cbName)
+                {
+                    memcpy(pszName, pEntry->pszName, cchComponent + 1);
+                    rc = VINF_SUCCESS;
+                }
+                else
+                    rc = VERR_BUFFER_OVERFLOW;
+                vbsfCacheEntryTouchLocked(pEntry);
+            }
+        }
+        ppEntry = &pEntry->pNext;
+    }
+
+    if (rc == VERR_NOT_FOUND && fComplete)
+        rc = VERR_FILE_NOT_FOUND;
+    if (rc != VERR_NOT_FOUND)
+        g_CacheStats.cNameHits++;
+    else
+        g_CacheStats.cNameMisses++;
+
+    RTCritSectLeave(&g_CacheCritSect);
+    return rc;
+}
+
+/**
+ * Remembers the real spelling of a directory entry.
+ *
+ * @returns VBox status code, failure if the name was not added.
+ * @param   pszDir      The host directory, not terminated.
+ * @param   cchDir      The length of the directory, without the trailing
+ *                      delimiter.
+ * @param   pszName     The name of the entry.
+ * @param   uGen        What vbsfCacheGeneration returned before the directory
+ *                      was read.  Nothing is added if entries were invalidated
+ *                      meanwhile.
+ */
+int vbsfCacheInsertName(const char *pszDir, size_t cchDir, const char *pszName, uint32_t uGen)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return VERR_NOT_SUPPORTED;
+
+    size_t const    cchName = strlen(pszName);
+    size_t const    cchKey  = cchDir + 1 + cchName;
+    PSHFLCACHEENTRY pEntry  = (PSHFLCACHEENTRY)RTMemAlloc(RT_UOFFSETOF(SHFLCACHEENTRY, szKey) + 2 * (cchKey + 1));
+    if (!pEntry)
+        return VERR_NO_MEMORY;
+
+    memcpy(pEntry->szKey, pszDir, cchDir);
+    pEntry->szKey[cchDir] = RTPATH_DELIMITER;
+    memcpy(&pEntry->szKey[cchDir + 1], pszName, cchName + 1);
+    RTStrToLower(&pEntry->szKey[cchDir + 1]);
+    pEntry->cchKey  = cchDir + 1 + strlen(&pEntry->szKey[cchDir + 1]);
+    pEntry->pszName = (char *)memcpy(&pEntry->szKey[pEntry->cchKey + 1], pszName, cchName + 1);
+    pEntry->cchDir  = cchDir;
+    pEntry->uHash   = vbsfCacheHashPath(pszDir, cchDir);
+    pEntry->uType   = SHFLCACHE_TYPE_NAME;
+    pEntry->fFlags  = 0;
+    pEntry->rc      = VINF_SUCCESS;
+    RT_ZERO(pEntry->Info);
+
+    RTCritSectEnter(&g_CacheCritSect);
+
+    if (   ASMAtomicReadU32(&g_uCacheGen) != uGen
+        || !vbsfCacheWatchDirLocked(pszDir, cchDir))
+    {
+        RTCritSectLeave(&g_CacheCritSect);
+        RTMemFree(pEntry);
+        return VERR_TRY_AGAIN;
+    }
+
+    /* The first spelling found wins, like in a directory scan. */
+    PSHFLCACHEENTRY pCur = g_apCacheHash[pEntry->uHash % SHFLCACHE_HASH_SIZE];
+    for (; pCur; pCur = pCur->pNext)
+        if (   pCur->uType == SHFLCACHE_TYPE_NAME
+            && pCur->uHash == pEntry->uHash
+            && pCur->cchDir == cchDir
+            && pCur->cchKey == pEntry->cchKey
+            && !memcmp(pCur->szKey, pEntry->szKey, pEntry->cchKey))
+            break;
+    if (!pCur)
+        vbsfCacheEntryInsertLocked(pEntry);
+    else
+        RTMemFree(pEntry);
+
+    RTCritSectLeave(&g_CacheCritSect);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Marks a directory as completely present in the cache after a full scan.
+ *
+ * @param   pszDir      The host directory, not terminated.
+ * @param   cchDir      The length of the directory, without the trailing
+ *                      delimiter.
+ * @param   uDirGen     What vbsfCacheGeneration returned before the scan.
+ *                      Nothing is done if entries have been dropped meanwhile.
+ */
+void vbsfCacheSetDirComplete(const char *pszDir, size_t cchDir, uint32_t uDirGen)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return;
+
+    PSHFLCACHEENTRY pEntry = (PSHFLCACHEENTRY)RTMemAlloc(RT_UOFFSETOF(SHFLCACHEENTRY, szKey) + cchDir + 1);
+    if (!pEntry)
+        return;
+
+    memcpy(pEntry->szKey, pszDir, cchDir);
+    pEntry->szKey[cchDir] = '\0';
+    pEntry->cchKey  = cchDir;
+    pEntry->cchDir  = cchDir;
+    pEntry->pszName = NULL;
+    pEntry->uHash   = vbsfCacheHashPath(pszDir, cchDir);
+    pEntry->uType   = SHFLCACHE_TYPE_DIR_COMPLETE;
+    pEntry->fFlags  = 0;
+    pEntry->rc      = VINF_SUCCESS;
+    RT_ZERO(pEntry->Info);
+
+    RTCritSectEnter(&g_CacheCritSect);
+    if (ASMAtomicReadU32(&g_uCacheGen) == uDirGen)
+        vbsfCacheEntryInsertLocked(pEntry);
+    else
+        RTMemFree(pEntry);
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+/**
+ * Forgets everything about a path after the guest created, removed or renamed
+ * it, including the attributes of the parent directory, which changed as well.
+ *
+ * If the path is a directory and it was removed or renamed the caller must
+ * use vbsfCacheInvalidateAll instead, as paths below it are affected as well.
+ */
+void vbsfCacheInvalidatePath(const char *pszPath)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return;
+
+    size_t const cchPath = strlen(pszPath);
+
+    size_t const cchDir  = vbsfCacheDirLength(pszPath, cchPath);
+
+    RTCritSectEnter(&g_CacheCritSect);
+    vbsfCacheInvalidateInfoLocked(pszPath, cchPath);
+    vbsfCacheInvalidateInfoLocked(pszPath, cchDir);
+    vbsfCacheInvalidateDirLocked(pszPath, cchDir);
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+/**
+ * Forgets the attributes of the object with the given path hash after the
+ * guest modified it through a handle.
+ *
+ * This is called for every write, so an empty hash chain is checked without
+ * taking the lock and the generation is only bumped when something was
+ * actually dropped.
+ */
+void vbsfCacheInvalidateHash(uint32_t uPathHash)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return;
+
+    PSHFLCACHEENTRY *ppEntry = &g_apCacheHash[uPathHash % SHFLCACHE_HASH_SIZE];
+    if (!ASMAtomicUoReadPtrT(ppEntry, PSHFLCACHEENTRY))
+        return;
+
+    bool fFound = false;
+    RTCritSectEnter(&g_CacheCritSect);
+    while (*ppEntry)
+    {
+        PSHFLCACHEENTRY pEntry = *ppEntry;
+        if (   pEntry->uType == SHFLCACHE_TYPE_INFO
+            && pEntry->uHash == uPathHash)
+        {
+            vbsfCacheEntryRemove(ppEntry);
+            g_CacheStats.cInvalidations++;
+            fFound = true;
+        }
+        else
+            ppEntry = &pEntry->pNext;
+    }
+    if (fFound)
+        ASMAtomicIncU32(&g_uCacheGen);
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+void vbsfCacheInvalidateAll(void)
+{
+    if (!ASMAtomicReadU32(&g_cMsCacheTtl))
+        return;
+
+    RTCritSectEnter(&g_CacheCritSect);
+    vbsfCacheInvalidateAllLocked();
+    RTCritSectLeave(&g_CacheCritSect);
+}
+
+bool vbsfCacheIsEnabled(void)
+{
+    return ASMAtomicReadU32(&g_cMsCacheTtl) != 0;
+}
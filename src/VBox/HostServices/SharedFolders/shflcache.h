@@ -0,0 +1,70 @@
+/* $Id$ */
+/** @file
+ * Shared Folders: Host side metadata and casing cache.
+ */
+
+/*
+ * Copyright (C) 2013 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___SHFLCACHE_H
+#define ___SHFLCACHE_H
+
+#include "shfl.h"
+#include <iprt/fs.h>
+
+/** Cache statistics. */
+typedef struct SHFLCACHESTATS
+{
+    /** Attribute lookups answered from the cache. */
+    uint64_t    cInfoHits;
+    /** Attribute lookups which had to go to the host file system. */
+    uint64_t    cInfoMisses;
+    /** Case corrections answered from the cache. */
+    uint64_t    cNameHits;
+    /** Case corrections which had to scan the host directory. */
+    uint64_t    cNameMisses;
+    /** Entries dropped because the object changed. */
+    uint64_t    cInvalidations;
+    /** Entries dropped because the cache was full. */
+    uint64_t    cEvictions;
+    /** Change notifications received from the host. */
+    uint64_t    cNotifications;
+    /** Current number of entries. */
+    uint32_t    cEntries;
+    /** Current number of watched host directories. */
+    uint32_t    cWatches;
+} SHFLCACHESTATS;
+/** Pointer to cache statistics. */
+typedef SHFLCACHESTATS *PSHFLCACHESTATS;
+
+int      vbsfCacheInit(void);
+void     vbsfCacheTerm(void);
+int      vbsfCacheSetTtl(uint32_t cMsTtl);
+uint32_t vbsfCacheHashPath(const char *pszPath, size_t cchPath);
+
+bool     vbsfCacheIsEnabled(void);
+
+uint32_t vbsfCacheGeneration(void);
+
+bool     vbsfCacheLookupInfo(const char *pszPath, uint32_t fFlags, PRTFSOBJINFO pInfo, int *prc);
+void     vbsfCacheInsertInfo(const char *pszPath, uint32_t fFlags, int rc, PCRTFSOBJINFO pInfo, uint32_t uGen);
+void     vbsfCacheInsertDirEntry(const char *pszDir, const char *pszName, uint32_t fFlags, PCRTFSOBJINFO pInfo, uint32_t uGen);
+
+int      vbsfCacheLookupName(const char *pszDir, size_t cchDir, const char *pszComponent, char *pszName, size_t cbName);
+int      vbsfCacheInsertName(const char *pszDir, size_t cchDir, const char *pszName, uint32_t uGen);
+void     vbsfCacheSetDirComplete(const char *pszDir, size_t cchDir, uint32_t uDirGen);
+
+void     vbsfCacheInvalidatePath(const char *pszPath);
+void     vbsfCacheInvalidateHash(uint32_t uPathHash);
+void     vbsfCacheInvalidateAll(void);
+
+#endif /* !___SHFLCACHE_H */
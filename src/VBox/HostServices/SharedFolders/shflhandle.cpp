@@ -18,134 +18,242 @@
 
 #include "shflhandle.h"
 #include <iprt/alloc.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/critsect.h>
 
 
 /*
- * Very basic and primitive handle management. Should be sufficient for our needs.
- * Handle allocation can be rather slow, but at least lookup is fast.
+ * Every client has its own handle table so clients neither compete for
+ * handles nor for a lock.  The table is a fixed directory of chunks which are
+ * allocated as the client opens more objects.  Chunks are only freed together
+ * with the table when the client disconnects, so looking up a handle needs no
+ * lock: the chunk pointer and the entry are read atomically.  Allocating and
+ * freeing handles is serialized by the table's critical section, free entries
+ * are kept in a list.
  *
+ * The callers make sure that a handle is not freed while it is being used, the
+ * worker threads execute all requests for a handle on the same lane.
  */
+#define SHFLHANDLE_CHUNK_SHIFT  8
+#define SHFLHANDLE_CHUNK_SIZE   (1 << SHFLHANDLE_CHUNK_SHIFT)
+#define SHFLHANDLE_CHUNK_MASK   (SHFLHANDLE_CHUNK_SIZE - 1)
+#define SHFLHANDLE_MAX_CHUNKS   (SHFLHANDLE_MAX / SHFLHANDLE_CHUNK_SIZE)
+AssertCompile(SHFLHANDLE_MAX % SHFLHANDLE_CHUNK_SIZE == 0);
+
+/** End of the free list. */
+#define SHFLHANDLE_FREE_END     UINT32_MAX
+
 typedef struct
 {
-    uint32_t         uFlags;
-    uintptr_t        pvUserData;
-    PSHFLCLIENTDATA  pClient;
+    uint32_t volatile   uFlags;
+    /** Index of the next free entry if not valid. */
+    uint32_t            iNextFree;
+    void * volatile     pvUserData;
 } SHFLINTHANDLE, *PSHFLINTHANDLE;
 
-static SHFLINTHANDLE *pHandles = NULL;
-static int32_t        lastHandleIndex = 0;
-static RTCRITSECT     lock;
-
-int vbsfInitHandleTable()
+typedef struct SHFLHANDLETABLE
 {
-    pHandles = (SHFLINTHANDLE *)RTMemAllocZ (sizeof (SHFLINTHANDLE) * SHFLHANDLE_MAX);
-    if (pHandles == NULL)
+    /** Serializes allocating and freeing handles. */
+    RTCRITSECT                  CritSect;
+    /** Head of the free list. */
+    uint32_t                    iFreeHead;
+    /** Number of allocated chunks. */
+    uint32_t                    cChunks;
+    /** Number of handles in use. */
+    uint32_t                    cUsed;
+    /** The chunks, allocated on demand. */
+    PSHFLINTHANDLE volatile     apChunks[SHFLHANDLE_MAX_CHUNKS];
+} SHFLHANDLETABLE, *PSHFLHANDLETABLE;
+
+
+/**
+ * Returns the client's handle table, creating it if necessary.
+ */
+static PSHFLHANDLETABLE vbsfGetHandleTable(PSHFLCLIENTDATA pClient)
+{
+    PSHFLHANDLETABLE pTable = ASMAtomicReadPtrT(&pClient->pHandleTable, PSHFLHANDLETABLE);
+    if (pTable)
+        return pTable;
+
+    pTable = (PSHFLHANDLETABLE)RTMemAllocZ(sizeof(*pTable));
+    if (!pTable)
+        return NULL;
+    int rc = RTCritSectInit(&pTable->CritSect);
+    if (RT_FAILURE(rc))
     {
-        AssertFailed();
-        return VERR_NO_MEMORY;
+        RTMemFree(pTable);
+        return NULL;
     }
+    pTable->iFreeHead = SHFLHANDLE_FREE_END;
 
-    /* Never return handle 0 */
-    pHandles[0].uFlags = SHFL_HF_TYPE_DONTUSE;
-    lastHandleIndex    = 1;
-
-    return RTCritSectInit(&lock);
+    /* Several worker threads may get here for the same client. */
+    if (!ASMAtomicCmpXchgPtr(&pClient->pHandleTable, pTable, NULL))
+    {
+        RTCritSectDelete(&pTable->CritSect);
+        RTMemFree(pTable);
+        pTable = ASMAtomicReadPtrT(&pClient->pHandleTable, PSHFLHANDLETABLE);
+    }
+    return pTable;
 }
 
-int vbsfFreeHandleTable()
+/**
+ * Adds a chunk of free handles to the table.
+ */
+static int vbsfGrowHandleTable(PSHFLHANDLETABLE pTable)
 {
-    if (pHandles)
-        RTMemFree(pHandles);
+    if (pTable->cChunks >= SHFLHANDLE_MAX_CHUNKS)
+        return VERR_TOO_MANY_OPEN_FILES;
 
-    pHandles = NULL;
+    PSHFLINTHANDLE paChunk = (PSHFLINTHANDLE)RTMemAllocZ(sizeof(SHFLINTHANDLE) * SHFLHANDLE_CHUNK_SIZE);
+    if (!paChunk)
+        return VERR_NO_MEMORY;
 
-    if (RTCritSectIsInitialized(&lock))
-        RTCritSectDelete(&lock);
+    /* Link the entries in ascending order, never hand out handle 0. */
+    uint32_t const iBase = pTable->cChunks << SHFLHANDLE_CHUNK_SHIFT;
+    for (uint32_t i = SHFLHANDLE_CHUNK_SIZE; i-- > 0;)
+    {
+        paChunk[i].iNextFree = pTable->iFreeHead;
+        if (iBase + i != 0)
+            pTable->iFreeHead = iBase + i;
+        else
+            paChunk[i].uFlags = SHFL_HF_TYPE_DONTUSE;
+    }
 
+    ASMAtomicWritePtr(&pTable->apChunks[pTable->cChunks], paChunk);
+    pTable->cChunks++;
     return VINF_SUCCESS;
 }
 
-SHFLHANDLE  vbsfAllocHandle(PSHFLCLIENTDATA pClient, uint32_t uType,
-                            uintptr_t pvUserData)
+/**
+ * Looks up a handle table entry without taking the lock.
+ */
+DECLINLINE(PSHFLINTHANDLE) vbsfLookupHandle(PSHFLCLIENTDATA pClient, SHFLHANDLE handle)
 {
-    SHFLHANDLE handle;
-
-    Assert((uType & SHFL_HF_TYPE_MASK) != 0 && pvUserData);
-
-    RTCritSectEnter(&lock);
-
-    /* Find next free handle */
-    if(lastHandleIndex >= SHFLHANDLE_MAX-1)
+    PSHFLHANDLETABLE pTable = ASMAtomicReadPtrT(&pClient->pHandleTable, PSHFLHANDLETABLE);
+    if (   pTable
+        && handle < SHFLHANDLE_MAX)
     {
-        lastHandleIndex = 1;
+        PSHFLINTHANDLE paChunk = ASMAtomicReadPtrT(&pTable->apChunks[handle >> SHFLHANDLE_CHUNK_SHIFT], PSHFLINTHANDLE);
+        if (paChunk)
+            return &paChunk[handle & SHFLHANDLE_CHUNK_MASK];
     }
+    return NULL;
+}
 
-    /* Nice linear search */
-    for(handle=lastHandleIndex;handle<SHFLHANDLE_MAX;handle++)
+/**
+ * Frees all remaining handles and the handle table of a client.
+ *
+ * The caller has closed the objects already, see vbsfDisconnect.
+ */
+int vbsfFreeHandleTable(PSHFLCLIENTDATA pClient)
+{
+    PSHFLHANDLETABLE pTable = ASMAtomicXchgPtrT(&pClient->pHandleTable, NULL, PSHFLHANDLETABLE);
+    if (pTable)
     {
-        if(pHandles[handle].pvUserData == 0)
+        for (uint32_t i = 0; i < pTable->cChunks; i++)
         {
-            lastHandleIndex = handle;
-            break;
+            PSHFLINTHANDLE paChunk = pTable->apChunks[i];
+            for (uint32_t j = 0; j < SHFLHANDLE_CHUNK_SIZE; j++)
+                if (paChunk[j].uFlags & SHFL_HF_VALID)
+                    RTMemFree(paChunk[j].pvUserData);
+            RTMemFree(paChunk);
         }
+        RTCritSectDelete(&pTable->CritSect);
+        RTMemFree(pTable);
     }
 
-    if(handle == SHFLHANDLE_MAX)
+    return VINF_SUCCESS;
+}
+
+/**
+ * Returns the number of handle values which may be in use by the client, for
+ * enumerating them.
+ */
+uint32_t vbsfQueryHandleLimit(PSHFLCLIENTDATA pClient)
+{
+    PSHFLHANDLETABLE pTable = ASMAtomicReadPtrT(&pClient->pHandleTable, PSHFLHANDLETABLE);
+    if (pTable)
+        return ASMAtomicReadU32(&pTable->cChunks) << SHFLHANDLE_CHUNK_SHIFT;
+    return 0;
+}
+
+SHFLHANDLE  vbsfAllocHandle(PSHFLCLIENTDATA pClient, uint32_t uType,
+                            uintptr_t pvUserData)
+{
+    Assert((uType & SHFL_HF_TYPE_MASK) != 0 && pvUserData);
+
+    PSHFLHANDLETABLE pTable = vbsfGetHandleTable(pClient);
+    if (!pTable)
+        return SHFL_HANDLE_NIL;
+
+    RTCritSectEnter(&pTable->CritSect);
+
+    if (pTable->iFreeHead == SHFLHANDLE_FREE_END)
     {
-        /* Try once more from the start */
-        for(handle=1;handle<SHFLHANDLE_MAX;handle++)
-        {
-            if(pHandles[handle].pvUserData == 0)
-            {
-                lastHandleIndex = handle;
-                break;
-            }
-        }
-        if(handle == SHFLHANDLE_MAX)
+        int rc = vbsfGrowHandleTable(pTable);
+        if (RT_FAILURE(rc))
         { /* Out of handles */
-            RTCritSectLeave(&lock);
-            AssertFailed();
+            RTCritSectLeave(&pTable->CritSect);
+            LogRel(("SharedFolders: cannot allocate handle: %Rrc (%u in use)\n", rc, pTable->cUsed));
             return SHFL_HANDLE_NIL;
         }
     }
-    pHandles[handle].uFlags     = (uType & SHFL_HF_TYPE_MASK) | SHFL_HF_VALID;
-    pHandles[handle].pvUserData = pvUserData;
-    pHandles[handle].pClient    = pClient;
 
-    lastHandleIndex++;
+    uint32_t const handle = pTable->iFreeHead;
+    PSHFLINTHANDLE pEntry = &pTable->apChunks[handle >> SHFLHANDLE_CHUNK_SHIFT][handle & SHFLHANDLE_CHUNK_MASK];
+    pTable->iFreeHead = pEntry->iNextFree;
+    pTable->cUsed++;
+
+    /* The user data must be visible before the entry turns valid. */
+    ASMAtomicWritePtr(&pEntry->pvUserData, (void *)pvUserData);
+    ASMAtomicWriteU32(&pEntry->uFlags, (uType & SHFL_HF_TYPE_MASK) | SHFL_HF_VALID);
 
-    RTCritSectLeave(&lock);
+    RTCritSectLeave(&pTable->CritSect);
 
     return handle;
 }
 
 static int vbsfFreeHandle(PSHFLCLIENTDATA pClient, SHFLHANDLE handle)
 {
-    if (   handle < SHFLHANDLE_MAX
-        && (pHandles[handle].uFlags & SHFL_HF_VALID)
-        && pHandles[handle].pClient == pClient)
+    int rc = VERR_INVALID_HANDLE;
+
+    PSHFLHANDLETABLE pTable = ASMAtomicReadPtrT(&pClient->pHandleTable, PSHFLHANDLETABLE);
+    if (!pTable)
+        return rc;
+
+    /* Serialize with vbsfAllocHandle, handles are freed by the worker threads too. */
+    RTCritSectEnter(&pTable->CritSect);
+
+    PSHFLINTHANDLE pEntry = vbsfLookupHandle(pClient, handle);
+    if (   pEntry
+        && (pEntry->uFlags & SHFL_HF_VALID))
     {
-        pHandles[handle].uFlags     = 0;
-        pHandles[handle].pvUserData = 0;
-        pHandles[handle].pClient    = 0;
-        return VINF_SUCCESS;
+        ASMAtomicWriteU32(&pEntry->uFlags, 0);
+        ASMAtomicWriteNullPtr(&pEntry->pvUserData);
+        pEntry->iNextFree = pTable->iFreeHead;
+        pTable->iFreeHead = (uint32_t)handle;
+        pTable->cUsed--;
+        rc = VINF_SUCCESS;
     }
-    return VERR_INVALID_HANDLE;
+
+    RTCritSectLeave(&pTable->CritSect);
+
+    return rc;
 }
 
 uintptr_t vbsfQueryHandle(PSHFLCLIENTDATA pClient, SHFLHANDLE handle,
                           uint32_t uType)
 {
-    if (   handle < SHFLHANDLE_MAX
-        && (pHandles[handle].uFlags & SHFL_HF_VALID)
-        && pHandles[handle].pClient == pClient)
+    PSHFLINTHANDLE pEntry = vbsfLookupHandle(pClient, handle);
+    if (pEntry)
     {
+        uint32_t const uFlags = ASMAtomicReadU32(&pEntry->uFlags);
         Assert((uType & SHFL_HF_TYPE_MASK) != 0);
 
-        if (pHandles[handle].uFlags & uType)
-            return pHandles[handle].pvUserData;
+        if (   (uFlags & SHFL_HF_VALID)
+            && (uFlags & uType))
+            return (uintptr_t)ASMAtomicReadPtrT(&pEntry->pvUserData, void *);
     }
     return 0;
 }
@@ -164,12 +272,14 @@ SHFLFILEHANDLE *vbsfQueryDirHandle(PSHFLCLIENTDATA pClient, SHFLHANDLE handle)
 
 uint32_t vbsfQueryHandleType(PSHFLCLIENTDATA pClient, SHFLHANDLE handle)
 {
-    if (   handle < SHFLHANDLE_MAX
-        && (pHandles[handle].uFlags & SHFL_HF_VALID)
-        && pHandles[handle].pClient == pClient)
-        return pHandles[handle].uFlags & SHFL_HF_TYPE_MASK;
-    else
-        return 0;
+    PSHFLINTHANDLE pEntry = vbsfLookupHandle(pClient, handle);
+    if (pEntry)
+    {
+        uint32_t const uFlags = ASMAtomicReadU32(&pEntry->uFlags);
+        if (uFlags & SHFL_HF_VALID)
+            return uFlags & SHFL_HF_TYPE_MASK;
+    }
+    return 0;
 }
 
 SHFLHANDLE vbsfAllocDirHandle(PSHFLCLIENTDATA pClient)
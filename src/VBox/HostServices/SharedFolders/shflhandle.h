@@ -31,7 +31,8 @@
 
 #define SHFL_HF_VALID           (0x80000000)
 
-#define SHFLHANDLE_MAX          (4096)
+/** Maximum number of handles per client. */
+#define SHFLHANDLE_MAX          (_256K)
 
 typedef struct _SHFLHANDLEHDR
 {
@@ -43,6 +44,7 @@ typedef struct _SHFLHANDLEHDR
 typedef struct _SHFLFILEHANDLE
 {
     SHFLHANDLEHDR Header;
+    uint32_t      uPathHash;    /* hash of the host path, for cache invalidation */
     union
     {
         struct
@@ -54,6 +56,7 @@ typedef struct _SHFLFILEHANDLE
             PRTDIR        Handle;
             PRTDIR        SearchHandle;
             PRTDIRENTRYEX pLastValidEntry; /* last found file in a directory search */
+            char         *pszDir;          /* host directory being listed, only if caching */
         } dir;
     };
 } SHFLFILEHANDLE;
@@ -64,8 +67,8 @@ SHFLHANDLE      vbsfAllocFileHandle(PSHFLCLIENTDATA pClient);
 void            vbsfFreeFileHandle (PSHFLCLIENTDATA pClient, SHFLHANDLE hHandle);
 
 
-int         vbsfInitHandleTable();
-int         vbsfFreeHandleTable();
+int         vbsfFreeHandleTable(PSHFLCLIENTDATA pClient);
+uint32_t    vbsfQueryHandleLimit(PSHFLCLIENTDATA pClient);
 SHFLHANDLE  vbsfAllocHandle(PSHFLCLIENTDATA pClient, uint32_t uType,
                             uintptr_t pvUserData);
 SHFLFILEHANDLE *vbsfQueryFileHandle(PSHFLCLIENTDATA pClient,
@@ -0,0 +1,553 @@
+/* $Id$ */
+/** @file
+ * Shared Folders: Parallel I/O benchmark.
+ *
+ * This testcase loads the shared folders service, maps a temporary host
+ * directory and keeps a number of guest READ/WRITE requests on different
+ * files in flight at the same time, once with synchronous execution on the
+ * calling thread and once for each requested worker pool size.  The results
+ * are checked and the achieved throughput is reported.  Then several writes
+ * per handle are kept in flight to check that they complete in the order
+ * issued.  Finally path lookups are timed with the metadata cache disabled
+ * and enabled.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/******************************************************************************
+*   Header Files                                                              *
+******************************************************************************/
+#include <VBox/shflsvc.h>
+#include <VBox/hgcmsvc.h>
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/dir.h>
+#include <iprt/getopt.h>
+#include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+
+/******************************************************************************
+*   Defined Constants And Macros                                              *
+******************************************************************************/
+/** Maximum number of files (i.e. requests in flight). */
+#define TST_FILES_MAX       256
+/** Number of writes kept in flight per file by the ordering test. */
+#define TST_ORDER_DEPTH     8
+
+
+/******************************************************************************
+*   Structures and Typedefs                                                   *
+******************************************************************************/
+/** Call handle structure for the guest call completion callback. */
+struct VBOXHGCMCALLHANDLE_TYPEDEF
+{
+    /** Where to store the result code */
+    int32_t volatile rc;
+    /** The sequence number of the request within its handle, 1 based.  Only
+     * used by the ordering test. */
+    uint32_t         iSeq;
+    /** The sequence number of the last completed request on the handle, NULL
+     * if not checked. */
+    uint32_t volatile *piLastSeq;
+};
+
+/** Shared folder string with room for a short path. */
+struct TESTSHFLSTRING
+{
+    SHFLSTRING string;
+    char acData[512];
+};
+
+/** Per file state. */
+typedef struct TSTFILE
+{
+    /** The service handle. */
+    SHFLHANDLE                  hFile;
+    /** The call handle of the request in flight. */
+    VBOXHGCMCALLHANDLE_TYPEDEF  Call;
+    /** The request parameters. */
+    VBOXHGCMSVCPARM             aParms[SHFL_CPARMS_READ];
+    /** The data buffer. */
+    uint8_t                    *pbBuf;
+    /** The sequence number of the last completed ordering test request. */
+    uint32_t volatile           iLastSeq;
+} TSTFILE, *PTSTFILE;
+
+/** A request of the ordering test. */
+typedef struct TSTORDERREQ
+{
+    /** The call handle. */
+    VBOXHGCMCALLHANDLE_TYPEDEF  Call;
+    /** The request parameters. */
+    VBOXHGCMSVCPARM             aParms[SHFL_CPARMS_WRITE];
+} TSTORDERREQ, *PTSTORDERREQ;
+
+
+/******************************************************************************
+*   Global Variables                                                          *
+******************************************************************************/
+static RTTEST               g_hTest = NIL_RTTEST;
+/** Number of requests still to be completed. */
+static uint32_t volatile    g_cPending = 0;
+/** Signalled when the last pending request has been completed. */
+static RTSEMEVENT           g_hEvtDone = NIL_RTSEMEVENT;
+/** Number of requests completed before an earlier one on the same handle. */
+static uint32_t volatile    g_cOutOfOrder = 0;
+
+static uint32_t             g_cFiles     = 8;
+static uint32_t             g_cbFile     = _256K;
+static uint32_t             g_cbIo       = _16K;
+static uint32_t             g_cPasses    = 2;
+static uint32_t             g_cLookups   = 2000;
+
+
+/******************************************************************************
+*   Declarations                                                              *
+******************************************************************************/
+extern "C" DECLCALLBACK(DECLEXPORT(int)) VBoxHGCMSvcLoad (VBOXHGCMSVCFNTABLE *ptable);
+
+
+/** Call completion callback, may be invoked on any thread. */
+static DECLCALLBACK(void) callComplete(VBOXHGCMCALLHANDLE callHandle, int32_t rc)
+{
+    if (   callHandle->piLastSeq
+        && ASMAtomicXchgU32(callHandle->piLastSeq, callHandle->iSeq) + 1 != callHandle->iSeq)
+        ASMAtomicIncU32(&g_cOutOfOrder);
+    ASMAtomicWriteS32(&callHandle->rc, rc);
+    if (ASMAtomicDecU32(&g_cPending) == 0)
+        RTSemEventSignal(g_hEvtDone);
+}
+
+static void fillTestShflString(struct TESTSHFLSTRING *pDest, const char *pcszSource)
+{
+    AssertRelease(  strlen(pcszSource) * 2 + 2
+                  < sizeof(*pDest) - RT_UOFFSETOF(SHFLSTRING, String));
+    pDest->string.u16Length = (uint16_t)(strlen(pcszSource) * sizeof(RTUTF16));
+    pDest->string.u16Size   = pDest->string.u16Length + sizeof(RTUTF16);
+    for (unsigned i = 0; i <= pDest->string.u16Length / sizeof(RTUTF16); ++i)
+        pDest->string.String.ucs2[i] = (uint16_t)pcszSource[i];
+}
+
+/**
+ * Issues a single call and waits for it, regardless of whether the service
+ * completes it synchronously or on a worker.
+ */
+static int callAndWait(VBOXHGCMSVCFNTABLE *pTable, uint32_t u32Function, uint32_t cParms, VBOXHGCMSVCPARM *paParms)
+{
+    VBOXHGCMCALLHANDLE_TYPEDEF Call = { VERR_INTERNAL_ERROR };
+
+    ASMAtomicWriteU32(&g_cPending, 1);
+    pTable->pfnCall(NULL, &Call, 1, pTable->pvService, u32Function, cParms, paParms);
+    while (ASMAtomicReadU32(&g_cPending) != 0)
+        RTSemEventWait(g_hEvtDone, RT_INDEFINITE_WAIT);
+    return Call.rc;
+}
+
+static int setWorkers(VBOXHGCMSVCFNTABLE *pTable, uint32_t cWorkers)
+{
+    VBOXHGCMSVCPARM Parm;
+    Parm.setUInt32(cWorkers);
+    return pTable->pfnHostCall(NULL, SHFL_FN_SET_WORKER_THREADS, SHFL_CPARMS_SET_WORKER_THREADS, &Parm);
+}
+
+/**
+ * Runs one pass over all files, keeping one request per file in flight.
+ *
+ * @returns Number of nanoseconds it took.
+ */
+static uint64_t doPass(VBOXHGCMSVCFNTABLE *pTable, SHFLROOT Root, PTSTFILE paFiles, bool fWrite, uint8_t bPattern)
+{
+    uint64_t const nsStart = RTTimeNanoTS();
+
+    for (uint32_t off = 0; off < g_cbFile; off += g_cbIo)
+    {
+        ASMAtomicWriteU32(&g_cPending, g_cFiles);
+        for (uint32_t i = 0; i < g_cFiles; i++)
+        {
+            PTSTFILE pFile = &paFiles[i];
+
+            if (fWrite)
+                memset(pFile->pbBuf, bPattern ^ (uint8_t)i, g_cbIo);
+            pFile->Call.rc = VERR_INTERNAL_ERROR;
+            pFile->aParms[0].setUInt32(Root);
+            pFile->aParms[1].setUInt64(pFile->hFile);
+            pFile->aParms[2].setUInt64(off);
+            pFile->aParms[3].setUInt32(g_cbIo);
+            pFile->aParms[4].setPointer(pFile->pbBuf, g_cbIo);
+            pTable->pfnCall(NULL, &pFile->Call, 1, pTable->pvService,
+                            fWrite ? SHFL_FN_WRITE : SHFL_FN_READ, SHFL_CPARMS_READ, pFile->aParms);
+        }
+
+        while (ASMAtomicReadU32(&g_cPending) != 0)
+            RTSemEventWait(g_hEvtDone, RT_INDEFINITE_WAIT);
+
+        for (uint32_t i = 0; i < g_cFiles; i++)
+        {
+            PTSTFILE pFile = &paFiles[i];
+
+            RTTEST_CHECK_RC(g_hTest, pFile->Call.rc, VINF_SUCCESS);
+            RTTEST_CHECK(g_hTest, pFile->aParms[3].u.uint32 == g_cbIo);
+            if (!fWrite)
+                RTTEST_CHECK(g_hTest, ASMMemIsAll8(pFile->pbBuf, g_cbIo, bPattern ^ (uint8_t)i) == NULL);
+        }
+    }
+
+    return RTTimeNanoTS() - nsStart;
+}
+
+static void doBenchmark(VBOXHGCMSVCFNTABLE *pTable, SHFLROOT Root, PTSTFILE paFiles, uint32_t cWorkers)
+{
+    RTTestSubF(g_hTest, "%u workers", cWorkers);
+
+    int rc = setWorkers(pTable, cWorkers);
+    RTTEST_CHECK_RC_OK_RETV(g_hTest, rc);
+
+    uint64_t nsWrite = 0;
+    uint64_t nsRead  = 0;
+    for (uint32_t iPass = 0; iPass < g_cPasses; iPass++)
+    {
+        uint8_t bPattern = (uint8_t)(0x5a + iPass * 7 + cWorkers);
+        nsWrite += doPass(pTable, Root, paFiles, true /*fWrite*/, bPattern);
+        nsRead  += doPass(pTable, Root, paFiles, false /*fWrite*/, bPattern);
+    }
+
+    uint64_t cbTotal = (uint64_t)g_cbFile * g_cFiles * g_cPasses;
+    RTTestValue(g_hTest, "Write", cbTotal * RT_NS_1SEC / RT_MAX(nsWrite, 1) / _1K, RTTESTUNIT_KILOBYTES_PER_SEC);
+    RTTestValue(g_hTest, "Read",  cbTotal * RT_NS_1SEC / RT_MAX(nsRead,  1) / _1K, RTTESTUNIT_KILOBYTES_PER_SEC);
+}
+
+/**
+ * Keeps several overlapping writes per file in flight and checks that each
+ * file's requests complete in the order issued and the last write wins, even
+ * when the files are spread over several workers.
+ */
+static void doOrdering(VBOXHGCMSVCFNTABLE *pTable, SHFLROOT Root, PTSTFILE paFiles, uint32_t cWorkers)
+{
+    RTTestSubF(g_hTest, "Ordering, %u workers", cWorkers);
+
+    int rc = setWorkers(pTable, cWorkers);
+    RTTEST_CHECK_RC_OK_RETV(g_hTest, rc);
+
+    uint32_t const cReqs   = g_cFiles * TST_ORDER_DEPTH;
+    PTSTORDERREQ   paReqs  = (PTSTORDERREQ)RTMemAllocZ(cReqs * sizeof(TSTORDERREQ));
+    uint8_t       *pbBufs  = (uint8_t *)RTMemAlloc((size_t)cReqs * g_cbIo);
+    if (!paReqs || !pbBufs)
+    {
+        RTTestFailed(g_hTest, "Out of memory");
+        RTMemFree(pbBufs);
+        RTMemFree(paReqs);
+        return;
+    }
+
+    /* Interleave the files so every worker has several handles queued. */
+    ASMAtomicWriteU32(&g_cOutOfOrder, 0);
+    for (uint32_t i = 0; i < g_cFiles; i++)
+        paFiles[i].iLastSeq = 0;
+    ASMAtomicWriteU32(&g_cPending, cReqs);
+    for (uint32_t iSeq = 1; iSeq <= TST_ORDER_DEPTH; iSeq++)
+        for (uint32_t i = 0; i < g_cFiles; i++)
+        {
+            PTSTORDERREQ pReq = &paReqs[(iSeq - 1) * g_cFiles + i];
+            uint8_t     *pbBuf = &pbBufs[(size_t)((iSeq - 1) * g_cFiles + i) * g_cbIo];
+
+            memset(pbBuf, (uint8_t)(iSeq * 0x11) ^ (uint8_t)i, g_cbIo);
+            pReq->Call.rc        = VERR_INTERNAL_ERROR;
+            pReq->Call.iSeq      = iSeq;
+            pReq->Call.piLastSeq = &paFiles[i].iLastSeq;
+            pReq->aParms[0].setUInt32(Root);
+            pReq->aParms[1].setUInt64(paFiles[i].hFile);
+            pReq->aParms[2].setUInt64(0);
+            pReq->aParms[3].setUInt32(g_cbIo);
+            pReq->aParms[4].setPointer(pbBuf, g_cbIo);
+            pTable->pfnCall(NULL, &pReq->Call, 1, pTable->pvService,
+                            SHFL_FN_WRITE, SHFL_CPARMS_WRITE, pReq->aParms);
+        }
+
+    while (ASMAtomicReadU32(&g_cPending) != 0)
+        RTSemEventWait(g_hEvtDone, RT_INDEFINITE_WAIT);
+
+    for (uint32_t i = 0; i < cReqs; i++)
+        RTTEST_CHECK_RC(g_hTest, paReqs[i].Call.rc, VINF_SUCCESS);
+    RTTEST_CHECK_MSG(g_hTest, g_cOutOfOrder == 0, (g_hTest, "%u requests completed out of order\n", g_cOutOfOrder));
+
+    /* The last write of each file must be the one on disk. */
+    for (uint32_t i = 0; i < g_cFiles; i++)
+    {
+        PTSTFILE pFile = &paFiles[i];
+
+        RT_BZERO(pFile->pbBuf, g_cbIo);
+        pFile->aParms[0].setUInt32(Root);
+        pFile->aParms[1].setUInt64(pFile->hFile);
+        pFile->aParms[2].setUInt64(0);
+        pFile->aParms[3].setUInt32(g_cbIo);
+        pFile->aParms[4].setPointer(pFile->pbBuf, g_cbIo);
+        RTTEST_CHECK_RC_OK(g_hTest, callAndWait(pTable, SHFL_FN_READ, SHFL_CPARMS_READ, pFile->aParms));
+        RTTEST_CHECK(g_hTest, ASMMemIsAll8(pFile->pbBuf, g_cbIo, (uint8_t)(TST_ORDER_DEPTH * 0x11) ^ (uint8_t)i) == NULL);
+    }
+
+    RTMemFree(pbBufs);
+    RTMemFree(paReqs);
+}
+
+/**
+ * Opens or looks up a path.
+ *
+ * @returns The SHFL_XXX result of the create call.
+ */
+static SHFLCREATERESULT createPath(VBOXHGCMSVCFNTABLE *pTable, SHFLROOT Root, const char *pszPath,
+                                   uint32_t fCreateFlags, SHFLHANDLE *phFile)
+{
+    struct TESTSHFLSTRING   Path;
+    SHFLCREATEPARMS         CreateParms;
+    VBOXHGCMSVCPARM         aCreateParms[SHFL_CPARMS_CREATE];
+
+    fillTestShflString(&Path, pszPath);
+    RT_ZERO(CreateParms);
+    CreateParms.Handle      = SHFL_HANDLE_NIL;
+    CreateParms.CreateFlags = fCreateFlags;
+    aCreateParms[0].setUInt32(Root);
+    aCreateParms[1].setPointer(&Path, RT_UOFFSETOF(SHFLSTRING, String) + Path.string.u16Size);
+    aCreateParms[2].setPointer(&CreateParms, sizeof(CreateParms));
+    RTTEST_CHECK_RC_OK(g_hTest, callAndWait(pTable, SHFL_FN_CREATE, SHFL_CPARMS_CREATE, aCreateParms));
+    if (phFile)
+        *phFile = CreateParms.Handle;
+    return CreateParms.Result;
+}
+
+static void doLookupBenchmark(VBOXHGCMSVCFNTABLE *pTable, SHFLROOT Root, uint32_t cMsTtl)
+{
+    RTTestSubF(g_hTest, "Lookups, cache time to live %u ms", cMsTtl);
+
+    VBOXHGCMSVCPARM Parm;
+    Parm.setUInt32(cMsTtl);
+    int rc = pTable->pfnHostCall(NULL, SHFL_FN_SET_CACHE_TTL, SHFL_CPARMS_SET_CACHE_TTL, &Parm);
+    RTTEST_CHECK_RC_OK_RETV(g_hTest, rc);
+
+    /* Existing and missing files, as seen when searching include paths. */
+    uint64_t const nsStart = RTTimeNanoTS();
+    for (uint32_t i = 0; i < g_cLookups; i++)
+    {
+        char szName[32];
+        RTStrPrintf(szName, sizeof(szName), "/file%u", i % g_cFiles);
+        RTTEST_CHECK(g_hTest, createPath(pTable, Root, szName, SHFL_CF_LOOKUP, NULL) == SHFL_FILE_EXISTS);
+        RTTEST_CHECK(g_hTest, createPath(pTable, Root, "/missing", SHFL_CF_LOOKUP, NULL) == SHFL_FILE_NOT_FOUND);
+    }
+    uint64_t const nsElapsed = RTTimeNanoTS() - nsStart;
+    RTTestValue(g_hTest, "Lookup", nsElapsed / RT_MAX(g_cLookups * 2, 1), RTTESTUNIT_NS_PER_CALL);
+
+    /* A cached miss must not hide a file the guest creates. */
+    SHFLHANDLE hFile = SHFL_HANDLE_NIL;
+    RTTEST_CHECK(g_hTest, createPath(pTable, Root, "/missing",
+                                     SHFL_CF_ACCESS_READWRITE | SHFL_CF_ACT_CREATE_IF_NEW | SHFL_CF_ACT_FAIL_IF_EXISTS,
+                                     &hFile) == SHFL_FILE_CREATED);
+    RTTEST_CHECK(g_hTest, createPath(pTable, Root, "/missing", SHFL_CF_LOOKUP, NULL) == SHFL_FILE_EXISTS);
+    if (hFile != SHFL_HANDLE_NIL)
+    {
+        VBOXHGCMSVCPARM aParms[RT_MAX(SHFL_CPARMS_CLOSE, SHFL_CPARMS_REMOVE)];
+        struct TESTSHFLSTRING Path;
+        fillTestShflString(&Path, "/missing");
+        aParms[0].setUInt32(Root);
+        aParms[1].setUInt64(hFile);
+        RTTEST_CHECK_RC_OK(g_hTest, callAndWait(pTable, SHFL_FN_CLOSE, SHFL_CPARMS_CLOSE, aParms));
+        aParms[1].setPointer(&Path, RT_UOFFSETOF(SHFLSTRING, String) + Path.string.u16Size);
+        aParms[2].setUInt32(SHFL_REMOVE_FILE);
+        RTTEST_CHECK_RC_OK(g_hTest, callAndWait(pTable, SHFL_FN_REMOVE, SHFL_CPARMS_REMOVE, aParms));
+    }
+    RTTEST_CHECK(g_hTest, createPath(pTable, Root, "/missing", SHFL_CF_LOOKUP, NULL) == SHFL_FILE_NOT_FOUND);
+}
+
+int main(int argc, char **argv)
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate(RTPathFilename(argv[0]), &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    /*
+     * Parse arguments.  The non-option arguments are the worker pool sizes
+     * to measure besides synchronous execution.
+     */
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--files",        'f', RTGETOPT_REQ_UINT32 },
+        { "--file-size",    's', RTGETOPT_REQ_UINT32 },
+        { "--io-size",      'b', RTGETOPT_REQ_UINT32 },
+        { "--passes",       'p', RTGETOPT_REQ_UINT32 },
+        { "--lookups",      'l', RTGETOPT_REQ_UINT32 },
+    };
+    uint32_t        acWorkers[16];
+    uint32_t        cWorkerCounts = 0;
+    RTGETOPTUNION   Val;
+    RTGETOPTSTATE   State;
+    int rc = RTGetOptInit(&State, argc, argv, &s_aOptions[0], RT_ELEMENTS(s_aOptions), 1, 0);
+    AssertRCReturn(rc, RTEXITCODE_FAILURE);
+    while ((rc = RTGetOpt(&State, &Val)))
+    {
+        switch (rc)
+        {
+            case 'f': g_cFiles  = Val.u32; break;
+            case 's': g_cbFile  = Val.u32; break;
+            case 'b': g_cbIo    = Val.u32; break;
+            case 'p': g_cPasses = Val.u32; break;
+            case 'l': g_cLookups = Val.u32; break;
+            case VINF_GETOPT_NOT_OPTION:
+            {
+                uint32_t cWorkers;
+                rc = RTStrToUInt32Full(Val.psz, 0, &cWorkers);
+                if (   rc != VINF_SUCCESS
+                    || cWorkers > SHFL_MAX_WORKER_THREADS
+                    || cWorkerCounts >= RT_ELEMENTS(acWorkers))
+                    return RTTestSkipAndDestroy(g_hTest, "Bad worker count '%s'", Val.psz);
+                acWorkers[cWorkerCounts++] = cWorkers;
+                break;
+            }
+            default:
+                RTGetOptPrintError(rc, &Val);
+                return RTTestSkipAndDestroy(g_hTest, "Invalid arguments");
+        }
+    }
+    if (   !g_cFiles || g_cFiles > TST_FILES_MAX
+        || !g_cbIo || g_cbFile < g_cbIo || g_cbFile % g_cbIo)
+        return RTTestSkipAndDestroy(g_hTest, "Invalid file/request size combination");
+    if (!cWorkerCounts)
+    {
+        acWorkers[cWorkerCounts++] = 2;
+        acWorkers[cWorkerCounts++] = 4;
+        acWorkers[cWorkerCounts++] = 8;
+    }
+
+    RTTestSub(g_hTest, "Setup");
+    RTTEST_CHECK_RC_OK_RET(g_hTest, RTSemEventCreate(&g_hEvtDone), RTTestSummaryAndDestroy(g_hTest));
+
+    char szDir[RTPATH_MAX];
+    RTTEST_CHECK_RC_OK_RET(g_hTest, RTPathTemp(szDir, sizeof(szDir)), RTTestSummaryAndDestroy(g_hTest));
+    RTTEST_CHECK_RC_OK_RET(g_hTest, RTPathAppend(szDir, sizeof(szDir), "tstShflParallel-XXXXXX"), RTTestSummaryAndDestroy(g_hTest));
+    RTTEST_CHECK_RC_OK_RET(g_hTest, RTDirCreateTemp(szDir, 0700), RTTestSummaryAndDestroy(g_hTest));
+
+    /*
+     * Load the service and map the directory.
+     */
+    VBOXHGCMSVCFNTABLE  svcTable;
+    VBOXHGCMSVCHELPERS  svcHelpers;
+    RT_ZERO(svcTable);
+    RT_ZERO(svcHelpers);
+    svcTable.cbSize             = sizeof(VBOXHGCMSVCFNTABLE);
+    svcTable.u32Version         = VBOX_HGCM_SVC_VERSION;
+    svcHelpers.pfnCallComplete  = callComplete;
+    svcTable.pHelpers           = &svcHelpers;
+    RTTEST_CHECK_RC_OK_RET(g_hTest, VBoxHGCMSvcLoad(&svcTable), RTTestSummaryAndDestroy(g_hTest));
+    svcTable.pvService = RTTestGuardedAllocTail(g_hTest, svcTable.cbClient);
+    RTTEST_CHECK_RET(g_hTest, svcTable.pvService != NULL, RTTestSummaryAndDestroy(g_hTest));
+    RT_BZERO(svcTable.pvService, svcTable.cbClient);
+
+    static struct TESTSHFLSTRING s_FolderName, s_MapName;
+    fillTestShflString(&s_FolderName, szDir);
+    fillTestShflString(&s_MapName, "tstShflParallel");
+
+    VBOXHGCMSVCPARM aParms[RT_MAX(SHFL_CPARMS_ADD_MAPPING, SHFL_CPARMS_MAP_FOLDER)];
+    aParms[0].setPointer(&s_FolderName, RT_UOFFSETOF(SHFLSTRING, String) + s_FolderName.string.u16Size);
+    aParms[1].setPointer(&s_MapName, RT_UOFFSETOF(SHFLSTRING, String) + s_MapName.string.u16Size);
+    aParms[2].setUInt32(SHFL_ADD_MAPPING_F_WRITABLE);
+    rc = svcTable.pfnHostCall(NULL, SHFL_FN_ADD_MAPPING, SHFL_CPARMS_ADD_MAPPING, aParms);
+    RTTEST_CHECK_RC_OK(g_hTest, rc);
+
+    aParms[0].setPointer(&s_MapName, RT_UOFFSETOF(SHFLSTRING, String) + s_MapName.string.u16Size);
+    aParms[1].setUInt32(0);     /* root */
+    aParms[2].setUInt32('/');   /* delimiter */
+    aParms[3].setUInt32(1);     /* case sensitive */
+    rc = callAndWait(&svcTable, SHFL_FN_MAP_FOLDER, SHFL_CPARMS_MAP_FOLDER, aParms);
+    RTTEST_CHECK_RC_OK(g_hTest, rc);
+    SHFLROOT Root = aParms[1].u.uint32;
+
+    /*
+     * Create the files.
+     */
+    PTSTFILE paFiles = (PTSTFILE)RTMemAllocZ(g_cFiles * sizeof(TSTFILE));
+    RTTEST_CHECK(g_hTest, paFiles != NULL);
+    for (uint32_t i = 0; paFiles && i < g_cFiles && RT_SUCCESS(rc); i++)
+    {
+        char                    szName[32];
+        struct TESTSHFLSTRING   Path;
+        SHFLCREATEPARMS         CreateParms;
+        VBOXHGCMSVCPARM         aCreateParms[SHFL_CPARMS_CREATE];
+
+        RTStrPrintf(szName, sizeof(szName), "/file%u", i);
+        fillTestShflString(&Path, szName);
+        RT_ZERO(CreateParms);
+        CreateParms.CreateFlags = SHFL_CF_ACCESS_READWRITE | SHFL_CF_ACT_CREATE_IF_NEW | SHFL_CF_ACT_OVERWRITE_IF_EXISTS;
+        aCreateParms[0].setUInt32(Root);
+        aCreateParms[1].setPointer(&Path, RT_UOFFSETOF(SHFLSTRING, String) + Path.string.u16Size);
+        aCreateParms[2].setPointer(&CreateParms, sizeof(CreateParms));
+        rc = callAndWait(&svcTable, SHFL_FN_CREATE, SHFL_CPARMS_CREATE, aCreateParms);
+        RTTEST_CHECK_RC_OK(g_hTest, rc);
+        RTTEST_CHECK(g_hTest, CreateParms.Handle != SHFL_HANDLE_NIL);
+        paFiles[i].hFile = CreateParms.Handle;
+        paFiles[i].pbBuf = (uint8_t *)RTMemAlloc(g_cbIo);
+        if (!paFiles[i].pbBuf)
+            rc = VERR_NO_MEMORY;
+    }
+
+    /*
+     * Measure synchronous execution and then each worker pool size.
+     */
+    if (RT_SUCCESS(rc) && !RTTestErrorCount(g_hTest))
+    {
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%u files of %u KB, %u KB requests, %u passes\n",
+                     g_cFiles, g_cbFile / _1K, g_cbIo / _1K, g_cPasses);
+        doBenchmark(&svcTable, Root, paFiles, 0);
+        for (uint32_t i = 0; i < cWorkerCounts; i++)
+            doBenchmark(&svcTable, Root, paFiles, acWorkers[i]);
+
+        /* Several requests per handle in flight. */
+        doOrdering(&svcTable, Root, paFiles, 0);
+        for (uint32_t i = 0; i < cWorkerCounts; i++)
+            doOrdering(&svcTable, Root, paFiles, acWorkers[i]);
+
+        /* Path lookups without and with the metadata cache. */
+        doLookupBenchmark(&svcTable, Root, 0);
+        doLookupBenchmark(&svcTable, Root, 60000);
+    }
+
+    /*
+     * Cleanup.  Closing goes through the workers of the last pool size.
+     */
+    RTTestSub(g_hTest, "Cleanup");
+    for (uint32_t i = 0; paFiles && i < g_cFiles; i++)
+    {
+        if (paFiles[i].hFile != SHFL_HANDLE_NIL && paFiles[i].hFile != 0)
+        {
+            VBOXHGCMSVCPARM aCloseParms[SHFL_CPARMS_CLOSE];
+            aCloseParms[0].setUInt32(Root);
+            aCloseParms[1].setUInt64(paFiles[i].hFile);
+            RTTEST_CHECK_RC_OK(g_hTest, callAndWait(&svcTable, SHFL_FN_CLOSE, SHFL_CPARMS_CLOSE, aCloseParms));
+        }
+        RTMemFree(paFiles[i].pbBuf);
+    }
+    RTMemFree(paFiles);
+
+    aParms[0].setUInt32(Root);
+    RTTEST_CHECK_RC_OK(g_hTest, callAndWait(&svcTable, SHFL_FN_UNMAP_FOLDER, SHFL_CPARMS_UNMAP_FOLDER, aParms));
+    aParms[0].setPointer(&s_MapName, RT_UOFFSETOF(SHFLSTRING, String) + s_MapName.string.u16Size);
+    RTTEST_CHECK_RC_OK(g_hTest, svcTable.pfnHostCall(NULL, SHFL_FN_REMOVE_MAPPING, SHFL_CPARMS_REMOVE_MAPPING, aParms));
+    svcTable.pfnUnload(NULL);
+
+    RTDirRemoveRecursive(szDir, RTDIRRMREC_F_CONTENT_AND_DIR);
+    RTSemEventDestroy(g_hEvtDone);
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
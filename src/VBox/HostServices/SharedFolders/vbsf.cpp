@@ -22,6 +22,7 @@
 #include "mappings.h"
 #include "vbsf.h"
 #include "shflhandle.h"
+#include "shflcache.h"
 
 #include <iprt/alloc.h>
 #include <iprt/assert.h>
@@ -130,6 +131,23 @@ static int vbsfCorrectCasing(SHFLCLIENTDATA *pClient, char *pszFullPath, char *p
     size_t cchFullPath  = cchParentDir + cchComponent;
     Assert(strlen(pszFullPath) == cchFullPath);
 
+    /*
+     * Ask the cache first, it may know the directory already.
+     */
+    int rc = vbsfCacheLookupName(pszFullPath, cchParentDir - 1, pszStartComponent, pszStartComponent, cchComponent + 1);
+    if (rc == VINF_SUCCESS)
+    {
+        Log(("Found original name %s in the cache\n", pszStartComponent));
+        return rc;
+    }
+    if (rc == VERR_FILE_NOT_FOUND)
+    {
+        Log(("vbsfCorrectCasing %s not found in cached directory\n", pszStartComponent));
+        return VERR_NO_MORE_FILES;
+    }
+    bool     fCacheNames = vbsfCacheIsEnabled();
+    uint32_t uDirGen     = vbsfCacheGeneration();
+
     size_t cbDirEntry   = 4096;
     if (cchFullPath + 4 > cbDirEntry - RT_OFFSETOF(RTDIRENTRYEX, szName))
         cbDirEntry = RT_OFFSETOF(RTDIRENTRYEX, szName) + cchFullPath + 4;
@@ -146,7 +164,7 @@ static int vbsfCorrectCasing(SHFLCLIENTDATA *pClient, char *pszFullPath, char *p
      *        supporting opendir wildcard filters, it would make sense to build
      *        one here with '?' for case foldable charaters. */
     /** @todo Use RTDirOpen here and drop the whole uncessary path copying? */
-    int rc = RTPathJoinEx(pDirEntry->szName, cbDirEntry - RT_OFFSETOF(RTDIRENTRYEX, szName),
+    rc = RTPathJoinEx(pDirEntry->szName, cbDirEntry - RT_OFFSETOF(RTDIRENTRYEX, szName),
                           pszFullPath, cchParentDir,
                           RT_STR_TUPLE("*"));
     AssertRC(rc);
@@ -162,12 +180,19 @@ static int vbsfCorrectCasing(SHFLCLIENTDATA *pClient, char *pszFullPath, char *p
 
                 rc = RTDirReadEx(hSearch, pDirEntry, &cbDirEntrySize, RTFSOBJATTRADD_NOTHING, SHFL_RT_LINK(pClient));
                 if (rc == VERR_NO_MORE_FILES)
+                {
+                    /* Every name made it into the cache, so the next miss in
+                       this directory needs no scan either. */
+                    if (fCacheNames)
+                        vbsfCacheSetDirComplete(pszFullPath, cchParentDir - 1, uDirGen);
                     break;
+                }
 
                 if (   rc != VINF_SUCCESS
                     && rc != VWRN_NO_DIRENT_INFO)
                 {
                     AssertFailed();
+                    fCacheNames = false;
                     if (   rc == VERR_NO_TRANSLATION
                         || rc == VERR_INVALID_UTF8_ENCODING)
                         continue;
@@ -175,6 +200,9 @@ static int vbsfCorrectCasing(SHFLCLIENTDATA *pClient, char *pszFullPath, char *p
                 }
 
                 Log2(("vbsfCorrectCasing: found %s\n", &pDirEntry->szName[0]));
+                if (   fCacheNames
+                    && RT_FAILURE(vbsfCacheInsertName(pszFullPath, cchParentDir - 1, &pDirEntry->szName[0], uDirGen)))
+                    fCacheNames = false;
                 if (    pDirEntry->cbName == cchComponent
                     &&  !RTStrICmp(pszStartComponent, &pDirEntry->szName[0]))
                 {
@@ -197,6 +225,20 @@ static int vbsfCorrectCasing(SHFLCLIENTDATA *pClient, char *pszFullPath, char *p
     return rc;
 }
 
+/**
+ * RTPathQueryInfoEx going through the metadata cache.
+ */
+static int vbsfPathQueryInfoCached(const char *pszPath, PRTFSOBJINFO pInfo, uint32_t fFlags)
+{
+    int rc;
+    if (vbsfCacheLookupInfo(pszPath, fFlags, pInfo, &rc))
+        return rc;
+    uint32_t const uGen = vbsfCacheGeneration();
+    rc = RTPathQueryInfoEx(pszPath, pInfo, RTFSOBJATTRADD_NOTHING, fFlags);
+    vbsfCacheInsertInfo(pszPath, fFlags, rc, pInfo, uGen);
+    return rc;
+}
+
 /* Temporary stand-in for RTPathExistEx. */
 static int vbsfQueryExistsEx(const char *pszPath, uint32_t fFlags)
 {
@@ -204,7 +246,7 @@ static int vbsfQueryExistsEx(const char *pszPath, uint32_t fFlags)
     return RTPathExistsEx(pszPath, fFlags);
 #else
     RTFSOBJINFO IgnInfo;
-    return RTPathQueryInfoEx(pszPath, &IgnInfo, RTFSOBJATTRADD_NOTHING, fFlags);
+    return vbsfPathQueryInfoCached(pszPath, &IgnInfo, fFlags);
 #endif
 }
 
@@ -945,6 +987,7 @@ static int vbsfOpenFile(SHFLCLIENTDATA *pClient, const char *pszPath, SHFLCREATE
             pHandle = vbsfQueryFileHandle(pClient, handle);
             if (pHandle)
             {
+                pHandle->uPathHash = vbsfCacheHashPath(pszPath, strlen(pszPath));
                 rc = RTFileOpen(&pHandle->file.Handle, pszPath, fOpen);
             }
         }
@@ -1108,6 +1151,9 @@ static int vbsfOpenDir(SHFLCLIENTDATA *pClient, const char *pszPath,
     if (0 != pHandle)
     {
         rc = VINF_SUCCESS;
+        pHandle->uPathHash = vbsfCacheHashPath(pszPath, strlen(pszPath));
+        if (vbsfCacheIsEnabled())
+            pHandle->dir.pszDir = RTStrDup(pszPath);
         pParms->Result = SHFL_FILE_EXISTS;  /* May be overwritten with SHFL_FILE_CREATED. */
         /** @todo Can anyone think of a sensible, race-less way to do this?  Although
                   I suspect that the race is inherent, due to the API available... */
@@ -1180,6 +1226,11 @@ static int vbsfOpenDir(SHFLCLIENTDATA *pClient, const char *pszPath,
             RTDirClose(pHandle->dir.Handle);
             pHandle->dir.Handle = 0;
         }
+        if (0 != pHandle)
+        {
+            RTStrFree(pHandle->dir.pszDir);
+            pHandle->dir.pszDir = NULL;
+        }
         if (SHFL_HANDLE_NIL != handle)
         {
             vbsfFreeFileHandle(pClient, handle);
@@ -1212,6 +1263,9 @@ static int vbsfCloseDir(SHFLFILEHANDLE *pHandle)
         pHandle->dir.pLastValidEntry = NULL;
     }
 
+    RTStrFree(pHandle->dir.pszDir);
+    pHandle->dir.pszDir = NULL;
+
     LogFlow(("vbsfCloseDir: rc = %d\n", rc));
 
     return rc;
@@ -1245,7 +1299,7 @@ static int vbsfLookupFile(SHFLCLIENTDATA *pClient, char *pszPath, SHFLCREATEPARM
     RTFSOBJINFO info;
     int rc;
 
-    rc = RTPathQueryInfoEx(pszPath, &info, RTFSOBJATTRADD_NOTHING, SHFL_RT_LINK(pClient));
+    rc = vbsfPathQueryInfoCached(pszPath, &info, SHFL_RT_LINK(pClient));
     LogFlow(("SHFL_CF_LOOKUP\n"));
     /* Client just wants to know if the object exists. */
     switch (rc)
@@ -1351,7 +1405,7 @@ int vbsfCreate(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pPath, uint32
             /* Query path information. */
             RTFSOBJINFO info;
 
-            rc = RTPathQueryInfoEx(pszFullPath, &info, RTFSOBJATTRADD_NOTHING, SHFL_RT_LINK(pClient));
+            rc = vbsfPathQueryInfoCached(pszFullPath, &info, SHFL_RT_LINK(pClient));
             LogFlow(("RTPathQueryInfoEx returned %Rrc\n", rc));
 
             if (RT_SUCCESS(rc))
@@ -1412,6 +1466,11 @@ int vbsfCreate(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pPath, uint32
                 {
                     rc = vbsfOpenFile(pClient, pszFullPath, pParms);
                 }
+
+                /* The object may have been created or truncated. */
+                if (   pParms->Result == SHFL_FILE_CREATED
+                    || pParms->Result == SHFL_FILE_REPLACED)
+                    vbsfCacheInvalidatePath(pszFullPath);
             }
             else
             {
@@ -1557,6 +1616,7 @@ int vbsfWrite(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Handle, uint64_
     }
 
     rc = RTFileWrite(pHandle->file.Handle, pBuffer, *pcbBuffer, &count);
+    vbsfCacheInvalidateHash(pHandle->uPathHash);
     *pcbBuffer = (uint32_t)count;
     Log(("RTFileWrite returned %Rrc bytes written %x\n", rc, count));
     return rc;
@@ -1658,6 +1718,15 @@ int vbsfDirList(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Handle, SHFLS
             {
                 rc = RTDirOpenFiltered(&pHandle->dir.SearchHandle, pszFullPath, RTDIRFILTER_WINNT, 0);
 
+                /* The listing primes the cache, remember which directory it is. */
+                if (RT_SUCCESS(rc) && pHandle->dir.pszDir)
+                {
+                    RTStrFree(pHandle->dir.pszDir);
+                    pHandle->dir.pszDir = RTStrDup(pszFullPath);
+                    if (pHandle->dir.pszDir)
+                        RTPathStripFilename(pHandle->dir.pszDir);
+                }
+
                 /* free the path string */
                 vbsfFreeFullPath(pszFullPath);
 
@@ -1685,6 +1754,7 @@ int vbsfDirList(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Handle, SHFLS
         {
             pDirEntry = pDirEntryOrg;
 
+            uint32_t const uCacheGen = vbsfCacheGeneration();
             rc = RTDirReadEx(DirHandle, pDirEntry, &cbDirEntrySize, RTFSOBJATTRADD_NOTHING, SHFL_RT_LINK(pClient));
             if (rc == VERR_NO_MORE_FILES)
             {
@@ -1701,6 +1771,10 @@ int vbsfDirList(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Handle, SHFLS
                     continue;
                 break;
             }
+
+            if (rc == VINF_SUCCESS && pHandle->dir.pszDir)
+                vbsfCacheInsertDirEntry(pHandle->dir.pszDir, pDirEntry->szName, SHFL_RT_LINK(pClient), &pDirEntry->Info,
+                                        uCacheGen);
         }
 
         cbNeeded = RT_OFFSETOF(SHFLDIRINFO, name.String);
@@ -1919,6 +1993,7 @@ static int vbsfSetFileInfo(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Ha
     if (type == SHFL_HF_TYPE_DIR)
     {
         SHFLFILEHANDLE *pHandle = vbsfQueryDirHandle(pClient, Handle);
+        vbsfCacheInvalidateHash(pHandle->uPathHash);
         rc = RTDirSetTimes(pHandle->dir.Handle,
                             (RTTimeSpecGetNano(&pSFDEntry->AccessTime)) ?       &pSFDEntry->AccessTime : NULL,
                             (RTTimeSpecGetNano(&pSFDEntry->ModificationTime)) ? &pSFDEntry->ModificationTime: NULL,
@@ -1929,6 +2004,7 @@ static int vbsfSetFileInfo(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE Ha
     else
     {
         SHFLFILEHANDLE *pHandle = vbsfQueryFileHandle(pClient, Handle);
+        vbsfCacheInvalidateHash(pHandle->uPathHash);
         rc = RTFileSetTimes(pHandle->file.Handle,
                             (RTTimeSpecGetNano(&pSFDEntry->AccessTime)) ?       &pSFDEntry->AccessTime : NULL,
                             (RTTimeSpecGetNano(&pSFDEntry->ModificationTime)) ? &pSFDEntry->ModificationTime: NULL,
@@ -2008,6 +2084,7 @@ static int vbsfSetEndOfFile(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLHANDLE H
     if (flags & SHFL_INFO_SIZE)
     {
         rc = RTFileSetSize(pHandle->file.Handle, pSFDEntry->cbObject);
+        vbsfCacheInvalidateHash(pHandle->uPathHash);
         if (rc != VINF_SUCCESS)
             AssertFailed();
     }
@@ -2292,6 +2369,11 @@ int vbsfRemove(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pPath, uint32
                 rc = RTFileDelete(pszFullPath);
             else
                 rc = RTDirRemove(pszFullPath);
+
+            if (flags & (SHFL_REMOVE_SYMLINK | SHFL_REMOVE_FILE))
+                vbsfCacheInvalidatePath(pszFullPath);
+            else
+                vbsfCacheInvalidateAll();
         }
 
 #ifndef DEBUG_dmik
@@ -2362,6 +2444,15 @@ int vbsfRename(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pSrc, SHFLSTR
                 rc = RTDirRename(pszFullPathSrc, pszFullPathDest,
                                    ((flags & SHFL_RENAME_REPLACE_IF_EXISTS) ? RTPATHRENAME_FLAGS_REPLACE : 0));
             }
+
+            /* Renaming a directory changes every path below it. */
+            if (flags & SHFL_RENAME_FILE)
+            {
+                vbsfCacheInvalidatePath(pszFullPathSrc);
+                vbsfCacheInvalidatePath(pszFullPathDest);
+            }
+            else
+                vbsfCacheInvalidateAll();
         }
 
 #ifndef DEBUG_dmik
@@ -2407,6 +2498,7 @@ int vbsfSymlink(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pNewPath, SH
 
     rc = RTSymlinkCreate(pszFullNewPath, (const char *)pOldPath->String.utf8,
                          RTSYMLINKTYPE_UNKNOWN, 0);
+    vbsfCacheInvalidatePath(pszFullNewPath);
     if (RT_SUCCESS(rc))
     {
         RTFSOBJINFO info;
@@ -2426,7 +2518,8 @@ int vbsfSymlink(SHFLCLIENTDATA *pClient, SHFLROOT root, SHFLSTRING *pNewPath, SH
  */
 int vbsfDisconnect(SHFLCLIENTDATA *pClient)
 {
-    for (int i=0; i<SHFLHANDLE_MAX; i++)
+    uint32_t const cHandles = vbsfQueryHandleLimit(pClient);
+    for (uint32_t i=0; i<cHandles; i++)
     {
         SHFLHANDLE Handle = (SHFLHANDLE)i;
         if (vbsfQueryHandleType(pClient, Handle))
@@ -2435,5 +2528,5 @@ int vbsfDisconnect(SHFLCLIENTDATA *pClient)
             vbsfClose(pClient, SHFL_HANDLE_ROOT /* incorrect, but it's not important */, (SHFLHANDLE)i);
         }
     }
-    return VINF_SUCCESS;
+    return vbsfFreeHandleTable(pClient);
 }
@@ -285,6 +285,7 @@ private:
     VDTYPE i_convertDeviceType();
     DeviceType_T i_convertToDeviceType(VDTYPE enmType);
     Utf8Str i_vdError(int aVRC);
+    void i_vdSetCopyThreads(PVBOXHDD aHdd);
 
     bool    i_isPropertyForFilter(const com::Utf8Str &aName);
 
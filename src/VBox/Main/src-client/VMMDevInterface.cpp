@@ -785,7 +785,9 @@ DECLCALLBACK(int) VMMDev::drvConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfgHandle,
     /*
      * Validate configuration.
      */
-    if (!CFGMR3AreValuesValid(pCfgHandle, "Object\0"))
+    if (!CFGMR3AreValuesValid(pCfgHandle, "Object\0"
+                                          "SharedFolderWorkers\0"
+                                          "SharedFolderCacheTTL\0"))
         return VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES;
     AssertMsgReturn(PDMDrvHlpNoAttach(pDrvIns) == VERR_PDM_NO_ATTACHED_DRIVER,
                     ("Configuration error: Not possible to attach anything to this driver!\n"),
@@ -871,6 +873,38 @@ DECLCALLBACK(int) VMMDev::drvConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pCfgHandle,
         }
         else
             AssertMsgFailed(("pfnQueryStatusLed failed with %Rrc (pLed=%x)\n", rc, pLed));
+
+        /* Optionally let a pool of worker threads execute the guest requests. */
+        uint32_t cShflWorkers;
+        rc = CFGMR3QueryU32Def(pCfgHandle, "SharedFolderWorkers", &cShflWorkers, 0);
+        AssertRCReturn(rc, rc);
+        if (cShflWorkers)
+        {
+            VBOXHGCMSVCPARM  parm;
+
+            parm.type = VBOX_HGCM_SVC_PARM_32BIT;
+            parm.u.uint32 = cShflWorkers;
+
+            rc = HGCMHostCall("VBoxSharedFolders", SHFL_FN_SET_WORKER_THREADS, 1, &parm);
+            if (RT_FAILURE(rc))
+                LogRel(("Failed to start %u Shared Folders worker threads %Rrc\n", cShflWorkers, rc));
+        }
+
+        /* Optionally cache host file metadata for the given number of milliseconds. */
+        uint32_t cMsShflCacheTtl;
+        rc = CFGMR3QueryU32Def(pCfgHandle, "SharedFolderCacheTTL", &cMsShflCacheTtl, 0);
+        AssertRCReturn(rc, rc);
+        if (cMsShflCacheTtl)
+        {
+            VBOXHGCMSVCPARM  parm;
+
+            parm.type = VBOX_HGCM_SVC_PARM_32BIT;
+            parm.u.uint32 = cMsShflCacheTtl;
+
+            rc = HGCMHostCall("VBoxSharedFolders", SHFL_FN_SET_CACHE_TTL, 1, &parm);
+            if (RT_FAILURE(rc))
+                LogRel(("Failed to enable the Shared Folders metadata cache %Rrc\n", rc));
+        }
     }
     else
         LogRel(("Failed to load Shared Folders service %Rrc\n", rc));
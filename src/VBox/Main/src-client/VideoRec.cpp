@@ -19,6 +19,7 @@
 #include <VBox/log.h>
 #include <iprt/asm.h>
 #include <iprt/assert.h>
+#include <iprt/mp.h>
 #include <iprt/semaphore.h>
 #include <iprt/thread.h>
 #include <iprt/time.h>
@@ -34,8 +35,14 @@
 #include <vpx/vp8cx.h>
 #include <vpx/vpx_image.h>
 
+#ifdef RT_ARCH_AMD64
+# include <emmintrin.h>
+#endif
+
 /** Default VPX codec to use */
 #define DEFAULTCODEC (vpx_codec_vp8_cx())
+/** Upper limit for the number of encoder threads per stream */
+#define VIDEORECMAXENCODERTHREADS 8
 
 static int videoRecEncodeAndWrite(PVIDEORECSTREAM pStrm);
 static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm);
@@ -94,18 +101,28 @@ typedef struct VIDEORECSTREAM
     uint64_t            u64TimeStamp;
     /* encoder deadline */
     unsigned int        uEncoderDeadline;
+    /* semaphore to signal the encoding worker thread of this stream */
+    RTSEMEVENT          WaitEvent;
+    /* worker thread of this stream */
+    RTTHREAD            Thread;
+    /* nano time stamp at which the current frame was copied */
+    uint64_t            u64CopyNanoTS;
+    /* number of frames encoded */
+    uint32_t            cFramesEncoded;
+    /* number of frames dropped because the previous one was still being encoded */
+    uint32_t volatile   cFramesDropped;
+    /* total time between copying and having written the encoded frames in ns */
+    uint64_t            cNsLatencyTotal;
+    /* maximum time between copying and having written an encoded frame in ns */
+    uint64_t            cNsLatencyMax;
 } VIDEORECSTREAM;
 
 typedef struct VIDEORECCONTEXT
 {
-    /* semaphore to signal the encoding worker thread */
-    RTSEMEVENT          WaitEvent;
     /* semaphore required during termination */
     RTSEMEVENT          TermEvent;
     /* true if video recording is enabled */
     bool                fEnabled;
-    /* worker thread */
-    RTTHREAD            Thread;
     /* number of stream contexts */
     uint32_t            cScreens;
     /* maximal time stamp */
@@ -351,6 +368,138 @@ inline bool colorConvWriteYUV420p(unsigned aWidth, unsigned aHeight,
     return rc;
 }
 
+/**
+ * Convert one 2x2 block of a BGRA32 image to YUV420p, exactly like
+ * colorConvWriteYUV420p<ColorConvBGRA32Iter> does.
+ */
+DECLINLINE(void) colorConvBGRA32Block(const uint8_t *pSrc1, const uint8_t *pSrc2,
+                                      uint8_t *pDstY1, uint8_t *pDstY2, uint8_t *pDstU, uint8_t *pDstV)
+{
+    const uint8_t *apSrc[4] = { pSrc1, pSrc1 + 4, pSrc2, pSrc2 + 4 };
+    uint8_t       *apDstY[4] = { pDstY1, pDstY1 + 1, pDstY2, pDstY2 + 1 };
+    unsigned u = 0, v = 0;
+    for (unsigned i = 0; i < 4; i++)
+    {
+        unsigned red   = apSrc[i][2];
+        unsigned green = apSrc[i][1];
+        unsigned blue  = apSrc[i][0];
+        *apDstY[i] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
+        u += (((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128) / 4;
+        v += (((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128) / 4;
+    }
+    *pDstU = u;
+    *pDstV = v;
+}
+
+#ifdef RT_ARCH_AMD64
+/**
+ * Adds neighbouring 32-bit lanes: returns a0+a1, a2+a3, b0+b1, b2+b3.
+ */
+DECLINLINE(__m128i) colorConvAddPairs(__m128i a, __m128i b)
+{
+    __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odd  = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+/**
+ * Computes the dot product of four BGRA32 pixels with the given coefficients,
+ * returns four 32-bit values.
+ */
+DECLINLINE(__m128i) colorConvDot4(__m128i Pixels, __m128i Coeffs)
+{
+    __m128i const Zero = _mm_setzero_si128();
+    return colorConvAddPairs(_mm_madd_epi16(_mm_unpacklo_epi8(Pixels, Zero), Coeffs),
+                             _mm_madd_epi16(_mm_unpackhi_epi8(Pixels, Zero), Coeffs));
+}
+
+/**
+ * Luma of four BGRA32 pixels.
+ */
+DECLINLINE(__m128i) colorConvLuma4(__m128i Pixels)
+{
+    __m128i const Coeffs = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    __m128i Sum = _mm_add_epi32(colorConvDot4(Pixels, Coeffs), _mm_set1_epi32(128));
+    return _mm_add_epi32(_mm_srai_epi32(Sum, 8), _mm_set1_epi32(16));
+}
+
+/**
+ * Quarter chroma contribution of four BGRA32 pixels.  The result is never
+ * negative, so the arithmetic shifts give the same values as the unsigned
+ * arithmetic of the scalar code modulo 256.
+ */
+DECLINLINE(__m128i) colorConvChroma4(__m128i Pixels, __m128i Coeffs)
+{
+    __m128i Sum = _mm_add_epi32(colorConvDot4(Pixels, Coeffs), _mm_set1_epi32(128));
+    return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(Sum, 8), _mm_set1_epi32(128)), 2);
+}
+
+/**
+ * Stores the low bytes of four 32-bit values, which must be in the range 0..255.
+ */
+DECLINLINE(void) colorConvStore4(uint8_t *pDst, __m128i Values)
+{
+    __m128i const Zero = _mm_setzero_si128();
+    uint32_t u32 = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(Values, Zero), Zero));
+    memcpy(pDst, &u32, sizeof(u32));
+}
+
+/**
+ * Convert a BGRA32 image to YUV420p using SSE2, eight pixels of two lines at
+ * a time.  Gives the same result as colorConvWriteYUV420p<ColorConvBGRA32Iter>.
+ * @returns true on success, false on failure
+ * @param aWidth    width of image
+ * @param aHeight   height of image
+ * @param aDestBuf  an allocated memory buffer large enough to hold the
+ *                  destination image (i.e. width * height * 12bits)
+ * @param aSrcBuf   the source image as an array of bytes
+ */
+static bool colorConvWriteYUV420pBGRA32SSE2(unsigned aWidth, unsigned aHeight,
+                                            uint8_t *aDestBuf, uint8_t *aSrcBuf)
+{
+    AssertReturn(0 == (aWidth & 1), false);
+    AssertReturn(0 == (aHeight & 1), false);
+    __m128i const CoeffsU = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    __m128i const CoeffsV = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    unsigned cPixels = aWidth * aHeight;
+    uint8_t *pDstU = aDestBuf + cPixels;
+    uint8_t *pDstV = aDestBuf + cPixels + cPixels / 4;
+    for (unsigned i = 0; i < aHeight / 2; ++i)
+    {
+        const uint8_t *pSrc1  = aSrcBuf + 2 * i * aWidth * 4;
+        const uint8_t *pSrc2  = pSrc1 + aWidth * 4;
+        uint8_t       *pDstY1 = aDestBuf + 2 * i * aWidth;
+        uint8_t       *pDstY2 = pDstY1 + aWidth;
+        unsigned j = 0;
+        for (; j + 8 <= aWidth; j += 8)
+        {
+            __m128i Top0    = _mm_loadu_si128((const __m128i *)&pSrc1[j * 4]);
+            __m128i Top1    = _mm_loadu_si128((const __m128i *)&pSrc1[j * 4 + 16]);
+            __m128i Bottom0 = _mm_loadu_si128((const __m128i *)&pSrc2[j * 4]);
+            __m128i Bottom1 = _mm_loadu_si128((const __m128i *)&pSrc2[j * 4 + 16]);
+
+            colorConvStore4(&pDstY1[j],     colorConvLuma4(Top0));
+            colorConvStore4(&pDstY1[j + 4], colorConvLuma4(Top1));
+            colorConvStore4(&pDstY2[j],     colorConvLuma4(Bottom0));
+            colorConvStore4(&pDstY2[j + 4], colorConvLuma4(Bottom1));
+
+            __m128i U0 = _mm_add_epi32(colorConvChroma4(Top0, CoeffsU), colorConvChroma4(Bottom0, CoeffsU));
+            __m128i U1 = _mm_add_epi32(colorConvChroma4(Top1, CoeffsU), colorConvChroma4(Bottom1, CoeffsU));
+            colorConvStore4(&pDstU[j / 2], colorConvAddPairs(U0, U1));
+
+            __m128i V0 = _mm_add_epi32(colorConvChroma4(Top0, CoeffsV), colorConvChroma4(Bottom0, CoeffsV));
+            __m128i V1 = _mm_add_epi32(colorConvChroma4(Top1, CoeffsV), colorConvChroma4(Bottom1, CoeffsV));
+            colorConvStore4(&pDstV[j / 2], colorConvAddPairs(V0, V1));
+        }
+        for (; j < aWidth; j += 2)
+            colorConvBGRA32Block(&pSrc1[j * 4], &pSrc2[j * 4], &pDstY1[j], &pDstY2[j], &pDstU[j / 2], &pDstV[j / 2]);
+        pDstU += aWidth / 2;
+        pDstV += aWidth / 2;
+    }
+    return true;
+}
+#endif /* RT_ARCH_AMD64 */
+
 /**
  * Convert an image to RGB24 format
  * @returns true on success, false on failure
@@ -385,38 +534,41 @@ inline bool colorConvWriteRGB24(unsigned aWidth, unsigned aHeight,
 }
 
 /**
- * Worker thread for all streams.
+ * Worker thread of a stream.
  *
- * RGB/YUV conversion and encoding.
+ * RGB/YUV conversion and encoding, so each screen is recorded on its own thread.
  */
 static DECLCALLBACK(int) videoRecThread(RTTHREAD Thread, void *pvUser)
 {
-    PVIDEORECCONTEXT pCtx = (PVIDEORECCONTEXT)pvUser;
+    PVIDEORECSTREAM pStrm = (PVIDEORECSTREAM)pvUser;
     for (;;)
     {
-        int rc = RTSemEventWait(pCtx->WaitEvent, RT_INDEFINITE_WAIT);
+        int rc = RTSemEventWait(pStrm->WaitEvent, RT_INDEFINITE_WAIT);
         AssertRCBreak(rc);
 
         if (ASMAtomicReadU32(&g_enmState) == VIDREC_TERMINATING)
             break;
-        for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
+        if (ASMAtomicReadBool(&pStrm->fRgbFilled))
         {
-            PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
-            if (   pStrm->fEnabled
-                && ASMAtomicReadBool(&pStrm->fRgbFilled))
+            rc = videoRecRGBToYUV(pStrm);
+            ASMAtomicWriteBool(&pStrm->fRgbFilled, false);
+            if (RT_SUCCESS(rc))
+                rc = videoRecEncodeAndWrite(pStrm);
+            if (RT_SUCCESS(rc))
             {
-                rc = videoRecRGBToYUV(pStrm);
-                ASMAtomicWriteBool(&pStrm->fRgbFilled, false);
-                if (RT_SUCCESS(rc))
-                    rc = videoRecEncodeAndWrite(pStrm);
-                if (RT_FAILURE(rc))
+                uint64_t cNsLatency = RTTimeNanoTS() - pStrm->u64CopyNanoTS;
+                pStrm->cFramesEncoded++;
+                pStrm->cNsLatencyTotal += cNsLatency;
+                if (cNsLatency > pStrm->cNsLatencyMax)
+                    pStrm->cNsLatencyMax = cNsLatency;
+            }
+            else
+            {
+                static unsigned cErrors = 100;
+                if (cErrors > 0)
                 {
-                    static unsigned cErrors = 100;
-                    if (cErrors > 0)
-                    {
-                        LogRel(("Error %Rrc encoding / writing video frame\n", rc));
-                        cErrors--;
-                    }
+                    LogRel(("Error %Rrc encoding / writing video frame\n", rc));
+                    cErrors--;
                 }
             }
         }
@@ -449,14 +601,7 @@ int VideoRecContextCreate(PVIDEORECCONTEXT *ppCtx, uint32_t cScreens)
         new (&pCtx->Strm[uScreen] + RT_OFFSETOF(VIDEORECSTREAM, Ebml)) WebMWriter();
     }
 
-    int rc = RTSemEventCreate(&pCtx->WaitEvent);
-    AssertRCReturn(rc, rc);
-
-    rc = RTSemEventCreate(&pCtx->TermEvent);
-    AssertRCReturn(rc, rc);
-
-    rc = RTThreadCreate(&pCtx->Thread, videoRecThread, (void*)pCtx, 0,
-                        RTTHREADTYPE_MAIN_WORKER, RTTHREADFLAGS_WAITABLE, "VideoRec");
+    int rc = RTSemEventCreate(&pCtx->TermEvent);
     AssertRCReturn(rc, rc);
 
     ASMAtomicWriteU32(&g_enmState, VIDREC_IDLE);
@@ -510,6 +655,7 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
 
     com::Utf8Str options(pszOptions);
     size_t pos = 0;
+    uint32_t cThreadsOption = 0;
 
     do {
 
@@ -536,6 +682,8 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
                 pStrm->uEncoderDeadline = value.toUInt32();
             }
         }
+        else if (key == "threads")
+            cThreadsOption = value.toUInt32();
         else LogRel(("Getting unknown option: %s=%s\n", key.c_str(), value.c_str()));
 
     } while(pos != com::Utf8Str::npos);
@@ -549,8 +697,10 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
     /* 1ms per frame */
     pStrm->VpxConfig.g_timebase.num = 1;
     pStrm->VpxConfig.g_timebase.den = 1000;
-    /* disable multithreading */
-    pStrm->VpxConfig.g_threads = 0;
+    /* let the encoder use its share of the host CPUs */
+    pStrm->VpxConfig.g_threads = RT_MIN(RT_MAX(RTMpGetOnlineCount() / pCtx->cScreens, 1), VIDEORECMAXENCODERTHREADS);
+    if (cThreadsOption)
+        pStrm->VpxConfig.g_threads = RT_MIN(cThreadsOption, VIDEORECMAXENCODERTHREADS);
 
     pStrm->uDelay = 1000 / uFps;
 
@@ -573,6 +723,13 @@ int VideoRecStrmInit(PVIDEORECCONTEXT pCtx, uint32_t uScreen, const char *pszFil
     }
     pStrm->pu8YuvBuf = pStrm->VpxRawImage.planes[0];
 
+    rc = RTSemEventCreate(&pStrm->WaitEvent);
+    AssertRCReturn(rc, rc);
+
+    rc = RTThreadCreateF(&pStrm->Thread, videoRecThread, pStrm, 0,
+                         RTTHREADTYPE_MAIN_WORKER, RTTHREADFLAGS_WAITABLE, "VideoRec%u", uScreen);
+    AssertRCReturn(rc, rc);
+
     pCtx->fEnabled = true;
     pStrm->fEnabled = true;
     return VINF_SUCCESS;
@@ -602,9 +759,21 @@ void VideoRecContextClose(PVIDEORECCONTEXT pCtx)
         AssertRC(rc);
     }
 
-    RTSemEventSignal(pCtx->WaitEvent);
-    RTThreadWait(pCtx->Thread, 10000, NULL);
-    RTSemEventDestroy(pCtx->WaitEvent);
+    for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
+    {
+        PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
+        if (pStrm->Thread != NIL_RTTHREAD)
+        {
+            RTSemEventSignal(pStrm->WaitEvent);
+            RTThreadWait(pStrm->Thread, 10000, NULL);
+            pStrm->Thread = NIL_RTTHREAD;
+        }
+        if (pStrm->WaitEvent != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pStrm->WaitEvent);
+            pStrm->WaitEvent = NIL_RTSEMEVENT;
+        }
+    }
     RTSemEventDestroy(pCtx->TermEvent);
 
     for (unsigned uScreen = 0; uScreen < pCtx->cScreens; uScreen++)
@@ -612,6 +781,10 @@ void VideoRecContextClose(PVIDEORECCONTEXT pCtx)
         PVIDEORECSTREAM pStrm = &pCtx->Strm[uScreen];
         if (pStrm->fEnabled)
         {
+            LogRel(("Video recording screen %u: %u frames encoded, %u dropped, latency %RU64 ms average, %RU64 ms maximum\n",
+                    uScreen, pStrm->cFramesEncoded, pStrm->cFramesDropped,
+                    pStrm->cFramesEncoded ? pStrm->cNsLatencyTotal / pStrm->cFramesEncoded / RT_NS_1MS : 0,
+                    pStrm->cNsLatencyMax / RT_NS_1MS));
             int rc = pStrm->Ebml.writeFooter(0);
             AssertRC(rc);
             pStrm->Ebml.close();
@@ -665,6 +838,8 @@ bool VideoRecIsReady(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint64_t u64TimeSt
     if (u64TimeStamp < pStrm->u64LastTimeStamp + pStrm->uDelay)
         return false;
 
+    /* Not counted as dropped here, this is only a query.  The frame is
+       dropped (and counted) by VideoRecCopyToIntBuf. */
     if (ASMAtomicReadBool(&pStrm->fRgbFilled))
         return false;
 
@@ -765,10 +940,17 @@ static int videoRecRGBToYUV(PVIDEORECSTREAM pStrm)
     {
         case VPX_IMG_FMT_RGB32:
             LogFlow(("32 bit\n"));
+#ifdef RT_ARCH_AMD64
+            if (!colorConvWriteYUV420pBGRA32SSE2(pStrm->uTargetWidth,
+                                                 pStrm->uTargetHeight,
+                                                 pStrm->pu8YuvBuf,
+                                                 pStrm->pu8RgbBuf))
+#else
             if (!colorConvWriteYUV420p<ColorConvBGRA32Iter>(pStrm->uTargetWidth,
                                                             pStrm->uTargetHeight,
                                                             pStrm->pu8YuvBuf,
                                                             pStrm->pu8RgbBuf))
+#endif
                 return VERR_GENERAL_FAILURE;
             break;
         case VPX_IMG_FMT_RGB24:
@@ -842,6 +1024,7 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
         }
         if (ASMAtomicReadBool(&pStrm->fRgbFilled))
         {
+            ASMAtomicIncU32(&pStrm->cFramesDropped);
             rc = VERR_TRY_AGAIN; /* previous frame not yet encoded */
             break;
         }
@@ -947,9 +1130,10 @@ int VideoRecCopyToIntBuf(PVIDEORECCONTEXT pCtx, uint32_t uScreen, uint32_t x, ui
         }
 
         pStrm->u64TimeStamp = u64TimeStamp;
+        pStrm->u64CopyNanoTS = RTTimeNanoTS();
 
         ASMAtomicWriteBool(&pStrm->fRgbFilled, true);
-        RTSemEventSignal(pCtx->WaitEvent);
+        RTSemEventSignal(pStrm->WaitEvent);
     } while (0);
 
     if (!ASMAtomicCmpXchgU32(&g_enmState, VIDREC_IDLE, VIDREC_COPYING))
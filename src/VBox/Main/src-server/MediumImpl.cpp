@@ -6408,6 +6408,32 @@ Utf8Str Medium::i_vdError(int aVRC)
     return error;
 }
 
+/**
+ * Configures the number of worker threads used by the given VD container
+ * when copying or merging images.
+ *
+ * The value is taken from the global "VBoxInternal2/MediumCopyThreads" extra
+ * data item, the VD default is used if it is not set or invalid.
+ *
+ * @param aHdd  The VD container to configure.
+ */
+void Medium::i_vdSetCopyThreads(PVBOXHDD aHdd)
+{
+    Bstr value;
+    HRESULT rc = m->pVirtualBox->GetExtraData(Bstr("VBoxInternal2/MediumCopyThreads").raw(),
+                                              value.asOutParam());
+    if (SUCCEEDED(rc) && !value.isEmpty())
+    {
+        uint32_t cThreads = 0;
+        int vrc = RTStrToUInt32Full(Utf8Str(value).c_str(), 10, &cThreads);
+        if (vrc == VINF_SUCCESS)
+            vrc = VDSetCopyThreads(aHdd, cThreads);
+        if (vrc != VINF_SUCCESS)
+            LogRel(("Medium: Ignoring invalid VBoxInternal2/MediumCopyThreads value '%ls' (%Rrc)\n",
+                    value.raw(), vrc));
+    }
+}
+
 /**
  * Error message callback.
  *
@@ -7097,6 +7123,8 @@ HRESULT Medium::i_taskMergeHandler(Medium::MergeTask &task)
             ComAssertThrow(   uSourceIdx != VD_LAST_IMAGE
                            && uTargetIdx != VD_LAST_IMAGE, E_FAIL);
 
+            i_vdSetCopyThreads(hdd);
+
             vrc = VDMerge(hdd, uSourceIdx, uTargetIdx,
                           task.mVDOperationIfaces);
             if (RT_FAILURE(vrc))
@@ -7452,6 +7480,8 @@ HRESULT Medium::i_taskCloneHandler(Medium::CloneTask &task)
                                        i_vdError(vrc).c_str());
                 }
 
+                i_vdSetCopyThreads(hdd);
+
                 /** @todo r=klaus target isn't locked, race getting the state */
                 if (task.midxSrcImageSame == UINT32_MAX)
                 {
@@ -8094,6 +8124,8 @@ HRESULT Medium::i_taskExportHandler(Medium::ExportTask &task)
 
             try
             {
+                i_vdSetCopyThreads(hdd);
+
                 vrc = VDCopy(hdd,
                              VD_LAST_IMAGE,
                              targetHdd,
@@ -8263,6 +8295,8 @@ HRESULT Medium::i_taskImportHandler(Medium::ImportTask &task)
                                        i_vdError(vrc).c_str());
                 }
 
+                i_vdSetCopyThreads(hdd);
+
                 /** @todo r=klaus target isn't locked, race getting the state */
                 vrc = VDCopy(hdd,
                              VD_LAST_IMAGE,
@@ -136,6 +136,19 @@ RTDECL(int) RTLdrClose(RTLDRMOD hLdrMod)
     PRTLDRMODINTERNAL pMod = (PRTLDRMODINTERNAL)hLdrMod;
     //AssertMsgReturn(pMod->eState == LDR_STATE_OPENED, ("eState=%d\n", pMod->eState), VERR_WRONG_ORDER);
 
+#ifdef IN_RING3
+    /*
+     * Asynchronous loggers only record the format string pointers, write out
+     * what the default loggers have queued before the strings can go away.
+     */
+    PRTLOGGER pLogger = RTLogGetDefaultInstance();
+    if (pLogger && (pLogger->fFlags & RTLOGFLAGS_ASYNC))
+        RTLogFlush(pLogger);
+    pLogger = RTLogRelDefaultInstance();
+    if (pLogger && (pLogger->fFlags & RTLOGFLAGS_ASYNC))
+        RTLogFlush(pLogger);
+#endif
+
     /*
      * Do it.
      */
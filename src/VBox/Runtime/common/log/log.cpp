@@ -43,6 +43,7 @@
 # include <iprt/file.h>
 # include <iprt/lockvalidator.h>
 # include <iprt/path.h>
+# include <iprt/formats/logbin.h>
 #endif
 #include <iprt/time.h>
 #include <iprt/asm.h>
@@ -88,6 +89,20 @@ AssertCompile(sizeof(RTLOG_RINGBUF_EYE_CATCHER) == 16);
 #define RTLOG_RINGBUF_EYE_CATCHER_END    "\0\0\0END RING BUF"
 AssertCompile(sizeof(RTLOG_RINGBUF_EYE_CATCHER_END) == 16);
 
+#ifdef IN_RING3
+/** The size of the per-thread asynchronous logging buffer (power of two). */
+# define RTLOG_ASYNC_BUF_SIZE           _256K
+/** The max size of an asynchronous log record.  Log statements which doesn't
+ * fit are written synchronously. */
+# define RTLOG_ASYNC_MAX_REC            _4K
+/** The max number of per-thread asynchronous log buffers.  Threads logging
+ * beyond this limit are written synchronously. */
+# define RTLOG_ASYNC_MAX_BUFS           64
+/** The size of the binary log stream write buffer. */
+# define RTLOG_ASYNC_BIN_BUF_SIZE       _64K
+AssertCompile(RT_IS_POWER_OF_TWO(RTLOG_ASYNC_BUF_SIZE));
+#endif
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -103,8 +118,163 @@ typedef struct RTLOGOUTPUTPREFIXEDARGS
     unsigned                fFlags;
     /** The group. (used for prefixing.) */
     unsigned                iGroup;
+#ifdef IN_RING3
+    /** The asynchronous log record being written, NULL when formatting on the
+     * calling thread.  Provides the timestamp and CPU for the prefix. */
+    struct RTLOGASYNCREC const *pAsyncRec;
+    /** The buffer of the thread which logged pAsyncRec, provides the thread
+     * for the prefix. */
+    struct RTLOGASYNCBUF const *pAsyncBuf;
+#endif
 } RTLOGOUTPUTPREFIXEDARGS, *PRTLOGOUTPUTPREFIXEDARGS;
 
+#ifdef IN_RING3
+
+/**
+ * Asynchronous log record, as stored in the per-thread buffers.
+ *
+ * The packed arguments (RTLOGBINREC_TYPE_MSG) or the formatted text
+ * (RTLOGBINREC_TYPE_TEXT) follow it, padded to RTLOGBIN_ARG_ALIGN.
+ */
+typedef struct RTLOGASYNCREC
+{
+    /** The binary stream message header.  idFormat is assigned when writing
+     * the binary stream. */
+    RTLOGBINMSG             Msg;
+    /** The format string (RTLOGBINREC_TYPE_MSG only). */
+    const char             *pszFormat;
+# if ARCH_BITS == 32
+    /** Alignment padding. */
+    uint32_t                u32Padding;
+# endif
+} RTLOGASYNCREC;
+AssertCompileSize(RTLOGASYNCREC, 56);
+/** Pointer to an asynchronous log record. */
+typedef RTLOGASYNCREC *PRTLOGASYNCREC;
+/** Pointer to a const asynchronous log record. */
+typedef RTLOGASYNCREC const *PCRTLOGASYNCREC;
+
+/** Record type filling the space up to the end of a per-thread buffer. */
+# define RTLOGASYNCREC_TYPE_PAD         UINT16_C(0)
+
+/**
+ * Per-thread asynchronous log buffer.
+ *
+ * This is a single producer (the owner thread), single consumer (whoever
+ * drains the buffers while owning the logger lock) ring buffer, so no locking
+ * is required for adding records.
+ */
+typedef struct RTLOGASYNCBUF
+{
+    /** Pointer to the next buffer. */
+    struct RTLOGASYNCBUF   *pNext;
+    /** Where the next record goes (free running, only written by the owner). */
+    uint32_t volatile       offHead;
+    /** The oldest record (free running, only written by the drainer). */
+    uint32_t volatile       offTail;
+    /** The head snapshot taken by the current drain pass. */
+    uint32_t                offDrainEnd;
+    /** Number of records dropped since the last drain pass. */
+    uint32_t volatile       cDropped;
+    /** Set by the TLS destructor when the owner thread terminates. */
+    bool volatile           fOrphaned;
+    /** Set when the thread has been defined in the binary stream. */
+    bool                    fBinDefined;
+    /** Set while the owner thread waits for room (lossless mode). */
+    bool volatile           fWaiting;
+    /** Signalled by the drainer when fWaiting is set. */
+    RTSEMEVENT              hEvtSpace;
+    /** The thread ID used in the records. */
+    uint32_t                idThread;
+    /** The native handle of the owner thread. */
+    RTNATIVETHREAD          hNativeThread;
+    /** The name of the owner thread. */
+    char                    szName[32];
+    /** Scratch buffer for assembling a record. */
+    uint8_t                 abScratch[RTLOG_ASYNC_MAX_REC];
+    /** The ring buffer. */
+    uint8_t                 abBuf[RTLOG_ASYNC_BUF_SIZE];
+} RTLOGASYNCBUF;
+/** Pointer to a per-thread asynchronous log buffer. */
+typedef RTLOGASYNCBUF *PRTLOGASYNCBUF;
+
+/**
+ * Format string to binary stream ID mapping entry.
+ */
+typedef struct RTLOGASYNCFMT
+{
+    /** The format string pointer, NULL if the entry is free. */
+    const char             *pszFormat;
+    /** Copy of the format string, for detecting reuse of the address. */
+    char                   *pszCopy;
+    /** The format ID. */
+    uint32_t                idFormat;
+} RTLOGASYNCFMT;
+/** Pointer to a format string mapping entry. */
+typedef RTLOGASYNCFMT *PRTLOGASYNCFMT;
+
+/**
+ * Asynchronous logging state.
+ */
+typedef struct RTLOGASYNC
+{
+    /** The writer thread. */
+    RTTHREAD                hThread;
+    /** The native handle of the writer thread. */
+    RTNATIVETHREAD          hNativeThread;
+    /** Event semaphore for waking up the writer thread. */
+    RTSEMEVENT              hEvt;
+    /** Tells the writer thread to terminate. */
+    bool volatile           fTerminate;
+    /** Set when the writer thread has drained everything and is about to
+     * wait for hEvt, the next record queued signals it. */
+    bool volatile           fWriterIdle;
+    /** Set when we've tried opening the binary log stream. */
+    bool                    fBinOpened;
+    /** TLS index for the per-thread buffers. */
+    RTTLS                   iTls;
+    /** The per-thread buffers (LIFO, pushed without locking). */
+    PRTLOGASYNCBUF volatile pBufHead;
+    /** Number of threads which has been logging (for assigning IDs). */
+    uint32_t volatile       cThreads;
+    /** Number of buffers allocated, limited to RTLOG_ASYNC_MAX_BUFS. */
+    uint32_t volatile       cBufs;
+
+    /** @name Binary log stream (RTLOGDEST_BINFILE).
+     * @{ */
+    /** The binary log stream file. */
+    RTFILE                  hBinFile;
+    /** Number of format IDs handed out. */
+    uint32_t                cFmts;
+    /** The size of the paFmts hash table (power of two). */
+    uint32_t                cFmtsAlloc;
+    /** Format string pointer to ID hash table (open addressing). */
+    PRTLOGASYNCFMT          paFmts;
+    /** Number of bytes in abBinBuf. */
+    uint32_t                offBinBuf;
+    /** The write buffer. */
+    uint8_t                 abBinBuf[RTLOG_ASYNC_BIN_BUF_SIZE];
+    /** @} */
+} RTLOGASYNC;
+/** Pointer to the asynchronous logging state. */
+typedef RTLOGASYNC *PRTLOGASYNC;
+
+/** @name Asynchronous logging states (RTLOGGERINTERNAL::enmAsyncState).
+ * @{ */
+/** Not started yet. */
+# define RTLOGASYNCSTATE_NONE           UINT32_C(0)
+/** The writer thread is being started. */
+# define RTLOGASYNCSTATE_STARTING       UINT32_C(1)
+/** Up and running. */
+# define RTLOGASYNCSTATE_RUNNING        UINT32_C(2)
+/** Starting the writer thread failed, log synchronously. */
+# define RTLOGASYNCSTATE_FAILED         UINT32_C(3)
+/** The logger is being destroyed. */
+# define RTLOGASYNCSTATE_STOPPED        UINT32_C(4)
+/** @} */
+
+#endif /* IN_RING3 */
+
 #ifndef IN_RC
 
 /**
@@ -199,11 +369,22 @@ typedef struct RTLOGGERINTERNAL
     /** Pointer to filename. */
     char                    szFilename[RTPATH_MAX];
     /** @} */
+
+    /** @name Asynchronous logging (RTLOGFLAGS_ASYNC).
+     * @{ */
+    /** The state (RTLOGASYNCSTATE_XXX). */
+    uint32_t volatile       enmAsyncState;
+    /** The asynchronous logging state, NULL if not started. */
+    PRTLOGASYNC volatile    pAsync;
+    /** The binary log stream filename (RTLOGDEST_BINFILE), NULL for
+     * szFilename + ".bin". */
+    char                   *pszBinFilename;
+    /** @} */
 # endif /* IN_RING3 */
 } RTLOGGERINTERNAL;
 
 /** The revision of the internal logger structure. */
-# define RTLOGGERINTERNAL_REV    UINT32_C(10)
+# define RTLOGGERINTERNAL_REV    UINT32_C(11)
 
 # ifdef IN_RING3
 /** The size of the RTLOGGERINTERNAL structure in ring-0.  */
@@ -229,6 +410,10 @@ static void rtR0LogLoggerExFallback(uint32_t fDestFlags, uint32_t fFlags, PRTLOG
 #ifdef IN_RING3
 static int rtlogFileOpen(PRTLOGGER pLogger, char *pszErrorMsg, size_t cchErrorMsg);
 static void rtlogRotate(PRTLOGGER pLogger, uint32_t uTimeSlot, bool fFirst);
+static bool rtlogAsyncLog(PRTLOGGER pLogger, unsigned fFlags, unsigned iGroup, const char *pszFormat, va_list args);
+static void rtlogAsyncDrainLocked(PRTLOGGER pLogger);
+static void rtlogAsyncStop(PRTLOGGER pLogger);
+static void rtlogAsyncDestroyLocked(PRTLOGGER pLogger);
 #endif
 #ifndef IN_RC
 static void rtLogRingBufFlush(PRTLOGGER pLogger);
@@ -332,6 +517,10 @@ static struct
     { "msprog",       sizeof("msprog"      ) - 1,   RTLOGFLAGS_PREFIX_MS_PROG,      false },
     { "tsc",          sizeof("tsc"         ) - 1,   RTLOGFLAGS_PREFIX_TSC,          false }, /* before ts! */
     { "ts",           sizeof("ts"          ) - 1,   RTLOGFLAGS_PREFIX_TS,           false },
+    { "async",        sizeof("async"       ) - 1,   RTLOGFLAGS_ASYNC,               false },
+    { "sync",         sizeof("sync"        ) - 1,   RTLOGFLAGS_ASYNC,               true  },
+    { "lossy",        sizeof("lossy"       ) - 1,   RTLOGFLAGS_ASYNC_LOSSY,         false },
+    { "lossless",     sizeof("lossless"    ) - 1,   RTLOGFLAGS_ASYNC_LOSSY,         true  },
     /* We intentionally omit RTLOGFLAGS_RESTRICT_GROUPS. */
 };
 
@@ -356,6 +545,7 @@ static struct
     { RT_STR_TUPLE("debugger"),     RTLOGDEST_DEBUGGER },
     { RT_STR_TUPLE("com"),          RTLOGDEST_COM },
     { RT_STR_TUPLE("user"),         RTLOGDEST_USER },
+    { RT_STR_TUPLE("binfile"),      RTLOGDEST_BINFILE },
 };
 
 /** Log rotation backoff table - millisecond sleep intervals.
@@ -1080,6 +1270,13 @@ RTDECL(int) RTLogDestroy(PRTLOGGER pLogger)
     AssertReturn(pLogger->u32Magic == RTLOGGER_MAGIC, VERR_INVALID_MAGIC);
     AssertPtrReturn(pLogger->pInt, VERR_INVALID_POINTER);
 
+# ifdef IN_RING3
+    /*
+     * Stop the asynchronous writer thread before taking the lock it needs.
+     */
+    rtlogAsyncStop(pLogger);
+# endif
+
     /*
      * Acquire logger instance sem and disable all logging. (paranoia)
      */
@@ -1094,6 +1291,9 @@ RTDECL(int) RTLogDestroy(PRTLOGGER pLogger)
     /*
      * Flush it.
      */
+# ifdef IN_RING3
+    rtlogAsyncDrainLocked(pLogger);
+# endif
     rtlogFlush(pLogger);
 
 # ifdef IN_RING3
@@ -1115,6 +1315,7 @@ RTDECL(int) RTLogDestroy(PRTLOGGER pLogger)
             rc = rc2;
         pLogger->pInt->hFile = NIL_RTFILE;
     }
+    rtlogAsyncDestroyLocked(pLogger);
 # endif
 
     /*
@@ -2343,6 +2544,14 @@ RTDECL(int) RTLogDestinations(PRTLOGGER pLogger, char const *pszValue)
                         else
                             pLogger->pInt->cSecsHistoryTimeSlot = UINT32_MAX;
                     }
+                    /* binary log stream file name */
+                    else if (s_aLogDst[i].fFlag == RTLOGDEST_BINFILE && !fNo)
+                    {
+                        char *pszBinFilename = RTStrDupN(pszValue, cch);
+                        AssertReturn(pszBinFilename, VERR_NO_STR_MEMORY);
+                        RTStrFree(pLogger->pInt->pszBinFilename);
+                        pLogger->pInt->pszBinFilename = pszBinFilename;
+                    }
 # endif /* IN_RING3 */
                     else if (i == 5 /* ringbuf */ && !fNo)
                     {
@@ -2441,6 +2650,17 @@ RTDECL(int) RTLogGetDestinations(PRTLOGGER pLogger, char *pszBuf, size_t cchBuf)
             rc = RTStrCopyP(&pszBuf, &cchBuf, s_aLogDst[i].pszInstr);
             if (RT_FAILURE(rc))
                 return rc;
+# ifdef IN_RING3
+            if (s_aLogDst[i].fFlag == RTLOGDEST_BINFILE && pLogger->pInt->pszBinFilename)
+            {
+                rc = RTStrCopyP(&pszBuf, &cchBuf, "=");
+                if (RT_FAILURE(rc))
+                    return rc;
+                rc = RTStrCopyP(&pszBuf, &cchBuf, pLogger->pInt->pszBinFilename);
+                if (RT_FAILURE(rc))
+                    return rc;
+            }
+# endif
             fNotFirst = true;
         }
 
@@ -2539,6 +2759,9 @@ RTDECL(void) RTLogFlush(PRTLOGGER pLogger)
     if (   pLogger->offScratch
 #ifndef IN_RC
         || (pLogger->fDestFlags & RTLOGDEST_RINGBUF)
+#endif
+#ifdef IN_RING3
+        || pLogger->pInt->pAsync
 #endif
        )
     {
@@ -2549,6 +2772,12 @@ RTDECL(void) RTLogFlush(PRTLOGGER pLogger)
         int rc = rtlogLock(pLogger);
         if (RT_FAILURE(rc))
             return;
+#endif
+#ifdef IN_RING3
+        /*
+         * Write out what the asynchronous log buffers holds.
+         */
+        rtlogAsyncDrainLocked(pLogger);
 #endif
         /*
          * Call worker.
@@ -2805,6 +3034,20 @@ RTDECL(void) RTLogLoggerExV(PRTLOGGER pLogger, unsigned fFlags, unsigned iGroup,
         &&  (pLogger->afGroups[iGroup] & (fFlags | RTLOGGRPFLAGS_ENABLED)) != (fFlags | RTLOGGRPFLAGS_ENABLED))
         return;
 
+#ifdef IN_RING3
+    /*
+     * Asynchronous logging: Capture the arguments and leave the formatting
+     * and writing to the writer thread.  Restricted groups needs the lock for
+     * counting, so they take the synchronous path.
+     */
+    if (   (pLogger->fFlags & RTLOGFLAGS_ASYNC)
+        && (   !(pLogger->fFlags & RTLOGFLAGS_RESTRICT_GROUPS)
+            || iGroup >= pLogger->cGroups
+            || !(pLogger->afGroups[iGroup] & RTLOGGRPFLAGS_RESTRICT))
+        && rtlogAsyncLog(pLogger, fFlags, iGroup, pszFormat, args))
+        return;
+#endif
+
     /*
      * Acquire logger instance sem.
      */
@@ -2818,6 +3061,14 @@ RTDECL(void) RTLogLoggerExV(PRTLOGGER pLogger, unsigned fFlags, unsigned iGroup,
         return;
     }
 
+#ifdef IN_RING3
+    /*
+     * Keep the ordering with records still sitting in the asynchronous buffers.
+     */
+    if (pLogger->pInt->pAsync)
+        rtlogAsyncDrainLocked(pLogger);
+#endif
+
     /*
      * Check restrictions and call worker.
      */
@@ -3458,7 +3709,11 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
                 psz = &pLogger->achScratch[pLogger->offScratch];
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_TS)
                 {
+#ifdef IN_RING3
+                    uint64_t     u64    = pArgs->pAsyncRec ? pArgs->pAsyncRec->Msg.u64NanoTS : RTTimeNanoTS();
+#else
                     uint64_t     u64    = RTTimeNanoTS();
+#endif
                     int          iBase  = 16;
                     unsigned int fFlags = RTSTR_F_ZEROPAD;
                     if (pLogger->fFlags & RTLOGFLAGS_DECIMAL_TS)
@@ -3484,10 +3739,16 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
 
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_TSC)
                 {
+                    uint64_t     u64;
+#ifdef IN_RING3
+                    if (pArgs->pAsyncRec)
+                        u64 = pArgs->pAsyncRec->Msg.u64Tsc;
+                    else
+#endif
 #if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
-                    uint64_t     u64    = ASMReadTSC();
+                        u64 = ASMReadTSC();
 #else
-                    uint64_t     u64    = RTTimeNanoTS();
+                        u64 = RTTimeNanoTS();
 #endif
                     int          iBase  = 16;
                     unsigned int fFlags = RTSTR_F_ZEROPAD;
@@ -3514,7 +3775,11 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
 
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_MS_PROG)
                 {
-#if defined(IN_RING3) || defined(IN_RC)
+#if defined(IN_RING3)
+                    uint64_t u64 = pArgs->pAsyncRec
+                                 ? (pArgs->pAsyncRec->Msg.u64NanoTS - RTTimeProgramStartNanoTS()) / RT_NS_1MS
+                                 : RTTimeProgramMilliTS();
+#elif defined(IN_RC)
                     uint64_t u64 = RTTimeProgramMilliTS();
 #else
                     uint64_t u64 = 0;
@@ -3530,7 +3795,12 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
 #if defined(IN_RING3) || defined(IN_RING0)
                     RTTIMESPEC TimeSpec;
                     RTTIME Time;
-                    RTTimeExplode(&Time, RTTimeNow(&TimeSpec));
+                    RTTimeNow(&TimeSpec);
+# ifdef IN_RING3
+                    if (pArgs->pAsyncRec)
+                        RTTimeSpecSubNano(&TimeSpec, RTTimeNanoTS() - pArgs->pAsyncRec->Msg.u64NanoTS);
+# endif
+                    RTTimeExplode(&Time, &TimeSpec);
                     psz += RTStrFormatNumber(psz, Time.u8Hour, 10, 2, 0, RTSTR_F_ZEROPAD);
                     *psz++ = ':';
                     psz += RTStrFormatNumber(psz, Time.u8Minute, 10, 2, 0, RTSTR_F_ZEROPAD);
@@ -3550,7 +3820,13 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
                 {
 
 #if defined(IN_RING3) || defined(IN_RC)
+# ifdef IN_RING3
+                    uint64_t u64 = pArgs->pAsyncRec
+                                 ? (pArgs->pAsyncRec->Msg.u64NanoTS - RTTimeProgramStartNanoTS()) / RT_NS_1US
+                                 : RTTimeProgramMicroTS();
+# else
                     uint64_t u64 = RTTimeProgramMicroTS();
+# endif
                     psz += RTStrFormatNumber(psz, (uint32_t)(u64 / RT_US_1HOUR), 10, 2, 0, RTSTR_F_ZEROPAD);
                     *psz++ = ':';
                     uint32_t u32 = (uint32_t)(u64 % RT_US_1HOUR);
@@ -3599,7 +3875,9 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
 
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_TID)
                 {
-#ifndef IN_RC
+#ifdef IN_RING3
+                    RTNATIVETHREAD Thread = pArgs->pAsyncBuf ? pArgs->pAsyncBuf->hNativeThread : RTThreadNativeSelf();
+#elif !defined(IN_RC)
                     RTNATIVETHREAD Thread = RTThreadNativeSelf();
 #else
                     RTNATIVETHREAD Thread = NIL_RTNATIVETHREAD;
@@ -3612,7 +3890,7 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_THREAD)
                 {
 #ifdef IN_RING3
-                    const char *pszName = RTThreadSelfName();
+                    const char *pszName = pArgs->pAsyncBuf ? pArgs->pAsyncBuf->szName : RTThreadSelfName();
 #elif defined IN_RC
                     const char *pszName = "EMT-RC";
 #else
@@ -3625,7 +3903,13 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_CPUID)
                 {
 #if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+# ifdef IN_RING3
+                    const uint8_t idCpu = pArgs->pAsyncRec ? (uint8_t)pArgs->pAsyncRec->Msg.idCpu : ASMGetApicId();
+# else
                     const uint8_t idCpu = ASMGetApicId();
+# endif
+#elif defined(IN_RING3)
+                    const RTCPUID idCpu = pArgs->pAsyncRec ? pArgs->pAsyncRec->Msg.idCpu : RTMpCpuId();
 #else
                     const RTCPUID idCpu = RTMpCpuId();
 #endif
@@ -3647,7 +3931,8 @@ static DECLCALLBACK(size_t) rtLogOutputPrefixed(void *pv, const char *pachChars,
                 if (pLogger->fFlags & RTLOGFLAGS_PREFIX_LOCK_COUNTS)
                 {
 #ifdef IN_RING3 /** @todo implement these counters in ring-0 too? */
-                    RTTHREAD Thread = RTThreadSelf();
+                    /* Not known for records logged asynchronously. */
+                    RTTHREAD Thread = !pArgs->pAsyncRec ? RTThreadSelf() : NIL_RTTHREAD;
                     if (Thread != NIL_RTTHREAD)
                     {
                         uint32_t cReadLocks  = RTLockValidatorReadLockGetCount(Thread);
@@ -3844,6 +4129,10 @@ static void rtlogLoggerExVLocked(PRTLOGGER pLogger, unsigned fFlags, unsigned iG
         OutputArgs.pLogger = pLogger;
         OutputArgs.iGroup  = iGroup;
         OutputArgs.fFlags  = fFlags;
+#ifdef IN_RING3
+        OutputArgs.pAsyncRec = NULL;
+        OutputArgs.pAsyncBuf = NULL;
+#endif
         RTLogFormatV(rtLogOutputPrefixed, &OutputArgs, pszFormat, args);
     }
     else
@@ -3875,3 +4164,876 @@ static void rtlogLoggerExFLocked(PRTLOGGER pLogger, unsigned fFlags, unsigned iG
 }
 #endif /* !IN_RC */
 
+
+
+#ifdef IN_RING3
+
+/**
+ * Text output buffer for rtlogAsyncTextOutput.
+ */
+typedef struct RTLOGASYNCTEXTARGS
+{
+    /** The buffer. */
+    char       *pchBuf;
+    /** The buffer size. */
+    size_t      cbBuf;
+    /** The current offset into the buffer. */
+    size_t      off;
+    /** Set if the text didn't fit. */
+    bool        fOverflow;
+} RTLOGASYNCTEXTARGS;
+/** Pointer to a text output buffer for rtlogAsyncTextOutput. */
+typedef RTLOGASYNCTEXTARGS *PRTLOGASYNCTEXTARGS;
+
+
+/**
+ * @callback_method_impl{FNRTSTROUTPUT, Formats into a RTLOGASYNCTEXTARGS
+ *                      buffer.}
+ */
+static DECLCALLBACK(size_t) rtlogAsyncTextOutput(void *pvArg, const char *pachChars, size_t cbChars)
+{
+    PRTLOGASYNCTEXTARGS pArgs = (PRTLOGASYNCTEXTARGS)pvArg;
+    if (cbChars)
+    {
+        if (cbChars > pArgs->cbBuf - pArgs->off)
+        {
+            pArgs->fOverflow = true;
+            cbChars = pArgs->cbBuf - pArgs->off;
+        }
+        memcpy(&pArgs->pchBuf[pArgs->off], pachChars, cbChars);
+        pArgs->off += cbChars;
+    }
+    return cbChars;
+}
+
+
+/**
+ * @callback_method_impl{FNRTTLSDTOR, Flags the buffer of a terminating thread
+ *                      so the drainer can free it once it's empty.}
+ */
+static DECLCALLBACK(void) rtlogAsyncBufTlsDtor(void *pvValue)
+{
+    PRTLOGASYNCBUF pBuf = (PRTLOGASYNCBUF)pvValue;
+    if (pBuf)
+        ASMAtomicWriteBool(&pBuf->fOrphaned, true);
+}
+
+
+/**
+ * Creates the asynchronous log buffer for the calling thread.
+ *
+ * @returns Pointer to the buffer, NULL on failure.
+ * @param   pAsync      The asynchronous logging state.
+ */
+static PRTLOGASYNCBUF rtlogAsyncBufCreate(PRTLOGASYNC pAsync)
+{
+    /* Each buffer is rather big, don't let lots of threads eat up the memory. */
+    if (ASMAtomicIncU32(&pAsync->cBufs) > RTLOG_ASYNC_MAX_BUFS)
+    {
+        ASMAtomicDecU32(&pAsync->cBufs);
+        return NULL;
+    }
+
+    PRTLOGASYNCBUF pBuf = (PRTLOGASYNCBUF)RTMemAllocZ(sizeof(*pBuf));
+    if (pBuf)
+    {
+        const char *pszName = RTThreadSelfName();
+        pBuf->hNativeThread = RTThreadNativeSelf();
+        pBuf->idThread      = ASMAtomicIncU32(&pAsync->cThreads);
+        RTStrCopy(pBuf->szName, sizeof(pBuf->szName), pszName ? pszName : "");
+
+        int rc = RTSemEventCreateEx(&pBuf->hEvtSpace, RTSEMEVENT_FLAGS_NO_LOCK_VAL, NIL_RTLOCKVALCLASS, NULL);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTTlsSet(pAsync->iTls, pBuf);
+            if (RT_SUCCESS(rc))
+            {
+                /* Push it; buffers are only unlinked while owning the logger lock. */
+                PRTLOGASYNCBUF pHead;
+                do
+                {
+                    pHead = ASMAtomicReadPtrT(&pAsync->pBufHead, PRTLOGASYNCBUF);
+                    pBuf->pNext = pHead;
+                } while (!ASMAtomicCmpXchgPtr(&pAsync->pBufHead, pBuf, pHead));
+                return pBuf;
+            }
+            RTSemEventDestroy(pBuf->hEvtSpace);
+        }
+        RTMemFree(pBuf);
+    }
+    ASMAtomicDecU32(&pAsync->cBufs);
+    return NULL;
+}
+
+
+/**
+ * Frees a per-thread asynchronous log buffer which has been unlinked.
+ *
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pBuf        The buffer.
+ */
+static void rtlogAsyncBufFree(PRTLOGASYNC pAsync, PRTLOGASYNCBUF pBuf)
+{
+    RTSemEventDestroy(pBuf->hEvtSpace);
+    RTMemFree(pBuf);
+    ASMAtomicDecU32(&pAsync->cBufs);
+}
+
+
+/**
+ * Adds a record to the calling thread's buffer.
+ *
+ * @returns true if the record was taken care of (queued or dropped), false if
+ *          the caller should log it synchronously.
+ * @param   pLogger     The logger instance.
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pBuf        The calling thread's buffer.
+ * @param   pRec        The record.
+ */
+static bool rtlogAsyncBufPut(PRTLOGGER pLogger, PRTLOGASYNC pAsync, PRTLOGASYNCBUF pBuf, PCRTLOGASYNCREC pRec)
+{
+    uint32_t const cbRec = pRec->Msg.Hdr.cbRec;
+    for (;;)
+    {
+        uint32_t const offHead  = pBuf->offHead;
+        uint32_t const cbUsed   = offHead - ASMAtomicReadU32(&pBuf->offTail);
+        uint32_t const offBuf   = offHead & (RTLOG_ASYNC_BUF_SIZE - 1);
+        uint32_t const cbToEnd  = RTLOG_ASYNC_BUF_SIZE - offBuf;
+        uint32_t const cbNeeded = cbRec <= cbToEnd ? cbRec : cbToEnd + cbRec;
+        if (cbNeeded <= RTLOG_ASYNC_BUF_SIZE - cbUsed)
+        {
+            uint32_t offRec = offHead;
+            if (cbRec > cbToEnd)
+            {
+                /* Records doesn't wrap around, pad up to the end of the buffer. */
+                PRTLOGBINREC pPad = (PRTLOGBINREC)&pBuf->abBuf[offBuf];
+                pPad->cbRec       = cbToEnd;
+                pPad->uType       = RTLOGASYNCREC_TYPE_PAD;
+                pPad->u16Reserved = 0;
+                offRec += cbToEnd;
+            }
+            memcpy(&pBuf->abBuf[offRec & (RTLOG_ASYNC_BUF_SIZE - 1)], pRec, cbRec);
+            ASMAtomicWriteU32(&pBuf->offHead, offRec + cbRec);
+
+            /* Wake up the writer if it has run out of records, and when crossing
+               the half full mark so it gets going before we fill up.  Otherwise
+               the records are picked up by the drain pass in progress. */
+            if (ASMAtomicXchgBool(&pAsync->fWriterIdle, false))
+                RTSemEventSignal(pAsync->hEvt);
+            else if (   cbUsed < RTLOG_ASYNC_BUF_SIZE / 2
+                     && cbUsed + cbNeeded >= RTLOG_ASYNC_BUF_SIZE / 2)
+                RTSemEventSignal(pAsync->hEvt);
+            if (pBuf->fWaiting)
+                ASMAtomicWriteBool(&pBuf->fWaiting, false);
+            return true;
+        }
+
+        /*
+         * Full.  Either drop the record or wait for the drainer to make room.
+         * fWaiting is set before checking again, so the drainer either sees it
+         * and signals us or we see the room it made.
+         */
+        if (pLogger->fFlags & RTLOGFLAGS_ASYNC_LOSSY)
+        {
+            ASMAtomicIncU32(&pBuf->cDropped);
+            if (ASMAtomicXchgBool(&pAsync->fWriterIdle, false))
+                RTSemEventSignal(pAsync->hEvt);
+            return true;
+        }
+        if (ASMAtomicReadBool(&pAsync->fTerminate))
+        {
+            ASMAtomicWriteBool(&pBuf->fWaiting, false);
+            return false;
+        }
+        if (!pBuf->fWaiting)
+        {
+            ASMAtomicWriteBool(&pBuf->fWaiting, true);
+            continue;
+        }
+        RTSemEventSignal(pAsync->hEvt);
+        RTSemEventWait(pBuf->hEvtSpace, RT_INDEFINITE_WAIT);
+    }
+}
+
+
+/**
+ * The asynchronous log writer thread.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hThreadSelf The thread handle.
+ * @param   pvUser      The logger instance.
+ */
+static DECLCALLBACK(int) rtlogAsyncWriterThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PRTLOGGER   pLogger = (PRTLOGGER)pvUser;
+    PRTLOGASYNC pAsync;
+
+    /* Wait for rtlogAsyncStart to publish the state. */
+    RTThreadUserWait(hThreadSelf, RT_INDEFINITE_WAIT);
+    pAsync = pLogger->pInt->pAsync;
+    AssertPtrReturn(pAsync, VERR_INTERNAL_ERROR_3);
+
+    while (!ASMAtomicReadBool(&pAsync->fTerminate))
+    {
+        bool fWait = true;
+        if (RT_SUCCESS(rtlogLock(pLogger)))
+        {
+            rtlogAsyncDrainLocked(pLogger);
+
+            /*
+             * Announce that we're going to sleep and check for records queued
+             * meanwhile.  A producer either sees fWriterIdle and signals us,
+             * or we see its record here.
+             */
+            ASMAtomicWriteBool(&pAsync->fWriterIdle, true);
+            for (PRTLOGASYNCBUF pBuf = ASMAtomicReadPtrT(&pAsync->pBufHead, PRTLOGASYNCBUF); pBuf; pBuf = pBuf->pNext)
+                if (   ASMAtomicReadU32(&pBuf->offHead) != pBuf->offTail
+                    || ASMAtomicReadU32(&pBuf->cDropped))
+                {
+                    /* If a producer cleared the flag the event is signalled already. */
+                    if (ASMAtomicXchgBool(&pAsync->fWriterIdle, false))
+                        fWait = false;
+                    break;
+                }
+            rtlogUnlock(pLogger);
+        }
+        if (fWait)
+            RTSemEventWait(pAsync->hEvt, RT_INDEFINITE_WAIT);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts the asynchronous log writer, called on first use.
+ *
+ * @returns true if running, false if the caller should log synchronously.
+ * @param   pLogger     The logger instance.
+ */
+static bool rtlogAsyncStart(PRTLOGGER pLogger)
+{
+    PRTLOGGERINTERNAL pInt = pLogger->pInt;
+    if (!ASMAtomicCmpXchgU32(&pInt->enmAsyncState, RTLOGASYNCSTATE_STARTING, RTLOGASYNCSTATE_NONE))
+        return ASMAtomicReadU32(&pInt->enmAsyncState) == RTLOGASYNCSTATE_RUNNING;
+
+    PRTLOGASYNC pAsync = (PRTLOGASYNC)RTMemAllocZ(sizeof(*pAsync));
+    if (pAsync)
+    {
+        pAsync->hThread  = NIL_RTTHREAD;
+        pAsync->hBinFile = NIL_RTFILE;
+        int rc = RTTlsAllocEx(&pAsync->iTls, rtlogAsyncBufTlsDtor);
+        if (RT_FAILURE(rc))
+        {
+            /* Not all hosts do TLS destructors, the buffers are then freed
+               when destroying the logger. */
+            pAsync->iTls = RTTlsAlloc();
+            rc = pAsync->iTls != NIL_RTTLS ? VINF_SUCCESS : VERR_NO_MEMORY;
+        }
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTSemEventCreate(&pAsync->hEvt);
+            if (RT_SUCCESS(rc))
+            {
+                rc = RTThreadCreate(&pAsync->hThread, rtlogAsyncWriterThread, pLogger, 0 /*cbStack*/,
+                                    RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "LogWriter");
+                if (RT_SUCCESS(rc))
+                {
+                    pAsync->hNativeThread = RTThreadGetNative(pAsync->hThread);
+                    ASMAtomicWritePtr(&pInt->pAsync, pAsync);
+                    ASMAtomicWriteU32(&pInt->enmAsyncState, RTLOGASYNCSTATE_RUNNING);
+                    RTThreadUserSignal(pAsync->hThread);
+                    return true;
+                }
+                RTSemEventDestroy(pAsync->hEvt);
+            }
+            RTTlsFree(pAsync->iTls);
+        }
+        RTMemFree(pAsync);
+    }
+    ASMAtomicWriteU32(&pInt->enmAsyncState, RTLOGASYNCSTATE_FAILED);
+    return false;
+}
+
+
+/**
+ * Queues a log statement for the asynchronous writer.
+ *
+ * The arguments are packed by value (RTLogBinPackV), format strings which
+ * can't be handled that way are formatted here.  This is called without
+ * owning the logger lock.
+ *
+ * @returns true if taken care of, false if the caller should log it
+ *          synchronously.
+ * @param   pLogger     The logger instance.
+ * @param   fFlags      The logging flags.
+ * @param   iGroup      The group.
+ * @param   pszFormat   Format string.
+ * @param   args        Format arguments.  Not consumed.
+ */
+static bool rtlogAsyncLog(PRTLOGGER pLogger, unsigned fFlags, unsigned iGroup, const char *pszFormat, va_list args)
+{
+    PRTLOGGERINTERNAL pInt = pLogger->pInt;
+    if (RT_UNLIKELY(ASMAtomicUoReadU32(&pInt->enmAsyncState) != RTLOGASYNCSTATE_RUNNING))
+    {
+        if (   ASMAtomicUoReadU32(&pInt->enmAsyncState) != RTLOGASYNCSTATE_NONE
+            || !pInt->fCreated
+            || !rtlogAsyncStart(pLogger))
+            return false;
+    }
+
+    /* The writer thread logs synchronously, it would otherwise wait on itself. */
+    PRTLOGASYNC pAsync = pInt->pAsync;
+    if (RTThreadNativeSelf() == pAsync->hNativeThread)
+        return false;
+
+    PRTLOGASYNCBUF pBuf = (PRTLOGASYNCBUF)RTTlsGet(pAsync->iTls);
+    if (RT_UNLIKELY(!pBuf))
+    {
+        pBuf = rtlogAsyncBufCreate(pAsync);
+        if (!pBuf)
+            return false;
+    }
+
+    /*
+     * Assemble the record in the scratch buffer.
+     */
+    PRTLOGASYNCREC pRec   = (PRTLOGASYNCREC)&pBuf->abScratch[0];
+    size_t const   cbMax  = sizeof(pBuf->abScratch) - sizeof(*pRec);
+    size_t         cbData = 0;
+    int rc = RTLogBinPackV(pRec + 1, cbMax, &cbData, pszFormat, args);
+    if (RT_SUCCESS(rc))
+    {
+        pRec->Msg.Hdr.uType = RTLOGBINREC_TYPE_MSG;
+        pRec->pszFormat     = pszFormat;
+    }
+    else if (rc == VERR_NOT_SUPPORTED)
+    {
+        RTLOGASYNCTEXTARGS TextArgs;
+        va_list            va;
+        TextArgs.pchBuf    = (char *)(pRec + 1);
+        TextArgs.cbBuf     = cbMax;
+        TextArgs.off       = 0;
+        TextArgs.fOverflow = false;
+        va_copy(va, args);
+        RTLogFormatV(rtlogAsyncTextOutput, &TextArgs, pszFormat, va);
+        va_end(va);
+        if (TextArgs.fOverflow)
+            return false;
+        pRec->Msg.Hdr.uType = RTLOGBINREC_TYPE_TEXT;
+        pRec->pszFormat     = NULL;
+        cbData = TextArgs.off;
+    }
+    else
+        return false;
+
+    size_t const cbRec = RT_ALIGN_Z(sizeof(*pRec) + cbData, RTLOGBIN_ARG_ALIGN);
+    if (cbRec > sizeof(pBuf->abScratch))
+        return false;
+    memset((uint8_t *)(pRec + 1) + cbData, 0, cbRec - sizeof(*pRec) - cbData);
+
+    pRec->Msg.Hdr.cbRec       = (uint32_t)cbRec;
+    pRec->Msg.Hdr.u16Reserved = 0;
+    pRec->Msg.idFormat        = UINT32_MAX;
+    pRec->Msg.idThread        = pBuf->idThread;
+    pRec->Msg.iGroup          = iGroup;
+    pRec->Msg.fGrpFlags       = fFlags;
+    pRec->Msg.u64NanoTS       = RTTimeNanoTS();
+#if defined(RT_ARCH_AMD64) || defined(RT_ARCH_X86)
+    pRec->Msg.u64Tsc          = ASMReadTSC();
+    pRec->Msg.idCpu           = pLogger->fFlags & RTLOGFLAGS_PREFIX_CPUID ? ASMGetApicId() : 0;
+#else
+    pRec->Msg.u64Tsc          = pRec->Msg.u64NanoTS;
+    pRec->Msg.idCpu           = pLogger->fFlags & RTLOGFLAGS_PREFIX_CPUID ? RTMpCpuId() : 0;
+#endif
+    pRec->Msg.cbData          = (uint32_t)cbData;
+
+    return rtlogAsyncBufPut(pLogger, pAsync, pBuf, pRec);
+}
+
+
+/**
+ * Flushes the binary log stream write buffer.
+ *
+ * @param   pAsync      The asynchronous logging state.
+ */
+static void rtlogAsyncBinFlush(PRTLOGASYNC pAsync)
+{
+    if (pAsync->offBinBuf && pAsync->hBinFile != NIL_RTFILE)
+    {
+        int rc = RTFileWrite(pAsync->hBinFile, pAsync->abBinBuf, pAsync->offBinBuf, NULL);
+        if (RT_FAILURE(rc))
+        {
+            /* Give up on the stream rather than writing a corrupt one. */
+            RTFileClose(pAsync->hBinFile);
+            pAsync->hBinFile = NIL_RTFILE;
+        }
+    }
+    pAsync->offBinBuf = 0;
+}
+
+
+/**
+ * Writes bytes to the binary log stream.
+ *
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pv          What to write.
+ * @param   cb          How much to write.
+ */
+static void rtlogAsyncBinWrite(PRTLOGASYNC pAsync, const void *pv, size_t cb)
+{
+    const uint8_t *pb = (const uint8_t *)pv;
+    while (cb > 0)
+    {
+        if (pAsync->offBinBuf >= sizeof(pAsync->abBinBuf))
+            rtlogAsyncBinFlush(pAsync);
+        size_t cbChunk = RT_MIN(cb, sizeof(pAsync->abBinBuf) - pAsync->offBinBuf);
+        memcpy(&pAsync->abBinBuf[pAsync->offBinBuf], pb, cbChunk);
+        pAsync->offBinBuf += (uint32_t)cbChunk;
+        pb += cbChunk;
+        cb -= cbChunk;
+    }
+}
+
+
+/**
+ * Writes a binary log stream record with a trailing string.
+ *
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pHdr        The record header, cbRec is filled in here.
+ * @param   cbHdr       The size of the record structure.
+ * @param   psz         The string.
+ * @param   cch         The string length.
+ */
+static void rtlogAsyncBinWriteStrRec(PRTLOGASYNC pAsync, PRTLOGBINREC pHdr, size_t cbHdr, const char *psz, size_t cch)
+{
+    static const uint8_t s_abZeros[RTLOGBIN_ARG_ALIGN] = { 0 };
+    size_t const cbRec = RT_ALIGN_Z(cbHdr + cch + 1, RTLOGBIN_ARG_ALIGN);
+    pHdr->cbRec       = (uint32_t)cbRec;
+    pHdr->u16Reserved = 0;
+    rtlogAsyncBinWrite(pAsync, pHdr, cbHdr);
+    rtlogAsyncBinWrite(pAsync, psz, cch);
+    rtlogAsyncBinWrite(pAsync, s_abZeros, cbRec - cbHdr - cch);
+}
+
+
+/**
+ * Opens the binary log stream and writes the header and group names.
+ *
+ * The file is only tried once, failures are quietly ignored.
+ *
+ * @param   pLogger     The logger instance.
+ * @param   pAsync      The asynchronous logging state.
+ */
+static void rtlogAsyncBinOpen(PRTLOGGER pLogger, PRTLOGASYNC pAsync)
+{
+    PRTLOGGERINTERNAL pInt = pLogger->pInt;
+    char              szFilename[RTPATH_MAX];
+    int               rc;
+
+    pAsync->fBinOpened = true;
+    if (pInt->pszBinFilename)
+        rc = RTStrCopy(szFilename, sizeof(szFilename), pInt->pszBinFilename);
+    else if (pInt->szFilename[0])
+    {
+        rc = RTStrCopy(szFilename, sizeof(szFilename), pInt->szFilename);
+        if (RT_SUCCESS(rc))
+            rc = RTStrCat(szFilename, sizeof(szFilename), ".bin");
+    }
+    else
+        rc = VERR_INVALID_STATE;
+    if (RT_SUCCESS(rc))
+        rc = RTFileOpen(&pAsync->hBinFile, szFilename, RTFILE_O_WRITE | RTFILE_O_DENY_WRITE | RTFILE_O_CREATE_REPLACE);
+    if (RT_FAILURE(rc))
+    {
+        pAsync->hBinFile = NIL_RTFILE;
+        return;
+    }
+
+    RTLOGBINHDR Hdr;
+    RTTIMESPEC  Now;
+    RT_ZERO(Hdr);
+    memcpy(Hdr.szMagic, RTLOGBINHDR_MAGIC, sizeof(RTLOGBINHDR_MAGIC));
+    Hdr.uVersion           = RTLOGBINHDR_VERSION;
+    Hdr.cbHdr              = sizeof(Hdr);
+    Hdr.u32Endian          = RTLOGBINHDR_ENDIAN;
+    Hdr.fLogFlags          = pLogger->fFlags;
+    Hdr.u64NanoTSProgStart = RTTimeProgramStartNanoTS();
+    Hdr.u64NanoTSStart     = RTTimeNanoTS();
+    Hdr.i64WallNanoStart   = RTTimeSpecGetNano(RTTimeNow(&Now));
+    Hdr.u64ProcessId       = RTProcSelf();
+    rtlogAsyncBinWrite(pAsync, &Hdr, sizeof(Hdr));
+
+    if (pInt->papszGroups)
+        for (uint32_t iGroup = 0; iGroup < pLogger->cGroups; iGroup++)
+            if (pInt->papszGroups[iGroup])
+            {
+                RTLOGBINGROUP Group;
+                Group.Hdr.uType = RTLOGBINREC_TYPE_GROUP;
+                Group.iGroup    = iGroup;
+                Group.cchName   = (uint32_t)strlen(pInt->papszGroups[iGroup]);
+                rtlogAsyncBinWriteStrRec(pAsync, &Group.Hdr, sizeof(Group), pInt->papszGroups[iGroup], Group.cchName);
+            }
+}
+
+
+/**
+ * Looks up the binary log stream ID of a format string, defining it in the
+ * stream the first time around.
+ *
+ * @returns The format ID.
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pszFormat   The format string.
+ */
+static uint32_t rtlogAsyncBinFormatId(PRTLOGASYNC pAsync, const char *pszFormat)
+{
+    /*
+     * Grow the hash table when it's half full.  Should we run out of memory,
+     * we simply define the format string again.
+     */
+    if (pAsync->cFmts * 2 >= pAsync->cFmtsAlloc)
+    {
+        uint32_t const cNew  = pAsync->cFmtsAlloc ? pAsync->cFmtsAlloc * 2 : 256;
+        PRTLOGASYNCFMT paNew = (PRTLOGASYNCFMT)RTMemAllocZ(cNew * sizeof(paNew[0]));
+        if (paNew)
+        {
+            for (uint32_t i = 0; i < pAsync->cFmtsAlloc; i++)
+                if (pAsync->paFmts[i].pszFormat)
+                {
+                    uint32_t j = (uint32_t)(((uintptr_t)pAsync->paFmts[i].pszFormat >> 2) * UINT32_C(0x9e3779b1)) & (cNew - 1);
+                    while (paNew[j].pszFormat)
+                        j = (j + 1) & (cNew - 1);
+                    paNew[j] = pAsync->paFmts[i];
+                }
+            RTMemFree(pAsync->paFmts);
+            pAsync->paFmts     = paNew;
+            pAsync->cFmtsAlloc = cNew;
+        }
+    }
+
+    /*
+     * Look it up.  The address is the key, but since it may have been reused
+     * by a different string (unloaded module, stack buffer) the content is
+     * compared too.
+     */
+    uint32_t const idFormat = pAsync->cFmts++;
+    if (pAsync->cFmts * 2 <= pAsync->cFmtsAlloc)
+    {
+        uint32_t const fMask = pAsync->cFmtsAlloc - 1;
+        uint32_t       i     = (uint32_t)(((uintptr_t)pszFormat >> 2) * UINT32_C(0x9e3779b1)) & fMask;
+        while (   pAsync->paFmts[i].pszFormat
+               && pAsync->paFmts[i].pszFormat != pszFormat)
+            i = (i + 1) & fMask;
+
+        PRTLOGASYNCFMT pEntry = &pAsync->paFmts[i];
+        if (pEntry->pszFormat)
+        {
+            if (pEntry->pszCopy && !strcmp(pEntry->pszCopy, pszFormat))
+            {
+                pAsync->cFmts--;
+                return pEntry->idFormat;
+            }
+            RTStrFree(pEntry->pszCopy);
+        }
+        pEntry->pszFormat = pszFormat;
+        pEntry->pszCopy   = RTStrDup(pszFormat);
+        pEntry->idFormat  = idFormat;
+    }
+
+    RTLOGBINFMT Fmt;
+    Fmt.Hdr.uType = RTLOGBINREC_TYPE_FORMAT;
+    Fmt.idFormat  = idFormat;
+    Fmt.cchFormat = (uint32_t)strlen(pszFormat);
+    rtlogAsyncBinWriteStrRec(pAsync, &Fmt.Hdr, sizeof(Fmt), pszFormat, Fmt.cchFormat);
+    return idFormat;
+}
+
+
+/**
+ * Writes a record to the binary log stream.
+ *
+ * @param   pLogger     The logger instance.
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pBuf        The buffer the record is from.
+ * @param   pRec        The record.
+ */
+static void rtlogAsyncBinWriteRec(PRTLOGGER pLogger, PRTLOGASYNC pAsync, PRTLOGASYNCBUF pBuf, PCRTLOGASYNCREC pRec)
+{
+    if (!pAsync->fBinOpened)
+        rtlogAsyncBinOpen(pLogger, pAsync);
+    if (pAsync->hBinFile == NIL_RTFILE)
+        return;
+
+    if (!pBuf->fBinDefined)
+    {
+        RTLOGBINTHREAD Thread;
+        Thread.Hdr.uType       = RTLOGBINREC_TYPE_THREAD;
+        Thread.idThread        = pBuf->idThread;
+        Thread.cchName         = (uint32_t)strlen(pBuf->szName);
+        Thread.u64NativeThread = (uint64_t)pBuf->hNativeThread;
+        rtlogAsyncBinWriteStrRec(pAsync, &Thread.Hdr, sizeof(Thread), pBuf->szName, Thread.cchName);
+        pBuf->fBinDefined = true;
+    }
+
+    RTLOGBINMSG Msg = pRec->Msg;
+    if (Msg.Hdr.uType == RTLOGBINREC_TYPE_MSG)
+        Msg.idFormat = rtlogAsyncBinFormatId(pAsync, pRec->pszFormat);
+    Msg.Hdr.cbRec = pRec->Msg.Hdr.cbRec - (uint32_t)(sizeof(*pRec) - sizeof(Msg));
+    rtlogAsyncBinWrite(pAsync, &Msg, sizeof(Msg));
+    rtlogAsyncBinWrite(pAsync, pRec + 1, Msg.Hdr.cbRec - sizeof(Msg));
+}
+
+
+/**
+ * Reports records dropped because a thread's buffer was full.
+ *
+ * @param   pLogger     The logger instance.
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pBuf        The buffer of the thread.
+ * @param   cDropped    The number of records dropped.
+ */
+static void rtlogAsyncReportDropped(PRTLOGGER pLogger, PRTLOGASYNC pAsync, PRTLOGASYNCBUF pBuf, uint32_t cDropped)
+{
+    if (pLogger->fDestFlags & ~RTLOGDEST_BINFILE)
+        rtlogLoggerExFLocked(pLogger, 0, ~0U, "*** %u log records from thread '%s' dropped, asynchronous log buffer full ***\n",
+                             cDropped, pBuf->szName);
+    if (   (pLogger->fDestFlags & RTLOGDEST_BINFILE)
+        && pAsync->hBinFile != NIL_RTFILE)
+    {
+        RTLOGBINDROPPED Dropped;
+        Dropped.Hdr.cbRec       = sizeof(Dropped);
+        Dropped.Hdr.uType       = RTLOGBINREC_TYPE_DROPPED;
+        Dropped.Hdr.u16Reserved = 0;
+        Dropped.idThread        = pBuf->idThread;
+        Dropped.cDropped        = cDropped;
+        rtlogAsyncBinWrite(pAsync, &Dropped, sizeof(Dropped));
+    }
+}
+
+
+/**
+ * Formats and writes an asynchronous record to the logger destinations.
+ *
+ * @param   pLogger     The logger instance.
+ * @param   pAsync      The asynchronous logging state.
+ * @param   pBuf        The buffer the record is from.
+ * @param   pRec        The record.
+ */
+static void rtlogAsyncWriteRec(PRTLOGGER pLogger, PRTLOGASYNC pAsync, PRTLOGASYNCBUF pBuf, PCRTLOGASYNCREC pRec)
+{
+    if (pLogger->fDestFlags & ~RTLOGDEST_BINFILE)
+    {
+        const char *pchText = (const char *)(pRec + 1);
+        if (pLogger->fFlags & (RTLOGFLAGS_PREFIX_MASK | RTLOGFLAGS_USECRLF))
+        {
+            RTLOGOUTPUTPREFIXEDARGS OutputArgs;
+            OutputArgs.pLogger   = pLogger;
+            OutputArgs.iGroup    = pRec->Msg.iGroup;
+            OutputArgs.fFlags    = pRec->Msg.fGrpFlags;
+            OutputArgs.pAsyncRec = pRec;
+            OutputArgs.pAsyncBuf = pBuf;
+            if (pRec->Msg.Hdr.uType == RTLOGBINREC_TYPE_MSG)
+                RTLogBinFormat(rtLogOutputPrefixed, &OutputArgs, pRec->pszFormat, pRec + 1, pRec->Msg.cbData);
+            else
+            {
+                rtLogOutputPrefixed(&OutputArgs, pchText, pRec->Msg.cbData);
+                rtLogOutputPrefixed(&OutputArgs, NULL, 0);
+            }
+        }
+        else if (pRec->Msg.Hdr.uType == RTLOGBINREC_TYPE_MSG)
+            RTLogBinFormat(rtLogOutput, pLogger, pRec->pszFormat, pRec + 1, pRec->Msg.cbData);
+        else
+        {
+            rtLogOutput(pLogger, pchText, pRec->Msg.cbData);
+            rtLogOutput(pLogger, NULL, 0);
+        }
+    }
+
+    if (pLogger->fDestFlags & RTLOGDEST_BINFILE)
+        rtlogAsyncBinWriteRec(pLogger, pAsync, pBuf, pRec);
+}
+
+
+/**
+ * Returns the oldest record in a buffer, skipping padding.
+ *
+ * @returns Pointer to the record, NULL if none left in this drain pass.
+ * @param   pBuf        The buffer.
+ */
+static PCRTLOGASYNCREC rtlogAsyncBufPeek(PRTLOGASYNCBUF pBuf)
+{
+    uint32_t offTail = pBuf->offTail;
+    while (offTail != pBuf->offDrainEnd)
+    {
+        PCRTLOGASYNCREC pRec = (PCRTLOGASYNCREC)&pBuf->abBuf[offTail & (RTLOG_ASYNC_BUF_SIZE - 1)];
+        if (pRec->Msg.Hdr.uType != RTLOGASYNCREC_TYPE_PAD)
+            return pRec;
+        offTail += pRec->Msg.Hdr.cbRec;
+        ASMAtomicWriteU32(&pBuf->offTail, offTail);
+    }
+    return NULL;
+}
+
+
+/**
+ * Writes out the records in the asynchronous log buffers.
+ *
+ * The records of all threads are merged by timestamp.  Buffers of terminated
+ * threads are freed once they are empty.
+ *
+ * @param   pLogger     The logger instance, owner of the lock.
+ */
+static void rtlogAsyncDrainLocked(PRTLOGGER pLogger)
+{
+    PRTLOGASYNC    pAsync = pLogger->pInt->pAsync;
+    PRTLOGASYNCBUF pHead;
+    PRTLOGASYNCBUF pBuf;
+    if (!pAsync)
+        return;
+
+    /*
+     * Snapshot the buffers; records added after this are for the next pass.
+     */
+    pHead = ASMAtomicReadPtrT(&pAsync->pBufHead, PRTLOGASYNCBUF);
+    for (pBuf = pHead; pBuf; pBuf = pBuf->pNext)
+    {
+        uint32_t cDropped = ASMAtomicXchgU32(&pBuf->cDropped, 0);
+        pBuf->offDrainEnd = ASMAtomicReadU32(&pBuf->offHead);
+        if (cDropped)
+            rtlogAsyncReportDropped(pLogger, pAsync, pBuf, cDropped);
+    }
+
+    /*
+     * Merge.
+     */
+    for (;;)
+    {
+        PRTLOGASYNCBUF  pBest    = NULL;
+        PCRTLOGASYNCREC pBestRec = NULL;
+        for (pBuf = pHead; pBuf; pBuf = pBuf->pNext)
+        {
+            PCRTLOGASYNCREC pRec = rtlogAsyncBufPeek(pBuf);
+            if (   pRec
+                && (!pBestRec || pRec->Msg.u64NanoTS < pBestRec->Msg.u64NanoTS))
+            {
+                pBest    = pBuf;
+                pBestRec = pRec;
+            }
+        }
+        if (!pBest)
+            break;
+
+        rtlogAsyncWriteRec(pLogger, pAsync, pBest, pBestRec);
+        ASMAtomicWriteU32(&pBest->offTail, pBest->offTail + pBestRec->Msg.Hdr.cbRec);
+    }
+
+    /*
+     * Wake up the threads waiting for room (lossless mode).
+     */
+    for (pBuf = pHead; pBuf; pBuf = pBuf->pNext)
+        if (ASMAtomicReadBool(&pBuf->fWaiting))
+            RTSemEventSignal(pBuf->hEvtSpace);
+
+    /*
+     * Free the empty buffers of terminated threads.  Only the head can be
+     * changed by others (pushing), so we only need to be careful there.
+     */
+    PRTLOGASYNCBUF pPrev = NULL;
+    pBuf = pHead;
+    while (pBuf)
+    {
+        PRTLOGASYNCBUF pNext = pBuf->pNext;
+        if (   ASMAtomicReadBool(&pBuf->fOrphaned)
+            && pBuf->offTail == ASMAtomicReadU32(&pBuf->offHead)
+            && !ASMAtomicReadU32(&pBuf->cDropped))
+        {
+            if (pPrev)
+                pPrev->pNext = pNext;
+            else if (!ASMAtomicCmpXchgPtr(&pAsync->pBufHead, pNext, pBuf))
+            {
+                pPrev = ASMAtomicReadPtrT(&pAsync->pBufHead, PRTLOGASYNCBUF);
+                while (pPrev->pNext != pBuf)
+                    pPrev = pPrev->pNext;
+                pPrev->pNext = pNext;
+            }
+            rtlogAsyncBufFree(pAsync, pBuf);
+        }
+        else
+            pPrev = pBuf;
+        pBuf = pNext;
+    }
+
+    /*
+     * Write it out.
+     */
+    if (   !(pLogger->fFlags & RTLOGFLAGS_BUFFERED)
+        && pLogger->offScratch)
+        rtlogFlush(pLogger);
+    rtlogAsyncBinFlush(pAsync);
+}
+
+
+/**
+ * Stops the asynchronous log writer thread, if running.
+ *
+ * Called by RTLogDestroy before taking the logger lock.
+ *
+ * @param   pLogger     The logger instance.
+ */
+static void rtlogAsyncStop(PRTLOGGER pLogger)
+{
+    PRTLOGGERINTERNAL pInt = pLogger->pInt;
+    ASMAtomicWriteU32(&pInt->enmAsyncState, RTLOGASYNCSTATE_STOPPED);
+
+    PRTLOGASYNC pAsync = pInt->pAsync;
+    if (pAsync)
+    {
+        ASMAtomicWriteBool(&pAsync->fTerminate, true);
+        RTSemEventSignal(pAsync->hEvt);
+        int rc = RTThreadWait(pAsync->hThread, RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc);
+    }
+}
+
+
+/**
+ * Frees the asynchronous logging state after the final drain.
+ *
+ * @param   pLogger     The logger instance, owner of the lock.
+ */
+static void rtlogAsyncDestroyLocked(PRTLOGGER pLogger)
+{
+    PRTLOGGERINTERNAL pInt   = pLogger->pInt;
+    PRTLOGASYNC       pAsync = pInt->pAsync;
+    if (pAsync)
+    {
+        ASMAtomicWriteNullPtr(&pInt->pAsync);
+
+        rtlogAsyncBinFlush(pAsync);
+        if (pAsync->hBinFile != NIL_RTFILE)
+        {
+            RTFileClose(pAsync->hBinFile);
+            pAsync->hBinFile = NIL_RTFILE;
+        }
+
+        PRTLOGASYNCBUF pBuf = pAsync->pBufHead;
+        while (pBuf)
+        {
+            PRTLOGASYNCBUF pNext = pBuf->pNext;
+            rtlogAsyncBufFree(pAsync, pBuf);
+            pBuf = pNext;
+        }
+        pAsync->pBufHead = NULL;
+
+        for (uint32_t i = 0; i < pAsync->cFmtsAlloc; i++)
+            RTStrFree(pAsync->paFmts[i].pszCopy);
+        RTMemFree(pAsync->paFmts);
+        RTTlsFree(pAsync->iTls);
+        RTSemEventDestroy(pAsync->hEvt);
+        RTMemFree(pAsync);
+    }
+
+    RTStrFree(pInt->pszBinFilename);
+    pInt->pszBinFilename = NULL;
+}
+
+#endif /* IN_RING3 */
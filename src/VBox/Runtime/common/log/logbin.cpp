@@ -0,0 +1,727 @@
+/* $Id$ */
+/** @file
+ * IPRT - Logging, argument packing for deferred formatting.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/log.h>
+#include "internal/iprt.h"
+
+#include <iprt/assert.h>
+#include <iprt/ctype.h>
+#include <iprt/err.h>
+#include <iprt/string.h>
+#include <iprt/formats/logbin.h>
+
+#include <iprt/stdarg.h>
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Argument kinds of a format specifier.
+ */
+typedef enum RTLOGBINARGKIND
+{
+    /** The specifier cannot be captured by value. */
+    RTLOGBINARGKIND_UNSUPPORTED = 0,
+    /** Integer (%d, %u, %x, ...). */
+    RTLOGBINARGKIND_INT,
+    /** Pointer (%p). */
+    RTLOGBINARGKIND_PTR,
+    /** Character (%c). */
+    RTLOGBINARGKIND_CHAR,
+    /** UTF-8 string (%s). */
+    RTLOGBINARGKIND_STR,
+    /** Scalar IPRT type (%RX32, %Rrc, %RGp, ...). */
+    RTLOGBINARGKIND_RT_INT
+} RTLOGBINARGKIND;
+
+/**
+ * A parsed format specifier.
+ *
+ * The offsets are relative to the '%' and delimit the flags, width,
+ * precision, size and type parts of the specifier.
+ */
+typedef struct RTLOGBINSPEC
+{
+    /** The argument kind. */
+    RTLOGBINARGKIND enmKind;
+    /** The argument size in bytes (INT and RT_INT). */
+    uint8_t         cbArg;
+    /** Whether the argument is signed (INT and RT_INT). */
+    bool            fSigned;
+    /** The width is taken from the arguments ('*'). */
+    bool            fWidthArg;
+    /** The precision is taken from the arguments ('*'). */
+    bool            fPrecisionArg;
+    /** The literal precision, -1 if not specified or taken from the arguments. */
+    int             cchPrecision;
+    /** The argument size character as interpreted by RTStrFormatV. */
+    char            chArgSize;
+    /** End of the flags. */
+    uint8_t         offFlagsEnd;
+    /** End of the width. */
+    uint8_t         offWidthEnd;
+    /** End of the precision. */
+    uint8_t         offPrecisionEnd;
+    /** End of the argument size, i.e. start of the type. */
+    uint8_t         offSizeEnd;
+    /** End of the specifier. */
+    uint8_t         offEnd;
+} RTLOGBINSPEC;
+/** Pointer to a parsed format specifier. */
+typedef RTLOGBINSPEC *PRTLOGBINSPEC;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/**
+ * The IPRT format types which take a scalar argument and thus can be
+ * captured by value.  The sizes must match strformatrt.cpp.
+ */
+static const struct
+{
+    const char *pszType;
+    size_t      cchType;
+    uint8_t     cb;
+    bool        fSigned;
+} g_aRtScalarTypes[] =
+{
+    { RT_STR_TUPLE("Ci"),      sizeof(RTINT),          true  },
+    { RT_STR_TUPLE("Cp"),      sizeof(RTCCPHYS),       false },
+    { RT_STR_TUPLE("Cr"),      sizeof(RTCCUINTREG),    false },
+    { RT_STR_TUPLE("Cu"),      sizeof(RTUINT),         false },
+    { RT_STR_TUPLE("Cv"),      sizeof(void *),         false },
+    { RT_STR_TUPLE("Cx"),      sizeof(RTUINT),         false },
+    { RT_STR_TUPLE("Gi"),      sizeof(RTGCINT),        true  },
+    { RT_STR_TUPLE("Gp"),      sizeof(RTGCPHYS),       false },
+    { RT_STR_TUPLE("Gr"),      sizeof(RTGCUINTREG),    false },
+    { RT_STR_TUPLE("Gu"),      sizeof(RTGCUINT),       false },
+    { RT_STR_TUPLE("Gv"),      sizeof(RTGCPTR),        false },
+    { RT_STR_TUPLE("Gx"),      sizeof(RTGCUINT),       false },
+    { RT_STR_TUPLE("Hi"),      sizeof(RTHCINT),        true  },
+    { RT_STR_TUPLE("Hp"),      sizeof(RTHCPHYS),       false },
+    { RT_STR_TUPLE("Hr"),      sizeof(RTHCUINTREG),    false },
+    { RT_STR_TUPLE("Hu"),      sizeof(RTHCUINT),       false },
+    { RT_STR_TUPLE("Hv"),      sizeof(RTHCPTR),        false },
+    { RT_STR_TUPLE("Hx"),      sizeof(RTHCUINT),       false },
+    { RT_STR_TUPLE("I16"),     sizeof(int16_t),        true  },
+    { RT_STR_TUPLE("I32"),     sizeof(int32_t),        true  },
+    { RT_STR_TUPLE("I64"),     sizeof(int64_t),        true  },
+    { RT_STR_TUPLE("I8"),      sizeof(int8_t),         true  },
+    { RT_STR_TUPLE("Rv"),      sizeof(RTRCPTR),        false },
+    { RT_STR_TUPLE("Tbool"),   sizeof(bool),           false },
+    { RT_STR_TUPLE("Tfile"),   sizeof(RTFILE),         false },
+    { RT_STR_TUPLE("Tfmode"),  sizeof(RTFMODE),        false },
+    { RT_STR_TUPLE("Tfoff"),   sizeof(RTFOFF),         true  },
+    { RT_STR_TUPLE("Tgid"),    sizeof(RTGID),          true  },
+    { RT_STR_TUPLE("Tino"),    sizeof(RTINODE),        false },
+    { RT_STR_TUPLE("Tint"),    sizeof(RTINT),          true  },
+    { RT_STR_TUPLE("Tiop"),    sizeof(RTIOPORT),       false },
+    { RT_STR_TUPLE("Tldrm"),   sizeof(RTLDRMOD),       false },
+    { RT_STR_TUPLE("Tnthrd"),  sizeof(RTNATIVETHREAD), false },
+    { RT_STR_TUPLE("Tproc"),   sizeof(RTPROCESS),      false },
+    { RT_STR_TUPLE("Tptr"),    sizeof(RTUINTPTR),      false },
+    { RT_STR_TUPLE("Treg"),    sizeof(RTCCUINTREG),    false },
+    { RT_STR_TUPLE("Tsel"),    sizeof(RTSEL),          false },
+    { RT_STR_TUPLE("Tsem"),    sizeof(RTSEMEVENT),     false },
+    { RT_STR_TUPLE("Tsock"),   sizeof(RTSOCKET),       false },
+    { RT_STR_TUPLE("Tthrd"),   sizeof(RTTHREAD),       false },
+    { RT_STR_TUPLE("Tuid"),    sizeof(RTUID),          true  },
+    { RT_STR_TUPLE("Tuint"),   sizeof(RTUINT),         false },
+    { RT_STR_TUPLE("Tunicp"),  sizeof(RTUNICP),        false },
+    { RT_STR_TUPLE("Tutf16"),  sizeof(RTUTF16),        false },
+    { RT_STR_TUPLE("Txint"),   sizeof(RTUINT),         false },
+    { RT_STR_TUPLE("U16"),     sizeof(uint16_t),       false },
+    { RT_STR_TUPLE("U32"),     sizeof(uint32_t),       false },
+    { RT_STR_TUPLE("U64"),     sizeof(uint64_t),       false },
+    { RT_STR_TUPLE("U8"),      sizeof(uint8_t),        false },
+    { RT_STR_TUPLE("X16"),     sizeof(uint16_t),       false },
+    { RT_STR_TUPLE("X32"),     sizeof(uint32_t),       false },
+    { RT_STR_TUPLE("X64"),     sizeof(uint64_t),       false },
+    { RT_STR_TUPLE("X8"),      sizeof(uint8_t),        false },
+};
+
+
+/**
+ * Parses a format specifier the way RTStrFormatV does.
+ *
+ * @returns true if parsed, false if the specifier is too long to be handled.
+ * @param   pszSpec     The specifier, pointing at the '%'.
+ * @param   pSpec       Where to return the parsed specifier.
+ */
+static bool rtLogBinParseSpec(const char *pszSpec, PRTLOGBINSPEC pSpec)
+{
+    const char *psz = pszSpec + 1;
+
+    RT_ZERO(*pSpec);
+    pSpec->enmKind      = RTLOGBINARGKIND_UNSUPPORTED;
+    pSpec->cchPrecision = -1;
+
+    /* flags */
+    while (   *psz == '#' || *psz == '-' || *psz == '+'
+           || *psz == ' ' || *psz == '0' || *psz == '\'')
+        psz++;
+    pSpec->offFlagsEnd = (uint8_t)RT_MIN(psz - pszSpec, 255);
+
+    /* width */
+    if (*psz == '*')
+    {
+        pSpec->fWidthArg = true;
+        psz++;
+    }
+    else
+        while (RT_C_IS_DIGIT(*psz))
+            psz++;
+    pSpec->offWidthEnd = (uint8_t)RT_MIN(psz - pszSpec, 255);
+
+    /* precision */
+    if (*psz == '.')
+    {
+        psz++;
+        if (*psz == '*')
+        {
+            pSpec->fPrecisionArg = true;
+            psz++;
+        }
+        else
+        {
+            pSpec->cchPrecision = 0;
+            while (RT_C_IS_DIGIT(*psz))
+                pSpec->cchPrecision = pSpec->cchPrecision * 10 + (*psz++ - '0');
+        }
+    }
+    pSpec->offPrecisionEnd = (uint8_t)RT_MIN(psz - pszSpec, 255);
+
+    /* argument size */
+    pSpec->chArgSize = *psz;
+    switch (*psz)
+    {
+        default:
+            pSpec->chArgSize = 0;
+            break;
+        case 'z':
+        case 'L':
+        case 'j':
+        case 't':
+            psz++;
+            break;
+        case 'l':
+            if (*++psz == 'l')
+            {
+                pSpec->chArgSize = 'L';
+                psz++;
+            }
+            break;
+        case 'h':
+            if (*++psz == 'h')
+            {
+                pSpec->chArgSize = 'H';
+                psz++;
+            }
+            break;
+        case 'I':
+            if (psz[1] == '6' && psz[2] == '4')
+            {
+                pSpec->chArgSize = 'L';
+                psz += 3;
+            }
+            else if (psz[1] == '3' && psz[2] == '2')
+            {
+                pSpec->chArgSize = 0;
+                psz += 3;
+            }
+            else
+            {
+                pSpec->chArgSize = 'j';
+                psz++;
+            }
+            break;
+        case 'q':
+            pSpec->chArgSize = 'L';
+            psz++;
+            break;
+    }
+    pSpec->offSizeEnd = (uint8_t)RT_MIN(psz - pszSpec, 255);
+
+    /* type */
+    switch (*psz++)
+    {
+        case 'c':
+            pSpec->enmKind = RTLOGBINARGKIND_CHAR;
+            break;
+
+        case 'S':
+        case 's':
+            if (!pSpec->chArgSize)
+                pSpec->enmKind = RTLOGBINARGKIND_STR;
+            break;
+
+        case 'd':
+        case 'i':
+            pSpec->fSigned = true;
+            /* fall thru */
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            pSpec->enmKind = RTLOGBINARGKIND_INT;
+            switch (pSpec->chArgSize)
+            {
+                case 'L':
+                case 'j':   pSpec->cbArg = sizeof(int64_t); break;
+                case 'l':   pSpec->cbArg = sizeof(long); break;
+                case 'z':   pSpec->cbArg = sizeof(size_t); break;
+                case 't':   pSpec->cbArg = sizeof(ptrdiff_t); break;
+                case 'h':   pSpec->cbArg = sizeof(short); break;
+                case 'H':   pSpec->cbArg = sizeof(int8_t); break;
+                default:    pSpec->cbArg = sizeof(int); break;
+            }
+            break;
+
+        case 'p':
+            pSpec->enmKind = RTLOGBINARGKIND_PTR;
+            break;
+
+        case 'R':
+            if (pSpec->chArgSize)
+                break;
+            if (   *psz == 'r'
+                && (psz[1] == 'c' || psz[1] == 's' || psz[1] == 'f' || psz[1] == 'a'))
+            {
+                pSpec->enmKind = RTLOGBINARGKIND_RT_INT;
+                pSpec->cbArg   = sizeof(int);
+                pSpec->fSigned = true;
+                psz += 2;
+            }
+            else
+                for (unsigned i = 0; i < RT_ELEMENTS(g_aRtScalarTypes); i++)
+                    if (!strncmp(psz, g_aRtScalarTypes[i].pszType, g_aRtScalarTypes[i].cchType))
+                    {
+                        pSpec->enmKind = RTLOGBINARGKIND_RT_INT;
+                        pSpec->cbArg   = g_aRtScalarTypes[i].cb;
+                        pSpec->fSigned = g_aRtScalarTypes[i].fSigned;
+                        psz += g_aRtScalarTypes[i].cchType;
+                        break;
+                    }
+            break;
+
+        /* %M, %N, %R[type], %l[sS], unknown and truncated specifiers. */
+        default:
+            psz--;
+            break;
+    }
+
+    if (psz - pszSpec > 48)
+    {
+        pSpec->enmKind = RTLOGBINARGKIND_UNSUPPORTED;
+        return false;
+    }
+    pSpec->offEnd = (uint8_t)(psz - pszSpec);
+    return true;
+}
+
+
+/**
+ * Truncates and sign or zero extends a value to 64-bit.
+ *
+ * @returns The normalized value.
+ * @param   u64         The value.
+ * @param   cb          The size of the source type.
+ * @param   fSigned     Whether the source type is signed.
+ */
+DECLINLINE(uint64_t) rtLogBinNormalize(uint64_t u64, unsigned cb, bool fSigned)
+{
+    if (cb >= sizeof(uint64_t))
+        return u64;
+    unsigned const cShift = 64 - cb * 8;
+    if (fSigned)
+        return (uint64_t)((int64_t)(u64 << cShift) >> cShift);
+    return u64 & (UINT64_MAX >> cShift);
+}
+
+
+/**
+ * Stores a 64-bit value in the packed argument buffer.
+ *
+ * @returns false on buffer overflow.
+ * @param   pbBuf       The buffer.
+ * @param   cbBuf       The buffer size.
+ * @param   poff        The current offset, advanced.
+ * @param   u64         The value.
+ */
+DECLINLINE(bool) rtLogBinPutU64(uint8_t *pbBuf, size_t cbBuf, size_t *poff, uint64_t u64)
+{
+    if (cbBuf - *poff < sizeof(uint64_t))
+        return false;
+    memcpy(&pbBuf[*poff], &u64, sizeof(u64));
+    *poff += sizeof(uint64_t);
+    return true;
+}
+
+
+RTDECL(int) RTLogBinPackV(void *pvBuf, size_t cbBuf, size_t *pcbPacked, const char *pszFormat, va_list args)
+{
+    uint8_t    *pbBuf = (uint8_t *)pvBuf;
+    size_t      off   = 0;
+    int         rc    = VINF_SUCCESS;
+    const char *psz   = pszFormat;
+    va_list     va;
+
+    AssertPtrReturn(pszFormat, VERR_INVALID_POINTER);
+    cbBuf &= ~(size_t)(RTLOGBIN_ARG_ALIGN - 1);
+
+    va_copy(va, args);
+    while ((psz = strchr(psz, '%')) != NULL)
+    {
+        RTLOGBINSPEC Spec;
+        uint64_t     u64;
+        int          cchPrecision;
+
+        if (psz[1] == '%')
+        {
+            psz += 2;
+            continue;
+        }
+        if (   !rtLogBinParseSpec(psz, &Spec)
+            || Spec.enmKind == RTLOGBINARGKIND_UNSUPPORTED)
+        {
+            rc = VERR_NOT_SUPPORTED;
+            break;
+        }
+
+        /*
+         * Width and precision arguments.
+         */
+        if (Spec.fWidthArg)
+        {
+            int cchWidth = va_arg(va, int);
+            if (!rtLogBinPutU64(pbBuf, cbBuf, &off, (uint64_t)(int64_t)cchWidth))
+            {
+                rc = VERR_BUFFER_OVERFLOW;
+                break;
+            }
+        }
+        cchPrecision = Spec.cchPrecision;
+        if (Spec.fPrecisionArg)
+        {
+            cchPrecision = va_arg(va, int);
+            if (!rtLogBinPutU64(pbBuf, cbBuf, &off, (uint64_t)(int64_t)cchPrecision))
+            {
+                rc = VERR_BUFFER_OVERFLOW;
+                break;
+            }
+        }
+
+        /*
+         * The argument itself, fetched exactly like RTStrFormatV does.
+         */
+        switch (Spec.enmKind)
+        {
+            case RTLOGBINARGKIND_INT:
+                switch (Spec.chArgSize)
+                {
+                    case 'L':
+                    case 'j':   u64 = va_arg(va, uint64_t); break;
+                    case 'l':   u64 = va_arg(va, unsigned long); break;
+                    case 'z':   u64 = va_arg(va, size_t); break;
+                    case 't':   u64 = va_arg(va, ptrdiff_t); break;
+                    default:    u64 = va_arg(va, unsigned int); break;
+                }
+                u64 = rtLogBinNormalize(u64, Spec.cbArg, Spec.fSigned);
+                break;
+
+            case RTLOGBINARGKIND_RT_INT:
+                if (Spec.cbArg == sizeof(uint64_t))
+                    u64 = va_arg(va, uint64_t);
+                else
+                {
+                    Assert(Spec.cbArg <= sizeof(uint32_t));
+                    u64 = va_arg(va, uint32_t);
+                }
+                u64 = rtLogBinNormalize(u64, Spec.cbArg, Spec.fSigned);
+                break;
+
+            case RTLOGBINARGKIND_PTR:
+                u64 = va_arg(va, uintptr_t);
+                break;
+
+            case RTLOGBINARGKIND_CHAR:
+                u64 = (uint8_t)va_arg(va, int);
+                break;
+
+            case RTLOGBINARGKIND_STR:
+            {
+                const char *pszStr = va_arg(va, const char *);
+                size_t      cchMax = RTLOGBIN_MAX_STR + 1;
+                size_t      cchStr;
+                size_t      cbEntry;
+                uint32_t    u32Len;
+                if (!VALID_PTR(pszStr))
+                    pszStr = "<NULL>";
+                if (cchPrecision >= 0 && (size_t)cchPrecision < cchMax)
+                    cchMax = cchPrecision;
+                cchStr  = RTStrNLen(pszStr, cchMax);
+                if (cchStr > RTLOGBIN_MAX_STR)
+                {
+                    /* Don't truncate, let the caller format it the normal way. */
+                    rc = VERR_BUFFER_OVERFLOW;
+                    break;
+                }
+                cbEntry = RT_ALIGN_Z(sizeof(uint32_t) + cchStr + 1, RTLOGBIN_ARG_ALIGN);
+                if (cbBuf - off < cbEntry)
+                {
+                    rc = VERR_BUFFER_OVERFLOW;
+                    break;
+                }
+                u32Len = (uint32_t)cchStr;
+                memcpy(&pbBuf[off], &u32Len, sizeof(u32Len));
+                memcpy(&pbBuf[off + sizeof(u32Len)], pszStr, cchStr);
+                memset(&pbBuf[off + sizeof(u32Len) + cchStr], 0, cbEntry - sizeof(u32Len) - cchStr);
+                off += cbEntry;
+                break;
+            }
+
+            default:
+                AssertFailed();
+                rc = VERR_INTERNAL_ERROR_3;
+                break;
+        }
+        if (RT_FAILURE(rc))
+            break;
+        if (   Spec.enmKind != RTLOGBINARGKIND_STR
+            && !rtLogBinPutU64(pbBuf, cbBuf, &off, u64))
+        {
+            rc = VERR_BUFFER_OVERFLOW;
+            break;
+        }
+
+        psz += Spec.offEnd;
+    }
+    va_end(va);
+
+    *pcbPacked = off;
+    return rc;
+}
+RT_EXPORT_SYMBOL(RTLogBinPackV);
+
+
+/**
+ * Fetches a 64-bit value from the packed arguments.
+ *
+ * @returns false if there are no more arguments.
+ * @param   pbArgs      The packed arguments.
+ * @param   cbArgs      The size of the packed arguments.
+ * @param   poff        The current offset, advanced.
+ * @param   pu64        Where to return the value.
+ */
+DECLINLINE(bool) rtLogBinGetU64(uint8_t const *pbArgs, size_t cbArgs, size_t *poff, uint64_t *pu64)
+{
+    if (*poff > cbArgs || cbArgs - *poff < sizeof(uint64_t))
+        return false;
+    memcpy(pu64, &pbArgs[*poff], sizeof(*pu64));
+    *poff += sizeof(uint64_t);
+    return true;
+}
+
+
+/**
+ * Appends a decimal number to a format specifier being assembled.
+ *
+ * @returns The new end of the specifier.
+ * @param   pszDst      Where to append.
+ * @param   uValue      The number.
+ */
+static char *rtLogBinSpecPutNum(char *pszDst, uint32_t uValue)
+{
+    return pszDst + RTStrFormatNumber(pszDst, uValue, 10, -1, -1, 0);
+}
+
+
+RTDECL(size_t) RTLogBinFormat(PFNRTSTROUTPUT pfnOutput, void *pvArg, const char *pszFormat, const void *pvArgs, size_t cbArgs)
+{
+    uint8_t const  *pbArgs = (uint8_t const *)pvArgs;
+    size_t          offArg = 0;
+    size_t          cch    = 0;
+    const char     *psz    = pszFormat;
+
+    for (;;)
+    {
+        RTLOGBINSPEC    Spec;
+        char            szSpec[80];
+        char           *pszDst;
+        uint64_t        u64;
+        const char     *pszPct = strchr(psz, '%');
+
+        if (!pszPct)
+        {
+            if (*psz)
+                cch += pfnOutput(pvArg, psz, strlen(psz));
+            break;
+        }
+        if (pszPct != psz)
+            cch += pfnOutput(pvArg, psz, pszPct - psz);
+        if (pszPct[1] == '%')
+        {
+            cch += pfnOutput(pvArg, "%", 1);
+            psz = pszPct + 2;
+            continue;
+        }
+
+        /*
+         * Re-assemble the specifier with the '*' arguments inlined and let
+         * RTStrFormat do the actual formatting.  Integers are passed as
+         * 64-bit values since the size of 'l' and friends is a property of
+         * the logging host and not necessarily of this one.
+         */
+        if (   !rtLogBinParseSpec(pszPct, &Spec)
+            || Spec.enmKind == RTLOGBINARGKIND_UNSUPPORTED)
+            break;
+
+        pszDst = szSpec;
+        memcpy(pszDst, pszPct, Spec.offFlagsEnd);
+        pszDst += Spec.offFlagsEnd;
+        if (Spec.enmKind == RTLOGBINARGKIND_PTR)
+            *pszDst++ = '0';
+
+        if (Spec.fWidthArg)
+        {
+            if (!rtLogBinGetU64(pbArgs, cbArgs, &offArg, &u64))
+                break;
+            int32_t cchWidth = (int32_t)u64;
+            if (cchWidth < 0)
+            {
+                *pszDst++ = '-';
+                cchWidth = -cchWidth;
+            }
+            pszDst = rtLogBinSpecPutNum(pszDst, (uint32_t)cchWidth);
+        }
+        else if (Spec.offWidthEnd > Spec.offFlagsEnd)
+        {
+            memcpy(pszDst, &pszPct[Spec.offFlagsEnd], Spec.offWidthEnd - Spec.offFlagsEnd);
+            pszDst += Spec.offWidthEnd - Spec.offFlagsEnd;
+        }
+        else if (Spec.enmKind == RTLOGBINARGKIND_PTR)
+            pszDst = rtLogBinSpecPutNum(pszDst, sizeof(void *) * 2);
+
+        if (Spec.fPrecisionArg)
+        {
+            if (!rtLogBinGetU64(pbArgs, cbArgs, &offArg, &u64))
+                break;
+            int32_t cchPrecision = (int32_t)u64;
+            *pszDst++ = '.';
+            pszDst = rtLogBinSpecPutNum(pszDst, cchPrecision >= 0 ? (uint32_t)cchPrecision : 0);
+        }
+        else if (Spec.offPrecisionEnd > Spec.offWidthEnd)
+        {
+            memcpy(pszDst, &pszPct[Spec.offWidthEnd], Spec.offPrecisionEnd - Spec.offWidthEnd);
+            pszDst += Spec.offPrecisionEnd - Spec.offWidthEnd;
+        }
+
+        switch (Spec.enmKind)
+        {
+            case RTLOGBINARGKIND_INT:
+                *pszDst++ = 'l';
+                *pszDst++ = 'l';
+                *pszDst++ = pszPct[Spec.offEnd - 1];
+                break;
+            case RTLOGBINARGKIND_PTR:
+                *pszDst++ = 'l';
+                *pszDst++ = 'l';
+                *pszDst++ = 'x';
+                break;
+            default:
+                memcpy(pszDst, &pszPct[Spec.offSizeEnd], Spec.offEnd - Spec.offSizeEnd);
+                pszDst += Spec.offEnd - Spec.offSizeEnd;
+                break;
+        }
+        *pszDst = '\0';
+
+        /*
+         * Fetch the argument and format it.
+         */
+        if (Spec.enmKind == RTLOGBINARGKIND_STR)
+        {
+            uint32_t cchStr;
+            if (   offArg > cbArgs
+                || cbArgs - offArg < sizeof(uint32_t))
+                break;
+            memcpy(&cchStr, &pbArgs[offArg], sizeof(cchStr));
+            size_t const cbEntry = RT_ALIGN_Z(sizeof(uint32_t) + (size_t)cchStr + 1, RTLOGBIN_ARG_ALIGN);
+            if (   cbArgs - offArg < cbEntry
+                || pbArgs[offArg + sizeof(uint32_t) + cchStr] != '\0')
+                break;
+            cch += RTStrFormat(pfnOutput, pvArg, NULL, NULL, szSpec, (const char *)&pbArgs[offArg + sizeof(uint32_t)]);
+            offArg += cbEntry;
+        }
+        else
+        {
+            if (!rtLogBinGetU64(pbArgs, cbArgs, &offArg, &u64))
+                break;
+            switch (Spec.enmKind)
+            {
+                case RTLOGBINARGKIND_INT:
+                case RTLOGBINARGKIND_PTR:
+                    cch += RTStrFormat(pfnOutput, pvArg, NULL, NULL, szSpec, u64);
+                    break;
+                case RTLOGBINARGKIND_CHAR:
+                    cch += RTStrFormat(pfnOutput, pvArg, NULL, NULL, szSpec, (int)(uint8_t)u64);
+                    break;
+                case RTLOGBINARGKIND_RT_INT:
+                    if (Spec.cbArg == sizeof(uint64_t))
+                        cch += RTStrFormat(pfnOutput, pvArg, NULL, NULL, szSpec, u64);
+                    else
+                        cch += RTStrFormat(pfnOutput, pvArg, NULL, NULL, szSpec, (uint32_t)u64);
+                    break;
+                default:
+                    AssertFailed();
+                    break;
+            }
+        }
+
+        psz = pszPct + Spec.offEnd;
+    }
+
+    /*
+     * Whatever couldn't be formatted (unsupported specifier, missing
+     * arguments) is written out as-is so the reader can tell.
+     */
+    if (*psz && strchr(psz, '%'))
+    {
+        const char *pszRest = strchr(psz, '%');
+        cch += pfnOutput(pvArg, RT_STR_TUPLE("<?>"));
+        cch += pfnOutput(pvArg, pszRest, strlen(pszRest));
+    }
+
+    pfnOutput(pvArg, NULL, 0);
+    return cch;
+}
+RT_EXPORT_SYMBOL(RTLogBinFormat);
+
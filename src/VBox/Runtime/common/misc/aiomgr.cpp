@@ -51,6 +51,11 @@
 /** Pointer to an internal async I/O file instance. */
 typedef struct RTAIOMGRFILEINT *PRTAIOMGRFILEINT;
 
+/** Size of a single buffer in the bounce buffer pool of a manager. */
+#define RTAIOMGR_BOUNCE_BUF_SIZE  _64K
+/** Number of buffers in the bounce buffer pool of a manager. */
+#define RTAIOMGR_BOUNCE_BUF_COUNT 32
+
 /**
  * Blocking event types.
  */
@@ -91,6 +96,11 @@ typedef struct RTAIOMGRINT
     uint32_t                      cReqsActiveMax;
     /** Memory cache for requests. */
     RTMEMCACHE                    hMemCacheReqs;
+    /** Preallocated page aligned bounce buffers, NULL if the allocation failed.
+     * Only accessed by the async I/O thread which also allocates it. */
+    uint8_t                      *pbBouncePool;
+    /** Bitmap of free buffers in the bounce buffer pool (set bit means free). */
+    uint32_t                      bmBounceFree[RTAIOMGR_BOUNCE_BUF_COUNT / 32];
     /** Critical section protecting the blocking event handling. */
     RTCRITSECT                    CritSectBlockingEvent;
     /** Event semaphore for blocking external events.
@@ -199,12 +209,17 @@ typedef struct RTAIOMGRREQ
     void             *pvBounceBuffer;
     /** Start offset in the bounce buffer to copy from. */
     uint32_t          offBounceBuffer;
+    /** Next request merged into this one. Only the head of the chain owns the
+     * native request and the bounce buffer. */
+    struct RTAIOMGRREQ *pMergedNext;
 } RTAIOMGRREQ;
 /** Pointer to a I/O manager request. */
 typedef RTAIOMGRREQ *PRTAIOMGRREQ;
 
 /** Flag whether the request was prepared already. */
-#define RTAIOMGRREQ_FLAGS_PREPARED RT_BIT_32(0)
+#define RTAIOMGRREQ_FLAGS_PREPARED    RT_BIT_32(0)
+/** Flag whether the bounce buffer was taken from the pool of the manager. */
+#define RTAIOMGRREQ_FLAGS_BOUNCE_POOL RT_BIT_32(1)
 
 /*******************************************************************************
 *   Defined Constants And Macros                                               *
@@ -253,6 +268,65 @@ static bool rtAioMgrFileRemove(PRTAIOMGRFILEINT pFile)
     return true;
 }
 
+/**
+ * Allocates the bounce buffer pool of the given async I/O manager.
+ *
+ * This is called on the async I/O thread so the pages are touched first, and
+ * therefore placed, on the NUMA node the thread is running on. Requests fall
+ * back to allocating their bounce buffers if this fails.
+ *
+ * @returns nothing.
+ * @param   pThis             The async I/O manager instance.
+ */
+static void rtAioMgrBouncePoolInit(PRTAIOMGRINT pThis)
+{
+    size_t cbPool = RTAIOMGR_BOUNCE_BUF_COUNT * RTAIOMGR_BOUNCE_BUF_SIZE;
+
+    pThis->pbBouncePool = (uint8_t *)RTMemPageAlloc(cbPool);
+    if (pThis->pbBouncePool)
+    {
+        memset(pThis->pbBouncePool, 0, cbPool);
+        ASMBitSetRange(&pThis->bmBounceFree[0], 0, RTAIOMGR_BOUNCE_BUF_COUNT);
+    }
+}
+
+/**
+ * Takes a free buffer from the bounce buffer pool.
+ *
+ * @returns Pointer to the buffer of RTAIOMGR_BOUNCE_BUF_SIZE bytes or NULL if
+ *          the pool is exhausted.
+ * @param   pThis             The async I/O manager instance.
+ */
+static void *rtAioMgrBouncePoolAlloc(PRTAIOMGRINT pThis)
+{
+    if (!pThis->pbBouncePool)
+        return NULL;
+
+    int iBuf = ASMBitFirstSet(&pThis->bmBounceFree[0], RTAIOMGR_BOUNCE_BUF_COUNT);
+    if (iBuf < 0)
+        return NULL;
+
+    ASMBitClear(&pThis->bmBounceFree[0], iBuf);
+    return pThis->pbBouncePool + (size_t)iBuf * RTAIOMGR_BOUNCE_BUF_SIZE;
+}
+
+/**
+ * Returns a buffer to the bounce buffer pool.
+ *
+ * @returns nothing.
+ * @param   pThis             The async I/O manager instance.
+ * @param   pvBuf             The buffer to return.
+ */
+static void rtAioMgrBouncePoolFree(PRTAIOMGRINT pThis, void *pvBuf)
+{
+    size_t offBuf = (uint8_t *)pvBuf - pThis->pbBouncePool;
+
+    Assert(!(offBuf % RTAIOMGR_BOUNCE_BUF_SIZE));
+    Assert(offBuf / RTAIOMGR_BOUNCE_BUF_SIZE < RTAIOMGR_BOUNCE_BUF_COUNT);
+    Assert(!ASMBitTest(&pThis->bmBounceFree[0], (int32_t)(offBuf / RTAIOMGR_BOUNCE_BUF_SIZE)));
+    ASMBitSet(&pThis->bmBounceFree[0], (int32_t)(offBuf / RTAIOMGR_BOUNCE_BUF_SIZE));
+}
+
 /**
  * Allocate a new I/O request.
  *
@@ -276,15 +350,41 @@ static void rtAioMgrReqFree(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq)
     if (pReq->cbBounceBuffer)
     {
         AssertPtr(pReq->pvBounceBuffer);
-        RTMemPageFree(pReq->pvBounceBuffer, pReq->cbBounceBuffer);
+        if (pReq->fFlags & RTAIOMGRREQ_FLAGS_BOUNCE_POOL)
+            rtAioMgrBouncePoolFree(pThis, pReq->pvBounceBuffer);
+        else
+            RTMemPageFree(pReq->pvBounceBuffer, pReq->cbBounceBuffer);
         pReq->pvBounceBuffer = NULL;
         pReq->cbBounceBuffer = 0;
     }
-    pReq->fFlags = 0;
+    pReq->fFlags      = 0;
+    pReq->pMergedNext = NULL;
     RTAioMgrFileRelease(pReq->pFile);
     RTMemCacheFree(pThis->hMemCacheReqs, pReq);
 }
 
+/**
+ * Calls the completion callback for the given request and all requests merged
+ * into it and frees them.
+ *
+ * @returns nothing.
+ * @param   pThis             The async I/O manager instance.
+ * @param   pReq              The request to complete.
+ * @param   rcReq             The status code to pass to the callbacks.
+ */
+static void rtAioMgrReqNotify(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq, int rcReq)
+{
+    while (pReq)
+    {
+        PRTAIOMGRFILEINT pFile = pReq->pFile;
+        PRTAIOMGRREQ pReqNext = pReq->pMergedNext;
+
+        pFile->pfnReqCompleted(pFile, rcReq, pReq->pvUser);
+        rtAioMgrReqFree(pThis, pReq);
+        pReq = pReqNext;
+    }
+}
+
 static void rtAioMgrReqCompleteRc(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq,
                                   int rcReq, size_t cbTransfered)
 {
@@ -302,10 +402,7 @@ static void rtAioMgrReqCompleteRc(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq,
      * The endpoint will be migrated to a failsafe manager in case a request fails.
      */
     if (RT_FAILURE(rcReq))
-    {
-        pFile->pfnReqCompleted(pFile, rcReq, pReq->pvUser);
-        rtAioMgrReqFree(pThis, pReq);
-    }
+        rtAioMgrReqNotify(pThis, pReq, rcReq);
     else
     {
         /*
@@ -383,14 +480,17 @@ static void rtAioMgrReqCompleteRc(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq,
             if (RT_SUCCESS(rc) && pReq->cbBounceBuffer)
             {
                 if (pReq->enmType == RTAIOMGRREQTYPE_READ)
-                    memcpy(pReq->DataSeg.pvSeg,
-                           ((uint8_t *)pReq->pvBounceBuffer) + pReq->offBounceBuffer,
-                           pReq->DataSeg.cbSeg);
+                {
+                    /* Scatter the data to all merged requests. */
+                    for (PRTAIOMGRREQ pReqCur = pReq; pReqCur; pReqCur = pReqCur->pMergedNext)
+                        memcpy(pReqCur->DataSeg.pvSeg,
+                               ((uint8_t *)pReq->pvBounceBuffer) + pReqCur->offBounceBuffer,
+                               pReqCur->DataSeg.cbSeg);
+                }
             }
 
             /* Call completion callback */
-            pFile->pfnReqCompleted(pFile, rcReq, pReq->pvUser);
-            rtAioMgrReqFree(pThis, pReq);
+            rtAioMgrReqNotify(pThis, pReq, rcReq);
         }
     } /* request completed successfully */
 }
@@ -482,6 +582,111 @@ static void rtAioMgrFileAddReqsToWaitingList(PRTAIOMGRFILEINT pFile, PRTAIOMGRRE
     }
 }
 
+/**
+ * Tries to merge the given request with the directly following new requests
+ * into a single transfer through a buffer from the bounce buffer pool.
+ *
+ * Only requests of the same direction continuing exactly where the previous one
+ * ended are merged. Writes are only merged if the combined range is sector
+ * aligned so no read-modify-write cycle is required.
+ *
+ * @returns true if at least one request was merged, false otherwise.
+ * @param   pThis       The async I/O manager instance data.
+ * @param   pReq        The request to merge the following requests into.
+ * @param   ppReqsNew   Where to take the following requests from, updated with
+ *                      the remaining ones on success.
+ */
+static bool rtAioMgrReqsMerge(PRTAIOMGRINT pThis, PRTAIOMGRREQ pReq, PRTAIOMGRREQ *ppReqsNew)
+{
+    RTFOFF       offStart   = pReq->off & ~(RTFOFF)(512-1);
+    RTFOFF       offEnd     = pReq->off + pReq->DataSeg.cbSeg;
+    RTFOFF       offEndLast = offEnd;
+    PRTAIOMGRREQ pReqLast   = NULL;
+    PRTAIOMGRREQ pReqIt     = *ppReqsNew;
+
+    if (   (   pReq->enmType != RTAIOMGRREQTYPE_READ
+            && pReq->enmType != RTAIOMGRREQTYPE_WRITE)
+        || (   pReq->enmType == RTAIOMGRREQTYPE_WRITE
+            && offStart != pReq->off))
+        return false;
+
+    while (   pReqIt
+           && pReqIt->enmType == pReq->enmType
+           && pReqIt->off == offEnd
+           && RT_ALIGN_64(offEnd + pReqIt->DataSeg.cbSeg, 512) - offStart <= RTAIOMGR_BOUNCE_BUF_SIZE)
+    {
+        offEnd += pReqIt->DataSeg.cbSeg;
+        if (   pReq->enmType == RTAIOMGRREQTYPE_READ
+            || !(offEnd & (512-1)))
+        {
+            pReqLast   = pReqIt;
+            offEndLast = offEnd;
+        }
+        pReqIt = (PRTAIOMGRREQ)pReqIt->WorkItem.pNext;
+    }
+
+    if (!pReqLast)
+        return false;
+
+    void *pvBuf = rtAioMgrBouncePoolAlloc(pThis);
+    if (!pvBuf)
+        return false;
+
+    /* Move the requests from the new list over to the merged chain. */
+    pReqIt     = *ppReqsNew;
+    *ppReqsNew = (PRTAIOMGRREQ)pReqLast->WorkItem.pNext;
+    pReq->pMergedNext = pReqIt;
+    for (;;)
+    {
+        PRTAIOMGRREQ pReqNext = (PRTAIOMGRREQ)pReqIt->WorkItem.pNext;
+
+        pReqIt->WorkItem.pNext = NULL;
+        if (pReqIt == pReqLast)
+            break;
+        pReqIt->pMergedNext = pReqNext;
+        pReqIt = pReqNext;
+    }
+
+    pReq->fFlags        |= RTAIOMGRREQ_FLAGS_BOUNCE_POOL;
+    pReq->pvBounceBuffer = pvBuf;
+    pReq->cbBounceBuffer = RT_ALIGN_Z((size_t)(offEndLast - offStart), 512);
+    return true;
+}
+
+/**
+ * Prepares the native I/O request for a chain of merged requests.
+ *
+ * @returns IPRT status code.
+ * @param   pFile    The file instance data.
+ * @param   pReq     The head of the merged chain, the bounce buffer is
+ *                   already assigned.
+ */
+static int rtAioMgrReqPrepareMerged(PRTAIOMGRFILEINT pFile, PRTAIOMGRREQ pReq)
+{
+    int    rc;
+    RTFOFF offStart = pReq->off & ~(RTFOFF)(512-1);
+
+    Assert(pReq->fFlags & RTAIOMGRREQ_FLAGS_BOUNCE_POOL);
+    for (PRTAIOMGRREQ pReqCur = pReq; pReqCur; pReqCur = pReqCur->pMergedNext)
+    {
+        pReqCur->offBounceBuffer = (uint32_t)(pReqCur->off - offStart);
+        if (pReq->enmType == RTAIOMGRREQTYPE_WRITE)
+            memcpy((uint8_t *)pReq->pvBounceBuffer + pReqCur->offBounceBuffer,
+                   pReqCur->DataSeg.pvSeg, pReqCur->DataSeg.cbSeg);
+    }
+
+    if (pReq->enmType == RTAIOMGRREQTYPE_WRITE)
+        rc = RTFileAioReqPrepareWrite(pReq->hReqIo, pFile->hFile, offStart,
+                                      pReq->pvBounceBuffer, pReq->cbBounceBuffer, pReq);
+    else
+        rc = RTFileAioReqPrepareRead(pReq->hReqIo, pFile->hFile, offStart,
+                                     pReq->pvBounceBuffer, pReq->cbBounceBuffer, pReq);
+    AssertRC(rc);
+    pReq->fFlags |= RTAIOMGRREQ_FLAGS_PREPARED;
+
+    return rc;
+}
+
 /**
  * Prepare the native I/o request ensuring that all alignment prerequisites of
  * the host are met.
@@ -492,6 +697,9 @@ static void rtAioMgrFileAddReqsToWaitingList(PRTAIOMGRFILEINT pFile, PRTAIOMGRRE
  */
 static int rtAioMgrReqPrepareNonBuffered(PRTAIOMGRFILEINT pFile, PRTAIOMGRREQ pReq)
 {
+    if (pReq->pMergedNext)
+        return rtAioMgrReqPrepareMerged(pFile, pReq);
+
     int   rc    = VINF_SUCCESS;
     RTFOFF offStart = pReq->off & ~(RTFOFF)(512-1);
     size_t cbToTransfer = RT_ALIGN_Z(pReq->DataSeg.cbSeg + (pReq->off - offStart), 512);
@@ -514,12 +722,20 @@ static int rtAioMgrReqPrepareNonBuffered(PRTAIOMGRFILEINT pFile, PRTAIOMGRREQ pR
                   pReq->off, offStart));
         pReq->offBounceBuffer = pReq->off - offStart;
 
-        /** @todo: I think we need something like a RTMemAllocAligned method here.
+        /*
+         * Take the buffer from the pool if possible.
+         *
+         * @todo: I think we need something like a RTMemAllocAligned method here.
          * Current assumption is that the maximum alignment is 4096byte
          * (GPT disk on Windows)
          * so we can use RTMemPageAlloc here.
          */
-        pReq->pvBounceBuffer = RTMemPageAlloc(cbToTransfer);
+        if (cbToTransfer <= RTAIOMGR_BOUNCE_BUF_SIZE)
+            pReq->pvBounceBuffer = rtAioMgrBouncePoolAlloc(pFile->pAioMgr);
+        if (pReq->pvBounceBuffer)
+            pReq->fFlags |= RTAIOMGRREQ_FLAGS_BOUNCE_POOL;
+        else
+            pReq->pvBounceBuffer = RTMemPageAlloc(cbToTransfer);
         if (RT_LIKELY(pReq->pvBounceBuffer))
         {
             pvBuf = pReq->pvBounceBuffer;
@@ -530,7 +746,7 @@ static int rtAioMgrReqPrepareNonBuffered(PRTAIOMGRFILEINT pFile, PRTAIOMGRREQ pR
                     || RT_UNLIKELY(offStart != pReq->off))
                 {
                     /* We have to fill the buffer first before we can update the data. */
-                    pReq->enmType = RTAIOMGRREQTYPE_WRITE;
+                    pReq->enmType = RTAIOMGRREQTYPE_PREFETCH;
                 }
                 else
                     memcpy(pvBuf, pReq->DataSeg.pvSeg, pReq->DataSeg.cbSeg);
@@ -624,6 +840,10 @@ static int rtAioMgrPrepareNewReqs(PRTAIOMGRINT pThis,
         AssertMsg(!(pCurr->fFlags & RTAIOMGRREQ_FLAGS_PREPARED),
                   ("Request on the new list is already prepared\n"));
 
+        /* Combine adjacent requests into a single transfer to save system calls. */
+        if (pReqsNew)
+            rtAioMgrReqsMerge(pThis, pCurr, &pReqsNew);
+
         rc = rtAioMgrPrepareReq(pCurr, &apReqs[cRequests]);
         if (RT_FAILURE(rc))
             rtAioMgrReqCompleteRc(pThis, pCurr, rc, 0);
@@ -848,6 +1068,8 @@ static DECLCALLBACK(int) rtAioMgrWorker(RTTHREAD hThreadSelf, void *pvUser)
     bool fRunning = true;
     int rc = VINF_SUCCESS;
 
+    rtAioMgrBouncePoolInit(pThis);
+
     do
     {
         uint32_t cReqsCompleted = 0;
@@ -1000,6 +1222,10 @@ static void rtAioMgrDestroy(PRTAIOMGRINT pThis)
     rc = RTMemCacheDestroy(pThis->hMemCacheReqs);
     AssertRC(rc);
 
+    if (pThis->pbBouncePool)
+        RTMemPageFree(pThis->pbBouncePool, RTAIOMGR_BOUNCE_BUF_COUNT * RTAIOMGR_BOUNCE_BUF_SIZE);
+
+    pThis->pbBouncePool  = NULL;
     pThis->hThread       = NIL_RTTHREAD;
     pThis->hAioCtx       = NIL_RTFILEAIOCTX;
     pThis->hMemCacheReqs = NIL_RTMEMCACHE;
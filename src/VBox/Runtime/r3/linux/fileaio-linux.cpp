@@ -40,6 +40,15 @@
  * compensated if the user of this API implements caching itself. The next
  * limitation is that data buffers must be aligned at a 512 byte boundary or the
  * request will fail.
+ *
+ * Newer kernels (5.11 and later) provide io_uring which is used instead of the
+ * io_* syscalls when available. Submission and completion happen through two
+ * rings shared with the kernel, so a batch of requests is submitted with a
+ * single syscall and completed requests are reaped without entering the kernel
+ * at all as long as there are some. The ring is detected at runtime and the
+ * implementation falls back to the io_* syscalls if the kernel lacks support or
+ * the IPRT_FILEAIO_NO_IO_URING environment variable is set when the context
+ * is created.
  */
 /** @todo r=bird: What's this about "must be opened with O_DIRECT"? An
  *        explanation would be nice, esp. seeing what Linus is quoted saying
@@ -56,12 +65,24 @@
 #include <iprt/err.h>
 #include <iprt/log.h>
 #include <iprt/thread.h>
+#include <iprt/env.h>
+#include <iprt/once.h>
+#include <iprt/semaphore.h>
+#include <iprt/time.h>
 #include "internal/fileaio.h"
 
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <errno.h>
 
+#ifndef __NR_io_uring_setup
+# define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+# define __NR_io_uring_enter 426
+#endif
+
 #include <iprt/file.h>
 
 
@@ -166,6 +187,206 @@ typedef struct LNXKAIOIOEVENT
 } LNXKAIOIOEVENT, *PLNXKAIOIOEVENT;
 
 
+/**
+ * Supported io_uring opcodes.
+ */
+enum
+{
+    LNXIOURING_OP_FSYNC        = 3,
+    LNXIOURING_OP_ASYNC_CANCEL = 14,
+    LNXIOURING_OP_READ         = 22,
+    LNXIOURING_OP_WRITE        = 23
+};
+
+/** User data of the cancel requests, their completions are dropped. */
+#define LNXIOURING_USER_CANCEL      UINT64_C(0)
+
+/** io_uring mmap offset of the submission queue ring. */
+#define LNXIOURING_OFF_SQ_RING      UINT64_C(0)
+/** io_uring mmap offset of the submission queue entries. */
+#define LNXIOURING_OFF_SQES         UINT64_C(0x10000000)
+/** Feature: Submission and completion ring share one mapping. */
+#define LNXIOURING_FEAT_SINGLE_MMAP RT_BIT_32(0)
+/** Feature: Completion events are never dropped. */
+#define LNXIOURING_FEAT_NODROP      RT_BIT_32(1)
+/** Feature: io_uring_enter takes the extended argument with a timeout. */
+#define LNXIOURING_FEAT_EXT_ARG     RT_BIT_32(8)
+/** io_uring_enter flag: Wait for completion events. */
+#define LNXIOURING_ENTER_GETEVENTS  RT_BIT_32(0)
+/** io_uring_enter flag: The argument is a LNXIOURINGGETEVENTSARG structure. */
+#define LNXIOURING_ENTER_EXT_ARG    RT_BIT_32(3)
+/** The features required to use io_uring. */
+#define LNXIOURING_FEAT_REQUIRED    (LNXIOURING_FEAT_SINGLE_MMAP | LNXIOURING_FEAT_NODROP | LNXIOURING_FEAT_EXT_ARG)
+
+/**
+ * io_uring submission queue entry.
+ */
+typedef struct LNXIOURINGSQE
+{
+    /** The opcode. */
+    uint8_t   u8OpCode;
+    /** Flags, IOSQE_*. */
+    uint8_t   fFlags;
+    /** Request priority. */
+    uint16_t  u16IoPrio;
+    /** The file descriptor. */
+    int32_t   iFd;
+    /** At which offset to start the transfer. */
+    uint64_t  off;
+    /** The userspace address of the buffer. */
+    uint64_t  u64Addr;
+    /** How many bytes to transfer. */
+    uint32_t  cbTransfer;
+    /** Opcode specific flags. */
+    uint32_t  fOpFlags;
+    /** Opaque user data returned in the completion entry. */
+    uint64_t  u64User;
+    /** Reserved. */
+    uint64_t  au64Reserved[3];
+} LNXIOURINGSQE;
+AssertCompileSize(LNXIOURINGSQE, 64);
+/** Pointer to a io_uring submission queue entry. */
+typedef LNXIOURINGSQE *PLNXIOURINGSQE;
+
+/**
+ * io_uring completion queue entry.
+ */
+typedef struct LNXIOURINGCQE
+{
+    /** The user data of the submission queue entry. */
+    uint64_t  u64User;
+    /** Result, number of bytes transferred or negative errno. */
+    int32_t   rc;
+    /** Flags. */
+    uint32_t  fFlags;
+} LNXIOURINGCQE;
+AssertCompileSize(LNXIOURINGCQE, 16);
+/** Pointer to a io_uring completion queue entry. */
+typedef LNXIOURINGCQE *PLNXIOURINGCQE;
+
+/**
+ * Offsets of the submission queue ring members.
+ */
+typedef struct LNXIOURINGSQOFFSETS
+{
+    uint32_t  u32OffHead;
+    uint32_t  u32OffTail;
+    uint32_t  u32OffRingMask;
+    uint32_t  u32OffRingEntries;
+    uint32_t  u32OffFlags;
+    uint32_t  u32OffDropped;
+    uint32_t  u32OffArray;
+    uint32_t  u32Reserved0;
+    uint64_t  u64Reserved1;
+} LNXIOURINGSQOFFSETS;
+AssertCompileSize(LNXIOURINGSQOFFSETS, 40);
+
+/**
+ * Offsets of the completion queue ring members.
+ */
+typedef struct LNXIOURINGCQOFFSETS
+{
+    uint32_t  u32OffHead;
+    uint32_t  u32OffTail;
+    uint32_t  u32OffRingMask;
+    uint32_t  u32OffRingEntries;
+    uint32_t  u32OffOverflow;
+    uint32_t  u32OffCqes;
+    uint32_t  u32OffFlags;
+    uint32_t  u32Reserved0;
+    uint64_t  u64Reserved1;
+} LNXIOURINGCQOFFSETS;
+AssertCompileSize(LNXIOURINGCQOFFSETS, 40);
+
+/**
+ * io_uring setup parameters.
+ */
+typedef struct LNXIOURINGPARAMS
+{
+    /** Number of submission queue entries. */
+    uint32_t            cSqEntries;
+    /** Number of completion queue entries. */
+    uint32_t            cCqEntries;
+    /** Setup flags. */
+    uint32_t            fFlags;
+    /** CPU of the submission queue polling thread. */
+    uint32_t            u32SqThreadCpu;
+    /** Idle time of the submission queue polling thread. */
+    uint32_t            u32SqThreadIdle;
+    /** Features supported by the kernel, LNXIOURING_FEAT_*. */
+    uint32_t            fFeatures;
+    /** Work queue to share. */
+    uint32_t            u32WqFd;
+    /** Reserved. */
+    uint32_t            au32Reserved[3];
+    /** Submission queue ring offsets. */
+    LNXIOURINGSQOFFSETS SqOffsets;
+    /** Completion queue ring offsets. */
+    LNXIOURINGCQOFFSETS CqOffsets;
+} LNXIOURINGPARAMS;
+AssertCompileSize(LNXIOURINGPARAMS, 120);
+
+/**
+ * Kernel timespec as used by io_uring.
+ */
+typedef struct LNXIOURINGTIMESPEC
+{
+    int64_t   i64Sec;
+    int64_t   i64NanoSec;
+} LNXIOURINGTIMESPEC;
+
+/**
+ * Extended argument of io_uring_enter.
+ */
+typedef struct LNXIOURINGGETEVENTSARG
+{
+    uint64_t  u64SigMask;
+    uint32_t  cbSigMask;
+    uint32_t  u32Padding;
+    uint64_t  u64Ts;
+} LNXIOURINGGETEVENTSARG;
+AssertCompileSize(LNXIOURINGGETEVENTSARG, 24);
+
+/**
+ * io_uring state of a completion context.
+ */
+typedef struct LNXIOURING
+{
+    /** The ring file descriptor. */
+    int                 iFdRing;
+    /** The mapping of the submission and completion queue rings. */
+    void               *pvRings;
+    /** Size of the ring mapping. */
+    size_t              cbRings;
+    /** The mapping of the submission queue entries. */
+    PLNXIOURINGSQE      paSqes;
+    /** Size of the submission queue entry mapping. */
+    size_t              cbSqes;
+    /** Submission queue head, advanced by the kernel. */
+    volatile uint32_t  *pu32SqHead;
+    /** Submission queue tail, advanced by us. */
+    volatile uint32_t  *pu32SqTail;
+    /** Submission queue index array. */
+    volatile uint32_t  *pau32SqArray;
+    /** Submission queue index mask. */
+    uint32_t            fSqMask;
+    /** Number of submission queue entries. */
+    uint32_t            cSqEntries;
+    /** Completion queue head, advanced by us. */
+    volatile uint32_t  *pu32CqHead;
+    /** Completion queue tail, advanced by the kernel. */
+    volatile uint32_t  *pu32CqTail;
+    /** The completion queue entries. */
+    PLNXIOURINGCQE      paCqes;
+    /** Completion queue index mask. */
+    uint32_t            fCqMask;
+    /** Serializes submissions. */
+    RTSEMFASTMUTEX      hMtxSubmit;
+} LNXIOURING;
+/** Pointer to the io_uring state. */
+typedef LNXIOURING *PLNXIOURING;
+
+
 /**
  * Async I/O completion context state.
  */
@@ -187,6 +408,10 @@ typedef struct RTFILEAIOCTXINTERNAL
     uint32_t            fFlags;
     /** Magic value (RTFILEAIOCTX_MAGIC). */
     uint32_t            u32Magic;
+    /** Flag whether the context uses io_uring instead of the io_* syscalls. */
+    bool                fIoUring;
+    /** The io_uring state if fIoUring is set. */
+    LNXIOURING          IoUring;
 } RTFILEAIOCTXINTERNAL;
 /** Pointer to an internal context structure. */
 typedef RTFILEAIOCTXINTERNAL *PRTFILEAIOCTXINTERNAL;
@@ -223,6 +448,15 @@ typedef RTFILEAIOREQINTERNAL *PRTFILEAIOREQINTERNAL;
 #define AIO_MAXIMUM_REQUESTS_PER_CONTEXT 64
 
 
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** Init once structure for the io_uring detection. */
+static RTONCE   g_IoUringOnce = RTONCE_INITIALIZER;
+/** Flag whether the kernel supports io_uring with all required features. */
+static bool     g_fIoUringSupported = false;
+
+
 /**
  * Creates a new async I/O context.
  */
@@ -287,6 +521,138 @@ DECLINLINE(int) rtFileAsyncIoLinuxGetEvents(LNXKAIOCONTEXT AioContext, long cReq
     return rc;
 }
 
+/**
+ * Sets up a new io_uring instance.
+ * @returns File descriptor of the ring or IPRT error code (negative).
+ */
+DECLINLINE(int) rtFileAsyncIoLinuxIoUringSetup(uint32_t cEntries, LNXIOURINGPARAMS *pParams)
+{
+    int rc = syscall(__NR_io_uring_setup, cEntries, pParams);
+    if (RT_UNLIKELY(rc == -1))
+        return RTErrConvertFromErrno(errno);
+
+    return rc;
+}
+
+/**
+ * Submits new requests and/or waits for completions on an io_uring instance.
+ * @returns Number of submitted requests (natural number w/ 0), IPRT error code (negative).
+ */
+DECLINLINE(int) rtFileAsyncIoLinuxIoUringEnter(int iFdRing, uint32_t cToSubmit, uint32_t cMinComplete,
+                                               uint32_t fFlags, LNXIOURINGGETEVENTSARG *pArg)
+{
+    int rc = syscall(__NR_io_uring_enter, iFdRing, cToSubmit, cMinComplete, fFlags,
+                     pArg, pArg ? sizeof(*pArg) : 0);
+    if (RT_UNLIKELY(rc == -1))
+    {
+        /* io_uring reports an expired timeout with ETIME. */
+        if (errno == ETIME)
+            return VERR_TIMEOUT;
+        return RTErrConvertFromErrno(errno);
+    }
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNRTONCE, Checks whether io_uring can be used.}
+ */
+static DECLCALLBACK(int32_t) rtFileAsyncIoLinuxIoUringDetect(void *pvUser)
+{
+    NOREF(pvUser);
+
+    LNXIOURINGPARAMS Params;
+    RT_ZERO(Params);
+    int iFdRing = rtFileAsyncIoLinuxIoUringSetup(1, &Params);
+    if (iFdRing >= 0)
+    {
+        g_fIoUringSupported = (Params.fFeatures & LNXIOURING_FEAT_REQUIRED) == LNXIOURING_FEAT_REQUIRED;
+        close(iFdRing);
+    }
+
+    LogRel(("RTFileAio: io_uring is %s\n", g_fIoUringSupported ? "supported" : "not supported"));
+    return VINF_SUCCESS;
+}
+
+/**
+ * Destroys the io_uring state of a completion context.
+ */
+static void rtFileAsyncIoLinuxIoUringDestroy(PLNXIOURING pIoUring)
+{
+    if (pIoUring->paSqes)
+        munmap(pIoUring->paSqes, pIoUring->cbSqes);
+    if (pIoUring->pvRings)
+        munmap(pIoUring->pvRings, pIoUring->cbRings);
+    if (pIoUring->iFdRing >= 0)
+        close(pIoUring->iFdRing);
+    if (pIoUring->hMtxSubmit != NIL_RTSEMFASTMUTEX)
+        RTSemFastMutexDestroy(pIoUring->hMtxSubmit);
+    pIoUring->iFdRing    = -1;
+    pIoUring->pvRings    = NULL;
+    pIoUring->paSqes     = NULL;
+    pIoUring->hMtxSubmit = NIL_RTSEMFASTMUTEX;
+}
+
+/**
+ * Creates the io_uring state for a completion context.
+ */
+static int rtFileAsyncIoLinuxIoUringCreate(PLNXIOURING pIoUring, uint32_t cEntries)
+{
+    LNXIOURINGPARAMS Params;
+    RT_ZERO(Params);
+
+    pIoUring->iFdRing    = -1;
+    pIoUring->pvRings    = NULL;
+    pIoUring->paSqes     = NULL;
+    pIoUring->hMtxSubmit = NIL_RTSEMFASTMUTEX;
+
+    int rc = RTSemFastMutexCreate(&pIoUring->hMtxSubmit);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    rc = rtFileAsyncIoLinuxIoUringSetup(cEntries, &Params);
+    if (rc >= 0)
+    {
+        pIoUring->iFdRing = rc;
+        rc = VINF_SUCCESS;
+
+        /* The submission and completion queue rings share one mapping. */
+        pIoUring->cbRings = RT_MAX(Params.SqOffsets.u32OffArray + Params.cSqEntries * sizeof(uint32_t),
+                                   Params.CqOffsets.u32OffCqes  + Params.cCqEntries * sizeof(LNXIOURINGCQE));
+        pIoUring->cbSqes  = Params.cSqEntries * sizeof(LNXIOURINGSQE);
+
+        void *pvRings = mmap(NULL, pIoUring->cbRings, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             pIoUring->iFdRing, LNXIOURING_OFF_SQ_RING);
+        if (pvRings != MAP_FAILED)
+        {
+            pIoUring->pvRings = pvRings;
+
+            void *pvSqes = mmap(NULL, pIoUring->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                pIoUring->iFdRing, LNXIOURING_OFF_SQES);
+            if (pvSqes != MAP_FAILED)
+            {
+                uint8_t *pbRings = (uint8_t *)pvRings;
+
+                pIoUring->paSqes       = (PLNXIOURINGSQE)pvSqes;
+                pIoUring->pu32SqHead   = (volatile uint32_t *)(pbRings + Params.SqOffsets.u32OffHead);
+                pIoUring->pu32SqTail   = (volatile uint32_t *)(pbRings + Params.SqOffsets.u32OffTail);
+                pIoUring->pau32SqArray = (volatile uint32_t *)(pbRings + Params.SqOffsets.u32OffArray);
+                pIoUring->fSqMask      = *(uint32_t *)(pbRings + Params.SqOffsets.u32OffRingMask);
+                pIoUring->cSqEntries   = Params.cSqEntries;
+                pIoUring->pu32CqHead   = (volatile uint32_t *)(pbRings + Params.CqOffsets.u32OffHead);
+                pIoUring->pu32CqTail   = (volatile uint32_t *)(pbRings + Params.CqOffsets.u32OffTail);
+                pIoUring->paCqes       = (PLNXIOURINGCQE)(pbRings + Params.CqOffsets.u32OffCqes);
+                pIoUring->fCqMask      = *(uint32_t *)(pbRings + Params.CqOffsets.u32OffRingMask);
+                return VINF_SUCCESS;
+            }
+        }
+        rc = RTErrConvertFromErrno(errno);
+    }
+
+    rtFileAsyncIoLinuxIoUringDestroy(pIoUring);
+    return rc;
+}
+
 RTR3DECL(int) RTFileAioGetLimits(PRTFILEAIOLIMITS pAioLimits)
 {
     int rc = VINF_SUCCESS;
@@ -294,16 +660,20 @@ RTR3DECL(int) RTFileAioGetLimits(PRTFILEAIOLIMITS pAioLimits)
 
     /*
      * Check if the API is implemented by creating a
-     * completion port.
+     * completion port if io_uring is not available.
      */
-    LNXKAIOCONTEXT AioContext = 0;
-    rc = rtFileAsyncIoLinuxCreate(1, &AioContext);
-    if (RT_FAILURE(rc))
-        return rc;
+    RTOnce(&g_IoUringOnce, rtFileAsyncIoLinuxIoUringDetect, NULL);
+    if (!g_fIoUringSupported)
+    {
+        LNXKAIOCONTEXT AioContext = 0;
+        rc = rtFileAsyncIoLinuxCreate(1, &AioContext);
+        if (RT_FAILURE(rc))
+            return rc;
 
-    rc = rtFileAsyncIoLinuxDestroy(AioContext);
-    if (RT_FAILURE(rc))
-        return rc;
+        rc = rtFileAsyncIoLinuxDestroy(AioContext);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
 
     /* Supported - fill in the limits. The alignment is the only restriction. */
     pAioLimits->cReqsOutstandingMax = RTFILEAIO_UNLIMITED_REQS;
@@ -430,12 +800,54 @@ RTDECL(void *) RTFileAioReqGetUser(RTFILEAIOREQ hReq)
 }
 
 
+/**
+ * Asks the kernel to cancel a request submitted to an io_uring.
+ *
+ * io_uring cancels asynchronously, the request always completes through
+ * RTFileAioCtxWait, with VERR_FILE_AIO_CANCELED if the cancellation worked.
+ *
+ * @returns VERR_FILE_AIO_IN_PROGRESS.
+ * @param   pReqInt         The request to cancel.
+ */
+static int rtFileAioReqCancelIoUring(PRTFILEAIOREQINTERNAL pReqInt)
+{
+    PLNXIOURING pIoUring = &pReqInt->pCtxInt->IoUring;
+
+    RTSemFastMutexRequest(pIoUring->hMtxSubmit);
+    uint32_t const uTail = *pIoUring->pu32SqTail;
+    if (uTail - ASMAtomicReadU32(pIoUring->pu32SqHead) < pIoUring->cSqEntries)
+    {
+        uint32_t const idxSqe = uTail & pIoUring->fSqMask;
+        PLNXIOURINGSQE pSqe = &pIoUring->paSqes[idxSqe];
+
+        RT_ZERO(*pSqe);
+        pSqe->u8OpCode = LNXIOURING_OP_ASYNC_CANCEL;
+        pSqe->iFd      = -1;
+        pSqe->u64Addr  = (uintptr_t)pReqInt; /* The user data of the request to cancel. */
+        pSqe->u64User  = LNXIOURING_USER_CANCEL;
+        pIoUring->pau32SqArray[idxSqe] = idxSqe;
+        ASMAtomicWriteU32(pIoUring->pu32SqTail, uTail + 1);
+
+        int rcEnter = rtFileAsyncIoLinuxIoUringEnter(pIoUring->iFdRing, 1, 0, 0, NULL);
+        if (rcEnter != 1)
+            ASMAtomicWriteU32(pIoUring->pu32SqTail, uTail);
+    }
+    /* else: No room for the cancel request, let the request complete normally. */
+    RTSemFastMutexRelease(pIoUring->hMtxSubmit);
+
+    return VERR_FILE_AIO_IN_PROGRESS;
+}
+
+
 RTDECL(int) RTFileAioReqCancel(RTFILEAIOREQ hReq)
 {
     PRTFILEAIOREQINTERNAL pReqInt = hReq;
     RTFILEAIOREQ_VALID_RETURN(pReqInt);
     RTFILEAIOREQ_STATE_RETURN_RC(pReqInt, SUBMITTED, VERR_FILE_AIO_NOT_SUBMITTED);
 
+    if (pReqInt->pCtxInt->fIoUring)
+        return rtFileAioReqCancelIoUring(pReqInt);
+
     LNXKAIOIOEVENT AioEvent;
     int rc = rtFileAsyncIoLinuxCancel(pReqInt->AioContext, &pReqInt->AioCB, &AioEvent);
     if (RT_SUCCESS(rc))
@@ -489,8 +901,19 @@ RTDECL(int) RTFileAioCtxCreate(PRTFILEAIOCTX phAioCtx, uint32_t cAioReqsMax,
     if (RT_UNLIKELY(!pCtxInt))
         return VERR_NO_MEMORY;
 
+    /* Use io_uring if available and not disabled, fall back to the io_* syscalls otherwise. */
+    int rc = VERR_NOT_SUPPORTED;
+    RTOnce(&g_IoUringOnce, rtFileAsyncIoLinuxIoUringDetect, NULL);
+    if (   g_fIoUringSupported
+        && !RTEnvExist("IPRT_FILEAIO_NO_IO_URING"))
+    {
+        rc = rtFileAsyncIoLinuxIoUringCreate(&pCtxInt->IoUring, cAioReqsMax);
+        pCtxInt->fIoUring = RT_SUCCESS(rc);
+    }
+
     /* Init the event handle. */
-    int rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
+    if (!pCtxInt->fIoUring)
+        rc = rtFileAsyncIoLinuxCreate(cAioReqsMax, &pCtxInt->AioContext);
     if (RT_SUCCESS(rc))
     {
         pCtxInt->fWokenUp     = false;
@@ -521,9 +944,14 @@ RTDECL(int) RTFileAioCtxDestroy(RTFILEAIOCTX hAioCtx)
         return VERR_FILE_AIO_BUSY;
 
     /* The native bit first, then mark it as dead and free it. */
-    int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
-    if (RT_FAILURE(rc))
-        return rc;
+    if (pCtxInt->fIoUring)
+        rtFileAsyncIoLinuxIoUringDestroy(&pCtxInt->IoUring);
+    else
+    {
+        int rc = rtFileAsyncIoLinuxDestroy(pCtxInt->AioContext);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
     ASMAtomicUoWriteU32(&pCtxInt->u32Magic, RTFILEAIOCTX_MAGIC_DEAD);
     RTMemFree(pCtxInt);
 
@@ -552,6 +980,118 @@ RTDECL(int) RTFileAioCtxAssociateWithFile(RTFILEAIOCTX hAioCtx, RTFILE hFile)
     return VINF_SUCCESS;
 }
 
+/**
+ * Submits already validated requests to the io_uring of the given context.
+ *
+ * All requests are put into the submission queue and handed to the kernel
+ * with a single syscall.
+ */
+static int rtFileAioCtxSubmitIoUring(PRTFILEAIOCTXINTERNAL pCtxInt, PRTFILEAIOREQ pahReqs, size_t cReqs)
+{
+    PLNXIOURING pIoUring = &pCtxInt->IoUring;
+    int rc = VINF_SUCCESS;
+
+    RTSemFastMutexRequest(pIoUring->hMtxSubmit);
+
+    /*
+     * Don't exceed the maximum number of requests in flight, the completion
+     * queue is sized accordingly. Everything which doesn't fit is reverted.
+     */
+    int32_t const cReqsActive = ASMAtomicReadS32(&pCtxInt->cRequests);
+    size_t const  cReqsFree   = cReqsActive < pCtxInt->cRequestsMax ? (size_t)(pCtxInt->cRequestsMax - cReqsActive) : 0;
+    size_t cReqsSubmit = RT_MIN(cReqs, cReqsFree);
+    if (cReqsSubmit < cReqs)
+    {
+        for (size_t i = cReqsSubmit; i < cReqs; i++)
+        {
+            PRTFILEAIOREQINTERNAL pReqInt = pahReqs[i];
+            pReqInt->pCtxInt = NULL;
+            RTFILEAIOREQ_SET_STATE(pReqInt, PREPARED);
+        }
+        rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+    }
+
+    size_t iReq = 0;
+    while (iReq < cReqsSubmit)
+    {
+        /* Fill the submission queue as far as possible. */
+        uint32_t const uTailOld = *pIoUring->pu32SqTail;
+        uint32_t       uTail    = uTailOld;
+        uint32_t const cSqFree  = pIoUring->cSqEntries - (uTail - ASMAtomicReadU32(pIoUring->pu32SqHead));
+        uint32_t const cBatch   = (uint32_t)RT_MIN(cReqsSubmit - iReq, cSqFree);
+        for (uint32_t i = 0; i < cBatch; i++, uTail++)
+        {
+            PRTFILEAIOREQINTERNAL pReqInt = pahReqs[iReq + i];
+            uint32_t const idxSqe = uTail & pIoUring->fSqMask;
+            PLNXIOURINGSQE pSqe = &pIoUring->paSqes[idxSqe];
+
+            RT_ZERO(*pSqe);
+            switch (pReqInt->AioCB.u16IoOpCode)
+            {
+                case LNXKAIO_IOCB_CMD_READ:
+                    pSqe->u8OpCode = LNXIOURING_OP_READ;
+                    break;
+                case LNXKAIO_IOCB_CMD_WRITE:
+                    pSqe->u8OpCode = LNXIOURING_OP_WRITE;
+                    break;
+                default:
+                    pSqe->u8OpCode = LNXIOURING_OP_FSYNC;
+            }
+            pSqe->iFd        = (int32_t)pReqInt->AioCB.uFileDesc;
+            pSqe->off        = (uint64_t)pReqInt->AioCB.off;
+            pSqe->u64Addr    = (uintptr_t)pReqInt->AioCB.pvBuf;
+            pSqe->cbTransfer = (uint32_t)pReqInt->AioCB.cbTransfer;
+            pSqe->u64User    = (uintptr_t)pReqInt;
+            pIoUring->pau32SqArray[idxSqe] = idxSqe;
+        }
+        ASMAtomicWriteU32(pIoUring->pu32SqTail, uTail);
+
+        /*
+         * The kernel may consume fewer entries than we queued, keep entering
+         * until it takes all of them or makes no progress.
+         */
+        uint32_t cConsumed = 0;
+        int      rcEnter   = VINF_SUCCESS;
+        while (cConsumed < cBatch)
+        {
+            rcEnter = rtFileAsyncIoLinuxIoUringEnter(pIoUring->iFdRing, cBatch - cConsumed, 0, 0, NULL);
+            if (rcEnter <= 0)
+                break;
+            cConsumed += (uint32_t)rcEnter;
+        }
+
+        ASMAtomicAddS32(&pCtxInt->cRequests, cConsumed);
+        iReq += cConsumed;
+
+        if (RT_UNLIKELY(cConsumed < cBatch))
+        {
+            /*
+             * Take the entries the kernel didn't consume back from the ring and
+             * revert every remaining request into the prepared state. Only the
+             * consumed ones count as submitted.
+             */
+            ASMAtomicWriteU32(pIoUring->pu32SqTail, uTailOld + cConsumed);
+            for (size_t i = iReq; i < cReqsSubmit; i++)
+            {
+                PRTFILEAIOREQINTERNAL pReqInt = pahReqs[i];
+                pReqInt->pCtxInt = NULL;
+                RTFILEAIOREQ_SET_STATE(pReqInt, PREPARED);
+            }
+
+            if (   rcEnter >= 0
+                || rcEnter == VERR_TRY_AGAIN
+                || rcEnter == VERR_RESOURCE_BUSY)
+                rc = VERR_FILE_AIO_INSUFFICIENT_RESSOURCES;
+            else
+                rc = rcEnter;
+            break;
+        }
+    }
+
+    RTSemFastMutexRelease(pIoUring->hMtxSubmit);
+    return rc;
+}
+
 RTDECL(int) RTFileAioCtxSubmit(RTFILEAIOCTX hAioCtx, PRTFILEAIOREQ pahReqs, size_t cReqs)
 {
     int rc = VINF_SUCCESS;
@@ -590,6 +1130,9 @@ RTDECL(int) RTFileAioCtxSubmit(RTFILEAIOCTX hAioCtx, PRTFILEAIOREQ pahReqs, size
         RTFILEAIOREQ_SET_STATE(pReqInt, SUBMITTED);
     }
 
+    if (pCtxInt->fIoUring)
+        return rtFileAioCtxSubmitIoUring(pCtxInt, pahReqs, cReqs);
+
     do
     {
         /*
@@ -646,6 +1189,58 @@ RTDECL(int) RTFileAioCtxSubmit(RTFILEAIOCTX hAioCtx, PRTFILEAIOREQ pahReqs, size
 }
 
 
+/**
+ * Reaps completed requests from the io_uring completion queue without
+ * entering the kernel.
+ *
+ * @returns Number of requests reaped.
+ * @param   pIoUring        The io_uring state.
+ * @param   pahReqs         Where to store the completed requests.
+ * @param   cReqs           Maximum number of requests to reap.
+ */
+static uint32_t rtFileAioCtxReapIoUring(PLNXIOURING pIoUring, PRTFILEAIOREQ pahReqs, size_t cReqs)
+{
+    uint32_t       cReaped = 0;
+    uint32_t       uHead   = *pIoUring->pu32CqHead;
+    uint32_t const uTail   = ASMAtomicReadU32(pIoUring->pu32CqTail);
+
+    while (   uHead != uTail
+           && cReaped < cReqs)
+    {
+        PLNXIOURINGCQE pCqe = &pIoUring->paCqes[uHead & pIoUring->fCqMask];
+        if (pCqe->u64User == LNXIOURING_USER_CANCEL)
+        {
+            /* Completion of a cancel request, the canceled request reports the outcome. */
+            uHead++;
+            continue;
+        }
+
+        PRTFILEAIOREQINTERNAL pReqInt = (PRTFILEAIOREQINTERNAL)(uintptr_t)pCqe->u64User;
+        AssertPtr(pReqInt);
+        Assert(pReqInt->u32Magic == RTFILEAIOREQ_MAGIC);
+
+        if (RT_UNLIKELY(pCqe->rc == -ECANCELED))
+            pReqInt->Rc = VERR_FILE_AIO_CANCELED;
+        else if (RT_UNLIKELY(pCqe->rc < 0))
+            pReqInt->Rc = RTErrConvertFromErrno(-pCqe->rc); /* Convert to positive value. */
+        else
+        {
+            pReqInt->Rc = VINF_SUCCESS;
+            pReqInt->cbTransfered = pCqe->rc;
+        }
+
+        /* Mark the request as finished. */
+        RTFILEAIOREQ_SET_STATE(pReqInt, COMPLETED);
+
+        pahReqs[cReaped++] = (RTFILEAIOREQ)pReqInt;
+        uHead++;
+    }
+
+    /* Hand the consumed entries back to the kernel. */
+    ASMAtomicWriteU32(pIoUring->pu32CqHead, uHead);
+    return cReaped;
+}
+
 RTDECL(int) RTFileAioCtxWait(RTFILEAIOCTX hAioCtx, size_t cMinReqs, RTMSINTERVAL cMillies,
                              PRTFILEAIOREQ pahReqs, size_t cReqs, uint32_t *pcReqs)
 {
@@ -695,7 +1290,54 @@ RTDECL(int) RTFileAioCtxWait(RTFILEAIOCTX hAioCtx, size_t cMinReqs, RTMSINTERVAL
      */
     int rc = VINF_SUCCESS;
     int cRequestsCompleted = 0;
-    while (!pCtxInt->fWokenUp)
+    while (!pCtxInt->fWokenUp && pCtxInt->fIoUring)
+    {
+        /*
+         * Take everything already completed, only enter the kernel if we
+         * have to wait for more.
+         */
+        uint32_t const cDone = rtFileAioCtxReapIoUring(&pCtxInt->IoUring, &pahReqs[cRequestsCompleted], cReqs);
+        cRequestsCompleted += cDone;
+        if (cDone >= cMinReqs)
+            break;
+        cMinReqs -= cDone;
+        cReqs    -= cDone;
+
+        LNXIOURINGGETEVENTSARG GetEventsArg;
+        LNXIOURINGTIMESPEC     TimeoutRing;
+        RT_ZERO(GetEventsArg);
+        if (pTimeout)
+        {
+            TimeoutRing.i64Sec     = Timeout.tv_sec;
+            TimeoutRing.i64NanoSec = Timeout.tv_nsec;
+            GetEventsArg.u64Ts = (uintptr_t)&TimeoutRing;
+        }
+
+        ASMAtomicXchgBool(&pCtxInt->fWaiting, true);
+        rc = rtFileAsyncIoLinuxIoUringEnter(pCtxInt->IoUring.iFdRing, 0, (uint32_t)cMinReqs,
+                                            LNXIOURING_ENTER_GETEVENTS | LNXIOURING_ENTER_EXT_ARG,
+                                            &GetEventsArg);
+        ASMAtomicXchgBool(&pCtxInt->fWaiting, false);
+        if (RT_FAILURE(rc))
+        {
+            /* Don't lose requests which completed while we were waiting. */
+            cRequestsCompleted += rtFileAioCtxReapIoUring(&pCtxInt->IoUring, &pahReqs[cRequestsCompleted], cReqs);
+            break;
+        }
+        rc = VINF_SUCCESS;
+
+        if (cMillies != RT_INDEFINITE_WAIT)
+        {
+            uint64_t NanoTS = RTTimeNanoTS();
+            uint64_t cMilliesElapsed = (NanoTS - StartNanoTS) / 1000000;
+            if (cMilliesElapsed >= cMillies)
+                cMilliesElapsed = cMillies;
+            Timeout.tv_sec  = (cMillies - (RTMSINTERVAL)cMilliesElapsed) / 1000;
+            Timeout.tv_nsec = (cMillies - (RTMSINTERVAL)cMilliesElapsed) % 1000 * 1000000;
+        }
+    }
+
+    while (!pCtxInt->fWokenUp && !pCtxInt->fIoUring)
     {
         LNXKAIOIOEVENT  aPortEvents[AIO_MAXIMUM_REQUESTS_PER_CONTEXT];
         int             cRequestsToWait = RT_MIN(cReqs, AIO_MAXIMUM_REQUESTS_PER_CONTEXT);
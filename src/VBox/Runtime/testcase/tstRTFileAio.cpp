@@ -30,11 +30,15 @@
 *******************************************************************************/
 #include <iprt/file.h>
 
+#include <iprt/env.h>
 #include <iprt/err.h>
 #include <iprt/mem.h>
 #include <iprt/param.h>
+#include <iprt/rand.h>
 #include <iprt/string.h>
 #include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -43,6 +47,10 @@
 /** @todo make configurable through cmd line. */
 #define TSTFILEAIO_MAX_REQS_IN_FLIGHT   64
 #define TSTFILEAIO_BUFFER_SIZE          (64*_1K)
+/** Size of the requests issued by the benchmark. */
+#define TSTFILEAIO_BENCH_REQ_SIZE       (4*_1K)
+/** How long each benchmark run lasts in milliseconds. */
+#define TSTFILEAIO_BENCH_RUNTIME_MS     5000
 
 
 /*******************************************************************************
@@ -169,6 +177,95 @@ void tstFileAioTestReadWriteBasic(RTFILE File, bool fWrite, void *pvTestBuf,
     RTTestGuardedFree(g_hTest, paReqs);
 }
 
+/**
+ * Random read benchmark keeping cMaxReqsInFlight requests in flight, reporting
+ * the achieved IOPS and the CPU time spent per request.
+ */
+void tstFileAioTestBenchmark(RTFILE File, const char *pszName, size_t cbTestFile, uint32_t cMaxReqsInFlight)
+{
+    RTFILEAIOREQ *paReqs = (PRTFILEAIOREQ)RTTestGuardedAllocHead(g_hTest, cMaxReqsInFlight * sizeof(RTFILEAIOREQ));
+    RTTESTI_CHECK_RETV(paReqs);
+    RTFILEAIOREQ *paReqsCompleted = (PRTFILEAIOREQ)RTTestGuardedAllocHead(g_hTest, cMaxReqsInFlight * sizeof(RTFILEAIOREQ));
+    RTTESTI_CHECK_RETV(paReqsCompleted);
+    uint8_t *pbBuf;
+    RTTESTI_CHECK_RC_OK_RETV(RTTestGuardedAlloc(g_hTest, cMaxReqsInFlight * TSTFILEAIO_BENCH_REQ_SIZE, PAGE_SIZE,
+                                                true /*fHead*/, (void **)&pbBuf));
+
+    RTFILEAIOCTX hAioContext;
+    RTTESTI_CHECK_RC_RETV(RTFileAioCtxCreate(&hAioContext, cMaxReqsInFlight, 0 /* fFlags */), VINF_SUCCESS);
+    RTTESTI_CHECK_RC_RETV(RTFileAioCtxAssociateWithFile(hAioContext, File), VINF_SUCCESS);
+
+    uint32_t const cBlocks = (uint32_t)(cbTestFile / TSTFILEAIO_BENCH_REQ_SIZE);
+    for (unsigned i = 0; i < cMaxReqsInFlight; i++)
+    {
+        RTTESTI_CHECK_RC(RTFileAioReqCreate(&paReqs[i]), VINF_SUCCESS);
+        RTTESTI_CHECK_RC(RTFileAioReqPrepareRead(paReqs[i], File,
+                                                 (RTFOFF)RTRandU32Ex(0, cBlocks - 1) * TSTFILEAIO_BENCH_REQ_SIZE,
+                                                 pbBuf + i * TSTFILEAIO_BENCH_REQ_SIZE, TSTFILEAIO_BENCH_REQ_SIZE,
+                                                 pbBuf + i * TSTFILEAIO_BENCH_REQ_SIZE),
+                         VINF_SUCCESS);
+    }
+
+    uint64_t cMsKernelStart, cMsUserStart;
+    RTThreadGetExecutionTimeMilli(&cMsKernelStart, &cMsUserStart);
+    uint64_t const NanoTSStart = RTTimeNanoTS();
+    uint64_t       cReqsDone   = 0;
+
+    int rc = RTFileAioCtxSubmit(hAioContext, paReqs, cMaxReqsInFlight);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    while (   RT_SUCCESS(rc)
+           && RTTimeNanoTS() - NanoTSStart < TSTFILEAIO_BENCH_RUNTIME_MS * UINT64_C(1000000))
+    {
+        uint32_t cCompleted = 0;
+        rc = RTFileAioCtxWait(hAioContext, 1, RT_INDEFINITE_WAIT, paReqsCompleted, cMaxReqsInFlight, &cCompleted);
+        RTTESTI_CHECK_RC_BREAK(rc, VINF_SUCCESS);
+
+        /* Resubmit the completed requests at new random offsets. */
+        for (uint32_t i = 0; i < cCompleted; i++)
+        {
+            void *pvBuf = RTFileAioReqGetUser(paReqsCompleted[i]);
+            RTTESTI_CHECK_RC(RTFileAioReqGetRC(paReqsCompleted[i], NULL), VINF_SUCCESS);
+            RTFileAioReqPrepareRead(paReqsCompleted[i], File,
+                                    (RTFOFF)RTRandU32Ex(0, cBlocks - 1) * TSTFILEAIO_BENCH_REQ_SIZE,
+                                    pvBuf, TSTFILEAIO_BENCH_REQ_SIZE, pvBuf);
+        }
+        cReqsDone += cCompleted;
+
+        rc = RTFileAioCtxSubmit(hAioContext, paReqsCompleted, cCompleted);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    }
+
+    uint64_t const cNsElapsed = RTTimeNanoTS() - NanoTSStart;
+    uint64_t cMsKernel, cMsUser;
+    RTThreadGetExecutionTimeMilli(&cMsKernel, &cMsUser);
+
+    /* Drain the requests still in flight. */
+    uint32_t cInFlight = RT_SUCCESS(rc) ? cMaxReqsInFlight : 0;
+    while (cInFlight)
+    {
+        uint32_t cCompleted = 0;
+        rc = RTFileAioCtxWait(hAioContext, 1, RT_INDEFINITE_WAIT, paReqsCompleted, cMaxReqsInFlight, &cCompleted);
+        RTTESTI_CHECK_RC_BREAK(rc, VINF_SUCCESS);
+        cInFlight -= cCompleted;
+    }
+
+    if (cReqsDone)
+    {
+        uint64_t cNsCpu = (cMsKernel - cMsKernelStart + cMsUser - cMsUserStart) * UINT64_C(1000000);
+        RTTestValueF(g_hTest, cReqsDone * UINT64_C(1000000000) / cNsElapsed, RTTESTUNIT_OCCURRENCES_PER_SEC,
+                     "%s IOPS", pszName);
+        RTTestValueF(g_hTest, cNsCpu / cReqsDone, RTTESTUNIT_NS_PER_OCCURRENCE, "%s CPU time per request", pszName);
+    }
+
+    /* cleanup */
+    for (unsigned i = 0; i < cMaxReqsInFlight; i++)
+        RTTESTI_CHECK_RC(RTFileAioReqDestroy(paReqs[i]), VINF_SUCCESS);
+    RTTESTI_CHECK_RC(RTFileAioCtxDestroy(hAioContext), VINF_SUCCESS);
+    RTTestGuardedFree(g_hTest, pbBuf);
+    RTTestGuardedFree(g_hTest, paReqsCompleted);
+    RTTestGuardedFree(g_hTest, paReqs);
+}
+
 int main()
 {
     int rc = RTTestInitAndCreate("tstRTFileAio", &g_hTest);
@@ -216,6 +313,27 @@ int main()
                 }
             }
 
+            /* Random read benchmark, comparing io_uring with the io_* syscalls on Linux. */
+            if (RTTestErrorCount(g_hTest) == 0)
+            {
+                RTTestSub(g_hTest, "Benchmark");
+                RTTESTI_CHECK_RC(rc = RTFileOpen(&hFile, "tstFileAio#1.tst",
+                                                 RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE | RTFILE_O_ASYNC_IO),
+                                 VINF_SUCCESS);
+                if (RT_SUCCESS(rc))
+                {
+#ifdef RT_OS_LINUX
+                    tstFileAioTestBenchmark(hFile, "io_uring", 100*_1M, cReqsMax);
+                    RTEnvSet("IPRT_FILEAIO_NO_IO_URING", "1");
+                    tstFileAioTestBenchmark(hFile, "io_submit", 100*_1M, cReqsMax);
+                    RTEnvUnset("IPRT_FILEAIO_NO_IO_URING");
+#else
+                    tstFileAioTestBenchmark(hFile, "Native", 100*_1M, cReqsMax);
+#endif
+                    RTFileClose(hFile);
+                }
+            }
+
             /* Cleanup */
             RTFileDelete("tstFileAio#1.tst");
         }
@@ -0,0 +1,242 @@
+/* $Id$ */
+/** @file
+ * IPRT Testcase - Deferred format (binary) logging.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/log.h>
+#include <iprt/formats/logbin.h>
+
+#include <iprt/err.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/process.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+
+
+/**
+ * Output buffer for tstOutput.
+ */
+typedef struct TSTOUTPUT
+{
+    char    szBuf[4096];
+    size_t  off;
+} TSTOUTPUT;
+
+
+/** @callback_method_impl{FNRTSTROUTPUT} */
+static DECLCALLBACK(size_t) tstOutput(void *pvArg, const char *pachChars, size_t cbChars)
+{
+    TSTOUTPUT *pOut = (TSTOUTPUT *)pvArg;
+    if (cbChars)
+    {
+        size_t cbCopy = RT_MIN(cbChars, sizeof(pOut->szBuf) - 1 - pOut->off);
+        memcpy(&pOut->szBuf[pOut->off], pachChars, cbCopy);
+        pOut->off += cbCopy;
+    }
+    pOut->szBuf[pOut->off] = '\0';
+    return cbChars;
+}
+
+
+/**
+ * Packs the arguments, formats them again and compares with RTStrPrintfV.
+ */
+static void tstRoundTrip(unsigned iLine, const char *pszFormat, ...)
+{
+    char    szExpect[4096];
+    va_list va;
+    va_start(va, pszFormat);
+    RTStrPrintfV(szExpect, sizeof(szExpect), pszFormat, va);
+    va_end(va);
+
+    uint64_t au64Packed[_4K / sizeof(uint64_t)];
+    size_t   cbPacked = 0;
+    va_start(va, pszFormat);
+    int rc = RTLogBinPackV(au64Packed, sizeof(au64Packed), &cbPacked, pszFormat, va);
+    va_end(va);
+    if (RT_FAILURE(rc))
+    {
+        RTTestIFailed("at line %u: RTLogBinPackV(,,,\"%s\",) -> %Rrc\n", iLine, pszFormat, rc);
+        return;
+    }
+    if (cbPacked & (RTLOGBIN_ARG_ALIGN - 1))
+        RTTestIFailed("at line %u: cbPacked=%#zx is not aligned\n", iLine, cbPacked);
+
+    TSTOUTPUT Out;
+    Out.off = 0;
+    Out.szBuf[0] = '\0';
+    size_t cch = RTLogBinFormat(tstOutput, &Out, pszFormat, au64Packed, cbPacked);
+    if (strcmp(Out.szBuf, szExpect))
+        RTTestIFailed("at line %u: format '%s'\n"
+                      "    output: '%s'\n"
+                      "  expected: '%s'\n",
+                      iLine, pszFormat, Out.szBuf, szExpect);
+    else if (cch != strlen(szExpect))
+        RTTestIFailed("at line %u: returned %zu, expected %zu\n", iLine, cch, strlen(szExpect));
+}
+
+
+/**
+ * Checks the RTLogBinPackV status code.
+ */
+static void tstPackStatus(unsigned iLine, int rcExpect, size_t cbBuf, const char *pszFormat, ...)
+{
+    uint64_t au64Packed[_4K / sizeof(uint64_t)];
+    size_t   cbPacked = 0;
+    va_list  va;
+    va_start(va, pszFormat);
+    int rc = RTLogBinPackV(au64Packed, RT_MIN(cbBuf, sizeof(au64Packed)), &cbPacked, pszFormat, va);
+    va_end(va);
+    if (rc != rcExpect)
+        RTTestIFailed("at line %u: RTLogBinPackV(,%zu,,\"%s\",) -> %Rrc, expected %Rrc\n", iLine, cbBuf, pszFormat, rc, rcExpect);
+}
+
+
+static void tstPackFormat(void)
+{
+    RTTestISub("Pack and format");
+    tstRoundTrip(__LINE__, "no arguments\n");
+    tstRoundTrip(__LINE__, "%%d: %d %i %u %x %X %o\n", -42, 42, 42U, 0xdead, 0xBEEF, 8);
+    tstRoundTrip(__LINE__, "%5d|%-5d|%05d|%+d|% d|%#x|%#o\n", 1, 2, 3, 4, 5, 0x6, 7);
+    tstRoundTrip(__LINE__, "%*d|%-*d|%.*d|%*.*x\n", 6, 1, 6, 2, 4, 3, 8, 6, 0x4);
+    tstRoundTrip(__LINE__, "%hhd %hd %ld %lld %zu %jd\n", (signed char)-1, (short)-2, -3L, -4LL, (size_t)5, (intmax_t)-6);
+    tstRoundTrip(__LINE__, "%llx %RX64 %RI64 %RU64\n", UINT64_C(0xfedcba9876543210), UINT64_C(0x1234567890abcdef),
+                 INT64_MIN, UINT64_MAX);
+    tstRoundTrip(__LINE__, "%RX8 %RX16 %RX32 %RI8 %RI16 %RI32\n", (uint8_t)0xab, (uint16_t)0xabcd, UINT32_C(0xabcdef01),
+                 (int8_t)-8, (int16_t)-16, (int32_t)-32);
+    tstRoundTrip(__LINE__, "%c%c%c\n", 'a', 'b', 'c');
+    tstRoundTrip(__LINE__, "%s, %10s|%-10s|%.3s|%s\n", "string", "right", "left", "truncated", "");
+    tstRoundTrip(__LINE__, "%s\n", (const char *)NULL);
+    tstRoundTrip(__LINE__, "%p %p\n", (void *)tstRoundTrip, (void *)NULL);
+    tstRoundTrip(__LINE__, "%RTbool %RTbool %RTproc %RTnthrd\n", true, false, (RTPROCESS)1234, (RTNATIVETHREAD)0x5678);
+    tstRoundTrip(__LINE__, "%RGp %RHp %RGv %RCv\n", (RTGCPHYS)0x123000, (RTHCPHYS)0x456000, (RTGCPTR)0x789000, (void *)0xabc);
+    tstRoundTrip(__LINE__, "%Rrc %Rrc %Rrc\n", VINF_SUCCESS, VERR_NOT_SUPPORTED, 12345);
+
+    /* Strings up to RTLOGBIN_MAX_STR are stored completely, a precision can
+       limit longer ones. */
+    static char s_szLong[RTLOGBIN_MAX_STR + 2];
+    memset(s_szLong, 'x', RTLOGBIN_MAX_STR);
+    tstRoundTrip(__LINE__, "%s\n", s_szLong);
+    s_szLong[RTLOGBIN_MAX_STR] = 'y';
+    tstRoundTrip(__LINE__, "%.*s\n", RTLOGBIN_MAX_STR, s_szLong);
+
+    RTTestISub("Unsupported and overflow");
+    uint8_t abUuid[16] = { 0 };
+    tstPackStatus(__LINE__, VERR_NOT_SUPPORTED, _4K, "%.*Rhxs", sizeof(abUuid), abUuid);
+    tstPackStatus(__LINE__, VERR_NOT_SUPPORTED, _4K, "%ls", L"wide");
+    tstPackStatus(__LINE__, VERR_NOT_SUPPORTED, _4K, "%R[foo]", NULL);
+    tstPackStatus(__LINE__, VERR_BUFFER_OVERFLOW, 16, "%d %d %d", 1, 2, 3);
+    tstPackStatus(__LINE__, VERR_BUFFER_OVERFLOW, 16, "%s", "more than eight bytes");
+    tstPackStatus(__LINE__, VERR_BUFFER_OVERFLOW, _4K, "%s", s_szLong); /* not truncated */
+}
+
+
+static void tstAsyncLogger(void)
+{
+    RTTestISub("Asynchronous logger");
+
+    char szTmpDir[RTPATH_MAX];
+    RTTESTI_CHECK_RC_RETV(RTPathTemp(szTmpDir, sizeof(szTmpDir)), VINF_SUCCESS);
+    char szLog[RTPATH_MAX];
+    RTStrPrintf(szLog, sizeof(szLog), "%s/tstRTLogBin-%u.log", szTmpDir, RTProcSelf());
+    char szBin[RTPATH_MAX];
+    RTStrPrintf(szBin, sizeof(szBin), "%s.bin", szLog);
+
+    static const char * const s_apszGroups[] = { "DEFAULT", "TEST" };
+    PRTLOGGER pLogger;
+    int rc = RTLogCreate(&pLogger, RTLOGFLAGS_ASYNC, "all", NULL, RT_ELEMENTS(s_apszGroups), s_apszGroups,
+                         RTLOGDEST_FILE | RTLOGDEST_BINFILE, "%s", szLog);
+    RTTESTI_CHECK_RC_RETV(rc, VINF_SUCCESS);
+    for (unsigned i = 0; i < 1000; i++)
+        RTLogLoggerEx(pLogger, RTLOGGRPFLAGS_ENABLED, 1, "line %u %s %#RX64\n", i, "text", (uint64_t)i * 3);
+    RTLogLoggerEx(pLogger, RTLOGGRPFLAGS_ENABLED, 1, "last line %.*Rhxs\n", 2, "\x12\x34");
+    RTTESTI_CHECK_RC(RTLogDestroy(pLogger), VINF_SUCCESS);
+
+    /* The text log must have all the lines in order. */
+    void  *pvFile;
+    size_t cbFile;
+    rc = RTFileReadAll(szLog, &pvFile, &cbFile);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        char *pszText = (char *)RTMemAllocZ(cbFile + 1);
+        RTTESTI_CHECK_RETV(pszText);
+        memcpy(pszText, pvFile, cbFile);
+        const char *psz = pszText;
+        for (unsigned i = 0; i < 1000 && psz; i++)
+        {
+            char szLine[64];
+            RTStrPrintf(szLine, sizeof(szLine), "line %u text %#RX64\n", i, (uint64_t)i * 3);
+            const char *pszHit = strstr(psz, szLine);
+            if (!pszHit)
+                RTTestIFailed("'%s' missing or out of order", szLine);
+            psz = pszHit ? pszHit + strlen(szLine) : NULL;
+        }
+        if (psz && !strstr(psz, "last line 12 34\n"))
+            RTTestIFailed("last line missing");
+        RTMemFree(pszText);
+        RTFileReadAllFree(pvFile, cbFile);
+    }
+
+    /* The binary stream must start with the header. */
+    rc = RTFileReadAll(szBin, &pvFile, &cbFile);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        PCRTLOGBINHDR pHdr = (PCRTLOGBINHDR)pvFile;
+        RTTESTI_CHECK(cbFile > sizeof(*pHdr));
+        if (cbFile > sizeof(*pHdr))
+        {
+            RTTESTI_CHECK(!memcmp(pHdr->szMagic, RTLOGBINHDR_MAGIC, sizeof(RTLOGBINHDR_MAGIC)));
+            RTTESTI_CHECK(pHdr->u32Endian == RTLOGBINHDR_ENDIAN);
+            RTTESTI_CHECK(pHdr->cbHdr == sizeof(*pHdr));
+        }
+        RTFileReadAllFree(pvFile, cbFile);
+    }
+
+    RTFileDelete(szLog);
+    RTFileDelete(szBin);
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    int rc = RTTestInitAndCreate("tstRTLogBin", &hTest);
+    if (rc)
+        return rc;
+    RTTestBanner(hTest);
+
+    tstPackFormat();
+    tstAsyncLogger();
+
+    return RTTestSummaryAndDestroy(hTest);
+}
+
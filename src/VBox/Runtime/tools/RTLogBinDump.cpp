@@ -0,0 +1,474 @@
+/* $Id$ */
+/** @file
+ * IPRT - Binary Log Stream Decoder.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ *
+ * The contents of this file may alternatively be used under the terms
+ * of the Common Development and Distribution License Version 1.0
+ * (CDDL) only, as it comes in the "COPYING.CDDL" file of the
+ * VirtualBox OSE distribution, in which case the provisions of the
+ * CDDL are applicable instead of those of the GPL.
+ *
+ * You may elect to license modified versions of this file under the
+ * terms and conditions of either the GPL or the CDDL or both.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <iprt/log.h>
+#include <iprt/formats/logbin.h>
+
+#include <iprt/assert.h>
+#include <iprt/err.h>
+#include <iprt/file.h>
+#include <iprt/getopt.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/message.h>
+#include <iprt/path.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * Decoder state for one binary log stream.
+ */
+typedef struct RTLOGBINDUMP
+{
+    /** The output stream. */
+    PRTSTREAM       pOutput;
+    /** The stream header. */
+    PCRTLOGBINHDR   pHdr;
+    /** Whether to display the definition records. */
+    bool            fVerbose;
+    /** Set when at the start of an output line. */
+    bool            fAtLineStart;
+    /** The prefix for the current record. */
+    char            szPrefix[128];
+
+    /** Format strings indexed by ID. */
+    const char    **papszFormats;
+    /** Number of entries in papszFormats. */
+    uint32_t        cFormats;
+    /** Thread names indexed by ID. */
+    const char    **papszThreads;
+    /** Number of entries in papszThreads. */
+    uint32_t        cThreads;
+    /** Group names indexed by group number. */
+    const char    **papszGroups;
+    /** Number of entries in papszGroups. */
+    uint32_t        cGroups;
+} RTLOGBINDUMP;
+/** Pointer to the decoder state. */
+typedef RTLOGBINDUMP *PRTLOGBINDUMP;
+
+
+/**
+ * Stores a name in one of the ID indexed tables.
+ *
+ * @returns IPRT status code.
+ * @param   ppapsz      The table.
+ * @param   pcEntries   The table size.
+ * @param   id          The ID.
+ * @param   psz         The name.
+ */
+static int rtLogBinDumpSetName(const char ***ppapsz, uint32_t *pcEntries, uint32_t id, const char *psz)
+{
+    if (id >= _1M)
+        return VERR_OUT_OF_RANGE;
+    if (id >= *pcEntries)
+    {
+        uint32_t cNew = RT_ALIGN_32(id + 1, 64);
+        void *pvNew = RTMemRealloc((void *)*ppapsz, cNew * sizeof(const char *));
+        if (!pvNew)
+            return VERR_NO_MEMORY;
+        *ppapsz = (const char **)pvNew;
+        RT_BZERO(&(*ppapsz)[*pcEntries], (cNew - *pcEntries) * sizeof(const char *));
+        *pcEntries = cNew;
+    }
+    (*ppapsz)[id] = psz;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Looks up a name in one of the ID indexed tables.
+ *
+ * @returns The name, NULL if not defined.
+ * @param   papsz       The table.
+ * @param   cEntries    The table size.
+ * @param   id          The ID.
+ */
+static const char *rtLogBinDumpGetName(const char * const *papsz, uint32_t cEntries, uint32_t id)
+{
+    return id < cEntries ? papsz[id] : NULL;
+}
+
+
+/**
+ * @callback_method_impl{FNRTSTROUTPUT, Writes to the output stream, inserting
+ *                      the record prefix at the start of each line.}
+ */
+static DECLCALLBACK(size_t) rtLogBinDumpOutput(void *pvArg, const char *pachChars, size_t cbChars)
+{
+    PRTLOGBINDUMP pThis = (PRTLOGBINDUMP)pvArg;
+    size_t        cbRet = cbChars;
+    while (cbChars > 0)
+    {
+        if (pThis->fAtLineStart)
+        {
+            RTStrmPutStr(pThis->pOutput, pThis->szPrefix);
+            pThis->fAtLineStart = false;
+        }
+        const char *pchNewLine = (const char *)memchr(pachChars, '\n', cbChars);
+        size_t      cbLine     = pchNewLine ? pchNewLine - pachChars + 1 : cbChars;
+        RTStrmWrite(pThis->pOutput, pachChars, cbLine);
+        if (pchNewLine)
+            pThis->fAtLineStart = true;
+        pachChars += cbLine;
+        cbChars   -= cbLine;
+    }
+    return cbRet;
+}
+
+
+/**
+ * Makes sure the output is at the start of a line.
+ *
+ * @param   pThis       The decoder state.
+ */
+static void rtLogBinDumpNewLine(PRTLOGBINDUMP pThis)
+{
+    if (!pThis->fAtLineStart)
+    {
+        RTStrmPutCh(pThis->pOutput, '\n');
+        pThis->fAtLineStart = true;
+    }
+}
+
+
+/**
+ * Gets the string trailing a definition record.
+ *
+ * @returns Pointer to the string, NULL if malformed.
+ * @param   pRec        The record.
+ * @param   cbStruct    The size of the record structure.
+ * @param   cch         The string length given by the record.
+ */
+static const char *rtLogBinDumpRecString(PCRTLOGBINREC pRec, size_t cbStruct, uint32_t cch)
+{
+    if (   pRec->cbRec < cbStruct
+        || cch >= pRec->cbRec - cbStruct)
+        return NULL;
+    const char *psz = (const char *)pRec + cbStruct;
+    return psz[cch] == '\0' ? psz : NULL;
+}
+
+
+/**
+ * Formats the prefix of a log statement record.
+ *
+ * @param   pThis       The decoder state.
+ * @param   pMsg        The record.
+ */
+static void rtLogBinDumpFormatPrefix(PRTLOGBINDUMP pThis, RTLOGBINMSG const *pMsg)
+{
+    uint64_t    cNsProg   = pMsg->u64NanoTS - pThis->pHdr->u64NanoTSProgStart;
+    uint64_t    cUsProg   = cNsProg / RT_NS_1US;
+    const char *pszThread = rtLogBinDumpGetName(pThis->papszThreads, pThis->cThreads, pMsg->idThread);
+    const char *pszGroup  = pMsg->iGroup != ~0U
+                          ? rtLogBinDumpGetName(pThis->papszGroups, pThis->cGroups, pMsg->iGroup) : "default";
+    RTStrPrintf(pThis->szPrefix, sizeof(pThis->szPrefix), "%02RU64:%02RU64:%02RU64.%06RU64 %-16s %-12s ",
+                cUsProg / RT_US_1HOUR, cUsProg / RT_US_1MIN % 60, cUsProg / RT_US_1SEC % 60, cUsProg % RT_US_1SEC,
+                pszThread ? pszThread : "<unknown>", pszGroup ? pszGroup : "<unknown>");
+}
+
+
+/**
+ * Decodes one binary log stream.
+ *
+ * @returns RTEXITCODE_SUCCESS or RTEXITCODE_FAILURE (error displayed).
+ * @param   pThis       The decoder state.
+ * @param   pszFile     The file name.
+ */
+static RTEXITCODE rtLogBinDumpFile(PRTLOGBINDUMP pThis, const char *pszFile)
+{
+    void   *pvFile;
+    size_t  cbFile;
+    int rc = RTFileReadAll(pszFile, &pvFile, &cbFile);
+    if (RT_FAILURE(rc))
+        return RTMsgErrorExit(RTEXITCODE_FAILURE, "Failed to read '%s': %Rrc", pszFile, rc);
+
+    /*
+     * Validate the header.
+     */
+    RTEXITCODE      rcExit = RTEXITCODE_SUCCESS;
+    PCRTLOGBINHDR   pHdr   = (PCRTLOGBINHDR)pvFile;
+    if (   cbFile < sizeof(*pHdr)
+        || memcmp(pHdr->szMagic, RTLOGBINHDR_MAGIC, sizeof(RTLOGBINHDR_MAGIC)))
+        rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "'%s' is not a binary log stream", pszFile);
+    else if (pHdr->u32Endian != RTLOGBINHDR_ENDIAN)
+        rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "'%s' was written with a different byte order (%#x)", pszFile, pHdr->u32Endian);
+    else if (   (pHdr->uVersion >> 16) != (RTLOGBINHDR_VERSION >> 16)
+             || pHdr->cbHdr < sizeof(*pHdr)
+             || pHdr->cbHdr > cbFile
+             || (pHdr->cbHdr & (RTLOGBIN_ARG_ALIGN - 1)))
+        rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "'%s' has an unsupported version (%#x) or header size (%#x)",
+                                pszFile, pHdr->uVersion, pHdr->cbHdr);
+    if (rcExit != RTEXITCODE_SUCCESS)
+    {
+        RTFileReadAllFree(pvFile, cbFile);
+        return rcExit;
+    }
+
+    pThis->pHdr         = pHdr;
+    pThis->fAtLineStart = true;
+    pThis->cFormats     = 0;
+    pThis->cThreads     = 0;
+    pThis->cGroups      = 0;
+    if (pThis->fVerbose)
+    {
+        RTTIMESPEC Start;
+        char       szStart[64];
+        RTTimeSpecToString(RTTimeSpecSetNano(&Start, pHdr->i64WallNanoStart), szStart, sizeof(szStart));
+        RTStrmPrintf(pThis->pOutput, "%s: version %#x, pid %RU64, started %s, log flags %#x\n",
+                     pszFile, pHdr->uVersion, pHdr->u64ProcessId, szStart, pHdr->fLogFlags);
+    }
+
+    /*
+     * Process the records.
+     */
+    uint64_t cMsgs = 0;
+    size_t   off   = pHdr->cbHdr;
+    while (off < cbFile)
+    {
+        PCRTLOGBINREC pRec = (PCRTLOGBINREC)((uint8_t const *)pvFile + off);
+        if (   cbFile - off < sizeof(*pRec)
+            || pRec->cbRec < sizeof(*pRec)
+            || pRec->cbRec > cbFile - off
+            || (pRec->cbRec & (RTLOGBIN_ARG_ALIGN - 1)))
+        {
+            rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "%s: Bad record header at %#zx (truncated stream?)", pszFile, off);
+            break;
+        }
+
+        switch (pRec->uType)
+        {
+            case RTLOGBINREC_TYPE_FORMAT:
+            {
+                RTLOGBINFMT const *pFmt = (RTLOGBINFMT const *)pRec;
+                const char *pszFormat = pRec->cbRec >= sizeof(*pFmt)
+                                      ? rtLogBinDumpRecString(pRec, sizeof(*pFmt), pFmt->cchFormat) : NULL;
+                rc = pszFormat ? rtLogBinDumpSetName(&pThis->papszFormats, &pThis->cFormats, pFmt->idFormat, pszFormat)
+                               : VERR_PARSE_ERROR;
+                if (RT_SUCCESS(rc) && pThis->fVerbose)
+                {
+                    rtLogBinDumpNewLine(pThis);
+                    RTStrmPrintf(pThis->pOutput, "format #%u: \"%s\"\n", pFmt->idFormat, pszFormat);
+                }
+                break;
+            }
+
+            case RTLOGBINREC_TYPE_GROUP:
+            {
+                RTLOGBINGROUP const *pGroup = (RTLOGBINGROUP const *)pRec;
+                const char *pszName = pRec->cbRec >= sizeof(*pGroup)
+                                    ? rtLogBinDumpRecString(pRec, sizeof(*pGroup), pGroup->cchName) : NULL;
+                rc = pszName ? rtLogBinDumpSetName(&pThis->papszGroups, &pThis->cGroups, pGroup->iGroup, pszName)
+                             : VERR_PARSE_ERROR;
+                if (RT_SUCCESS(rc) && pThis->fVerbose)
+                {
+                    rtLogBinDumpNewLine(pThis);
+                    RTStrmPrintf(pThis->pOutput, "group #%u: %s\n", pGroup->iGroup, pszName);
+                }
+                break;
+            }
+
+            case RTLOGBINREC_TYPE_THREAD:
+            {
+                RTLOGBINTHREAD const *pThread = (RTLOGBINTHREAD const *)pRec;
+                const char *pszName = pRec->cbRec >= sizeof(*pThread)
+                                    ? rtLogBinDumpRecString(pRec, sizeof(*pThread), pThread->cchName) : NULL;
+                rc = pszName ? rtLogBinDumpSetName(&pThis->papszThreads, &pThis->cThreads, pThread->idThread, pszName)
+                             : VERR_PARSE_ERROR;
+                if (RT_SUCCESS(rc) && pThis->fVerbose)
+                {
+                    rtLogBinDumpNewLine(pThis);
+                    RTStrmPrintf(pThis->pOutput, "thread #%u: %s (native %#RX64)\n",
+                                 pThread->idThread, pszName, pThread->u64NativeThread);
+                }
+                break;
+            }
+
+            case RTLOGBINREC_TYPE_MSG:
+            case RTLOGBINREC_TYPE_TEXT:
+            {
+                RTLOGBINMSG const *pMsg = (RTLOGBINMSG const *)pRec;
+                if (   pRec->cbRec < sizeof(*pMsg)
+                    || pMsg->cbData > pRec->cbRec - sizeof(*pMsg))
+                {
+                    rc = VERR_PARSE_ERROR;
+                    break;
+                }
+                rc = VINF_SUCCESS;
+                rtLogBinDumpFormatPrefix(pThis, pMsg);
+                if (pRec->uType == RTLOGBINREC_TYPE_TEXT)
+                    rtLogBinDumpOutput(pThis, (const char *)(pMsg + 1), pMsg->cbData);
+                else
+                {
+                    const char *pszFormat = rtLogBinDumpGetName(pThis->papszFormats, pThis->cFormats, pMsg->idFormat);
+                    if (pszFormat)
+                        RTLogBinFormat(rtLogBinDumpOutput, pThis, pszFormat, pMsg + 1, pMsg->cbData);
+                    else
+                    {
+                        rtLogBinDumpNewLine(pThis);
+                        RTStrmPrintf(pThis->pOutput, "%s<undefined format #%u>\n", pThis->szPrefix, pMsg->idFormat);
+                    }
+                }
+                cMsgs++;
+                break;
+            }
+
+            case RTLOGBINREC_TYPE_DROPPED:
+            {
+                RTLOGBINDROPPED const *pDropped = (RTLOGBINDROPPED const *)pRec;
+                if (pRec->cbRec < sizeof(*pDropped))
+                {
+                    rc = VERR_PARSE_ERROR;
+                    break;
+                }
+                rc = VINF_SUCCESS;
+                const char *pszThread = rtLogBinDumpGetName(pThis->papszThreads, pThis->cThreads, pDropped->idThread);
+                rtLogBinDumpNewLine(pThis);
+                RTStrmPrintf(pThis->pOutput, "*** %u records from thread '%s' (#%u) dropped ***\n",
+                             pDropped->cDropped, pszThread ? pszThread : "<unknown>", pDropped->idThread);
+                break;
+            }
+
+            default:
+                /* Skip unknown records, newer minor versions may add some. */
+                rc = VINF_SUCCESS;
+                break;
+        }
+        if (RT_FAILURE(rc))
+        {
+            rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "%s: Bad record of type %u at %#zx: %Rrc", pszFile, pRec->uType, off, rc);
+            break;
+        }
+        off += pRec->cbRec;
+    }
+
+    rtLogBinDumpNewLine(pThis);
+    if (pThis->fVerbose)
+        RTStrmPrintf(pThis->pOutput, "%s: %RU64 log statements, %u format strings, %u threads\n",
+                     pszFile, cMsgs, pThis->cFormats, pThis->cThreads);
+
+    RTMemFree((void *)pThis->papszFormats);
+    RTMemFree((void *)pThis->papszThreads);
+    RTMemFree((void *)pThis->papszGroups);
+    pThis->papszFormats = pThis->papszThreads = pThis->papszGroups = NULL;
+    pThis->pHdr = NULL;
+    RTFileReadAllFree(pvFile, cbFile);
+    return rcExit;
+}
+
+
+int main(int argc, char **argv)
+{
+    int rc = RTR3InitExe(argc, &argv, 0);
+    if (RT_FAILURE(rc))
+        return RTMsgInitFailure(rc);
+
+    RTLOGBINDUMP This;
+    RT_ZERO(This);
+    This.pOutput = g_pStdOut;
+
+    /*
+     * Parse arguments.
+     */
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--output",       'o', RTGETOPT_REQ_STRING },
+        { "--verbose",      'v', RTGETOPT_REQ_NOTHING },
+    };
+
+    RTEXITCODE      rcExit = RTEXITCODE_SUCCESS;
+    unsigned        cFiles = 0;
+    RTGETOPTUNION   ValueUnion;
+    RTGETOPTSTATE   GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0);
+    while ((rc = RTGetOpt(&GetState, &ValueUnion)))
+    {
+        switch (rc)
+        {
+            case 'o':
+                if (This.pOutput != g_pStdOut)
+                    RTStrmClose(This.pOutput);
+                rc = RTStrmOpen(ValueUnion.psz, "w", &This.pOutput);
+                if (RT_FAILURE(rc))
+                    return RTMsgErrorExit(RTEXITCODE_FAILURE, "Failed to open '%s' for writing: %Rrc", ValueUnion.psz, rc);
+                break;
+
+            case 'v':
+                This.fVerbose = true;
+                break;
+
+            case 'h':
+                RTPrintf("Usage: %s [options] <file> [file2 [..]]\n"
+                         "\n"
+                         "Decodes binary log streams written by loggers using the binfile destination.\n"
+                         "\n"
+                         "Options:\n"
+                         "  -o, --output=file\n"
+                         "      Write the text to the given file instead of standard output.\n"
+                         "  -v, --verbose\n"
+                         "      Display the header and the format, thread and group definitions.\n"
+                         "  -h, -?, --help\n"
+                         "      Display this help text and exit successfully.\n"
+                         "  -V, --version\n"
+                         "      Display the revision and exit successfully.\n"
+                         , RTPathFilename(argv[0]));
+                return RTEXITCODE_SUCCESS;
+
+            case 'V':
+                RTPrintf("$Revision$\n");
+                return RTEXITCODE_SUCCESS;
+
+            case VINF_GETOPT_NOT_OPTION:
+                if (rtLogBinDumpFile(&This, ValueUnion.psz) != RTEXITCODE_SUCCESS)
+                    rcExit = RTEXITCODE_FAILURE;
+                cFiles++;
+                break;
+
+            default:
+                return RTGetOptPrintError(rc, &ValueUnion);
+        }
+    }
+
+    if (!cFiles)
+        return RTMsgErrorExit(RTEXITCODE_SYNTAX, "No input files, try --help");
+    if (This.pOutput != g_pStdOut)
+    {
+        rc = RTStrmClose(This.pOutput);
+        if (RT_FAILURE(rc))
+            rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "Failed to close the output file: %Rrc", rc);
+    }
+    return rcExit;
+}
+
@@ -29,6 +29,7 @@
 #include <iprt/assert.h>
 #include <iprt/base64.h>
 #include <iprt/ctype.h>
+#include <iprt/list.h>
 #include <iprt/mem.h>
 #include <iprt/string.h>
 #include <iprt/zip.h>
@@ -301,10 +302,29 @@ typedef struct DMGEXTENT
     uint64_t             offFileStart;
     /** Number of bytes for the extent data in the file. */
     uint64_t             cbFile;
+    /** Decompressed data of a compressed extent if cached, NULL otherwise. */
+    struct DMGDECOMPCHUNK *pChunk;
 } DMGEXTENT;
 /** Pointer to an DMG extent. */
 typedef DMGEXTENT *PDMGEXTENT;
 
+/**
+ * Decompressed data of a compressed extent in the chunk cache.
+ */
+typedef struct DMGDECOMPCHUNK
+{
+    /** Node in the LRU list, most recently used first. */
+    RTLISTNODE           NodeLru;
+    /** The extent this data belongs to. */
+    PDMGEXTENT           pExtent;
+    /** Size of the decompressed data. */
+    size_t               cbData;
+    /** The decompressed data - variable size. */
+    uint8_t              abData[1];
+} DMGDECOMPCHUNK;
+/** Pointer to a decompressed chunk. */
+typedef DMGDECOMPCHUNK *PDMGDECOMPCHUNK;
+
 /**
  * VirtualBox Apple Disk Image (DMG) interpreter instance data.
  */
@@ -362,12 +382,22 @@ typedef struct DMGIMAGE
     /** Index of the last accessed extent. */
     unsigned            idxExtentLast;
 
-    /** Extent which owns the data in the buffer. */
-    PDMGEXTENT          pExtentDecomp;
-    /** Buffer holding the decompressed data for a extent. */
-    void               *pvDecompExtent;
-    /** Size of the buffer. */
-    size_t              cbDecompExtent;
+    /** LRU list of decompressed chunks, most recently used first. */
+    RTLISTANCHOR        ListDecompLru;
+    /** Memory used by the decompressed chunks. */
+    size_t              cbDecompCache;
+    /** Maximum memory the decompressed chunks may use. */
+    uint64_t            cbDecompCacheMax;
+    /** Number of compressed extents to decompress ahead on sequential access. */
+    uint32_t            cDecompReadAhead;
+    /** Index of the last extent decompressed, UINT32_MAX if none. */
+    uint32_t            idxExtentDecompLast;
+    /** Number of reads served from the chunk cache. */
+    uint64_t            cDecompHits;
+    /** Number of chunks decompressed for reads. */
+    uint64_t            cDecompMisses;
+    /** Number of chunks decompressed ahead. */
+    uint64_t            cDecompReadAheads;
 } DMGIMAGE;
 /** Pointer to an instance of the DMG Image Interpreter. */
 typedef DMGIMAGE *PDMGIMAGE;
@@ -389,6 +419,8 @@ typedef struct DMGINFLATESTATE
     uint64_t  uFileOffset;
     /* Current read position. */
     ssize_t   iOffset;
+    /* Compressed data already in memory, NULL to read it from the file. */
+    const uint8_t *pbSrc;
 } DMGINFLATESTATE;
 
 /*******************************************************************************
@@ -399,6 +431,15 @@ typedef struct DMGINFLATESTATE
  */
 #define DMG_PRINTF(a)  LogRel(a)
 
+/** Default memory limit of the decompressed chunk cache. */
+#define DMG_DECOMP_CACHE_MEMORY_DEF     (16*_1M)
+/** Minimum memory limit of the decompressed chunk cache. */
+#define DMG_DECOMP_CACHE_MEMORY_MIN     (1*_1M)
+/** Default number of compressed extents to decompress ahead. */
+#define DMG_DECOMP_READ_AHEAD_DEF       4
+/** Maximum number of compressed extents to decompress ahead. */
+#define DMG_DECOMP_READ_AHEAD_MAX       64
+
 /** @def DMG_VALIDATE
  * For validating a struct thing and log/print what's wrong.
  */
@@ -417,6 +458,19 @@ typedef struct DMGINFLATESTATE
 *   Static Variables                                                           *
 *******************************************************************************/
 
+/** Default decompressed chunk cache size, must match DMG_DECOMP_CACHE_MEMORY_DEF. */
+static const char *s_dmgConfigDefaultDecompCacheSize = "16777216";
+/** Default number of extents to decompress ahead, must match DMG_DECOMP_READ_AHEAD_DEF. */
+static const char *s_dmgConfigDefaultDecompReadAhead = "4";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_dmgConfigInfo[] =
+{
+    { "DecompCacheSize",      s_dmgConfigDefaultDecompCacheSize,         VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "DecompReadAhead",      s_dmgConfigDefaultDecompReadAhead,         VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
 /** NULL-terminated array of supported file extensions. */
 static const VDFILEEXTENSION s_aDmgFileExtensions[] =
 {
@@ -518,9 +572,17 @@ static DECLCALLBACK(int) dmgFileInflateHelper(void *pvUser, void *pvBuf, size_t
         return VINF_SUCCESS;
     }
     cbBuf = RT_MIN(cbBuf, pInflateState->cbSize);
-    int rc = dmgWrapFileReadSync(pInflateState->pImage, pInflateState->uFileOffset, pvBuf, cbBuf);
-    if (RT_FAILURE(rc))
-        return rc;
+    if (pInflateState->pbSrc)
+    {
+        memcpy(pvBuf, pInflateState->pbSrc, cbBuf);
+        pInflateState->pbSrc += cbBuf;
+    }
+    else
+    {
+        int rc = dmgWrapFileReadSync(pInflateState->pImage, pInflateState->uFileOffset, pvBuf, cbBuf);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
     pInflateState->uFileOffset += cbBuf;
     pInflateState->iOffset += cbBuf;
     pInflateState->cbSize -= cbBuf;
@@ -531,10 +593,11 @@ static DECLCALLBACK(int) dmgFileInflateHelper(void *pvUser, void *pvBuf, size_t
 
 /**
  * Internal: read from a file and inflate the compressed data,
- * distinguishing between async and normal operation
+ * distinguishing between async and normal operation. If pbSrc is given the
+ * compressed data was read already and is taken from there.
  */
 DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, size_t cbToRead,
-                                   void *pvBuf, size_t cbBuf)
+                                   void *pvBuf, size_t cbBuf, const uint8_t *pbSrc)
 {
     int rc;
     PRTZIPDECOMP pZip = NULL;
@@ -545,6 +608,7 @@ DECLINLINE(int) dmgFileInflateSync(PDMGIMAGE pImage, uint64_t uOffset, size_t cb
     InflateState.cbSize      = cbToRead;
     InflateState.uFileOffset = uOffset;
     InflateState.iOffset     = -1;
+    InflateState.pbSrc       = pbSrc;
 
     rc = RTZipDecompCreate(&pZip, &InflateState, dmgFileInflateHelper);
     if (RT_FAILURE(rc))
@@ -804,6 +868,278 @@ static int dmgFlushImage(PDMGIMAGE pThis)
 }
 
 
+/**
+ * Initializes the decompressed chunk cache, reading the configuration.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The DMG instance data.
+ */
+static int dmgDecompCacheInit(PDMGIMAGE pThis)
+{
+    int rc = VINF_SUCCESS;
+
+    RTListInit(&pThis->ListDecompLru);
+    pThis->cbDecompCache       = 0;
+    pThis->cbDecompCacheMax    = DMG_DECOMP_CACHE_MEMORY_DEF;
+    pThis->cDecompReadAhead    = DMG_DECOMP_READ_AHEAD_DEF;
+    pThis->idxExtentDecompLast = UINT32_MAX;
+    pThis->cDecompHits         = 0;
+    pThis->cDecompMisses       = 0;
+    pThis->cDecompReadAheads   = 0;
+
+    /* The cache can be tuned per image through the configuration interface. */
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pThis->pVDIfsImage);
+    if (pIfConfig)
+    {
+        rc = VDCFGQueryU64Def(pIfConfig, "DecompCacheSize", &pThis->cbDecompCacheMax,
+                              DMG_DECOMP_CACHE_MEMORY_DEF);
+        if (RT_SUCCESS(rc))
+            rc = VDCFGQueryU32Def(pIfConfig, "DecompReadAhead", &pThis->cDecompReadAhead,
+                                  DMG_DECOMP_READ_AHEAD_DEF);
+        if (RT_SUCCESS(rc))
+        {
+            pThis->cbDecompCacheMax = RT_MAX(pThis->cbDecompCacheMax, DMG_DECOMP_CACHE_MEMORY_MIN);
+            pThis->cDecompReadAhead = RT_MIN(pThis->cDecompReadAhead, DMG_DECOMP_READ_AHEAD_MAX);
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * Frees a decompressed chunk and removes it from the cache.
+ *
+ * @param   pThis       The DMG instance data.
+ * @param   pChunk      The chunk to free.
+ */
+static void dmgDecompChunkFree(PDMGIMAGE pThis, PDMGDECOMPCHUNK pChunk)
+{
+    RTListNodeRemove(&pChunk->NodeLru);
+    pChunk->pExtent->pChunk = NULL;
+    Assert(pThis->cbDecompCache >= pChunk->cbData);
+    pThis->cbDecompCache -= pChunk->cbData;
+    RTMemFree(pChunk);
+}
+
+/**
+ * Destroys the decompressed chunk cache.
+ *
+ * @param   pThis       The DMG instance data.
+ */
+static void dmgDecompCacheDestroy(PDMGIMAGE pThis)
+{
+    PDMGDECOMPCHUNK pChunk, pChunkNext;
+
+    RTListForEachSafe(&pThis->ListDecompLru, pChunk, pChunkNext, DMGDECOMPCHUNK, NodeLru)
+    {
+        dmgDecompChunkFree(pThis, pChunk);
+    }
+
+    Assert(!pThis->cbDecompCache);
+}
+
+/**
+ * Allocates a chunk for the decompressed data of the given extent, evicting
+ * the least recently used chunks if the cache would exceed its limit.
+ *
+ * @returns Pointer to the chunk or NULL if out of memory.
+ * @param   pThis       The DMG instance data.
+ * @param   pExtent     The extent to decompress.
+ */
+static PDMGDECOMPCHUNK dmgDecompChunkAlloc(PDMGIMAGE pThis, PDMGEXTENT pExtent)
+{
+    size_t cbData = DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
+
+    /* Keep at least one chunk even if it exceeds the limit on its own. */
+    while (   pThis->cbDecompCache + cbData > pThis->cbDecompCacheMax
+           && !RTListIsEmpty(&pThis->ListDecompLru))
+        dmgDecompChunkFree(pThis, RTListGetLast(&pThis->ListDecompLru, DMGDECOMPCHUNK, NodeLru));
+
+    PDMGDECOMPCHUNK pChunk = (PDMGDECOMPCHUNK)RTMemAlloc(RT_OFFSETOF(DMGDECOMPCHUNK, abData[cbData]));
+    if (pChunk)
+    {
+        pChunk->pExtent = pExtent;
+        pChunk->cbData  = cbData;
+    }
+
+    return pChunk;
+}
+
+/**
+ * Inserts a filled chunk at the head of the LRU list.
+ *
+ * @param   pThis       The DMG instance data.
+ * @param   pChunk      The chunk to insert.
+ */
+static void dmgDecompChunkInsert(PDMGIMAGE pThis, PDMGDECOMPCHUNK pChunk)
+{
+    RTListPrepend(&pThis->ListDecompLru, &pChunk->NodeLru);
+    pChunk->pExtent->pChunk = pChunk;
+    pThis->cbDecompCache += pChunk->cbData;
+}
+
+/**
+ * Returns whether the given extent continues a sequential read of the
+ * compressed extents, i.e. there is no compressed extent between it and the
+ * one decompressed last.
+ *
+ * @returns true if the access is sequential.
+ * @param   pThis       The DMG instance data.
+ * @param   idxExtent   Index of the extent.
+ */
+static bool dmgDecompIsSequential(PDMGIMAGE pThis, uint32_t idxExtent)
+{
+    uint32_t idxLast = pThis->idxExtentDecompLast;
+
+    if (   idxLast == UINT32_MAX
+        || idxExtent <= idxLast)
+        return false;
+
+    for (uint32_t i = idxLast + 1; i < idxExtent; i++)
+        if (pThis->paExtents[i].enmType == DMGEXTENTTYPE_COMP_ZLIB)
+            return false;
+
+    return true;
+}
+
+/**
+ * Returns the decompressed data of the given compressed extent, decompressing
+ * it and, on sequential access, the following compressed extents if not cached.
+ * Failing to decompress ahead doesn't fail the request.
+ *
+ * @returns VBox status code.
+ * @param   pThis       The DMG instance data.
+ * @param   pExtent     The compressed extent.
+ * @param   ppChunk     Where to store the chunk holding the decompressed data.
+ */
+static int dmgDecompChunkFetch(PDMGIMAGE pThis, PDMGEXTENT pExtent, PDMGDECOMPCHUNK *ppChunk)
+{
+    PDMGDECOMPCHUNK pChunk = pExtent->pChunk;
+    int rc = VINF_SUCCESS;
+
+    if (pChunk)
+    {
+        /* Move to the head of the LRU list. */
+        RTListNodeRemove(&pChunk->NodeLru);
+        RTListPrepend(&pThis->ListDecompLru, &pChunk->NodeLru);
+        pThis->cDecompHits++;
+        *ppChunk = pChunk;
+        return VINF_SUCCESS;
+    }
+
+    pThis->cDecompMisses++;
+
+    /*
+     * Collect the compressed extents to decompress: the requested one and on
+     * sequential access the following ones which are stored right after it in
+     * the file, so the compressed data can be read with a single request.
+     * Never decompress ahead more than half of the cache.
+     */
+    uint32_t idxFirst = (uint32_t)(pExtent - pThis->paExtents);
+    uint32_t idxEnd   = idxFirst + 1;
+    uint64_t cbComp   = pExtent->cbFile;
+    uint64_t cbDecomp = DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
+
+    if (   pThis->cDecompReadAhead
+        && dmgDecompIsSequential(pThis, idxFirst))
+    {
+        while (   idxEnd < pThis->cExtents
+               && idxEnd - idxFirst <= pThis->cDecompReadAhead)
+        {
+            PDMGEXTENT pNext = &pThis->paExtents[idxEnd];
+            PDMGEXTENT pPrev = &pThis->paExtents[idxEnd - 1];
+
+            if (   pNext->enmType != DMGEXTENTTYPE_COMP_ZLIB
+                || pNext->pChunk
+                || pNext->offFileStart != pPrev->offFileStart + pPrev->cbFile
+                || cbDecomp + DMG_BLOCK2BYTE(pNext->cSectorsExtent) > pThis->cbDecompCacheMax / 2)
+                break;
+
+            cbComp   += pNext->cbFile;
+            cbDecomp += DMG_BLOCK2BYTE(pNext->cSectorsExtent);
+            idxEnd++;
+        }
+    }
+
+    /*
+     * Read all the compressed data at once.  Decompressing ahead is only an
+     * optimization, so if that fails retry with just the requested extent.
+     */
+    uint8_t *pbComp = (uint8_t *)RTMemTmpAlloc(cbComp);
+    if (pbComp)
+        rc = dmgWrapFileReadSync(pThis, pExtent->offFileStart, pbComp, cbComp);
+    if (   (!pbComp || RT_FAILURE(rc))
+        && idxEnd > idxFirst + 1)
+    {
+        RTMemTmpFree(pbComp);
+        idxEnd = idxFirst + 1;
+        cbComp = pExtent->cbFile;
+        pbComp = (uint8_t *)RTMemTmpAlloc(cbComp);
+        if (pbComp)
+            rc = dmgWrapFileReadSync(pThis, pExtent->offFileStart, pbComp, cbComp);
+    }
+    if (!pbComp)
+        return VERR_NO_TMP_MEMORY;
+
+    /* The requested extent first, its errors are returned to the caller. */
+    if (RT_SUCCESS(rc))
+    {
+        pChunk = dmgDecompChunkAlloc(pThis, pExtent);
+        if (pChunk)
+        {
+            rc = dmgFileInflateSync(pThis, pExtent->offFileStart, pExtent->cbFile,
+                                    pChunk->abData, pChunk->cbData, pbComp);
+            if (RT_SUCCESS(rc))
+                dmgDecompChunkInsert(pThis, pChunk);
+            else
+                RTMemFree(pChunk);
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        pThis->idxExtentDecompLast = idxFirst;
+
+        /*
+         * Then the following extents on a best effort basis.  All of them
+         * together take at most half of the cache, so making room for them
+         * never evicts the requested extent.
+         */
+        for (uint32_t idx = idxFirst + 1; idx < idxEnd; idx++)
+        {
+            PDMGEXTENT pCur = &pThis->paExtents[idx];
+            PDMGDECOMPCHUNK pNew = dmgDecompChunkAlloc(pThis, pCur);
+            if (!pNew)
+                break;
+
+            int rc2 = dmgFileInflateSync(pThis, pCur->offFileStart, pCur->cbFile,
+                                         pNew->abData, pNew->cbData,
+                                         pbComp + (pCur->offFileStart - pExtent->offFileStart));
+            if (RT_FAILURE(rc2))
+            {
+                LogFlowFunc(("Decompressing extent %u ahead failed with %Rrc\n", idx, rc2));
+                RTMemFree(pNew);
+                break;
+            }
+
+            dmgDecompChunkInsert(pThis, pNew);
+            pThis->idxExtentDecompLast = idx;
+            pThis->cDecompReadAheads++;
+        }
+
+        /* Keep the requested extent at the head of the LRU list. */
+        Assert(pExtent->pChunk == pChunk);
+        RTListNodeRemove(&pChunk->NodeLru);
+        RTListPrepend(&pThis->ListDecompLru, &pChunk->NodeLru);
+        *ppChunk = pChunk;
+    }
+
+    RTMemTmpFree(pbComp);
+    return rc;
+}
+
 /**
  * Internal. Free all allocated space for representing an image except pThis,
  * and optionally delete the image from disk.
@@ -855,12 +1191,7 @@ static int dmgFreeImage(PDMGIMAGE pThis, bool fDelete)
         if (fDelete && pThis->pszFilename)
             vdIfIoIntFileDelete(pThis->pIfIoXxx, pThis->pszFilename);
 
-        if (pThis->pvDecompExtent)
-        {
-            RTMemFree(pThis->pvDecompExtent);
-            pThis->pvDecompExtent = NULL;
-            pThis->cbDecompExtent = 0;
-        }
+        dmgDecompCacheDestroy(pThis);
     }
 
     LogFlowFunc(("returns %Rrc\n", rc));
@@ -1351,6 +1682,7 @@ static int dmgExtentCreateFromBlkxDesc(PDMGIMAGE pThis, uint64_t uSectorPart, PD
             pExtentNew->cSectorsExtent = pBlkxDesc->u64SectorCount;
             pExtentNew->offFileStart   = pBlkxDesc->offData;
             pExtentNew->cbFile         = pBlkxDesc->cbData;
+            pExtentNew->pChunk         = NULL;
         }
     }
 
@@ -1556,9 +1888,14 @@ static int dmgOpenImage(PDMGIMAGE pThis, unsigned uOpenFlags)
     pThis->pIfIoXxx = VDIfIoIntGet(pThis->pVDIfsImage);
     pThis->hDmgFileInXar = NIL_RTVFSFILE;
     pThis->hXarFss = NIL_RTVFSFSSTREAM;
+
+    int rc = dmgDecompCacheInit(pThis);
+    if (RT_FAILURE(rc))
+        return rc;
+
     AssertPtrReturn(pThis->pIfIoXxx, VERR_INVALID_PARAMETER);
 
-    int rc = vdIfIoIntFileOpen(pThis->pIfIoXxx, pThis->pszFilename,
+    rc = vdIfIoIntFileOpen(pThis->pIfIoXxx, pThis->pszFilename,
                                VDOpenFlagsToFileOpenFlags(uOpenFlags, false /* fCreate */),
                                &pThis->pStorage);
     if (RT_FAILURE(rc))
@@ -1931,33 +2268,11 @@ static DECLCALLBACK(int) dmgRead(void *pBackendData, uint64_t uOffset,  size_t c
             }
             case DMGEXTENTTYPE_COMP_ZLIB:
             {
-                if (pThis->pExtentDecomp != pExtent)
-                {
-                    if (DMG_BLOCK2BYTE(pExtent->cSectorsExtent) > pThis->cbDecompExtent)
-                    {
-                        if (RT_LIKELY(pThis->pvDecompExtent))
-                            RTMemFree(pThis->pvDecompExtent);
-
-                        pThis->pvDecompExtent = RTMemAllocZ(DMG_BLOCK2BYTE(pExtent->cSectorsExtent));
-                        if (!pThis->pvDecompExtent)
-                            rc = VERR_NO_MEMORY;
-                        else
-                            pThis->cbDecompExtent = DMG_BLOCK2BYTE(pExtent->cSectorsExtent);
-                    }
-
-                    if (RT_SUCCESS(rc))
-                    {
-                        rc = dmgFileInflateSync(pThis, pExtent->offFileStart, pExtent->cbFile,
-                                                pThis->pvDecompExtent,
-                                                RT_MIN(pThis->cbDecompExtent, DMG_BLOCK2BYTE(pExtent->cSectorsExtent)));
-                        if (RT_SUCCESS(rc))
-                            pThis->pExtentDecomp = pExtent;
-                    }
-                }
-
+                PDMGDECOMPCHUNK pChunk = NULL;
+                rc = dmgDecompChunkFetch(pThis, pExtent, &pChunk);
                 if (RT_SUCCESS(rc))
                     vdIfIoIntIoCtxCopyTo(pThis->pIfIoXxx, pIoCtx,
-                                         (uint8_t *)pThis->pvDecompExtent + DMG_BLOCK2BYTE(uExtentRel),
+                                         &pChunk->abData[DMG_BLOCK2BYTE(uExtentRel)],
                                          cbToRead);
                 break;
             }
@@ -2467,6 +2782,9 @@ static DECLCALLBACK(void) dmgDump(void *pBackendData)
                          pThis->PCHSGeometry.cCylinders, pThis->PCHSGeometry.cHeads, pThis->PCHSGeometry.cSectors,
                          pThis->LCHSGeometry.cCylinders, pThis->LCHSGeometry.cHeads, pThis->LCHSGeometry.cSectors,
                          pThis->cbSize / DMG_SECTOR_SIZE);
+        vdIfErrorMessage(pThis->pIfError, "Decompressed chunk cache: cbMax=%llu cbUsed=%zu cHits=%llu cMisses=%llu cReadAheads=%llu\n",
+                         pThis->cbDecompCacheMax, pThis->cbDecompCache, pThis->cDecompHits,
+                         pThis->cDecompMisses, pThis->cDecompReadAheads);
     }
 }
 
@@ -2482,7 +2800,7 @@ const VBOXHDDBACKEND g_DmgBackend =
     /* paFileExtensions */
     s_aDmgFileExtensions,
     /* paConfigInfo */
-    NULL,
+    s_dmgConfigInfo,
     /* pfnCheckIfValid */
     dmgCheckIfValid,
     /* pfnOpen */
@@ -427,6 +427,12 @@ typedef struct ISCSICMD
     void                 *pvUser;
     /** Command to execute. */
     ISCSICMDTYPE          enmCmdType;
+    /** Number of Data-Out PDUs of this command waiting to get transmitted. */
+    uint32_t              cDataOutPending;
+    /** Flag whether the command completed while Data-Out PDUs were still pending. */
+    bool                  fCompletePending;
+    /** Status code to complete the command with when the last Data-Out PDU is gone. */
+    int                   rcCmdPending;
     /** Command type dependent data. */
     union
     {
@@ -465,6 +471,8 @@ typedef struct ISCSIPDUTX
     size_t      cbSgLeft;
     /** The iSCSI command this PDU belongs to. */
     PISCSICMD   pIScsiCmd;
+    /** Flag whether this is a Data-Out PDU for the command. */
+    bool        fDataOut;
     /** Number of segments in the request segments array. */
     unsigned    cISCSIReq;
     /** The request segments - variable in size. */
@@ -531,6 +539,21 @@ typedef struct ISCSIIMAGE
     uint32_t            cbSendDataLength;
     /** Negotiated maximum data length when receiving from target. */
     uint32_t            cbRecvDataLength;
+    /** Negotiated maximum amount of data sent for one R2T or unsolicited. */
+    uint32_t            cbMaxBurstLength;
+    /** Negotiated maximum amount of unsolicited data sent for a command. */
+    uint32_t            cbFirstBurstLength;
+    /** Flag whether immediate data was negotiated for the session. */
+    bool                fImmediateData;
+    /** Flag whether the target requires an R2T before any Data-Out PDU. */
+    bool                fInitialR2T;
+    /** Flag whether to offer immediate data during login. */
+    bool                fImmediateDataCfg;
+    /** Flag whether to request an R2T before any Data-Out PDU during login. */
+    bool                fInitialR2TCfg;
+    /** Maximum number of commands sent to the target without a response yet,
+     * 0 if only limited by the command window of the target. */
+    uint32_t            cCmdsOutstandingMax;
 
     /** Current state of the connection/session. */
     ISCSISTATE          state;
@@ -604,6 +627,8 @@ typedef struct ISCSIIMAGE
      * Used for timeout handling for poll.
      */
     unsigned            cCmdsWaiting;
+    /** Maximum number of commands waiting for an answer seen so far. */
+    unsigned            cCmdsWaitingMax;
     /** Table of commands waiting for a response from the target. */
     PISCSICMD           aCmdsWaiting[ISCSI_CMD_WAITING_ENTRIES];
 
@@ -634,6 +659,15 @@ static const char *s_iscsiConfigDefaultHostIPStack = "1";
 /** Default dump malformed packet configuration value. */
 static const char *s_iscsiConfigDefaultDumpMalformedPackets = "0";
 
+/** Default immediate data configuration value. */
+static const char *s_iscsiConfigDefaultImmediateData = "1";
+
+/** Default initial R2T configuration value, send unsolicited data. */
+static const char *s_iscsiConfigDefaultInitialR2T = "0";
+
+/** Default maximum number of outstanding commands, only limited by the target. */
+static const char *s_iscsiConfigDefaultMaxOutstandingCmds = "0";
+
 /** Description of all accepted config parameters. */
 static const VDCONFIGINFO s_iscsiConfigInfo[] =
 {
@@ -650,6 +684,9 @@ static const VDCONFIGINFO s_iscsiConfigInfo[] =
     { "Timeout",              s_iscsiConfigDefaultTimeout,               VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { "HostIPStack",          s_iscsiConfigDefaultHostIPStack,           VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { "DumpMalformedPackets", s_iscsiConfigDefaultDumpMalformedPackets,  VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "ImmediateData",        s_iscsiConfigDefaultImmediateData,         VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "InitialR2T",           s_iscsiConfigDefaultInitialR2T,            VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { "MaxOutstandingCmds",   s_iscsiConfigDefaultMaxOutstandingCmds,    VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
     { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
 };
 
@@ -666,8 +703,11 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage);
 static int iscsiValidatePDU(PISCSIRES paRes, uint32_t cnRes);
 static int iscsiRecvPDUProcess(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnRes);
 static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd);
+static int iscsiPDUTxPrepareDataOut(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, uint32_t Ttt,
+                                    size_t offData, size_t cbData, bool fR2T);
 static int iscsiRecvPDUUpdateRequest(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnRes);
 static void iscsiCmdComplete(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd);
+static void iscsiCmdDataOutRelease(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd);
 static int iscsiTextAddKeyValue(uint8_t *pbBuf, size_t cbBuf, size_t *pcbBufCurr, const char *pcszKey, const char *pcszValue, size_t cbValue);
 static int iscsiTextGetKeyValue(const uint8_t *pbBuf, size_t cbBuf, const char *pcszKey, const char **ppcszValue);
 static int iscsiStrToBinary(const char *pcszValue, uint8_t *pbValue, size_t *pcbValue);
@@ -738,6 +778,8 @@ static void iscsiCmdInsert(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     pIScsiCmd->pNext = pIScsiCmdOld;
     pImage->aCmdsWaiting[idx] = pIScsiCmd;
     pImage->cCmdsWaiting++;
+    if (pImage->cCmdsWaiting > pImage->cCmdsWaitingMax)
+        pImage->cCmdsWaitingMax = pImage->cCmdsWaiting;
 }
 
 static PISCSICMD iscsiCmdRemove(PISCSIIMAGE pImage, uint32_t Itt)
@@ -1229,8 +1271,12 @@ static int iscsiAttach(void *pvUser)
     PISCSIIMAGE pImage = (PISCSIIMAGE)pvUser;
 
     bool fParameterNeg = true;;
-    pImage->cbRecvDataLength = ISCSI_DATA_LENGTH_MAX;
-    pImage->cbSendDataLength = RT_MIN(ISCSI_DATA_LENGTH_MAX, pImage->cbWriteSplit);
+    pImage->cbRecvDataLength   = ISCSI_DATA_LENGTH_MAX;
+    pImage->cbSendDataLength   = RT_MIN(ISCSI_DATA_LENGTH_MAX, pImage->cbWriteSplit);
+    pImage->cbMaxBurstLength   = ISCSI_DATA_LENGTH_MAX;
+    pImage->cbFirstBurstLength = ISCSI_DATA_LENGTH_MAX;
+    pImage->fImmediateData     = pImage->fImmediateDataCfg;
+    pImage->fInitialR2T        = pImage->fInitialR2TCfg;
     char szMaxDataLength[16];
     RTStrPrintf(szMaxDataLength, sizeof(szMaxDataLength), "%u", ISCSI_DATA_LENGTH_MAX);
     ISCSIPARAMETER aParameterNeg[] =
@@ -1238,8 +1284,8 @@ static int iscsiAttach(void *pvUser)
         { "HeaderDigest", "None", 0 },
         { "DataDigest", "None", 0 },
         { "MaxConnections", "1", 0 },
-        { "InitialR2T", "No", 0 },
-        { "ImmediateData", "Yes", 0 },
+        { "InitialR2T", pImage->fInitialR2TCfg ? "Yes" : "No", 0 },
+        { "ImmediateData", pImage->fImmediateDataCfg ? "Yes" : "No", 0 },
         { "MaxRecvDataSegmentLength", szMaxDataLength, 0 },
         { "MaxBurstLength", szMaxDataLength, 0 },
         { "FirstBurstLength", szMaxDataLength, 0 },
@@ -2301,6 +2347,11 @@ static void iscsiRecvPDUReset(PISCSIIMAGE pImage)
 
 static void iscsiPDUTxAdd(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDUTx, bool fFront)
 {
+    /* The PDU might be the head of a chain of PDUs which are added in order. */
+    PISCSIPDUTX pIScsiPDUTxLast = pIScsiPDUTx;
+    while (pIScsiPDUTxLast->pNext)
+        pIScsiPDUTxLast = pIScsiPDUTxLast->pNext;
+
     if (!fFront)
     {
         /* Insert PDU at the tail of the list. */
@@ -2308,15 +2359,49 @@ static void iscsiPDUTxAdd(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDUTx, bool fFro
             pImage->pIScsiPDUTxHead = pIScsiPDUTx;
         else
             pImage->pIScsiPDUTxTail->pNext = pIScsiPDUTx;
-        pImage->pIScsiPDUTxTail = pIScsiPDUTx;
+        pImage->pIScsiPDUTxTail = pIScsiPDUTxLast;
     }
     else
     {
         /* Insert PDU at the beginning of the list. */
-        pIScsiPDUTx->pNext = pImage->pIScsiPDUTxHead;
+        pIScsiPDUTxLast->pNext = pImage->pIScsiPDUTxHead;
         pImage->pIScsiPDUTxHead = pIScsiPDUTx;
         if (!pImage->pIScsiPDUTxTail)
-            pImage->pIScsiPDUTxTail = pIScsiPDUTx;
+            pImage->pIScsiPDUTxTail = pIScsiPDUTxLast;
+    }
+}
+
+/**
+ * Adds a chain of Data-Out PDUs answering an R2T to the list.
+ *
+ * The PDUs are sent before any new command but after the Data-Out PDUs of the
+ * same command which are still waiting, the data of a command must be sent in
+ * order.
+ *
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pIScsiPDUTx Head of the PDU chain to add.
+ * @param   pIScsiCmd   The command the PDUs belong to.
+ */
+static void iscsiPDUTxAddR2T(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDUTx, PISCSICMD pIScsiCmd)
+{
+    PISCSIPDUTX pIScsiPDUTxPrev = NULL;
+
+    for (PISCSIPDUTX pIt = pImage->pIScsiPDUTxHead; pIt; pIt = pIt->pNext)
+        if (pIt->pIScsiCmd == pIScsiCmd)
+            pIScsiPDUTxPrev = pIt;
+
+    if (!pIScsiPDUTxPrev)
+        iscsiPDUTxAdd(pImage, pIScsiPDUTx, true /* fFront */);
+    else
+    {
+        PISCSIPDUTX pIScsiPDUTxLast = pIScsiPDUTx;
+        while (pIScsiPDUTxLast->pNext)
+            pIScsiPDUTxLast = pIScsiPDUTxLast->pNext;
+
+        pIScsiPDUTxLast->pNext = pIScsiPDUTxPrev->pNext;
+        pIScsiPDUTxPrev->pNext = pIScsiPDUTx;
+        if (pImage->pIScsiPDUTxTail == pIScsiPDUTxPrev)
+            pImage->pIScsiPDUTxTail = pIScsiPDUTxLast;
     }
 }
 
@@ -2400,11 +2485,21 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage)
          * If there is no PDU active, get the first one from the list.
          * Check that we are allowed to transfer the PDU by comparing the
          * command sequence number and the maximum sequence number allowed by the target.
+         * Data-Out PDUs belong to a command which was sent already and are not
+         * subject to the command window. New commands are also limited by the
+         * configured maximum number of outstanding commands.
          */
         if (!pImage->pIScsiPDUTxCur)
         {
-            if (   !pImage->pIScsiPDUTxHead
-                || serial_number_greater(pImage->pIScsiPDUTxHead->CmdSN, pImage->MaxCmdSN))
+            PISCSIPDUTX pIScsiPDUTx = pImage->pIScsiPDUTxHead;
+
+            if (   !pIScsiPDUTx
+                || (   !pIScsiPDUTx->fDataOut
+                    && serial_number_greater(pIScsiPDUTx->CmdSN, pImage->MaxCmdSN))
+                || (   pIScsiPDUTx->pIScsiCmd
+                    && !pIScsiPDUTx->fDataOut
+                    && pImage->cCmdsOutstandingMax
+                    && pImage->cCmdsWaiting >= pImage->cCmdsOutstandingMax))
                 break;
 
             pImage->pIScsiPDUTxCur = pImage->pIScsiPDUTxHead;
@@ -2424,13 +2519,20 @@ static int iscsiSendPDUAsync(PISCSIIMAGE pImage)
             if (!pImage->pIScsiPDUTxCur->cbSgLeft)
             {
                 /* PDU completed, free it and place the command on the waiting for response list. */
-                if (pImage->pIScsiPDUTxCur->pIScsiCmd)
+                PISCSIPDUTX pIScsiPDUTx = pImage->pIScsiPDUTxCur;
+
+                pImage->pIScsiPDUTxCur = NULL;
+                if (pIScsiPDUTx->fDataOut)
+                {
+                    LogFlow(("Sent complete Data-Out PDU\n"));
+                    iscsiCmdDataOutRelease(pImage, pIScsiPDUTx->pIScsiCmd);
+                }
+                else if (pIScsiPDUTx->pIScsiCmd)
                 {
                     LogFlow(("Sent complete PDU, placing on waiting list\n"));
-                    iscsiCmdInsert(pImage, pImage->pIScsiPDUTxCur->pIScsiCmd);
+                    iscsiCmdInsert(pImage, pIScsiPDUTx->pIScsiCmd);
                 }
-                RTMemFree(pImage->pIScsiPDUTxCur);
-                pImage->pIScsiPDUTxCur = NULL;
+                RTMemFree(pIScsiPDUTx);
             }
         }
     } while (   RT_SUCCESS(rc)
@@ -2582,6 +2684,11 @@ static int iscsiRecvPDUProcess(PISCSIIMAGE pImage, PISCSIRES paRes, uint32_t cnR
                     if (!pImage->pIScsiPDUTxCur)
                         rc = iscsiSendPDUAsync(pImage);
                 }
+                else if (!pImage->pIScsiPDUTxCur)
+                {
+                    /* The target might have opened the command window, try to send more PDUs. */
+                    rc = iscsiSendPDUAsync(pImage);
+                }
             }
         } while (0);
     }
@@ -2672,8 +2779,16 @@ static int iscsiValidatePDU(PISCSIRES paRes, uint32_t cnRes)
                 ||  (RT_N2H_U32(pcrgResBHS[4]) != ISCSI_TASK_TAG_RSVD))
                 return VERR_PARSE_ERROR;
             break;
-        case ISCSIOP_SCSI_TASKMGMT_RES:
         case ISCSIOP_R2T:
+            /* R2Ts must have the final bit set, may not contain any data and must
+             * request a transfer for a valid initiator task tag. */
+            if (    ((hw0 & ISCSI_FINAL_BIT) == 0)
+                ||  (RT_N2H_U32(pcrgResBHS[1]) != 0)
+                ||  (RT_N2H_U32(pcrgResBHS[4]) == ISCSI_TASK_TAG_RSVD)
+                ||  (RT_N2H_U32(pcrgResBHS[11]) == 0))
+                return VERR_PARSE_ERROR;
+            break;
+        case ISCSIOP_SCSI_TASKMGMT_RES:
         case ISCSIOP_REJECT:
         default:
             /* Do some logging, ignore PDU. */
@@ -2689,6 +2804,146 @@ static int iscsiValidatePDU(PISCSIRES paRes, uint32_t cnRes)
 }
 
 
+/**
+ * Adds the given range of the initiator to target data of a SCSI request
+ * to the segments of a PDU, padding it to a multiple of 4 bytes.
+ *
+ * @returns Number of bytes added including the padding.
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pIScsiPDU   The PDU to add the data to. Must have room for the
+ *                      I2T segments of the request plus one for the padding.
+ * @param   pScsiReq    The SCSI request the data belongs to.
+ * @param   offData     Offset into the initiator to target data.
+ * @param   cbData      Number of bytes to add.
+ */
+static size_t iscsiPDUTxAddData(PISCSIIMAGE pImage, PISCSIPDUTX pIScsiPDU, PSCSIREQ pScsiReq,
+                                size_t offData, size_t cbData)
+{
+    RTSGBUF SgBuf;
+    unsigned cSegs = pScsiReq->cI2TSegs;
+
+    RTSgBufInit(&SgBuf, pScsiReq->paI2TSegs, pScsiReq->cI2TSegs);
+    RTSgBufAdvance(&SgBuf, offData);
+
+    size_t cbSegs = RTSgBufSegArrayCreate(&SgBuf, &pIScsiPDU->aISCSIReq[pIScsiPDU->cISCSIReq],
+                                          &cSegs, cbData);
+    Assert(cbSegs == cbData);
+    pIScsiPDU->cISCSIReq += cSegs;
+
+    /* Add padding if necessary. */
+    if (cbData & 3)
+    {
+        pIScsiPDU->aISCSIReq[pIScsiPDU->cISCSIReq].pvSeg = &pImage->aPadding[0];
+        pIScsiPDU->aISCSIReq[pIScsiPDU->cISCSIReq].cbSeg = 4 - (cbData & 3);
+        cbSegs += pIScsiPDU->aISCSIReq[pIScsiPDU->cISCSIReq].cbSeg;
+        pIScsiPDU->cISCSIReq++;
+    }
+
+    return cbSegs;
+}
+
+/**
+ * Prepares the Data-Out PDUs transferring the given range of the write data
+ * of a command and adds them to the list.
+ *
+ * @returns VBox status code.
+ * @param   pImage      The iSCSI connection state to be used.
+ * @param   pIScsiCmd   The command the data belongs to.
+ * @param   Ttt         The target transfer tag from the R2T in network byte order,
+ *                      ISCSI_TASK_TAG_RSVD for unsolicited data.
+ * @param   offData     Offset of the first byte to transfer.
+ * @param   cbData      Number of bytes to transfer.
+ * @param   fR2T        Flag whether the PDUs answer an R2T and are sent before
+ *                      any new command, see iscsiPDUTxAddR2T().
+ */
+static int iscsiPDUTxPrepareDataOut(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, uint32_t Ttt,
+                                    size_t offData, size_t cbData, bool fR2T)
+{
+    PSCSIREQ pScsiReq = pIScsiCmd->CmdType.ScsiReq.pScsiReq;
+    PISCSIPDUTX pIScsiPDUHead = NULL;
+    PISCSIPDUTX pIScsiPDUTail = NULL;
+    uint32_t DataSN = 0;
+    int rc = VINF_SUCCESS;
+
+    LogFlowFunc(("pImage=%#p pIScsiCmd=%#p Ttt=%#x offData=%zu cbData=%zu\n",
+                 pImage, pIScsiCmd, Ttt, offData, cbData));
+
+    /* The sequence is split into PDUs the target is able to receive. */
+    while (cbData)
+    {
+        size_t cbPDU = RT_MIN(cbData, pImage->cbSendDataLength);
+        PISCSIPDUTX pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[pScsiReq->cI2TSegs + 2]));
+        if (!pIScsiPDU)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+
+        uint32_t *paReqBHS = pIScsiPDU->aBHS;
+        paReqBHS[0]  = RT_H2N_U32((cbPDU == cbData ? ISCSI_FINAL_BIT : 0) | ISCSIOP_SCSI_DATA_OUT);
+        paReqBHS[1]  = RT_H2N_U32(0x00000000 | ((uint32_t)cbPDU & 0xffffff)); /* TotalAHSLength=0 */
+        paReqBHS[2]  = RT_H2N_U32(pImage->LUN >> 32);
+        paReqBHS[3]  = RT_H2N_U32(pImage->LUN & 0xffffffff);
+        paReqBHS[4]  = pIScsiCmd->Itt;
+        paReqBHS[5]  = Ttt;
+        paReqBHS[6]  = 0;           /* reserved */
+        paReqBHS[7]  = RT_H2N_U32(pImage->ExpStatSN);
+        paReqBHS[8]  = 0;           /* reserved */
+        paReqBHS[9]  = RT_H2N_U32(DataSN);
+        paReqBHS[10] = RT_H2N_U32((uint32_t)offData);
+        paReqBHS[11] = 0;           /* reserved */
+
+        pIScsiPDU->pIScsiCmd = pIScsiCmd;
+        pIScsiPDU->fDataOut  = true;
+        pIScsiPDU->aISCSIReq[0].cbSeg = sizeof(pIScsiPDU->aBHS);
+        pIScsiPDU->aISCSIReq[0].pvSeg = pIScsiPDU->aBHS;
+        pIScsiPDU->cISCSIReq = 1;
+        pIScsiPDU->cbSgLeft  =   sizeof(pIScsiPDU->aBHS)
+                               + iscsiPDUTxAddData(pImage, pIScsiPDU, pScsiReq, offData, cbPDU);
+        RTSgBufInit(&pIScsiPDU->SgBuf, pIScsiPDU->aISCSIReq, pIScsiPDU->cISCSIReq);
+
+        if (pIScsiPDUTail)
+            pIScsiPDUTail->pNext = pIScsiPDU;
+        else
+            pIScsiPDUHead = pIScsiPDU;
+        pIScsiPDUTail = pIScsiPDU;
+
+        DataSN++;
+        offData += cbPDU;
+        cbData  -= cbPDU;
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        if (pIScsiPDUHead)
+        {
+            for (PISCSIPDUTX pIt = pIScsiPDUHead; pIt; pIt = pIt->pNext)
+                pIScsiCmd->cDataOutPending++;
+
+            /* Link the PDUs to the list. */
+            if (fR2T)
+                iscsiPDUTxAddR2T(pImage, pIScsiPDUHead, pIScsiCmd);
+            else
+                iscsiPDUTxAdd(pImage, pIScsiPDUHead, false /* fFront */);
+
+            /* Start transfer of a PDU if there is no one active at the moment. */
+            if (!pImage->pIScsiPDUTxCur)
+                rc = iscsiSendPDUAsync(pImage);
+        }
+    }
+    else
+    {
+        while (pIScsiPDUHead)
+        {
+            PISCSIPDUTX pIScsiPDUFree = pIScsiPDUHead;
+            pIScsiPDUHead = pIScsiPDUHead->pNext;
+            RTMemFree(pIScsiPDUFree);
+        }
+    }
+
+    return rc;
+}
+
 /**
  * Prepares a PDU to transfer for the given command and adds it to the list.
  */
@@ -2698,12 +2953,15 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     uint32_t *paReqBHS;
     size_t cbData = 0;
     size_t cbSegs = 0;
+    size_t cbImmediate = 0;
+    size_t cbUnsolicited = 0;
     PSCSIREQ pScsiReq;
     PISCSIPDUTX pIScsiPDU = NULL;
 
     LogFlowFunc(("pImage=%#p pIScsiCmd=%#p\n", pImage, pIScsiCmd));
 
     Assert(pIScsiCmd->enmCmdType == ISCSICMDTYPE_REQ);
+    Assert(!pIScsiCmd->cDataOutPending);
 
     pIScsiCmd->Itt = iscsiNewITT(pImage);
     pScsiReq = pIScsiCmd->CmdType.ScsiReq.pScsiReq;
@@ -2712,11 +2970,9 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
         RTSgBufInit(&pScsiReq->SgBufT2I, pScsiReq->paT2ISegs, pScsiReq->cT2ISegs);
 
     /*
-     * Allocate twice as much entries as required for padding (worst case).
-     * The additional segment is for the BHS.
+     * One segment for the BHS, the I2T segments and one for the padding.
      */
-    size_t cI2TSegs = 2*(pScsiReq->cI2TSegs + 1);
-    pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[cI2TSegs]));
+    pIScsiPDU = (PISCSIPDUTX)RTMemAllocZ(RT_OFFSETOF(ISCSIPDUTX, aISCSIReq[pScsiReq->cI2TSegs + 2]));
     if (!pIScsiPDU)
         return VERR_NO_MEMORY;
 
@@ -2727,12 +2983,30 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     else
         cbData = (uint32_t)pScsiReq->cbI2TData;
 
+    /*
+     * Immediate data goes with the command up to the first burst length.
+     * Unless the target wants an R2T first the rest of the first burst follows
+     * in Data-Out PDUs right after the command, everything else is requested
+     * by the target with R2Ts.
+     */
+    if (pScsiReq->cbI2TData)
+    {
+        if (pImage->fImmediateData)
+            cbImmediate = RT_MIN(pScsiReq->cbI2TData,
+                                 RT_MIN(pImage->cbFirstBurstLength, pImage->cbSendDataLength));
+        if (pImage->fInitialR2T)
+            cbUnsolicited = cbImmediate;
+        else
+            cbUnsolicited = RT_MIN(pScsiReq->cbI2TData, pImage->cbFirstBurstLength);
+    }
+
     paReqBHS = pIScsiPDU->aBHS;
 
     /* Setup the BHS. */
-    paReqBHS[0] = RT_H2N_U32(  ISCSI_FINAL_BIT | ISCSI_TASK_ATTR_SIMPLE | ISCSIOP_SCSI_CMD
-                             | (pScsiReq->enmXfer << 21)); /* I=0,F=1,Attr=Simple */
-    paReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)pScsiReq->cbI2TData & 0xffffff)); /* TotalAHSLength=0 */
+    paReqBHS[0] = RT_H2N_U32(  (cbUnsolicited == cbImmediate ? ISCSI_FINAL_BIT : 0)
+                             | ISCSI_TASK_ATTR_SIMPLE | ISCSIOP_SCSI_CMD
+                             | (pScsiReq->enmXfer << 21)); /* I=0,Attr=Simple */
+    paReqBHS[1] = RT_H2N_U32(0x00000000 | ((uint32_t)cbImmediate & 0xffffff)); /* TotalAHSLength=0 */
     paReqBHS[2] = RT_H2N_U32(pImage->LUN >> 32);
     paReqBHS[3] = RT_H2N_U32(pImage->LUN & 0xffffffff);
     paReqBHS[4] = pIScsiCmd->Itt;
@@ -2752,37 +3026,24 @@ static int iscsiPDUTxPrepare(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
     cbSegs = sizeof(pIScsiPDU->aBHS);
     /* Padding is not necessary for the BHS. */
 
-    if (pScsiReq->cbI2TData)
-    {
-        for (unsigned cSeg = 0; cSeg < pScsiReq->cI2TSegs; cSeg++)
-        {
-            Assert(cnISCSIReq < cI2TSegs);
-            pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = pScsiReq->paI2TSegs[cSeg].cbSeg;
-            pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = pScsiReq->paI2TSegs[cSeg].pvSeg;
-            cbSegs += pScsiReq->paI2TSegs[cSeg].cbSeg;
-            cnISCSIReq++;
-
-            /* Add padding if necessary. */
-            if (pScsiReq->paI2TSegs[cSeg].cbSeg & 3)
-            {
-                Assert(cnISCSIReq < cI2TSegs);
-                pIScsiPDU->aISCSIReq[cnISCSIReq].pvSeg = &pImage->aPadding[0];
-                pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg = 4 - (pScsiReq->paI2TSegs[cSeg].cbSeg & 3);
-                cbSegs += pIScsiPDU->aISCSIReq[cnISCSIReq].cbSeg;
-                cnISCSIReq++;
-            }
-        }
-    }
-
     pIScsiPDU->cISCSIReq = cnISCSIReq;
+    if (cbImmediate)
+        cbSegs += iscsiPDUTxAddData(pImage, pIScsiPDU, pScsiReq, 0, cbImmediate);
+
     pIScsiPDU->cbSgLeft  = cbSegs;
-    RTSgBufInit(&pIScsiPDU->SgBuf, pIScsiPDU->aISCSIReq, cnISCSIReq);
+    RTSgBufInit(&pIScsiPDU->SgBuf, pIScsiPDU->aISCSIReq, pIScsiPDU->cISCSIReq);
 
     /* Link the PDU to the list. */
     iscsiPDUTxAdd(pImage, pIScsiPDU, false /* fFront */);
 
+    /* The unsolicited data must follow the command immediately. */
+    if (cbUnsolicited > cbImmediate)
+        rc = iscsiPDUTxPrepareDataOut(pImage, pIScsiCmd, RT_H2N_U32(ISCSI_TASK_TAG_RSVD),
+                                      cbImmediate, cbUnsolicited - cbImmediate, false /* fR2T */);
+
     /* Start transfer of a PDU if there is no one active at the moment. */
-    if (!pImage->pIScsiPDUTxCur)
+    if (   RT_SUCCESS(rc)
+        && !pImage->pIScsiPDUTxCur)
         rc = iscsiSendPDUAsync(pImage);
 
     return rc;
@@ -2892,6 +3153,31 @@ static int iscsiRecvPDUUpdateRequest(PISCSIIMAGE pImage, PISCSIRES paRes, uint32
                 }
             }
         }
+        else if (cmd == ISCSIOP_R2T)
+        {
+            /* The target is ready to receive the given range of the write data,
+             * send it with Data-Out PDUs as soon as possible. */
+            uint64_t offData = RT_N2H_U32(paResBHS[10]);
+            uint64_t cbData  = RT_N2H_U32(paResBHS[11]);
+
+            if (   pScsiReq->enmXfer != SCSIXFER_TO_TARGET
+                || cbData > pImage->cbMaxBurstLength
+                || offData + cbData > pScsiReq->cbI2TData)
+            {
+                /*
+                 * The target and the initiator disagree about the command. Ignoring
+                 * the R2T would stall the command until the timeout hits, so let the
+                 * caller recover the connection which resends all pending commands.
+                 */
+                LogRel(("iSCSI: Received invalid R2T from target %s (offset=%RU64 length=%RU64), reconnecting\n",
+                        pImage->pszTargetName, offData, cbData));
+                iscsiDumpPacket(pImage, (PISCSIREQ)paRes, cnRes, VERR_NET_PROTOCOL_ERROR, false /* fRequest */);
+                return VERR_NET_PROTOCOL_ERROR;
+            }
+
+            rc = iscsiPDUTxPrepareDataOut(pImage, pIScsiCmd, paResBHS[5], (size_t)offData,
+                                          (size_t)cbData, true /* fR2T */);
+        }
         else
             rc = VERR_PARSE_ERROR;
     }
@@ -3116,6 +3402,8 @@ static int iscsiUpdateParameters(PISCSIIMAGE pImage, const uint8_t *pbBuf, size_
     const char *pcszMaxRecvDataSegmentLength = NULL;
     const char *pcszMaxBurstLength = NULL;
     const char *pcszFirstBurstLength = NULL;
+    const char *pcszImmediateData = NULL;
+    const char *pcszInitialR2T = NULL;
     rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "MaxRecvDataSegmentLength", &pcszMaxRecvDataSegmentLength);
     if (rc == VERR_INVALID_NAME)
         rc = VINF_SUCCESS;
@@ -3127,6 +3415,16 @@ static int iscsiUpdateParameters(PISCSIIMAGE pImage, const uint8_t *pbBuf, size_
     if (RT_FAILURE(rc))
         return VERR_PARSE_ERROR;
     rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "FirstBurstLength", &pcszFirstBurstLength);
+    if (rc == VERR_INVALID_NAME)
+        rc = VINF_SUCCESS;
+    if (RT_FAILURE(rc))
+        return VERR_PARSE_ERROR;
+    rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "ImmediateData", &pcszImmediateData);
+    if (rc == VERR_INVALID_NAME)
+        rc = VINF_SUCCESS;
+    if (RT_FAILURE(rc))
+        return VERR_PARSE_ERROR;
+    rc = iscsiTextGetKeyValue(pbBuf, cbBuf, "InitialR2T", &pcszInitialR2T);
     if (rc == VERR_INVALID_NAME)
         rc = VINF_SUCCESS;
     if (RT_FAILURE(rc))
@@ -3140,18 +3438,25 @@ static int iscsiUpdateParameters(PISCSIIMAGE pImage, const uint8_t *pbBuf, size_
     }
     if (pcszMaxBurstLength)
     {
-        uint32_t cb = pImage->cbSendDataLength;
+        uint32_t cb = pImage->cbMaxBurstLength;
         rc = RTStrToUInt32Full(pcszMaxBurstLength, 0, &cb);
         AssertRC(rc);
-        pImage->cbSendDataLength = RT_MIN(pImage->cbSendDataLength, cb);
+        pImage->cbMaxBurstLength = RT_MIN(pImage->cbMaxBurstLength, cb);
     }
     if (pcszFirstBurstLength)
     {
-        uint32_t cb = pImage->cbSendDataLength;
+        uint32_t cb = pImage->cbFirstBurstLength;
         rc = RTStrToUInt32Full(pcszFirstBurstLength, 0, &cb);
         AssertRC(rc);
-        pImage->cbSendDataLength = RT_MIN(pImage->cbSendDataLength, cb);
+        pImage->cbFirstBurstLength = RT_MIN(pImage->cbFirstBurstLength, cb);
     }
+    /* The result of ImmediateData is the AND of both sides, InitialR2T the OR. */
+    if (pcszImmediateData)
+        pImage->fImmediateData = pImage->fImmediateData && !strcmp(pcszImmediateData, "Yes");
+    if (pcszInitialR2T)
+        pImage->fInitialR2T = pImage->fInitialR2T || !strcmp(pcszInitialR2T, "Yes");
+    /* The first burst can't be larger than a burst. */
+    pImage->cbFirstBurstLength = RT_MIN(pImage->cbFirstBurstLength, pImage->cbMaxBurstLength);
     return VINF_SUCCESS;
 }
 
@@ -3265,6 +3570,43 @@ static void iscsiCmdComplete(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd)
     /* Remove from the table first. */
     iscsiCmdRemove(pImage, pIScsiCmd->Itt);
 
+    if (pIScsiCmd->cDataOutPending)
+    {
+        /* The target doesn't want the data anymore, drop the Data-Out PDUs not sent yet. */
+        PISCSIPDUTX pIScsiPDUTxPrev = NULL;
+        PISCSIPDUTX pIScsiPDUTx = pImage->pIScsiPDUTxHead;
+
+        while (pIScsiPDUTx)
+        {
+            PISCSIPDUTX pIScsiPDUTxNext = pIScsiPDUTx->pNext;
+
+            if (   pIScsiPDUTx->fDataOut
+                && pIScsiPDUTx->pIScsiCmd == pIScsiCmd)
+            {
+                if (pIScsiPDUTxPrev)
+                    pIScsiPDUTxPrev->pNext = pIScsiPDUTxNext;
+                else
+                    pImage->pIScsiPDUTxHead = pIScsiPDUTxNext;
+                if (pImage->pIScsiPDUTxTail == pIScsiPDUTx)
+                    pImage->pIScsiPDUTxTail = pIScsiPDUTxPrev;
+                RTMemFree(pIScsiPDUTx);
+                pIScsiCmd->cDataOutPending--;
+            }
+            else
+                pIScsiPDUTxPrev = pIScsiPDUTx;
+
+            pIScsiPDUTx = pIScsiPDUTxNext;
+        }
+
+        /* A Data-Out PDU still in transfer references the data, complete after it was sent. */
+        if (pIScsiCmd->cDataOutPending)
+        {
+            pIScsiCmd->fCompletePending = true;
+            pIScsiCmd->rcCmdPending     = rcCmd;
+            return;
+        }
+    }
+
     /* Call completion callback. */
     pIScsiCmd->pfnComplete(pImage, rcCmd, pIScsiCmd->pvUser);
 
@@ -3275,6 +3617,20 @@ static void iscsiCmdComplete(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd, int rcCmd)
     RTMemFree(pIScsiCmd);
 }
 
+/**
+ * Internal. - Releases a Data-Out PDU of the given command after it was sent
+ *             or aborted, completing the command if it is waiting for it.
+ */
+static void iscsiCmdDataOutRelease(PISCSIIMAGE pImage, PISCSICMD pIScsiCmd)
+{
+    Assert(pIScsiCmd->cDataOutPending);
+
+    pIScsiCmd->cDataOutPending--;
+    if (   !pIScsiCmd->cDataOutPending
+        && pIScsiCmd->fCompletePending)
+        iscsiCmdComplete(pImage, pIScsiCmd, pIScsiCmd->rcCmdPending);
+}
+
 /**
  * Reattaches the to the target after an error aborting
  * pending commands and resending them.
@@ -3307,7 +3663,10 @@ static void iscsiReattach(PISCSIIMAGE pImage)
 
         pIScsiCmd = pIScsiPDUTx->pIScsiCmd;
 
-        if (pIScsiCmd)
+        /* The command of a Data-Out PDU is already on the waiting list. */
+        if (pIScsiPDUTx->fDataOut)
+            iscsiCmdDataOutRelease(pImage, pIScsiCmd);
+        else if (pIScsiCmd)
         {
             /* Place on command list. */
             pIScsiCmd->pNext = pIScsiCmdHead;
@@ -3327,7 +3686,9 @@ static void iscsiReattach(PISCSIIMAGE pImage)
         pImage->pIScsiPDUTxCur = NULL;
         pIScsiCmd = pIScsiPDUTx->pIScsiCmd;
 
-        if (pIScsiCmd)
+        if (pIScsiPDUTx->fDataOut)
+            iscsiCmdDataOutRelease(pImage, pIScsiCmd);
+        else if (pIScsiCmd)
         {
             pIScsiCmd->pNext = pIScsiCmdHead;
             pIScsiCmdHead = pIScsiCmd;
@@ -3476,7 +3837,8 @@ static DECLCALLBACK(int) iscsiIoThreadWorker(RTTHREAD ThreadSelf, void *pvUser)
                 /* Continue or start a new PDU receive task */
                 LogFlow(("There is data on the socket\n"));
                 rc = iscsiRecvPDUAsync(pImage);
-                if (rc == VERR_BROKEN_PIPE)
+                if (   rc == VERR_BROKEN_PIPE
+                    || rc == VERR_NET_PROTOCOL_ERROR)
                     iscsiReattach(pImage);
                 else if (RT_FAILURE(rc))
                     iscsiLogRel(pImage, "iSCSI: Handling incoming request failed %Rrc\n", rc);
@@ -3822,6 +4184,9 @@ static int iscsiOpenImage(PISCSIIMAGE pImage, unsigned uOpenFlags)
     uint64_t uCfgTmp = 0;
     bool fHostIPDef = false;
     bool fDumpMalformedPacketsDef = false;
+    bool fImmediateDataDef = false;
+    bool fInitialR2TDef = false;
+    uint32_t cCmdsOutstandingMaxDef = 0;
     rc = RTStrToUInt32Full(s_iscsiConfigDefaultWriteSplit, 0, &uWriteSplitDef);
     AssertRC(rc);
     rc = RTStrToUInt32Full(s_iscsiConfigDefaultTimeout, 0, &uTimeoutDef);
@@ -3834,6 +4199,17 @@ static int iscsiOpenImage(PISCSIIMAGE pImage, unsigned uOpenFlags)
     AssertRC(rc);
     fDumpMalformedPacketsDef = RT_BOOL(uCfgTmp);
 
+    rc = RTStrToUInt64Full(s_iscsiConfigDefaultImmediateData, 0, &uCfgTmp);
+    AssertRC(rc);
+    fImmediateDataDef = RT_BOOL(uCfgTmp);
+
+    rc = RTStrToUInt64Full(s_iscsiConfigDefaultInitialR2T, 0, &uCfgTmp);
+    AssertRC(rc);
+    fInitialR2TDef = RT_BOOL(uCfgTmp);
+
+    rc = RTStrToUInt32Full(s_iscsiConfigDefaultMaxOutstandingCmds, 0, &cCmdsOutstandingMaxDef);
+    AssertRC(rc);
+
     pImage->uOpenFlags      = uOpenFlags;
 
     /* Get error signalling interface. */
@@ -4072,6 +4448,33 @@ static int iscsiOpenImage(PISCSIIMAGE pImage, unsigned uOpenFlags)
         goto out;
     }
 
+    rc = VDCFGQueryBoolDef(pImage->pIfConfig,
+                           "ImmediateData", &pImage->fImmediateDataCfg,
+                           fImmediateDataDef);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read ImmediateData as boolean"));
+        goto out;
+    }
+
+    rc = VDCFGQueryBoolDef(pImage->pIfConfig,
+                           "InitialR2T", &pImage->fInitialR2TCfg,
+                           fInitialR2TDef);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read InitialR2T as boolean"));
+        goto out;
+    }
+
+    rc = VDCFGQueryU32Def(pImage->pIfConfig,
+                          "MaxOutstandingCmds", &pImage->cCmdsOutstandingMax,
+                          cCmdsOutstandingMaxDef);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("iSCSI: configuration error: failed to read MaxOutstandingCmds as U32"));
+        goto out;
+    }
+
     /* Don't actually establish iSCSI transport connection if this is just an
      * open to query the image information and the host IP stack isn't used.
      * Even trying is rather useless, as in this context the InTnet IP stack
@@ -4110,7 +4513,10 @@ static int iscsiOpenImage(PISCSIIMAGE pImage, unsigned uOpenFlags)
         }
         else
         {
+            /* Without the I/O thread R2Ts are not handled, all data must go with the command. */
             pImage->fExtendedSelectSupported = false;
+            pImage->fImmediateDataCfg = true;
+            pImage->fInitialR2TCfg = false;
             rc = pImage->pIfNet->pfnSocketCreate(0, &pImage->Socket);
             if (RT_FAILURE(rc))
             {
@@ -4797,9 +5203,13 @@ static int iscsiWrite(void *pBackendData, uint64_t uOffset, size_t cbToWrite,
         return VERR_INVALID_PARAMETER;
 
     /*
-     * Clip read size to a value which is supported by the target.
+     * Clip write size to a value which is supported by the target. Without the
+     * I/O thread there is no R2T handling and all data must go with the command.
      */
-    cbToWrite = RT_MIN(cbToWrite, pImage->cbSendDataLength);
+    if (pImage->fExtendedSelectSupported)
+        cbToWrite = RT_MIN(cbToWrite, RT_MIN(pImage->cbWriteSplit, pImage->cbMaxBurstLength));
+    else
+        cbToWrite = RT_MIN(cbToWrite, RT_MIN(pImage->cbSendDataLength, pImage->cbFirstBurstLength));
 
     unsigned cI2TSegs = 0;
     size_t   cbSegs = 0;
@@ -5399,6 +5809,12 @@ static void iscsiDump(void *pBackendData)
     {
         /** @todo put something useful here */
         vdIfErrorMessage(pImage->pIfError, "Header: cVolume=%u\n", pImage->cVolume);
+        vdIfErrorMessage(pImage->pIfError, "Session: ImmediateData=%RTbool InitialR2T=%RTbool FirstBurstLength=%u MaxBurstLength=%u MaxSendDataSegmentLength=%u\n",
+                         pImage->fImmediateData, pImage->fInitialR2T, pImage->cbFirstBurstLength,
+                         pImage->cbMaxBurstLength, pImage->cbSendDataLength);
+        vdIfErrorMessage(pImage->pIfError, "Commands: CmdSN=%u ExpCmdSN=%u MaxCmdSN=%u cCmdsWaiting=%u cCmdsWaitingMax=%u cCmdsOutstandingMax=%u\n",
+                         pImage->CmdSN, pImage->ExpCmdSN, pImage->MaxCmdSN, pImage->cCmdsWaiting,
+                         pImage->cCmdsWaitingMax, pImage->cCmdsOutstandingMax);
     }
 }
 
@@ -29,6 +29,7 @@
 #include <iprt/alloc.h>
 #include <iprt/path.h>
 #include <iprt/list.h>
+#include <iprt/avl.h>
 
 #include "VDBackends.h"
 
@@ -139,8 +140,9 @@ typedef QCowHeader *PQCowHeader;
  */
 typedef struct QCOWL2CACHEENTRY
 {
-    /** List node for the search list. */
-    RTLISTNODE              NodeSearch;
+    /** AVL tree node for the lookup, the key range covers the whole L2 table
+     * starting at offL2Tbl. Must be first. */
+    AVLRU64NODECORE         Core;
     /** List node for the LRU list. */
     RTLISTNODE              NodeLru;
     /** Reference counter. */
@@ -151,8 +153,10 @@ typedef struct QCOWL2CACHEENTRY
     uint64_t               *paL2Tbl;
 } QCOWL2CACHEENTRY, *PQCOWL2CACHEENTRY;
 
-/** Maximum amount of memory the cache is allowed to use. */
-#define QCOW_L2_CACHE_MEMORY_MAX (2*_1M)
+/** Default amount of memory the cache is allowed to use. */
+#define QCOW_L2_CACHE_MEMORY_DEF (2*_1M)
+/** Minimum amount of memory the cache can be configured to use. */
+#define QCOW_L2_CACHE_MEMORY_MIN (256*_1K)
 
 /** QCOW default cluster size for image version 2. */
 #define QCOW2_CLUSTER_SIZE_DEFAULT (64*_1K)
@@ -222,10 +226,18 @@ typedef struct QCOWIMAGE
     uint32_t            cL2TableEntries;
     /** Memory occupied by the L2 table cache. */
     size_t              cbL2Cache;
-    /** The sorted L2 entry list used for searching. */
-    RTLISTNODE          ListSearch;
+    /** Maximum amount of memory the L2 table cache is allowed to use. */
+    uint64_t            cbL2CacheMax;
+    /** The AVL tree of cached L2 tables used for searching. */
+    AVLRU64TREE         TreeL2Cache;
     /** The LRU L2 entry list used for eviction. */
     RTLISTNODE          ListLru;
+    /** Statistics: Number of L2 table lookups served from the cache. */
+    uint64_t            cL2CacheHits;
+    /** Statistics: Number of L2 table lookups which had to go to the image. */
+    uint64_t            cL2CacheMisses;
+    /** Statistics: Number of L2 tables evicted from the cache. */
+    uint64_t            cL2CacheEvictions;
 
     /** Offset of the refcount table. */
     uint64_t            offRefcountTable;
@@ -291,6 +303,16 @@ typedef struct QCOWCLUSTERASYNCALLOC
 *   Static Variables                                                           *
 *******************************************************************************/
 
+/** Default L2 table cache size, must match QCOW_L2_CACHE_MEMORY_DEF. */
+static const char *s_qcowConfigDefaultL2CacheSize = "2097152";
+
+/** Description of all accepted config parameters. */
+static const VDCONFIGINFO s_qcowConfigInfo[] =
+{
+    { "L2CacheSize",          s_qcowConfigDefaultL2CacheSize,            VDCFGVALUETYPE_INTEGER, VD_CFGKEY_EXPERT },
+    { NULL,                   NULL,                                      VDCFGVALUETYPE_INTEGER, 0 }
+};
+
 /** NULL-terminated array of supported file extensions. */
 static const VDFILEEXTENSION s_aQCowFileExtensions[] =
 {
@@ -490,11 +512,27 @@ static void qcowRefcountTableConvertFromHostEndianess(uint16_t *paTblImg, uint16
  */
 static int qcowL2TblCacheCreate(PQCOWIMAGE pImage)
 {
-    pImage->cbL2Cache = 0;
-    RTListInit(&pImage->ListSearch);
+    int rc = VINF_SUCCESS;
+
+    pImage->cbL2Cache         = 0;
+    pImage->cbL2CacheMax      = QCOW_L2_CACHE_MEMORY_DEF;
+    pImage->TreeL2Cache       = NULL;
+    pImage->cL2CacheHits      = 0;
+    pImage->cL2CacheMisses    = 0;
+    pImage->cL2CacheEvictions = 0;
     RTListInit(&pImage->ListLru);
 
-    return VINF_SUCCESS;
+    /* The cache size can be tuned per image through the configuration interface. */
+    PVDINTERFACECONFIG pIfConfig = VDIfConfigGet(pImage->pVDIfsImage);
+    if (pIfConfig)
+    {
+        rc = VDCFGQueryU64Def(pIfConfig, "L2CacheSize", &pImage->cbL2CacheMax,
+                              QCOW_L2_CACHE_MEMORY_DEF);
+        if (RT_SUCCESS(rc))
+            pImage->cbL2CacheMax = RT_MAX(pImage->cbL2CacheMax, QCOW_L2_CACHE_MEMORY_MIN);
+    }
+
+    return rc;
 }
 
 /**
@@ -508,17 +546,20 @@ static void qcowL2TblCacheDestroy(PQCOWIMAGE pImage)
     PQCOWL2CACHEENTRY pL2Entry = NULL;
     PQCOWL2CACHEENTRY pL2Next  = NULL;
 
-    RTListForEachSafe(&pImage->ListSearch, pL2Entry, pL2Next, QCOWL2CACHEENTRY, NodeSearch)
+    /* Every entry in the tree is on the LRU list as well. */
+    RTListForEachSafe(&pImage->ListLru, pL2Entry, pL2Next, QCOWL2CACHEENTRY, NodeLru)
     {
         Assert(!pL2Entry->cRefs);
 
-        RTListNodeRemove(&pL2Entry->NodeSearch);
+        RTListNodeRemove(&pL2Entry->NodeLru);
+        RTAvlrU64Remove(&pImage->TreeL2Cache, pL2Entry->Core.Key);
         RTMemPageFree(pL2Entry->paL2Tbl, pImage->cbL2Table);
         RTMemFree(pL2Entry);
     }
 
+    Assert(!pImage->TreeL2Cache);
     pImage->cbL2Cache       = 0;
-    RTListInit(&pImage->ListSearch);
+    pImage->TreeL2Cache     = NULL;
     RTListInit(&pImage->ListLru);
 }
 
@@ -531,24 +572,20 @@ static void qcowL2TblCacheDestroy(PQCOWIMAGE pImage)
  */
 static PQCOWL2CACHEENTRY qcowL2TblCacheRetain(PQCOWIMAGE pImage, uint64_t offL2Tbl)
 {
-    PQCOWL2CACHEENTRY pL2Entry = NULL;
-
-    RTListForEach(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch)
-    {
-        if (pL2Entry->offL2Tbl == offL2Tbl)
-            break;
-    }
+    PQCOWL2CACHEENTRY pL2Entry = (PQCOWL2CACHEENTRY)RTAvlrU64Get(&pImage->TreeL2Cache, offL2Tbl);
 
-    if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
+    if (pL2Entry)
     {
         /* Update LRU list. */
         RTListNodeRemove(&pL2Entry->NodeLru);
         RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
         pL2Entry->cRefs++;
+        pImage->cL2CacheHits++;
         return pL2Entry;
     }
-    else
-        return NULL;
+
+    pImage->cL2CacheMisses++;
+    return NULL;
 }
 
 /**
@@ -572,9 +609,8 @@ static void qcowL2TblCacheEntryRelease(PQCOWL2CACHEENTRY pL2Entry)
 static PQCOWL2CACHEENTRY qcowL2TblCacheEntryAlloc(PQCOWIMAGE pImage)
 {
     PQCOWL2CACHEENTRY pL2Entry = NULL;
-    int rc = VINF_SUCCESS;
 
-    if (pImage->cbL2Cache + pImage->cbL2Table <= QCOW_L2_CACHE_MEMORY_MAX)
+    if (pImage->cbL2Cache + pImage->cbL2Table <= pImage->cbL2CacheMax)
     {
         /* Add a new entry. */
         pL2Entry = (PQCOWL2CACHEENTRY)RTMemAllocZ(sizeof(QCOWL2CACHEENTRY));
@@ -604,12 +640,14 @@ static PQCOWL2CACHEENTRY qcowL2TblCacheEntryAlloc(PQCOWIMAGE pImage)
                 break;
         }
 
-        if (!RTListNodeIsDummy(&pImage->ListSearch, pL2Entry, QCOWL2CACHEENTRY, NodeSearch))
+        if (!RTListNodeIsDummy(&pImage->ListLru, pL2Entry, QCOWL2CACHEENTRY, NodeLru))
         {
-            RTListNodeRemove(&pL2Entry->NodeSearch);
+            PAVLRU64NODECORE pNodeRemoved = RTAvlrU64Remove(&pImage->TreeL2Cache, pL2Entry->Core.Key);
+            Assert(pNodeRemoved == &pL2Entry->Core); NOREF(pNodeRemoved);
             RTListNodeRemove(&pL2Entry->NodeLru);
             pL2Entry->offL2Tbl = 0;
             pL2Entry->cRefs    = 1;
+            pImage->cL2CacheEvictions++;
         }
         else
             pL2Entry = NULL;
@@ -643,40 +681,16 @@ static void qcowL2TblCacheEntryFree(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entr
  */
 static void qcowL2TblCacheEntryInsert(PQCOWIMAGE pImage, PQCOWL2CACHEENTRY pL2Entry)
 {
-    PQCOWL2CACHEENTRY pIt = NULL;
-
     Assert(pL2Entry->offL2Tbl > 0);
 
     /* Insert at the top of the LRU list. */
     RTListPrepend(&pImage->ListLru, &pL2Entry->NodeLru);
 
-    if (RTListIsEmpty(&pImage->ListSearch))
-    {
-        RTListAppend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-    }
-    else
-    {
-        /* Insert into search list. */
-        pIt = RTListGetFirst(&pImage->ListSearch, QCOWL2CACHEENTRY, NodeSearch);
-        if (pIt->offL2Tbl > pL2Entry->offL2Tbl)
-            RTListPrepend(&pImage->ListSearch, &pL2Entry->NodeSearch);
-        else
-        {
-            bool fInserted = false;
-
-            RTListForEach(&pImage->ListSearch, pIt, QCOWL2CACHEENTRY, NodeSearch)
-            {
-                Assert(pIt->offL2Tbl != pL2Entry->offL2Tbl);
-                if (pIt->offL2Tbl < pL2Entry->offL2Tbl)
-                {
-                    RTListNodeInsertAfter(&pIt->NodeSearch, &pL2Entry->NodeSearch);
-                    fInserted = true;
-                    break;
-                }
-            }
-             Assert(fInserted);
-        }
-    }
+    /* Insert into the search tree. */
+    pL2Entry->Core.Key     = pL2Entry->offL2Tbl;
+    pL2Entry->Core.KeyLast = pL2Entry->offL2Tbl + pImage->cbL2Table - 1;
+    bool fInserted = RTAvlrU64Insert(&pImage->TreeL2Cache, &pL2Entry->Core);
+    Assert(fInserted); NOREF(fInserted);
 }
 
 /**
@@ -1034,7 +1048,12 @@ static int qcowOpenImage(PQCOWIMAGE pImage, unsigned uOpenFlags)
     AssertPtrReturn(pImage->pIfIo, VERR_INVALID_PARAMETER);
 
     rc = qcowL2TblCacheCreate(pImage);
-    AssertRC(rc);
+    if (RT_FAILURE(rc))
+    {
+        rc = vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("QCow: configuration error: failed to read L2CacheSize as U64 for image '%s'"),
+                       pImage->pszFilename);
+        goto out;
+    }
 
     /*
      * Open the image.
@@ -2387,6 +2406,9 @@ static void qcowDump(void *pBackendData)
                          pImage->PCHSGeometry.cCylinders, pImage->PCHSGeometry.cHeads, pImage->PCHSGeometry.cSectors,
                          pImage->LCHSGeometry.cCylinders, pImage->LCHSGeometry.cHeads, pImage->LCHSGeometry.cSectors,
                          pImage->cbSize / 512);
+        vdIfErrorMessage(pImage->pIfError, "L2 cache: cbMax=%llu cbUsed=%zu cHits=%llu cMisses=%llu cEvictions=%llu\n",
+                         pImage->cbL2CacheMax, pImage->cbL2Cache, pImage->cL2CacheHits,
+                         pImage->cL2CacheMisses, pImage->cL2CacheEvictions);
     }
 }
 
@@ -2468,11 +2490,11 @@ const VBOXHDDBACKEND g_QCowBackend =
     /* cbSize */
     sizeof(VBOXHDDBACKEND),
     /* uBackendCaps */
-    VD_CAP_FILE | VD_CAP_VFS | VD_CAP_CREATE_DYNAMIC | VD_CAP_DIFF | VD_CAP_ASYNC,
+    VD_CAP_FILE | VD_CAP_VFS | VD_CAP_CREATE_DYNAMIC | VD_CAP_DIFF | VD_CAP_ASYNC | VD_CAP_CONFIG,
     /* paFileExtensions */
     s_aQCowFileExtensions,
     /* paConfigInfo */
-    NULL,
+    s_qcowConfigInfo,
     /* pfnCheckIfValid */
     qcowCheckIfValid,
     /* pfnOpen */
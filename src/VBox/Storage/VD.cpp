@@ -39,6 +39,7 @@
 #include <iprt/list.h>
 #include <iprt/avl.h>
 #include <iprt/semaphore.h>
+#include <iprt/thread.h>
 
 #include <VBox/vd-plugin.h>
 
@@ -56,9 +57,36 @@
 /** Buffer size used for merging images. */
 #define VD_MERGE_BUFFER_SIZE    (16 * _1M)
 
+/** Size of the chunks processed by one worker when copying or merging images. */
+#define VD_COPY_CHUNK_SIZE      (4 * _1M)
+/** Default number of worker threads for copying and merging images. */
+#define VD_COPY_THREADS_DEFAULT 4
+/** Maximum number of worker threads for copying and merging images. */
+#define VD_COPY_THREADS_MAX     16
+/** Granularity of the check for zeroed data which doesn't need to be copied. */
+#define VD_COPY_ZERO_CHECK_SIZE _64K
+
 /** Maximum number of segments in one I/O task. */
 #define VD_IO_TASK_SEGMENTS_MAX 64
 
+/** Shift of the block size tracked by one allocation map entry (4K). */
+#define VD_ALLOC_MAP_BLOCK_SHIFT    12
+/** Shift of the number of entries in one lazily allocated allocation map chunk. */
+#define VD_ALLOC_MAP_CHUNK_SHIFT    16
+/** Maximum number of allocation map chunks allocated at a time (64K each,
+ * covering 256M of the disk).  Reads outside the covered ranges search the
+ * chain as before. */
+#define VD_ALLOC_MAP_CHUNKS_MAX     64
+/** Minimum number of images in the chain before the allocation map is used. */
+#define VD_ALLOC_MAP_IMAGES_MIN     2
+/** Allocation map entry: owner of the block is not known yet. */
+#define VD_ALLOC_MAP_UNKNOWN        0
+/** Allocation map entry: block is not allocated in any image of the chain. */
+#define VD_ALLOC_MAP_NONE           UINT8_MAX
+/** Maximum number of images the allocation map can track
+ * (entries 1..254 are the image index + 1). */
+#define VD_ALLOC_MAP_IMAGES_MAX     (VD_ALLOC_MAP_NONE - 1)
+
 /** Threshold after not recently used blocks are removed from the list. */
 #define VD_DISCARD_REMOVE_THRESHOLD (10 * _1M) /** @todo: experiment */
 
@@ -293,6 +321,19 @@ struct VBOXHDD
     PVDFILTER              pFilterHead;
     /** Pointer to the last filter in the chain. */
     PVDFILTER              pFilterTail;
+
+    /** Number of worker threads used when copying or merging from this disk,
+     * 0 for the default. */
+    unsigned               cCopyThreads;
+
+    /** Allocation map recording which image of the chain owns a block,
+     * array of lazily allocated chunks. NULL if not built yet. Only accessed
+     * while the disk is locked or the image list is modified. */
+    uint8_t              **papbAllocMap;
+    /** Number of chunk pointers in the allocation map. */
+    uint32_t               cAllocMapChunks;
+    /** Number of allocated allocation map chunks, at most VD_ALLOC_MAP_CHUNKS_MAX. */
+    uint32_t               cAllocMapChunksUsed;
 };
 
 # define VD_IS_LOCKED(a_pDisk) \
@@ -888,6 +929,268 @@ static int vdFindFilterBackend(const char *pszFilter, PCVDFILTERBACKEND *ppBacke
 }
 
 
+/**
+ * internal: frees the allocation map, it is rebuilt lazily by the following reads.
+ */
+static void vdAllocMapDestroy(PVBOXHDD pDisk)
+{
+    if (pDisk->papbAllocMap)
+    {
+        for (uint32_t i = 0; i < pDisk->cAllocMapChunks; i++)
+            if (pDisk->papbAllocMap[i])
+                RTMemFree(pDisk->papbAllocMap[i]);
+
+        RTMemFree(pDisk->papbAllocMap);
+        pDisk->papbAllocMap        = NULL;
+        pDisk->cAllocMapChunks     = 0;
+        pDisk->cAllocMapChunksUsed = 0;
+    }
+}
+
+/**
+ * internal: returns whether the allocation map can be used for the current
+ * chain layout.
+ */
+DECLINLINE(bool) vdAllocMapIsUsable(PVBOXHDD pDisk)
+{
+    return    pDisk->cImages >= VD_ALLOC_MAP_IMAGES_MIN
+           && pDisk->cImages <= VD_ALLOC_MAP_IMAGES_MAX
+           && pDisk->cbSize;
+}
+
+/**
+ * internal: returns the allocation map entry for the given block, NULL if
+ * the chunk was not allocated yet.
+ */
+static uint8_t *vdAllocMapGetEntry(PVBOXHDD pDisk, uint64_t idxBlock, bool fAlloc)
+{
+    if (!pDisk->papbAllocMap)
+    {
+        if (!fAlloc)
+            return NULL;
+
+        uint64_t cBlocks = (pDisk->cbSize + RT_BIT_64(VD_ALLOC_MAP_BLOCK_SHIFT) - 1) >> VD_ALLOC_MAP_BLOCK_SHIFT;
+        uint64_t cChunks = (cBlocks + RT_BIT_64(VD_ALLOC_MAP_CHUNK_SHIFT) - 1) >> VD_ALLOC_MAP_CHUNK_SHIFT;
+        if (cChunks > UINT32_MAX)
+            return NULL;
+
+        pDisk->papbAllocMap = (uint8_t **)RTMemAllocZ(cChunks * sizeof(uint8_t *));
+        if (!pDisk->papbAllocMap)
+            return NULL;
+        pDisk->cAllocMapChunks = (uint32_t)cChunks;
+    }
+
+    uint64_t idxChunk = idxBlock >> VD_ALLOC_MAP_CHUNK_SHIFT;
+    if (idxChunk >= pDisk->cAllocMapChunks)
+        return NULL;
+
+    uint8_t *pbChunk = pDisk->papbAllocMap[idxChunk];
+    if (!pbChunk)
+    {
+        /* The map is only a hint, don't let it grow with the disk size. */
+        if (   !fAlloc
+            || pDisk->cAllocMapChunksUsed >= VD_ALLOC_MAP_CHUNKS_MAX)
+            return NULL;
+
+        pbChunk = (uint8_t *)RTMemAllocZ(RT_BIT_32(VD_ALLOC_MAP_CHUNK_SHIFT));
+        if (!pbChunk)
+            return NULL;
+        pDisk->papbAllocMap[idxChunk] = pbChunk;
+        pDisk->cAllocMapChunksUsed++;
+    }
+
+    return &pbChunk[idxBlock & (RT_BIT_64(VD_ALLOC_MAP_CHUNK_SHIFT) - 1)];
+}
+
+/**
+ * internal: returns the allocation map entry value for the given image.
+ */
+static uint8_t vdAllocMapEntryFromImage(PVBOXHDD pDisk, PVDIMAGE pImage)
+{
+    if (!pImage)
+        return VD_ALLOC_MAP_NONE;
+
+    unsigned iImage = 0;
+    for (PVDIMAGE pCur = pDisk->pBase; pCur && pCur != pImage; pCur = pCur->pNext)
+        iImage++;
+
+    Assert(iImage < VD_ALLOC_MAP_IMAGES_MAX);
+    return (uint8_t)(iImage + 1);
+}
+
+/**
+ * internal: returns the image for the given allocation map entry value.
+ */
+static PVDIMAGE vdAllocMapEntryToImage(PVBOXHDD pDisk, uint8_t bEntry)
+{
+    Assert(bEntry != VD_ALLOC_MAP_UNKNOWN && bEntry != VD_ALLOC_MAP_NONE);
+
+    PVDIMAGE pImage = pDisk->pBase;
+    while (pImage && --bEntry)
+        pImage = pImage->pNext;
+
+    return pImage;
+}
+
+/**
+ * internal: looks up the owner of the first block of the given range.
+ *
+ * @returns Entry value of the first block, VD_ALLOC_MAP_UNKNOWN if not known.
+ * @param   pDisk           The disk.
+ * @param   uOffset         Start offset of the range.
+ * @param   cbRange         Size of the range.
+ * @param   pcbRun          Where to store the number of bytes starting at uOffset
+ *                          which have the same owner, at most cbRange.
+ */
+static uint8_t vdAllocMapLookup(PVBOXHDD pDisk, uint64_t uOffset, size_t cbRange, size_t *pcbRun)
+{
+    uint64_t idxBlock = uOffset >> VD_ALLOC_MAP_BLOCK_SHIFT;
+    uint8_t *pbEntry  = vdAllocMapGetEntry(pDisk, idxBlock, false /* fAlloc */);
+
+    if (!pbEntry || *pbEntry == VD_ALLOC_MAP_UNKNOWN)
+        return VD_ALLOC_MAP_UNKNOWN;
+
+    uint8_t  bOwner = *pbEntry;
+    uint64_t offEnd = uOffset + cbRange;
+    uint64_t offRun = (idxBlock + 1) << VD_ALLOC_MAP_BLOCK_SHIFT;
+
+    /* Extend the run over the following blocks with the same owner. */
+    while (offRun < offEnd)
+    {
+        idxBlock++;
+        pbEntry = vdAllocMapGetEntry(pDisk, idxBlock, false /* fAlloc */);
+        if (!pbEntry || *pbEntry != bOwner)
+            break;
+        offRun += RT_BIT_64(VD_ALLOC_MAP_BLOCK_SHIFT);
+    }
+
+    *pcbRun = (size_t)(RT_MIN(offRun, offEnd) - uOffset);
+    return bOwner;
+}
+
+/**
+ * internal: records the owner for all blocks completely covered by the given range.
+ */
+static void vdAllocMapSet(PVBOXHDD pDisk, uint64_t uOffset, size_t cbRange, uint8_t bOwner)
+{
+    uint64_t idxBlock    = (uOffset + RT_BIT_64(VD_ALLOC_MAP_BLOCK_SHIFT) - 1) >> VD_ALLOC_MAP_BLOCK_SHIFT;
+    uint64_t idxBlockEnd = (uOffset + cbRange) >> VD_ALLOC_MAP_BLOCK_SHIFT;
+
+    for (; idxBlock < idxBlockEnd; idxBlock++)
+    {
+        uint8_t *pbEntry = vdAllocMapGetEntry(pDisk, idxBlock, true /* fAlloc */);
+        if (!pbEntry)
+            break; /* Out of memory, the map is only a hint. */
+        *pbEntry = bOwner;
+    }
+}
+
+/**
+ * internal: forgets the owner of all blocks touched by the given range
+ * unless the block is already owned by the given image.
+ */
+static void vdAllocMapInvalidate(PVBOXHDD pDisk, uint64_t uOffset, size_t cbRange, uint8_t bKeep)
+{
+    if (!pDisk->papbAllocMap || !cbRange)
+        return;
+
+    uint64_t idxBlock    = uOffset >> VD_ALLOC_MAP_BLOCK_SHIFT;
+    uint64_t idxBlockEnd = (uOffset + cbRange + RT_BIT_64(VD_ALLOC_MAP_BLOCK_SHIFT) - 1) >> VD_ALLOC_MAP_BLOCK_SHIFT;
+
+    for (; idxBlock < idxBlockEnd; idxBlock++)
+    {
+        uint8_t *pbEntry = vdAllocMapGetEntry(pDisk, idxBlock, false /* fAlloc */);
+        if (pbEntry && *pbEntry != bKeep)
+            *pbEntry = VD_ALLOC_MAP_UNKNOWN;
+    }
+}
+
+/**
+ * internal: updates the allocation map before data is written to the given image
+ * and again once the write completed.
+ *
+ * Blocks already owned by the top image keep their entry, everything else
+ * touched by the write may change its owner and is forgotten.  A read running
+ * while the write allocates the block in the image still finds it free there
+ * and records the parent as the owner, hence the second pass on completion.
+ */
+static void vdAllocMapWrite(PVBOXHDD pDisk, PVDIMAGE pImage, uint64_t uOffset, size_t cbWrite)
+{
+    uint8_t bKeep = VD_ALLOC_MAP_UNKNOWN;
+
+    if (!pDisk->papbAllocMap)
+        return;
+
+    if (pImage == pDisk->pLast)
+        bKeep = (uint8_t)pDisk->cImages;
+
+    vdAllocMapInvalidate(pDisk, uOffset, cbWrite, bKeep);
+}
+
+/**
+ * internal: tries to read the given range directly from the image owning it
+ * according to the allocation map.
+ *
+ * @returns VBox status code of the backend.
+ * @retval  VERR_VD_BLOCK_FREE if the map says no image in the chain contains the range.
+ * @retval  VERR_NOT_FOUND if the owner is not known and the chain must be searched.
+ * @param   pDisk           The disk.
+ * @param   uOffset         Start offset of the read.
+ * @param   cbRead          Maximum number of bytes to read.
+ * @param   pIoCtx          The I/O context.
+ * @param   pcbThisRead     Where to store the number of bytes processed.
+ */
+static int vdAllocMapRead(PVBOXHDD pDisk, uint64_t uOffset, size_t cbRead,
+                          PVDIOCTX pIoCtx, size_t *pcbThisRead)
+{
+    size_t  cbRun  = 0;
+    uint8_t bOwner = vdAllocMapLookup(pDisk, uOffset, cbRead, &cbRun);
+
+    if (bOwner == VD_ALLOC_MAP_UNKNOWN)
+        return VERR_NOT_FOUND;
+
+    *pcbThisRead = cbRun;
+    if (bOwner == VD_ALLOC_MAP_NONE)
+        return VERR_VD_BLOCK_FREE;
+
+    PVDIMAGE pImage = vdAllocMapEntryToImage(pDisk, bOwner);
+    AssertPtrReturn(pImage, VERR_NOT_FOUND);
+
+    int rc = pImage->Backend->pfnRead(pImage->pBackendData, uOffset, cbRun,
+                                      pIoCtx, pcbThisRead);
+    if (rc == VERR_VD_BLOCK_FREE)
+    {
+        /* The image doesn't own the block anymore (discarded or compacted), search the chain. */
+        vdAllocMapInvalidate(pDisk, uOffset, cbRun, VD_ALLOC_MAP_UNKNOWN);
+        *pcbThisRead = cbRead;
+        rc = VERR_NOT_FOUND;
+    }
+
+    return rc;
+}
+
+/**
+ * internal: records the result of a read which searched the whole chain.
+ *
+ * @param   pDisk           The disk.
+ * @param   uOffset         Start offset of the read.
+ * @param   cbThisRead      Number of bytes processed by the read.
+ * @param   rc              Status code of the read.
+ * @param   pImage          The image which contained the data, NULL if none.
+ */
+static void vdAllocMapRecordRead(PVBOXHDD pDisk, uint64_t uOffset, size_t cbThisRead,
+                                 int rc, PVDIMAGE pImage)
+{
+    if (rc == VERR_VD_BLOCK_FREE)
+        vdAllocMapSet(pDisk, uOffset, cbThisRead, VD_ALLOC_MAP_NONE);
+    else if (   RT_SUCCESS(rc)
+             || rc == VERR_VD_ASYNC_IO_IN_PROGRESS)
+    {
+        AssertPtr(pImage);
+        vdAllocMapSet(pDisk, uOffset, cbThisRead, vdAllocMapEntryFromImage(pDisk, pImage));
+    }
+}
+
 /**
  * internal: add image structure to the end of images list.
  */
@@ -911,6 +1214,9 @@ static void vdAddImageToList(PVBOXHDD pDisk, PVDIMAGE pImage)
     }
 
     pDisk->cImages++;
+
+    /* The new image might contain data already. */
+    vdAllocMapDestroy(pDisk);
 }
 
 /**
@@ -934,6 +1240,9 @@ static void vdRemoveImageFromList(PVBOXHDD pDisk, PVDIMAGE pImage)
     pImage->pNext = NULL;
 
     pDisk->cImages--;
+
+    /* The image indices changed. */
+    vdAllocMapDestroy(pDisk);
 }
 
 /**
@@ -1723,6 +2032,12 @@ static int vdIoCtxProcessLocked(PVDIOCTX pIoCtx)
     }
 
 out:
+    if (   rc == VINF_VD_ASYNC_IO_FINISHED
+        && pIoCtx->enmTxDir == VDIOCTXTXDIR_WRITE
+        && !pIoCtx->pIoCtxParent)
+        vdAllocMapWrite(pIoCtx->pDisk, pIoCtx->Req.Io.pImageStart,
+                        pIoCtx->Req.Io.uOffsetXferOrig, pIoCtx->Req.Io.cbXferOrig);
+
     LogFlowFunc(("pIoCtx=%#p rc=%Rrc cDataTransfersPending=%u cMetaTransfersPending=%u fComplete=%RTbool\n",
                  pIoCtx, rc, pIoCtx->cDataTransfersPending, pIoCtx->cMetaTransfersPending,
                  pIoCtx->fComplete));
@@ -1996,24 +2311,42 @@ static int vdDiskReadHelper(PVBOXHDD pDisk, PVDIMAGE pImage, PVDIMAGE pImagePare
 
     *pcbThisRead = 0;
 
-    /*
-     * Try to read from the given image.
-     * If the block is not allocated read from override chain if present.
-     */
-    rc = pImage->Backend->pfnRead(pImage->pBackendData,
-                                  uOffset, cbThisRead, pIoCtx,
-                                  &cbThisRead);
+    /* Go straight to the owning image if the whole chain is read. */
+    bool fAllocMap =    pImage == pDisk->pLast
+                     && !pImageParentOverride
+                     && vdAllocMapIsUsable(pDisk);
+    rc = fAllocMap
+       ? vdAllocMapRead(pDisk, uOffset, cbThisRead, pIoCtx, &cbThisRead)
+       : VERR_NOT_FOUND;
 
-    if (rc == VERR_VD_BLOCK_FREE)
+    if (rc == VERR_NOT_FOUND)
     {
-        for (PVDIMAGE pCurrImage = pImageParentOverride ? pImageParentOverride : pImage->pPrev;
-             pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
-             pCurrImage = pCurrImage->pPrev)
+        PVDIMAGE pCurrImage = pImage;
+
+        /*
+         * Try to read from the given image.
+         * If the block is not allocated read from override chain if present.
+         */
+        rc = pImage->Backend->pfnRead(pImage->pBackendData,
+                                      uOffset, cbThisRead, pIoCtx,
+                                      &cbThisRead);
+
+        if (rc == VERR_VD_BLOCK_FREE)
         {
-            rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                              uOffset, cbThisRead, pIoCtx,
-                                              &cbThisRead);
+            for (pCurrImage = pImageParentOverride ? pImageParentOverride : pImage->pPrev;
+                 pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
+                 pCurrImage = pCurrImage->pPrev)
+            {
+                rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                  uOffset, cbThisRead, pIoCtx,
+                                                  &cbThisRead);
+                if (rc != VERR_VD_BLOCK_FREE)
+                    break;
+            }
         }
+
+        if (fAllocMap)
+            vdAllocMapRecordRead(pDisk, uOffset, cbThisRead, rc, pCurrImage);
     }
 
     if (RT_SUCCESS(rc) || rc == VERR_VD_BLOCK_FREE)
@@ -2083,34 +2416,52 @@ static int vdReadHelperAsync(PVDIOCTX pIoCtx)
         else
         {
             /*
-             * Try to read from the given image.
-             * If the block is not allocated read from override chain if present.
+             * Go straight to the owning image if the whole chain is searched,
+             * fall back to walking the chain if the owner is not known yet.
              */
-            rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                              uOffset, cbThisRead, pIoCtx,
-                                              &cbThisRead);
-
-            if (   rc == VERR_VD_BLOCK_FREE
-                && cImagesRead != 1)
+            bool fAllocMap =    pCurrImage == pDisk->pLast
+                             && pIoCtx->Req.Io.pImageStart == pDisk->pLast
+                             && !pImageParentOverride
+                             && !cImagesRead
+                             && vdAllocMapIsUsable(pDisk);
+            rc = fAllocMap
+               ? vdAllocMapRead(pDisk, uOffset, cbThisRead, pIoCtx, &cbThisRead)
+               : VERR_NOT_FOUND;
+            if (rc == VERR_NOT_FOUND)
             {
-                unsigned cImagesToProcess = cImagesRead;
-
-                pCurrImage = pImageParentOverride ? pImageParentOverride : pCurrImage->pPrev;
-                pIoCtx->Req.Io.pImageParentOverride = NULL;
+                /*
+                 * Try to read from the given image.
+                 * If the block is not allocated read from override chain if present.
+                 */
+                rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                  uOffset, cbThisRead, pIoCtx,
+                                                  &cbThisRead);
 
-                while (pCurrImage && rc == VERR_VD_BLOCK_FREE)
+                if (   rc == VERR_VD_BLOCK_FREE
+                    && cImagesRead != 1)
                 {
-                    rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                                      uOffset, cbThisRead,
-                                                      pIoCtx, &cbThisRead);
-                    if (cImagesToProcess == 1)
-                        break;
-                    else if (cImagesToProcess > 0)
-                        cImagesToProcess--;
+                    unsigned cImagesToProcess = cImagesRead;
+
+                    pCurrImage = pImageParentOverride ? pImageParentOverride : pCurrImage->pPrev;
+                    pIoCtx->Req.Io.pImageParentOverride = NULL;
 
-                    if (rc == VERR_VD_BLOCK_FREE)
-                        pCurrImage = pCurrImage->pPrev;
+                    while (pCurrImage && rc == VERR_VD_BLOCK_FREE)
+                    {
+                        rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                          uOffset, cbThisRead,
+                                                          pIoCtx, &cbThisRead);
+                        if (cImagesToProcess == 1)
+                            break;
+                        else if (cImagesToProcess > 0)
+                            cImagesToProcess--;
+
+                        if (rc == VERR_VD_BLOCK_FREE)
+                            pCurrImage = pCurrImage->pPrev;
+                    }
                 }
+
+                if (fAllocMap)
+                    vdAllocMapRecordRead(pDisk, uOffset, cbThisRead, rc, pCurrImage);
             }
         }
 
@@ -2381,152 +2732,628 @@ static int vdWriteHelper(PVBOXHDD pDisk, PVDIMAGE pImage, uint64_t uOffset,
 }
 
 /**
- * Internal: Copies the content of one disk to another one applying optimizations
- * to speed up the copy process if possible.
+ * Reads part of a chunk for the copy pipeline.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_VD_BLOCK_FREE if the range is not allocated and must not be written.
+ * @param   pvUser          Opaque user data of the operation.
+ * @param   uOffset         Start offset of the read.
+ * @param   pvBuf           Where to store the data.
+ * @param   cbRead          Number of bytes to read.
+ * @param   pcbThisRead     Where to store the number of bytes actually processed,
+ *                          may be less than cbRead at block boundaries.
  */
-static int vdCopyHelper(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, PVBOXHDD pDiskTo,
-                        uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
-                        bool fSuppressRedundantIo, PVDINTERFACEPROGRESS pIfProgress,
-                        PVDINTERFACEPROGRESS pDstIfProgress)
+typedef DECLCALLBACK(int) FNVDCOPYREAD(void *pvUser, uint64_t uOffset, void *pvBuf,
+                                       size_t cbRead, size_t *pcbThisRead);
+/** Pointer to a copy pipeline read callback. */
+typedef FNVDCOPYREAD *PFNVDCOPYREAD;
+
+/**
+ * Writes data for the copy pipeline.
+ *
+ * @returns VBox status code.
+ * @param   pvUser          Opaque user data of the operation.
+ * @param   uOffset         Start offset of the write.
+ * @param   pvBuf           The data to write.
+ * @param   cbWrite         Number of bytes to write.
+ */
+typedef DECLCALLBACK(int) FNVDCOPYWRITE(void *pvUser, uint64_t uOffset, const void *pvBuf,
+                                        size_t cbWrite);
+/** Pointer to a copy pipeline write callback. */
+typedef FNVDCOPYWRITE *PFNVDCOPYWRITE;
+
+/**
+ * Range of a chunk with the same allocation state.
+ */
+typedef struct VDCOPYRANGE
 {
-    int rc = VINF_SUCCESS;
-    int rc2;
-    uint64_t uOffset = 0;
-    uint64_t cbRemaining = cbSize;
-    void *pvBuf = NULL;
-    bool fLockReadFrom = false;
-    bool fLockWriteTo = false;
-    bool fBlockwiseCopy = fSuppressRedundantIo || (cImagesFromRead > 0);
-    unsigned uProgressOld = 0;
+    /** Offset of the range from the start of the chunk. */
+    size_t                 offChunk;
+    /** Size of the range in bytes. */
+    size_t                 cbRange;
+    /** Flag whether the range is allocated and needs to be written. */
+    bool                   fAllocated;
+} VDCOPYRANGE;
+/** Pointer to a chunk range. */
+typedef VDCOPYRANGE *PVDCOPYRANGE;
 
-    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool pIfProgress=%#p pDstIfProgress=%#p\n",
-                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, pDstIfProgress, pDstIfProgress));
+/**
+ * Copy pipeline worker.
+ */
+typedef struct VDCOPYWORKER
+{
+    /** Pointer to the owning pipeline. */
+    struct VDCOPYPIPE     *pPipe;
+    /** The worker thread. */
+    RTTHREAD               hThread;
+    /** Signalled when it might be the turn of this worker to write. */
+    RTSEMEVENT             hEvtTurn;
+    /** The chunk buffer. */
+    void                  *pvBuf;
+    /** Array of ranges of the current chunk. */
+    PVDCOPYRANGE           paRanges;
+    /** Number of ranges used. */
+    unsigned               cRanges;
+    /** Number of entries in the range array. */
+    unsigned               cRangesMax;
+} VDCOPYWORKER;
+/** Pointer to a copy pipeline worker. */
+typedef VDCOPYWORKER *PVDCOPYWORKER;
 
-    /* Allocate tmp buffer. */
-    pvBuf = RTMemTmpAlloc(VD_MERGE_BUFFER_SIZE);
-    if (!pvBuf)
-        return rc;
+/**
+ * Copy pipeline state.
+ *
+ * The data is processed in chunks of VD_COPY_CHUNK_SIZE. Every worker reads a
+ * chunk, waits until all preceding chunks were written and writes its chunk.
+ * Reads are serialized because the image backends are not thread safe, but
+ * run concurrently with the writes of the preceding chunks. Reads and writes
+ * are both issued in ascending offset order as some backends (streamOptimized
+ * VMDK for example) only support sequential access.
+ */
+typedef struct VDCOPYPIPE
+{
+    /** Number of bytes to copy. */
+    uint64_t               cbSize;
+    /** Number of chunks to process. */
+    uint64_t               cChunks;
+    /** Read callback. */
+    PFNVDCOPYREAD          pfnRead;
+    /** Write callback. */
+    PFNVDCOPYWRITE         pfnWrite;
+    /** Opaque user data for the callbacks. */
+    void                  *pvUser;
+    /** Flag whether zeroed data can be skipped instead of written. */
+    bool                   fSkipZeroes;
+    /** Flag whether the operation was aborted due to an error or cancellation. */
+    volatile bool          fAbort;
+    /** Status code of the first failure. */
+    volatile int32_t       rc;
+    /** Serializes the reads. */
+    RTSEMFASTMUTEX         hMtxRead;
+    /** Signalled whenever a chunk was written or the operation aborted. */
+    RTSEMEVENT             hEvtProgress;
+    /** Index of the next chunk to read. */
+    volatile uint64_t      iChunkNext;
+    /** Index of the next chunk to write. */
+    volatile uint64_t      iChunkWrite;
+    /** Number of workers. */
+    unsigned               cWorkers;
+    /** The worker processing a chunk, indexed by chunk index modulo cWorkers. */
+    PVDCOPYWORKER volatile apChunkOwner[VD_COPY_THREADS_MAX];
+    /** The workers. */
+    VDCOPYWORKER           aWorkers[VD_COPY_THREADS_MAX];
+} VDCOPYPIPE;
+/** Pointer to the copy pipeline state. */
+typedef VDCOPYPIPE *PVDCOPYPIPE;
+
+/**
+ * Aborts the copy pipeline, waking up everyone waiting.
+ *
+ * @param   pPipe           The copy pipeline.
+ * @param   rc              The status code causing the abort.
+ */
+static void vdCopyPipeAbort(PVDCOPYPIPE pPipe, int rc)
+{
+    ASMAtomicCmpXchgS32(&pPipe->rc, rc, VINF_SUCCESS);
+    ASMAtomicWriteBool(&pPipe->fAbort, true);
+    for (unsigned i = 0; i < pPipe->cWorkers; i++)
+        RTSemEventSignal(pPipe->aWorkers[i].hEvtTurn);
+    RTSemEventSignal(pPipe->hEvtProgress);
+}
 
-    do
+/**
+ * Adds a range to the ranges of the worker's chunk, merging it with the
+ * previous one if the allocation state matches.
+ *
+ * @returns VBox status code.
+ * @param   pWorker         The worker.
+ * @param   offChunk        Offset of the range from the start of the chunk.
+ * @param   cbRange         Size of the range.
+ * @param   fAllocated      Whether the range is allocated.
+ */
+static int vdCopyWorkerAddRange(PVDCOPYWORKER pWorker, size_t offChunk, size_t cbRange, bool fAllocated)
+{
+    if (   pWorker->cRanges
+        && pWorker->paRanges[pWorker->cRanges - 1].fAllocated == fAllocated)
     {
-        size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
+        pWorker->paRanges[pWorker->cRanges - 1].cbRange += cbRange;
+        return VINF_SUCCESS;
+    }
 
-        /* Note that we don't attempt to synchronize cross-disk accesses.
-         * It wouldn't be very difficult to do, just the lock order would
-         * need to be defined somehow to prevent deadlocks. Postpone such
-         * magic as there is no use case for this. */
+    if (pWorker->cRanges == pWorker->cRangesMax)
+    {
+        unsigned cRangesNew = pWorker->cRangesMax ? pWorker->cRangesMax * 2 : 64;
+        PVDCOPYRANGE paRangesNew = (PVDCOPYRANGE)RTMemRealloc(pWorker->paRanges, cRangesNew * sizeof(VDCOPYRANGE));
+        if (!paRangesNew)
+            return VERR_NO_MEMORY;
+        pWorker->paRanges   = paRangesNew;
+        pWorker->cRangesMax = cRangesNew;
+    }
 
-        rc2 = vdThreadStartRead(pDiskFrom);
-        AssertRC(rc2);
-        fLockReadFrom = true;
+    pWorker->paRanges[pWorker->cRanges].offChunk   = offChunk;
+    pWorker->paRanges[pWorker->cRanges].cbRange    = cbRange;
+    pWorker->paRanges[pWorker->cRanges].fAllocated = fAllocated;
+    pWorker->cRanges++;
+    return VINF_SUCCESS;
+}
 
-        if (fBlockwiseCopy)
-        {
-            RTSGSEG SegmentBuf;
-            RTSGBUF SgBuf;
-            VDIOCTX IoCtx;
+/**
+ * Checks whether the given buffer contains only zeros.
+ */
+DECLINLINE(bool) vdCopyIsZero(const void *pv, size_t cb)
+{
+    if (cb & 3)
+        return !ASMMemIsAll8(pv, cb, 0);
+    return !ASMMemIsAllU32(pv, cb, 0);
+}
 
-            SegmentBuf.pvSeg = pvBuf;
-            SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
-            RTSgBufInit(&SgBuf, &SegmentBuf, 1);
-            vdIoCtxInit(&IoCtx, pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
-                        &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
+/**
+ * Writes an allocated range, skipping zeroed parts if allowed.
+ *
+ * @returns VBox status code.
+ * @param   pPipe           The copy pipeline.
+ * @param   uOffset         Start offset of the range.
+ * @param   pbBuf           The data of the range.
+ * @param   cbRange         Size of the range.
+ */
+static int vdCopyPipeWriteRange(PVDCOPYPIPE pPipe, uint64_t uOffset, const uint8_t *pbBuf, size_t cbRange)
+{
+    if (!pPipe->fSkipZeroes)
+        return pPipe->pfnWrite(pPipe->pvUser, uOffset, pbBuf, cbRange);
 
-            /* Read the source data. */
-            rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
-                                              uOffset, cbThisRead, &IoCtx,
-                                              &cbThisRead);
+    int rc = VINF_SUCCESS;
+    size_t offRun = 0;  /* Start of the current run of data to write. */
+    size_t off    = 0;
+    while (off < cbRange && RT_SUCCESS(rc))
+    {
+        size_t cbThisCheck = RT_MIN(VD_COPY_ZERO_CHECK_SIZE, cbRange - off);
+        if (vdCopyIsZero(pbBuf + off, cbThisCheck))
+        {
+            if (off > offRun)
+                rc = pPipe->pfnWrite(pPipe->pvUser, uOffset + offRun, pbBuf + offRun, off - offRun);
+            offRun = off + cbThisCheck;
+        }
+        off += cbThisCheck;
+    }
 
-            if (   rc == VERR_VD_BLOCK_FREE
-                && cImagesFromRead != 1)
-            {
-                unsigned cImagesToProcess = cImagesFromRead;
+    if (   RT_SUCCESS(rc)
+        && cbRange > offRun)
+        rc = pPipe->pfnWrite(pPipe->pvUser, uOffset + offRun, pbBuf + offRun, cbRange - offRun);
+    return rc;
+}
 
-                for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
-                     pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
-                     pCurrImage = pCurrImage->pPrev)
-                {
-                    rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                                           uOffset, cbThisRead,
-                                                           &IoCtx, &cbThisRead);
-                    if (cImagesToProcess == 1)
-                        break;
-                    else if (cImagesToProcess > 0)
-                        cImagesToProcess--;
-                }
-            }
-        }
-        else
-            rc = vdReadHelper(pDiskFrom, pImageFrom, uOffset, pvBuf, cbThisRead,
-                              false /* fUpdateCache */);
+/**
+ * Copy pipeline worker thread.
+ *
+ * @returns VBox status code.
+ * @param   hThread         The thread handle.
+ * @param   pvUser          The worker.
+ */
+static DECLCALLBACK(int) vdCopyWorkerThread(RTTHREAD hThread, void *pvUser)
+{
+    PVDCOPYWORKER pWorker = (PVDCOPYWORKER)pvUser;
+    PVDCOPYPIPE   pPipe   = pWorker->pPipe;
+    int rc = VINF_SUCCESS;
 
-        if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
+    while (!ASMAtomicReadBool(&pPipe->fAbort))
+    {
+        /* Claim the next chunk while holding the read lock so the chunks are
+         * read in ascending order, required for sequential sources. */
+        RTSemFastMutexRequest(pPipe->hMtxRead);
+        uint64_t iChunk = ASMAtomicIncU64(&pPipe->iChunkNext) - 1;
+        if (iChunk >= pPipe->cChunks)
+        {
+            RTSemFastMutexRelease(pPipe->hMtxRead);
             break;
+        }
 
-        rc2 = vdThreadFinishRead(pDiskFrom);
-        AssertRC(rc2);
-        fLockReadFrom = false;
+        uint64_t uOffset = iChunk * VD_COPY_CHUNK_SIZE;
+        size_t   cbChunk = (size_t)RT_MIN(VD_COPY_CHUNK_SIZE, pPipe->cbSize - uOffset);
+
+        /* Register as owner before checking whose turn it is, see below. */
+        ASMAtomicWritePtr(&pPipe->apChunkOwner[iChunk % pPipe->cWorkers], pWorker);
 
-        if (rc != VERR_VD_BLOCK_FREE)
+        /* Read the chunk, remembering which parts are allocated. */
+        pWorker->cRanges = 0;
+        size_t offChunk = 0;
+        while (   offChunk < cbChunk
+               && !ASMAtomicReadBool(&pPipe->fAbort))
         {
-            rc2 = vdThreadStartWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = true;
+            size_t cbThisRead = cbChunk - offChunk;
+            rc = pPipe->pfnRead(pPipe->pvUser, uOffset + offChunk,
+                                (uint8_t *)pWorker->pvBuf + offChunk, cbThisRead, &cbThisRead);
+            if (RT_FAILURE(rc) && rc != VERR_VD_BLOCK_FREE)
+                break;
 
-            /* Only do collapsed I/O if we are copying the data blockwise. */
-            rc = vdWriteHelperEx(pDiskTo, pDiskTo->pLast, NULL, uOffset, pvBuf,
-                                 cbThisRead, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
-                                 fBlockwiseCopy ? cImagesToRead : 0);
+            rc = vdCopyWorkerAddRange(pWorker, offChunk, cbThisRead, rc != VERR_VD_BLOCK_FREE);
             if (RT_FAILURE(rc))
                 break;
+            offChunk += cbThisRead;
+        }
+        RTSemFastMutexRelease(pPipe->hMtxRead);
+        if (RT_FAILURE(rc))
+            break;
 
-            rc2 = vdThreadFinishWrite(pDiskTo);
-            AssertRC(rc2);
-            fLockWriteTo = false;
+        /* Wait until all preceding chunks were written. */
+        while (   ASMAtomicReadU64(&pPipe->iChunkWrite) != iChunk
+               && !ASMAtomicReadBool(&pPipe->fAbort))
+            RTSemEventWait(pWorker->hEvtTurn, RT_INDEFINITE_WAIT);
+        if (ASMAtomicReadBool(&pPipe->fAbort))
+            break;
+
+        for (unsigned i = 0; i < pWorker->cRanges && RT_SUCCESS(rc); i++)
+        {
+            PVDCOPYRANGE pRange = &pWorker->paRanges[i];
+            if (pRange->fAllocated)
+                rc = vdCopyPipeWriteRange(pPipe, uOffset + pRange->offChunk,
+                                          (uint8_t *)pWorker->pvBuf + pRange->offChunk,
+                                          pRange->cbRange);
         }
-        else /* Don't propagate the error to the outside */
-            rc = VINF_SUCCESS;
+        if (RT_FAILURE(rc))
+            break;
+
+        /* Pass the turn on to the owner of the next chunk. */
+        ASMAtomicWriteU64(&pPipe->iChunkWrite, iChunk + 1);
+        PVDCOPYWORKER pNext = ASMAtomicReadPtrT(&pPipe->apChunkOwner[(iChunk + 1) % pPipe->cWorkers], PVDCOPYWORKER);
+        if (pNext)
+            RTSemEventSignal(pNext->hEvtTurn);
+        RTSemEventSignal(pPipe->hEvtProgress);
+    }
+
+    if (RT_FAILURE(rc))
+        vdCopyPipeAbort(pPipe, rc);
+
+    return rc;
+}
+
+/**
+ * Runs the copy pipeline, reporting progress on the calling thread.
+ *
+ * @returns VBox status code.
+ * @param   cbSize          Number of bytes to copy.
+ * @param   cThreads        Number of worker threads, 0 for the default.
+ * @param   fSkipZeroes     Whether zeroed data needs not to be written because
+ *                          the destination reads as zero already.
+ * @param   pfnRead         The read callback.
+ * @param   pfnWrite        The write callback.
+ * @param   pvUser          Opaque user data for the callbacks.
+ * @param   pIfProgress     Progress interface, optional.
+ * @param   pDstIfProgress  Progress interface of the destination, optional.
+ */
+static int vdCopyPipeRun(uint64_t cbSize, unsigned cThreads, bool fSkipZeroes,
+                         PFNVDCOPYREAD pfnRead, PFNVDCOPYWRITE pfnWrite, void *pvUser,
+                         PVDINTERFACEPROGRESS pIfProgress, PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    int rc = VINF_SUCCESS;
 
-        uOffset += cbThisRead;
-        cbRemaining -= cbThisRead;
+    LogFlowFunc(("cbSize=%llu cThreads=%u fSkipZeroes=%RTbool\n", cbSize, cThreads, fSkipZeroes));
 
-        unsigned uProgressNew = uOffset * 99 / cbSize;
+    if (!cbSize)
+        return VINF_SUCCESS;
+
+    PVDCOPYPIPE pPipe = (PVDCOPYPIPE)RTMemAllocZ(sizeof(VDCOPYPIPE));
+    if (!pPipe)
+        return VERR_NO_MEMORY;
+
+    pPipe->cbSize       = cbSize;
+    pPipe->cChunks      = (cbSize + VD_COPY_CHUNK_SIZE - 1) / VD_COPY_CHUNK_SIZE;
+    pPipe->pfnRead      = pfnRead;
+    pPipe->pfnWrite     = pfnWrite;
+    pPipe->pvUser       = pvUser;
+    pPipe->fSkipZeroes  = fSkipZeroes;
+    pPipe->rc           = VINF_SUCCESS;
+    pPipe->hMtxRead     = NIL_RTSEMFASTMUTEX;
+    pPipe->hEvtProgress = NIL_RTSEMEVENT;
+    pPipe->cWorkers     = cThreads ? RT_MIN(cThreads, VD_COPY_THREADS_MAX) : VD_COPY_THREADS_DEFAULT;
+    if (pPipe->cWorkers > pPipe->cChunks)
+        pPipe->cWorkers = (unsigned)pPipe->cChunks;
+    for (unsigned i = 0; i < pPipe->cWorkers; i++)
+    {
+        pPipe->aWorkers[i].pPipe    = pPipe;
+        pPipe->aWorkers[i].hThread  = NIL_RTTHREAD;
+        pPipe->aWorkers[i].hEvtTurn = NIL_RTSEMEVENT;
+    }
+
+    rc = RTSemFastMutexCreate(&pPipe->hMtxRead);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPipe->hEvtProgress);
+    for (unsigned i = 0; i < pPipe->cWorkers && RT_SUCCESS(rc); i++)
+    {
+        rc = RTSemEventCreate(&pPipe->aWorkers[i].hEvtTurn);
+        if (RT_SUCCESS(rc))
+        {
+            pPipe->aWorkers[i].pvBuf = RTMemTmpAlloc(VD_COPY_CHUNK_SIZE);
+            if (!pPipe->aWorkers[i].pvBuf)
+                rc = VERR_NO_MEMORY;
+        }
+    }
+
+    unsigned cThreadsStarted = 0;
+    for (unsigned i = 0; i < pPipe->cWorkers && RT_SUCCESS(rc); i++)
+    {
+        rc = RTThreadCreateF(&pPipe->aWorkers[i].hThread, vdCopyWorkerThread, &pPipe->aWorkers[i], 0,
+                             RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VDCopy%u", i);
+        if (RT_SUCCESS(rc))
+            cThreadsStarted++;
+        else
+            vdCopyPipeAbort(pPipe, rc);
+    }
+
+    /* Report the progress until everything was written or the copy failed. */
+    unsigned uProgressOld = 0;
+    while (   cThreadsStarted
+           && ASMAtomicReadU64(&pPipe->iChunkWrite) < pPipe->cChunks
+           && !ASMAtomicReadBool(&pPipe->fAbort))
+    {
+        RTSemEventWait(pPipe->hEvtProgress, RT_INDEFINITE_WAIT);
+
+        uint64_t cbDone = RT_MIN(ASMAtomicReadU64(&pPipe->iChunkWrite) * VD_COPY_CHUNK_SIZE, cbSize);
+        unsigned uProgressNew = cbDone * 99 / cbSize;
         if (uProgressNew != uProgressOld)
         {
             uProgressOld = uProgressNew;
 
+            int rc2 = VINF_SUCCESS;
             if (pIfProgress && pIfProgress->pfnProgress)
+                rc2 = pIfProgress->pfnProgress(pIfProgress->Core.pvUser, uProgressOld);
+            if (RT_SUCCESS(rc2) && pDstIfProgress && pDstIfProgress->pfnProgress)
+                rc2 = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser, uProgressOld);
+            if (RT_FAILURE(rc2))
+                vdCopyPipeAbort(pPipe, rc2);
+        }
+    }
+
+    for (unsigned i = 0; i < pPipe->cWorkers; i++)
+    {
+        if (pPipe->aWorkers[i].hThread != NIL_RTTHREAD)
+            RTThreadWait(pPipe->aWorkers[i].hThread, RT_INDEFINITE_WAIT, NULL);
+        if (pPipe->aWorkers[i].hEvtTurn != NIL_RTSEMEVENT)
+            RTSemEventDestroy(pPipe->aWorkers[i].hEvtTurn);
+        if (pPipe->aWorkers[i].pvBuf)
+            RTMemTmpFree(pPipe->aWorkers[i].pvBuf);
+        if (pPipe->aWorkers[i].paRanges)
+            RTMemFree(pPipe->aWorkers[i].paRanges);
+    }
+    if (pPipe->hEvtProgress != NIL_RTSEMEVENT)
+        RTSemEventDestroy(pPipe->hEvtProgress);
+    if (pPipe->hMtxRead != NIL_RTSEMFASTMUTEX)
+        RTSemFastMutexDestroy(pPipe->hMtxRead);
+
+    if (RT_SUCCESS(rc))
+        rc = pPipe->rc;
+    RTMemFree(pPipe);
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal: State of a copy between two disks.
+ */
+typedef struct VDCOPYSTATE
+{
+    PVBOXHDD               pDiskFrom;
+    PVDIMAGE               pImageFrom;
+    PVBOXHDD               pDiskTo;
+    unsigned               cImagesFromRead;
+    unsigned               cImagesToRead;
+    bool                   fBlockwiseCopy;
+} VDCOPYSTATE;
+/** Pointer to the copy state. */
+typedef VDCOPYSTATE *PVDCOPYSTATE;
+
+/**
+ * @callback_method_impl{FNVDCOPYREAD, Reads from the source disk of a copy.}
+ */
+static DECLCALLBACK(int) vdCopyHelperRead(void *pvUser, uint64_t uOffset, void *pvBuf,
+                                          size_t cbRead, size_t *pcbThisRead)
+{
+    PVDCOPYSTATE pState = (PVDCOPYSTATE)pvUser;
+    PVDIMAGE pImageFrom = pState->pImageFrom;
+    int rc, rc2;
+
+    /* Note that we don't attempt to synchronize cross-disk accesses.
+     * It wouldn't be very difficult to do, just the lock order would
+     * need to be defined somehow to prevent deadlocks. Postpone such
+     * magic as there is no use case for this. */
+
+    rc2 = vdThreadStartRead(pState->pDiskFrom);
+    AssertRC(rc2);
+
+    if (pState->fBlockwiseCopy)
+    {
+        RTSGSEG SegmentBuf;
+        RTSGBUF SgBuf;
+        VDIOCTX IoCtx;
+
+        SegmentBuf.pvSeg = pvBuf;
+        SegmentBuf.cbSeg = cbRead;
+        RTSgBufInit(&SgBuf, &SegmentBuf, 1);
+        vdIoCtxInit(&IoCtx, pState->pDiskFrom, VDIOCTXTXDIR_READ, 0, 0, NULL,
+                    &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
+
+        /* Read the source data. */
+        rc = pImageFrom->Backend->pfnRead(pImageFrom->pBackendData,
+                                          uOffset, cbRead, &IoCtx,
+                                          pcbThisRead);
+
+        if (   rc == VERR_VD_BLOCK_FREE
+            && pState->cImagesFromRead != 1)
+        {
+            unsigned cImagesToProcess = pState->cImagesFromRead;
+
+            for (PVDIMAGE pCurrImage = pImageFrom->pPrev;
+                 pCurrImage != NULL && rc == VERR_VD_BLOCK_FREE;
+                 pCurrImage = pCurrImage->pPrev)
             {
-                rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
-                                              uProgressOld);
-                if (RT_FAILURE(rc))
-                    break;
-            }
-            if (pDstIfProgress && pDstIfProgress->pfnProgress)
-            {
-                rc = pDstIfProgress->pfnProgress(pDstIfProgress->Core.pvUser,
-                                                 uProgressOld);
-                if (RT_FAILURE(rc))
+                rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                  uOffset, *pcbThisRead,
+                                                  &IoCtx, pcbThisRead);
+                if (cImagesToProcess == 1)
                     break;
+                else if (cImagesToProcess > 0)
+                    cImagesToProcess--;
             }
         }
-    } while (uOffset < cbSize);
-
-    RTMemFree(pvBuf);
-
-    if (fLockReadFrom)
+    }
+    else
     {
-        rc2 = vdThreadFinishRead(pDiskFrom);
-        AssertRC(rc2);
+        rc = vdReadHelper(pState->pDiskFrom, pImageFrom, uOffset, pvBuf, cbRead,
+                          false /* fUpdateCache */);
+        *pcbThisRead = cbRead;
     }
 
-    if (fLockWriteTo)
+    rc2 = vdThreadFinishRead(pState->pDiskFrom);
+    AssertRC(rc2);
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNVDCOPYWRITE, Writes to the destination disk of a copy.}
+ */
+static DECLCALLBACK(int) vdCopyHelperWrite(void *pvUser, uint64_t uOffset, const void *pvBuf,
+                                           size_t cbWrite)
+{
+    PVDCOPYSTATE pState = (PVDCOPYSTATE)pvUser;
+    int rc, rc2;
+
+    rc2 = vdThreadStartWrite(pState->pDiskTo);
+    AssertRC(rc2);
+
+    /* Only do collapsed I/O if we are copying the data blockwise. */
+    rc = vdWriteHelperEx(pState->pDiskTo, pState->pDiskTo->pLast, NULL, uOffset, pvBuf,
+                         cbWrite, VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG /* fFlags */,
+                         pState->fBlockwiseCopy ? pState->cImagesToRead : 0);
+
+    rc2 = vdThreadFinishWrite(pState->pDiskTo);
+    AssertRC(rc2);
+
+    return rc;
+}
+
+/**
+ * Internal: Copies the content of one disk to another one applying optimizations
+ * to speed up the copy process if possible.
+ */
+static int vdCopyHelper(PVBOXHDD pDiskFrom, PVDIMAGE pImageFrom, PVBOXHDD pDiskTo,
+                        uint64_t cbSize, unsigned cImagesFromRead, unsigned cImagesToRead,
+                        bool fSuppressRedundantIo, bool fSkipZeroes, PVDINTERFACEPROGRESS pIfProgress,
+                        PVDINTERFACEPROGRESS pDstIfProgress)
+{
+    VDCOPYSTATE State;
+
+    LogFlowFunc(("pDiskFrom=%#p pImageFrom=%#p pDiskTo=%#p cbSize=%llu cImagesFromRead=%u cImagesToRead=%u fSuppressRedundantIo=%RTbool fSkipZeroes=%RTbool pIfProgress=%#p pDstIfProgress=%#p\n",
+                 pDiskFrom, pImageFrom, pDiskTo, cbSize, cImagesFromRead, cImagesToRead, fSuppressRedundantIo, fSkipZeroes, pIfProgress, pDstIfProgress));
+
+    State.pDiskFrom       = pDiskFrom;
+    State.pImageFrom      = pImageFrom;
+    State.pDiskTo         = pDiskTo;
+    State.cImagesFromRead = cImagesFromRead;
+    State.cImagesToRead   = cImagesToRead;
+    State.fBlockwiseCopy  = fSuppressRedundantIo || (cImagesFromRead > 0);
+
+    int rc = vdCopyPipeRun(cbSize, pDiskFrom->cCopyThreads, fSkipZeroes,
+                           vdCopyHelperRead, vdCopyHelperWrite, &State,
+                           pIfProgress, pDstIfProgress);
+
+    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    return rc;
+}
+
+/**
+ * Internal: State of a child into parent merge.
+ */
+typedef struct VDMERGESTATE
+{
+    PVBOXHDD               pDisk;
+    PVDIMAGE               pImageFrom;
+    PVDIMAGE               pImageTo;
+} VDMERGESTATE;
+/** Pointer to the merge state. */
+typedef VDMERGESTATE *PVDMERGESTATE;
+
+/**
+ * @callback_method_impl{FNVDCOPYREAD, Reads from the images to merge into the parent.}
+ */
+static DECLCALLBACK(int) vdMergeHelperRead(void *pvUser, uint64_t uOffset, void *pvBuf,
+                                           size_t cbRead, size_t *pcbThisRead)
+{
+    PVDMERGESTATE pState = (PVDMERGESTATE)pvUser;
+    int rc = VERR_VD_BLOCK_FREE;
+    int rc2;
+    RTSGSEG SegmentBuf;
+    RTSGBUF SgBuf;
+    VDIOCTX IoCtx;
+
+    SegmentBuf.pvSeg = pvBuf;
+    SegmentBuf.cbSeg = cbRead;
+    RTSgBufInit(&SgBuf, &SegmentBuf, 1);
+    vdIoCtxInit(&IoCtx, pState->pDisk, VDIOCTXTXDIR_READ, 0, 0, NULL,
+                &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
+
+    rc2 = vdThreadStartWrite(pState->pDisk);
+    AssertRC(rc2);
+
+    /* Search for image with allocated block. Do not attempt to
+     * read more than the previous reads marked as valid. Otherwise
+     * this would return stale data when different block sizes are
+     * used for the images. */
+    *pcbThisRead = cbRead;
+    for (PVDIMAGE pCurrImage = pState->pImageFrom;
+         pCurrImage != NULL && pCurrImage != pState->pImageTo && rc == VERR_VD_BLOCK_FREE;
+         pCurrImage = pCurrImage->pPrev)
     {
-        rc2 = vdThreadFinishWrite(pDiskTo);
-        AssertRC(rc2);
+        rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                          uOffset, *pcbThisRead,
+                                          &IoCtx, pcbThisRead);
     }
 
-    LogFlowFunc(("returns rc=%Rrc\n", rc));
+    rc2 = vdThreadFinishWrite(pState->pDisk);
+    AssertRC(rc2);
+
+    return rc;
+}
+
+/**
+ * @callback_method_impl{FNVDCOPYWRITE, Writes merged data to the parent image.}
+ */
+static DECLCALLBACK(int) vdMergeHelperWrite(void *pvUser, uint64_t uOffset, const void *pvBuf,
+                                            size_t cbWrite)
+{
+    PVDMERGESTATE pState = (PVDMERGESTATE)pvUser;
+    int rc, rc2;
+
+    rc2 = vdThreadStartWrite(pState->pDisk);
+    AssertRC(rc2);
+
+    /* The modified flag was set before the pipe started, see VDMerge. */
+    rc = vdWriteHelper(pState->pDisk, pState->pImageTo, uOffset, pvBuf, cbWrite,
+                       VDIOCTX_FLAGS_READ_UPDATE_CACHE | VDIOCTX_FLAGS_DONT_SET_MODIFIED_FLAG);
+
+    rc2 = vdThreadFinishWrite(pState->pDisk);
+    AssertRC(rc2);
+
     return rc;
 }
 
@@ -2995,6 +3822,8 @@ static int vdWriteHelperAsync(PVDIOCTX pIoCtx)
     if (RT_FAILURE(rc))
         return rc;
 
+    vdAllocMapWrite(pDisk, pImage, uOffset, cbWrite);
+
     /* Loop until all written. */
     do
     {
@@ -3446,6 +4275,8 @@ static int vdDiscardHelperAsync(PVDIOCTX pIoCtx)
             LogFlowFunc(("New range descriptor loaded (%u) offStart=%llu cbDiscard=%zu\n",
                          pIoCtx->Req.Discard.idxRange, offStart, cbDiscardLeft));
             pIoCtx->Req.Discard.idxRange++;
+
+            vdAllocMapInvalidate(pDisk, offStart, cbDiscardLeft, VD_ALLOC_MAP_UNKNOWN);
         }
 
         /* Look for a matching block in the AVL tree first. */
@@ -6012,6 +6843,10 @@ VBOXDDU_DECL(int) VDCreate(PVDINTERFACE pVDIfsDisk, VDTYPE enmType, PVBOXHDD *pp
             pDisk->hMemCacheIoTask         = NIL_RTMEMCACHE;
             pDisk->pFilterHead             = NULL;
             pDisk->pFilterTail             = NULL;
+            pDisk->cCopyThreads            = 0;
+            pDisk->papbAllocMap            = NULL;
+            pDisk->cAllocMapChunks         = 0;
+            pDisk->cAllocMapChunksUsed     = 0;
 
             /* Create the I/O ctx cache */
             rc = RTMemCacheCreate(&pDisk->hMemCacheIoCtx, sizeof(VDIOCTX), 0, UINT32_MAX,
@@ -7818,71 +8653,100 @@ VBOXDDU_DECL(int) VDMerge(PVBOXHDD pDisk, unsigned nImageFrom,
             /* Merge child state into parent. This means writing all blocks
              * which are allocated in the image up to the source image to the
              * destination image. */
-            uint64_t uOffset = 0;
-            uint64_t cbRemaining = cbSize;
-            do
+            if (!pDisk->pInterfaceThreadSync)
             {
-                size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
-                RTSGSEG SegmentBuf;
-                RTSGBUF SgBuf;
-                VDIOCTX IoCtx;
+                /* Nobody else accesses the disk, so the reads and writes of
+                 * different chunks can be done in parallel. */
+                VDMERGESTATE State;
 
-                rc = VERR_VD_BLOCK_FREE;
-
-                SegmentBuf.pvSeg = pvBuf;
-                SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
-                RTSgBufInit(&SgBuf, &SegmentBuf, 1);
-                vdIoCtxInit(&IoCtx, pDisk, VDIOCTXTXDIR_READ, 0, 0, NULL,
-                            &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
-
-                /* Need to hold the write lock during a read-write operation. */
+                /* Mark the disk as modified up front, doing it from the first
+                 * of several concurrent writes races on the first modification
+                 * handling (UUID update and flush). */
                 rc2 = vdThreadStartWrite(pDisk);
                 AssertRC(rc2);
-                fLockWrite = true;
+                vdSetModifiedFlag(pDisk);
+                rc2 = vdThreadFinishWrite(pDisk);
+                AssertRC(rc2);
 
-                /* Search for image with allocated block. Do not attempt to
-                 * read more than the previous reads marked as valid. Otherwise
-                 * this would return stale data when different block sizes are
-                 * used for the images. */
-                for (PVDIMAGE pCurrImage = pImageFrom;
-                     pCurrImage != NULL && pCurrImage != pImageTo && rc == VERR_VD_BLOCK_FREE;
-                     pCurrImage = pCurrImage->pPrev)
+                State.pDisk      = pDisk;
+                State.pImageFrom = pImageFrom;
+                State.pImageTo   = pImageTo;
+                rc = vdCopyPipeRun(cbSize, pDisk->cCopyThreads, false /* fSkipZeroes */,
+                                   vdMergeHelperRead, vdMergeHelperWrite, &State,
+                                   pIfProgress, NULL);
+            }
+            else
+            {
+                /* In case of a live merge the read and the write of a block must
+                 * be done while holding the write lock, otherwise a guest write
+                 * relayed to the destination in between is overwritten with
+                 * stale data. */
+                uint64_t uOffset = 0;
+                uint64_t cbRemaining = cbSize;
+                do
                 {
-                    rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
-                                                           uOffset, cbThisRead,
-                                                           &IoCtx, &cbThisRead);
-                }
+                    size_t cbThisRead = RT_MIN(VD_MERGE_BUFFER_SIZE, cbRemaining);
+                    RTSGSEG SegmentBuf;
+                    RTSGBUF SgBuf;
+                    VDIOCTX IoCtx;
 
-                if (rc != VERR_VD_BLOCK_FREE)
-                {
-                    if (RT_FAILURE(rc))
-                        break;
-                    rc = vdWriteHelper(pDisk, pImageTo, uOffset, pvBuf,
-                                       cbThisRead, VDIOCTX_FLAGS_READ_UPDATE_CACHE);
-                    if (RT_FAILURE(rc))
-                        break;
-                }
-                else
-                    rc = VINF_SUCCESS;
+                    rc = VERR_VD_BLOCK_FREE;
 
-                rc2 = vdThreadFinishWrite(pDisk);
-                AssertRC(rc2);
-                fLockWrite = false;
+                    SegmentBuf.pvSeg = pvBuf;
+                    SegmentBuf.cbSeg = VD_MERGE_BUFFER_SIZE;
+                    RTSgBufInit(&SgBuf, &SegmentBuf, 1);
+                    vdIoCtxInit(&IoCtx, pDisk, VDIOCTXTXDIR_READ, 0, 0, NULL,
+                                &SgBuf, NULL, NULL, VDIOCTX_FLAGS_SYNC);
 
-                uOffset += cbThisRead;
-                cbRemaining -= cbThisRead;
+                    /* Need to hold the write lock during a read-write operation. */
+                    rc2 = vdThreadStartWrite(pDisk);
+                    AssertRC(rc2);
+                    fLockWrite = true;
 
-                if (pIfProgress && pIfProgress->pfnProgress)
-                {
-                    /** @todo r=klaus: this can update the progress to the same
-                     * percentage over and over again if the image format makes
-                     * relatively small increments. */
-                    rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
-                                                  uOffset * 99 / cbSize);
-                    if (RT_FAILURE(rc))
-                        break;
-                }
-            } while (uOffset < cbSize);
+                    /* Search for image with allocated block. Do not attempt to
+                     * read more than the previous reads marked as valid. Otherwise
+                     * this would return stale data when different block sizes are
+                     * used for the images. */
+                    for (PVDIMAGE pCurrImage = pImageFrom;
+                         pCurrImage != NULL && pCurrImage != pImageTo && rc == VERR_VD_BLOCK_FREE;
+                         pCurrImage = pCurrImage->pPrev)
+                    {
+                        rc = pCurrImage->Backend->pfnRead(pCurrImage->pBackendData,
+                                                               uOffset, cbThisRead,
+                                                               &IoCtx, &cbThisRead);
+                    }
+
+                    if (rc != VERR_VD_BLOCK_FREE)
+                    {
+                        if (RT_FAILURE(rc))
+                            break;
+                        rc = vdWriteHelper(pDisk, pImageTo, uOffset, pvBuf,
+                                           cbThisRead, VDIOCTX_FLAGS_READ_UPDATE_CACHE);
+                        if (RT_FAILURE(rc))
+                            break;
+                    }
+                    else
+                        rc = VINF_SUCCESS;
+
+                    rc2 = vdThreadFinishWrite(pDisk);
+                    AssertRC(rc2);
+                    fLockWrite = false;
+
+                    uOffset += cbThisRead;
+                    cbRemaining -= cbThisRead;
+
+                    if (pIfProgress && pIfProgress->pfnProgress)
+                    {
+                        /** @todo r=klaus: this can update the progress to the same
+                         * percentage over and over again if the image format makes
+                         * relatively small increments. */
+                        rc = pIfProgress->pfnProgress(pIfProgress->Core.pvUser,
+                                                      uOffset * 99 / cbSize);
+                        if (RT_FAILURE(rc))
+                            break;
+                    }
+                } while (uOffset < cbSize);
+            }
 
             /* In case we set up a "write proxy" image above we must clear
              * this again now to prevent stray writes. Failure or not. */
@@ -8275,6 +9139,11 @@ VBOXDDU_DECL(int) VDCopyEx(PVBOXHDD pDiskFrom, unsigned nImage, PVBOXHDD pDiskTo
          * Don't optimize if the image existed or if it is a child image. */
         bool fSuppressRedundantIo = (   !(pszFilename == NULL || cImagesTo > 0)
                                      || (nImageToSame != VD_IMAGE_CONTENT_UNKNOWN));
+        /* Zeroed blocks don't need to be written if the destination is a freshly
+         * created dynamic base image which reads as zero already. */
+        bool fSkipZeroes = (   pszFilename != NULL
+                            && cImagesTo == 0
+                            && !(uImageFlags & VD_IMAGE_FLAGS_FIXED));
         unsigned cImagesFromReadBack, cImagesToReadBack;
 
         if (nImageFromSame == VD_IMAGE_CONTENT_UNKNOWN)
@@ -8295,7 +9164,7 @@ VBOXDDU_DECL(int) VDCopyEx(PVBOXHDD pDiskFrom, unsigned nImage, PVBOXHDD pDiskTo
         /* Copy the data. */
         rc = vdCopyHelper(pDiskFrom, pImageFrom, pDiskTo, cbSize,
                           cImagesFromReadBack, cImagesToReadBack,
-                          fSuppressRedundantIo, pIfProgress, pDstIfProgress);
+                          fSuppressRedundantIo, fSkipZeroes, pIfProgress, pDstIfProgress);
 
         if (RT_SUCCESS(rc))
         {
@@ -8498,6 +9367,9 @@ VBOXDDU_DECL(int) VDCompact(PVBOXHDD pDisk, unsigned nImage,
                                          pDisk->pVDIfsDisk,
                                          pImage->pVDIfsImage,
                                          pVDIfsOperation);
+
+        /* Blocks might have been freed or moved in the image. */
+        vdAllocMapDestroy(pDisk);
     } while (0);
 
     if (RT_UNLIKELY(fLockWrite))
@@ -8652,6 +9524,7 @@ VBOXDDU_DECL(int) VDResize(PVBOXHDD pDisk, uint64_t cbSize,
             pIfProgress->pfnProgress(pIfProgress->Core.pvUser, 100);
 
         pDisk->cbSize = cbSize;
+        vdAllocMapDestroy(pDisk);
     }
 
     LogFlowFunc(("returns %Rrc\n", rc));
@@ -9212,6 +10085,50 @@ VBOXDDU_DECL(unsigned) VDGetCount(PVBOXHDD pDisk)
     return cImages;
 }
 
+/**
+ * Sets the number of worker threads used when copying or merging images
+ * of the HDD container.
+ *
+ * @return  VBox status code.
+ * @return  VERR_INVALID_PARAMETER if cThreads exceeds the supported maximum.
+ * @param   pDisk           Pointer to HDD container.
+ * @param   cThreads        Number of worker threads, 0 selects the default.
+ */
+VBOXDDU_DECL(int) VDSetCopyThreads(PVBOXHDD pDisk, unsigned cThreads)
+{
+    int rc = VINF_SUCCESS;
+    int rc2;
+    bool fLockWrite = false;
+
+    LogFlowFunc(("pDisk=%#p cThreads=%u\n", pDisk, cThreads));
+    do
+    {
+        /* sanity check */
+        AssertPtrBreakStmt(pDisk, rc = VERR_INVALID_PARAMETER);
+        AssertMsg(pDisk->u32Signature == VBOXHDDDISK_SIGNATURE, ("u32Signature=%08x\n", pDisk->u32Signature));
+
+        /* Check arguments. */
+        AssertMsgBreakStmt(cThreads <= VD_COPY_THREADS_MAX,
+                           ("cThreads=%u\n", cThreads),
+                           rc = VERR_INVALID_PARAMETER);
+
+        rc2 = vdThreadStartWrite(pDisk);
+        AssertRC(rc2);
+        fLockWrite = true;
+
+        pDisk->cCopyThreads = cThreads;
+    } while (0);
+
+    if (RT_UNLIKELY(fLockWrite))
+    {
+        rc2 = vdThreadFinishWrite(pDisk);
+        AssertRC(rc2);
+    }
+
+    LogFlowFunc(("returns %Rrc\n", rc));
+    return rc;
+}
+
 /**
  * Get read/write mode of HDD container.
  *
@@ -31,6 +31,10 @@
 #include <iprt/rand.h>
 #include <iprt/zip.h>
 #include <iprt/asm.h>
+#include <iprt/critsect.h>
+#include <iprt/semaphore.h>
+#include <iprt/thread.h>
+#include <iprt/mp.h>
 
 #include "VDBackends.h"
 
@@ -305,6 +309,9 @@ typedef struct VMDKEXTENT
     bool        fMetaDirty;
     /** Flag whether there is a footer in this extent. */
     bool        fFooter;
+    /** Flag whether the grain directory of this readonly streamOptimized
+     * extent can't be located and the grains are indexed on open. */
+    bool        fGrainIndex;
     /** Compression type for this extent. */
     uint16_t    uCompression;
     /** Append position for writing new grain. Only for sparse extents. */
@@ -323,12 +330,86 @@ typedef struct VMDKEXTENT
     void        *pvCompGrain;
     /** Decompressed grain buffer for streamOptimized extents. */
     void        *pvGrain;
+    /** Grain index of readonly streamOptimized extents without a usable grain
+     * directory. File sector of the marker of each grain, 0 if not present. */
+    uint32_t    *pauGrainIndex;
+    /** Number of entries in the grain index. */
+    uint32_t    cGrainIndex;
+    /** Pipeline deflating grains in parallel when writing streamOptimized
+     * extents, NULL if grains are deflated inline. */
+    struct VMDKDEFLATEPIPE *pDeflatePipe;
+    /** Flag whether grains are deflated inline because the pipeline is
+     * not available (single CPU host or creation failed). */
+    bool        fDeflateInline;
     /** Reference to the image in which this extent is used. Do not use this
      * on a regular basis to avoid passing pImage references to functions
      * explicitly. */
     struct VMDKIMAGE *pImage;
 } VMDKEXTENT, *PVMDKEXTENT;
 
+/** Maximum number of threads deflating grains of a streamOptimized extent. */
+#define VMDK_DEFLATE_THREADS_MAX        8
+/** Number of grains queued per deflate thread. */
+#define VMDK_DEFLATE_SLOTS_PER_THREAD   2
+
+/**
+ * Grain queued for deflating when writing streamOptimized extents.
+ */
+typedef struct VMDKDEFLATESLOT
+{
+    /** Grain number. */
+    uint32_t        uGrain;
+    /** Size of the compressed grain including marker and padding. */
+    uint32_t        cbCompGrain;
+    /** Start sector of the grain, stored in the marker. */
+    uint64_t        uLBA;
+    /** Status code of deflating the grain. */
+    int             rc;
+    /** Flag whether a worker finished deflating the grain. */
+    volatile bool   fDone;
+    /** Uncompressed grain data. */
+    void           *pvGrain;
+    /** Compressed grain buffer with marker. */
+    void           *pvCompGrain;
+} VMDKDEFLATESLOT, *PVMDKDEFLATESLOT;
+
+/**
+ * Pipeline deflating the grains of a streamOptimized extent on worker
+ * threads. The grains are written to the file and entered into the grain
+ * table in order by the thread doing the writes.
+ */
+typedef struct VMDKDEFLATEPIPE
+{
+    /** Critical section protecting the deflate queue. */
+    RTCRITSECT      CritSect;
+    /** Event signalled when grains are queued or the workers should stop. */
+    RTSEMEVENT      hEvtWork;
+    /** Event signalled when a worker finished a grain. */
+    RTSEMEVENT      hEvtDone;
+    /** Flag whether the workers should terminate. */
+    volatile bool   fShutdown;
+    /** Number of worker threads. */
+    unsigned        cThreads;
+    /** The worker threads. */
+    RTTHREAD        ahThreads[VMDK_DEFLATE_THREADS_MAX];
+    /** Size of an uncompressed grain. */
+    size_t          cbGrain;
+    /** Size of the compressed grain buffers. */
+    size_t          cbCompGrain;
+    /** Number of slots in the ring. */
+    unsigned        cSlots;
+    /** Number of grains queued and not yet written, writer thread only. */
+    unsigned        cQueued;
+    /** Index of the oldest queued grain which is written next, writer thread only. */
+    unsigned        idxWrite;
+    /** Number of queued grains not picked up by a worker yet. */
+    unsigned        cPending;
+    /** Index of the next grain to deflate. */
+    unsigned        idxDeflate;
+    /** The slots, cSlots entries. */
+    VMDKDEFLATESLOT aSlots[1];
+} VMDKDEFLATEPIPE, *PVMDKDEFLATEPIPE;
+
 /**
  * Grain table cache size. Allocated per image.
  */
@@ -783,22 +864,22 @@ static DECLCALLBACK(int) vmdkFileDeflateHelper(void *pvUser, const void *pvBuf,
 }
 
 /**
- * Internal: deflate the uncompressed data and write to a file,
- * distinguishing between async and normal operation
+ * Internal: deflate the uncompressed data into the given buffer and put the
+ * compressed grain marker in front of it. Doesn't touch any extent state, so
+ * it can be called from the deflate worker threads.
  */
-DECLINLINE(int) vmdkFileDeflateSync(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
-                                    uint64_t uOffset, const void *pvBuf,
-                                    size_t cbToWrite, uint64_t uLBA,
-                                    uint32_t *pcbMarkerData)
+static int vmdkDeflateGrain(void *pvCompGrain, size_t cbCompGrain,
+                            const void *pvBuf, size_t cbToWrite, uint64_t uLBA,
+                            uint32_t *pcbMarkerData)
 {
     int rc;
     PRTZIPCOMP pZip = NULL;
     VMDKCOMPRESSIO DeflateState;
 
-    DeflateState.pImage = pImage;
+    DeflateState.pImage = NULL;
     DeflateState.iOffset = -1;
-    DeflateState.cbCompGrain = pExtent->cbCompGrain;
-    DeflateState.pvCompGrain = pExtent->pvCompGrain;
+    DeflateState.cbCompGrain = cbCompGrain;
+    DeflateState.pvCompGrain = pvCompGrain;
 
     rc = RTZipCompCreate(&pZip, &DeflateState, vmdkFileDeflateHelper,
                          RTZIPTYPE_ZLIB, RTZIPLEVEL_DEFAULT);
@@ -818,7 +899,7 @@ DECLINLINE(int) vmdkFileDeflateSync(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
         if (uSize % 512)
         {
             uint32_t uSizeAlign = RT_ALIGN(uSize, 512);
-            memset((uint8_t *)pExtent->pvCompGrain + uSize, '\0',
+            memset((uint8_t *)pvCompGrain + uSize, '\0',
                    uSizeAlign - uSize);
             uSize = uSizeAlign;
         }
@@ -827,14 +908,32 @@ DECLINLINE(int) vmdkFileDeflateSync(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
             *pcbMarkerData = uSize;
 
         /* Compressed grain marker. Data follows immediately. */
-        VMDKMARKER *pMarker = (VMDKMARKER *)pExtent->pvCompGrain;
+        VMDKMARKER *pMarker = (VMDKMARKER *)pvCompGrain;
         pMarker->uSector = RT_H2LE_U64(uLBA);
         pMarker->cbSize = RT_H2LE_U32(  DeflateState.iOffset
                                       - RT_OFFSETOF(VMDKMARKER, uType));
+    }
+    return rc;
+}
+
+/**
+ * Internal: deflate the uncompressed data and write to a file,
+ * distinguishing between async and normal operation
+ */
+DECLINLINE(int) vmdkFileDeflateSync(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
+                                    uint64_t uOffset, const void *pvBuf,
+                                    size_t cbToWrite, uint64_t uLBA,
+                                    uint32_t *pcbMarkerData)
+{
+    uint32_t cbMarkerData = 0;
+    int rc = vmdkDeflateGrain(pExtent->pvCompGrain, pExtent->cbCompGrain,
+                              pvBuf, cbToWrite, uLBA, &cbMarkerData);
+    if (RT_SUCCESS(rc))
+    {
+        if (pcbMarkerData)
+            *pcbMarkerData = cbMarkerData;
         rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
-                                    uOffset, pMarker, uSize);
-        if (RT_FAILURE(rc))
-            return rc;
+                                    uOffset, pExtent->pvCompGrain, cbMarkerData);
     }
     return rc;
 }
@@ -2507,6 +2606,103 @@ static int vmdkValidateHeader(PVMDKIMAGE pImage, PVMDKEXTENT pExtent, const Spar
     return rc;
 }
 
+/**
+ * Internal: builds the grain index of a readonly streamOptimized extent by
+ * walking over all markers, used if the grain directory can't be located.
+ */
+static int vmdkStreamBuildGrainIndex(PVMDKIMAGE pImage, PVMDKEXTENT pExtent)
+{
+    uint64_t cGrains = (pExtent->cSectors + pExtent->cSectorsPerGrain - 1) / pExtent->cSectorsPerGrain;
+    uint64_t uGrainSectorAbs = pExtent->cOverheadSectors;
+    uint64_t cbFile = 0;
+
+    int rc = vdIfIoIntFileGetSize(pImage->pIfIo, pExtent->pFile->pStorage, &cbFile);
+    if (RT_FAILURE(rc))
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VMDK: cannot get size of '%s'"), pExtent->pszFullname);
+
+    uint64_t cFileSectors = VMDK_BYTE2SECTOR(cbFile);
+    if (   !cGrains
+        || cGrains > UINT32_MAX
+        || cFileSectors > UINT32_MAX)
+        return vdIfError(pImage->pIfError, VERR_VD_VMDK_INVALID_HEADER, RT_SRC_POS,
+                         N_("VMDK: cannot index grains of '%s'"), pExtent->pszFullname);
+
+    pExtent->pauGrainIndex = (uint32_t *)RTMemAllocZ(cGrains * sizeof(uint32_t));
+    if (!pExtent->pauGrainIndex)
+        return VERR_NO_MEMORY;
+    pExtent->cGrainIndex = (uint32_t)cGrains;
+
+    while (uGrainSectorAbs < cFileSectors)
+    {
+        VMDKMARKER Marker;
+        RT_ZERO(Marker);
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                   VMDK_SECTOR2BYTE(uGrainSectorAbs),
+                                   &Marker, RT_OFFSETOF(VMDKMARKER, uType));
+        if (RT_FAILURE(rc))
+            break;
+        Marker.uSector = RT_LE2H_U64(Marker.uSector);
+        Marker.cbSize = RT_LE2H_U32(Marker.cbSize);
+
+        if (Marker.cbSize)
+        {
+            /* Compressed grain, the data follows the marker immediately. */
+            if (   Marker.uSector % pExtent->cSectorsPerGrain
+                || Marker.uSector >= pExtent->cSectors)
+            {
+                rc = VERR_VD_VMDK_INVALID_FORMAT;
+                break;
+            }
+            pExtent->pauGrainIndex[Marker.uSector / pExtent->cSectorsPerGrain] = (uint32_t)uGrainSectorAbs;
+            uGrainSectorAbs += VMDK_BYTE2SECTOR(RT_ALIGN_64(Marker.cbSize + RT_OFFSETOF(VMDKMARKER, uType), 512));
+            continue;
+        }
+
+        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                     VMDK_SECTOR2BYTE(uGrainSectorAbs)
+                                   + RT_OFFSETOF(VMDKMARKER, uType),
+                                   &Marker.uType, sizeof(Marker.uType));
+        if (RT_FAILURE(rc))
+            break;
+        Marker.uType = RT_LE2H_U32(Marker.uType);
+        if (Marker.uType == VMDK_MARKER_EOS)
+            break;
+
+        /* Skip metadata the same way as the sequential reader does. */
+        switch (Marker.uType)
+        {
+            case VMDK_MARKER_GT:
+                uGrainSectorAbs += 1 + VMDK_BYTE2SECTOR(pExtent->cGTEntries * sizeof(uint32_t));
+                break;
+            case VMDK_MARKER_GD:
+                uGrainSectorAbs += 1 + VMDK_BYTE2SECTOR(RT_ALIGN(pExtent->cGDEntries * sizeof(uint32_t), 512));
+                break;
+            case VMDK_MARKER_FOOTER:
+                uGrainSectorAbs += 2;
+                break;
+            case VMDK_MARKER_UNSPECIFIED:
+                uGrainSectorAbs += 1;
+                break;
+            default:
+                rc = VERR_VD_VMDK_INVALID_FORMAT;
+                break;
+        }
+        if (RT_FAILURE(rc))
+            break;
+    }
+
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pExtent->pauGrainIndex);
+        pExtent->pauGrainIndex = NULL;
+        pExtent->cGrainIndex = 0;
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS,
+                         N_("VMDK: error indexing the grains of '%s'"), pExtent->pszFullname);
+    }
+
+    return rc;
+}
+
 /**
  * Internal: read metadata belonging to an extent with binary header, i.e.
  * as found in monolithic files.
@@ -2567,19 +2763,37 @@ static int vmdkReadBinaryMetaExtent(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
             || !(pImage->uOpenFlags & VD_OPEN_FLAGS_SEQUENTIAL)))
     {
         /* Read the footer, which comes before the end-of-stream marker. */
-        rc = vdIfIoIntFileReadSync(pImage->pIfIo, pExtent->pFile->pStorage,
-                                   cbFile - 2*512, &Header,
-                                   sizeof(Header));
-        AssertRC(rc);
-        if (RT_FAILURE(rc))
+        SparseExtentHeader Footer;
+        RT_ZERO(Footer);
+        if (cbFile >= 2*512)
+            rc = vdIfIoIntFileReadSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                       cbFile - 2*512, &Footer,
+                                       sizeof(Footer));
+        if (   (pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+            && (   RT_FAILURE(rc)
+                || RT_LE2H_U32(Footer.magicNumber) != VMDK_SPARSE_MAGICNUMBER
+                || RT_LE2H_U64(Footer.gdOffset) == VMDK_GD_AT_END))
         {
-            vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VMDK: error reading extent footer in '%s'"), pExtent->pszFullname);
-            rc = VERR_VD_VMDK_INVALID_HEADER;
-            goto out;
+            /* No usable footer (e.g. a truncated stream), so there is no way
+             * to find the grain directory. Index the grains instead. */
+            LogRel(("VMDK: no usable footer in '%s', indexing grains\n", pExtent->pszFullname));
+            pExtent->fGrainIndex = true;
+            rc = VINF_SUCCESS;
+        }
+        else
+        {
+            AssertRC(rc);
+            if (RT_FAILURE(rc))
+            {
+                vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VMDK: error reading extent footer in '%s'"), pExtent->pszFullname);
+                rc = VERR_VD_VMDK_INVALID_HEADER;
+                goto out;
+            }
+            Header = Footer;
+            rc = vmdkValidateHeader(pImage, pExtent, &Header);
+            if (RT_FAILURE(rc))
+                goto out;
         }
-        rc = vmdkValidateHeader(pImage, pExtent, &Header);
-        if (RT_FAILURE(rc))
-            goto out;
         /* Prohibit any writes to this extent. */
         pExtent->uAppendPosition = 0;
     }
@@ -2608,6 +2822,7 @@ static int vmdkReadBinaryMetaExtent(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
     }
     if (   (   pExtent->uSectorGD == VMDK_GD_AT_END
             || pExtent->uSectorRGD == VMDK_GD_AT_END)
+        && !pExtent->fGrainIndex
         && (   !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
             || !(pImage->uOpenFlags & VD_OPEN_FLAGS_SEQUENTIAL)))
     {
@@ -2701,9 +2916,16 @@ static int vmdkReadMetaExtent(PVMDKIMAGE pImage, PVMDKEXTENT pExtent)
     if (pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED)
         pExtent->uAppendPosition = 0;
 
-    if (   !(pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED)
-        || !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
-        || !(pImage->uOpenFlags & VD_OPEN_FLAGS_SEQUENTIAL))
+    if (pExtent->fGrainIndex)
+    {
+        if (pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED)
+            rc = vmdkStreamBuildGrainIndex(pImage, pExtent);
+        else
+            rc = vdIfError(pImage->pIfError, VERR_VD_VMDK_INVALID_HEADER, RT_SRC_POS, N_("VMDK: cannot resolve grain directory offset in '%s'"), pExtent->pszFullname);
+    }
+    else if (   !(pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED)
+             || !(pImage->uOpenFlags & VD_OPEN_FLAGS_READONLY)
+             || !(pImage->uOpenFlags & VD_OPEN_FLAGS_SEQUENTIAL))
         rc = vmdkReadGrainDirectory(pImage, pExtent);
     else
     {
@@ -2854,11 +3076,274 @@ out:
 }
 #endif /* VBOX_WITH_VMDK_ESX */
 
+/**
+ * Internal: worker thread deflating queued grains of a streamOptimized extent.
+ */
+static DECLCALLBACK(int) vmdkStreamDeflateWorker(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PVMDKDEFLATEPIPE pPipe = (PVMDKDEFLATEPIPE)pvUser;
+
+    for (;;)
+    {
+        RTCritSectEnter(&pPipe->CritSect);
+        if (pPipe->fShutdown)
+        {
+            RTCritSectLeave(&pPipe->CritSect);
+            /* Wake up the next worker so it notices the shutdown too. */
+            RTSemEventSignal(pPipe->hEvtWork);
+            break;
+        }
+
+        if (!pPipe->cPending)
+        {
+            RTCritSectLeave(&pPipe->CritSect);
+            RTSemEventWait(pPipe->hEvtWork, RT_INDEFINITE_WAIT);
+            continue;
+        }
+
+        PVMDKDEFLATESLOT pSlot = &pPipe->aSlots[pPipe->idxDeflate];
+        pPipe->idxDeflate = (pPipe->idxDeflate + 1) % pPipe->cSlots;
+        pPipe->cPending--;
+        bool fMore = pPipe->cPending > 0;
+        RTCritSectLeave(&pPipe->CritSect);
+
+        /* Let another worker pick up the remaining grains. */
+        if (fMore)
+            RTSemEventSignal(pPipe->hEvtWork);
+
+        pSlot->rc = vmdkDeflateGrain(pSlot->pvCompGrain, pPipe->cbCompGrain,
+                                     pSlot->pvGrain, pPipe->cbGrain,
+                                     pSlot->uLBA, &pSlot->cbCompGrain);
+        ASMAtomicWriteBool(&pSlot->fDone, true);
+        RTSemEventSignal(pPipe->hEvtDone);
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Internal: stops the deflate workers and frees the pipeline. Grains which
+ * were not written yet are discarded.
+ */
+static void vmdkStreamDeflatePipeDestroy(PVMDKEXTENT pExtent)
+{
+    PVMDKDEFLATEPIPE pPipe = pExtent->pDeflatePipe;
+
+    if (!pPipe)
+        return;
+
+    RTCritSectEnter(&pPipe->CritSect);
+    pPipe->fShutdown = true;
+    RTCritSectLeave(&pPipe->CritSect);
+    RTSemEventSignal(pPipe->hEvtWork);
+
+    for (unsigned i = 0; i < pPipe->cThreads; i++)
+        RTThreadWait(pPipe->ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+
+    for (unsigned i = 0; i < pPipe->cSlots; i++)
+    {
+        RTMemFree(pPipe->aSlots[i].pvGrain);
+        RTMemFree(pPipe->aSlots[i].pvCompGrain);
+    }
+
+    RTSemEventDestroy(pPipe->hEvtWork);
+    RTSemEventDestroy(pPipe->hEvtDone);
+    RTCritSectDelete(&pPipe->CritSect);
+    RTMemFree(pPipe);
+    pExtent->pDeflatePipe = NULL;
+}
+
+/**
+ * Internal: creates the deflate pipeline for writing a streamOptimized extent.
+ * Nothing is created on single CPU hosts, grains are deflated inline then.
+ */
+static int vmdkStreamDeflatePipeCreate(PVMDKEXTENT pExtent)
+{
+    unsigned cThreads = RT_MIN(RTMpGetOnlineCount(), VMDK_DEFLATE_THREADS_MAX);
+    if (cThreads < 2)
+        return VINF_SUCCESS;
+
+    unsigned cSlots = cThreads * VMDK_DEFLATE_SLOTS_PER_THREAD;
+    PVMDKDEFLATEPIPE pPipe = (PVMDKDEFLATEPIPE)RTMemAllocZ(RT_OFFSETOF(VMDKDEFLATEPIPE, aSlots[cSlots]));
+    if (!pPipe)
+        return VERR_NO_MEMORY;
+
+    pPipe->cbGrain     = VMDK_SECTOR2BYTE(pExtent->cSectorsPerGrain);
+    pPipe->cbCompGrain = pExtent->cbCompGrain;
+    pPipe->cSlots      = cSlots;
+    pPipe->hEvtWork    = NIL_RTSEMEVENT;
+    pPipe->hEvtDone    = NIL_RTSEMEVENT;
+    pExtent->pDeflatePipe = pPipe;
+
+    int rc = RTCritSectInit(&pPipe->CritSect);
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pPipe);
+        pExtent->pDeflatePipe = NULL;
+        return rc;
+    }
+
+    rc = RTSemEventCreate(&pPipe->hEvtWork);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPipe->hEvtDone);
+
+    for (unsigned i = 0; i < cSlots && RT_SUCCESS(rc); i++)
+    {
+        pPipe->aSlots[i].pvGrain     = RTMemAlloc(pPipe->cbGrain);
+        pPipe->aSlots[i].pvCompGrain = RTMemAlloc(pPipe->cbCompGrain);
+        if (   !pPipe->aSlots[i].pvGrain
+            || !pPipe->aSlots[i].pvCompGrain)
+            rc = VERR_NO_MEMORY;
+    }
+
+    for (unsigned i = 0; i < cThreads && RT_SUCCESS(rc); i++)
+    {
+        rc = RTThreadCreateF(&pPipe->ahThreads[i], vmdkStreamDeflateWorker, pPipe, 0,
+                             RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "VMDKDefl%u", i);
+        if (RT_SUCCESS(rc))
+            pPipe->cThreads++;
+    }
+
+    if (RT_FAILURE(rc))
+        vmdkStreamDeflatePipeDestroy(pExtent);
+
+    return rc;
+}
+
+/**
+ * Internal: writes the oldest queued grain to the file once it is deflated
+ * and enters it into the grain table.
+ */
+static int vmdkStreamDeflatePipeWriteOne(PVMDKIMAGE pImage, PVMDKEXTENT pExtent)
+{
+    PVMDKDEFLATEPIPE pPipe = pExtent->pDeflatePipe;
+    PVMDKDEFLATESLOT pSlot = &pPipe->aSlots[pPipe->idxWrite];
+    int rc;
+
+    Assert(pPipe->cQueued);
+    while (!ASMAtomicReadBool(&pSlot->fDone))
+        RTSemEventWait(pPipe->hEvtDone, RT_INDEFINITE_WAIT);
+
+    pPipe->idxWrite = (pPipe->idxWrite + 1) % pPipe->cSlots;
+    pPipe->cQueued--;
+
+    rc = pSlot->rc;
+    if (RT_SUCCESS(rc))
+    {
+        uint64_t uFileOffset = pExtent->uAppendPosition;
+        if (!uFileOffset)
+            return VERR_INTERNAL_ERROR;
+        /* Align to sector, as the previous write could have been any size. */
+        uFileOffset = RT_ALIGN_64(uFileOffset, 512);
+
+        uint32_t uCacheLine = pSlot->uGrain % pExtent->cGTEntries / VMDK_GT_CACHELINE_SIZE;
+        uint32_t uCacheEntry = pSlot->uGrain % VMDK_GT_CACHELINE_SIZE;
+        pImage->pGTCache->aGTCache[uCacheLine].aGTData[uCacheEntry] = VMDK_BYTE2SECTOR(uFileOffset);
+
+        rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                    uFileOffset, pSlot->pvCompGrain, pSlot->cbCompGrain);
+        if (RT_SUCCESS(rc))
+            pExtent->uAppendPosition = uFileOffset + pSlot->cbCompGrain;
+    }
+
+    if (RT_FAILURE(rc))
+    {
+        pExtent->uGrainSectorAbs = 0;
+        AssertRC(rc);
+        return vdIfError(pImage->pIfError, rc, RT_SRC_POS, N_("VMDK: cannot write compressed data block in '%s'"), pExtent->pszFullname);
+    }
+
+    return rc;
+}
+
+/**
+ * Internal: writes all queued grains, required before the grain table is
+ * written out.
+ */
+static int vmdkStreamDeflatePipeDrain(PVMDKIMAGE pImage, PVMDKEXTENT pExtent)
+{
+    int rc = VINF_SUCCESS;
+
+    if (pExtent->pDeflatePipe)
+    {
+        while (pExtent->pDeflatePipe->cQueued)
+        {
+            int rc2 = vmdkStreamDeflatePipeWriteOne(pImage, pExtent);
+            if (RT_SUCCESS(rc))
+                rc = rc2;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * Internal: returns whether the given grain is queued for deflating and not
+ * written yet.
+ */
+static bool vmdkStreamDeflatePipeIsQueued(PVMDKEXTENT pExtent, uint32_t uGrain)
+{
+    PVMDKDEFLATEPIPE pPipe = pExtent->pDeflatePipe;
+
+    if (pPipe)
+    {
+        for (unsigned i = 0; i < pPipe->cQueued; i++)
+            if (pPipe->aSlots[(pPipe->idxWrite + i) % pPipe->cSlots].uGrain == uGrain)
+                return true;
+    }
+
+    return false;
+}
+
+/**
+ * Internal: queues a grain for deflating. The data is copied from the I/O
+ * context, so the request completes before the grain reaches the file.
+ */
+static int vmdkStreamDeflatePipeQueue(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
+                                      uint32_t uGrain, uint64_t uLBA,
+                                      PVDIOCTX pIoCtx, size_t cbWrite)
+{
+    PVMDKDEFLATEPIPE pPipe = pExtent->pDeflatePipe;
+    int rc = VINF_SUCCESS;
+
+    if (pPipe->cQueued == pPipe->cSlots)
+    {
+        rc = vmdkStreamDeflatePipeWriteOne(pImage, pExtent);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    PVMDKDEFLATESLOT pSlot = &pPipe->aSlots[(pPipe->idxWrite + pPipe->cQueued) % pPipe->cSlots];
+    vdIfIoIntIoCtxCopyFrom(pImage->pIfIo, pIoCtx, pSlot->pvGrain, cbWrite);
+    if (cbWrite < pPipe->cbGrain)
+        memset((uint8_t *)pSlot->pvGrain + cbWrite, '\0', pPipe->cbGrain - cbWrite);
+    pSlot->uGrain      = uGrain;
+    pSlot->uLBA        = uLBA;
+    pSlot->cbCompGrain = 0;
+    pSlot->rc          = VINF_SUCCESS;
+    pSlot->fDone       = false;
+    pPipe->cQueued++;
+
+    RTCritSectEnter(&pPipe->CritSect);
+    pPipe->cPending++;
+    RTCritSectLeave(&pPipe->CritSect);
+    RTSemEventSignal(pPipe->hEvtWork);
+
+    return rc;
+}
+
 /**
  * Internal: free the buffers used for streamOptimized images.
  */
 static void vmdkFreeStreamBuffers(PVMDKEXTENT pExtent)
 {
+    vmdkStreamDeflatePipeDestroy(pExtent);
+    if (pExtent->pauGrainIndex)
+    {
+        RTMemFree(pExtent->pauGrainIndex);
+        pExtent->pauGrainIndex = NULL;
+        pExtent->cGrainIndex = 0;
+    }
     if (pExtent->pvCompGrain)
     {
         RTMemFree(pExtent->pvCompGrain);
@@ -4272,13 +4757,21 @@ static int vmdkFreeImage(PVMDKIMAGE pImage, bool fDelete)
             {
                 PVMDKEXTENT pExtent = &pImage->pExtents[0];
                 uint32_t uLastGDEntry = pExtent->uLastGrainAccess / pExtent->cGTEntries;
-                rc = vmdkStreamFlushGT(pImage, pExtent, uLastGDEntry);
-                AssertRC(rc);
+                /* Errors are remembered, but the remaining metadata is still
+                 * written so that the grains which made it to the file can be
+                 * read back. */
+                rc = vmdkStreamDeflatePipeDrain(pImage, pExtent);
+                int rc2 = vmdkStreamFlushGT(pImage, pExtent, uLastGDEntry);
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
                 vmdkStreamClearGT(pImage, pExtent);
                 for (uint32_t i = uLastGDEntry + 1; i < pExtent->cGDEntries; i++)
                 {
-                    rc = vmdkStreamFlushGT(pImage, pExtent, i);
-                    AssertRC(rc);
+                    rc2 = vmdkStreamFlushGT(pImage, pExtent, i);
+                    AssertRC(rc2);
+                    if (RT_SUCCESS(rc))
+                        rc = rc2;
                 }
 
                 uint64_t uFileOffset = pExtent->uAppendPosition;
@@ -4295,9 +4788,11 @@ static int vmdkFreeImage(PVMDKIMAGE pImage, bool fDelete)
                 memset(pMarker, '\0', sizeof(aMarker));
                 pMarker->uSector = VMDK_BYTE2SECTOR(RT_ALIGN_64(RT_H2LE_U64((uint64_t)pExtent->cGDEntries * sizeof(uint32_t)), 512));
                 pMarker->uType = RT_H2LE_U32(VMDK_MARKER_GD);
-                rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage, uFileOffset,
-                                            aMarker, sizeof(aMarker));
-                AssertRC(rc);
+                rc2 = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage, uFileOffset,
+                                             aMarker, sizeof(aMarker));
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
                 uFileOffset += 512;
 
                 /* Write grain directory in little endian style. The array will
@@ -4305,10 +4800,12 @@ static int vmdkFreeImage(PVMDKIMAGE pImage, bool fDelete)
                 uint32_t *pGDTmp = pExtent->pGD;
                 for (uint32_t i = 0; i < pExtent->cGDEntries; i++, pGDTmp++)
                     *pGDTmp = RT_H2LE_U32(*pGDTmp);
-                rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
-                                            uFileOffset, pExtent->pGD,
-                                            pExtent->cGDEntries * sizeof(uint32_t));
-                AssertRC(rc);
+                rc2 = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                             uFileOffset, pExtent->pGD,
+                                             pExtent->cGDEntries * sizeof(uint32_t));
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
 
                 pExtent->uSectorGD = VMDK_BYTE2SECTOR(uFileOffset);
                 pExtent->uSectorRGD = VMDK_BYTE2SECTOR(uFileOffset);
@@ -4320,20 +4817,26 @@ static int vmdkFreeImage(PVMDKIMAGE pImage, bool fDelete)
                 memset(pMarker, '\0', sizeof(aMarker));
                 pMarker->uSector = VMDK_BYTE2SECTOR(512);
                 pMarker->uType = RT_H2LE_U32(VMDK_MARKER_FOOTER);
-                rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
-                                            uFileOffset, aMarker, sizeof(aMarker));
-                AssertRC(rc);
+                rc2 = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                             uFileOffset, aMarker, sizeof(aMarker));
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
 
                 uFileOffset += 512;
-                rc = vmdkWriteMetaSparseExtent(pImage, pExtent, uFileOffset, NULL);
-                AssertRC(rc);
+                rc2 = vmdkWriteMetaSparseExtent(pImage, pExtent, uFileOffset, NULL);
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
 
                 uFileOffset += 512;
                 /* End-of-stream marker. */
                 memset(pMarker, '\0', sizeof(aMarker));
-                rc = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
-                                            uFileOffset, aMarker, sizeof(aMarker));
-                AssertRC(rc);
+                rc2 = vdIfIoIntFileWriteSync(pImage->pIfIo, pExtent->pFile->pStorage,
+                                             uFileOffset, aMarker, sizeof(aMarker));
+                AssertRC(rc2);
+                if (RT_SUCCESS(rc))
+                    rc = rc2;
             }
         }
         else
@@ -4409,6 +4912,11 @@ static int vmdkFlushImage(PVMDKIMAGE pImage, PVDIOCTX pIoCtx)
                     }
                     else
                     {
+                        /* Write out queued grains first, reports deferred errors. */
+                        rc = vmdkStreamDeflatePipeDrain(pImage, pExtent);
+                        if (RT_FAILURE(rc))
+                            goto out;
+
                         uint64_t uFileOffset = pExtent->uAppendPosition;
                         /* Simply skip writing anything if the streamOptimized
                          * image hasn't been just created. */
@@ -4519,6 +5027,21 @@ static int vmdkGetSector(PVMDKIMAGE pImage, PVDIOCTX pIoCtx,
     uint32_t aGTDataTmp[VMDK_GT_CACHELINE_SIZE];
     int rc;
 
+    /* Readonly streamOptimized extents without grain directory use the
+     * grain index built on open. */
+    if (pExtent->pauGrainIndex)
+    {
+        uint64_t uGrain = uSector / pExtent->cSectorsPerGrain;
+        if (uGrain >= pExtent->cGrainIndex)
+            return VERR_OUT_OF_RANGE;
+        uint32_t uGrainSector = pExtent->pauGrainIndex[uGrain];
+        if (uGrainSector)
+            *puExtentSector = uGrainSector + uSector % pExtent->cSectorsPerGrain;
+        else
+            *puExtentSector = 0;
+        return VINF_SUCCESS;
+    }
+
     /* For newly created and readonly/sequentially opened streamOptimized
      * images this must be a no-op, as the grain directory is not there. */
     if (   (   pImage->uImageFlags & VD_VMDK_IMAGE_FLAGS_STREAM_OPTIMIZED
@@ -4620,6 +5143,10 @@ static int vmdkStreamAllocGrain(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
 
     if (uGDEntry != uLastGDEntry)
     {
+        /* The grain table must be complete before it is written. */
+        rc = vmdkStreamDeflatePipeDrain(pImage, pExtent);
+        if (RT_FAILURE(rc))
+            return rc;
         rc = vmdkStreamFlushGT(pImage, pExtent, uLastGDEntry);
         if (RT_FAILURE(rc))
             return rc;
@@ -4647,6 +5174,29 @@ static int vmdkStreamAllocGrain(PVMDKIMAGE pImage, PVMDKEXTENT pExtent,
         || pImage->pGTCache->aGTCache[uCacheLine].aGTData[uCacheEntry])
         return VERR_INTERNAL_ERROR;
 
+    /* The grain table entry of a queued grain is only set once it was
+     * written, reject a second write to it like for any allocated grain. */
+    if (vmdkStreamDeflatePipeIsQueued(pExtent, uGrain))
+        return VERR_VD_VMDK_INVALID_STATE;
+
+    /* Hand the grain to the deflate workers, it is written and entered into
+     * the grain table once it was deflated. Any error is returned by one of
+     * the following writes or when the image is closed. */
+    if (   !pExtent->pDeflatePipe
+        && !pExtent->fDeflateInline)
+    {
+        rc = vmdkStreamDeflatePipeCreate(pExtent);
+        if (RT_FAILURE(rc) || !pExtent->pDeflatePipe)
+            pExtent->fDeflateInline = true;
+    }
+    if (pExtent->pDeflatePipe)
+    {
+        rc = vmdkStreamDeflatePipeQueue(pImage, pExtent, uGrain, uSector, pIoCtx, cbWrite);
+        if (RT_SUCCESS(rc))
+            pExtent->uLastGrainAccess = uGrain;
+        return rc;
+    }
+
     /* Update grain table entry. */
     pImage->pGTCache->aGTCache[uCacheLine].aGTData[uCacheEntry] = VMDK_BYTE2SECTOR(uFileOffset);
 
@@ -126,6 +126,19 @@ typedef struct VDPATTERN
     void          *pvPattern;
 } VDPATTERN, *PVDPATTERN;
 
+/**
+ * Configuration key/value pair handed to the backends.
+ */
+typedef struct VDCFGKEY
+{
+    /** List node. */
+    RTLISTNODE     ListNode;
+    /** Name of the key. */
+    char          *pszKey;
+    /** The value. */
+    char          *pszValue;
+} VDCFGKEY, *PVDCFGKEY;
+
 /**
  * Global VD test state.
  */
@@ -147,6 +160,10 @@ typedef struct VDTESTGLOB
     VDINTERFACEIO    VDIfIo;
     /** Pointer to the per image interface list. */
     PVDINTERFACE     pInterfacesImages;
+    /** Config interface. */
+    VDINTERFACECONFIG VDIfConfig;
+    /** Head of the configuration key list. */
+    RTLISTNODE       ListCfgKeys;
     /** I/O RNG handle. */
     PVDIORND         pIoRnd;
     /** Current storage backend to use. */
@@ -256,6 +273,7 @@ static DECLCALLBACK(int) vdScriptHandlerShowStatistics(PVDSCRIPTARG paScriptArgs
 static DECLCALLBACK(int) vdScriptHandlerResetStatistics(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerResize(PVDSCRIPTARG paScriptArgs, void *pvUser);
 static DECLCALLBACK(int) vdScriptHandlerSetFileBackend(PVDSCRIPTARG paScriptArgs, void *pvUser);
+static DECLCALLBACK(int) vdScriptHandlerSetConfig(PVDSCRIPTARG paScriptArgs, void *pvUser);
 
 #ifdef VBOX_TSTVDIO_WITH_LOG_REPLAY
 static DECLCALLBACK(int) vdScriptHandlerIoLogReplay(PVDSCRIPTARG paScriptArgs, void *pvUser);
@@ -470,6 +488,13 @@ const VDSCRIPTTYPE g_aArgSetFileBackend[] =
     VDSCRIPTTYPE_STRING /* new file backend */
 };
 
+/* Set configuration key. */
+const VDSCRIPTTYPE g_aArgSetConfig[] =
+{
+    VDSCRIPTTYPE_STRING, /* key */
+    VDSCRIPTTYPE_STRING  /* value, empty to remove the key */
+};
+
 const VDSCRIPTCALLBACK g_aScriptActions[] =
 {
     /* pcszFnName                  enmTypeReturn      paArgDesc                          cArgDescs                                      pfnHandler */
@@ -502,6 +527,7 @@ const VDSCRIPTCALLBACK g_aScriptActions[] =
     {"resetstatistics",            VDSCRIPTTYPE_VOID, g_aArgResetStatistics,             RT_ELEMENTS(g_aArgResetStatistics),            vdScriptHandlerResetStatistics},
     {"resize",                     VDSCRIPTTYPE_VOID, g_aArgResize,                      RT_ELEMENTS(g_aArgResize),                     vdScriptHandlerResize},
     {"setfilebackend",             VDSCRIPTTYPE_VOID, g_aArgSetFileBackend,              RT_ELEMENTS(g_aArgSetFileBackend),             vdScriptHandlerSetFileBackend},
+    {"setconfig",                  VDSCRIPTTYPE_VOID, g_aArgSetConfig,                   RT_ELEMENTS(g_aArgSetConfig),                  vdScriptHandlerSetConfig},
 };
 
 const unsigned g_cScriptActions = RT_ELEMENTS(g_aScriptActions);
@@ -527,6 +553,48 @@ static int tstVDMessage(void *pvUser, const char *pszFormat, va_list va)
     return VINF_SUCCESS;
 }
 
+static PVDCFGKEY tstVDIoCfgKeyGetByName(PVDTESTGLOB pGlob, const char *pszName)
+{
+    PVDCFGKEY pIt = NULL;
+
+    RTListForEach(&pGlob->ListCfgKeys, pIt, VDCFGKEY, ListNode)
+    {
+        if (!RTStrCmp(pIt->pszKey, pszName))
+            return pIt;
+    }
+
+    return NULL;
+}
+
+static DECLCALLBACK(bool) tstVDCfgAreKeysValid(void *pvUser, const char *pszzValid)
+{
+    NOREF(pvUser); NOREF(pszzValid);
+    /* Backends get whatever the script configured, no validation here. */
+    return true;
+}
+
+static DECLCALLBACK(int) tstVDCfgQuerySize(void *pvUser, const char *pszName, size_t *pcbValue)
+{
+    PVDCFGKEY pCfgKey = tstVDIoCfgKeyGetByName((PVDTESTGLOB)pvUser, pszName);
+    if (!pCfgKey)
+        return VERR_CFGM_VALUE_NOT_FOUND;
+
+    *pcbValue = strlen(pCfgKey->pszValue) + 1;
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) tstVDCfgQuery(void *pvUser, const char *pszName, char *pszValue, size_t cchValue)
+{
+    PVDCFGKEY pCfgKey = tstVDIoCfgKeyGetByName((PVDTESTGLOB)pvUser, pszName);
+    if (!pCfgKey)
+        return VERR_CFGM_VALUE_NOT_FOUND;
+
+    int rc = RTStrCopy(pszValue, cchValue, pCfgKey->pszValue);
+    if (rc == VERR_BUFFER_OVERFLOW)
+        rc = VERR_CFGM_NOT_ENOUGH_SPACE;
+    return rc;
+}
+
 static int tstVDIoTestInit(PVDIOTEST pIoTest, PVDTESTGLOB pGlob, bool fRandomAcc, uint64_t cbIo,
                            size_t cbBlkSize, uint64_t offStart, uint64_t offEnd,
                            unsigned uWriteChance, PVDPATTERN pPattern);
@@ -955,7 +1023,9 @@ static DECLCALLBACK(int) vdScriptHandlerIo(PVDSCRIPTARG paScriptArgs, void *pvUs
 
                 NanoTS = RTTimeNanoTS() - NanoTS;
                 uint64_t SpeedKBs = (uint64_t)(cbIo / (NanoTS / 1000000000.0) / 1024);
+                uint64_t Iops     = (uint64_t)((cbIo / cbBlkSize) / (NanoTS / 1000000000.0));
                 RTTestValue(pGlob->hTest, "Throughput", SpeedKBs, RTTESTUNIT_KILOBYTES_PER_SEC);
+                RTTestValue(pGlob->hTest, "IOPS", Iops, RTTESTUNIT_OCCURRENCES_PER_SEC);
 
                 for (unsigned i = 0; i < cMaxTasksOutstanding; i++)
                 {
@@ -2061,6 +2131,46 @@ static DECLCALLBACK(int) vdScriptHandlerSetFileBackend(PVDSCRIPTARG paScriptArgs
     return rc;
 }
 
+static DECLCALLBACK(int) vdScriptHandlerSetConfig(PVDSCRIPTARG paScriptArgs, void *pvUser)
+{
+    int rc = VINF_SUCCESS;
+    PVDTESTGLOB pGlob = (PVDTESTGLOB)pvUser;
+    const char *pcszKey = paScriptArgs[0].psz;
+    const char *pcszValue = paScriptArgs[1].psz;
+
+    PVDCFGKEY pCfgKey = tstVDIoCfgKeyGetByName(pGlob, pcszKey);
+    if (pCfgKey)
+    {
+        RTListNodeRemove(&pCfgKey->ListNode);
+        RTStrFree(pCfgKey->pszKey);
+        RTStrFree(pCfgKey->pszValue);
+        RTMemFree(pCfgKey);
+    }
+
+    if (*pcszValue)
+    {
+        pCfgKey = (PVDCFGKEY)RTMemAllocZ(sizeof(VDCFGKEY));
+        if (pCfgKey)
+        {
+            pCfgKey->pszKey   = RTStrDup(pcszKey);
+            pCfgKey->pszValue = RTStrDup(pcszValue);
+            if (pCfgKey->pszKey && pCfgKey->pszValue)
+                RTListAppend(&pGlob->ListCfgKeys, &pCfgKey->ListNode);
+            else
+            {
+                RTStrFree(pCfgKey->pszKey);
+                RTStrFree(pCfgKey->pszValue);
+                RTMemFree(pCfgKey);
+                rc = VERR_NO_MEMORY;
+            }
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+
+    return rc;
+}
+
 static DECLCALLBACK(int) tstVDIoFileOpen(void *pvUser, const char *pszLocation,
                                          uint32_t fOpen,
                                          PFNVDCOMPLETED pfnCompleted,
@@ -2704,6 +2814,7 @@ static void tstVDIoScriptExec(const char *pszScript)
     RTListInit(&GlobTest.ListFiles);
     RTListInit(&GlobTest.ListDisks);
     RTListInit(&GlobTest.ListPatterns);
+    RTListInit(&GlobTest.ListCfgKeys);
     GlobTest.pszIoBackend = RTStrDup("memory");
     if (!GlobTest.pszIoBackend)
     {
@@ -2738,6 +2849,15 @@ static void tstVDIoScriptExec(const char *pszScript)
                         &GlobTest, sizeof(VDINTERFACEIO), &GlobTest.pInterfacesImages);
     AssertRC(rc);
 
+    GlobTest.VDIfConfig.pfnAreKeysValid = tstVDCfgAreKeysValid;
+    GlobTest.VDIfConfig.pfnQuerySize    = tstVDCfgQuerySize;
+    GlobTest.VDIfConfig.pfnQuery        = tstVDCfgQuery;
+    GlobTest.VDIfConfig.pfnQueryBytes   = NULL;
+
+    rc = VDInterfaceAdd(&GlobTest.VDIfConfig.Core, "tstVDIo_VDIConfig", VDINTERFACETYPE_CONFIG,
+                        &GlobTest, sizeof(VDINTERFACECONFIG), &GlobTest.pInterfacesImages);
+    AssertRC(rc);
+
     rc = RTTestCreate("tstVDIo", &GlobTest.hTest);
     if (RT_SUCCESS(rc))
     {
@@ -2772,6 +2892,14 @@ static void tstVDIoScriptExec(const char *pszScript)
     else
         RTStrmPrintf(g_pStdErr, "tstVDIo: fatal error: RTTestCreate failed with rc=%Rrc\n", rc);
 
+    PVDCFGKEY pCfgKey, pCfgKeyNext;
+    RTListForEachSafe(&GlobTest.ListCfgKeys, pCfgKey, pCfgKeyNext, VDCFGKEY, ListNode)
+    {
+        RTListNodeRemove(&pCfgKey->ListNode);
+        RTStrFree(pCfgKey->pszKey);
+        RTStrFree(pCfgKey->pszValue);
+        RTMemFree(pCfgKey);
+    }
     RTStrFree(GlobTest.pszIoBackend);
 }
 
@@ -58,6 +58,7 @@ static void printUsage(PRTSTREAM pStrm)
                  "                [--srcformat VDI|VMDK|VHD|RAW|..]\n"
                  "                [--dstformat VDI|VMDK|VHD|RAW|..]\n"
                  "                [--variant Standard,Fixed,Split2G,Stream,ESX]\n"
+                 "                [--threads <number>]\n"
                  "\n"
                  "   info         --filename <filename>\n"
                  "\n"
@@ -846,6 +847,7 @@ static int handleConvert(HandlerArg *a)
     PVDINTERFACE pIfsImageOutput = NULL;
     VDINTERFACEIO IfsInputIO;
     VDINTERFACEIO IfsOutputIO;
+    unsigned cThreads = 0;
     int rc = VINF_SUCCESS;
 
     /* Parse the command line. */
@@ -857,7 +859,8 @@ static int handleConvert(HandlerArg *a)
         { "--stdout", 'P', RTGETOPT_REQ_NOTHING },
         { "--srcformat", 's', RTGETOPT_REQ_STRING },
         { "--dstformat", 'd', RTGETOPT_REQ_STRING },
-        { "--variant", 'v', RTGETOPT_REQ_STRING }
+        { "--variant", 'v', RTGETOPT_REQ_STRING },
+        { "--threads", 't', RTGETOPT_REQ_UINT32 }
     };
     int ch;
     RTGETOPTUNION ValueUnion;
@@ -888,6 +891,9 @@ static int handleConvert(HandlerArg *a)
             case 'v':   // --variant
                 pszVariant = ValueUnion.psz;
                 break;
+            case 't':   // --threads
+                cThreads = ValueUnion.u32;
+                break;
 
             default:
                 ch = RTGetOptPrintError(ch, &ValueUnion);
@@ -1029,6 +1035,13 @@ static int handleConvert(HandlerArg *a)
             break;
         }
 
+        rc = VDSetCopyThreads(pSrcDisk, cThreads);
+        if (RT_FAILURE(rc))
+        {
+            errorRuntime("Error while setting the number of copy threads to %u: %Rrc\n", cThreads, rc);
+            break;
+        }
+
         uint64_t cbSize = VDGetSize(pSrcDisk, VD_LAST_IMAGE);
         RTStrmPrintf(g_pStdErr, "Converting image \"%s\" with size %RU64 bytes (%RU64MB)...\n", pszSrcFilename, cbSize, (cbSize + _1M - 1) / _1M);
 
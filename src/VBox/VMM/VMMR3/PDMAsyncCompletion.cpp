@@ -1053,166 +1053,228 @@ static int pdmR3AsyncCompletionStatisticsRegister(PPDMASYNCCOMPLETIONENDPOINT pE
                              STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                              "Nanosecond resolution runtime statistics",
                              "/PDM/AsyncCompletion/File/%s/TaskRun1Ns-%u-%u",
-                             RTPathFilename(pEndpoint->pszUri), i*100, i*100+100-1);
+                             pEndpoint->pszStatId, i*100, i*100+100-1);
 
     for (unsigned i = 0; i < RT_ELEMENTS(pEndpoint->StatTaskRunTimesUs) && RT_SUCCESS(rc); i++)
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatTaskRunTimesUs[i], STAMTYPE_COUNTER,
                              STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                              "Microsecond resolution runtime statistics",
                              "/PDM/AsyncCompletion/File/%s/TaskRun2MicroSec-%u-%u",
-                             RTPathFilename(pEndpoint->pszUri), i*100, i*100+100-1);
+                             pEndpoint->pszStatId, i*100, i*100+100-1);
 
     for (unsigned i = 0; i < RT_ELEMENTS(pEndpoint->StatTaskRunTimesMs) && RT_SUCCESS(rc); i++)
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatTaskRunTimesMs[i], STAMTYPE_COUNTER,
                              STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                              "Milliseconds resolution runtime statistics",
                              "/PDM/AsyncCompletion/File/%s/TaskRun3Ms-%u-%u",
-                             RTPathFilename(pEndpoint->pszUri), i*100, i*100+100-1);
+                             pEndpoint->pszStatId, i*100, i*100+100-1);
 
     for (unsigned i = 0; i < RT_ELEMENTS(pEndpoint->StatTaskRunTimesMs) && RT_SUCCESS(rc); i++)
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatTaskRunTimesSec[i], STAMTYPE_COUNTER,
                              STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                              "Second resolution runtime statistics",
                              "/PDM/AsyncCompletion/File/%s/TaskRun4Sec-%u-%u",
-                             RTPathFilename(pEndpoint->pszUri), i*10, i*10+10-1);
+                             pEndpoint->pszStatId, i*10, i*10+10-1);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatTaskRunOver100Sec, STAMTYPE_COUNTER,
                              STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
                              "Tasks which ran more than 100sec",
                              "/PDM/AsyncCompletion/File/%s/TaskRunSecGreater100Sec",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatIoOpsPerSec, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Processed I/O operations per second",
                              "/PDM/AsyncCompletion/File/%s/IoOpsPerSec",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatIoOpsStarted, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Started I/O operations for this endpoint",
                              "/PDM/AsyncCompletion/File/%s/IoOpsStarted",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatIoOpsCompleted, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Completed I/O operations for this endpoint",
                              "/PDM/AsyncCompletion/File/%s/IoOpsCompleted",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSizeSmaller512, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size smaller than 512 bytes",
                              "/PDM/AsyncCompletion/File/%s/ReqSizeSmaller512",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize512To1K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 512 bytes and 1KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize512To1K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize1KTo2K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 1KB and 2KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize1KTo2K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize2KTo4K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 2KB and 4KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize2KTo4K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize4KTo8K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 4KB and 8KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize4KTo8K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize8KTo16K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 8KB and 16KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize8KTo16K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize16KTo32K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 16KB and 32KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize16KTo32K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize32KTo64K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 32KB and 64KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize32KTo64K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize64KTo128K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 64KB and 128KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize64KTo128K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize128KTo256K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 128KB and 256KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize128KTo256K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSize256KTo512K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size between 256KB and 512KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSize256KTo512K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqSizeOver512K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests with a size over 512KB",
                              "/PDM/AsyncCompletion/File/%s/ReqSizeOver512K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqsUnaligned512, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests which size is not aligned to 512 bytes",
                              "/PDM/AsyncCompletion/File/%s/ReqsUnaligned512",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqsUnaligned4K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests which size is not aligned to 4KB",
                              "/PDM/AsyncCompletion/File/%s/ReqsUnaligned4K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     if (RT_SUCCESS(rc))
         rc = STAMR3RegisterF(pVM, &pEndpoint->StatReqsUnaligned8K, STAMTYPE_COUNTER,
                              STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
                              "Number of requests which size is not aligned to 8KB",
                              "/PDM/AsyncCompletion/File/%s/ReqsUnaligned8K",
-                             RTPathFilename(pEndpoint->pszUri));
+                             pEndpoint->pszStatId);
 
     return rc;
 }
 
 
+/**
+ * Creates the name the statistics of an endpoint are registered under.
+ *
+ * Images in different directories can share a file name, so when another open
+ * endpoint already uses the plain file name the instance number of the new
+ * endpoint is appended to it.
+ *
+ * @returns VBox status code.
+ * @param   pEndpointClass  The endpoint class.
+ * @param   pEndpoint       The endpoint being created, not linked into the
+ *                          class list yet.
+ */
+static int pdmR3AsyncCompletionStatIdCreate(PPDMASYNCCOMPLETIONEPCLASS pEndpointClass,
+                                            PPDMASYNCCOMPLETIONENDPOINT pEndpoint)
+{
+    const char *pszName = RTPathFilename(pEndpoint->pszUri);
+    if (!pszName)
+        pszName = pEndpoint->pszUri;
+
+    int rc = RTCritSectEnter(&pEndpointClass->CritSect);
+    AssertRCReturn(rc, rc);
+
+    uint32_t const iInstance = ++pEndpointClass->cEndpointsCreated;
+    bool           fInUse    = false;
+    for (PPDMASYNCCOMPLETIONENDPOINT pEpIt = pEndpointClass->pEndpointsHead; pEpIt; pEpIt = pEpIt->pNext)
+        if (!RTStrCmp(pEpIt->pszStatId, pszName))
+        {
+            fInUse = true;
+            break;
+        }
+
+    RTCritSectLeave(&pEndpointClass->CritSect);
+
+    if (!fInUse)
+        pEndpoint->pszStatId = RTStrDup(pszName);
+    else
+        RTStrAPrintf(&pEndpoint->pszStatId, "%s-%u", pszName, iInstance);
+    return pEndpoint->pszStatId ? VINF_SUCCESS : VERR_NO_STR_MEMORY;
+}
+
+
+/**
+ * Registers the task latency histogram of an endpoint.
+ *
+ * The histogram is purely informational, failing to register it only gets
+ * logged.
+ *
+ * @returns nothing.
+ * @param   pEndpoint    The endpoint.
+ */
+static void pdmR3AsyncCompletionLatencyRegister(PPDMASYNCCOMPLETIONENDPOINT pEndpoint)
+{
+    int rc = STAMR3RegisterF(pEndpoint->pEpClass->pVM, &pEndpoint->StatTaskLatency, STAMTYPE_HISTOGRAM,
+                             STAMVISIBILITY_USED, STAMUNIT_NS,
+                             "Task completion latency",
+                             "/PDM/AsyncCompletion/File/%s/TaskLatency", pEndpoint->pszStatId);
+    if (RT_FAILURE(rc))
+        LogRel(("AsyncCompletion: Failed to register the task latency statistics for '%s': %Rrc\n",
+                pEndpoint->pszUri, rc));
+}
+
+
 /**
  * Deregisters advanced statistics for one endpoint.
  *
@@ -1222,7 +1284,7 @@ static int pdmR3AsyncCompletionStatisticsRegister(PPDMASYNCCOMPLETIONENDPOINT pE
 static void pdmR3AsyncCompletionStatisticsDeregister(PPDMASYNCCOMPLETIONENDPOINT pEndpoint)
 {
     /* I hope this doesn't remove too much... */
-    STAMR3DeregisterF(pEndpoint->pEpClass->pVM->pUVM, "/PDM/AsyncCompletion/File/%s/*", RTPathFilename(pEndpoint->pszUri));
+    STAMR3DeregisterF(pEndpoint->pEpClass->pVM->pUVM, "/PDM/AsyncCompletion/File/%s/*", pEndpoint->pszStatId);
 }
 
 
@@ -1368,6 +1430,7 @@ static void pdmR3AsyncCompletionPutTask(PPDMASYNCCOMPLETIONENDPOINT pEndpoint, P
     if (RT_UNLIKELY(cNsRun >= RT_NS_10SEC))
         LogRel(("AsyncCompletion: Task %#p completed after %llu seconds\n", pTask, cNsRun / RT_NS_1SEC));
 
+    STAM_REL_HISTOGRAM_ADD(&pEndpoint->StatTaskLatency, cNsRun);
     if (pEndpointClass->fGatherAdvancedStatistics)
         pdmR3AsyncCompletionStatisticsRecordCompletionTime(pEndpoint, cNsRun);
 
@@ -1450,14 +1513,19 @@ VMMR3DECL(int) PDMR3AsyncCompletionEpCreateForFile(PPPDMASYNCCOMPLETIONENDPOINT
         pEndpoint->pszUri            = RTStrDup(pszFilename);
         pEndpoint->cUsers            = 1;
         pEndpoint->pBwMgr            = NULL;
+        pEndpoint->pszStatId         = NULL;
 
-        if (   pEndpoint->pszUri
-            && RT_SUCCESS(rc))
+        if (pEndpoint->pszUri)
+            rc = pdmR3AsyncCompletionStatIdCreate(pEndpointClass, pEndpoint);
+        else
+            rc = VERR_NO_STR_MEMORY;
+        if (RT_SUCCESS(rc))
         {
             /* Call the initializer for the endpoint. */
             rc = pEndpointClass->pEndpointOps->pfnEpInitialize(pEndpoint, pszFilename, fFlags);
             if (RT_SUCCESS(rc))
             {
+                pdmR3AsyncCompletionLatencyRegister(pEndpoint);
                 if (pEndpointClass->fGatherAdvancedStatistics)
                     rc = pdmR3AsyncCompletionStatisticsRegister(pEndpoint);
 
@@ -1487,9 +1555,11 @@ VMMR3DECL(int) PDMR3AsyncCompletionEpCreateForFile(PPPDMASYNCCOMPLETIONENDPOINT
 
                 if (pEndpointClass->fGatherAdvancedStatistics)
                     pdmR3AsyncCompletionStatisticsDeregister(pEndpoint);
+                STAMR3DeregisterByAddr(pUVM, &pEndpoint->StatTaskLatency);
             }
-            RTStrFree(pEndpoint->pszUri);
         }
+        RTStrFree(pEndpoint->pszStatId);
+        RTStrFree(pEndpoint->pszUri);
         MMR3HeapFree(pEndpoint);
     }
 
@@ -1545,7 +1615,9 @@ VMMR3DECL(void) PDMR3AsyncCompletionEpClose(PPDMASYNCCOMPLETIONENDPOINT pEndpoin
 
         if (pEndpointClass->fGatherAdvancedStatistics)
             pdmR3AsyncCompletionStatisticsDeregister(pEndpoint);
+        STAMR3DeregisterByAddr(pVM->pUVM, &pEndpoint->StatTaskLatency);
 
+        RTStrFree(pEndpoint->pszStatId);
         RTStrFree(pEndpoint->pszUri);
         MMR3HeapFree(pEndpoint);
     }
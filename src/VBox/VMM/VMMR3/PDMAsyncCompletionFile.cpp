@@ -852,6 +852,15 @@ static int pdmacFileInitialize(PPDMASYNCCOMPLETIONEPCLASS pClassGlobals, PCFGMNO
 
             LogRel(("AIOMgr: Default file backend is \"%s\"\n", pdmacFileBackendTypeToName(pEpClassFile->enmEpBackendDefault)));
 
+            /* Query the request scheduling parameters. */
+            rc = CFGMR3QueryU32Def(pCfgNode, "MergeMax", &pEpClassFile->cbMergeMax, PDMACEPFILE_MERGE_MAX_DEFAULT);
+            AssertLogRelRCReturn(rc, rc);
+            rc = CFGMR3QueryU32Def(pCfgNode, "SchedWindow", &pEpClassFile->cSchedWindow, PDMACEPFILE_SCHED_WINDOW_DEFAULT);
+            AssertLogRelRCReturn(rc, rc);
+
+            LogRel(("AIOMgr: Merging requests up to %u bytes, scheduling window is %u tasks\n",
+                    pEpClassFile->cbMergeMax, pEpClassFile->cSchedWindow));
+
 #ifdef RT_OS_LINUX
             if (   pEpClassFile->enmMgrTypeOverride == PDMACEPFILEMGRTYPE_ASYNC
                 && pEpClassFile->enmEpBackendDefault == PDMACFILEEPBACKEND_BUFFERED)
@@ -866,6 +875,8 @@ static int pdmacFileInitialize(PPDMASYNCCOMPLETIONEPCLASS pClassGlobals, PCFGMNO
             /* No configuration supplied, set defaults */
             pEpClassFile->enmEpBackendDefault = PDMACFILEEPBACKEND_NON_BUFFERED;
             pEpClassFile->enmMgrTypeOverride  = PDMACEPFILEMGRTYPE_ASYNC;
+            pEpClassFile->cbMergeMax          = PDMACEPFILE_MERGE_MAX_DEFAULT;
+            pEpClassFile->cSchedWindow        = PDMACEPFILE_SCHED_WINDOW_DEFAULT;
         }
     }
 
@@ -1099,15 +1110,33 @@ static int pdmacFileEpInitialize(PPDMASYNCCOMPLETIONENDPOINT pEndpoint,
         STAMR3RegisterF(pEpClassFile->Core.pVM, &pEpFile->StatRead,
                        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS,
                        STAMUNIT_TICKS_PER_CALL, "Time taken to read from the endpoint",
-                       "/PDM/AsyncCompletion/File/%s/Read", RTPathFilename(pEpFile->Core.pszUri));
+                       "/PDM/AsyncCompletion/File/%s/Read", pEpFile->Core.pszStatId);
 
         STAMR3RegisterF(pEpClassFile->Core.pVM, &pEpFile->StatWrite,
                        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS,
                        STAMUNIT_TICKS_PER_CALL, "Time taken to write to the endpoint",
-                       "/PDM/AsyncCompletion/File/%s/Write", RTPathFilename(pEpFile->Core.pszUri));
+                       "/PDM/AsyncCompletion/File/%s/Write", pEpFile->Core.pszStatId);
     }
 #endif
 
+    if (RT_SUCCESS(rc))
+    {
+        STAMR3RegisterF(pEpClassFile->Core.pVM, &pEpFile->StatTasksRw,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       STAMUNIT_OCCURENCES, "Number of read and write tasks submitted to the host",
+                       "/PDM/AsyncCompletion/File/%s/TasksRw", pEpFile->Core.pszStatId);
+
+        STAMR3RegisterF(pEpClassFile->Core.pVM, &pEpFile->StatHostReqsRw,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       STAMUNIT_OCCURENCES, "Number of host read and write requests the tasks were combined into",
+                       "/PDM/AsyncCompletion/File/%s/HostReqsRw", pEpFile->Core.pszStatId);
+
+        STAMR3RegisterF(pEpClassFile->Core.pVM, &pEpFile->StatTasksMerged,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       STAMUNIT_OCCURENCES, "Number of tasks merged into the request of an adjacent task",
+                       "/PDM/AsyncCompletion/File/%s/TasksMerged", pEpFile->Core.pszStatId);
+    }
+
     if (RT_SUCCESS(rc))
         LogRel(("AIOMgr: Endpoint for file '%s' (flags %08x) created successfully\n", pszUri, pEpFile->fFlags));
 
@@ -1152,9 +1181,13 @@ static int pdmacFileEpClose(PPDMASYNCCOMPLETIONENDPOINT pEndpoint)
 
     RTFileClose(pEpFile->hFile);
 
+    STAMR3DeregisterByAddr(pEpClassFile->Core.pVM->pUVM, &pEpFile->StatTasksRw);
+    STAMR3DeregisterByAddr(pEpClassFile->Core.pVM->pUVM, &pEpFile->StatHostReqsRw);
+    STAMR3DeregisterByAddr(pEpClassFile->Core.pVM->pUVM, &pEpFile->StatTasksMerged);
+
 #ifdef VBOX_WITH_STATISTICS
     /* Not sure if this might be unnecessary because of similar statement in pdmR3AsyncCompletionStatisticsDeregister? */
-    STAMR3DeregisterF(pEpClassFile->Core.pVM->pUVM, "/PDM/AsyncCompletion/File/%s/*", RTPathFilename(pEpFile->Core.pszUri));
+    STAMR3DeregisterF(pEpClassFile->Core.pVM->pUVM, "/PDM/AsyncCompletion/File/%s/*", pEpFile->Core.pszStatId);
 #endif
 
     return VINF_SUCCESS;
@@ -757,6 +757,231 @@ static PPDMACTASKFILE pdmacFileAioMgrNormalRangeLockFree(PPDMACEPFILEMGR pAioMgr
     return pTasksWaitingHead;
 }
 
+/**
+ * Orders new tasks by their file offset to turn them into an ascending sweep
+ * over the file (elevator).
+ *
+ * Tasks are only reordered within runs of at most PDMASYNCCOMPLETIONEPCLASSFILE::cSchedWindow
+ * read and write tasks, which bounds how far a task can be overtaken. Flush requests
+ * are never moved and no task is moved across a flush. The sort is stable.
+ *
+ * @returns Head of the reordered task list.
+ * @param   pEndpoint  The endpoint the tasks belong to.
+ * @param   pTaskHead  The list of new tasks in arrival order.
+ */
+static PPDMACTASKFILE pdmacFileAioMgrNormalSchedule(PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint,
+                                                    PPDMACTASKFILE pTaskHead)
+{
+    PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pEndpoint->Core.pEpClass;
+    PPDMACTASKFILE                 pHead        = NULL;
+    PPDMACTASKFILE                 pTail        = NULL;
+
+    if (pEpClassFile->cSchedWindow <= 1)
+        return pTaskHead;
+
+    while (pTaskHead)
+    {
+        PPDMACTASKFILE pRunHead = NULL;
+        PPDMACTASKFILE pRunTail = NULL;
+        uint32_t       cRun     = 0;
+
+        /* Insertion sort of the next run, appending is O(1) for the common sequential case. */
+        while (   pTaskHead
+               && pTaskHead->enmTransferType != PDMACTASKFILETRANSFER_FLUSH
+               && cRun < pEpClassFile->cSchedWindow)
+        {
+            PPDMACTASKFILE pCurr = pTaskHead;
+
+            pTaskHead    = pTaskHead->pNext;
+            pCurr->pNext = NULL;
+            cRun++;
+
+            if (!pRunTail)
+                pRunHead = pRunTail = pCurr;
+            else if (pCurr->Off >= pRunTail->Off)
+            {
+                pRunTail->pNext = pCurr;
+                pRunTail        = pCurr;
+            }
+            else if (pCurr->Off < pRunHead->Off)
+            {
+                pCurr->pNext = pRunHead;
+                pRunHead     = pCurr;
+            }
+            else
+            {
+                PPDMACTASKFILE pPrev = pRunHead;
+
+                while (pPrev->pNext->Off <= pCurr->Off)
+                    pPrev = pPrev->pNext;
+                pCurr->pNext = pPrev->pNext;
+                pPrev->pNext = pCurr;
+            }
+        }
+
+        /* Take over the flush request terminating the run unchanged. */
+        if (   pTaskHead
+            && pTaskHead->enmTransferType == PDMACTASKFILETRANSFER_FLUSH)
+        {
+            PPDMACTASKFILE pFlush = pTaskHead;
+
+            pTaskHead     = pTaskHead->pNext;
+            pFlush->pNext = NULL;
+            if (pRunTail)
+                pRunTail->pNext = pFlush;
+            else
+                pRunHead = pFlush;
+            pRunTail = pFlush;
+        }
+
+        if (pTail)
+            pTail->pNext = pRunHead;
+        else
+            pHead = pRunHead;
+        pTail = pRunTail;
+    }
+
+    return pHead;
+}
+
+/**
+ * Tries to merge the given task with the directly following tasks of the list
+ * into a single host request using a bounce buffer.
+ *
+ * Only tasks of the same type which continue exactly where the previous one ended
+ * are merged and the combined range must be sector aligned, so the request never
+ * needs a read-modify-write cycle.
+ *
+ * @returns true if at least one task was merged, false otherwise.
+ * @param   pEndpoint   The endpoint the tasks belong to.
+ * @param   pTask       The task to merge the following tasks into.
+ * @param   ppTaskHead  Where to take the following tasks from, updated with
+ *                      the remaining ones on success.
+ */
+static bool pdmacFileAioMgrNormalTaskMerge(PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint,
+                                           PPDMACTASKFILE pTask, PPDMACTASKFILE *ppTaskHead)
+{
+    PPDMASYNCCOMPLETIONEPCLASSFILE pEpClassFile = (PPDMASYNCCOMPLETIONEPCLASSFILE)pEndpoint->Core.pEpClass;
+    PPDMACTASKFILE                 pTaskLast    = NULL;
+    PPDMACTASKFILE                 pTaskIt      = *ppTaskHead;
+    RTFOFF                         offEnd       = pTask->Off + pTask->DataSeg.cbSeg;
+    RTFOFF                         offEndLast   = offEnd;
+    RTMSINTERVAL                   msWhenNext;
+
+    if (   !pEpClassFile->cbMergeMax
+        || (pTask->Off & (512 - 1))
+        || pTask->pMergedNext)
+        return false;
+
+    while (   pTaskIt
+           && pTaskIt->enmTransferType == pTask->enmTransferType
+           && pTaskIt->hReq == NIL_RTFILEAIOREQ
+           && !pTaskIt->pMergedNext
+           && pTaskIt->Off == offEnd
+           && (uint64_t)(offEnd + pTaskIt->DataSeg.cbSeg - pTask->Off) <= pEpClassFile->cbMergeMax)
+    {
+        offEnd += pTaskIt->DataSeg.cbSeg;
+        if (!(offEnd & (512 - 1)))
+        {
+            pTaskLast  = pTaskIt;
+            offEndLast = offEnd;
+        }
+        pTaskIt = pTaskIt->pNext;
+    }
+
+    if (!pTaskLast)
+        return false;
+
+    /* The merged tasks must fit into the bandwidth limit as well. */
+    size_t cbTransfer = (size_t)(offEndLast - pTask->Off);
+    if (!pdmacEpIsTransferAllowed(&pEndpoint->Core, (uint32_t)(cbTransfer - pTask->DataSeg.cbSeg), &msWhenNext))
+        return false;
+
+    /** @todo: Same assumption about the maximum alignment as for the other bounce buffers. */
+    void *pvBuf = RTMemPageAlloc(cbTransfer);
+    if (!pvBuf)
+        return false;
+
+    pTask->pvBounceBuffer  = pvBuf;
+    pTask->cbBounceBuffer  = cbTransfer;
+    pTask->offBounceBuffer = 0;
+
+    /* Move the tasks over to the merged chain and gather the data for a write. */
+    pTaskIt     = *ppTaskHead;
+    *ppTaskHead = pTaskLast->pNext;
+    pTask->pMergedNext = pTaskIt;
+    for (PPDMACTASKFILE pTaskCur = pTask; pTaskCur; pTaskCur = pTaskCur->pMergedNext)
+    {
+        pTaskCur->offBounceBuffer = (uint32_t)(pTaskCur->Off - pTask->Off);
+        if (pTaskCur != pTask)
+        {
+            pTaskCur->pMergedNext = pTaskCur == pTaskLast ? NULL : pTaskCur->pNext;
+            pTaskCur->pNext       = NULL;
+            STAM_REL_COUNTER_INC(&pEndpoint->StatTasksMerged);
+        }
+
+        if (pTask->enmTransferType == PDMACTASKFILETRANSFER_WRITE)
+            memcpy((uint8_t *)pvBuf + pTaskCur->offBounceBuffer, pTaskCur->DataSeg.pvSeg, pTaskCur->DataSeg.cbSeg);
+    }
+
+    return true;
+}
+
+/**
+ * Splits a chain of merged tasks up again, linking them with the next pointer
+ * in offset order after the head. Frees the bounce buffer of the chain.
+ *
+ * @returns The last task of the chain.
+ * @param   pTask    The head of the merged chain.
+ */
+static PPDMACTASKFILE pdmacFileAioMgrNormalTaskUnmerge(PPDMACTASKFILE pTask)
+{
+    if (!pTask->pMergedNext)
+        return pTask;
+
+    if (pTask->cbBounceBuffer)
+    {
+        RTMemPageFree(pTask->pvBounceBuffer, pTask->cbBounceBuffer);
+        pTask->pvBounceBuffer = NULL;
+        pTask->cbBounceBuffer = 0;
+    }
+
+    PPDMACTASKFILE pTaskNextOld = pTask->pNext;
+    PPDMACTASKFILE pTaskCur     = pTask;
+    while (pTaskCur->pMergedNext)
+    {
+        pTaskCur->pNext       = pTaskCur->pMergedNext;
+        pTaskCur->pMergedNext = NULL;
+        pTaskCur = pTaskCur->pNext;
+    }
+    pTaskCur->pNext = pTaskNextOld;
+
+    return pTaskCur;
+}
+
+/**
+ * Calls the completion callbacks of the tasks which were merged into another
+ * one and frees them.
+ *
+ * @returns nothing.
+ * @param   pEndpoint  The endpoint the tasks belong to.
+ * @param   pTask      The first merged task, may be NULL.
+ * @param   rc         The status code to complete the tasks with.
+ */
+static void pdmacFileAioMgrNormalTasksMergedComplete(PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint,
+                                                     PPDMACTASKFILE pTask, int rc)
+{
+    while (pTask)
+    {
+        PPDMACTASKFILE pTaskNext = pTask->pMergedNext;
+
+        pTask->pMergedNext = NULL;
+        pTask->pfnCompleted(pTask, pTask->pvUser, rc);
+        pdmacFileTaskFree(pEndpoint, pTask);
+        pTask = pTaskNext;
+    }
+}
+
 static int pdmacFileAioMgrNormalTaskPrepareBuffered(PPDMACEPFILEMGR pAioMgr,
                                                     PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint,
                                                     PPDMACTASKFILE pTask, PRTFILEAIOREQ phReq)
@@ -967,6 +1192,68 @@ static int pdmacFileAioMgrNormalTaskPrepareNonBuffered(PPDMACEPFILEMGR pAioMgr,
     return rc;
 }
 
+/**
+ * Prepares the host request for a chain of merged tasks.
+ *
+ * The bounce buffer covering the whole chain was set up when merging, the range
+ * is sector aligned so this works for the buffered and non buffered backend.
+ */
+static int pdmacFileAioMgrNormalTaskPrepareMerged(PPDMACEPFILEMGR pAioMgr,
+                                                  PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint,
+                                                  PPDMACTASKFILE pTask, PRTFILEAIOREQ phReq)
+{
+    size_t cbTransfer = pTask->cbBounceBuffer;
+
+    AssertPtr(pTask->pMergedNext);
+    AssertMsg(   pTask->enmTransferType == PDMACTASKFILETRANSFER_WRITE
+              || (uint64_t)(pTask->Off + cbTransfer) <= pEndpoint->cbFile,
+              ("Read exceeds file size offStart=%RTfoff cbToTransfer=%zu cbFile=%llu\n",
+               pTask->Off, cbTransfer, pEndpoint->cbFile));
+
+    pTask->fPrefetch = false;
+
+    /* See pdmacFileAioMgrNormalTaskPrepareNonBuffered() for the reason of the range locks. */
+    int  rc = VINF_SUCCESS;
+    bool fLocked = pdmacFileAioMgrNormalIsRangeLocked(pEndpoint, pTask->Off, cbTransfer, pTask,
+                                                      true /* fAlignedReq */);
+    if (!fLocked)
+    {
+        RTFILEAIOREQ hReq = pdmacFileAioMgrNormalRequestAlloc(pAioMgr);
+        AssertMsg(hReq != NIL_RTFILEAIOREQ, ("Out of request handles\n"));
+
+        LogFlow(("Merged task %#p covers offStart=%RTfoff cbToTransfer=%zu\n", pTask, pTask->Off, cbTransfer));
+
+        if (pTask->enmTransferType == PDMACTASKFILETRANSFER_WRITE)
+        {
+            /* Grow the file if needed. */
+            if (RT_UNLIKELY((uint64_t)(pTask->Off + cbTransfer) > pEndpoint->cbFile))
+            {
+                ASMAtomicWriteU64(&pEndpoint->cbFile, pTask->Off + cbTransfer);
+                RTFileSetSize(pEndpoint->hFile, pTask->Off + cbTransfer);
+            }
+
+            rc = RTFileAioReqPrepareWrite(hReq, pEndpoint->hFile,
+                                          pTask->Off, pTask->pvBounceBuffer, cbTransfer, pTask);
+        }
+        else
+            rc = RTFileAioReqPrepareRead(hReq, pEndpoint->hFile,
+                                         pTask->Off, pTask->pvBounceBuffer, cbTransfer, pTask);
+        AssertRC(rc);
+
+        rc = pdmacFileAioMgrNormalRangeLock(pAioMgr, pEndpoint, pTask->Off, cbTransfer,
+                                            pTask, true /* fAlignedReq */);
+        if (RT_SUCCESS(rc))
+        {
+            pTask->hReq = hReq;
+            *phReq = hReq;
+        }
+    }
+    else
+        LogFlow(("Merged task %#p was deferred because the access range is locked\n", pTask));
+
+    return rc;
+}
+
 static int pdmacFileAioMgrNormalProcessTaskList(PPDMACTASKFILE pTaskHead,
                                                 PPDMACEPFILEMGR pAioMgr,
                                                 PPDMASYNCCOMPLETIONENDPOINTFILE pEndpoint)
@@ -1050,7 +1337,13 @@ static int pdmacFileAioMgrNormalProcessTaskList(PPDMACTASKFILE pTaskHead,
 
                 if (pCurr->hReq == NIL_RTFILEAIOREQ)
                 {
-                    if (pEndpoint->enmBackendType == PDMACFILEEPBACKEND_BUFFERED)
+                    /* Combine adjacent tasks into a single request to save host I/O operations. */
+                    if (pTaskHead)
+                        pdmacFileAioMgrNormalTaskMerge(pEndpoint, pCurr, &pTaskHead);
+
+                    if (pCurr->pMergedNext)
+                        rc = pdmacFileAioMgrNormalTaskPrepareMerged(pAioMgr, pEndpoint, pCurr, &hReq);
+                    else if (pEndpoint->enmBackendType == PDMACFILEEPBACKEND_BUFFERED)
                         rc = pdmacFileAioMgrNormalTaskPrepareBuffered(pAioMgr, pEndpoint, pCurr, &hReq);
                     else if (pEndpoint->enmBackendType == PDMACFILEEPBACKEND_NON_BUFFERED)
                         rc = pdmacFileAioMgrNormalTaskPrepareNonBuffered(pAioMgr, pEndpoint, pCurr, &hReq);
@@ -1058,6 +1351,16 @@ static int pdmacFileAioMgrNormalProcessTaskList(PPDMACTASKFILE pTaskHead,
                         AssertMsgFailed(("Invalid backend type %d\n", pEndpoint->enmBackendType));
 
                     AssertRC(rc);
+
+                    if (hReq != NIL_RTFILEAIOREQ)
+                    {
+                        uint32_t cTasks = 0;
+                        for (PPDMACTASKFILE pTaskCur = pCurr; pTaskCur; pTaskCur = pTaskCur->pMergedNext)
+                            cTasks++;
+
+                        STAM_REL_COUNTER_INC(&pEndpoint->StatHostReqsRw);
+                        STAM_REL_COUNTER_ADD(&pEndpoint->StatTasksRw, cTasks);
+                    }
                 }
                 else
                 {
@@ -1166,6 +1469,7 @@ static int pdmacFileAioMgrNormalQueueReqs(PPDMACEPFILEMGR pAioMgr,
         pTasksHead = pdmacFileEpGetNewTasks(pEndpoint);
         if (pTasksHead)
         {
+            pTasksHead = pdmacFileAioMgrNormalSchedule(pEndpoint, pTasksHead);
             rc = pdmacFileAioMgrNormalProcessTaskList(pTasksHead, pAioMgr, pEndpoint);
             AssertRC(rc);
         }
@@ -1386,9 +1690,6 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
             rc = pdmacFileAioMgrNormalProcessTaskList(pTasksWaiting, pAioMgr, pEndpoint);
             AssertRC(rc);
 
-            if (pTask->cbBounceBuffer)
-                RTMemPageFree(pTask->pvBounceBuffer, pTask->cbBounceBuffer);
-
             /*
              * Fatal errors are reported to the guest and non-fatal errors
              * will cause a migration to the failsafe manager in the hope
@@ -1396,9 +1697,30 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
              */
             if (!pdmacFileAioMgrNormalRcIsFatal(rcReq))
             {
-                /* Queue the request on the pending list. */
-                pTask->pNext = pEndpoint->AioMgr.pReqsPendingHead;
+                /*
+                 * Queue the request on the pending list. The failsafe manager processes
+                 * tasks one by one, so split up any merged tasks on the list again.
+                 */
+                PPDMACTASKFILE pTaskTail = pdmacFileAioMgrNormalTaskUnmerge(pTask);
+
+                if (pTask->cbBounceBuffer)
+                {
+                    RTMemPageFree(pTask->pvBounceBuffer, pTask->cbBounceBuffer);
+                    pTask->pvBounceBuffer = NULL;
+                    pTask->cbBounceBuffer = 0;
+                }
+
+                pTaskTail->pNext = pEndpoint->AioMgr.pReqsPendingHead;
                 pEndpoint->AioMgr.pReqsPendingHead = pTask;
+                if (!pEndpoint->AioMgr.pReqsPendingTail)
+                    pEndpoint->AioMgr.pReqsPendingTail = pTaskTail;
+
+                for (PPDMACTASKFILE pTaskCur = pTaskTail->pNext; pTaskCur; pTaskCur = pTaskCur->pNext)
+                {
+                    pTaskCur = pdmacFileAioMgrNormalTaskUnmerge(pTaskCur);
+                    if (!pTaskCur->pNext)
+                        pEndpoint->AioMgr.pReqsPendingTail = pTaskCur;
+                }
 
                 /* Create a new failsafe manager if necessary. */
                 if (!pEndpoint->AioMgr.fMoving)
@@ -1432,8 +1754,15 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
             }
             else
             {
+                PPDMACTASKFILE pTasksMerged = pTask->pMergedNext;
+
+                if (pTask->cbBounceBuffer)
+                    RTMemPageFree(pTask->pvBounceBuffer, pTask->cbBounceBuffer);
+
+                pTask->pMergedNext = NULL;
                 pTask->pfnCompleted(pTask, pTask->pvUser, rcReq);
                 pdmacFileTaskFree(pEndpoint, pTask);
+                pdmacFileAioMgrNormalTasksMergedComplete(pEndpoint, pTasksMerged, rcReq);
             }
         }
     }
@@ -1536,12 +1865,16 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
             }
             else
             {
+                PPDMACTASKFILE pTasksMerged = pTask->pMergedNext;
+
                 if (RT_SUCCESS(rc) && pTask->cbBounceBuffer)
                 {
+                    /* Scatter the data to all merged tasks. */
                     if (pTask->enmTransferType == PDMACTASKFILETRANSFER_READ)
-                        memcpy(pTask->DataSeg.pvSeg,
-                               ((uint8_t *)pTask->pvBounceBuffer) + pTask->offBounceBuffer,
-                               pTask->DataSeg.cbSeg);
+                        for (PPDMACTASKFILE pTaskCur = pTask; pTaskCur; pTaskCur = pTaskCur->pMergedNext)
+                            memcpy(pTaskCur->DataSeg.pvSeg,
+                                   ((uint8_t *)pTask->pvBounceBuffer) + pTaskCur->offBounceBuffer,
+                                   pTaskCur->DataSeg.cbSeg);
 
                     RTMemPageFree(pTask->pvBounceBuffer, pTask->cbBounceBuffer);
                 }
@@ -1558,8 +1891,10 @@ static void pdmacFileAioMgrNormalReqCompleteRc(PPDMACEPFILEMGR pAioMgr, RTFILEAI
 
                 /* Call completion callback */
                 LogFlow(("Task=%#p completed with %Rrc\n", pTask, rcReq));
+                pTask->pMergedNext = NULL;
                 pTask->pfnCompleted(pTask, pTask->pvUser, rcReq);
                 pdmacFileTaskFree(pEndpoint, pTask);
+                pdmacFileAioMgrNormalTasksMergedComplete(pEndpoint, pTasksMerged, rcReq);
 
                 /*
                  * If there is no request left on the endpoint but a flush request is set
@@ -17,6 +17,22 @@
 
 /** @page pg_pdm_block_cache     PDM Block Cache - The I/O cache
  * This component implements an I/O cache based on the 2Q cache algorithm.
+ * Alternatively the ARC algorithm can be selected with the "CachePolicy"
+ * key. It adapts the target size of the recently used list on hits in the
+ * two ghost lists, and data of long sequential runs (backup scans) is
+ * inserted at the tail of the recently used list so it is evicted first
+ * instead of flushing the frequently used entries.
+ *
+ * The cache memory is split into shards selected by a hash of the cache user
+ * and the offset range of an entry. Every shard has its own lock and LRU lists,
+ * so independent disks and distant ranges of the same disk don't serialize on
+ * a single lock. Lock order is global lock, shard locks (ascending), per user
+ * R/W semaphore.
+ *
+ * Dirty entries are written back by a dedicated commit thread once the dirty
+ * threshold is exceeded or the commit timer fires. The per user semaphore is
+ * only held while the entries are marked as in progress, the writes are issued
+ * after it was released so readers are not blocked by a commit.
  */
 
 /*******************************************************************************
@@ -97,47 +113,107 @@ DECLINLINE(void) pdmBlkCacheEntryRef(PPDMBLKCACHEENTRY pEntry)
 }
 
 #ifdef VBOX_STRICT
-static void pdmBlkCacheValidate(PPDMBLKCACHEGLOBAL pCache)
+static void pdmBlkCacheShardValidate(PPDMBLKCACHESHARD pShard)
 {
     /* Amount of cached data should never exceed the maximum amount. */
-    AssertMsg(pCache->cbCached <= pCache->cbMax,
+    AssertMsg(pShard->cbCached <= pShard->cbMax,
               ("Current amount of cached data exceeds maximum\n"));
 
     /* The amount of cached data in the LRU and FRU list should match cbCached */
-    AssertMsg(pCache->LruRecentlyUsedIn.cbCached + pCache->LruFrequentlyUsed.cbCached == pCache->cbCached,
+    AssertMsg(pShard->LruRecentlyUsedIn.cbCached + pShard->LruFrequentlyUsed.cbCached == pShard->cbCached,
               ("Amount of cached data doesn't match\n"));
 
-    AssertMsg(pCache->LruRecentlyUsedOut.cbCached <= pCache->cbRecentlyUsedOutMax,
-              ("Paged out list exceeds maximum\n"));
+    if (pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        AssertMsg(   (uint64_t)pShard->LruRecentlyUsedOut.cbCached + pShard->LruFrequentlyUsedOut.cbCached
+                  <= 2 * (uint64_t)pShard->cbMax,
+                  ("Ghost lists exceed maximum\n"));
+    else
+        AssertMsg(pShard->LruRecentlyUsedOut.cbCached <= pShard->cbRecentlyUsedOutMax,
+                  ("Paged out list exceeds maximum\n"));
 }
 #endif
 
+/**
+ * Enters the global cache lock protecting the list of cache users.
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
 DECLINLINE(void) pdmBlkCacheLockEnter(PPDMBLKCACHEGLOBAL pCache)
 {
     RTCritSectEnter(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+{
+    RTCritSectLeave(&pCache->CritSect);
+}
+
+DECLINLINE(void) pdmBlkCacheShardLockEnter(PPDMBLKCACHESHARD pShard)
+{
+    RTCritSectEnter(&pShard->CritSect);
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheShardValidate(pShard);
 #endif
 }
 
-DECLINLINE(void) pdmBlkCacheLockLeave(PPDMBLKCACHEGLOBAL pCache)
+DECLINLINE(void) pdmBlkCacheShardLockLeave(PPDMBLKCACHESHARD pShard)
 {
 #ifdef VBOX_STRICT
-    pdmBlkCacheValidate(pCache);
+    pdmBlkCacheShardValidate(pShard);
 #endif
-    RTCritSectLeave(&pCache->CritSect);
+    RTCritSectLeave(&pShard->CritSect);
+}
+
+/**
+ * Enters the locks of all shards in ascending order.
+ *
+ * Required before the per user R/W semaphore is taken for operations which touch
+ * entries of arbitrary shards (destroying the tree of a user for example).
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheShardLockEnterAll(PPDMBLKCACHEGLOBAL pCache)
+{
+    for (uint32_t i = 0; i < pCache->cShards; i++)
+        pdmBlkCacheShardLockEnter(&pCache->paShards[i]);
+}
+
+static void pdmBlkCacheShardLockLeaveAll(PPDMBLKCACHEGLOBAL pCache)
+{
+    for (uint32_t i = pCache->cShards; i > 0; i--)
+        pdmBlkCacheShardLockLeave(&pCache->paShards[i - 1]);
+}
+
+/**
+ * Returns the shard responsible for the given offset of a cache user.
+ *
+ * @returns Pointer to the shard.
+ * @param   pBlkCache    The cache user.
+ * @param   off          The offset of the entry.
+ */
+DECLINLINE(PPDMBLKCACHESHARD) pdmBlkCacheShardGet(PPDMBLKCACHE pBlkCache, uint64_t off)
+{
+    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
+    uint64_t u64Hash = (off >> PDMBLKCACHE_SHARD_RANGE_SHIFT) ^ ((uint64_t)pBlkCache->uShardSeed << 40);
+
+    u64Hash *= UINT64_C(0x9e3779b97f4a7c15); /* Fibonacci hashing, the upper bits are well mixed. */
+    return &pCache->paShards[(uint32_t)(u64Hash >> 32) & (pCache->cShards - 1)];
 }
 
-DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+DECLINLINE(void) pdmBlkCacheSub(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached -= cbAmount;
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached -= cbAmount;
+    ASMAtomicSubU32(&pShard->pCache->cbCached, cbAmount);
 }
 
-DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHEGLOBAL pCache, uint32_t cbAmount)
+DECLINLINE(void) pdmBlkCacheAdd(PPDMBLKCACHESHARD pShard, uint32_t cbAmount)
 {
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
-    pCache->cbCached += cbAmount;
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+    pShard->cbCached += cbAmount;
+    ASMAtomicAddU32(&pShard->pCache->cbCached, cbAmount);
 }
 
 DECLINLINE(void) pdmBlkCacheListAdd(PPDMBLKLRULIST pList, uint32_t cbAmount)
@@ -276,6 +352,40 @@ static void pdmBlkCacheEntryAddToList(PPDMBLKLRULIST pList, PPDMBLKCACHEENTRY pE
 #endif
 }
 
+/**
+ * Adds a cache entry to the tail of the given LRU list, making it the first
+ * candidate for eviction. Unlinks it from the currently assigned list if needed.
+ *
+ * @returns nothing.
+ * @param    pList    List to the add entry to.
+ * @param    pEntry   Entry to add.
+ */
+static void pdmBlkCacheEntryAddToListTail(PPDMBLKLRULIST pList, PPDMBLKCACHEENTRY pEntry)
+{
+    LogFlowFunc((": Adding entry %#p to the tail of list %#p\n", pEntry, pList));
+
+    /* Remove from old list if needed */
+    if (pEntry->pList)
+        pdmBlkCacheEntryRemoveFromList(pEntry);
+
+    pEntry->pPrev = pList->pTail;
+    if (pList->pTail)
+        pList->pTail->pNext = pEntry;
+    else
+    {
+        Assert(!pList->pHead);
+        pList->pHead = pEntry;
+    }
+
+    pEntry->pNext    = NULL;
+    pList->pTail     = pEntry;
+    pdmBlkCacheListAdd(pList, pEntry->cbData);
+    pEntry->pList    = pList;
+#ifdef PDMACFILECACHE_WITH_LRULIST_CHECKS
+    pdmBlkCacheCheckList(pList, NULL);
+#endif
+}
+
 /**
  * Destroys a LRU list freeing all entries.
  *
@@ -300,12 +410,38 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
     }
 }
 
+/**
+ * Returns the maximum number of bytes the given ghost list may hold.
+ *
+ * @returns Maximum size of the ghost list in bytes.
+ * @param   pShard       The shard.
+ * @param   pGhostList   The ghost list.
+ */
+static uint64_t pdmBlkCacheGhostListMax(PPDMBLKCACHESHARD pShard, PPDMBLKLRULIST pGhostList)
+{
+    if (pShard->pCache->enmPolicy != PDMBLKCACHEPOLICY_ARC)
+        return pShard->cbRecentlyUsedOutMax;
+
+    /* ARC: T1 + B1 must not exceed the cache size and all four lists not twice the cache size. */
+    uint64_t cbMax = pShard->cbMax;
+    uint64_t cbUsed;
+    if (pGhostList == &pShard->LruRecentlyUsedOut)
+    {
+        cbUsed = pShard->LruRecentlyUsedIn.cbCached;
+        return cbUsed < cbMax ? cbMax - cbUsed : 0;
+    }
+
+    cbUsed =   (uint64_t)pShard->LruRecentlyUsedIn.cbCached + pShard->LruFrequentlyUsed.cbCached
+             + pShard->LruRecentlyUsedOut.cbCached;
+    return cbUsed < 2 * cbMax ? 2 * cbMax - cbUsed : 0;
+}
+
 /**
  * Tries to remove the given amount of bytes from a given list in the cache
  * moving the entries to one of the given ghosts lists
  *
  * @returns Amount of data which could be freed.
- * @param    pCache           Pointer to the global cache data.
+ * @param    pShard           The shard to evict data from.
  * @param    cbData           The amount of the data to free.
  * @param    pListSrc         The source list to evict data from.
  * @param    pGhostListSrc    The ghost list removed entries should be moved to
@@ -318,18 +454,19 @@ static void pdmBlkCacheDestroyList(PPDMBLKLRULIST pList)
  *          may be marked as non evictable if they are used for I/O at the
  *          moment.
  */
-static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData,
+static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHESHARD pShard, size_t cbData,
                                         PPDMBLKLRULIST pListSrc, PPDMBLKLRULIST pGhostListDst,
                                         bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbEvicted = 0;
 
-    PDMACFILECACHE_IS_CRITSECT_OWNER(pCache);
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
 
     AssertMsg(cbData > 0, ("Evicting 0 bytes not possible\n"));
     AssertMsg(   !pGhostListDst
-              || (pGhostListDst == &pCache->LruRecentlyUsedOut),
-              ("Destination list must be NULL or the recently used but paged out list\n"));
+              || (pGhostListDst == &pShard->LruRecentlyUsedOut)
+              || (pGhostListDst == &pShard->LruFrequentlyUsedOut),
+              ("Destination list must be NULL or one of the paged out lists\n"));
 
     if (fReuseBuffer)
     {
@@ -362,7 +499,7 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
 
                 if (fReuseBuffer && pCurr->cbData == cbData)
                 {
-                    STAM_COUNTER_INC(&pCache->StatBuffersReused);
+                    STAM_COUNTER_INC(&pShard->pCache->StatBuffersReused);
                     *ppbBuffer = pCurr->pbData;
                 }
                 else if (pCurr->pbData)
@@ -372,7 +509,8 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                 cbEvicted += pCurr->cbData;
 
                 pdmBlkCacheEntryRemoveFromList(pCurr);
-                pdmBlkCacheSub(pCache, pCurr->cbData);
+                pdmBlkCacheSub(pShard, pCurr->cbData);
+                STAM_COUNTER_ADD(&pShard->StatEvicted, pCurr->cbData);
 
                 if (pGhostListDst)
                 {
@@ -381,7 +519,8 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                     PPDMBLKCACHEENTRY pGhostEntFree = pGhostListDst->pTail;
 
                     /* We have to remove the last entries from the paged out list. */
-                    while (   pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax
+                    uint64_t cbGhostMax = pdmBlkCacheGhostListMax(pShard, pGhostListDst);
+                    while (   pGhostListDst->cbCached + pCurr->cbData > cbGhostMax
                            && pGhostEntFree)
                     {
                         PPDMBLKCACHEENTRY pFree = pGhostEntFree;
@@ -395,9 +534,9 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                         {
                             pdmBlkCacheEntryRemoveFromList(pFree);
 
-                            STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCacheFree->pTree, pFree->Core.Key);
-                            STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                             RTMemFree(pFree);
                         }
@@ -405,12 +544,12 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                         RTSemRWReleaseWrite(pBlkCacheFree->SemRWEntries);
                     }
 
-                    if (pGhostListDst->cbCached + pCurr->cbData > pCache->cbRecentlyUsedOutMax)
+                    if (pGhostListDst->cbCached + pCurr->cbData > cbGhostMax)
                     {
                         /* Couldn't remove enough entries. Delete */
-                        STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                        STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                         RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                        STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                        STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                         RTMemFree(pCurr);
                     }
@@ -420,9 +559,9 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
                 else
                 {
                     /* Delete the entry from the AVL tree it is assigned to. */
-                    STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_START(&pShard->pCache->StatTreeRemove, Cache);
                     RTAvlrU64Remove(pCurr->pBlkCache->pTree, pCurr->Core.Key);
-                    STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_STOP(&pShard->pCache->StatTreeRemove, Cache);
 
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
                     RTMemFree(pCurr);
@@ -437,17 +576,17 @@ static size_t pdmBlkCacheEvictPagesFrom(PPDMBLKCACHEGLOBAL pCache, size_t cbData
     return cbEvicted;
 }
 
-static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+static bool pdmBlkCacheReclaim2Q(PPDMBLKCACHESHARD pShard, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
 {
     size_t cbRemoved = 0;
 
-    if ((pCache->cbCached + cbData) < pCache->cbMax)
+    if ((pShard->cbCached + cbData) < pShard->cbMax)
         return true;
-    else if ((pCache->LruRecentlyUsedIn.cbCached + cbData) > pCache->cbRecentlyUsedInMax)
+    else if ((pShard->LruRecentlyUsedIn.cbCached + cbData) > pShard->cbRecentlyUsedInMax)
     {
         /* Try to evict as many bytes as possible from A1in */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruRecentlyUsedIn,
-                                                 &pCache->LruRecentlyUsedOut, fReuseBuffer, ppbBuffer);
+        cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruRecentlyUsedIn,
+                                                 &pShard->LruRecentlyUsedOut, fReuseBuffer, ppbBuffer);
 
         /*
          * If it was not possible to remove enough entries
@@ -462,17 +601,17 @@ static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fR
              * we don't need to evict that much data
              */
             if (!cbRemoved)
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
+                cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruFrequentlyUsed,
                                                           NULL, fReuseBuffer, ppbBuffer);
             else
-                cbRemoved += pdmBlkCacheEvictPagesFrom(pCache, cbData - cbRemoved, &pCache->LruFrequentlyUsed,
+                cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData - cbRemoved, &pShard->LruFrequentlyUsed,
                                                           NULL, false, NULL);
         }
     }
     else
     {
         /* We have to remove entries from frequently access list. */
-        cbRemoved = pdmBlkCacheEvictPagesFrom(pCache, cbData, &pCache->LruFrequentlyUsed,
+        cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, &pShard->LruFrequentlyUsed,
                                                  NULL, fReuseBuffer, ppbBuffer);
     }
 
@@ -480,6 +619,142 @@ static bool pdmBlkCacheReclaim(PPDMBLKCACHEGLOBAL pCache, size_t cbData, bool fR
     return (cbRemoved >= cbData);
 }
 
+/**
+ * ARC replacement, evicts from the recently used list if it exceeds its target
+ * size and from the frequently used list otherwise, moving the evicted entries
+ * to the matching ghost list.
+ *
+ * @returns Flag whether enough bytes could be freed.
+ * @param   pShard          The shard to evict data from.
+ * @param   cbData          The amount of the data to free.
+ * @param   fReuseBuffer    Flag whether a buffer should be reused if it has the same size
+ * @param   ppbBuffer       Where to store the address of the buffer if an entry with the
+ *                          same size was found and fReuseBuffer is true.
+ */
+static bool pdmBlkCacheReclaimArc(PPDMBLKCACHESHARD pShard, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+{
+    size_t cbRemoved = 0;
+
+    if ((pShard->cbCached + cbData) < pShard->cbMax)
+        return true;
+
+    PPDMBLKLRULIST pListFirst      = &pShard->LruFrequentlyUsed;
+    PPDMBLKLRULIST pGhostListFirst = &pShard->LruFrequentlyUsedOut;
+    PPDMBLKLRULIST pListSecond     = &pShard->LruRecentlyUsedIn;
+    PPDMBLKLRULIST pGhostListSecond = &pShard->LruRecentlyUsedOut;
+    if (   pShard->LruRecentlyUsedIn.cbCached
+        && pShard->LruRecentlyUsedIn.cbCached >= pShard->cbRecentlyUsedTarget)
+    {
+        pListFirst       = &pShard->LruRecentlyUsedIn;
+        pGhostListFirst  = &pShard->LruRecentlyUsedOut;
+        pListSecond      = &pShard->LruFrequentlyUsed;
+        pGhostListSecond = &pShard->LruFrequentlyUsedOut;
+    }
+
+    cbRemoved = pdmBlkCacheEvictPagesFrom(pShard, cbData, pListFirst, pGhostListFirst, fReuseBuffer, ppbBuffer);
+
+    /* Entries might be in use, fall back to the other list. */
+    if (cbRemoved < cbData)
+    {
+        Assert(!fReuseBuffer || !*ppbBuffer);
+
+        if (!cbRemoved)
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData, pListSecond, pGhostListSecond,
+                                                   fReuseBuffer, ppbBuffer);
+        else
+            cbRemoved += pdmBlkCacheEvictPagesFrom(pShard, cbData - cbRemoved, pListSecond, pGhostListSecond,
+                                                   false, NULL);
+    }
+
+    LogFlowFunc((": removed %u bytes, requested %u\n", cbRemoved, cbData));
+    return (cbRemoved >= cbData);
+}
+
+/**
+ * Makes room for the given amount of data in a shard using the configured
+ * replacement policy.
+ *
+ * @returns Flag whether enough bytes could be freed.
+ * @param   pShard          The shard to evict data from.
+ * @param   cbData          The amount of the data to free.
+ * @param   fReuseBuffer    Flag whether a buffer should be reused if it has the same size
+ * @param   ppbBuffer       Where to store the address of the buffer if an entry with the
+ *                          same size was found and fReuseBuffer is true.
+ */
+static bool pdmBlkCacheReclaim(PPDMBLKCACHESHARD pShard, size_t cbData, bool fReuseBuffer, uint8_t **ppbBuffer)
+{
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    if (pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        return pdmBlkCacheReclaimArc(pShard, cbData, fReuseBuffer, ppbBuffer);
+    return pdmBlkCacheReclaim2Q(pShard, cbData, fReuseBuffer, ppbBuffer);
+}
+
+/**
+ * Accounts a hit in one of the ghost lists, adapting the ARC target size of the
+ * recently used list. Must be called before the entry is removed from the list.
+ *
+ * @returns nothing.
+ * @param   pShard    The shard the entry belongs to.
+ * @param   pEntry    The entry which was hit.
+ */
+static void pdmBlkCacheGhostHit(PPDMBLKCACHESHARD pShard, PPDMBLKCACHEENTRY pEntry)
+{
+    PPDMBLKCACHEGLOBAL pCache = pShard->pCache;
+    PDMACFILECACHE_IS_CRITSECT_OWNER(pShard);
+
+    if (pEntry->pList == &pShard->LruRecentlyUsedOut)
+    {
+        STAM_REL_COUNTER_INC(&pCache->StatGhostHitsRecent);
+
+        if (pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC)
+        {
+            /* The recently used list was too small, grow it. */
+            uint64_t cbDelta = pEntry->cbData;
+            if (pShard->LruFrequentlyUsedOut.cbCached > pShard->LruRecentlyUsedOut.cbCached)
+                cbDelta *= pShard->LruFrequentlyUsedOut.cbCached / pShard->LruRecentlyUsedOut.cbCached;
+            pShard->cbRecentlyUsedTarget = (uint32_t)RT_MIN((uint64_t)pShard->cbRecentlyUsedTarget + cbDelta,
+                                                            pShard->cbMax);
+        }
+    }
+    else if (pEntry->pList == &pShard->LruFrequentlyUsedOut)
+    {
+        STAM_REL_COUNTER_INC(&pCache->StatGhostHitsFrequent);
+
+        /* The frequently used list was too small, shrink the recently used one. */
+        uint64_t cbDelta = pEntry->cbData;
+        if (pShard->LruRecentlyUsedOut.cbCached > pShard->LruFrequentlyUsedOut.cbCached)
+            cbDelta *= pShard->LruRecentlyUsedOut.cbCached / pShard->LruFrequentlyUsedOut.cbCached;
+        pShard->cbRecentlyUsedTarget = pShard->cbRecentlyUsedTarget > cbDelta
+                                     ? pShard->cbRecentlyUsedTarget - (uint32_t)cbDelta
+                                     : 0;
+    }
+}
+
+/**
+ * Updates the position of an entry holding data after it was accessed.
+ *
+ * Entries in the frequently used list are moved to the head. With ARC a second
+ * access to an entry in the recently used list promotes it to the frequently
+ * used list.
+ *
+ * @returns nothing.
+ * @param   pEntry    The accessed entry, must be referenced by the caller.
+ */
+static void pdmBlkCacheEntryTouch(PPDMBLKCACHEENTRY pEntry)
+{
+    PPDMBLKCACHESHARD pShard = pEntry->pShard;
+
+    if (   pEntry->pList == &pShard->LruFrequentlyUsed
+        || (   pShard->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC
+            && pEntry->pList == &pShard->LruRecentlyUsedIn))
+    {
+        pdmBlkCacheShardLockEnter(pShard);
+        pdmBlkCacheEntryAddToList(&pShard->LruFrequentlyUsed, pEntry);
+        pdmBlkCacheShardLockLeave(pShard);
+    }
+}
+
 DECLINLINE(int) pdmBlkCacheEnqueue(PPDMBLKCACHE pBlkCache, uint64_t off, size_t cbXfer, PPDMBLKCACHEIOXFER pIoXfer)
 {
     int rc = VINF_SUCCESS;
@@ -627,12 +902,13 @@ static int pdmBlkCacheRequestPassthrough(PPDMBLKCACHE pBlkCache, PPDMBLKCACHEREQ
  * Commit a single dirty entry to the endpoint
  *
  * @returns nothing
- * @param   pEntry    The entry to commit.
+ * @param   pEntry    The entry to commit. Must be marked as in progress already
+ *                    so it can't be evicted or modified once the lock is dropped.
  */
 static void pdmBlkCacheEntryCommit(PPDMBLKCACHEENTRY pEntry)
 {
     AssertMsg(   (pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY)
-              && !(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
+              && (pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
               ("Invalid flags set for entry %#p\n", pEntry));
 
     pdmBlkCacheEntryWriteToMedium(pEntry);
@@ -652,40 +928,74 @@ static void pdmBlkCacheCommit(PPDMBLKCACHE pBlkCache)
     if (pBlkCache->fSuspended)
         return;
 
-    RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
-
     /* The list is moved to a new header to reduce locking overhead. */
     RTLISTANCHOR ListDirtyNotCommitted;
-
     RTListInit(&ListDirtyNotCommitted);
+
+    /*
+     * Only mark the entries as in progress while the semaphore is held exclusively.
+     * The flag protects them from eviction and redirects writers to the waiter list,
+     * so the writes can be set up without blocking readers of the endpoint.
+     */
+    RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
+
+    /* Check again, the commit thread might have raced PDMR3BlkCacheSuspend. */
+    if (ASMAtomicReadBool(&pBlkCache->fSuspended))
+    {
+        RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
+        return;
+    }
+
     RTSpinlockAcquire(pBlkCache->LockList);
     RTListMove(&ListDirtyNotCommitted, &pBlkCache->ListDirtyNotCommitted);
     RTSpinlockRelease(pBlkCache->LockList);
 
-    if (!RTListIsEmpty(&ListDirtyNotCommitted))
+    PPDMBLKCACHEENTRY pEntry;
+    RTListForEach(&ListDirtyNotCommitted, pEntry, PDMBLKCACHEENTRY, NodeNotCommitted)
     {
-        PPDMBLKCACHEENTRY pEntry = RTListGetFirst(&ListDirtyNotCommitted, PDMBLKCACHEENTRY, NodeNotCommitted);
+        AssertMsg(   (pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY)
+                  && !(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
+                  ("Invalid flags set for entry %#p\n", pEntry));
+        pEntry->fFlags |= PDMBLKCACHE_ENTRY_IO_IN_PROGRESS;
+    }
 
-        while (!RTListNodeIsLast(&ListDirtyNotCommitted, &pEntry->NodeNotCommitted))
+    RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
+
+    while (!RTListIsEmpty(&ListDirtyNotCommitted))
+    {
+        /*
+         * Stop issuing writes when the endpoint got suspended meanwhile. Entries
+         * without waiters go back to the dirty list as they were, the others
+         * have to be written for the waiting requests to complete.
+         */
+        if (ASMAtomicReadBool(&pBlkCache->fSuspended))
         {
-            PPDMBLKCACHEENTRY pNext = RTListNodeGetNext(&pEntry->NodeNotCommitted, PDMBLKCACHEENTRY,
-                                                        NodeNotCommitted);
-            pdmBlkCacheEntryCommit(pEntry);
-            cbCommitted += pEntry->cbData;
-            RTListNodeRemove(&pEntry->NodeNotCommitted);
-            pEntry = pNext;
+            PPDMBLKCACHEENTRY pEntryNext;
+            RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
+            RTListForEachSafe(&ListDirtyNotCommitted, pEntry, pEntryNext, PDMBLKCACHEENTRY, NodeNotCommitted)
+            {
+                if (!pEntry->pWaitingHead)
+                {
+                    RTListNodeRemove(&pEntry->NodeNotCommitted);
+                    pEntry->fFlags &= ~PDMBLKCACHE_ENTRY_IO_IN_PROGRESS;
+                    RTSpinlockAcquire(pBlkCache->LockList);
+                    RTListAppend(&pBlkCache->ListDirtyNotCommitted, &pEntry->NodeNotCommitted);
+                    RTSpinlockRelease(pBlkCache->LockList);
+                }
+            }
+            RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
+            if (RTListIsEmpty(&ListDirtyNotCommitted))
+                break;
         }
 
-        /* Commit the last endpoint */
-        Assert(RTListNodeIsLast(&ListDirtyNotCommitted, &pEntry->NodeNotCommitted));
-        pdmBlkCacheEntryCommit(pEntry);
-        cbCommitted += pEntry->cbData;
+        pEntry = RTListGetFirst(&ListDirtyNotCommitted, PDMBLKCACHEENTRY, NodeNotCommitted);
+
+        /* Unlink before the write is issued, the completion might add the entry to the dirty list again. */
         RTListNodeRemove(&pEntry->NodeNotCommitted);
-        AssertMsg(RTListIsEmpty(&ListDirtyNotCommitted),
-                  ("Committed all entries but list is not empty\n"));
+        cbCommitted += pEntry->cbData;
+        pdmBlkCacheEntryCommit(pEntry);
     }
 
-    RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
     AssertMsg(pBlkCache->pCache->cbDirty >= cbCommitted,
               ("Number of committed bytes exceeds number of dirty bytes\n"));
     uint32_t cbDirtyOld = ASMAtomicSubU32(&pBlkCache->pCache->cbDirty, cbCommitted);
@@ -709,28 +1019,93 @@ static void pdmBlkCacheCommitDirtyEntries(PPDMBLKCACHEGLOBAL pCache)
     if (!fCommitInProgress)
     {
         pdmBlkCacheLockEnter(pCache);
-        Assert(!RTListIsEmpty(&pCache->ListUsers));
 
-        PPDMBLKCACHE pBlkCache = RTListGetFirst(&pCache->ListUsers, PDMBLKCACHE, NodeCacheUser);
-        AssertPtr(pBlkCache);
-
-        while (!RTListNodeIsLast(&pCache->ListUsers, &pBlkCache->NodeCacheUser))
+        /* The list can be empty if the last user went away before the commit thread woke up. */
+        PPDMBLKCACHE pBlkCache;
+        RTListForEach(&pCache->ListUsers, pBlkCache, PDMBLKCACHE, NodeCacheUser)
         {
             pdmBlkCacheCommit(pBlkCache);
-
-            pBlkCache = RTListNodeGetNext(&pBlkCache->NodeCacheUser, PDMBLKCACHE,
-                                          NodeCacheUser);
         }
 
-        /* Commit the last endpoint */
-        Assert(RTListNodeIsLast(&pCache->ListUsers, &pBlkCache->NodeCacheUser));
-        pdmBlkCacheCommit(pBlkCache);
-
         pdmBlkCacheLockLeave(pCache);
         ASMAtomicWriteBool(&pCache->fCommitInProgress, false);
     }
 }
 
+/**
+ * Kicks the commit thread to write back all dirty entries in the background.
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheCommitDirtyEntriesAsync(PPDMBLKCACHEGLOBAL pCache)
+{
+    int rc = RTSemEventSignal(pCache->hEvtCommit);
+    AssertRC(rc);
+}
+
+/**
+ * The commit thread, writes back dirty entries when kicked so the I/O path
+ * exceeding the dirty threshold doesn't have to do it inline.
+ *
+ * @returns IPRT status code.
+ * @param   hThreadSelf    The thread handle.
+ * @param   pvUser         The global cache instance.
+ */
+static DECLCALLBACK(int) pdmBlkCacheCommitThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PPDMBLKCACHEGLOBAL pCache = (PPDMBLKCACHEGLOBAL)pvUser;
+    NOREF(hThreadSelf);
+
+    while (!ASMAtomicReadBool(&pCache->fCommitThreadShutdown))
+    {
+        int rc = RTSemEventWait(pCache->hEvtCommit, RT_INDEFINITE_WAIT);
+        if (   RT_FAILURE(rc)
+            && rc != VERR_INTERRUPTED)
+        {
+            AssertLogRelMsgFailed(("BlkCache: Waiting for commit event failed with %Rrc\n", rc));
+            break;
+        }
+
+        if (ASMAtomicReadBool(&pCache->fCommitThreadShutdown))
+            break;
+
+        if (   ASMAtomicReadU32(&pCache->cbDirty) > 0
+            && !ASMAtomicReadBool(&pCache->fIoErrorVmSuspended))
+        {
+            STAM_COUNTER_INC(&pCache->StatCommitsBackground);
+            pdmBlkCacheCommitDirtyEntries(pCache);
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+/**
+ * Stops the commit thread and frees its resources.
+ *
+ * @returns nothing.
+ * @param   pCache    The global cache instance.
+ */
+static void pdmBlkCacheCommitThreadStop(PPDMBLKCACHEGLOBAL pCache)
+{
+    if (pCache->hThreadCommit != NIL_RTTHREAD)
+    {
+        ASMAtomicWriteBool(&pCache->fCommitThreadShutdown, true);
+        RTSemEventSignal(pCache->hEvtCommit);
+
+        int rc = RTThreadWait(pCache->hThreadCommit, RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc);
+        pCache->hThreadCommit = NIL_RTTHREAD;
+    }
+
+    if (pCache->hEvtCommit != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pCache->hEvtCommit);
+        pCache->hEvtCommit = NIL_RTSEMEVENT;
+    }
+}
+
 /**
  * Adds the given entry as a dirty to the cache.
  *
@@ -746,7 +1121,7 @@ static bool pdmBlkCacheAddDirtyEntry(PPDMBLKCACHE pBlkCache, PPDMBLKCACHEENTRY p
     /* If the commit timer is disabled we commit right away. */
     if (pCache->u32CommitTimeoutMs == 0)
     {
-        pEntry->fFlags |= PDMBLKCACHE_ENTRY_IS_DIRTY;
+        pEntry->fFlags |= PDMBLKCACHE_ENTRY_IS_DIRTY | PDMBLKCACHE_ENTRY_IO_IN_PROGRESS;
         pdmBlkCacheEntryCommit(pEntry);
     }
     else if (!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY))
@@ -801,9 +1176,9 @@ static DECLCALLBACK(void) pdmBlkCacheCommitTimerCallback(PVM pVM, PTMTIMER pTime
 
     if (   ASMAtomicReadU32(&pCache->cbDirty) > 0
         && !ASMAtomicReadBool(&pCache->fIoErrorVmSuspended))
-        pdmBlkCacheCommitDirtyEntries(pCache);
+        pdmBlkCacheCommitDirtyEntriesAsync(pCache);
 
-    LogFlowFunc(("Entries committed, going to sleep\n"));
+    LogFlowFunc(("Commit thread kicked, going to sleep\n"));
 }
 
 static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
@@ -843,8 +1218,8 @@ static DECLCALLBACK(int) pdmR3BlkCacheSaveExec(PVM pVM, PSSMHANDLE pSSM)
             AssertMsg(pEntry->fFlags & PDMBLKCACHE_ENTRY_IS_DIRTY, ("Entry is not dirty\n"));
             AssertMsg(!(pEntry->fFlags & ~PDMBLKCACHE_ENTRY_IS_DIRTY), ("Invalid flags set\n"));
             AssertMsg(!pEntry->pWaitingHead && !pEntry->pWaitingTail, ("There are waiting requests\n"));
-            AssertMsg(   pEntry->pList == &pBlkCacheGlobal->LruRecentlyUsedIn
-                      || pEntry->pList == &pBlkCacheGlobal->LruFrequentlyUsed,
+            AssertMsg(   pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn
+                      || pEntry->pList == &pEntry->pShard->LruFrequentlyUsed,
                       ("Invalid list\n"));
             AssertMsg(pEntry->cbData == pEntry->Core.KeyLast - pEntry->Core.Key + 1,
                       ("Size and range do not match\n"));
@@ -956,8 +1331,12 @@ static DECLCALLBACK(int) pdmR3BlkCacheLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_
 
             /* Add to the dirty list. */
             pdmBlkCacheAddDirtyEntry(pBlkCache, pEntry);
-            pdmBlkCacheEntryAddToList(&pBlkCacheGlobal->LruRecentlyUsedIn, pEntry);
-            pdmBlkCacheAdd(pBlkCacheGlobal, cbEntry);
+
+            PPDMBLKCACHESHARD pShard = pEntry->pShard;
+            pdmBlkCacheShardLockEnter(pShard);
+            pdmBlkCacheEntryAddToList(&pShard->LruRecentlyUsedIn, pEntry);
+            pdmBlkCacheAdd(pShard, cbEntry);
+            pdmBlkCacheShardLockLeave(pShard);
             pdmBlkCacheEntryRelease(pEntry);
             cEntries--;
         }
@@ -1007,19 +1386,9 @@ int pdmR3BlkCacheInit(PVM pVM)
     pBlkCacheGlobal->cRefs = 0;
     pBlkCacheGlobal->cbCached  = 0;
     pBlkCacheGlobal->fCommitInProgress = false;
-
-    /* Initialize members */
-    pBlkCacheGlobal->LruRecentlyUsedIn.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedIn.cbCached = 0;
-
-    pBlkCacheGlobal->LruRecentlyUsedOut.pHead    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.pTail    = NULL;
-    pBlkCacheGlobal->LruRecentlyUsedOut.cbCached = 0;
-
-    pBlkCacheGlobal->LruFrequentlyUsed.pHead    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.pTail    = NULL;
-    pBlkCacheGlobal->LruFrequentlyUsed.cbCached = 0;
+    pBlkCacheGlobal->fCommitThreadShutdown = false;
+    pBlkCacheGlobal->hThreadCommit = NIL_RTTHREAD;
+    pBlkCacheGlobal->hEvtCommit = NIL_RTSEMEVENT;
 
     do
     {
@@ -1027,16 +1396,118 @@ int pdmR3BlkCacheInit(PVM pVM)
         AssertLogRelRCBreak(rc);
         LogFlowFunc(("Maximum number of bytes cached %u\n", pBlkCacheGlobal->cbMax));
 
-        pBlkCacheGlobal->cbRecentlyUsedInMax  = (pBlkCacheGlobal->cbMax / 100) * 25; /* 25% of the buffer size */
-        pBlkCacheGlobal->cbRecentlyUsedOutMax = (pBlkCacheGlobal->cbMax / 100) * 50; /* 50% of the buffer size */
-        LogFlowFunc(("cbRecentlyUsedInMax=%u cbRecentlyUsedOutMax=%u\n",
-                     pBlkCacheGlobal->cbRecentlyUsedInMax, pBlkCacheGlobal->cbRecentlyUsedOutMax));
+        /*
+         * The cache is split into shards by (user, offset range) to reduce lock contention.
+         * By default every shard gets at least PDMBLKCACHE_SHARD_SIZE_MIN bytes so that
+         * small caches keep working like a single global cache.
+         */
+        uint32_t cShardsDef = RT_MAX(pBlkCacheGlobal->cbMax / PDMBLKCACHE_SHARD_SIZE_MIN, 1);
+        rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheShards", &pBlkCacheGlobal->cShards, cShardsDef);
+        AssertLogRelRCBreak(rc);
+        pBlkCacheGlobal->cShards = RT_MIN(RT_MAX(pBlkCacheGlobal->cShards, 1), PDMBLKCACHE_SHARDS_MAX);
+        /* Round down to a power of two for the shard hash. */
+        while (pBlkCacheGlobal->cShards & (pBlkCacheGlobal->cShards - 1))
+            pBlkCacheGlobal->cShards &= pBlkCacheGlobal->cShards - 1;
+        LogFlowFunc(("cShards=%u\n", pBlkCacheGlobal->cShards));
+
+        /* Replacement policy, the classic 2Q one is the default. */
+        char szPolicy[16];
+        rc = CFGMR3QueryStringDef(pCfgBlkCache, "CachePolicy", szPolicy, sizeof(szPolicy), "2Q");
+        AssertLogRelRCBreak(rc);
+        if (!RTStrICmp(szPolicy, "2Q"))
+            pBlkCacheGlobal->enmPolicy = PDMBLKCACHEPOLICY_2Q;
+        else if (!RTStrICmp(szPolicy, "ARC"))
+            pBlkCacheGlobal->enmPolicy = PDMBLKCACHEPOLICY_ARC;
+        else
+        {
+            rc = VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                            N_("Configuration error: Unknown block cache policy \"%s\", valid values are \"2Q\" and \"ARC\""),
+                            szPolicy);
+            break;
+        }
+
+        rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheScanThreshold", &pBlkCacheGlobal->cbScanThreshold,
+                               RT_MAX(pBlkCacheGlobal->cbMax / 4, _1M));
+        AssertLogRelRCBreak(rc);
+        LogRel(("BlkCache: Using the %s replacement policy (cbMax=%u cShards=%u)\n",
+                pBlkCacheGlobal->enmPolicy == PDMBLKCACHEPOLICY_ARC ? "ARC" : "2Q",
+                pBlkCacheGlobal->cbMax, pBlkCacheGlobal->cShards));
 
         /** @todo r=aeichner: Experiment to find optimal default values */
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheCommitIntervalMs", &pBlkCacheGlobal->u32CommitTimeoutMs, 10000 /* 10sec */);
         AssertLogRelRCBreak(rc);
         rc = CFGMR3QueryU32Def(pCfgBlkCache, "CacheCommitThreshold", &pBlkCacheGlobal->cbCommitDirtyThreshold, pBlkCacheGlobal->cbMax / 2);
         AssertLogRelRCBreak(rc);
+
+        pBlkCacheGlobal->paShards = (PPDMBLKCACHESHARD)RTMemAllocZ(pBlkCacheGlobal->cShards * sizeof(PDMBLKCACHESHARD));
+        if (!pBlkCacheGlobal->paShards)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+
+        /* Initialize the shards */
+        uint32_t iShard;
+        for (iShard = 0; iShard < pBlkCacheGlobal->cShards; iShard++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->paShards[iShard];
+
+            pShard->pCache               = pBlkCacheGlobal;
+            pShard->cbMax                = pBlkCacheGlobal->cbMax / pBlkCacheGlobal->cShards;
+            pShard->cbCached             = 0;
+            pShard->cbRecentlyUsedInMax  = (pShard->cbMax / 100) * 25; /* 25% of the buffer size */
+            pShard->cbRecentlyUsedOutMax = (pShard->cbMax / 100) * 50; /* 50% of the buffer size */
+            pShard->cbRecentlyUsedTarget = 0; /* ARC starts without a preference for recency. */
+            LogFlowFunc(("Shard %u: cbMax=%u cbRecentlyUsedInMax=%u cbRecentlyUsedOutMax=%u\n",
+                         iShard, pShard->cbMax, pShard->cbRecentlyUsedInMax, pShard->cbRecentlyUsedOutMax));
+
+            pShard->LruRecentlyUsedIn.pHead    = NULL;
+            pShard->LruRecentlyUsedIn.pTail    = NULL;
+            pShard->LruRecentlyUsedIn.cbCached = 0;
+
+            pShard->LruRecentlyUsedOut.pHead    = NULL;
+            pShard->LruRecentlyUsedOut.pTail    = NULL;
+            pShard->LruRecentlyUsedOut.cbCached = 0;
+
+            pShard->LruFrequentlyUsed.pHead    = NULL;
+            pShard->LruFrequentlyUsed.pTail    = NULL;
+            pShard->LruFrequentlyUsed.cbCached = 0;
+
+            pShard->LruFrequentlyUsedOut.pHead    = NULL;
+            pShard->LruFrequentlyUsedOut.pTail    = NULL;
+            pShard->LruFrequentlyUsedOut.cbCached = 0;
+
+            rc = RTCritSectInit(&pShard->CritSect);
+            if (RT_FAILURE(rc))
+                break;
+
+            STAMR3RegisterF(pVM, &pShard->cbMax, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Maximum shard size", "/PDM/BlkCache/Shard%u/cbMax", iShard);
+            STAMR3RegisterF(pVM, &pShard->cbCached, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Currently used shard memory", "/PDM/BlkCache/Shard%u/cbCached", iShard);
+            STAMR3RegisterF(pVM, &pShard->LruRecentlyUsedIn.cbCached, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in MRU list", "/PDM/BlkCache/Shard%u/cbCachedMruIn", iShard);
+            STAMR3RegisterF(pVM, &pShard->LruRecentlyUsedOut.cbCached, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in FRU list", "/PDM/BlkCache/Shard%u/cbCachedMruOut", iShard);
+            STAMR3RegisterF(pVM, &pShard->LruFrequentlyUsed.cbCached, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes cached in FRU ghost list", "/PDM/BlkCache/Shard%u/cbCachedFru", iShard);
+            STAMR3RegisterF(pVM, &pShard->LruFrequentlyUsedOut.cbCached, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes in the FRU ghost list (ARC only)", "/PDM/BlkCache/Shard%u/cbCachedFruOut", iShard);
+            STAMR3RegisterF(pVM, &pShard->cbRecentlyUsedTarget, STAMTYPE_U32, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Adaptive target size of the MRU list (ARC only)", "/PDM/BlkCache/Shard%u/cbMruTarget", iShard);
+#ifdef VBOX_WITH_STATISTICS
+            STAMR3RegisterF(pVM, &pShard->StatEvicted, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
+                            "Number of bytes evicted from the shard", "/PDM/BlkCache/Shard%u/Evicted", iShard);
+#endif
+        }
+
+        if (RT_FAILURE(rc))
+        {
+            while (iShard-- > 0)
+                RTCritSectDelete(&pBlkCacheGlobal->paShards[iShard].CritSect);
+            RTMemFree(pBlkCacheGlobal->paShards);
+            pBlkCacheGlobal->paShards = NULL;
+        }
     } while (0);
 
     if (RT_SUCCESS(rc))
@@ -1046,28 +1517,17 @@ int pdmR3BlkCacheInit(PVM pVM)
                        "/PDM/BlkCache/cbMax",
                        STAMUNIT_BYTES,
                        "Maximum cache size");
-        STAMR3Register(pVM, &pBlkCacheGlobal->cbCached,
+        STAMR3Register(pVM, (void *)&pBlkCacheGlobal->cbCached,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/cbCached",
                        STAMUNIT_BYTES,
                        "Currently used cache");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedIn.cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedMruIn",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in MRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruRecentlyUsedOut.cbCached,
-                       STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedMruOut",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in FRU list");
-        STAMR3Register(pVM, &pBlkCacheGlobal->LruFrequentlyUsed.cbCached,
+        STAMR3Register(pVM, &pBlkCacheGlobal->cShards,
                        STAMTYPE_U32, STAMVISIBILITY_ALWAYS,
-                       "/PDM/BlkCache/cbCachedFru",
-                       STAMUNIT_BYTES,
-                       "Number of bytes cached in FRU ghost list");
+                       "/PDM/BlkCache/cShards",
+                       STAMUNIT_COUNT,
+                       "Number of cache shards");
 
-#ifdef VBOX_WITH_STATISTICS
         STAMR3Register(pVM, &pBlkCacheGlobal->cHits,
                        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/CacheHits",
@@ -1080,6 +1540,20 @@ int pdmR3BlkCacheInit(PVM pVM)
                        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/CacheMisses",
                        STAMUNIT_COUNT, "Number of misses when accessing the cache");
+        STAMR3Register(pVM, &pBlkCacheGlobal->StatGhostHitsRecent,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       "/PDM/BlkCache/GhostHitsRecent",
+                       STAMUNIT_COUNT, "Number of accesses to evicted entries from the MRU list");
+        STAMR3Register(pVM, &pBlkCacheGlobal->StatGhostHitsFrequent,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       "/PDM/BlkCache/GhostHitsFrequent",
+                       STAMUNIT_COUNT, "Number of accesses to evicted entries from the FRU list");
+        STAMR3Register(pVM, &pBlkCacheGlobal->StatScanEntries,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       "/PDM/BlkCache/ScanEntries",
+                       STAMUNIT_COUNT, "Number of entries created by sequential scans inserted as eviction candidates");
+
+#ifdef VBOX_WITH_STATISTICS
         STAMR3Register(pVM, &pBlkCacheGlobal->StatRead,
                        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/CacheRead",
@@ -1104,16 +1578,32 @@ int pdmR3BlkCacheInit(PVM pVM)
                        STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
                        "/PDM/BlkCache/CacheBuffersReused",
                        STAMUNIT_COUNT, "Number of times a buffer could be reused");
+        STAMR3Register(pVM, &pBlkCacheGlobal->StatCommitsBackground,
+                       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS,
+                       "/PDM/BlkCache/CommitsBackground",
+                       STAMUNIT_COUNT, "Number of commits done by the commit thread");
 #endif
 
         /* Initialize the critical section */
         rc = RTCritSectInit(&pBlkCacheGlobal->CritSect);
+        if (RT_FAILURE(rc))
+        {
+            for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+                RTCritSectDelete(&pBlkCacheGlobal->paShards[i].CritSect);
+            RTMemFree(pBlkCacheGlobal->paShards);
+        }
     }
 
     if (RT_SUCCESS(rc))
     {
-        /* Create the commit timer */
-        if (pBlkCacheGlobal->u32CommitTimeoutMs > 0)
+        /* Create the commit thread and the commit timer */
+        rc = RTSemEventCreate(&pBlkCacheGlobal->hEvtCommit);
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreate(&pBlkCacheGlobal->hThreadCommit, pdmBlkCacheCommitThread, pBlkCacheGlobal,
+                                0, RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "BlkCacheCommit");
+
+        if (   RT_SUCCESS(rc)
+            && pBlkCacheGlobal->u32CommitTimeoutMs > 0)
             rc = TMR3TimerCreateInternal(pVM, TMCLOCK_REAL,
                                          pdmBlkCacheCommitTimerCallback,
                                          pBlkCacheGlobal,
@@ -1129,7 +1619,8 @@ int pdmR3BlkCacheInit(PVM pVM)
                                        NULL, pdmR3BlkCacheLoadExec, NULL);
             if (RT_SUCCESS(rc))
             {
-                LogRel(("BlkCache: Cache successfully initialised. Cache size is %u bytes\n", pBlkCacheGlobal->cbMax));
+                LogRel(("BlkCache: Cache successfully initialised. Cache size is %u bytes in %u shards\n",
+                        pBlkCacheGlobal->cbMax, pBlkCacheGlobal->cShards));
                 LogRel(("BlkCache: Cache commit interval is %u ms\n", pBlkCacheGlobal->u32CommitTimeoutMs));
                 LogRel(("BlkCache: Cache commit threshold is %u bytes\n", pBlkCacheGlobal->cbCommitDirtyThreshold));
                 pUVM->pdm.s.pBlkCacheGlobal = pBlkCacheGlobal;
@@ -1137,6 +1628,10 @@ int pdmR3BlkCacheInit(PVM pVM)
             }
         }
 
+        pdmBlkCacheCommitThreadStop(pBlkCacheGlobal);
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+            RTCritSectDelete(&pBlkCacheGlobal->paShards[i].CritSect);
+        RTMemFree(pBlkCacheGlobal->paShards);
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
     }
 
@@ -1153,17 +1648,30 @@ void pdmR3BlkCacheTerm(PVM pVM)
 
     if (pBlkCacheGlobal)
     {
+        /* The commit thread must not touch the cache anymore. */
+        pdmBlkCacheCommitThreadStop(pBlkCacheGlobal);
+
         /* Make sure no one else uses the cache now */
         pdmBlkCacheLockEnter(pBlkCacheGlobal);
 
         /* Cleanup deleting all cache entries waiting for in progress entries to finish. */
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedIn);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruRecentlyUsedOut);
-        pdmBlkCacheDestroyList(&pBlkCacheGlobal->LruFrequentlyUsed);
+        for (uint32_t i = 0; i < pBlkCacheGlobal->cShards; i++)
+        {
+            PPDMBLKCACHESHARD pShard = &pBlkCacheGlobal->paShards[i];
+
+            pdmBlkCacheShardLockEnter(pShard);
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedIn);
+            pdmBlkCacheDestroyList(&pShard->LruRecentlyUsedOut);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsed);
+            pdmBlkCacheDestroyList(&pShard->LruFrequentlyUsedOut);
+            RTCritSectLeave(&pShard->CritSect); /* The lists are gone, skip validation. */
+            RTCritSectDelete(&pShard->CritSect);
+        }
 
         pdmBlkCacheLockLeave(pBlkCacheGlobal);
 
         RTCritSectDelete(&pBlkCacheGlobal->CritSect);
+        RTMemFree(pBlkCacheGlobal->paShards);
         RTMemFree(pBlkCacheGlobal);
         pVM->pUVM->pdm.s.pBlkCacheGlobal = NULL;
     }
@@ -1179,7 +1687,7 @@ int pdmR3BlkCacheResume(PVM pVM)
         && ASMAtomicXchgBool(&pBlkCacheGlobal->fIoErrorVmSuspended, false))
     {
         /* The VM was suspended because of an I/O error, commit all dirty entries. */
-        pdmBlkCacheCommitDirtyEntries(pBlkCacheGlobal);
+        pdmBlkCacheCommitDirtyEntriesAsync(pBlkCacheGlobal);
     }
 
     return VINF_SUCCESS;
@@ -1214,6 +1722,7 @@ static int pdmR3BlkCacheRetain(PVM pVM, PPPDMBLKCACHE ppBlkCache, const char *pc
         {
             pBlkCache->fSuspended = false;
             pBlkCache->pCache = pBlkCacheGlobal;
+            pBlkCache->uShardSeed = pBlkCacheGlobal->uShardSeedNext++;
             RTListInit(&pBlkCache->ListDirtyNotCommitted);
 
             rc = RTSpinlockCreate(&pBlkCache->LockList, RTSPINLOCK_FLAGS_INTERRUPT_UNSAFE, "pdmR3BlkCacheRetain");
@@ -1376,6 +1885,7 @@ static int pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *pvUser)
 {
     PPDMBLKCACHEENTRY  pEntry = (PPDMBLKCACHEENTRY)pNode;
     PPDMBLKCACHEGLOBAL pCache = (PPDMBLKCACHEGLOBAL)pvUser;
+    PPDMBLKCACHESHARD  pShard = pEntry->pShard;
     PPDMBLKCACHE pBlkCache = pEntry->pBlkCache;
 
     while (ASMAtomicReadU32(&pEntry->fFlags) & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS)
@@ -1383,12 +1893,12 @@ static int pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *pvUser)
         /* Leave the locks to let the I/O thread make progress but reference the entry to prevent eviction. */
         pdmBlkCacheEntryRef(pEntry);
         RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheShardLockLeaveAll(pCache);
 
         RTThreadSleep(250);
 
         /* Re-enter all locks */
-        pdmBlkCacheLockEnter(pCache);
+        pdmBlkCacheShardLockEnterAll(pCache);
         RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
         pdmBlkCacheEntryRelease(pEntry);
     }
@@ -1396,13 +1906,13 @@ static int pdmBlkCacheEntryDestroy(PAVLRU64NODECORE pNode, void *pvUser)
     AssertMsg(!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS),
                 ("Entry is dirty and/or still in progress fFlags=%#x\n", pEntry->fFlags));
 
-    bool fUpdateCache =    pEntry->pList == &pCache->LruFrequentlyUsed
-                        || pEntry->pList == &pCache->LruRecentlyUsedIn;
+    bool fUpdateCache =    pEntry->pList == &pShard->LruFrequentlyUsed
+                        || pEntry->pList == &pShard->LruRecentlyUsedIn;
 
     pdmBlkCacheEntryRemoveFromList(pEntry);
 
     if (fUpdateCache)
-        pdmBlkCacheSub(pCache, pEntry->cbData);
+        pdmBlkCacheSub(pShard, pEntry->cbData);
 
     RTMemPageFree(pEntry->pbData, pEntry->cbData);
     RTMemFree(pEntry);
@@ -1430,9 +1940,11 @@ VMMR3DECL(void) PDMR3BlkCacheRelease(PPDMBLKCACHE pBlkCache)
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
     pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheShardLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
+    pdmBlkCacheShardLockLeaveAll(pCache);
 
     RTSpinlockDestroy(pBlkCache->LockList);
 
@@ -1617,6 +2129,7 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryAlloc(PPDMBLKCACHE pBlkCache,
     pEntryNew->Core.Key      = off;
     pEntryNew->Core.KeyLast  = off + cbData - 1;
     pEntryNew->pBlkCache     = pBlkCache;
+    pEntryNew->pShard        = pdmBlkCacheShardGet(pBlkCache, off);
     pEntryNew->fFlags        = 0;
     pEntryNew->cRefs         = 1; /* We are using it now. */
     pEntryNew->pList         = NULL;
@@ -1819,12 +2332,20 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
     *pcbData = pdmBlkCacheEntryBoundariesCalc(pBlkCache, off, (uint32_t)cb, &cbEntry);
     AssertReturn(cb <= UINT32_MAX, NULL);
 
-    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
-    pdmBlkCacheLockEnter(pCache);
+    /* Track sequential access, races between concurrent requests only affect the heuristic. */
+    if (off == pBlkCache->offSeqNext)
+        pBlkCache->cbSeqRun += *pcbData;
+    else
+        pBlkCache->cbSeqRun = *pcbData;
+    pBlkCache->offSeqNext = off + *pcbData;
+
+    /* The entry is accounted to the shard its start offset maps to. */
+    PPDMBLKCACHESHARD pShard = pdmBlkCacheShardGet(pBlkCache, off);
+    pdmBlkCacheShardLockEnter(pShard);
 
     PPDMBLKCACHEENTRY pEntryNew = NULL;
     uint8_t          *pbBuffer  = NULL;
-    bool fEnough = pdmBlkCacheReclaim(pCache, cbEntry, true, &pbBuffer);
+    bool fEnough = pdmBlkCacheReclaim(pShard, cbEntry, true, &pbBuffer);
     if (fEnough)
     {
         LogFlow(("Evicted enough bytes (%u requested). Creating new cache entry\n", cbEntry));
@@ -1832,9 +2353,24 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
         pEntryNew = pdmBlkCacheEntryAlloc(pBlkCache, off, cbEntry, pbBuffer);
         if (RT_LIKELY(pEntryNew))
         {
-            pdmBlkCacheEntryAddToList(&pCache->LruRecentlyUsedIn, pEntryNew);
-            pdmBlkCacheAdd(pCache, cbEntry);
-            pdmBlkCacheLockLeave(pCache);
+            Assert(pEntryNew->pShard == pShard);
+
+            /*
+             * Sequential scans would flush the frequently used list. With ARC
+             * data of long sequential runs is inserted at the tail of the recently
+             * used list so it is the first to go.
+             */
+            if (   pBlkCache->pCache->enmPolicy == PDMBLKCACHEPOLICY_ARC
+                && pBlkCache->pCache->cbScanThreshold
+                && pBlkCache->cbSeqRun >= pBlkCache->pCache->cbScanThreshold)
+            {
+                pdmBlkCacheEntryAddToListTail(&pShard->LruRecentlyUsedIn, pEntryNew);
+                STAM_REL_COUNTER_INC(&pBlkCache->pCache->StatScanEntries);
+            }
+            else
+                pdmBlkCacheEntryAddToList(&pShard->LruRecentlyUsedIn, pEntryNew);
+            pdmBlkCacheAdd(pShard, cbEntry);
+            pdmBlkCacheShardLockLeave(pShard);
 
             pdmBlkCacheInsertEntry(pBlkCache, pEntryNew);
 
@@ -1843,10 +2379,10 @@ static PPDMBLKCACHEENTRY pdmBlkCacheEntryCreate(PPDMBLKCACHE pBlkCache,
                       ("Overflow in calculation off=%llu\n", off));
         }
         else
-            pdmBlkCacheLockLeave(pCache);
+            pdmBlkCacheShardLockLeave(pShard);
     }
     else
-        pdmBlkCacheLockLeave(pCache);
+        pdmBlkCacheShardLockLeave(pShard);
 
     return pEntryNew;
 }
@@ -1926,7 +2462,6 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                                  PCRTSGBUF pcSgBuf, size_t cbRead, void *pvUser)
 {
     int rc = VINF_SUCCESS;
-    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
     PPDMBLKCACHEENTRY  pEntry;
     PPDMBLKCACHEREQ    pReq;
 
@@ -1983,15 +2518,15 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
             cbRead  -= cbToRead;
 
             if (!cbRead)
-                STAM_COUNTER_INC(&pCache->cHits);
+                STAM_REL_COUNTER_INC(&pBlkCache->pCache->cHits);
             else
-                STAM_COUNTER_INC(&pCache->cPartialHits);
+                STAM_REL_COUNTER_INC(&pBlkCache->pCache->cPartialHits);
 
-            STAM_COUNTER_ADD(&pCache->StatRead, cbToRead);
+            STAM_COUNTER_ADD(&pBlkCache->pCache->StatRead, cbToRead);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            if (   (pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pEntry->pShard->LruFrequentlyUsed))
             {
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
                                                               PDMBLKCACHE_ENTRY_IO_IN_PROGRESS,
@@ -2010,12 +2545,7 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                 }
 
                 /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                pdmBlkCacheEntryTouch(pEntry);
                 /* Release the entry */
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2025,16 +2555,17 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
 
                 LogFlow(("Fetching data for ghost entry %#p from file\n", pEntry));
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pEntry->pShard);
+                pdmBlkCacheGhostHit(pEntry->pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pEntry->pShard, pEntry->cbData, true, &pbBuffer);
 
                 /* Move the entry to Am and fetch it to the cache. */
                 if (fEnough)
                 {
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryAddToList(&pEntry->pShard->LruFrequentlyUsed, pEntry);
+                    pdmBlkCacheAdd(pEntry->pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2052,12 +2583,12 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
                 else
                 {
                     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
-                    STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_START(&pBlkCache->pCache->StatTreeRemove, Cache);
                     RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
-                    STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_STOP(&pBlkCache->pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                     RTMemFree(pEntry);
 
@@ -2080,9 +2611,9 @@ VMMR3DECL(int) PDMR3BlkCacheRead(PPDMBLKCACHE pBlkCache, uint64_t off,
             if (pEntryNew)
             {
                 if (!cbRead)
-                    STAM_COUNTER_INC(&pCache->cMisses);
+                    STAM_REL_COUNTER_INC(&pBlkCache->pCache->cMisses);
                 else
-                    STAM_COUNTER_INC(&pCache->cPartialHits);
+                    STAM_REL_COUNTER_INC(&pBlkCache->pCache->cPartialHits);
 
                 pdmBlkCacheEntryWaitersAdd(pEntryNew, pReq,
                                            &SgBuf,
@@ -2183,15 +2714,15 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
             cbWrite  -= cbToWrite;
 
             if (!cbWrite)
-                STAM_COUNTER_INC(&pCache->cHits);
+                STAM_REL_COUNTER_INC(&pCache->cHits);
             else
-                STAM_COUNTER_INC(&pCache->cPartialHits);
+                STAM_REL_COUNTER_INC(&pCache->cPartialHits);
 
             STAM_COUNTER_ADD(&pCache->StatWritten, cbToWrite);
 
             /* Ghost lists contain no data. */
-            if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                || (pEntry->pList == &pCache->LruFrequentlyUsed))
+            if (   (pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn)
+                || (pEntry->pList == &pEntry->pShard->LruFrequentlyUsed))
             {
                 /* Check if the entry is dirty. */
                 if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2235,17 +2766,12 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
 
                         bool fCommit = pdmBlkCacheAddDirtyEntry(pBlkCache, pEntry);
                         if (fCommit)
-                            pdmBlkCacheCommitDirtyEntries(pCache);
+                            pdmBlkCacheCommitDirtyEntriesAsync(pCache);
                     }
                 } /* Dirty bit not set */
 
                 /* Move this entry to the top position */
-                if (pEntry->pList == &pCache->LruFrequentlyUsed)
-                {
-                    pdmBlkCacheLockEnter(pCache);
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheLockLeave(pCache);
-                }
+                pdmBlkCacheEntryTouch(pEntry);
 
                 pdmBlkCacheEntryRelease(pEntry);
             }
@@ -2253,16 +2779,17 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
             {
                 uint8_t *pbBuffer = NULL;
 
-                pdmBlkCacheLockEnter(pCache);
+                pdmBlkCacheShardLockEnter(pEntry->pShard);
+                pdmBlkCacheGhostHit(pEntry->pShard, pEntry);
                 pdmBlkCacheEntryRemoveFromList(pEntry); /* Remove it before we remove data, otherwise it may get freed when evicting data. */
-                bool fEnough = pdmBlkCacheReclaim(pCache, pEntry->cbData, true, &pbBuffer);
+                bool fEnough = pdmBlkCacheReclaim(pEntry->pShard, pEntry->cbData, true, &pbBuffer);
 
                 if (fEnough)
                 {
                     /* Move the entry to Am and fetch it to the cache. */
-                    pdmBlkCacheEntryAddToList(&pCache->LruFrequentlyUsed, pEntry);
-                    pdmBlkCacheAdd(pCache, pEntry->cbData);
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheEntryAddToList(&pEntry->pShard->LruFrequentlyUsed, pEntry);
+                    pdmBlkCacheAdd(pEntry->pShard, pEntry->cbData);
+                    pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                     if (pbBuffer)
                         pEntry->pbData = pbBuffer;
@@ -2287,7 +2814,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
                     STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                     RTMemFree(pEntry);
                     pdmBlkCacheRequestPassthrough(pBlkCache, pReq,
@@ -2312,7 +2839,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
             {
                 uint64_t offDiff = off - pEntryNew->Core.Key;
 
-                STAM_COUNTER_INC(&pCache->cHits);
+                STAM_REL_COUNTER_INC(&pCache->cHits);
 
                 /*
                  * Check if it is possible to just write the data without waiting
@@ -2324,7 +2851,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
 
                     bool fCommit = pdmBlkCacheAddDirtyEntry(pBlkCache, pEntryNew);
                     if (fCommit)
-                        pdmBlkCacheCommitDirtyEntries(pCache);
+                        pdmBlkCacheCommitDirtyEntriesAsync(pCache);
                     STAM_COUNTER_ADD(&pCache->StatWritten, cbToWrite);
                 }
                 else
@@ -2347,7 +2874,7 @@ VMMR3DECL(int) PDMR3BlkCacheWrite(PPDMBLKCACHE pBlkCache, uint64_t off,
                  */
                 LogFlow(("Couldn't evict %u bytes from the cache. Remaining request will be passed through\n", cbToWrite));
 
-                STAM_COUNTER_INC(&pCache->cMisses);
+                STAM_REL_COUNTER_INC(&pCache->cMisses);
 
                 pdmBlkCacheRequestPassthrough(pBlkCache, pReq,
                                               &SgBuf, off, cbToWrite,
@@ -2396,7 +2923,6 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                                     unsigned cRanges, void *pvUser)
 {
     int rc = VINF_SUCCESS;
-    PPDMBLKCACHEGLOBAL pCache = pBlkCache->pCache;
     PPDMBLKCACHEENTRY pEntry;
     PPDMBLKCACHEREQ pReq;
 
@@ -2439,8 +2965,8 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 cbThisDiscard = RT_MIN(pEntry->cbData - offDiff, cbLeft);
 
                 /* Ghost lists contain no data. */
-                if (   (pEntry->pList == &pCache->LruRecentlyUsedIn)
-                    || (pEntry->pList == &pCache->LruFrequentlyUsed))
+                if (   (pEntry->pList == &pEntry->pShard->LruRecentlyUsedIn)
+                    || (pEntry->pList == &pEntry->pShard->LruFrequentlyUsed))
                 {
                     /* Check if the entry is dirty. */
                     if (pdmBlkCacheEntryFlagIsSetClearAcquireLock(pBlkCache, pEntry,
@@ -2450,14 +2976,14 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         /* If it is dirty but not yet in progress remove it. */
                         if (!(pEntry->fFlags & PDMBLKCACHE_ENTRY_IO_IN_PROGRESS))
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pEntry->pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
 
-                            STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_START(&pBlkCache->pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
-                            STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_STOP(&pBlkCache->pCache->StatTreeRemove, Cache);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2496,16 +3022,16 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                         }
                         else /* I/O in progress flag not set */
                         {
-                            pdmBlkCacheLockEnter(pCache);
+                            pdmBlkCacheShardLockEnter(pEntry->pShard);
                             pdmBlkCacheEntryRemoveFromList(pEntry);
 
                             RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
-                            STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_START(&pBlkCache->pCache->StatTreeRemove, Cache);
                             RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
-                            STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                            STAM_PROFILE_ADV_STOP(&pBlkCache->pCache->StatTreeRemove, Cache);
                             RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                            pdmBlkCacheLockLeave(pCache);
+                            pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                             RTMemFree(pEntry);
                         }
@@ -2513,16 +3039,16 @@ VMMR3DECL(int) PDMR3BlkCacheDiscard(PPDMBLKCACHE pBlkCache, PCRTRANGE paRanges,
                 }
                 else /* Entry is on the ghost list just remove cache entry. */
                 {
-                    pdmBlkCacheLockEnter(pCache);
+                    pdmBlkCacheShardLockEnter(pEntry->pShard);
                     pdmBlkCacheEntryRemoveFromList(pEntry);
 
                     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
-                    STAM_PROFILE_ADV_START(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_START(&pBlkCache->pCache->StatTreeRemove, Cache);
                     RTAvlrU64Remove(pBlkCache->pTree, pEntry->Core.Key);
-                    STAM_PROFILE_ADV_STOP(&pCache->StatTreeRemove, Cache);
+                    STAM_PROFILE_ADV_STOP(&pBlkCache->pCache->StatTreeRemove, Cache);
                     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
 
-                    pdmBlkCacheLockLeave(pCache);
+                    pdmBlkCacheShardLockLeave(pEntry->pShard);
 
                     RTMemFree(pEntry);
                 }
@@ -2654,7 +3180,7 @@ static void pdmBlkCacheIoXferCompleteEntry(PPDMBLKCACHE pBlkCache, PPDMBLKCACHEI
     pdmBlkCacheEntryRelease(pEntry);
 
     if (fCommit)
-        pdmBlkCacheCommitDirtyEntries(pCache);
+        pdmBlkCacheCommitDirtyEntriesAsync(pCache);
 
     /* Complete waiters now. */
     while (pComplete)
@@ -2715,6 +3241,13 @@ VMMR3DECL(int) PDMR3BlkCacheSuspend(PPDMBLKCACHE pBlkCache)
         pdmBlkCacheCommit(pBlkCache); /* Can issue new I/O requests. */
     ASMAtomicXchgBool(&pBlkCache->fSuspended, true);
 
+    /*
+     * The commit thread holds the cache lock while committing, wait for it to
+     * finish the current pass. Later passes skip this endpoint.
+     */
+    pdmBlkCacheLockEnter(pBlkCache->pCache);
+    pdmBlkCacheLockLeave(pBlkCache->pCache);
+
     /* Wait for all I/O to complete. */
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     rc = RTAvlrU64DoWithAll(pBlkCache->pTree, true, pdmBlkCacheEntryQuiesce, NULL);
@@ -2750,9 +3283,11 @@ VMMR3DECL(int) PDMR3BlkCacheClear(PPDMBLKCACHE pBlkCache)
 
     /* Make sure nobody is accessing the cache while we delete the tree. */
     pdmBlkCacheLockEnter(pCache);
+    pdmBlkCacheShardLockEnterAll(pCache);
     RTSemRWRequestWrite(pBlkCache->SemRWEntries, RT_INDEFINITE_WAIT);
     RTAvlrU64Destroy(pBlkCache->pTree, pdmBlkCacheEntryDestroy, pCache);
     RTSemRWReleaseWrite(pBlkCache->SemRWEntries);
+    pdmBlkCacheShardLockLeaveAll(pCache);
 
     pdmBlkCacheLockLeave(pCache);
     return rc;
@@ -2601,6 +2601,10 @@ VMMR3_INT_DECL(void) PGMR3MemSetup(PVM pVM, bool fAtReset)
     {
         pgmLock(pVM);
 
+        /* Some pages are zeroed in place, so the incremental save tracking
+           would miss the change. */
+        pgmR3IncrSaveStop(pVM);
+
         int rc = pgmR3PhysRamZeroAll(pVM);
         AssertReleaseRC(rc);
 
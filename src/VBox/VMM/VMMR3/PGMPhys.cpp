@@ -1212,6 +1212,10 @@ VMMR3DECL(int) PGMR3PhysWriteProtectRAM(PVM pVM)
 {
     VM_ASSERT_EMT_RETURN(pVM, VERR_VM_THREAD_NOT_EMT);
 
+    /* FTM takes over the write monitoring, so stop tracking changes for
+       incremental saved states (PGMR3SaveIncrementalBegin refuses from now on). */
+    pgmR3IncrSaveStop(pVM);
+
     int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PhysWriteProtectRAMRendezvous, NULL);
     AssertRC(rc);
     return rc;
@@ -37,6 +37,8 @@
 #include <iprt/assert.h>
 #include <iprt/crc.h>
 #include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/rand.h>
 #include <iprt/sha.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
@@ -46,7 +48,9 @@
 *   Defined Constants And Macros                                               *
 *******************************************************************************/
 /** Saved state data unit version.  */
-#define PGM_SAVED_STATE_VERSION                 14
+#define PGM_SAVED_STATE_VERSION                 15
+/** Saved state data unit version before the incremental saved state info. */
+#define PGM_SAVED_STATE_VERSION_PRE_INCREMENTAL 14
 /** Saved state data unit version before the PAE PDPE registers. */
 #define PGM_SAVED_STATE_VERSION_PRE_PAE         13
 /** Saved state data unit version after this includes ballooned page flags in
@@ -103,6 +107,10 @@
 /** The CRC-32 for a zero half page. */
 #define PGM_STATE_CRC32_ZERO_HALF_PAGE  UINT32_C(0xf1e8ba9e)
 
+/** The max number of parent saved states we're willing to follow when
+ * restoring an incremental saved state. */
+#define PGM_INCR_SAVE_MAX_DEPTH         32
+
 
 
 /** @name Old Page types used in older saved states.
@@ -148,6 +156,23 @@ typedef struct
     PGMMODE                         enmGuestMode;
 } PGMOLD;
 
+/** Parent saved state loading context (pgmR3LoadParentExec). */
+typedef struct PGMLOADPARENT
+{
+    /** Pointer to the VM. */
+    PVM                             pVM;
+    /** The ID the parent saved state is expected to have. */
+    uint64_t                        idExpected;
+    /** The depth of this parent in the chain (1 for the immediate parent). */
+    uint32_t                        cDepth;
+    /** Set if the parent is a live saved state (i.e. had a pass 0). */
+    bool                            fLiveSave;
+    /** Set if the parent saved state ID has been checked. */
+    bool                            fIdChecked;
+} PGMLOADPARENT;
+/** Pointer to a parent saved state loading context. */
+typedef PGMLOADPARENT *PPGMLOADPARENT;
+
 
 /*******************************************************************************
 *   Global Variables                                                           *
@@ -1142,9 +1167,26 @@ static int pgmR3PrepRamPages(PVM pVM)
 #ifdef PGMLIVESAVERAMPAGE_WITH_CRC32
                                 paLSPages[iPage].u32Crc  = UINT32_MAX;
 #endif
+
+                                /* Take over the pages monitored for incremental
+                                   saving.  Those not written to since the parent
+                                   saved state need not be saved in a delta. */
+                                if (   PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED
+                                    || PGM_PAGE_IS_WRITTEN_TO(pPage))
+                                {
+                                    paLSPages[iPage].fWriteMonitored        = 1;
+                                    paLSPages[iPage].fWriteMonitoredJustNow = 1;
+                                    pVM->pgm.s.LiveSave.Ram.cMonitoredPages++;
+                                    if (   pVM->pgm.s.IncrSave.fDelta
+                                        && PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+                                        paLSPages[iPage].fDirty = 0;
+                                }
                             }
                             paLSPages[iPage].fIgnore     = 0;
-                            pVM->pgm.s.LiveSave.Ram.cDirtyPages++;
+                            if (paLSPages[iPage].fDirty)
+                                pVM->pgm.s.LiveSave.Ram.cDirtyPages++;
+                            else
+                                pVM->pgm.s.LiveSave.Ram.cReadyPages++;
                             break;
 
                         case PGMPAGETYPE_ROM_SHADOW:
@@ -1250,6 +1292,57 @@ static int pgmR3LoadRamConfig(PVM pVM, PSSMHANDLE pSSM)
     return VINF_SUCCESS;
 }
 
+
+/**
+ * Works out the incremental saved state parameters for a new save operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ */
+static int pgmR3IncrSavePrep(PVM pVM)
+{
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    if (pVM->pgm.s.IncrSave.fRequested)
+    {
+        pVM->pgm.s.IncrSave.idCurSave = RTRandU64() | 1;
+        pVM->pgm.s.IncrSave.fDelta    = pVM->pgm.s.IncrSave.pszParent != NULL;
+        if (   pVM->pgm.s.IncrSave.fDelta
+            && (   !pVM->pgm.s.IncrSave.fTracking
+                || !pVM->pgm.s.IncrSave.idLastSave))
+        {
+            pVM->pgm.s.IncrSave.fDelta = false;
+            rc = VERR_PGM_NO_INCREMENTAL_BASE;
+        }
+    }
+    else
+    {
+        pVM->pgm.s.IncrSave.idCurSave = 0;
+        pVM->pgm.s.IncrSave.fDelta    = false;
+    }
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * Saves the incremental saved state info.
+ *
+ * This is the ID of the saved state, and if it's a delta, the ID and path of
+ * the parent saved state which the unsaved RAM pages should be taken from.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pSSM                The saved state handle.
+ */
+static int pgmR3SaveIncrementalInfo(PVM pVM, PSSMHANDLE pSSM)
+{
+    bool const fDelta = pVM->pgm.s.IncrSave.fDelta;
+    SSMR3PutU64(pSSM, pVM->pgm.s.IncrSave.idCurSave);
+    SSMR3PutU64(pSSM, fDelta ? pVM->pgm.s.IncrSave.idLastSave : 0);
+    return SSMR3PutStrZ(pSSM, fDelta ? pVM->pgm.s.IncrSave.pszParent : "");
+}
+
 #ifdef PGMLIVESAVERAMPAGE_WITH_CRC32
 
 /**
@@ -1622,6 +1715,10 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                         }
                         if (PGM_PAGE_GET_TYPE(pCurPage) != PGMPAGETYPE_RAM)
                             continue;
+                        if (   !paLSPages
+                            && pVM->pgm.s.IncrSave.fDelta
+                            && PGM_PAGE_GET_STATE(pCurPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+                            continue; /* Unchanged since the parent saved state. */
                     }
 
                     /*
@@ -1824,6 +1921,103 @@ static void pgmR3DoneRamPages(PVM pVM)
 }
 
 
+/**
+ * Starts tracking RAM changes relative to the given saved state.
+ *
+ * All allocated RAM pages are write monitored so that a subsequent delta save
+ * can skip the ones still in the write monitored state.
+ *
+ * @param   pVM                 Pointer to the VM.
+ * @param   idSave              The ID of the saved state just written or
+ *                              restored.
+ */
+static void pgmR3IncrSaveArm(PVM pVM, uint64_t idSave)
+{
+    Assert(idSave);
+    pgmLock(pVM);
+    Assert(!pVM->pgm.s.LiveSave.fActive);
+    for (PPGMRAMRANGE pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
+    {
+        if (PGM_RAM_RANGE_IS_AD_HOC(pCur))
+            continue;
+        uint32_t const cPages = pCur->cb >> PAGE_SHIFT;
+        for (uint32_t iPage = 0; iPage < cPages; iPage++)
+        {
+            PPGMPAGE pPage = &pCur->aPages[iPage];
+            if (PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM)
+                continue;
+            if (PGM_PAGE_IS_WRITTEN_TO(pPage))
+            {
+                PGM_PAGE_CLEAR_WRITTEN_TO(pVM, pPage);
+                Assert(pVM->pgm.s.cWrittenToPages > 0);
+                pVM->pgm.s.cWrittenToPages--;
+            }
+            if (   PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED
+                && PGM_PAGE_GET_WRITE_LOCKS(pPage) == 0)
+                pgmPhysPageWriteMonitor(pVM, pPage, pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+        }
+    }
+    pVM->pgm.s.IncrSave.idLastSave         = idSave;
+    pVM->pgm.s.IncrSave.fTracking          = true;
+    pVM->pgm.s.fPhysWriteMonitoringEngaged = true;
+    pgmUnlock(pVM);
+
+    /* Make the monitoring effective. */
+    pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/);
+}
+
+
+/**
+ * Stops tracking RAM changes for incremental saved states.
+ *
+ * This must be called before anything modifies RAM pages behind the back of
+ * the write monitoring, like zeroing them at reset time.
+ *
+ * @param   pVM                 Pointer to the VM.
+ */
+void pgmR3IncrSaveStop(PVM pVM)
+{
+    pgmLock(pVM);
+    pVM->pgm.s.IncrSave.idLastSave = 0;
+    if (pVM->pgm.s.IncrSave.fTracking)
+    {
+        uint32_t cMonitoredPages = 0;
+        for (PPGMRAMRANGE pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
+        {
+            if (PGM_RAM_RANGE_IS_AD_HOC(pCur))
+                continue;
+            uint32_t iPage = pCur->cb >> PAGE_SHIFT;
+            while (iPage--)
+            {
+                PPGMPAGE pPage = &pCur->aPages[iPage];
+                if (PGM_PAGE_IS_WRITTEN_TO(pPage))
+                {
+                    PGM_PAGE_CLEAR_WRITTEN_TO(pVM, pPage);
+                    Assert(pVM->pgm.s.cWrittenToPages > 0);
+                    pVM->pgm.s.cWrittenToPages--;
+                }
+                if (PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+                {
+                    PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_ALLOCATED);
+                    cMonitoredPages++;
+                }
+            }
+        }
+
+        Assert(pVM->pgm.s.cMonitoredPages >= cMonitoredPages);
+        if (pVM->pgm.s.cMonitoredPages < cMonitoredPages)
+            pVM->pgm.s.cMonitoredPages = 0;
+        else
+            pVM->pgm.s.cMonitoredPages -= cMonitoredPages;
+
+        pVM->pgm.s.IncrSave.fTracking = false;
+        if (!pVM->pgm.s.LiveSave.fActive)
+            pVM->pgm.s.fPhysWriteMonitoringEngaged = false;
+    }
+    pgmUnlock(pVM);
+}
+
+
 /**
  * Execute a live save pass.
  *
@@ -1842,6 +2036,9 @@ static DECLCALLBACK(int) pgmR3LiveExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
     if (uPass == 0)
     {
         rc = pgmR3SaveRamConfig(pVM, pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = pgmR3SaveIncrementalInfo(pVM, pSSM);
         if (RT_FAILURE(rc))
             return rc;
         rc = pgmR3SaveRomRanges(pVM, pSSM);
@@ -2012,15 +2209,23 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
 static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
 {
     /*
-     * Indicate that we will be using the write monitoring.
+     * Indicate that we will be using the write monitoring.  The incremental
+     * saved state tracking is the one user we know how to take over from,
+     * pgmR3PrepRamPages picks up the pages it is monitoring.
      */
+    int rc = pgmR3IncrSavePrep(pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+
     pgmLock(pVM);
     /** @todo find a way of mediating this when more users are added. */
-    if (pVM->pgm.s.fPhysWriteMonitoringEngaged)
+    if (   pVM->pgm.s.fPhysWriteMonitoringEngaged
+        && !pVM->pgm.s.IncrSave.fTracking)
     {
         pgmUnlock(pVM);
         AssertLogRelFailedReturn(VERR_PGM_WRITE_MONITOR_ENGAGED);
     }
+    pVM->pgm.s.IncrSave.fTracking          = false;
     pVM->pgm.s.fPhysWriteMonitoringEngaged = true;
     pgmUnlock(pVM);
 
@@ -2045,7 +2250,7 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
     /*
      * Per page type.
      */
-    int rc = pgmR3PrepRomPages(pVM);
+    rc = pgmR3PrepRomPages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepMmio2Pages(pVM);
     if (RT_SUCCESS(rc))
@@ -2104,7 +2309,11 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
         }
         else
         {
-            rc = pgmR3SaveRamConfig(pVM, pSSM);
+            rc = pgmR3IncrSavePrep(pVM);
+            if (RT_SUCCESS(rc))
+                rc = pgmR3SaveRamConfig(pVM, pSSM);
+            if (RT_SUCCESS(rc))
+                rc = pgmR3SaveIncrementalInfo(pVM, pSSM);
             if (RT_SUCCESS(rc))
                 rc = pgmR3SaveRomRanges(pVM, pSSM);
             if (RT_SUCCESS(rc))
@@ -2138,7 +2347,8 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     /*
      * Do per page type cleanups first.
      */
-    if (pVM->pgm.s.LiveSave.fActive)
+    bool const fLiveSave = pVM->pgm.s.LiveSave.fActive;
+    if (fLiveSave)
     {
         pgmR3DoneRomPages(pVM);
         pgmR3DoneMmio2Pages(pVM);
@@ -2152,10 +2362,22 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     pVM->pgm.s.LiveSave.fActive = false;
     /** @todo this is blindly assuming that we're the only user of write
      *        monitoring. Fix this when more users are added. */
-    pVM->pgm.s.fPhysWriteMonitoringEngaged = false;
+    pVM->pgm.s.fPhysWriteMonitoringEngaged = pVM->pgm.s.IncrSave.fTracking;
     pgmUnlock(pVM);
 
-    NOREF(pSSM);
+    /*
+     * (Re-)start tracking RAM changes if this was an incremental save that
+     * succeeded.  The live save cleanup above has already disarmed it.
+     */
+    uint64_t const idCurSave = pVM->pgm.s.IncrSave.idCurSave;
+    pVM->pgm.s.IncrSave.idCurSave = 0;
+    pVM->pgm.s.IncrSave.fDelta    = false;
+    if (   idCurSave
+        && RT_SUCCESS(SSMR3HandleGetStatus(pSSM)))
+        pgmR3IncrSaveArm(pVM, idCurSave);
+    else if (fLiveSave)
+        pVM->pgm.s.IncrSave.idLastSave = 0;
+
     return VINF_SUCCESS;
 }
 
@@ -2170,10 +2392,14 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
 static DECLCALLBACK(int) pgmR3LoadPrep(PVM pVM, PSSMHANDLE pSSM)
 {
     /*
-     * Call the reset function to make sure all the memory is cleared.
+     * Stop tracking changes for incremental saving, the memory is about to be
+     * replaced.  Then call the reset function to make sure all the memory is
+     * cleared.
      */
+    pgmR3IncrSaveStop(pVM);
     PGMR3Reset(pVM);
-    pVM->pgm.s.LiveSave.fActive = false;
+    pVM->pgm.s.LiveSave.fActive   = false;
+    pVM->pgm.s.IncrSave.idLoaded  = 0;
     NOREF(pSSM);
     return VINF_SUCCESS;
 }
@@ -2985,6 +3211,130 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
 }
 
 
+static DECLCALLBACK(int) pgmR3LoadParentExec(PSSMHANDLE pSSM, void *pvUser, uint32_t uVersion, uint32_t uPass);
+
+
+/**
+ * Loads the incremental saved state info and applies the parent saved state
+ * if this is a delta.
+ *
+ * The parent is loaded directly into guest RAM before the caller proceeds to
+ * load the pages of this saved state on top of it.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pSSM                The saved state handle.
+ * @param   cDepth              The depth of the saved state in the chain, 0 for
+ *                              the one being restored.
+ * @param   pidSave             Where to return the ID of the saved state.
+ */
+static int pgmR3LoadIncrementalInfo(PVM pVM, PSSMHANDLE pSSM, uint32_t cDepth, uint64_t *pidSave)
+{
+    uint64_t idSave;
+    uint64_t idParent;
+    char     szParent[RTPATH_MAX];
+    SSMR3GetU64(pSSM, &idSave);
+    SSMR3GetU64(pSSM, &idParent);
+    int rc = SSMR3GetStrZ(pSSM, szParent, sizeof(szParent));
+    if (RT_FAILURE(rc))
+        return rc;
+    *pidSave = idSave;
+    if (!idParent)
+        return VINF_SUCCESS;
+
+    if (cDepth >= PGM_INCR_SAVE_MAX_DEPTH)
+        return SSMR3SetLoadError(pSSM, VERR_PGM_INCREMENTAL_CHAIN_TOO_LONG, RT_SRC_POS,
+                                 N_("More than %u incremental saved states in the chain ending with '%s'"),
+                                 PGM_INCR_SAVE_MAX_DEPTH, szParent);
+
+    LogRel(("PGM: Loading parent saved state '%s' (id=%RX64 depth=%u)\n", szParent, idParent, cDepth + 1));
+    PGMLOADPARENT Parent;
+    Parent.pVM        = pVM;
+    Parent.idExpected = idParent;
+    Parent.cDepth     = cDepth + 1;
+    Parent.fLiveSave  = false;
+    Parent.fIdChecked = false;
+    rc = SSMR3LoadUnitFromFile(pVM, szParent, "pgm", 1, pgmR3LoadParentExec, &Parent);
+    if (RT_SUCCESS(rc) && !Parent.fIdChecked)
+        rc = VERR_SSM_LOAD_CONFIG_MISMATCH;
+    if (rc == VERR_SSM_LOAD_CONFIG_MISMATCH)
+        return SSMR3SetLoadError(pSSM, rc, RT_SRC_POS,
+                                 N_("The saved state '%s' is not the parent this saved state was made relative to (expected id %RX64)"),
+                                 szParent, idParent);
+    if (RT_FAILURE(rc))
+        return SSMR3SetLoadError(pSSM, rc, RT_SRC_POS, N_("Failed to load the parent saved state '%s'"), szParent);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Skips the basic PGM data at the start of the final pass of a parent saved
+ * state.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pSSM                The parent saved state handle.
+ */
+static int pgmR3LoadParentSkipBasicData(PVM pVM, PSSMHANDLE pSSM)
+{
+    void *pvScratch = RTMemTmpAllocZ(RT_MAX(sizeof(PGM), sizeof(PGMCPU)));
+    if (!pvScratch)
+        return VERR_NO_TMP_MEMORY;
+
+    int rc = SSMR3GetStruct(pSSM, pvScratch, &s_aPGMFields[0]);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus && RT_SUCCESS(rc); idCpu++)
+        rc = SSMR3GetStruct(pSSM, pvScratch, &s_aPGMCpuFields[0]);
+
+    RTMemTmpFree(pvScratch);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMEXTLOADEXEC,
+ *      Loads the RAM of a parent saved state.}
+ */
+static DECLCALLBACK(int) pgmR3LoadParentExec(PSSMHANDLE pSSM, void *pvUser, uint32_t uVersion, uint32_t uPass)
+{
+    PPGMLOADPARENT pParent = (PPGMLOADPARENT)pvUser;
+    PVM            pVM     = pParent->pVM;
+
+    /* Only saved states with incremental info can be parents. */
+    if (uVersion != PGM_SAVED_STATE_VERSION)
+        return VERR_SSM_LOAD_CONFIG_MISMATCH;
+
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    if (uPass == SSM_PASS_FINAL)
+        rc = pgmR3LoadParentSkipBasicData(pVM, pSSM);
+    if (   RT_SUCCESS(rc)
+        && (   uPass == 0
+            || (uPass == SSM_PASS_FINAL && !pParent->fLiveSave)))
+    {
+        pParent->fLiveSave = uPass == 0;
+
+        uint64_t idSave = 0;
+        rc = pgmR3LoadRamConfig(pVM, pSSM);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LoadIncrementalInfo(pVM, pSSM, pParent->cDepth, &idSave);
+        if (RT_SUCCESS(rc) && idSave != pParent->idExpected)
+        {
+            LogRel(("PGM: Parent saved state mismatch: id=%RX64 expected %RX64\n", idSave, pParent->idExpected));
+            rc = VERR_SSM_LOAD_CONFIG_MISMATCH;
+        }
+        pParent->fIdChecked = RT_SUCCESS(rc);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LoadRomRanges(pVM, pSSM);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LoadMmio2Ranges(pVM, pSSM);
+    }
+    if (RT_SUCCESS(rc))
+        rc = pgmR3LoadMemory(pVM, pSSM, uVersion, uPass);
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
 /**
  * Worker for pgmR3Load.
  *
@@ -3119,6 +3469,12 @@ static int pgmR3LoadFinalLocked(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion)
                 if (RT_FAILURE(rc))
                     return rc;
             }
+            if (uVersion > PGM_SAVED_STATE_VERSION_PRE_INCREMENTAL)
+            {
+                rc = pgmR3LoadIncrementalInfo(pVM, pSSM, 0 /*cDepth*/, &pVM->pgm.s.IncrSave.idLoaded);
+                if (RT_FAILURE(rc))
+                    return rc;
+            }
             rc = pgmR3LoadRomRanges(pVM, pSSM);
             if (RT_FAILURE(rc))
                 return rc;
@@ -3161,11 +3517,13 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
      */
     if (   (   uPass != SSM_PASS_FINAL
             && uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_INCREMENTAL
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
             && uVersion != PGM_SAVED_STATE_VERSION_NO_RAM_CFG)
         || (   uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_INCREMENTAL
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
@@ -3196,6 +3554,8 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
                 rc = pgmR3LoadRamConfig(pVM, pSSM);
             else
                 rc = VINF_SUCCESS;
+            if (RT_SUCCESS(rc) && uVersion > PGM_SAVED_STATE_VERSION_PRE_INCREMENTAL)
+                rc = pgmR3LoadIncrementalInfo(pVM, pSSM, 0 /*cDepth*/, &pVM->pgm.s.IncrSave.idLoaded);
             if (RT_SUCCESS(rc))
                 rc = pgmR3LoadRomRanges(pVM, pSSM);
             if (RT_SUCCESS(rc))
@@ -3329,6 +3689,30 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
 }
 
 
+/**
+ * Cleans up after a state load operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM             Pointer to the VM.
+ * @param   pSSM            SSM operation handle.
+ */
+static DECLCALLBACK(int) pgmR3LoadDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    /*
+     * Track RAM changes relative to the restored saved state if it has an ID,
+     * so it can serve as the parent of the next incremental save.
+     */
+    uint64_t const idLoaded = pVM->pgm.s.IncrSave.idLoaded;
+    pVM->pgm.s.IncrSave.idLoaded = 0;
+    if (   idLoaded
+        && RT_SUCCESS(SSMR3HandleGetStatus(pSSM))
+        && !FTMIsDeltaLoadSaveActive(pVM)
+        && !pVM->fFaultTolerantMaster)
+        pgmR3IncrSaveArm(pVM, idLoaded);
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Registers the saved state callbacks with SSM.
  *
@@ -3341,6 +3725,79 @@ int pgmR3InitSavedState(PVM pVM, uint64_t cbRam)
     return SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
                                  pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
                                  NULL,          pgmR3SaveExec, pgmR3SaveDone,
-                                 pgmR3LoadPrep, pgmR3Load,     NULL);
+                                 pgmR3LoadPrep, pgmR3Load,     pgmR3LoadDone);
 }
 
+
+/**
+ * Requests that the next saved state gets an ID and, optionally, only contains
+ * the RAM pages that changed since the given parent saved state.
+ *
+ * After the save completes, RAM pages are write monitored so that the next
+ * incremental save can use it as parent.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_NO_INCREMENTAL_BASE if a parent is given but we're not
+ *          tracking changes relative to any saved state.
+ * @retval  VERR_NOT_SUPPORTED if fault tolerance is active, FTM owns the write
+ *          monitoring then.
+ * @param   pVM                 Pointer to the VM.
+ * @param   pszParent           The absolute path of the parent saved state.
+ *                              NULL for a full saved state.
+ * @thread  Any.
+ */
+VMMR3_INT_DECL(int) PGMR3SaveIncrementalBegin(PVM pVM, const char *pszParent)
+{
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrNullReturn(pszParent, VERR_INVALID_POINTER);
+    if (   pVM->fFaultTolerantMaster
+        || FTMIsDeltaLoadSaveActive(pVM))
+        return VERR_NOT_SUPPORTED;
+
+    char *pszParentCopy = NULL;
+    if (pszParent)
+    {
+        pszParentCopy = RTStrDup(pszParent);
+        if (!pszParentCopy)
+            return VERR_NO_STR_MEMORY;
+    }
+
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    if (pVM->pgm.s.IncrSave.fRequested)
+        rc = VERR_WRONG_ORDER;
+    else if (   pszParent
+             && (   !pVM->pgm.s.IncrSave.fTracking
+                 || !pVM->pgm.s.IncrSave.idLastSave))
+        rc = VERR_PGM_NO_INCREMENTAL_BASE;
+    else
+    {
+        pVM->pgm.s.IncrSave.pszParent  = pszParentCopy;
+        pVM->pgm.s.IncrSave.fRequested = true;
+        pszParentCopy = NULL;
+    }
+    pgmUnlock(pVM);
+
+    RTStrFree(pszParentCopy);
+    return rc;
+}
+
+
+/**
+ * Ends an incremental save request started by PGMR3SaveIncrementalBegin.
+ *
+ * @param   pVM                 Pointer to the VM.
+ * @thread  Any.
+ */
+VMMR3_INT_DECL(void) PGMR3SaveIncrementalEnd(PVM pVM)
+{
+    AssertPtrReturnVoid(pVM);
+
+    pgmLock(pVM);
+    char *pszParent = pVM->pgm.s.IncrSave.pszParent;
+    pVM->pgm.s.IncrSave.pszParent  = NULL;
+    pVM->pgm.s.IncrSave.fRequested = false;
+    pgmUnlock(pVM);
+
+    RTStrFree(pszParent);
+}
@@ -145,6 +145,7 @@
 *******************************************************************************/
 #define LOG_GROUP LOG_GROUP_SSM
 #include <VBox/vmm/ssm.h>
+#include <VBox/vmm/cfgm.h>
 #include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/vmm/pdmcritsect.h>
@@ -161,6 +162,7 @@
 #include <iprt/crc.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/param.h>
 #include <iprt/thread.h>
 #include <iprt/semaphore.h>
@@ -227,10 +229,14 @@
 /** Named data items.
  * A length prefix zero terminated string (i.e. max 255) followed by the data.  */
 #define SSM_REC_TYPE_NAMED                      5
+/** Raw data compressed by zlib.
+ * Same layout as SSM_REC_TYPE_RAW_LZF, only the compressed data is a zlib
+ * stream.  Only written when /SSM/Compressor is set to "zlib". */
+#define SSM_REC_TYPE_RAW_ZLIB                   6
 /** Macro for validating the record type.
  * This can be used with the flags+type byte, no need to mask out the type first. */
 #define SSM_REC_TYPE_IS_VALID(u8Type)           (   ((u8Type) & SSM_REC_TYPE_MASK) >  SSM_REC_TYPE_INVALID \
-                                                 && ((u8Type) & SSM_REC_TYPE_MASK) <= SSM_REC_TYPE_NAMED )
+                                                 && ((u8Type) & SSM_REC_TYPE_MASK) <= SSM_REC_TYPE_RAW_ZLIB )
 /** @} */
 
 /** The flag mask. */
@@ -284,6 +290,15 @@
  * Must be a multiple of 1KB.  */
 #define SSM_ZIP_BLOCK_SIZE                      _4K
 AssertCompile(SSM_ZIP_BLOCK_SIZE / _1K * _1K == SSM_ZIP_BLOCK_SIZE);
+/** The max size of a compressed block record, header included. */
+#define SSM_ZIP_REC_MAX_SIZE                    (1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE)
+AssertCompile(SSM_ZIP_REC_MAX_SIZE < 0x00010000);
+
+/** The number of jobs in the compression worker ring (power of two). */
+#define SSM_ZIP_JOBS                            64
+AssertCompile(RT_IS_POWER_OF_TWO(SSM_ZIP_JOBS));
+/** The max number of compression worker threads. */
+#define SSM_ZIP_MAX_THREADS                     16
 
 
 /**
@@ -447,6 +462,87 @@ typedef struct SSMSTRM
 typedef SSMSTRM *PSSMSTRM;
 
 
+/**
+ * Block (de)compression job states.
+ */
+typedef enum SSMZIPJOBSTATE
+{
+    /** The job slot is not in use. */
+    SSMZIPJOBSTATE_FREE = 0,
+    /** Waiting for a worker to pick it up. */
+    SSMZIPJOBSTATE_QUEUED,
+    /** A worker (or the owner) is processing it. */
+    SSMZIPJOBSTATE_BUSY,
+    /** The output is ready (or the job didn't need processing). */
+    SSMZIPJOBSTATE_DONE
+} SSMZIPJOBSTATE;
+
+/**
+ * A block compression (save) or decompression (load) job.
+ */
+typedef struct SSMZIPJOB
+{
+    /** The job state (SSMZIPJOBSTATE). */
+    uint32_t volatile       enmState;
+    /** Set if compressing, clear if decompressing. */
+    bool                    fCompress;
+    /** The compression type. */
+    RTZIPTYPE               enmType;
+    /** The compression level (compression only). */
+    RTZIPLEVEL              enmLevel;
+    /** The job status code. */
+    int32_t                 rc;
+    /** Load: The stream offset of the compressed data.  This is what the
+     *  reader looks the job up by. */
+    uint64_t                offStream;
+    /** Number of valid bytes in abSrc. */
+    uint32_t                cbSrc;
+    /** Number of bytes in abDst (save: output size; load: the expected
+     *  decompressed size). */
+    uint32_t                cbDst;
+    /** Input: a block (save) or the compressed data (load). */
+    uint8_t                 abSrc[SSM_ZIP_REC_MAX_SIZE];
+    /** Output: the complete record (save) or the decompressed block (load). */
+    uint8_t                 abDst[SSM_ZIP_REC_MAX_SIZE];
+} SSMZIPJOB;
+/** Pointer to a block compression job. */
+typedef SSMZIPJOB *PSSMZIPJOB;
+
+/**
+ * Block compression worker pool.
+ *
+ * The jobs are kept in a ring which the owner (the thread doing the save or
+ * load) fills at iSubmit and retires in order at iRetire.  The workers walk it
+ * at iClaim and grab queued jobs by changing their state to busy, so the owner
+ * can process a job itself instead of waiting for a worker to get to it.
+ */
+typedef struct SSMZIPPOOL
+{
+    /** Number of worker threads. */
+    uint32_t                cThreads;
+    /** Set when the workers should terminate. */
+    bool volatile           fTerminate;
+    /** Event the workers wait on for more jobs. */
+    RTSEMEVENT              hEvtWork;
+    /** Event the workers signal when completing a job. */
+    RTSEMEVENT              hEvtDone;
+    /** The next job for the workers to look at (free running). */
+    uint32_t volatile       iClaim;
+    /** The next job to submit (free running, written by the owner only). */
+    uint32_t volatile       iSubmit;
+    /** The oldest job not yet retired (free running, owner only). */
+    uint32_t                iRetire;
+    /** Load: The stream offset where the read-ahead scanning stopped. */
+    uint64_t                offScanNext;
+    /** The worker threads. */
+    RTTHREAD                ahThreads[SSM_ZIP_MAX_THREADS];
+    /** The job ring. */
+    SSMZIPJOB               aJobs[SSM_ZIP_JOBS];
+} SSMZIPPOOL;
+/** Pointer to a block compression worker pool. */
+typedef SSMZIPPOOL *PSSMZIPPOOL;
+
+
 /**
  * Handle structure.
  */
@@ -500,6 +596,9 @@ typedef struct SSMHANDLE
     unsigned                uReportedLivePercent;
     /** The filename, NULL if remote stream. */
     const char             *pszFilename;
+    /** The block compression worker pool, NULL if (de)compressing on the
+     * calling thread. */
+    PSSMZIPPOOL             pZipPool;
 
     union
     {
@@ -514,6 +613,11 @@ typedef struct SSMHANDLE
             uint8_t         abDataBuffer[4096];
             /** The maximum downtime given as milliseconds. */
             uint32_t        cMsMaxDowntime;
+            /** The block compressor (RTZIPTYPE_LZF, RTZIPTYPE_ZLIB or
+             *  RTZIPTYPE_STORE). */
+            RTZIPTYPE       enmZipType;
+            /** The block compression level. */
+            RTZIPLEVEL      enmZipLevel;
         } Write;
 
         /** Read data. */
@@ -945,6 +1049,62 @@ static int ssmR3LazyInit(PVM pVM)
         STAM_REL_REG_USED(pVM, &pVM->ssm.s.uPass, STAMTYPE_U32, "/SSM/uPass", STAMUNIT_COUNT, "Current pass");
     }
 
+    /*
+     * Block compression configuration.
+     */
+    if (RT_SUCCESS(rc))
+    {
+        PCFGMNODE pCfgSSM = CFGMR3GetChild(CFGMR3GetRoot(pVM), "SSM");
+
+        /** @cfgm{/SSM/Compressor, string, "lzf"}
+         * The block compressor used when saving: "lzf", "zlib" or "none".  States
+         * saved with "zlib" cannot be restored by versions predating it. */
+        char szCompressor[16];
+        rc = CFGMR3QueryStringDef(pCfgSSM, "Compressor", szCompressor, sizeof(szCompressor), "lzf");
+        if (RT_SUCCESS(rc))
+        {
+            if (!RTStrICmp(szCompressor, "lzf"))
+                pVM->ssm.s.enmZipType = RTZIPTYPE_LZF;
+            else if (!RTStrICmp(szCompressor, "zlib"))
+                pVM->ssm.s.enmZipType = RTZIPTYPE_ZLIB;
+            else if (!RTStrICmp(szCompressor, "none"))
+                pVM->ssm.s.enmZipType = RTZIPTYPE_STORE;
+            else
+                rc = VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                N_("Invalid /SSM/Compressor value '%s', expected 'lzf', 'zlib' or 'none'"), szCompressor);
+        }
+
+        /** @cfgm{/SSM/CompressionLevel, uint8_t, 1, 3, 1}
+         * The compression level, 1 being the fastest and 3 the best.  LZF only
+         * has the one level. */
+        uint8_t uLevel = 1;
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3QueryU8Def(pCfgSSM, "CompressionLevel", &uLevel, 1);
+        if (RT_SUCCESS(rc))
+        {
+            if (uLevel >= 1 && uLevel <= 3)
+                pVM->ssm.s.enmZipLevel = uLevel == 1 ? RTZIPLEVEL_FAST : uLevel == 2 ? RTZIPLEVEL_DEFAULT : RTZIPLEVEL_MAX;
+            else
+                rc = VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                N_("Invalid /SSM/CompressionLevel value %u, expected 1 thru 3"), uLevel);
+        }
+
+        /** @cfgm{/SSM/CompressionThreads, uint32_t, 0, 16, online CPUs - 1 up to 4}
+         * The number of worker threads compressing blocks when saving and
+         * decompressing them ahead of the reader when restoring.  Zero does it
+         * all on the thread doing the save or restore. */
+        if (RT_SUCCESS(rc))
+        {
+            uint32_t cCpus = RTMpGetOnlineCount();
+            rc = CFGMR3QueryU32Def(pCfgSSM, "CompressionThreads", &pVM->ssm.s.cZipThreads,
+                                   cCpus > 1 ? RT_MIN(cCpus - 1, 4) : 0);
+            if (RT_SUCCESS(rc) && pVM->ssm.s.cZipThreads > SSM_ZIP_MAX_THREADS)
+                rc = VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                N_("Invalid /SSM/CompressionThreads value %u, max is %u"),
+                                pVM->ssm.s.cZipThreads, SSM_ZIP_MAX_THREADS);
+        }
+    }
+
     pVM->ssm.s.fInitialized = RT_SUCCESS(rc);
     return rc;
 }
@@ -2800,6 +2960,32 @@ static uint8_t const *ssmR3StrmReadDirect(PSSMSTRM pStrm, size_t cbToRead)
 }
 
 
+/**
+ * Peeks at data in the current read buffer without consuming it.
+ *
+ * @returns Pointer to the data at @a offStream, NULL if that isn't within the
+ *          current buffer.  Valid till the next read call.
+ * @param   pStrm       The stream handle.
+ * @param   offStream   The stream offset, at or after the current position.
+ * @param   pcbAvail    Where to return the number of bytes available at
+ *                      @a offStream in the current buffer.
+ */
+static uint8_t const *ssmR3StrmPeekCurBuf(PSSMSTRM pStrm, uint64_t offStream, uint32_t *pcbAvail)
+{
+    Assert(!pStrm->fWrite);
+    *pcbAvail = 0;
+
+    PSSMSTRMBUF pBuf = pStrm->pCur;
+    if (    !pBuf
+        ||  offStream <  pStrm->offCurStream + pStrm->off
+        ||  offStream >= pStrm->offCurStream + pBuf->cb)
+        return NULL;
+    uint32_t off = (uint32_t)(offStream - pStrm->offCurStream);
+    *pcbAvail = pBuf->cb - off;
+    return &pBuf->abData[off];
+}
+
+
 #ifndef SSM_STANDALONE
 /**
  * Check that the stream is OK and flush data that is getting old
@@ -3124,6 +3310,292 @@ static void ssmR3StrmStartIoThread(PSSMSTRM pStrm)
 
 #endif /* !SSM_STANDALONE */
 
+
+/**
+ * Compresses one block into a complete data record.
+ *
+ * Falls back on a raw record when the block doesn't compress or when
+ * compression is disabled (RTZIPTYPE_STORE).
+ *
+ * @returns The size of the record.
+ * @param   enmType     The compression type.
+ * @param   enmLevel    The compression level.
+ * @param   pvSrc       The block (SSM_ZIP_BLOCK_SIZE bytes).
+ * @param   pbRec       Where to put the record, SSM_ZIP_REC_MAX_SIZE bytes.
+ */
+static size_t ssmR3ZipCompressBlock(RTZIPTYPE enmType, RTZIPLEVEL enmLevel, void const *pvSrc, uint8_t *pbRec)
+{
+    size_t  cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
+    int     rc    = VERR_NOT_SUPPORTED;
+    if (enmType != RTZIPTYPE_STORE)
+        rc = RTZipBlockCompress(enmType, enmLevel, 0 /*fFlags*/,
+                                pvSrc, SSM_ZIP_BLOCK_SIZE,
+                                pbRec + 1 + 3 + 1, cbRec, &cbRec);
+    if (RT_SUCCESS(rc))
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT
+                 | (enmType == RTZIPTYPE_ZLIB ? SSM_REC_TYPE_RAW_ZLIB : SSM_REC_TYPE_RAW_LZF);
+        pbRec[4] = SSM_ZIP_BLOCK_SIZE / _1K;
+        cbRec += 1;
+    }
+    else
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
+        memcpy(&pbRec[4], pvSrc, SSM_ZIP_BLOCK_SIZE);
+        cbRec = SSM_ZIP_BLOCK_SIZE;
+    }
+    pbRec[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
+    pbRec[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
+    pbRec[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
+    return cbRec + 1 + 3;
+}
+
+
+/**
+ * Decompresses one block record payload.
+ *
+ * @returns VBox status code, VERR_SSM_INTEGRITY_DECOMPRESSION on failure.
+ * @param   enmType     The compression type.
+ * @param   pvSrc       The compressed data.
+ * @param   cbSrc       The size of the compressed data.
+ * @param   pvDst       The output buffer.
+ * @param   cbDst       The expected decompressed size.
+ */
+static int ssmR3ZipDecompressBlock(RTZIPTYPE enmType, void const *pvSrc, size_t cbSrc, void *pvDst, size_t cbDst)
+{
+    size_t cbDstActual;
+    int rc = RTZipBlockDecompress(enmType, 0 /*fFlags*/,
+                                  pvSrc, cbSrc, NULL /*pcbSrcActual*/,
+                                  pvDst, cbDst, &cbDstActual);
+    if (RT_SUCCESS(rc))
+    {
+        AssertLogRelMsgReturn(cbDstActual == cbDst, ("%#x %#x\n", cbDstActual, cbDst), VERR_SSM_INTEGRITY_DECOMPRESSION);
+        return VINF_SUCCESS;
+    }
+
+    AssertLogRelMsgFailed(("enmType=%d cbCompr=%#x cbDecompr=%#x rc=%Rrc\n", enmType, cbSrc, cbDst, rc));
+    return VERR_SSM_INTEGRITY_DECOMPRESSION;
+}
+
+
+/**
+ * Processes a job that has been claimed (state busy) and marks it done.
+ *
+ * @param   pPool       The worker pool.
+ * @param   pJob        The job.
+ */
+static void ssmR3ZipProcessJob(PSSMZIPPOOL pPool, PSSMZIPJOB pJob)
+{
+    Assert(pJob->enmState == SSMZIPJOBSTATE_BUSY);
+    if (pJob->fCompress)
+    {
+        pJob->cbDst = (uint32_t)ssmR3ZipCompressBlock(pJob->enmType, pJob->enmLevel, pJob->abSrc, pJob->abDst);
+        pJob->rc    = VINF_SUCCESS;
+    }
+    else
+        pJob->rc = ssmR3ZipDecompressBlock(pJob->enmType, pJob->abSrc, pJob->cbSrc, pJob->abDst, pJob->cbDst);
+    ASMAtomicWriteU32(&pJob->enmState, SSMZIPJOBSTATE_DONE);
+    RTSemEventSignal(pPool->hEvtDone);
+}
+
+
+/**
+ * Waits for a job to complete, processing it on the calling thread if no
+ * worker has picked it up yet.
+ *
+ * @param   pPool       The worker pool.
+ * @param   pJob        The job.
+ */
+static void ssmR3ZipWaitForJob(PSSMZIPPOOL pPool, PSSMZIPJOB pJob)
+{
+    for (;;)
+    {
+        uint32_t enmState = ASMAtomicReadU32(&pJob->enmState);
+        if (enmState == SSMZIPJOBSTATE_DONE)
+            break;
+        if (   enmState == SSMZIPJOBSTATE_QUEUED
+            && ASMAtomicCmpXchgU32(&pJob->enmState, SSMZIPJOBSTATE_BUSY, SSMZIPJOBSTATE_QUEUED))
+        {
+            ssmR3ZipProcessJob(pPool, pJob);
+            break;
+        }
+        RTSemEventWait(pPool->hEvtDone, RT_INDEFINITE_WAIT);
+    }
+}
+
+
+/**
+ * Queues a job that has been filled in by the owner.
+ *
+ * @param   pPool       The worker pool.
+ * @param   pJob        The job at iSubmit.
+ */
+static void ssmR3ZipSubmitJob(PSSMZIPPOOL pPool, PSSMZIPJOB pJob)
+{
+    Assert(pJob == &pPool->aJobs[pPool->iSubmit % SSM_ZIP_JOBS]);
+    ASMAtomicWriteU32(&pJob->enmState, SSMZIPJOBSTATE_QUEUED);
+    ASMAtomicIncU32(&pPool->iSubmit);
+    RTSemEventSignal(pPool->hEvtWork);
+}
+
+
+/**
+ * Frees the oldest job in the ring.
+ *
+ * @param   pPool       The worker pool.
+ * @param   pJob        The job at iRetire.
+ */
+DECLINLINE(void) ssmR3ZipFreeJob(PSSMZIPPOOL pPool, PSSMZIPJOB pJob)
+{
+    Assert(pJob == &pPool->aJobs[pPool->iRetire % SSM_ZIP_JOBS]);
+    ASMAtomicWriteU32(&pJob->enmState, SSMZIPJOBSTATE_FREE);
+    pPool->iRetire++;
+}
+
+
+#ifndef SSM_STANDALONE
+
+/**
+ * Discards all the jobs in the ring, waiting for the busy ones.
+ *
+ * @param   pPool       The worker pool.
+ */
+static void ssmR3ZipDiscardJobs(PSSMZIPPOOL pPool)
+{
+    while (pPool->iRetire != pPool->iSubmit)
+    {
+        PSSMZIPJOB pJob = &pPool->aJobs[pPool->iRetire % SSM_ZIP_JOBS];
+        ssmR3ZipWaitForJob(pPool, pJob);
+        ssmR3ZipFreeJob(pPool, pJob);
+    }
+}
+
+
+/**
+ * The block compression worker thread.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hSelf       The thread handle.
+ * @param   pvPool      The worker pool.
+ */
+static DECLCALLBACK(int) ssmR3ZipWorkerThread(RTTHREAD hSelf, void *pvPool)
+{
+    PSSMZIPPOOL pPool = (PSSMZIPPOOL)pvPool;
+    NOREF(hSelf);
+
+    for (;;)
+    {
+        uint32_t iClaim = ASMAtomicReadU32(&pPool->iClaim);
+        if (iClaim != ASMAtomicReadU32(&pPool->iSubmit))
+        {
+            /* Claim the index, then the job.  The slot may have been
+               recycled by the time we get to it, which is harmless as the
+               state exchange makes sure only one thread processes a job. */
+            if (ASMAtomicCmpXchgU32(&pPool->iClaim, iClaim + 1, iClaim))
+            {
+                PSSMZIPJOB pJob = &pPool->aJobs[iClaim % SSM_ZIP_JOBS];
+                if (ASMAtomicCmpXchgU32(&pJob->enmState, SSMZIPJOBSTATE_BUSY, SSMZIPJOBSTATE_QUEUED))
+                    ssmR3ZipProcessJob(pPool, pJob);
+            }
+            continue;
+        }
+
+        if (ASMAtomicReadBool(&pPool->fTerminate))
+        {
+            RTSemEventSignal(pPool->hEvtWork); /* pass it on to the next worker */
+            break;
+        }
+        RTSemEventWait(pPool->hEvtWork, RT_INDEFINITE_WAIT);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys the block compression worker pool of a handle, if any.
+ *
+ * Outstanding jobs are discarded, so flush them first if they matter.
+ *
+ * @param   pSSM        The saved state handle.
+ */
+static void ssmR3ZipPoolDestroy(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    if (!pPool)
+        return;
+    pSSM->pZipPool = NULL;
+
+    ssmR3ZipDiscardJobs(pPool);
+
+    ASMAtomicWriteBool(&pPool->fTerminate, true);
+    RTSemEventSignal(pPool->hEvtWork);
+    for (uint32_t i = 0; i < pPool->cThreads; i++)
+    {
+        int rc = RTThreadWait(pPool->ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+        AssertRC(rc);
+    }
+
+    RTSemEventDestroy(pPool->hEvtWork);
+    RTSemEventDestroy(pPool->hEvtDone);
+    RTMemFree(pPool);
+}
+
+
+/**
+ * Creates the block compression worker pool for a handle.
+ *
+ * Failure isn't fatal, the handle just goes on (de)compressing on the calling
+ * thread.
+ *
+ * @param   pSSM        The saved state handle.
+ * @param   cThreads    The number of worker threads.
+ */
+static void ssmR3ZipPoolCreate(PSSMHANDLE pSSM, uint32_t cThreads)
+{
+    Assert(!pSSM->pZipPool);
+    cThreads = RT_MIN(cThreads, SSM_ZIP_MAX_THREADS);
+    if (!cThreads)
+        return;
+
+    PSSMZIPPOOL pPool = (PSSMZIPPOOL)RTMemAllocZ(sizeof(*pPool));
+    if (!pPool)
+    {
+        LogRel(("SSM: Failed to allocate the compression worker pool, continuing without.\n"));
+        return;
+    }
+    pPool->hEvtWork = NIL_RTSEMEVENT;
+    pPool->hEvtDone = NIL_RTSEMEVENT;
+    int rc = RTSemEventCreate(&pPool->hEvtWork);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pPool->hEvtDone);
+    if (RT_FAILURE(rc))
+    {
+        RTSemEventDestroy(pPool->hEvtWork);
+        RTMemFree(pPool);
+        LogRel(("SSM: Failed to create the compression worker pool: %Rrc\n", rc));
+        return;
+    }
+
+    pSSM->pZipPool = pPool;
+    for (uint32_t i = 0; i < cThreads; i++)
+    {
+        rc = RTThreadCreateF(&pPool->ahThreads[i], ssmR3ZipWorkerThread, pPool, 0 /*cbStack*/,
+                             RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "SSM-Zip%u", i);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("SSM: Failed to create compression worker #%u: %Rrc\n", i, rc));
+            break;
+        }
+        pPool->cThreads = i + 1;
+    }
+    if (!pPool->cThreads)
+        ssmR3ZipPoolDestroy(pSSM);
+    else
+        LogRel(("SSM: Using %u compression worker threads\n", pPool->cThreads));
+}
+
+#endif /* !SSM_STANDALONE */
+
 /**
  * Works the progress calculation for non-live saves and restores.
  *
@@ -3263,6 +3735,138 @@ static void ssmR3DataWriteBegin(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Writes the oldest compression job to the stream and retires it.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataZipRetire(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    PSSMZIPJOB  pJob  = &pPool->aJobs[pPool->iRetire % SSM_ZIP_JOBS];
+    ssmR3ZipWaitForJob(pPool, pJob);
+
+    int rc = pSSM->rc;
+    if (RT_SUCCESS(rc))
+    {
+        rc = ssmR3StrmWrite(&pSSM->Strm, pJob->abDst, pJob->cbDst);
+        if (RT_SUCCESS(rc))
+            pSSM->offUnit += pJob->cbDst;
+        else
+            pSSM->rc = rc;
+    }
+    ssmR3ZipFreeJob(pPool, pJob);
+    return rc;
+}
+
+
+/**
+ * Writes all the outstanding compression jobs to the stream, in order.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataZipFlush(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    int         rc    = VINF_SUCCESS;
+    while (pPool->iRetire != pPool->iSubmit)
+    {
+        int rc2 = ssmR3DataZipRetire(pSSM);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    return rc;
+}
+
+
+/**
+ * Queues raw record bytes behind the outstanding compression jobs.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle.
+ * @param   pvBuf           The bits to write.
+ * @param   cbBuf           The number of bytes to write.
+ */
+static int ssmR3DataZipQueueRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    while (cbBuf > 0)
+    {
+        /* Append to the previous job if it's a raw one with room left. */
+        PSSMZIPJOB pJob = NULL;
+        if (pPool->iSubmit != pPool->iRetire)
+        {
+            pJob = &pPool->aJobs[(pPool->iSubmit - 1) % SSM_ZIP_JOBS];
+            if (pJob->fCompress || pJob->cbDst >= sizeof(pJob->abDst))
+                pJob = NULL;
+        }
+        if (pJob)
+        {
+            uint32_t cbToCopy = (uint32_t)RT_MIN(cbBuf, sizeof(pJob->abDst) - pJob->cbDst);
+            memcpy(&pJob->abDst[pJob->cbDst], pvBuf, cbToCopy);
+            pJob->cbDst += cbToCopy;
+            cbBuf -= cbToCopy;
+            pvBuf  = (uint8_t const *)pvBuf + cbToCopy;
+            continue;
+        }
+
+        /* New job, this may involve waiting for the oldest one. */
+        if (pPool->iSubmit - pPool->iRetire >= SSM_ZIP_JOBS)
+        {
+            int rc = ssmR3DataZipRetire(pSSM);
+            if (RT_FAILURE(rc))
+                return rc;
+        }
+        pJob = &pPool->aJobs[pPool->iSubmit % SSM_ZIP_JOBS];
+        pJob->fCompress = false;
+        pJob->rc        = VINF_SUCCESS;
+        pJob->cbDst     = 0;
+        ASMAtomicWriteU32(&pJob->enmState, SSMZIPJOBSTATE_DONE);
+        ASMAtomicIncU32(&pPool->iSubmit);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Queues a block for compression by the worker pool.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle.
+ * @param   pvBlock         The block (SSM_ZIP_BLOCK_SIZE bytes).
+ */
+static int ssmR3DataZipQueueBlock(PSSMHANDLE pSSM, void const *pvBlock)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+
+    /*
+     * Write out what's ready at the head of the ring and make room.
+     */
+    int rc = VINF_SUCCESS;
+    while (   pPool->iRetire != pPool->iSubmit
+           && (   pPool->iSubmit - pPool->iRetire >= SSM_ZIP_JOBS
+               || ASMAtomicReadU32(&pPool->aJobs[pPool->iRetire % SSM_ZIP_JOBS].enmState) == SSMZIPJOBSTATE_DONE))
+    {
+        rc = ssmR3DataZipRetire(pSSM);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    PSSMZIPJOB pJob = &pPool->aJobs[pPool->iSubmit % SSM_ZIP_JOBS];
+    pJob->fCompress = true;
+    pJob->enmType   = pSSM->u.Write.enmZipType;
+    pJob->enmLevel  = pSSM->u.Write.enmZipLevel;
+    pJob->rc        = VERR_IPE_UNINITIALIZED_STATUS;
+    pJob->cbSrc     = SSM_ZIP_BLOCK_SIZE;
+    pJob->cbDst     = 0;
+    memcpy(pJob->abSrc, pvBlock, SSM_ZIP_BLOCK_SIZE);
+    ssmR3ZipSubmitJob(pPool, pJob);
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Writes a record to the current data item in the saved state file.
  *
@@ -3282,6 +3886,12 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
     if (RT_FAILURE(pSSM->rc))
         return pSSM->rc;
 
+    /*
+     * Queue it behind the outstanding compression jobs to keep things in order.
+     */
+    if (pSSM->pZipPool && pSSM->pZipPool->iSubmit != pSSM->pZipPool->iRetire)
+        return ssmR3DataZipQueueRaw(pSSM, pvBuf, cbBuf);
+
     /*
      * Write the data item in 1MB chunks for progress indicator reasons.
      */
@@ -3369,12 +3979,14 @@ static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFla
 
 
 /**
- * Worker that flushes the buffered data.
+ * Worker that flushes the data buffer.
+ *
+ * The record may end up queued behind outstanding compression jobs.
  *
  * @returns VBox status code. Will set pSSM->rc on error.
  * @param   pSSM            The saved state handle.
  */
-static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
+static int ssmR3DataFlushDataBuffer(PSSMHANDLE pSSM)
 {
     /*
      * Check how much there current is in the buffer.
@@ -3397,6 +4009,26 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Worker that flushes the buffered data and writes out the outstanding
+ * compression jobs.
+ *
+ * @returns VBox status code. Will set pSSM->rc on error.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
+{
+    int rc = ssmR3DataFlushDataBuffer(pSSM);
+    if (pSSM->pZipPool)
+    {
+        int rc2 = ssmR3DataZipFlush(pSSM);
+        if (RT_FAILURE(rc2) && RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    return rc;
+}
+
+
 /**
  * ssmR3DataWrite worker that writes big stuff.
  *
@@ -3407,7 +4039,7 @@ static int ssmR3DataFlushBuffer(PSSMHANDLE pSSM)
  */
 static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
+    int rc = ssmR3DataFlushDataBuffer(pSSM);
     if (RT_SUCCESS(rc))
     {
         pSSM->offUnitUser += cbBuf;
@@ -3424,38 +4056,27 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
                )
             {
                 /*
-                 * Compress it.
+                 * Compress it, either by handing it to the worker pool or
+                 * directly into the stream buffer.
                  */
-                AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
-                uint8_t *pb;
-                rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
-                if (RT_FAILURE(rc))
-                    break;
-                size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
-                rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
-                                        pvBuf, SSM_ZIP_BLOCK_SIZE,
-                                        pb + 1 + 3 + 1, cbRec, &cbRec);
-                if (RT_SUCCESS(rc))
+                if (pSSM->pZipPool)
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
-                    pb[4] = SSM_ZIP_BLOCK_SIZE / _1K;
-                    cbRec += 1;
+                    rc = ssmR3DataZipQueueBlock(pSSM, pvBuf);
+                    if (RT_FAILURE(rc))
+                        break;
                 }
                 else
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
-                    memcpy(&pb[4], pvBuf, SSM_ZIP_BLOCK_SIZE);
-                    cbRec = SSM_ZIP_BLOCK_SIZE;
+                    uint8_t *pb;
+                    rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, SSM_ZIP_REC_MAX_SIZE, &pb);
+                    if (RT_FAILURE(rc))
+                        break;
+                    size_t cbRec = ssmR3ZipCompressBlock(pSSM->u.Write.enmZipType, pSSM->u.Write.enmZipLevel, pvBuf, pb);
+                    rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
+                    if (RT_FAILURE(rc))
+                        break;
+                    pSSM->offUnit += cbRec;
                 }
-                pb[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
-                pb[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
-                pb[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
-                cbRec += 1 + 3;
-                rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
-                if (RT_FAILURE(rc))
-                    break;
-
-                pSSM->offUnit += cbRec;
                 ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
 
                 /* advance */
@@ -3515,7 +4136,7 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
  */
 static int ssmR3DataWriteFlushAndBuffer(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 {
-    int rc = ssmR3DataFlushBuffer(pSSM);
+    int rc = ssmR3DataFlushDataBuffer(pSSM);
     if (RT_SUCCESS(rc))
     {
         memcpy(&pSSM->u.Write.abDataBuffer[0], pvBuf, cbBuf);
@@ -4535,6 +5156,7 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
      * Make it non-cancellable, close the stream and delete the file on failure.
      */
     ssmR3SetCancellable(pVM, pSSM, false);
+    ssmR3ZipPoolDestroy(pSSM);
     int rc = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     if (RT_SUCCESS(rc))
         rc = pSSM->rc;
@@ -5133,8 +5755,19 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
     pSSM->uPercentDone              = 0;
     pSSM->uReportedLivePercent      = 0;
     pSSM->pszFilename               = pszFilename;
+    pSSM->pZipPool                  = NULL;
     pSSM->u.Write.offDataBuffer     = 0;
     pSSM->u.Write.cMsMaxDowntime    = UINT32_MAX;
+    if (pVM->ssm.s.fInitialized)
+    {
+        pSSM->u.Write.enmZipType    = pVM->ssm.s.enmZipType;
+        pSSM->u.Write.enmZipLevel   = pVM->ssm.s.enmZipLevel;
+    }
+    else
+    {
+        pSSM->u.Write.enmZipType    = RTZIPTYPE_LZF;
+        pSSM->u.Write.enmZipLevel   = RTZIPLEVEL_FAST;
+    }
 
     int rc;
     if (pStreamOps)
@@ -5148,6 +5781,9 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
         return rc;
     }
 
+    if (pVM->ssm.s.fInitialized && pSSM->u.Write.enmZipType != RTZIPTYPE_STORE)
+        ssmR3ZipPoolCreate(pSSM, pVM->ssm.s.cZipThreads);
+
     *ppSSM = pSSM;
     return VINF_SUCCESS;
 }
@@ -5752,6 +6388,7 @@ VMMR3_INT_DECL(int) SSMR3LiveSave(PVM pVM, uint32_t cMsMaxDowntime,
         return VINF_SUCCESS;
     }
     /* bail out. */
+    ssmR3ZipPoolDestroy(pSSM);
     int rc2 = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     RTMemFree(pSSM);
     rc2 = RTFileDelete(pszFilename);
@@ -5999,18 +6636,147 @@ DECLINLINE(int) ssmR3DataReadV2RawLzfHdr(PSSMHANDLE pSSM, uint32_t *pcbDecompr)
 
 
 /**
- * Reads an LZF block from the stream and decompresses into the specified
- * buffer.
+ * Scans ahead in the current stream buffer and queues the compressed block
+ * records found there for decompression by the worker pool.
+ *
+ * This must be called at a record boundary.  The scanning stops at the end of
+ * the buffer, at the termination record, when the job ring is full, and at
+ * anything that doesn't look like a small record; the regular record reading
+ * code deals with validating that stuff.
+ *
+ * @param   pSSM            The saved state handle.
+ */
+static void ssmR3DataReadAheadV2(PSSMHANDLE pSSM)
+{
+    PSSMZIPPOOL     pPool = pSSM->pZipPool;
+    uint64_t        off   = RT_MAX(pPool->offScanNext, ssmR3StrmTell(&pSSM->Strm));
+    uint32_t        cbAvail;
+    uint8_t const  *pb    = ssmR3StrmPeekCurBuf(&pSSM->Strm, off, &cbAvail);
+    if (!pb)
+        return;
+
+    while (   cbAvail >= 2
+           && pPool->iSubmit - pPool->iRetire < SSM_ZIP_JOBS)
+    {
+        /*
+         * Decode the record header (see ssmR3DataReadRecHdrV2).
+         */
+        uint8_t const u8TypeAndFlags = pb[0];
+        if (   !SSM_REC_ARE_TYPE_AND_FLAGS_VALID(u8TypeAndFlags)
+            || (u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_TERM)
+            break;
+        uint32_t cbHdr;
+        uint32_t cbRec;
+        if (!(pb[1] & 0x80))
+        {
+            cbHdr = 2;
+            cbRec = pb[1];
+        }
+        else if (   (pb[1] & 0xe0) == 0xc0
+                 && cbAvail >= 3
+                 && (pb[2] & 0xc0) == 0x80)
+        {
+            cbHdr = 3;
+            cbRec = ((uint32_t)(pb[1] & 0x1f) << 6) | (pb[2] & 0x3f);
+        }
+        else if (   (pb[1] & 0xf0) == 0xe0
+                 && cbAvail >= 4
+                 && (pb[2] & 0xc0) == 0x80
+                 && (pb[3] & 0xc0) == 0x80)
+        {
+            cbHdr = 4;
+            cbRec = ((uint32_t)(pb[1] & 0x0f) << 12) | ((uint32_t)(pb[2] & 0x3f) << 6) | (pb[3] & 0x3f);
+        }
+        else
+            break;
+        if (cbHdr + cbRec > cbAvail)
+            break;
+
+        /*
+         * Queue compressed blocks passing the ssmR3DataReadV2RawLzfHdr checks.
+         */
+        uint8_t const u8Type = u8TypeAndFlags & SSM_REC_TYPE_MASK;
+        if (   (u8Type == SSM_REC_TYPE_RAW_LZF || u8Type == SSM_REC_TYPE_RAW_ZLIB)
+            && cbRec > 1
+            && cbRec <= SSM_ZIP_BLOCK_SIZE + 2)
+        {
+            uint32_t const cbCompr   = cbRec - 1;
+            uint32_t const cbDecompr = (uint32_t)pb[cbHdr] * _1K;
+            if (   cbDecompr >= cbCompr
+                && cbDecompr <= SSM_ZIP_BLOCK_SIZE)
+            {
+                PSSMZIPJOB pJob = &pPool->aJobs[pPool->iSubmit % SSM_ZIP_JOBS];
+                pJob->fCompress = false;
+                pJob->enmType   = u8Type == SSM_REC_TYPE_RAW_ZLIB ? RTZIPTYPE_ZLIB : RTZIPTYPE_LZF;
+                pJob->rc        = VERR_IPE_UNINITIALIZED_STATUS;
+                pJob->offStream = off + cbHdr + 1;
+                pJob->cbSrc     = cbCompr;
+                pJob->cbDst     = cbDecompr;
+                memcpy(pJob->abSrc, &pb[cbHdr + 1], cbCompr);
+                ssmR3ZipSubmitJob(pPool, pJob);
+            }
+        }
+
+        off     += cbHdr + cbRec;
+        pb      += cbHdr + cbRec;
+        cbAvail -= cbHdr + cbRec;
+    }
+    pPool->offScanNext = off;
+}
+
+
+/**
+ * Looks up the read-ahead decompression of a compressed block, retiring the
+ * jobs for blocks the reader has passed on the way.
+ *
+ * @returns VINF_SUCCESS if found and copied, VERR_NOT_FOUND if not.  Other
+ *          status codes (decompression failure) are returned as is.
+ * @param   pSSM            The saved state handle.
+ * @param   offStream       The stream offset of the compressed data.
+ * @param   cbCompr         The size of the compressed data.
+ * @param   pvDst           Where to put the decompressed data.
+ * @param   cbDecompr       The size of the decompressed data.
+ */
+static int ssmR3DataReadAheadLookupV2(PSSMHANDLE pSSM, uint64_t offStream, uint32_t cbCompr, void *pvDst, uint32_t cbDecompr)
+{
+    PSSMZIPPOOL pPool = pSSM->pZipPool;
+    while (pPool->iRetire != pPool->iSubmit)
+    {
+        PSSMZIPJOB pJob = &pPool->aJobs[pPool->iRetire % SSM_ZIP_JOBS];
+        if (pJob->offStream > offStream)
+            break;
+        ssmR3ZipWaitForJob(pPool, pJob);
+
+        bool const  fHit = pJob->offStream == offStream
+                        && pJob->cbSrc     == cbCompr
+                        && pJob->cbDst     == cbDecompr;
+        int const   rc   = pJob->rc;
+        if (fHit && RT_SUCCESS(rc))
+            memcpy(pvDst, pJob->abDst, cbDecompr);
+        ssmR3ZipFreeJob(pPool, pJob);
+        if (fHit)
+            return rc;
+    }
+    return VERR_NOT_FOUND;
+}
+
+
+/**
+ * Reads an LZF or zlib block from the stream and decompresses into the
+ * specified buffer.
  *
  * @returns VBox status code. Sets pSSM->rc on error.
  * @param   SSM             The saved state handle.
  * @param   pvDst           Pointer to the output buffer.
  * @param   cbDecompr       The size of the decompressed data.
+ * @param   enmType         The compression type, RTZIPTYPE_LZF or
+ *                          RTZIPTYPE_ZLIB.
  */
-static int ssmR3DataReadV2RawLzf(PSSMHANDLE pSSM, void *pvDst, size_t cbDecompr)
+static int ssmR3DataReadV2RawLzf(PSSMHANDLE pSSM, void *pvDst, size_t cbDecompr, RTZIPTYPE enmType)
 {
-    int         rc;
-    uint32_t    cbCompr    = pSSM->u.Read.cbRecLeft;
+    int             rc;
+    uint32_t        cbCompr    = pSSM->u.Read.cbRecLeft;
+    uint64_t const  offStream  = ssmR3StrmTell(&pSSM->Strm);
     pSSM->u.Read.cbRecLeft = 0;
 
     /*
@@ -6031,20 +6797,24 @@ static int ssmR3DataReadV2RawLzf(PSSMHANDLE pSSM, void *pvDst, size_t cbDecompr)
     }
 
     /*
-     * Decompress it.
+     * Pick up the result if the workers got to it already, and keep them
+     * busy with the blocks following it.
      */
-    size_t cbDstActual;
-    rc = RTZipBlockDecompress(RTZIPTYPE_LZF, 0 /*fFlags*/,
-                              pb, cbCompr, NULL /*pcbSrcActual*/,
-                              pvDst, cbDecompr, &cbDstActual);
-    if (RT_SUCCESS(rc))
+    if (pSSM->pZipPool)
     {
-        AssertLogRelMsgReturn(cbDstActual == cbDecompr, ("%#x %#x\n", cbDstActual, cbDecompr), pSSM->rc = VERR_SSM_INTEGRITY_DECOMPRESSION);
-        return VINF_SUCCESS;
+        rc = ssmR3DataReadAheadLookupV2(pSSM, offStream, cbCompr, pvDst, (uint32_t)cbDecompr);
+        ssmR3DataReadAheadV2(pSSM);
+        if (rc != VERR_NOT_FOUND)
+            return RT_SUCCESS(rc) ? VINF_SUCCESS : pSSM->rc = rc;
     }
 
-    AssertLogRelMsgFailed(("cbCompr=%#x cbDecompr=%#x rc=%Rrc\n", cbCompr, cbDecompr, rc));
-    return pSSM->rc = VERR_SSM_INTEGRITY_DECOMPRESSION;
+    /*
+     * Decompress it.
+     */
+    rc = ssmR3ZipDecompressBlock(enmType, pb, cbCompr, pvDst, cbDecompr);
+    if (RT_FAILURE(rc))
+        return pSSM->rc = rc;
+    return VINF_SUCCESS;
 }
 
 
@@ -6307,20 +7077,23 @@ static int ssmR3DataReadUnbufferedV2(PSSMHANDLE pSSM, void *pvBuf, size_t cbBuf)
             }
 
             case SSM_REC_TYPE_RAW_LZF:
+            case SSM_REC_TYPE_RAW_ZLIB:
             {
+                RTZIPTYPE const enmZipType = (pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_RAW_ZLIB
+                                           ? RTZIPTYPE_ZLIB : RTZIPTYPE_LZF;
                 int rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbToRead);
                 if (RT_FAILURE(rc))
                     return rc;
                 if (cbToRead <= cbBuf)
                 {
-                    rc = ssmR3DataReadV2RawLzf(pSSM, pvBuf, cbToRead);
+                    rc = ssmR3DataReadV2RawLzf(pSSM, pvBuf, cbToRead, enmZipType);
                     if (RT_FAILURE(rc))
                         return rc;
                 }
                 else
                 {
                     /* The output buffer is too small, use the data buffer. */
-                    rc = ssmR3DataReadV2RawLzf(pSSM, &pSSM->u.Read.abDataBuffer[0], cbToRead);
+                    rc = ssmR3DataReadV2RawLzf(pSSM, &pSSM->u.Read.abDataBuffer[0], cbToRead, enmZipType);
                     if (RT_FAILURE(rc))
                         return rc;
                     pSSM->u.Read.cbDataBuffer  = cbToRead;
@@ -6430,11 +7203,14 @@ static int ssmR3DataReadBufferedV2(PSSMHANDLE pSSM, void *pvBuf, size_t cbBuf)
             }
 
             case SSM_REC_TYPE_RAW_LZF:
+            case SSM_REC_TYPE_RAW_ZLIB:
             {
+                RTZIPTYPE const enmZipType = (pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_RAW_ZLIB
+                                           ? RTZIPTYPE_ZLIB : RTZIPTYPE_LZF;
                 int rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbToRead);
                 if (RT_FAILURE(rc))
                     return rc;
-                rc = ssmR3DataReadV2RawLzf(pSSM, &pSSM->u.Read.abDataBuffer[0], cbToRead);
+                rc = ssmR3DataReadV2RawLzf(pSSM, &pSSM->u.Read.abDataBuffer[0], cbToRead, enmZipType);
                 if (RT_FAILURE(rc))
                     return rc;
                 pSSM->u.Read.cbDataBuffer = cbToRead;
@@ -7986,6 +8762,7 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->uPercentDone          = 2;
     pSSM->uReportedLivePercent  = 0;
     pSSM->pszFilename           = pszFilename;
+    pSSM->pZipPool              = NULL;
 
     pSSM->u.Read.pZipDecompV1   = NULL;
     pSSM->u.Read.uFmtVerMajor   = UINT32_MAX;
@@ -8586,6 +9363,8 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     {
         ssmR3StrmStartIoThread(&Handle.Strm);
         ssmR3SetCancellable(pVM, &Handle, true);
+        if (pVM->ssm.s.fInitialized && Handle.u.Read.uFmtVerMajor >= 2)
+            ssmR3ZipPoolCreate(&Handle, pVM->ssm.s.cZipThreads);
 
         Handle.enmAfter         = enmAfter;
         Handle.pfnProgress      = pfnProgress;
@@ -8745,6 +9524,7 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
             pfnProgress(pVM->pUVM, 99, pvProgressUser);
 
         ssmR3SetCancellable(pVM, &Handle, false);
+        ssmR3ZipPoolDestroy(&Handle);
         ssmR3StrmClose(&Handle.Strm, Handle.rc == VERR_SSM_CANCELLED);
         rc = Handle.rc;
     }
@@ -8763,6 +9543,131 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
 }
 
 
+/**
+ * Replays one data unit from another saved state file.
+ *
+ * All the passes saved for the unit are handed to @a pfnLoadExec in stream
+ * order while the other units in the file are skipped.  This is used for
+ * composing incremental saved states, where a unit only saved the changes
+ * relative to a parent file and has to apply the parent data first.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_SSM_UNIT_NOT_FOUND if the file doesn't contain the unit.
+ *
+ * @param   pVM             Pointer to the VM.
+ * @param   pszFilename     The saved state file to replay the unit from.
+ * @param   pszUnit         The name of the data unit.
+ * @param   iInstance       The instance number.
+ * @param   pfnLoadExec     The load exec callback to call for each pass.
+ * @param   pvUser          User argument for the callback.
+ *
+ * @thread  EMT(0)
+ */
+VMMR3_INT_DECL(int) SSMR3LoadUnitFromFile(PVM pVM, const char *pszFilename, const char *pszUnit, uint32_t iInstance,
+                                          PFNSSMEXTLOADEXEC pfnLoadExec, void *pvUser)
+{
+    LogFlow(("SSMR3LoadUnitFromFile: pszFilename=%p:{%s} pszUnit=%p:{%s} iInstance=%u pfnLoadExec=%p pvUser=%p\n",
+             pszFilename, pszFilename, pszUnit, pszUnit, iInstance, pfnLoadExec, pvUser));
+    VM_ASSERT_EMT0(pVM);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    AssertPtrReturn(pszUnit, VERR_INVALID_POINTER);
+    AssertPtrReturn(pfnLoadExec, VERR_INVALID_POINTER);
+
+    PSSMHANDLE pSSM = (PSSMHANDLE)RTMemAllocZ(sizeof(*pSSM));
+    AssertReturn(pSSM, VERR_NO_MEMORY);
+    int rc = ssmR3OpenFile(pVM, pszFilename, NULL /*pStreamOps*/, NULL /*pvUser*/, false /*fChecksumIt*/,
+                           true /*fChecksumOnRead*/, 8 /*cBuffers*/, pSSM);
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pSSM);
+        return VMSetError(pVM, rc, RT_SRC_POS, N_("Failed to open the saved state file '%s'"), pszFilename);
+    }
+    pSSM->enmAfter = SSMAFTER_OPENED;
+    pSSM->enmOp    = SSMSTATE_LOAD_EXEC;
+    if (pSSM->u.Read.uFmtVerMajor < 2)
+        rc = VMSetError(pVM, VERR_NOT_SUPPORTED, RT_SRC_POS,
+                        N_("The saved state file '%s' is too old to be replayed"), pszFilename);
+    else
+    {
+        ssmR3StrmStartIoThread(&pSSM->Strm);
+        if (pVM->ssm.s.fInitialized)
+            ssmR3ZipPoolCreate(pSSM, pVM->ssm.s.cZipThreads);
+
+        /*
+         * Walk the units in stream order.
+         */
+        size_t const    cbUnitNm = strlen(pszUnit) + 1;
+        bool            fFound   = false;
+        for (;;)
+        {
+            uint64_t            offUnit         = ssmR3StrmTell(&pSSM->Strm);
+            uint32_t            u32CurStreamCRC = ssmR3StrmCurCRC(&pSSM->Strm);
+            SSMFILEUNITHDRV2    UnitHdr;
+            rc = ssmR3StrmRead(&pSSM->Strm, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName));
+            if (RT_FAILURE(rc))
+                break;
+            if (!memcmp(&UnitHdr.szMagic[0], SSMFILEUNITHDR_END, sizeof(UnitHdr.szMagic)))
+                break;
+            AssertLogRelMsgBreakStmt(   !memcmp(&UnitHdr.szMagic[0], SSMFILEUNITHDR_MAGIC, sizeof(UnitHdr.szMagic))
+                                     && UnitHdr.cbName > 1
+                                     && UnitHdr.cbName <= sizeof(UnitHdr.szName)
+                                     && UnitHdr.offStream == offUnit
+                                     && (UnitHdr.u32CurStreamCRC == u32CurStreamCRC || !pSSM->Strm.fChecksummed),
+                                     ("Unit at %#llx (%lld): Invalid unit header\n", offUnit, offUnit),
+                                     rc = VERR_SSM_INTEGRITY_UNIT);
+            rc = ssmR3StrmRead(&pSSM->Strm, &UnitHdr.szName[0], UnitHdr.cbName);
+            if (RT_FAILURE(rc))
+                break;
+            uint32_t const u32CRC = UnitHdr.u32CRC;
+            UnitHdr.u32CRC = 0;
+            uint32_t const u32ActualCRC = RTCrc32(&UnitHdr, RT_UOFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]));
+            UnitHdr.u32CRC = u32CRC;
+            AssertLogRelMsgBreakStmt(u32ActualCRC == u32CRC && !UnitHdr.szName[UnitHdr.cbName - 1],
+                                     ("Unit at %#llx (%lld): CRC mismatch: %08x, correct is %08x\n",
+                                      offUnit, offUnit, u32CRC, u32ActualCRC),
+                                     rc = VERR_SSM_INTEGRITY_CRC);
+
+            ssmR3DataReadBeginV2(pSSM);
+            if (    UnitHdr.u32Instance == iInstance
+                &&  UnitHdr.cbName == cbUnitNm
+                &&  !memcmp(UnitHdr.szName, pszUnit, cbUnitNm))
+            {
+                fFound = true;
+                pSSM->u.Read.uCurUnitVer  = UnitHdr.u32Version;
+                pSSM->u.Read.uCurUnitPass = UnitHdr.u32Pass;
+                pSSM->u.Read.pCurUnit     = ssmR3Find(pVM, pszUnit, iInstance);
+                rc = pfnLoadExec(pSSM, pvUser, UnitHdr.u32Version, UnitHdr.u32Pass);
+                if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
+                    pSSM->rc = rc;
+            }
+            else
+                SSMR3SkipToEndOfUnit(pSSM);
+            rc = ssmR3DataReadFinishV2(pSSM);
+            if (RT_FAILURE(rc))
+            {
+                LogRel(("SSM: Replaying '%s' instance #%u (version %u, pass %#x) from '%s' failed: %Rrc\n",
+                        UnitHdr.szName, UnitHdr.u32Instance, UnitHdr.u32Version, UnitHdr.u32Pass, pszFilename, rc));
+                break;
+            }
+            pSSM->offUnit     = UINT64_MAX;
+            pSSM->offUnitUser = UINT64_MAX;
+        }
+        if (RT_SUCCESS(rc) && !fFound)
+            rc = VERR_SSM_UNIT_NOT_FOUND;
+        else if (RT_FAILURE(rc) && !pSSM->u.Read.fHaveSetError)
+            rc = VMSetError(pVM, rc, RT_SRC_POS, N_("Failed to replay unit '%s' from the saved state file '%s'"),
+                            pszUnit, pszFilename);
+        ssmR3ZipPoolDestroy(pSSM);
+    }
+
+    pSSM->enmOp = SSMSTATE_OPEN_READ;
+    ssmR3StrmClose(&pSSM->Strm, false /*fCancelled*/);
+    RTMemFree(pSSM);
+    LogFlow(("SSMR3LoadUnitFromFile: returns %Rrc\n", rc));
+    return rc;
+}
+
+
 /**
  * VMSetError wrapper for load errors that inserts the saved state details.
  *
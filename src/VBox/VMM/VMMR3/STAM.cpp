@@ -41,6 +41,11 @@
  * And as mentioned in the introduction, the debugger console features a couple
  * of command: .stats and .statsreset.
  *
+ * For frequent polling there is a compact binary format, STAMR3SnapshotBinary,
+ * which only transmits the names once and delta encodes the values against
+ * the previous frame.  The sampler thread (STAMR3SamplerStart, or the
+ * /STAM/Sampler configuration) streams such frames to a file or named pipe.
+ *
  * @see grp_stam
  */
 
@@ -52,15 +57,21 @@
 #include "STAMInternal.h"
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/mm.h>
 #include <VBox/err.h>
 #include <VBox/dbg.h>
 #include <VBox/log.h>
 
 #include <iprt/assert.h>
 #include <iprt/asm.h>
+#include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/semaphore.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 
 
 /*******************************************************************************
@@ -69,6 +80,13 @@
 /** The maximum name length excluding the terminator. */
 #define STAM_MAX_NAME_LEN   239
 
+/** Magic value of STAMR3BINCTX::u32Magic (Ornette Coleman). */
+#define STAMR3BINCTX_MAGIC          UINT32_C(0x19300309)
+/** The max number of values a sample has in a binary snapshot. */
+#define STAMBIN_MAX_VALUES          4
+/** The max size of a varint encoded 64-bit value. */
+#define STAMBIN_MAX_VARINT          10
+
 
 /*******************************************************************************
 *   Structures and Typedefs                                                    *
@@ -118,6 +136,112 @@ typedef struct STAMR3SNAPSHOTONE
 } STAMR3SNAPSHOTONE, *PSTAMR3SNAPSHOTONE;
 
 
+/**
+ * Growable output buffer used by the binary snapshots.
+ */
+typedef struct STAMBINBUF
+{
+    /** The buffer. */
+    uint8_t        *pb;
+    /** The buffer size. */
+    size_t          cb;
+    /** The current write offset. */
+    size_t          off;
+} STAMBINBUF;
+/** Pointer to a binary snapshot output buffer. */
+typedef STAMBINBUF *PSTAMBINBUF;
+
+
+/**
+ * The values a binary snapshot context remembers for one sample ID.
+ */
+typedef struct STAMBINPREV
+{
+    /** The values from the previous frame. */
+    uint64_t        au64[STAMBIN_MAX_VALUES];
+    /** The histogram buckets from the previous frame, allocated on demand. */
+    uint64_t       *pau64Buckets;
+} STAMBINPREV;
+/** Pointer to the previous values of a sample. */
+typedef STAMBINPREV *PSTAMBINPREV;
+
+
+/**
+ * Binary snapshot context.
+ *
+ * Keeps what the reader knows about, so that only new schema records and the
+ * changes since the previous frame need to be emitted, and the buffers so
+ * polling doesn't keep allocating memory.
+ */
+typedef struct STAMR3BINCTX
+{
+    /** Magic value (STAMR3BINCTX_MAGIC). */
+    uint32_t        u32Magic;
+    /** Number of frames produced so far. */
+    uint32_t        iFrame;
+    /** The owner. */
+    PUVM            pUVM;
+    /** The sample pattern, NULL for all. */
+    char           *pszPat;
+    /** The STAMUSERPERVM::uDeregGen value of the previous frame. */
+    uint32_t        uDeregGen;
+    /** Set when the next frame must be a key frame. */
+    bool            fNeedKeyFrame;
+    /** Set while producing a key frame. */
+    bool            fKeyFrame;
+    /** The number of entries in paPrev and bits in pbmKnown. */
+    uint32_t        cIds;
+    /** Previous values, indexed by sample ID. */
+    PSTAMBINPREV    paPrev;
+    /** Bitmap of the sample IDs the reader has seen schema records for. */
+    uint32_t       *pbmKnown;
+    /** The frame: header and schema records. */
+    STAMBINBUF      Frame;
+    /** The value records, appended to Frame when done. */
+    STAMBINBUF      Values;
+    /** The number of schema records in the current frame. */
+    uint32_t        cSchemas;
+    /** The number of value records in the current frame. */
+    uint32_t        cValues;
+    /** Status code of the current frame. */
+    int             rc;
+} STAMR3BINCTX;
+
+
+/**
+ * Sampler thread instance data.
+ */
+typedef struct STAMR3SAMPLER
+{
+    /** The user mode VM handle. */
+    PUVM            pUVM;
+    /** The snapshot context. */
+    PSTAMR3BINCTX   pCtx;
+    /** The output file or pipe name. */
+    char           *pszFilename;
+    /** The output handle, opened by the thread. */
+    RTFILE          hFile;
+    /** The sampler thread. */
+    RTTHREAD        hThread;
+    /** Event semaphore for waking up the thread. */
+    RTSEMEVENT      hEvtWakeup;
+    /** The interval between frames in milliseconds. */
+    uint32_t        cMsInterval;
+    /** Number of frames between forced key frames, 0 for only the first. */
+    uint32_t        cKeyFrameInterval;
+    /** Reference count; the owner and the thread each hold one. */
+    uint32_t volatile cRefs;
+    /** Set when the thread should stop. */
+    bool volatile   fShutdown;
+    /** Number of frames written. */
+    uint64_t        cFrames;
+    /** Number of bytes written. */
+    uint64_t        cbWritten;
+} STAMR3SAMPLER;
+/** Pointer to a sampler instance. */
+typedef STAMR3SAMPLER *PSTAMR3SAMPLER;
+
+
 /**
  * Init record for a ring-0 statistic sample.
  */
@@ -148,6 +272,7 @@ static int                  stamR3ResetOne(PSTAMDESC pDesc, void *pvArg);
 static DECLCALLBACK(void)   stamR3EnumLogPrintf(PSTAMR3PRINTONEARGS pvArg, const char *pszFormat, ...);
 static DECLCALLBACK(void)   stamR3EnumRelLogPrintf(PSTAMR3PRINTONEARGS pvArg, const char *pszFormat, ...);
 static DECLCALLBACK(void)   stamR3EnumPrintf(PSTAMR3PRINTONEARGS pvArg, const char *pszFormat, ...);
+static uint64_t             stamR3HistogramPercentile(PCSTAMHISTOGRAM pHist, uint32_t uPer10K);
 static int                  stamR3SnapshotOne(PSTAMDESC pDesc, void *pvArg);
 static int                  stamR3SnapshotPrintf(PSTAMR3SNAPSHOTONE pThis, const char *pszFormat, ...);
 static int                  stamR3PrintOne(PSTAMDESC pDesc, void *pvArg);
@@ -287,6 +412,9 @@ VMMR3DECL(int) STAMR3InitUVM(PUVM pUVM)
     AssertRCReturn(rc, rc);
 
     RTListInit(&pUVM->stam.s.List);
+    pUVM->stam.s.idNextSample = 0;
+    pUVM->stam.s.uDeregGen    = 0;
+    pUVM->stam.s.pSampler     = NULL;
 
 #ifdef STAM_WITH_LOOKUP_TREE
     /*
@@ -342,6 +470,12 @@ VMMR3DECL(int) STAMR3InitUVM(PUVM pUVM)
  */
 VMMR3DECL(void) STAMR3TermUVM(PUVM pUVM)
 {
+    /*
+     * The sampler is normally stopped by vmR3Destroy, but make sure.
+     */
+    if (pUVM->stam.s.pSampler)
+        STAMR3SamplerStop(pUVM);
+
     /*
      * Free used memory and the RWLock.
      */
@@ -1357,6 +1491,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
         case STAMTYPE_COUNTER:
         case STAMTYPE_PROFILE:
         case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
             AssertMsg(!((uintptr_t)pvSample & 7), ("%p - %s\n", pvSample, pszName));
             break;
 
@@ -1414,6 +1549,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
             pNew->u.Callback.pfnPrint = pfnPrint;
         }
         pNew->enmUnit       = enmUnit;
+        pNew->idSample      = pUVM->stam.s.idNextSample++;
         pNew->pszDesc       = NULL;
         if (pszDesc)
             pNew->pszDesc   = (char *)memcpy((char *)(pNew + 1) + cchName + 1, pszDesc, cbDesc);
@@ -1450,6 +1586,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
 static int stamR3DestroyDesc(PUVM pUVM, PSTAMDESC pCur)
 {
     RTListNodeRemove(&pCur->ListEntry);
+    ASMAtomicIncU32(&pUVM->stam.s.uDeregGen);
 #ifdef STAM_WITH_LOOKUP_TREE
     pCur->pLookup->pDesc = NULL; /** @todo free lookup nodes once it's working. */
     stamR3LookupDecUsage(pCur->pLookup);
@@ -1723,6 +1860,15 @@ static int stamR3ResetOne(PSTAMDESC pDesc, void *pvArg)
             ASMAtomicXchgU64(&pDesc->u.pProfile->cTicksMin, ~0);
             break;
 
+        case STAMTYPE_HISTOGRAM:
+            for (unsigned i = 0; i < RT_ELEMENTS(pDesc->u.pHistogram->aBuckets); i++)
+                ASMAtomicXchgU64(&pDesc->u.pHistogram->aBuckets[i], 0);
+            ASMAtomicXchgU64(&pDesc->u.pHistogram->Core.cPeriods, 0);
+            ASMAtomicXchgU64(&pDesc->u.pHistogram->Core.cTicks, 0);
+            ASMAtomicXchgU64(&pDesc->u.pHistogram->Core.cTicksMax, 0);
+            ASMAtomicXchgU64(&pDesc->u.pHistogram->Core.cTicksMin, ~0);
+            break;
+
         case STAMTYPE_RATIO_U32_RESET:
             ASMAtomicXchgU32(&pDesc->u.pRatioU32->u32A, 0);
             ASMAtomicXchgU32(&pDesc->u.pRatioU32->u32B, 0);
@@ -1779,6 +1925,40 @@ static int stamR3ResetOne(PSTAMDESC pDesc, void *pvArg)
 }
 
 
+/**
+ * Estimates a percentile of a histogram sample.
+ *
+ * @returns The upper bound of the bucket containing the requested rank,
+ *          capped at the recorded maximum.  0 if the histogram is empty.
+ * @param   pHist       The histogram.
+ * @param   uPer10K     The percentile in hundredths of a percent (9900 = p99).
+ */
+static uint64_t stamR3HistogramPercentile(PCSTAMHISTOGRAM pHist, uint32_t uPer10K)
+{
+    /* The buckets are updated without locking, so count them rather than trusting Core.cPeriods. */
+    uint64_t cTotal = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(pHist->aBuckets); i++)
+        cTotal += pHist->aBuckets[i];
+    if (!cTotal)
+        return 0;
+
+    uint64_t cRank = cTotal < UINT64_MAX / 10000
+                   ? (cTotal * uPer10K + 9999) / 10000
+                   : cTotal / 10000 * uPer10K;
+    if (!cRank)
+        cRank = 1;
+
+    uint64_t cSeen = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(pHist->aBuckets) - 1; i++)
+    {
+        cSeen += pHist->aBuckets[i];
+        if (cSeen >= cRank)
+            return RT_MIN(STAMHistogramBucketLow(i + 1) - 1, pHist->Core.cTicksMax);
+    }
+    return pHist->Core.cTicksMax;
+}
+
+
 /**
  * Get a snapshot of the statistics.
  * It's possible to select a subset of the samples.
@@ -1861,6 +2041,28 @@ static int stamR3SnapshotOne(PSTAMDESC pDesc, void *pvArg)
                                  pDesc->u.pProfile->cTicksMax);
             break;
 
+        case STAMTYPE_HISTOGRAM:
+        {
+            PCSTAMHISTOGRAM pHist = pDesc->u.pHistogram;
+            if (pDesc->enmVisibility == STAMVISIBILITY_USED && pHist->Core.cPeriods == 0)
+                return VINF_SUCCESS;
+            stamR3SnapshotPrintf(pThis, "<Histogram cSamples=\"%lld\" cTotal=\"%lld\" min=\"%lld\" max=\"%lld\""
+                                 " p50=\"%lld\" p90=\"%lld\" p99=\"%lld\" p999=\"%lld\" buckets=\"",
+                                 pHist->Core.cPeriods, pHist->Core.cTicks, pHist->Core.cTicksMin, pHist->Core.cTicksMax,
+                                 stamR3HistogramPercentile(pHist, 5000), stamR3HistogramPercentile(pHist, 9000),
+                                 stamR3HistogramPercentile(pHist, 9900), stamR3HistogramPercentile(pHist, 9990));
+            /* Only the non-empty buckets, as "lower-bound:count" pairs. */
+            const char *pszSep = "";
+            for (unsigned i = 0; i < RT_ELEMENTS(pHist->aBuckets); i++)
+                if (pHist->aBuckets[i])
+                {
+                    stamR3SnapshotPrintf(pThis, "%s%llu:%llu", pszSep, STAMHistogramBucketLow(i), pHist->aBuckets[i]);
+                    pszSep = " ";
+                }
+            stamR3SnapshotPrintf(pThis, "\"");
+            break;
+        }
+
         case STAMTYPE_RATIO_U32:
         case STAMTYPE_RATIO_U32_RESET:
             if (pDesc->enmVisibility == STAMVISIBILITY_USED && !pDesc->u.pRatioU32->u32A && !pDesc->u.pRatioU32->u32B)
@@ -2085,6 +2287,697 @@ VMMR3DECL(int)  STAMR3SnapshotFree(PUVM pUVM, char *pszSnapshot)
 }
 
 
+/**
+ * Makes sure there is room for @a cbNeeded more bytes in a binary snapshot
+ * buffer.
+ *
+ * @returns true if there is room, false on allocation failure.
+ * @param   pBuf        The buffer.
+ * @param   cbNeeded    The number of bytes about to be written.
+ */
+static bool stamR3BinBufEnsure(PSTAMBINBUF pBuf, size_t cbNeeded)
+{
+    if (RT_LIKELY(pBuf->cb - pBuf->off >= cbNeeded))
+        return true;
+
+    size_t cbNew = RT_MAX(pBuf->cb * 2, _16K);
+    while (cbNew - pBuf->off < cbNeeded)
+        cbNew *= 2;
+    uint8_t *pbNew = (uint8_t *)RTMemRealloc(pBuf->pb, cbNew);
+    if (!pbNew)
+        return false;
+    pBuf->pb = pbNew;
+    pBuf->cb = cbNew;
+    return true;
+}
+
+
+/**
+ * Appends an unsigned LEB128 varint, space must have been ensured.
+ *
+ * @param   pBuf        The buffer.
+ * @param   u64         The value.
+ */
+DECLINLINE(void) stamR3BinPutVarU64(PSTAMBINBUF pBuf, uint64_t u64)
+{
+    uint8_t *pb = &pBuf->pb[pBuf->off];
+    while (u64 >= 0x80)
+    {
+        *pb++ = (uint8_t)u64 | 0x80;
+        u64 >>= 7;
+    }
+    *pb++ = (uint8_t)u64;
+    pBuf->off = pb - pBuf->pb;
+}
+
+
+/**
+ * Appends a byte string preceded by its varint length, space must have been
+ * ensured.
+ *
+ * @param   pBuf        The buffer.
+ * @param   pch         The string.
+ * @param   cch         The string length.
+ */
+DECLINLINE(void) stamR3BinPutString(PSTAMBINBUF pBuf, const char *pch, size_t cch)
+{
+    stamR3BinPutVarU64(pBuf, cch);
+    memcpy(&pBuf->pb[pBuf->off], pch, cch);
+    pBuf->off += cch;
+}
+
+
+/**
+ * Appends the zigzag varint encoded difference between two values, space
+ * must have been ensured.
+ *
+ * @param   pBuf        The buffer.
+ * @param   uNew        The new value.
+ * @param   uOld        The previous value.
+ */
+DECLINLINE(void) stamR3BinPutVarDelta(PSTAMBINBUF pBuf, uint64_t uNew, uint64_t uOld)
+{
+    int64_t iDelta = (int64_t)(uNew - uOld);
+    stamR3BinPutVarU64(pBuf, ((uint64_t)iDelta << 1) ^ (uint64_t)(iDelta >> 63));
+}
+
+
+/**
+ * Resets what the reader is assumed to know about a sample's values.
+ *
+ * @param   pPrev       The previous values of the sample.
+ */
+static void stamR3BinPrevClear(PSTAMBINPREV pPrev)
+{
+    RT_ZERO(pPrev->au64);
+    if (pPrev->pau64Buckets)
+        RT_BZERO(pPrev->pau64Buckets, STAM_HISTOGRAM_BUCKETS * sizeof(uint64_t));
+}
+
+
+/**
+ * Appends the changed buckets of a histogram to the current value record.
+ *
+ * @returns VBox status code.
+ * @param   pCtx        The binary snapshot context.
+ * @param   pPrev       The previous values of the sample.
+ * @param   pHist       The histogram.
+ */
+static int stamR3BinPutHistogram(PSTAMR3BINCTX pCtx, PSTAMBINPREV pPrev, PCSTAMHISTOGRAM pHist)
+{
+    if (!pPrev->pau64Buckets)
+    {
+        pPrev->pau64Buckets = (uint64_t *)RTMemAllocZ(STAM_HISTOGRAM_BUCKETS * sizeof(uint64_t));
+        if (!pPrev->pau64Buckets)
+            return pCtx->rc = VERR_NO_MEMORY;
+    }
+    if (!stamR3BinBufEnsure(&pCtx->Values, (1 + 2 * STAM_HISTOGRAM_BUCKETS) * STAMBIN_MAX_VARINT))
+        return pCtx->rc = VERR_NO_MEMORY;
+
+    /* Snapshot the buckets so the count and the pairs agree. */
+    uint64_t au64Cur[STAM_HISTOGRAM_BUCKETS];
+    uint32_t cChanged = 0;
+    for (unsigned i = 0; i < STAM_HISTOGRAM_BUCKETS; i++)
+    {
+        au64Cur[i] = pHist->aBuckets[i];
+        cChanged += au64Cur[i] != pPrev->pau64Buckets[i];
+    }
+
+    stamR3BinPutVarU64(&pCtx->Values, cChanged);
+    unsigned iPrev = 0;
+    for (unsigned i = 0; i < STAM_HISTOGRAM_BUCKETS; i++)
+        if (au64Cur[i] != pPrev->pau64Buckets[i])
+        {
+            stamR3BinPutVarU64(&pCtx->Values, i - iPrev);
+            stamR3BinPutVarDelta(&pCtx->Values, au64Cur[i], pPrev->pau64Buckets[i]);
+            pPrev->pau64Buckets[i] = au64Cur[i];
+            iPrev = i;
+        }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads the current values of a sample.
+ *
+ * @returns Number of values, 0 for callback samples.
+ * @param   pDesc       The sample.
+ * @param   pau64       Where to return the values.
+ */
+static unsigned stamR3BinGetValues(PSTAMDESC pDesc, uint64_t pau64[STAMBIN_MAX_VALUES])
+{
+    switch (pDesc->enmType)
+    {
+        case STAMTYPE_COUNTER:
+            pau64[0] = pDesc->u.pCounter->c;
+            return 1;
+
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
+            pau64[0] = pDesc->u.pProfile->cPeriods;
+            pau64[1] = pDesc->u.pProfile->cTicks;
+            pau64[2] = pDesc->u.pProfile->cTicksMin;
+            pau64[3] = pDesc->u.pProfile->cTicksMax;
+            return 4;
+
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            pau64[0] = pDesc->u.pRatioU32->u32A;
+            pau64[1] = pDesc->u.pRatioU32->u32B;
+            return 2;
+
+        case STAMTYPE_U8:
+        case STAMTYPE_U8_RESET:
+        case STAMTYPE_X8:
+        case STAMTYPE_X8_RESET:
+            pau64[0] = *pDesc->u.pu8;
+            return 1;
+
+        case STAMTYPE_U16:
+        case STAMTYPE_U16_RESET:
+        case STAMTYPE_X16:
+        case STAMTYPE_X16_RESET:
+            pau64[0] = *pDesc->u.pu16;
+            return 1;
+
+        case STAMTYPE_U32:
+        case STAMTYPE_U32_RESET:
+        case STAMTYPE_X32:
+        case STAMTYPE_X32_RESET:
+            pau64[0] = *pDesc->u.pu32;
+            return 1;
+
+        case STAMTYPE_U64:
+        case STAMTYPE_U64_RESET:
+        case STAMTYPE_X64:
+        case STAMTYPE_X64_RESET:
+            pau64[0] = *pDesc->u.pu64;
+            return 1;
+
+        case STAMTYPE_BOOL:
+        case STAMTYPE_BOOL_RESET:
+            pau64[0] = *pDesc->u.pf;
+            return 1;
+
+        case STAMTYPE_CALLBACK:
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Makes sure the per-ID tables of a binary snapshot context cover @a idSample.
+ *
+ * @returns VBox status code.
+ * @param   pCtx        The binary snapshot context.
+ * @param   idSample    The sample ID.
+ */
+static int stamR3BinCtxGrow(PSTAMR3BINCTX pCtx, uint32_t idSample)
+{
+    uint32_t cNew = RT_MAX(pCtx->cIds * 2, 1024);
+    while (cNew <= idSample)
+        cNew *= 2;
+
+    PSTAMBINPREV paPrev = (PSTAMBINPREV)RTMemRealloc(pCtx->paPrev, cNew * sizeof(paPrev[0]));
+    if (!paPrev)
+        return VERR_NO_MEMORY;
+    pCtx->paPrev = paPrev;
+    RT_BZERO(&paPrev[pCtx->cIds], (cNew - pCtx->cIds) * sizeof(paPrev[0]));
+
+    uint32_t *pbmKnown = (uint32_t *)RTMemRealloc(pCtx->pbmKnown, cNew / 8);
+    if (!pbmKnown)
+        return VERR_NO_MEMORY;
+    pCtx->pbmKnown = pbmKnown;
+    RT_BZERO((uint8_t *)pbmKnown + pCtx->cIds / 8, (cNew - pCtx->cIds) / 8);
+
+    pCtx->cIds = cNew;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * stamR3EnumU callback employed by STAMR3SnapshotBinary.
+ *
+ * @returns VBox status code, but it's interpreted as 0 == success / !0 == failure by enmR3Enum.
+ * @param   pDesc       The sample.
+ * @param   pvArg       The binary snapshot context.
+ */
+static int stamR3SnapshotBinaryOne(PSTAMDESC pDesc, void *pvArg)
+{
+    PSTAMR3BINCTX pCtx     = (PSTAMR3BINCTX)pvArg;
+    uint32_t      idSample = pDesc->idSample;
+    if (idSample >= pCtx->cIds)
+    {
+        pCtx->rc = stamR3BinCtxGrow(pCtx, idSample);
+        if (RT_FAILURE(pCtx->rc))
+            return pCtx->rc;
+    }
+
+    /*
+     * Describe the sample if the reader hasn't seen it yet.
+     */
+    if (!ASMBitTest(pCtx->pbmKnown, idSample))
+    {
+        size_t cchName = strlen(pDesc->pszName);
+        size_t cchDesc = pDesc->pszDesc ? strlen(pDesc->pszDesc) : 0;
+        if (!stamR3BinBufEnsure(&pCtx->Frame, cchName + cchDesc + 3 * STAMBIN_MAX_VARINT + 3))
+            return pCtx->rc = VERR_NO_MEMORY;
+        stamR3BinPutVarU64(&pCtx->Frame, idSample);
+        pCtx->Frame.pb[pCtx->Frame.off++] = (uint8_t)pDesc->enmType;
+        pCtx->Frame.pb[pCtx->Frame.off++] = (uint8_t)pDesc->enmUnit;
+        pCtx->Frame.pb[pCtx->Frame.off++] = (uint8_t)pDesc->enmVisibility;
+        stamR3BinPutString(&pCtx->Frame, pDesc->pszName, cchName);
+        stamR3BinPutString(&pCtx->Frame, pDesc->pszDesc, cchDesc);
+        pCtx->cSchemas++;
+
+        ASMBitSet(pCtx->pbmKnown, idSample);
+        stamR3BinPrevClear(&pCtx->paPrev[idSample]);
+    }
+
+    /*
+     * Callbacks can only be rendered as text and are always included.
+     */
+    if (pDesc->enmType == STAMTYPE_CALLBACK)
+    {
+        char szBuf[512];
+        szBuf[0] = '\0';
+        pDesc->u.Callback.pfnPrint(pCtx->pUVM->pVM, pDesc->u.Callback.pvSample, szBuf, sizeof(szBuf));
+        size_t cch = strlen(szBuf);
+        if (!stamR3BinBufEnsure(&pCtx->Values, cch + 2 * STAMBIN_MAX_VARINT))
+            return pCtx->rc = VERR_NO_MEMORY;
+        stamR3BinPutVarU64(&pCtx->Values, idSample);
+        stamR3BinPutString(&pCtx->Values, szBuf, cch);
+        pCtx->cValues++;
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Delta encode the values, skipping samples that didn't change.
+     */
+    uint64_t     au64[STAMBIN_MAX_VALUES];
+    unsigned     cValues = stamR3BinGetValues(pDesc, au64);
+    PSTAMBINPREV pPrev   = &pCtx->paPrev[idSample];
+    unsigned     iValue  = 0;
+    while (iValue < cValues && au64[iValue] == pPrev->au64[iValue])
+        iValue++;
+    if (iValue >= cValues)
+        return VINF_SUCCESS;
+
+    if (!stamR3BinBufEnsure(&pCtx->Values, (1 + STAMBIN_MAX_VALUES) * STAMBIN_MAX_VARINT))
+        return pCtx->rc = VERR_NO_MEMORY;
+    stamR3BinPutVarU64(&pCtx->Values, idSample);
+    for (iValue = 0; iValue < cValues; iValue++)
+    {
+        stamR3BinPutVarDelta(&pCtx->Values, au64[iValue], pPrev->au64[iValue]);
+        pPrev->au64[iValue] = au64[iValue];
+    }
+    pCtx->cValues++;
+
+    if (pDesc->enmType == STAMTYPE_HISTOGRAM)
+        return stamR3BinPutHistogram(pCtx, pPrev, pDesc->u.pHistogram);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Creates a binary snapshot context.
+ *
+ * The context remembers what the consumer has already been told, so that
+ * successive calls to STAMR3SnapshotBinary only produce schema records for new
+ * samples and the values which changed since the previous frame.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pszPat          The name matching pattern. See somewhere_where_this_is_described_in_detail.
+ *                          If NULL all samples are included.
+ * @param   ppCtx           Where to return the context.  Free it using
+ *                          STAMR3BinCtxDestroy().
+ */
+VMMR3DECL(int) STAMR3BinCtxCreate(PUVM pUVM, const char *pszPat, PSTAMR3BINCTX *ppCtx)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(ppCtx, VERR_INVALID_POINTER);
+    *ppCtx = NULL;
+
+    PSTAMR3BINCTX pCtx = (PSTAMR3BINCTX)RTMemAllocZ(sizeof(*pCtx));
+    if (!pCtx)
+        return VERR_NO_MEMORY;
+    pCtx->u32Magic      = STAMR3BINCTX_MAGIC;
+    pCtx->pUVM          = pUVM;
+    pCtx->fNeedKeyFrame = true;
+    if (pszPat && *pszPat && strcmp(pszPat, "*"))
+    {
+        pCtx->pszPat = RTStrDup(pszPat);
+        if (!pCtx->pszPat)
+        {
+            RTMemFree(pCtx);
+            return VERR_NO_STR_MEMORY;
+        }
+    }
+
+    *ppCtx = pCtx;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Destroys a binary snapshot context.
+ *
+ * @param   pCtx            The context. NULL is ignored.  Any frame returned by
+ *                          STAMR3SnapshotBinary becomes invalid.
+ */
+VMMR3DECL(void) STAMR3BinCtxDestroy(PSTAMR3BINCTX pCtx)
+{
+    if (!pCtx)
+        return;
+    AssertReturnVoid(pCtx->u32Magic == STAMR3BINCTX_MAGIC);
+    pCtx->u32Magic = ~STAMR3BINCTX_MAGIC;
+
+    RTMemFree(pCtx->Frame.pb);
+    RTMemFree(pCtx->Values.pb);
+    for (uint32_t i = 0; i < pCtx->cIds; i++)
+        RTMemFree(pCtx->paPrev[i].pau64Buckets);
+    RTMemFree(pCtx->paPrev);
+    RTMemFree(pCtx->pbmKnown);
+    RTStrFree(pCtx->pszPat);
+    RTMemFree(pCtx);
+}
+
+
+/**
+ * Takes a binary statistics snapshot.
+ *
+ * This is a much cheaper alternative to STAMR3Snapshot for monitoring agents
+ * that poll frequently.  See @ref grp_stam_r3_bin for the format.
+ *
+ * @returns VBox status code.  On failure the next frame will be a key frame.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pCtx            The binary snapshot context.
+ * @param   fKeyFrame       Whether to produce a key frame.  The first frame
+ *                          and the first frame after samples were deregistered
+ *                          are always key frames.
+ * @param   ppvFrame        Where to return the frame.  The buffer belongs to
+ *                          the context and is valid until the next call.
+ * @param   pcbFrame        Where to return the frame size.
+ */
+VMMR3DECL(int) STAMR3SnapshotBinary(PUVM pUVM, PSTAMR3BINCTX pCtx, bool fKeyFrame, const void **ppvFrame, size_t *pcbFrame)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_VALID_EXT_RETURN(pUVM->pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pCtx, VERR_INVALID_POINTER);
+    AssertReturn(pCtx->u32Magic == STAMR3BINCTX_MAGIC, VERR_INVALID_MAGIC);
+    AssertReturn(pCtx->pUVM == pUVM, VERR_INVALID_PARAMETER);
+    AssertPtrReturn(ppvFrame, VERR_INVALID_POINTER);
+    AssertPtrReturn(pcbFrame, VERR_INVALID_POINTER);
+    *ppvFrame = NULL;
+    *pcbFrame = 0;
+
+    /*
+     * Start over if requested or if samples went away, as the reader cannot
+     * tell a removed sample from an unchanged one.
+     */
+    uint32_t const uDeregGen = ASMAtomicReadU32(&pUVM->stam.s.uDeregGen);
+    if (   fKeyFrame
+        || pCtx->fNeedKeyFrame
+        || uDeregGen != pCtx->uDeregGen)
+    {
+        pCtx->fKeyFrame = true;
+        pCtx->uDeregGen = uDeregGen;
+        if (pCtx->cIds)
+        {
+            for (uint32_t i = 0; i < pCtx->cIds; i++)
+                stamR3BinPrevClear(&pCtx->paPrev[i]);
+            RT_BZERO(pCtx->pbmKnown, pCtx->cIds / 8);
+        }
+    }
+    else
+        pCtx->fKeyFrame = false;
+
+    if (!stamR3BinBufEnsure(&pCtx->Frame, sizeof(STAMBINHDR)))
+        return VERR_NO_MEMORY;
+    pCtx->Frame.off  = sizeof(STAMBINHDR);
+    pCtx->Values.off = 0;
+    pCtx->cSchemas   = 0;
+    pCtx->cValues    = 0;
+    pCtx->rc         = VINF_SUCCESS;
+
+    uint64_t const u64NanoTS = RTTimeNanoTS();
+    int rc = stamR3EnumU(pUVM, pCtx->pszPat, true /* fUpdateRing0 */, stamR3SnapshotBinaryOne, pCtx);
+    if (RT_SUCCESS(rc))
+        rc = pCtx->rc;
+
+    /*
+     * Join the two parts and fill in the header.
+     */
+    if (   RT_SUCCESS(rc)
+        && !stamR3BinBufEnsure(&pCtx->Frame, pCtx->Values.off))
+        rc = VERR_NO_MEMORY;
+    if (RT_SUCCESS(rc) && pCtx->Frame.off + pCtx->Values.off > UINT32_MAX)
+        rc = VERR_BUFFER_OVERFLOW;
+    if (RT_FAILURE(rc))
+    {
+        /* The reader and the context no longer agree on the previous values. */
+        pCtx->fNeedKeyFrame = true;
+        return rc;
+    }
+
+    if (pCtx->Values.off)
+        memcpy(&pCtx->Frame.pb[pCtx->Frame.off], pCtx->Values.pb, pCtx->Values.off);
+    pCtx->Frame.off += pCtx->Values.off;
+
+    PSTAMBINHDR pHdr = (PSTAMBINHDR)pCtx->Frame.pb;
+    pHdr->u32Magic  = STAMBIN_MAGIC;
+    pHdr->uVersion  = STAMBIN_VERSION;
+    pHdr->fFlags    = pCtx->fKeyFrame ? STAMBIN_F_KEYFRAME : 0;
+    pHdr->cbFrame   = (uint32_t)pCtx->Frame.off;
+    pHdr->iFrame    = pCtx->iFrame++;
+    pHdr->u64NanoTS = u64NanoTS;
+    pHdr->cSchemas  = pCtx->cSchemas;
+    pHdr->cValues   = pCtx->cValues;
+
+    pCtx->fNeedKeyFrame = false;
+    *ppvFrame = pHdr;
+    *pcbFrame = pCtx->Frame.off;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Releases a sampler instance reference.
+ *
+ * @param   pSampler        The sampler instance.
+ */
+static void stamR3SamplerRelease(PSTAMR3SAMPLER pSampler)
+{
+    if (ASMAtomicDecU32(&pSampler->cRefs) != 0)
+        return;
+
+    if (pSampler->hFile != NIL_RTFILE)
+        RTFileClose(pSampler->hFile);
+    RTSemEventDestroy(pSampler->hEvtWakeup);
+    STAMR3BinCtxDestroy(pSampler->pCtx);
+    RTStrFree(pSampler->pszFilename);
+    RTMemFree(pSampler);
+}
+
+
+/**
+ * The sampler thread.
+ *
+ * Opens the output (which may block for a named pipe until a reader connects)
+ * and writes a frame every STAMR3SAMPLER::cMsInterval milliseconds.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hThreadSelf     The thread handle.
+ * @param   pvUser          The sampler instance.
+ */
+static DECLCALLBACK(int) stamR3SamplerThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PSTAMR3SAMPLER pSampler = (PSTAMR3SAMPLER)pvUser;
+    NOREF(hThreadSelf);
+
+    int rc = RTFileOpen(&pSampler->hFile, pSampler->pszFilename,
+                        RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("STAM: Failed to open sampler output '%s': %Rrc\n", pSampler->pszFilename, rc));
+        pSampler->hFile = NIL_RTFILE;
+    }
+
+    uint64_t u64NextTS = RTTimeMilliTS();
+    while (   RT_SUCCESS(rc)
+           && !ASMAtomicReadBool(&pSampler->fShutdown))
+    {
+        bool const fKeyFrame = pSampler->cKeyFrameInterval
+                            && pSampler->cFrames % pSampler->cKeyFrameInterval == 0;
+        const void *pvFrame;
+        size_t      cbFrame;
+        rc = STAMR3SnapshotBinary(pSampler->pUVM, pSampler->pCtx, fKeyFrame, &pvFrame, &cbFrame);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTFileWrite(pSampler->hFile, pvFrame, cbFrame, NULL);
+            if (RT_SUCCESS(rc))
+            {
+                pSampler->cFrames++;
+                pSampler->cbWritten += cbFrame;
+            }
+            else
+                LogRel(("STAM: Sampler write to '%s' failed: %Rrc\n", pSampler->pszFilename, rc));
+        }
+        else
+            LogRel(("STAM: Sampler snapshot failed: %Rrc\n", rc));
+
+        /* Fixed rate; skip ticks rather than bursting if we fell behind. */
+        u64NextTS += pSampler->cMsInterval;
+        uint64_t u64Now = RTTimeMilliTS();
+        if (u64NextTS <= u64Now)
+            u64NextTS = u64Now + pSampler->cMsInterval;
+        if (!ASMAtomicReadBool(&pSampler->fShutdown))
+            RTSemEventWait(pSampler->hEvtWakeup, (RTMSINTERVAL)(u64NextTS - u64Now));
+    }
+
+    LogRel(("STAM: Sampler wrote %RU64 frames (%RU64 bytes) to '%s'\n",
+            pSampler->cFrames, pSampler->cbWritten, pSampler->pszFilename));
+    stamR3SamplerRelease(pSampler);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts a thread streaming binary snapshots to a file or named pipe.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_ALREADY_EXISTS if a sampler is already running.
+ * @param   pUVM                The user mode VM handle.
+ * @param   pszFilename         The output file or named pipe.  The thread opens
+ *                              it, so a pipe without a reader won't block the
+ *                              caller.
+ * @param   pszPat              The name matching pattern, NULL for all samples.
+ * @param   cMsInterval         The interval between frames in milliseconds.
+ * @param   cKeyFrameInterval   Number of frames between key frames, so a
+ *                              reader can pick up the stream midway.  0 means
+ *                              only the first frame (and those forced by
+ *                              deregistrations) are key frames.
+ */
+VMMR3DECL(int) STAMR3SamplerStart(PUVM pUVM, const char *pszFilename, const char *pszPat, uint32_t cMsInterval,
+                                  uint32_t cKeyFrameInterval)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    AssertReturn(*pszFilename, VERR_INVALID_PARAMETER);
+    AssertReturn(cMsInterval > 0 && cMsInterval <= RT_MS_1HOUR, VERR_OUT_OF_RANGE);
+    if (pUVM->stam.s.pSampler)
+        return VERR_ALREADY_EXISTS;
+
+    PSTAMR3SAMPLER pSampler = (PSTAMR3SAMPLER)RTMemAllocZ(sizeof(*pSampler));
+    if (!pSampler)
+        return VERR_NO_MEMORY;
+    pSampler->pUVM              = pUVM;
+    pSampler->hFile             = NIL_RTFILE;
+    pSampler->hThread           = NIL_RTTHREAD;
+    pSampler->hEvtWakeup        = NIL_RTSEMEVENT;
+    pSampler->cMsInterval       = cMsInterval;
+    pSampler->cKeyFrameInterval = cKeyFrameInterval;
+    pSampler->cRefs             = 1;
+
+    int rc = VERR_NO_STR_MEMORY;
+    pSampler->pszFilename = RTStrDup(pszFilename);
+    if (pSampler->pszFilename)
+        rc = STAMR3BinCtxCreate(pUVM, pszPat, &pSampler->pCtx);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pSampler->hEvtWakeup);
+    if (RT_SUCCESS(rc))
+    {
+        pSampler->cRefs = 2;
+        rc = RTThreadCreate(&pSampler->hThread, stamR3SamplerThread, pSampler, 0,
+                            RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "StamSampler");
+        if (RT_SUCCESS(rc))
+        {
+            pUVM->stam.s.pSampler = pSampler;
+            LogRel(("STAM: Sampling '%s' every %u ms to '%s'\n", pszPat ? pszPat : "*", cMsInterval, pszFilename));
+            return VINF_SUCCESS;
+        }
+        pSampler->cRefs = 1;
+    }
+
+    stamR3SamplerRelease(pSampler);
+    return rc;
+}
+
+
+/**
+ * Stops the sampler thread started by STAMR3SamplerStart.
+ *
+ * @returns VBox status code.
+ * @retval  VINF_SUCCESS if not running.
+ * @retval  VERR_TIMEOUT if the thread is stuck (e.g. opening a pipe nobody
+ *          reads).  It has been told to quit and will clean up after itself.
+ * @param   pUVM            The user mode VM handle.
+ */
+VMMR3DECL(int) STAMR3SamplerStop(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PSTAMR3SAMPLER pSampler = pUVM->stam.s.pSampler;
+    if (!pSampler)
+        return VINF_SUCCESS;
+    pUVM->stam.s.pSampler = NULL;
+
+    ASMAtomicWriteBool(&pSampler->fShutdown, true);
+    RTSemEventSignal(pSampler->hEvtWakeup);
+    int rc = RTThreadWait(pSampler->hThread, 5000, NULL);
+    if (RT_FAILURE(rc))
+        LogRel(("STAM: Sampler thread did not stop: %Rrc\n", rc));
+
+    stamR3SamplerRelease(pSampler);
+    return rc;
+}
+
+
+/**
+ * Starts the sampler if configured, called when ring-3 init has completed.
+ *
+ * The configuration lives in /STAM/Sampler: File (required), Pattern,
+ * Interval (ms) and KeyFrameInterval (frames).  The sampler is a diagnostics
+ * aid, so failing to start it is logged and doesn't fail VM creation.
+ *
+ * @param   pVM             Pointer to the VM.
+ */
+VMMR3_INT_DECL(void) STAMR3InitCompleted(PVM pVM)
+{
+    PCFGMNODE pCfg = CFGMR3GetChild(CFGMR3GetRoot(pVM), "STAM/Sampler");
+    if (!pCfg)
+        return;
+
+    char *pszFilename = NULL;
+    int rc = CFGMR3QueryStringAllocDef(pCfg, "File", &pszFilename, NULL);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("STAM: Failed to query /STAM/Sampler/File: %Rrc\n", rc));
+        return;
+    }
+    if (!pszFilename)
+        return;
+
+    char *pszPat = NULL;
+    uint32_t cMsInterval = 0;
+    uint32_t cKeyFrameInterval = 0;
+    rc = CFGMR3QueryStringAllocDef(pCfg, "Pattern", &pszPat, "*");
+    if (RT_SUCCESS(rc))
+        rc = CFGMR3QueryU32Def(pCfg, "Interval", &cMsInterval, 1000);
+    if (RT_SUCCESS(rc))
+        rc = CFGMR3QueryU32Def(pCfg, "KeyFrameInterval", &cKeyFrameInterval, 60);
+    if (RT_SUCCESS(rc))
+        rc = STAMR3SamplerStart(pVM->pUVM, pszFilename, pszPat, cMsInterval, cKeyFrameInterval);
+    if (RT_FAILURE(rc))
+        LogRel(("STAM: Failed to start the sampler: %Rrc\n", rc));
+
+    MMR3HeapFree(pszPat);
+    MMR3HeapFree(pszFilename);
+}
+
+
 /**
  * Dumps the selected statistics to the log.
  *
@@ -2238,6 +3131,21 @@ static int stamR3PrintOne(PSTAMDESC pDesc, void *pvArg)
             break;
         }
 
+        case STAMTYPE_HISTOGRAM:
+        {
+            PCSTAMHISTOGRAM pHist = pDesc->u.pHistogram;
+            if (pDesc->enmVisibility == STAMVISIBILITY_USED && pHist->Core.cPeriods == 0)
+                return VINF_SUCCESS;
+
+            uint64_t u64 = pHist->Core.cPeriods ? pHist->Core.cPeriods : 1;
+            pArgs->pfnPrintf(pArgs, "%-32s %8llu %s (%7llu times, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu)\n",
+                             pDesc->pszName, pHist->Core.cTicks / u64, STAMR3GetUnit(pDesc->enmUnit), pHist->Core.cPeriods,
+                             stamR3HistogramPercentile(pHist, 5000), stamR3HistogramPercentile(pHist, 9000),
+                             stamR3HistogramPercentile(pHist, 9900), stamR3HistogramPercentile(pHist, 9990),
+                             pHist->Core.cTicksMax);
+            break;
+        }
+
         case STAMTYPE_RATIO_U32:
         case STAMTYPE_RATIO_U32_RESET:
             if (pDesc->enmVisibility == STAMVISIBILITY_USED && !pDesc->u.pRatioU32->u32A && !pDesc->u.pRatioU32->u32B)
@@ -83,6 +83,7 @@
 #include <iprt/alloc.h>
 #include <iprt/asm.h>
 #include <iprt/env.h>
+#include <iprt/path.h>
 #include <iprt/string.h>
 #include <iprt/time.h>
 #include <iprt/semaphore.h>
@@ -1174,6 +1175,8 @@ static int vmR3InitDoCompleted(PVM pVM, VMINITCOMPLETED enmWhat)
         rc = HMR3InitCompleted(pVM, enmWhat);
     if (RT_SUCCESS(rc))
         rc = PGMR3InitCompleted(pVM, enmWhat);  /** @todo Why is this not inside VMMR3InitCompleted()? */
+    if (RT_SUCCESS(rc) && enmWhat == VMINITCOMPLETED_RING3)
+        STAMR3InitCompleted(pVM);
 #ifndef VBOX_WITH_RAW_MODE
     if (enmWhat == VMINITCOMPLETED_RING3)
     {
@@ -1958,6 +1961,86 @@ VMMR3DECL(int) VMR3Save(PUVM pUVM, const char *pszFilename, bool fContinueAfterw
     return rc;
 }
 
+
+/**
+ * Save current VM state as part of an incremental chain.
+ *
+ * This works like VMR3Save, except that the saved state gets an ID which the
+ * RAM changes are tracked relative to afterwards.  When a parent is given, only
+ * the RAM pages written to since that saved state was created (or restored)
+ * are included, the rest are loaded from the parent (and its parents) when the
+ * new saved state is restored.  The parent files must therefore be kept around
+ * at the same location.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_NO_INCREMENTAL_BASE if @a pszParentFilename is given but
+ *          RAM changes aren't being tracked relative to any saved state.
+ * @retval  VERR_NOT_SUPPORTED if fault tolerance is enabled.  Both need the
+ *          RAM write monitoring.
+ *
+ * @param   pUVM                The VM which state should be saved.
+ * @param   pszFilename         The name of the save state file.
+ * @param   pszParentFilename   The name of the most recent saved state created
+ *                              or restored by this function / VMR3LoadFromFile.
+ *                              NULL for a full saved state.
+ * @param   fContinueAfterwards Whether continue execution afterwards or not.
+ *                              When in doubt, set this to true.
+ * @param   pfnProgress         Progress callback. Optional.
+ * @param   pvUser              User argument for the progress callback.
+ * @param   pfSuspended         Set if we suspended the VM.
+ *
+ * @thread      Non-EMT.
+ * @vmstate     Suspended or Running
+ * @vmstateto   Saving+Suspended or
+ *              RunningLS+SuspendingLS+SuspendedLS+Saving+Suspended.
+ */
+VMMR3DECL(int) VMR3SaveIncremental(PUVM pUVM, const char *pszFilename, const char *pszParentFilename, bool fContinueAfterwards,
+                                   PFNVMPROGRESS pfnProgress, void *pvUser, bool *pfSuspended)
+{
+    LogFlow(("VMR3SaveIncremental: pUVM=%p pszFilename=%p:{%s} pszParentFilename=%p:{%s} fContinueAfterwards=%RTbool pfnProgress=%p pvUser=%p pfSuspended=%p\n",
+             pUVM, pszFilename, pszFilename, pszParentFilename, pszParentFilename, fContinueAfterwards, pfnProgress, pvUser, pfSuspended));
+
+    /*
+     * Validate input.
+     */
+    AssertPtr(pfSuspended);
+    *pfSuspended = false;
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    VM_ASSERT_OTHER_THREAD(pVM);
+    AssertReturn(VALID_PTR(pszFilename), VERR_INVALID_POINTER);
+    AssertReturn(*pszFilename, VERR_INVALID_PARAMETER);
+    AssertPtrNullReturn(pszParentFilename, VERR_INVALID_POINTER);
+    AssertReturn(!pszParentFilename || *pszParentFilename, VERR_INVALID_PARAMETER);
+    AssertPtrNullReturn(pfnProgress, VERR_INVALID_POINTER);
+
+    /*
+     * The parent path is stored in the new saved state, so make it absolute.
+     */
+    char szParent[RTPATH_MAX];
+    if (pszParentFilename)
+    {
+        int rc = RTPathAbs(pszParentFilename, szParent, sizeof(szParent));
+        if (RT_FAILURE(rc))
+            return rc;
+        pszParentFilename = szParent;
+    }
+
+    int rc = PGMR3SaveIncrementalBegin(pVM, pszParentFilename);
+    if (RT_SUCCESS(rc))
+    {
+        SSMAFTER enmAfter = fContinueAfterwards ? SSMAFTER_CONTINUE : SSMAFTER_DESTROY;
+        rc = vmR3SaveTeleport(pVM, 250 /*cMsMaxDowntime*/,
+                              pszFilename, NULL /* pStreamOps */, NULL /* pvStreamOpsUser */,
+                              enmAfter, pfnProgress, pvUser, pfSuspended,
+                              false /* fSkipStateChanges */);
+        PGMR3SaveIncrementalEnd(pVM);
+    }
+    LogFlow(("VMR3SaveIncremental: returns %Rrc (*pfSuspended=%RTbool)\n", rc, *pfSuspended));
+    return rc;
+}
+
 /**
  * Save current VM state (used by FTM)
  *
@@ -2484,8 +2567,9 @@ DECLCALLBACK(int) vmR3Destroy(PVM pVM)
     if (pVCpu->idCpu == 0)
     {
         /*
-         * Dump statistics to the log.
+         * Stop the statistics sampler and dump statistics to the log.
          */
+        STAMR3SamplerStop(pUVM);
 #if defined(VBOX_WITH_STATISTICS) || defined(LOG_ENABLED)
         RTLogFlags(NULL, "nodisabled nobuffered");
 #endif
@@ -48,6 +48,11 @@
 # define PDM_ASYNC_COMPLETION_FILE_WITH_DELAY
 #endif
 
+/** Default maximum size of a request combined from adjacent tasks. */
+#define PDMACEPFILE_MERGE_MAX_DEFAULT       _128K
+/** Default number of new tasks ordered by offset before submission. */
+#define PDMACEPFILE_SCHED_WINDOW_DEFAULT    64
+
 RT_C_DECLS_BEGIN
 
 /**
@@ -271,6 +276,10 @@ typedef struct PDMASYNCCOMPLETIONEPCLASSFILE
     RTR3UINTPTR                         uBitmaskAlignment;
     /** Flag whether the out of resources warning was printed already. */
     bool                                fOutOfResourcesWarningPrinted;
+    /** Maximum number of bytes to combine into a single host request, 0 disables merging. */
+    uint32_t                            cbMergeMax;
+    /** Maximum number of new tasks sorted by offset before submission, 0 keeps the arrival order. */
+    uint32_t                            cSchedWindow;
 #ifdef PDM_ASYNC_COMPLETION_FILE_WITH_DELAY
     /** Timer for delayed request completion. */
     PTMTIMERR3                          pTimer;
@@ -365,6 +374,12 @@ typedef struct PDMASYNCCOMPLETIONENDPOINTFILE
     /** Time spend in a write. */
     STAMPROFILEADV                         StatWrite;
 #endif
+    /** Number of read and write tasks submitted to the host. */
+    STAMCOUNTER                            StatTasksRw;
+    /** Number of read and write requests the tasks were submitted with. */
+    STAMCOUNTER                            StatHostReqsRw;
+    /** Number of tasks merged into the request of a preceding task. */
+    STAMCOUNTER                            StatTasksMerged;
 
     /** Event semaphore for blocking external events.
      * The caller waits on it until the async I/O manager
@@ -499,6 +514,10 @@ typedef struct PDMACTASKFILE
      * was not queued because the host has not enough
      * resources. */
     RTFILEAIOREQ                         hReq;
+    /** Next task merged into this one for a single host request.
+     * Only the head of the chain owns the I/O request, the bounce
+     * buffer and the range lock. */
+    struct PDMACTASKFILE                *pMergedNext;
     /** Completion function to call on completion. */
     PFNPDMACTASKCOMPLETED                pfnCompleted;
     /** User data */
@@ -175,6 +175,8 @@ typedef struct PDMASYNCCOMPLETIONEPCLASS
     RTCRITSECT                                  CritSect;
     /** Number of endpoints in the list. */
     volatile unsigned                           cEndpoints;
+    /** Number of endpoints created so far, used to make statistics names unique. */
+    uint32_t                                    cEndpointsCreated;
     /** Head of endpoints with this class. */
     R3PTRTYPE(PPDMASYNCCOMPLETIONENDPOINT)      pEndpointsHead;
     /** Head of the bandwidth managers for this class. */
@@ -209,8 +211,8 @@ typedef struct PDMASYNCCOMPLETIONENDPOINT
     char                                       *pszUri;
     /** Pointer to the assigned bandwidth manager. */
     volatile PPDMACBWMGR                        pBwMgr;
-    /** Aligns following statistic counters on a 8 byte boundary. */
-    uint32_t                                    u32Alignment;
+    /** Name of the endpoint in the statistics tree (unique file name). */
+    char                                       *pszStatId;
     /** @name Request size statistics.
      * @{ */
     STAMCOUNTER                                 StatReqSizeSmaller512;
@@ -242,9 +244,12 @@ typedef struct PDMASYNCCOMPLETIONENDPOINT
     uint64_t                                    tsIntervalStartMs;
     uint64_t                                    cIoOpsCompleted;
     /** @} */
+    /** Task completion latency histogram (always gathered). */
+    STAMHISTOGRAM                               StatTaskLatency;
 } PDMASYNCCOMPLETIONENDPOINT;
 AssertCompileMemberAlignment(PDMASYNCCOMPLETIONENDPOINT, StatReqSizeSmaller512, sizeof(uint64_t));
 AssertCompileMemberAlignment(PDMASYNCCOMPLETIONENDPOINT, StatTaskRunTimesNs, sizeof(uint64_t));
+AssertCompileMemberAlignment(PDMASYNCCOMPLETIONENDPOINT, StatTaskLatency, sizeof(uint64_t));
 
 /**
  * A PDM async completion task handle.
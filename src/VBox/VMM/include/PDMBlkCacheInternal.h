@@ -41,6 +41,8 @@ RT_C_DECLS_BEGIN
 typedef struct PDMBLKLRULIST *PPDMBLKLRULIST;
 /** Pointer to the global cache structure. */
 typedef struct PDMBLKCACHEGLOBAL *PPDMBLKCACHEGLOBAL;
+/** Pointer to a cache shard. */
+typedef struct PDMBLKCACHESHARD *PPDMBLKCACHESHARD;
 /** Pointer to a cache entry waiter structure. */
 typedef struct PDMBLKCACHEWAITER *PPDMBLKCACHEWAITER;
 
@@ -59,6 +61,8 @@ typedef struct PDMBLKCACHEENTRY
     PPDMBLKLRULIST                  pList;
     /** Cache the entry belongs to. */
     PPDMBLKCACHE                    pBlkCache;
+    /** Shard the entry is accounted to, fixed for the lifetime of the entry. */
+    PPDMBLKCACHESHARD               pShard;
     /** Flags for this entry. Combinations of PDMACFILECACHE_* #defines */
     volatile uint32_t               fFlags;
     /** Reference counter. Prevents eviction of the entry if > 0. */
@@ -96,29 +100,95 @@ typedef struct PDMBLKLRULIST
     uint32_t          cbCached;
 } PDMBLKLRULIST;
 
+/** Maximum number of cache shards. */
+#define PDMBLKCACHE_SHARDS_MAX              64
+/** Minimum amount of cache memory per shard when the shard count is derived from
+ * the cache size. Keeps shards big enough to hold typical request sizes. */
+#define PDMBLKCACHE_SHARD_SIZE_MIN          (4 * _1M)
+/** Shift of the offset range which is mapped to a single shard (1MB). */
+#define PDMBLKCACHE_SHARD_RANGE_SHIFT       20
+
 /**
- * Global cache data.
+ * Cache replacement policy.
  */
-typedef struct PDMBLKCACHEGLOBAL
+typedef enum PDMBLKCACHEPOLICY
 {
-    /** Pointer to the owning VM instance. */
-    PVM                 pVM;
-    /** Maximum size of the cache in bytes. */
+    /** Invalid policy. */
+    PDMBLKCACHEPOLICY_INVALID = 0,
+    /** 2Q with fixed list sizes (A1in 25%, A1out 50% of the cache). */
+    PDMBLKCACHEPOLICY_2Q,
+    /** Adaptive replacement cache, the size of the recently used list
+     * follows the hits in the ghost lists. */
+    PDMBLKCACHEPOLICY_ARC,
+    /** 32bit hack. */
+    PDMBLKCACHEPOLICY_32BIT_HACK = 0x7fffffff
+} PDMBLKCACHEPOLICY;
+
+/**
+ * A cache shard.
+ *
+ * The cache is partitioned into shards by (disk, offset range). Each shard
+ * has its own lock, its own share of the cache memory and its own set of 2Q
+ * lists so that accesses to different disks or distant offsets don't contend
+ * on a single lock.
+ */
+typedef struct PDMBLKCACHESHARD
+{
+    /** Critical section protecting the shard. */
+    RTCRITSECT          CritSect;
+    /** Pointer to the global cache data. */
+    PPDMBLKCACHEGLOBAL  pCache;
+    /** Maximum size of the shard in bytes. */
     uint32_t            cbMax;
-    /** Current size of the cache in bytes. */
+    /** Current size of the shard in bytes. */
     uint32_t            cbCached;
-    /** Critical section protecting the cache. */
-    RTCRITSECT          CritSect;
     /** Maximum number of bytes cached. */
     uint32_t            cbRecentlyUsedInMax;
     /** Maximum number of bytes in the paged out list .*/
     uint32_t            cbRecentlyUsedOutMax;
-    /** Recently used cache entries list */
+    /** ARC: Target size of the recently used list in bytes, adapted on ghost hits. */
+    uint32_t            cbRecentlyUsedTarget;
+    /** Recently used cache entries list (ARC: T1) */
     PDMBLKLRULIST       LruRecentlyUsedIn;
-    /** Scorecard cache entry list. */
+    /** Scorecard cache entry list (ARC: B1). */
     PDMBLKLRULIST       LruRecentlyUsedOut;
-    /** List of frequently used cache entries */
+    /** List of frequently used cache entries (ARC: T2) */
     PDMBLKLRULIST       LruFrequentlyUsed;
+    /** ARC: Ghost list of entries evicted from the frequently used list (B2). */
+    PDMBLKLRULIST       LruFrequentlyUsedOut;
+#ifdef VBOX_WITH_STATISTICS
+    /** Number of bytes evicted from the shard. */
+    STAMCOUNTER         StatEvicted;
+#endif
+} PDMBLKCACHESHARD;
+#ifdef VBOX_WITH_STATISTICS
+AssertCompileMemberAlignment(PDMBLKCACHESHARD, StatEvicted, sizeof(uint64_t));
+#endif
+
+/**
+ * Global cache data.
+ */
+typedef struct PDMBLKCACHEGLOBAL
+{
+    /** Pointer to the owning VM instance. */
+    PVM                 pVM;
+    /** Maximum size of the cache in bytes. */
+    uint32_t            cbMax;
+    /** Current size of the cache in bytes, sum over all shards. */
+    volatile uint32_t   cbCached;
+    /** Critical section protecting the list of users. */
+    RTCRITSECT          CritSect;
+    /** The replacement policy. */
+    PDMBLKCACHEPOLICY   enmPolicy;
+    /** Length of a sequential run of misses after which new entries of a user
+     * are treated as a scan (ARC only, 0 disables the detection). */
+    uint32_t            cbScanThreshold;
+    /** Number of shards, power of two. */
+    uint32_t            cShards;
+    /** Seed handed to the next cache user for the shard hash. */
+    uint32_t            uShardSeedNext;
+    /** Array of cShards shards. */
+    PPDMBLKCACHESHARD   paShards;
     /** Commit timeout in milli seconds */
     uint32_t            u32CommitTimeoutMs;
     /** Number of dirty bytes needed to start a commit of the data to the disk. */
@@ -129,19 +199,31 @@ typedef struct PDMBLKCACHEGLOBAL
     volatile bool       fIoErrorVmSuspended;
     /** Flag whether a commit is currently in progress. */
     volatile bool       fCommitInProgress;
+    /** Flag whether the commit thread should terminate. */
+    volatile bool       fCommitThreadShutdown;
     /** Commit interval timer */
     PTMTIMERR3          pTimerCommit;
+    /** Thread committing dirty entries in the background. */
+    RTTHREAD            hThreadCommit;
+    /** Event semaphore to wake up the commit thread. */
+    RTSEMEVENT          hEvtCommit;
     /** Number of endpoints using the cache. */
     uint32_t            cRefs;
     /** List of all users of this cache. */
     RTLISTANCHOR        ListUsers;
-#ifdef VBOX_WITH_STATISTICS
     /** Hit counter. */
     STAMCOUNTER         cHits;
     /** Partial hit counter. */
     STAMCOUNTER         cPartialHits;
     /** Miss counter. */
     STAMCOUNTER         cMisses;
+    /** Number of hits in the recently used ghost list. */
+    STAMCOUNTER         StatGhostHitsRecent;
+    /** Number of hits in the frequently used ghost list. */
+    STAMCOUNTER         StatGhostHitsFrequent;
+    /** Number of entries created as part of a detected scan. */
+    STAMCOUNTER         StatScanEntries;
+#ifdef VBOX_WITH_STATISTICS
     /** Bytes read from cache. */
     STAMCOUNTER         StatRead;
     /** Bytes written to the cache. */
@@ -154,11 +236,11 @@ typedef struct PDMBLKCACHEGLOBAL
     STAMPROFILEADV      StatTreeRemove;
     /** Number of times a buffer could be reused. */
     STAMCOUNTER         StatBuffersReused;
+    /** Number of commit runs done by the commit thread. */
+    STAMCOUNTER         StatCommitsBackground;
 #endif
 } PDMBLKCACHEGLOBAL;
-#ifdef VBOX_WITH_STATISTICS
 AssertCompileMemberAlignment(PDMBLKCACHEGLOBAL, cHits, sizeof(uint64_t));
-#endif
 
 /**
  * Block cache type.
@@ -262,6 +344,12 @@ typedef struct PDMBLKCACHE
 
     /** Flag whether the cache was suspended. */
     volatile bool                 fSuspended;
+    /** Seed for the shard hash, unique per user. */
+    uint32_t                      uShardSeed;
+    /** Offset following the last miss, for the scan detection. */
+    uint64_t                      offSeqNext;
+    /** Number of bytes missed sequentially up to offSeqNext. */
+    uint64_t                      cbSeqRun;
 
 } PDMBLKCACHE, *PPDMBLKCACHE;
 #ifdef VBOX_WITH_STATISTICS
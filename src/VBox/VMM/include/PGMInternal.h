@@ -3431,6 +3431,33 @@ typedef struct PGM
         uint32_t                    cAlignment;
     } LiveSave;
 
+    /**
+     * Incremental saved state data.
+     */
+    struct
+    {
+        /** The ID of the last saved state the write monitoring is relative to.
+         * This is 0 when we're not tracking changes for any saved state. */
+        uint64_t                    idLastSave;
+        /** The ID of the saved state currently being written, 0 if the current save
+         * was not requested via PGMR3SaveIncrementalBegin. */
+        uint64_t                    idCurSave;
+        /** The ID of the saved state last restored (for arming in pgmR3LoadDone). */
+        uint64_t                    idLoaded;
+        /** The absolute path of the parent saved state (RTStrDup), NULL if the
+         * requested save should be a full one. */
+        R3PTRTYPE(char *)           pszParent;
+        /** Set by PGMR3SaveIncrementalBegin, cleared by PGMR3SaveIncrementalEnd. */
+        bool                        fRequested;
+        /** Set if all RAM pages not written to since idLastSave are write monitored. */
+        bool                        fTracking;
+        /** Set if the current save only includes the RAM pages that changed since
+         * idLastSave. */
+        bool                        fDelta;
+        /** Padding. */
+        bool                        afReserved[HC_ARCH_BITS == 32 ? 1 : 5];
+    } IncrSave;
+
     /** @name   Error injection.
      * @{ */
     /** Inject handy page allocation errors pretending we're completely out of
@@ -4027,6 +4054,7 @@ void            pgmHandlerVirtualDumpPhysPages(PVM pVM);
 #endif
 DECLCALLBACK(void) pgmR3InfoHandlers(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 int             pgmR3InitSavedState(PVM pVM, uint64_t cbRam);
+void            pgmR3IncrSaveStop(PVM pVM);
 
 int             pgmPhysAllocPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys);
 int             pgmPhysAllocLargePage(PVM pVM, RTGCPHYS GCPhys);
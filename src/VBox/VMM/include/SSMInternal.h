@@ -22,6 +22,7 @@
 #include <VBox/types.h>
 #include <VBox/vmm/ssm.h>
 #include <iprt/critsect.h>
+#include <iprt/zip.h>
 
 RT_C_DECLS_BEGIN
 
@@ -313,7 +314,15 @@ typedef struct SSM
     bool                    fInitialized;
     /** Current pass (for STAM). */
     uint32_t                uPass;
-    uint32_t                u32Alignment;
+
+    /** The block compressor used when saving (/SSM/Compressor).
+     * RTZIPTYPE_LZF, RTZIPTYPE_ZLIB or RTZIPTYPE_STORE. */
+    RTZIPTYPE               enmZipType;
+    /** The compression level (/SSM/CompressionLevel). */
+    RTZIPLEVEL              enmZipLevel;
+    /** The number of compression worker threads, 0 means compressing
+     * and decompressing on the EMT (/SSM/CompressionThreads). */
+    uint32_t                cZipThreads;
 } SSM;
 /** Pointer to SSM VM instance data. */
 typedef SSM *PSSM;
@@ -96,6 +96,8 @@ typedef struct STAMDESC
         PSTAMPROFILE    pProfile;
         /** Advanced profile. */
         PSTAMPROFILEADV pProfileAdv;
+        /** Histogram. */
+        PSTAMHISTOGRAM  pHistogram;
         /** Ratio, unsigned 32-bit. */
         PSTAMRATIOU32   pRatioU32;
         /** unsigned 8-bit. */
@@ -125,6 +127,8 @@ typedef struct STAMDESC
     STAMUNIT            enmUnit;
     /** Description. */
     const char         *pszDesc;
+    /** Sample ID used by the binary snapshots, unique for the life of the UVM. */
+    uint32_t            idSample;
 } STAMDESC;
 
 
@@ -137,6 +141,12 @@ typedef struct STAMUSERPERVM
     RTLISTANCHOR            List;
     /** Root of the lookup tree. */
     PSTAMLOOKUP             pRoot;
+    /** The ID to give the next sample registered. */
+    uint32_t                idNextSample;
+    /** Incremented whenever samples are deregistered (binary snapshots). */
+    uint32_t volatile       uDeregGen;
+    /** The sampler thread instance, NULL if not running. */
+    struct STAMR3SAMPLER   *pSampler;
 
     /** RW Lock for the list and tree. */
     RTSEMRW                 RWSem;
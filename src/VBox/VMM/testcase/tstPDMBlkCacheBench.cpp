@@ -0,0 +1,630 @@
+/* $Id$ */
+/** @file
+ * PDM Block Cache Benchmark.
+ *
+ * This testcase drives several memory backed disks through the block cache
+ * from multiple threads with a random read/write mix (much like fio does) and
+ * reports the achieved IOPS and throughput per disk.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#define LOG_GROUP LOG_GROUP_PDM_BLK_CACHE
+
+#include "VMInternal.h" /* UVM */
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/pdmblkcache.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/getopt.h>
+#include <iprt/initterm.h>
+#include <iprt/list.h>
+#include <iprt/mem.h>
+#include <iprt/message.h>
+#include <iprt/rand.h>
+#include <iprt/semaphore.h>
+#include <iprt/sg.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#define TESTCASE "tstPDMBlkCacheBench"
+
+/** Maximum number of disks. */
+#define TSTBLK_DISKS_MAX    64
+/** Maximum number of jobs per disk. */
+#define TSTBLK_JOBS_MAX     64
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+
+/**
+ * I/O request queued to the backend of a disk.
+ */
+typedef struct TSTBLKIO
+{
+    /** List node. */
+    RTLISTNODE              NodeIo;
+    /** Transfer direction. */
+    PDMBLKCACHEXFERDIR      enmXferDir;
+    /** Start offset. */
+    uint64_t                off;
+    /** Size of the transfer. */
+    size_t                  cbXfer;
+    /** S/G buffer. */
+    RTSGBUF                 SgBuf;
+    /** The handle to complete. */
+    PPDMBLKCACHEIOXFER      hIoXfer;
+} TSTBLKIO, *PTSTBLKIO;
+
+/**
+ * A memory backed disk.
+ */
+typedef struct TSTBLKDISK
+{
+    /** The block cache handle. */
+    PPDMBLKCACHE            pBlkCache;
+    /** The disk content. */
+    uint8_t                *pbDisk;
+    /** Size of the disk. */
+    uint64_t                cbDisk;
+    /** Lock protecting the request list. */
+    RTCRITSECT              CritSect;
+    /** Requests waiting for the backend. */
+    RTLISTANCHOR            ListIo;
+    /** Event to wake up the backend thread. */
+    RTSEMEVENT              hEvtIo;
+    /** The backend thread. */
+    RTTHREAD                hThreadIo;
+    /** Flag whether the backend thread should terminate. */
+    volatile bool           fShutdown;
+    /** Number of reads which reached the backend. */
+    volatile uint64_t       cBackendReads;
+    /** Number of writes which reached the backend. */
+    volatile uint64_t       cBackendWrites;
+} TSTBLKDISK, *PTSTBLKDISK;
+
+/**
+ * A job issuing I/O to a disk.
+ */
+typedef struct TSTBLKJOB
+{
+    /** The disk. */
+    PTSTBLKDISK             pDisk;
+    /** The job thread. */
+    RTTHREAD                hThread;
+    /** Event signalled when the outstanding request completed. */
+    RTSEMEVENT              hEvtDone;
+    /** Status of the last request. */
+    volatile int            rcReq;
+    /** I/O buffer. */
+    uint8_t                *pbBuf;
+    /** Number of reads done. */
+    uint64_t                cReads;
+    /** Number of writes done. */
+    uint64_t                cWrites;
+    /** Number of failed requests. */
+    uint64_t                cErrors;
+} TSTBLKJOB, *PTSTBLKJOB;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/** Number of disks. */
+static uint32_t     g_cDisks       = 4;
+/** Number of jobs per disk. */
+static uint32_t     g_cJobs        = 2;
+/** Size of each disk. */
+static uint64_t     g_cbDisk       = 64 * _1M;
+/** Block size of the requests. */
+static uint32_t     g_cbBlock      = _4K;
+/** Percentage of reads. */
+static uint32_t     g_uReadPercent = 70;
+/** Runtime in seconds. */
+static uint32_t     g_cSecRuntime  = 10;
+/** Cache size, 0 for the default. */
+static uint32_t     g_cbCache      = 0;
+/** Number of cache shards, 0 for the default. */
+static uint32_t     g_cShards      = 0;
+/** Flag whether the jobs should stop. */
+static volatile bool g_fStop       = false;
+/** The disks. */
+static TSTBLKDISK   g_aDisks[TSTBLK_DISKS_MAX];
+
+
+static DECLCALLBACK(int) tstBlkDiskIoThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PTSTBLKDISK pDisk = (PTSTBLKDISK)pvUser;
+    NOREF(hThreadSelf);
+
+    while (!ASMAtomicReadBool(&pDisk->fShutdown))
+    {
+        RTLISTANCHOR ListIo;
+
+        RTListInit(&ListIo);
+        RTCritSectEnter(&pDisk->CritSect);
+        RTListMove(&ListIo, &pDisk->ListIo);
+        RTCritSectLeave(&pDisk->CritSect);
+
+        if (RTListIsEmpty(&ListIo))
+        {
+            RTSemEventWait(pDisk->hEvtIo, RT_INDEFINITE_WAIT);
+            continue;
+        }
+
+        while (!RTListIsEmpty(&ListIo))
+        {
+            PTSTBLKIO pIo = RTListGetFirst(&ListIo, TSTBLKIO, NodeIo);
+            RTListNodeRemove(&pIo->NodeIo);
+
+            switch (pIo->enmXferDir)
+            {
+                case PDMBLKCACHEXFERDIR_READ:
+                    RTSgBufCopyFromBuf(&pIo->SgBuf, pDisk->pbDisk + pIo->off, pIo->cbXfer);
+                    ASMAtomicIncU64(&pDisk->cBackendReads);
+                    break;
+                case PDMBLKCACHEXFERDIR_WRITE:
+                    RTSgBufCopyToBuf(&pIo->SgBuf, pDisk->pbDisk + pIo->off, pIo->cbXfer);
+                    ASMAtomicIncU64(&pDisk->cBackendWrites);
+                    break;
+                case PDMBLKCACHEXFERDIR_FLUSH:
+                    break;
+                default:
+                    AssertMsgFailed(("Invalid transfer direction %d\n", pIo->enmXferDir));
+            }
+
+            PDMR3BlkCacheIoXferComplete(pDisk->pBlkCache, pIo->hIoXfer, VINF_SUCCESS);
+            RTMemFree(pIo);
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+static DECLCALLBACK(int) tstBlkDiskXferEnqueue(void *pvUser, PDMBLKCACHEXFERDIR enmXferDir,
+                                               uint64_t off, size_t cbXfer,
+                                               PCRTSGBUF pcSgBuf, PPDMBLKCACHEIOXFER hIoXfer)
+{
+    PTSTBLKDISK pDisk = (PTSTBLKDISK)pvUser;
+
+    AssertReturn(   enmXferDir == PDMBLKCACHEXFERDIR_FLUSH
+                 || off + cbXfer <= pDisk->cbDisk, VERR_OUT_OF_RANGE);
+
+    PTSTBLKIO pIo = (PTSTBLKIO)RTMemAllocZ(sizeof(TSTBLKIO));
+    if (!pIo)
+        return VERR_NO_MEMORY;
+
+    pIo->enmXferDir = enmXferDir;
+    pIo->off        = off;
+    pIo->cbXfer     = cbXfer;
+    pIo->hIoXfer    = hIoXfer;
+    if (pcSgBuf)
+        RTSgBufClone(&pIo->SgBuf, pcSgBuf);
+
+    RTCritSectEnter(&pDisk->CritSect);
+    RTListAppend(&pDisk->ListIo, &pIo->NodeIo);
+    RTCritSectLeave(&pDisk->CritSect);
+
+    return RTSemEventSignal(pDisk->hEvtIo);
+}
+
+static DECLCALLBACK(void) tstBlkJobXferComplete(void *pvUserInt, void *pvUser, int rc)
+{
+    PTSTBLKJOB pJob = (PTSTBLKJOB)pvUser;
+    NOREF(pvUserInt);
+
+    ASMAtomicWriteS32(&pJob->rcReq, rc);
+    RTSemEventSignal(pJob->hEvtDone);
+}
+
+/**
+ * Waits for a request to complete if it didn't complete synchronously.
+ *
+ * @returns VBox status code of the request.
+ * @param   pJob    The job.
+ * @param   rc      The status code returned when the request was issued.
+ */
+static int tstBlkJobWait(PTSTBLKJOB pJob, int rc)
+{
+    if (rc == VINF_AIO_TASK_PENDING)
+    {
+        rc = RTSemEventWait(pJob->hEvtDone, RT_INDEFINITE_WAIT);
+        if (RT_SUCCESS(rc))
+            rc = ASMAtomicReadS32(&pJob->rcReq);
+    }
+
+    return rc;
+}
+
+static DECLCALLBACK(int) tstBlkJobThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PTSTBLKJOB  pJob  = (PTSTBLKJOB)pvUser;
+    PTSTBLKDISK pDisk = pJob->pDisk;
+    uint64_t    cBlocks = pDisk->cbDisk / g_cbBlock;
+    NOREF(hThreadSelf);
+
+    while (!ASMAtomicReadBool(&g_fStop))
+    {
+        uint64_t off    = RTRandU64Ex(0, cBlocks - 1) * g_cbBlock;
+        bool     fRead  = RTRandU32Ex(1, 100) <= g_uReadPercent;
+        RTSGSEG  Seg;
+        RTSGBUF  SgBuf;
+        int      rc;
+
+        Seg.pvSeg = pJob->pbBuf;
+        Seg.cbSeg = g_cbBlock;
+        RTSgBufInit(&SgBuf, &Seg, 1);
+
+        if (fRead)
+            rc = PDMR3BlkCacheRead(pDisk->pBlkCache, off, &SgBuf, g_cbBlock, pJob);
+        else
+            rc = PDMR3BlkCacheWrite(pDisk->pBlkCache, off, &SgBuf, g_cbBlock, pJob);
+
+        rc = tstBlkJobWait(pJob, rc);
+        if (RT_FAILURE(rc))
+            pJob->cErrors++;
+        else if (fRead)
+            pJob->cReads++;
+        else
+            pJob->cWrites++;
+    }
+
+    return VINF_SUCCESS;
+}
+
+static int tstBlkDiskCreate(PVM pVM, PTSTBLKDISK pDisk, unsigned iDisk)
+{
+    char szId[32];
+
+    RTListInit(&pDisk->ListIo);
+    pDisk->cbDisk    = g_cbDisk;
+    pDisk->fShutdown = false;
+    pDisk->pbDisk    = (uint8_t *)RTMemPageAllocZ(g_cbDisk);
+    if (!pDisk->pbDisk)
+        return VERR_NO_MEMORY;
+
+    int rc = RTCritSectInit(&pDisk->CritSect);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTSemEventCreate(&pDisk->hEvtIo);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTThreadCreateF(&pDisk->hThreadIo, tstBlkDiskIoThread, pDisk, 0, RTTHREADTYPE_IO,
+                                 RTTHREADFLAGS_WAITABLE, "Disk%u", iDisk);
+            if (RT_SUCCESS(rc))
+            {
+                RTStrPrintf(szId, sizeof(szId), "Disk%u", iDisk);
+                rc = PDMR3BlkCacheRetainInt(pVM, pDisk, &pDisk->pBlkCache,
+                                            tstBlkJobXferComplete, tstBlkDiskXferEnqueue,
+                                            NULL, szId);
+                if (RT_SUCCESS(rc))
+                    return VINF_SUCCESS;
+
+                ASMAtomicWriteBool(&pDisk->fShutdown, true);
+                RTSemEventSignal(pDisk->hEvtIo);
+                RTThreadWait(pDisk->hThreadIo, RT_INDEFINITE_WAIT, NULL);
+            }
+            RTSemEventDestroy(pDisk->hEvtIo);
+        }
+        RTCritSectDelete(&pDisk->CritSect);
+    }
+    RTMemPageFree(pDisk->pbDisk, g_cbDisk);
+
+    RTMsgError("Creating disk %u failed rc=%Rrc\n", iDisk, rc);
+    return rc;
+}
+
+static void tstBlkDiskDestroy(PTSTBLKDISK pDisk)
+{
+    /* Releasing the cache writes back all dirty data, the backend has to be still running. */
+    PDMR3BlkCacheRelease(pDisk->pBlkCache);
+
+    ASMAtomicWriteBool(&pDisk->fShutdown, true);
+    RTSemEventSignal(pDisk->hEvtIo);
+    RTThreadWait(pDisk->hThreadIo, RT_INDEFINITE_WAIT, NULL);
+
+    RTSemEventDestroy(pDisk->hEvtIo);
+    RTCritSectDelete(&pDisk->CritSect);
+    RTMemPageFree(pDisk->pbDisk, pDisk->cbDisk);
+}
+
+static DECLCALLBACK(int) tstBlkConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    NOREF(pUVM); NOREF(pvUser);
+
+    int rc = CFGMR3ConstructDefaultTree(pVM);
+    if (RT_SUCCESS(rc))
+    {
+        PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+        PCFGMNODE pPdm  = CFGMR3GetChild(pRoot, "PDM");
+        PCFGMNODE pBlkCache = NULL;
+
+        if (!pPdm)
+            rc = CFGMR3InsertNode(pRoot, "PDM", &pPdm);
+        if (RT_SUCCESS(rc))
+            rc = CFGMR3InsertNode(pPdm, "BlkCache", &pBlkCache);
+        if (RT_SUCCESS(rc) && g_cbCache)
+            rc = CFGMR3InsertInteger(pBlkCache, "CacheSize", g_cbCache);
+        if (RT_SUCCESS(rc) && g_cShards)
+            rc = CFGMR3InsertInteger(pBlkCache, "CacheShards", g_cShards);
+    }
+
+    return rc;
+}
+
+static void tstBlkShowUsage(void)
+{
+    RTPrintf("syntax: " TESTCASE " [options]\n"
+             "\n"
+             "Options:\n"
+             "  -h, --help\n"
+             "    Show this help page\n"
+             "  -d, --disks <num>\n"
+             "    Number of disks (default %u).\n"
+             "  -j, --jobs <num>\n"
+             "    Number of jobs per disk (default %u).\n"
+             "  -s, --disk-size <bytes>\n"
+             "    Size of each disk (default %llu).\n"
+             "  -b, --block-size <bytes>\n"
+             "    Size of each request (default %u).\n"
+             "  -r, --read-percent <0-100>\n"
+             "    Percentage of reads in the random mix (default %u).\n"
+             "  -t, --runtime <seconds>\n"
+             "    How long to run (default %u).\n"
+             "  -c, --cache-size <bytes>\n"
+             "    Size of the block cache (default: PDM default).\n"
+             "  -S, --shards <num>\n"
+             "    Number of cache shards (default: derived from the cache size).\n",
+             g_cDisks, g_cJobs, g_cbDisk, g_cbBlock, g_uReadPercent, g_cSecRuntime);
+}
+
+/**
+ *  Entry point.
+ */
+extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
+{
+    int rcRet = 0; /* error count */
+    NOREF(envp);
+
+    RTR3InitExe(argc, &argv, RTR3INIT_FLAGS_SUPLIB);
+
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--disks",        'd', RTGETOPT_REQ_UINT32 },
+        { "--jobs",         'j', RTGETOPT_REQ_UINT32 },
+        { "--disk-size",    's', RTGETOPT_REQ_UINT64 },
+        { "--block-size",   'b', RTGETOPT_REQ_UINT32 },
+        { "--read-percent", 'r', RTGETOPT_REQ_UINT32 },
+        { "--runtime",      't', RTGETOPT_REQ_UINT32 },
+        { "--cache-size",   'c', RTGETOPT_REQ_UINT32 },
+        { "--shards",       'S', RTGETOPT_REQ_UINT32 },
+    };
+
+    RTGETOPTUNION   Val;
+    RTGETOPTSTATE   State;
+    int rc = RTGetOptInit(&State, argc, argv, &s_aOptions[0], RT_ELEMENTS(s_aOptions), 1, 0);
+    AssertRCReturn(rc, 1);
+
+    while ((rc = RTGetOpt(&State, &Val)))
+    {
+        switch (rc)
+        {
+            case 'd':
+                if (Val.u32 < 1 || Val.u32 > TSTBLK_DISKS_MAX)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "The number of disks must be between 1 and %u\n", TSTBLK_DISKS_MAX);
+                g_cDisks = Val.u32;
+                break;
+            case 'j':
+                if (Val.u32 < 1 || Val.u32 > TSTBLK_JOBS_MAX)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "The number of jobs must be between 1 and %u\n", TSTBLK_JOBS_MAX);
+                g_cJobs = Val.u32;
+                break;
+            case 's':
+                g_cbDisk = Val.u64;
+                break;
+            case 'b':
+                if (Val.u32 < 512 || (Val.u32 & 511))
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "The block size must be a multiple of 512\n");
+                g_cbBlock = Val.u32;
+                break;
+            case 'r':
+                if (Val.u32 > 100)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "The read percentage must be between 0 and 100\n");
+                g_uReadPercent = Val.u32;
+                break;
+            case 't':
+                g_cSecRuntime = Val.u32;
+                break;
+            case 'c':
+                g_cbCache = Val.u32;
+                break;
+            case 'S':
+                g_cShards = Val.u32;
+                break;
+            case 'h':
+                tstBlkShowUsage();
+                return 0;
+            default:
+                return RTGetOptPrintError(rc, &Val);
+        }
+    }
+
+    if (g_cbDisk < g_cbBlock)
+        return RTMsgErrorExit(RTEXITCODE_SYNTAX, "The disk size must be at least one block\n");
+
+    PVM pVM;
+    PUVM pUVM;
+    rc = VMR3Create(1, NULL, NULL, NULL, tstBlkConfigConstructor, NULL, &pVM, &pUVM);
+    if (RT_SUCCESS(rc))
+    {
+        /*
+         * Little hack to avoid the VM_ASSERT_EMT assertion.
+         */
+        RTTlsSet(pVM->pUVM->vm.s.idxTLS, &pVM->pUVM->aCpus[0]);
+        pVM->pUVM->aCpus[0].pUVM = pVM->pUVM;
+        pVM->pUVM->aCpus[0].vm.s.NativeThreadEMT = RTThreadNativeSelf();
+
+        unsigned cDisksCreated;
+        for (cDisksCreated = 0; cDisksCreated < g_cDisks; cDisksCreated++)
+        {
+            rc = tstBlkDiskCreate(pVM, &g_aDisks[cDisksCreated], cDisksCreated);
+            if (RT_FAILURE(rc))
+                break;
+        }
+
+        if (RT_SUCCESS(rc))
+        {
+            uint32_t   cJobs = g_cDisks * g_cJobs;
+            PTSTBLKJOB paJobs = (PTSTBLKJOB)RTMemAllocZ(cJobs * sizeof(TSTBLKJOB));
+            if (paJobs)
+            {
+                RTPrintf(TESTCASE ": %u disks of %llu bytes, %u jobs per disk, %u byte blocks, %u%% reads, %u seconds\n",
+                         g_cDisks, g_cbDisk, g_cJobs, g_cbBlock, g_uReadPercent, g_cSecRuntime);
+
+                uint32_t cJobsStarted;
+                for (cJobsStarted = 0; cJobsStarted < cJobs; cJobsStarted++)
+                {
+                    PTSTBLKJOB pJob = &paJobs[cJobsStarted];
+
+                    pJob->pDisk = &g_aDisks[cJobsStarted / g_cJobs];
+                    pJob->pbBuf = (uint8_t *)RTMemPageAllocZ(g_cbBlock);
+                    if (!pJob->pbBuf)
+                    {
+                        rc = VERR_NO_MEMORY;
+                        break;
+                    }
+
+                    rc = RTSemEventCreate(&pJob->hEvtDone);
+                    if (RT_SUCCESS(rc))
+                    {
+                        rc = RTThreadCreateF(&pJob->hThread, tstBlkJobThread, pJob, 0, RTTHREADTYPE_DEFAULT,
+                                             RTTHREADFLAGS_WAITABLE, "Job%u", cJobsStarted);
+                        if (RT_FAILURE(rc))
+                            RTSemEventDestroy(pJob->hEvtDone);
+                    }
+                    if (RT_FAILURE(rc))
+                    {
+                        RTMemPageFree(pJob->pbBuf, g_cbBlock);
+                        break;
+                    }
+                }
+
+                uint64_t tsStart = RTTimeMilliTS();
+                if (RT_SUCCESS(rc))
+                    RTThreadSleep(g_cSecRuntime * RT_MS_1SEC);
+                ASMAtomicWriteBool(&g_fStop, true);
+
+                for (uint32_t i = 0; i < cJobsStarted; i++)
+                {
+                    RTThreadWait(paJobs[i].hThread, RT_INDEFINITE_WAIT, NULL);
+                    RTSemEventDestroy(paJobs[i].hEvtDone);
+                    RTMemPageFree(paJobs[i].pbBuf, g_cbBlock);
+                }
+                uint64_t cMsElapsed = RT_MAX(RTTimeMilliTS() - tsStart, 1);
+
+                if (RT_SUCCESS(rc))
+                {
+                    /*
+                     * Report.
+                     */
+                    uint64_t cReadsTotal = 0;
+                    uint64_t cWritesTotal = 0;
+                    uint64_t cErrorsTotal = 0;
+
+                    for (uint32_t iDisk = 0; iDisk < g_cDisks; iDisk++)
+                    {
+                        uint64_t cReads = 0;
+                        uint64_t cWrites = 0;
+
+                        for (uint32_t i = iDisk * g_cJobs; i < (iDisk + 1) * g_cJobs; i++)
+                        {
+                            cReads       += paJobs[i].cReads;
+                            cWrites      += paJobs[i].cWrites;
+                            cErrorsTotal += paJobs[i].cErrors;
+                        }
+
+                        RTPrintf(TESTCASE ": Disk%u: read %llu IOPS, write %llu IOPS, %llu KB/s (backend reads %llu, writes %llu)\n",
+                                 iDisk, cReads * RT_MS_1SEC / cMsElapsed, cWrites * RT_MS_1SEC / cMsElapsed,
+                                 (cReads + cWrites) * g_cbBlock / _1K * RT_MS_1SEC / cMsElapsed,
+                                 g_aDisks[iDisk].cBackendReads, g_aDisks[iDisk].cBackendWrites);
+                        cReadsTotal  += cReads;
+                        cWritesTotal += cWrites;
+                    }
+
+                    RTPrintf(TESTCASE ": Total: %llu IOPS, %llu KB/s\n",
+                             (cReadsTotal + cWritesTotal) * RT_MS_1SEC / cMsElapsed,
+                             (cReadsTotal + cWritesTotal) * g_cbBlock / _1K * RT_MS_1SEC / cMsElapsed);
+                    if (cErrorsTotal)
+                    {
+                        RTPrintf(TESTCASE ": %llu requests failed!\n", cErrorsTotal);
+                        rcRet++;
+                    }
+
+                    STAMR3Print(pUVM, "/PDM/BlkCache/*");
+                }
+                else
+                {
+                    RTPrintf(TESTCASE ": Starting the jobs failed rc=%Rrc\n", rc);
+                    rcRet++;
+                }
+
+                RTMemFree(paJobs);
+            }
+            else
+            {
+                RTPrintf(TESTCASE ": Out of memory allocating the jobs\n");
+                rcRet++;
+            }
+        }
+        else
+            rcRet++;
+
+        for (unsigned i = 0; i < cDisksCreated; i++)
+            tstBlkDiskDestroy(&g_aDisks[i]);
+
+        rc = VMR3Destroy(pUVM);
+        AssertMsg(rc == VINF_SUCCESS, ("%s: Destroying VM failed rc=%Rrc!!\n", __FUNCTION__, rc));
+    }
+    else
+    {
+        RTPrintf(TESTCASE ": failed to create VM!! rc=%Rrc\n", rc);
+        rcRet++;
+    }
+
+    return rcRet;
+}
+
+
+#if !defined(VBOX_WITH_HARDENING) || !defined(RT_OS_WINDOWS)
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv, char **envp)
+{
+    return TrustedMain(argc, argv, envp);
+}
+#endif
+
@@ -21,6 +21,7 @@
 *******************************************************************************/
 #include <VBox/vmm/ssm.h>
 #include "VMInternal.h" /* createFakeVM */
+#include "SSMInternal.h" /* compressor settings */
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
 #include <VBox/vmm/mm.h>
@@ -619,6 +620,23 @@ DECLCALLBACK(int) Item04Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32
 }
 
 
+/**
+ * @callback_method_impl{FNSSMEXTLOADEXEC,
+ *      Replays the 2nd item through SSMR3LoadUnitFromFile.}
+ */
+static DECLCALLBACK(int) Item02Replay(PSSMHANDLE pSSM, void *pvUser, uint32_t uVersion, uint32_t uPass)
+{
+    uint32_t *pcCalls = (uint32_t *)pvUser;
+    *pcCalls += 1;
+    if (uPass != SSM_PASS_FINAL)
+    {
+        RTPrintf("Item02Replay: uPass=%#x, expected SSM_PASS_FINAL\n", uPass);
+        return VERR_GENERAL_FAILURE;
+    }
+    return Item02Load(NULL, pSSM, uVersion, uPass);
+}
+
+
 /**
  * Creates a mockup VM structure for testing SSM.
  *
@@ -912,6 +930,79 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         return 1;
     }
 
+    /*
+     * Replay a single unit from the file (incremental saved state parents).
+     */
+    uint32_t cCalls = 0;
+    u64Start = RTTimeNanoTS();
+    rc = SSMR3LoadUnitFromFile(pVM, pszFilename, "SSM Testcase Data Item no.2 (rand mem)", 2, Item02Replay, &cCalls);
+    if (RT_FAILURE(rc) || cCalls != 1)
+    {
+        RTPrintf("SSMR3LoadUnitFromFile #1 -> %Rrc (cCalls=%u)\n", rc, cCalls);
+        return 1;
+    }
+    u64Elapsed = RTTimeNanoTS() - u64Start;
+    RTPrintf("tstSSM: Replayed 2nd item in %'RI64 ns\n", u64Elapsed);
+
+    cCalls = 0;
+    rc = SSMR3LoadUnitFromFile(pVM, pszFilename, "SSM Testcase Data Item no.2 (rand mem)", 3, Item02Replay, &cCalls);
+    if (rc != VERR_SSM_UNIT_NOT_FOUND || cCalls != 0)
+    {
+        RTPrintf("SSMR3LoadUnitFromFile #2 -> %Rrc (cCalls=%u), expected VERR_SSM_UNIT_NOT_FOUND\n", rc, cCalls);
+        return 1;
+    }
+
+    /*
+     * Save and restore with the various compressor and thread configurations.
+     */
+    static const struct
+    {
+        RTZIPTYPE       enmType;
+        uint32_t        cThreads;
+        const char     *pszDesc;
+    } s_aZipCfgs[] =
+    {
+        { RTZIPTYPE_LZF,    0, "lzf, no threads" },
+        { RTZIPTYPE_LZF,    4, "lzf, 4 threads" },
+        { RTZIPTYPE_ZLIB,   0, "zlib, no threads" },
+        { RTZIPTYPE_ZLIB,   4, "zlib, 4 threads" },
+        { RTZIPTYPE_STORE,  0, "none" },
+    };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aZipCfgs); i++)
+    {
+        pVM->ssm.s.enmZipType  = s_aZipCfgs[i].enmType;
+        pVM->ssm.s.enmZipLevel = RTZIPLEVEL_FAST;
+        pVM->ssm.s.cZipThreads = s_aZipCfgs[i].cThreads;
+
+        u64Start = RTTimeNanoTS();
+        rc = SSMR3Save(pVM, pszFilename, NULL, NULL, SSMAFTER_DESTROY, NULL, NULL);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3Save #2 (%s) -> %Rrc\n", s_aZipCfgs[i].pszDesc, rc);
+            return 1;
+        }
+        uint64_t const cNsSave = RTTimeNanoTS() - u64Start;
+
+        rc = RTPathQueryInfo(pszFilename, &Info, RTFSOBJATTRADD_NOTHING);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("tstSSM: failed to query file size: %Rrc\n", rc);
+            return 1;
+        }
+
+        u64Start = RTTimeNanoTS();
+        rc = SSMR3Load(pVM, pszFilename, NULL /*pStreamOps*/, NULL /*pStreamOpsUser*/,
+                       SSMAFTER_RESUME, NULL /*pfnProgress*/, NULL /*pvProgressUser*/);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("SSMR3Load #2 (%s) -> %Rrc\n", s_aZipCfgs[i].pszDesc, rc);
+            return 1;
+        }
+        u64Elapsed = RTTimeNanoTS() - u64Start;
+        RTPrintf("tstSSM: %-16s: saved in %'RI64 ns, loaded in %'RI64 ns, file size %'RI64 bytes\n",
+                 s_aZipCfgs[i].pszDesc, cNsSave, u64Elapsed, Info.cbObject);
+    }
+
     /* delete */
     RTFileDelete(pszFilename);
 
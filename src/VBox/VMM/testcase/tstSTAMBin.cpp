@@ -0,0 +1,846 @@
+/* $Id$ */
+/** @file
+ * Testcase for the STAM binary snapshots.
+ *
+ * Contains a standalone decoder for the format described in @ref
+ * grp_stam_r3_bin.  Run without arguments it checks that decoding the frames
+ * produced by STAMR3SnapshotBinary reproduces the sample values.  Given file
+ * names it dumps sampler output (see STAMR3SamplerStart) instead.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/sup.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
+
+#include <VBox/err.h>
+#include <VBox/param.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/rand.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+
+#include <iprt/test.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The maximum number of values in a value record. */
+#define TST_MAX_VALUES      4
+/** Upper limit for sample IDs accepted by the decoder. */
+#define TST_MAX_IDS         _1M
+
+
+/*******************************************************************************
+*   Structures and Typedefs                                                    *
+*******************************************************************************/
+/**
+ * What the decoder knows about one sample ID.
+ */
+typedef struct TSTSTAMBINSAMPLE
+{
+    /** Set once a schema record has been seen. */
+    bool        fDefined;
+    /** Set if the current frame had a value record for this sample. */
+    bool        fInFrame;
+    /** The sample type (STAMTYPE). */
+    uint8_t     enmType;
+    /** The unit (STAMUNIT). */
+    uint8_t     enmUnit;
+    /** The name. */
+    char       *pszName;
+    /** The description. */
+    char       *pszDesc;
+    /** The callback text. */
+    char       *pszText;
+    /** The values. */
+    uint64_t    au64[TST_MAX_VALUES];
+    /** The histogram buckets, allocated on first use. */
+    uint64_t   *pau64Buckets;
+} TSTSTAMBINSAMPLE;
+/** Pointer to a decoded sample. */
+typedef TSTSTAMBINSAMPLE *PTSTSTAMBINSAMPLE;
+
+/**
+ * Binary snapshot stream decoder state.
+ */
+typedef struct TSTSTAMBINREADER
+{
+    /** The samples indexed by ID. */
+    PTSTSTAMBINSAMPLE   paSamples;
+    /** Number of entries in paSamples. */
+    uint32_t            cIds;
+    /** Set when a key frame has been decoded and no frame was lost since. */
+    bool                fSynced;
+    /** The header of the last frame decoded. */
+    STAMBINHDR          Hdr;
+} TSTSTAMBINREADER;
+/** Pointer to the decoder state. */
+typedef TSTSTAMBINREADER *PTSTSTAMBINREADER;
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+static STAMCOUNTER      g_Counter;
+static uint32_t         g_u32;
+static uint8_t          g_u8;
+static bool             g_f;
+static uint64_t         g_u64;
+static STAMRATIOU32     g_Ratio;
+static STAMPROFILE      g_Profile;
+static STAMHISTOGRAM    g_Hist;
+static uint32_t         g_uCallback;
+static STAMCOUNTER      g_Late;
+
+/** The samples registered by the test. */
+static struct
+{
+    void       *pvSample;
+    STAMTYPE    enmType;
+    const char *pszName;
+    bool        fRegistered;
+} g_aSamples[] =
+{
+    { &g_Counter,   STAMTYPE_COUNTER,   "/tstSTAMBin/Counter",  false },
+    { &g_u32,       STAMTYPE_U32,       "/tstSTAMBin/U32",      false },
+    { &g_u8,        STAMTYPE_U8_RESET,  "/tstSTAMBin/U8",       false },
+    { &g_f,         STAMTYPE_BOOL,      "/tstSTAMBin/Bool",     false },
+    { &g_u64,       STAMTYPE_X64,       "/tstSTAMBin/X64",      false },
+    { &g_Ratio,     STAMTYPE_RATIO_U32, "/tstSTAMBin/Ratio",    false },
+    { &g_Profile,   STAMTYPE_PROFILE,   "/tstSTAMBin/Profile",  false },
+    { &g_Hist,      STAMTYPE_HISTOGRAM, "/tstSTAMBin/Hist",     false },
+    { &g_uCallback, STAMTYPE_CALLBACK,  "/tstSTAMBin/Callback", false },
+    { &g_Late,      STAMTYPE_COUNTER,   "/tstSTAMBin/Late",     false },
+};
+
+
+/**
+ * Gets the number of values a sample type has in a value record.
+ *
+ * @returns Number of values, 0 for callbacks, ~0U for unknown types.
+ * @param   enmType     The sample type.
+ */
+static unsigned tstStamBinValueCount(unsigned enmType)
+{
+    switch (enmType)
+    {
+        case STAMTYPE_CALLBACK:
+            return 0;
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+        case STAMTYPE_HISTOGRAM:
+            return 4;
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            return 2;
+        case STAMTYPE_COUNTER:
+        case STAMTYPE_U8:
+        case STAMTYPE_U8_RESET:
+        case STAMTYPE_X8:
+        case STAMTYPE_X8_RESET:
+        case STAMTYPE_U16:
+        case STAMTYPE_U16_RESET:
+        case STAMTYPE_X16:
+        case STAMTYPE_X16_RESET:
+        case STAMTYPE_U32:
+        case STAMTYPE_U32_RESET:
+        case STAMTYPE_X32:
+        case STAMTYPE_X32_RESET:
+        case STAMTYPE_U64:
+        case STAMTYPE_U64_RESET:
+        case STAMTYPE_X64:
+        case STAMTYPE_X64_RESET:
+        case STAMTYPE_BOOL:
+        case STAMTYPE_BOOL_RESET:
+            return 1;
+        default:
+            return ~0U;
+    }
+}
+
+
+/**
+ * Reads an unsigned LEB128 varint.
+ *
+ * @returns VBox status code.
+ * @param   pb          The frame.
+ * @param   cb          The frame size.
+ * @param   poff        The read offset, advanced.
+ * @param   pu64        Where to return the value.
+ */
+static int tstStamBinGetVarU64(const uint8_t *pb, size_t cb, size_t *poff, uint64_t *pu64)
+{
+    uint64_t u64    = 0;
+    unsigned cShift = 0;
+    size_t   off    = *poff;
+    for (;;)
+    {
+        if (off >= cb || cShift > 63)
+            return VERR_PARSE_ERROR;
+        uint8_t b = pb[off++];
+        u64 |= (uint64_t)(b & 0x7f) << cShift;
+        if (!(b & 0x80))
+            break;
+        cShift += 7;
+    }
+    *poff = off;
+    *pu64 = u64;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads a zigzag varint delta and applies it to a value.
+ *
+ * @returns VBox status code.
+ * @param   pb          The frame.
+ * @param   cb          The frame size.
+ * @param   poff        The read offset, advanced.
+ * @param   pu64        The value to update.
+ */
+static int tstStamBinApplyDelta(const uint8_t *pb, size_t cb, size_t *poff, uint64_t *pu64)
+{
+    uint64_t u64;
+    int rc = tstStamBinGetVarU64(pb, cb, poff, &u64);
+    if (RT_SUCCESS(rc))
+        *pu64 += (u64 >> 1) ^ (0 - (u64 & 1));
+    return rc;
+}
+
+
+/**
+ * Reads a varint length prefixed string, replacing @a *ppsz.
+ *
+ * @returns VBox status code.
+ * @param   pb          The frame.
+ * @param   cb          The frame size.
+ * @param   poff        The read offset, advanced.
+ * @param   ppsz        The string to replace.
+ */
+static int tstStamBinGetString(const uint8_t *pb, size_t cb, size_t *poff, char **ppsz)
+{
+    uint64_t cch;
+    int rc = tstStamBinGetVarU64(pb, cb, poff, &cch);
+    if (RT_FAILURE(rc))
+        return rc;
+    if (cch > cb - *poff)
+        return VERR_PARSE_ERROR;
+    char *psz = RTStrDupN((const char *)&pb[*poff], (size_t)cch);
+    if (!psz)
+        return VERR_NO_STR_MEMORY;
+    RTStrFree(*ppsz);
+    *ppsz = psz;
+    *poff += (size_t)cch;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Forgets everything known about a sample.
+ *
+ * @param   pSample     The sample.
+ */
+static void tstStamBinSampleClear(PTSTSTAMBINSAMPLE pSample)
+{
+    RTStrFree(pSample->pszName);
+    RTStrFree(pSample->pszDesc);
+    RTStrFree(pSample->pszText);
+    RTMemFree(pSample->pau64Buckets);
+    RT_ZERO(*pSample);
+}
+
+
+/**
+ * Frees the decoder state.
+ *
+ * @param   pReader     The decoder state.
+ */
+static void tstStamBinReaderDelete(PTSTSTAMBINREADER pReader)
+{
+    for (uint32_t i = 0; i < pReader->cIds; i++)
+        tstStamBinSampleClear(&pReader->paSamples[i]);
+    RTMemFree(pReader->paSamples);
+    RT_ZERO(*pReader);
+}
+
+
+/**
+ * Decodes one frame.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_WRONG_ORDER if the frame is a delta frame that doesn't follow
+ *          the previous frame decoded.  Skip to the next key frame.
+ * @param   pReader     The decoder state.
+ * @param   pvFrame     The frame.
+ * @param   cbAvail     The number of bytes available at @a pvFrame.
+ * @param   pcbFrame    Where to return the frame size.  Optional.
+ */
+static int tstStamBinDecodeFrame(PTSTSTAMBINREADER pReader, const void *pvFrame, size_t cbAvail, size_t *pcbFrame)
+{
+    /*
+     * Validate the header.
+     */
+    PCSTAMBINHDR pHdr = (PCSTAMBINHDR)pvFrame;
+    if (   cbAvail < sizeof(*pHdr)
+        || pHdr->u32Magic != STAMBIN_MAGIC
+        || pHdr->cbFrame < sizeof(*pHdr)
+        || pHdr->cbFrame > cbAvail)
+        return VERR_PARSE_ERROR;
+    if (pHdr->uVersion != STAMBIN_VERSION)
+        return VERR_VERSION_MISMATCH;
+    if (pcbFrame)
+        *pcbFrame = pHdr->cbFrame;
+
+    if (pHdr->fFlags & STAMBIN_F_KEYFRAME)
+    {
+        for (uint32_t i = 0; i < pReader->cIds; i++)
+            tstStamBinSampleClear(&pReader->paSamples[i]);
+    }
+    else if (   !pReader->fSynced
+             || pHdr->iFrame != pReader->Hdr.iFrame + 1)
+    {
+        pReader->fSynced = false;
+        return VERR_WRONG_ORDER;
+    }
+    pReader->fSynced = false;
+    for (uint32_t i = 0; i < pReader->cIds; i++)
+        pReader->paSamples[i].fInFrame = false;
+
+    const uint8_t *pb  = (const uint8_t *)pvFrame;
+    size_t const   cb  = pHdr->cbFrame;
+    size_t         off = sizeof(*pHdr);
+    int            rc  = VINF_SUCCESS;
+
+    /*
+     * The schema records.
+     */
+    for (uint32_t iRec = 0; iRec < pHdr->cSchemas && RT_SUCCESS(rc); iRec++)
+    {
+        uint64_t idSample;
+        rc = tstStamBinGetVarU64(pb, cb, &off, &idSample);
+        if (RT_FAILURE(rc))
+            break;
+        if (idSample >= TST_MAX_IDS || cb - off < 3)
+            return VERR_PARSE_ERROR;
+        if (idSample >= pReader->cIds)
+        {
+            uint32_t cNew = RT_ALIGN_32((uint32_t)idSample + 1, 256);
+            void *pvNew = RTMemRealloc(pReader->paSamples, cNew * sizeof(pReader->paSamples[0]));
+            if (!pvNew)
+                return VERR_NO_MEMORY;
+            pReader->paSamples = (PTSTSTAMBINSAMPLE)pvNew;
+            RT_BZERO(&pReader->paSamples[pReader->cIds], (cNew - pReader->cIds) * sizeof(pReader->paSamples[0]));
+            pReader->cIds = cNew;
+        }
+
+        /* A (re)definition starts the values over from zero. */
+        PTSTSTAMBINSAMPLE pSample = &pReader->paSamples[idSample];
+        tstStamBinSampleClear(pSample);
+        pSample->enmType  = pb[off++];
+        pSample->enmUnit  = pb[off++];
+        off++; /* visibility */
+        if (tstStamBinValueCount(pSample->enmType) == ~0U)
+            return VERR_PARSE_ERROR;
+        rc = tstStamBinGetString(pb, cb, &off, &pSample->pszName);
+        if (RT_SUCCESS(rc))
+            rc = tstStamBinGetString(pb, cb, &off, &pSample->pszDesc);
+        pSample->fDefined = RT_SUCCESS(rc);
+    }
+
+    /*
+     * The value records.
+     */
+    for (uint32_t iRec = 0; iRec < pHdr->cValues && RT_SUCCESS(rc); iRec++)
+    {
+        uint64_t idSample;
+        rc = tstStamBinGetVarU64(pb, cb, &off, &idSample);
+        if (RT_FAILURE(rc))
+            break;
+        if (idSample >= pReader->cIds || !pReader->paSamples[idSample].fDefined)
+            return VERR_PARSE_ERROR;
+        PTSTSTAMBINSAMPLE pSample = &pReader->paSamples[idSample];
+        pSample->fInFrame = true;
+
+        if (pSample->enmType == STAMTYPE_CALLBACK)
+        {
+            rc = tstStamBinGetString(pb, cb, &off, &pSample->pszText);
+            continue;
+        }
+
+        unsigned const cValues = tstStamBinValueCount(pSample->enmType);
+        for (unsigned iValue = 0; iValue < cValues && RT_SUCCESS(rc); iValue++)
+            rc = tstStamBinApplyDelta(pb, cb, &off, &pSample->au64[iValue]);
+
+        if (RT_SUCCESS(rc) && pSample->enmType == STAMTYPE_HISTOGRAM)
+        {
+            if (!pSample->pau64Buckets)
+            {
+                pSample->pau64Buckets = (uint64_t *)RTMemAllocZ(STAM_HISTOGRAM_BUCKETS * sizeof(uint64_t));
+                if (!pSample->pau64Buckets)
+                    return VERR_NO_MEMORY;
+            }
+            uint64_t cChanged;
+            rc = tstStamBinGetVarU64(pb, cb, &off, &cChanged);
+            if (RT_SUCCESS(rc) && cChanged > STAM_HISTOGRAM_BUCKETS)
+                rc = VERR_PARSE_ERROR;
+            uint64_t iBucket = 0;
+            for (uint64_t i = 0; i < cChanged && RT_SUCCESS(rc); i++)
+            {
+                uint64_t cGap;
+                rc = tstStamBinGetVarU64(pb, cb, &off, &cGap);
+                if (RT_FAILURE(rc))
+                    break;
+                if (cGap >= STAM_HISTOGRAM_BUCKETS - iBucket)
+                    return VERR_PARSE_ERROR;
+                iBucket += cGap;
+                rc = tstStamBinApplyDelta(pb, cb, &off, &pSample->pau64Buckets[iBucket]);
+            }
+        }
+    }
+
+    if (RT_SUCCESS(rc) && off != cb)
+        rc = VERR_PARSE_ERROR;
+    if (RT_SUCCESS(rc))
+    {
+        pReader->Hdr     = *pHdr;
+        pReader->fSynced = true;
+    }
+    return rc;
+}
+
+
+/**
+ * Looks up a decoded sample by name.
+ *
+ * @returns Pointer to the sample, NULL if not known.
+ * @param   pReader     The decoder state.
+ * @param   pszName     The sample name.
+ */
+static PTSTSTAMBINSAMPLE tstStamBinLookup(PTSTSTAMBINREADER pReader, const char *pszName)
+{
+    for (uint32_t i = 0; i < pReader->cIds; i++)
+        if (   pReader->paSamples[i].fDefined
+            && !strcmp(pReader->paSamples[i].pszName, pszName))
+            return &pReader->paSamples[i];
+    return NULL;
+}
+
+
+/**
+ * @callback_method_impl{FNSTAMR3CALLBACKPRINT}
+ */
+static DECLCALLBACK(void) tstStamBinCallbackPrint(PVM pVM, void *pvSample, char *pszBuf, size_t cchBuf)
+{
+    NOREF(pVM);
+    RTStrPrintf(pszBuf, cchBuf, "callback %u", *(uint32_t *)pvSample);
+}
+
+
+/**
+ * Checks that the decoder state matches the registered samples.
+ *
+ * @param   pReader     The decoder state.
+ */
+static void tstStamBinCheckValues(PTSTSTAMBINREADER pReader)
+{
+    unsigned cRegistered = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aSamples); i++)
+    {
+        PTSTSTAMBINSAMPLE pSample = tstStamBinLookup(pReader, g_aSamples[i].pszName);
+        if (!g_aSamples[i].fRegistered)
+        {
+            RTTESTI_CHECK_MSG(!pSample, ("%s\n", g_aSamples[i].pszName));
+            continue;
+        }
+        cRegistered++;
+        RTTESTI_CHECK_MSG_RETV(pSample, ("%s\n", g_aSamples[i].pszName));
+        RTTESTI_CHECK(pSample->enmType == g_aSamples[i].enmType);
+
+        uint64_t au64[TST_MAX_VALUES] = { 0, 0, 0, 0 };
+        switch (g_aSamples[i].enmType)
+        {
+            case STAMTYPE_COUNTER:
+                au64[0] = ((PSTAMCOUNTER)g_aSamples[i].pvSample)->c;
+                break;
+            case STAMTYPE_U32:
+                au64[0] = g_u32;
+                break;
+            case STAMTYPE_U8_RESET:
+                au64[0] = g_u8;
+                break;
+            case STAMTYPE_BOOL:
+                au64[0] = g_f;
+                break;
+            case STAMTYPE_X64:
+                au64[0] = g_u64;
+                break;
+            case STAMTYPE_RATIO_U32:
+                au64[0] = g_Ratio.u32A;
+                au64[1] = g_Ratio.u32B;
+                break;
+            case STAMTYPE_PROFILE:
+            case STAMTYPE_HISTOGRAM:
+            {
+                PSTAMPROFILE pProfile = (PSTAMPROFILE)g_aSamples[i].pvSample;
+                au64[0] = pProfile->cPeriods;
+                au64[1] = pProfile->cTicks;
+                au64[2] = pProfile->cTicksMin;
+                au64[3] = pProfile->cTicksMax;
+                break;
+            }
+            case STAMTYPE_CALLBACK:
+            {
+                char szExpect[64];
+                tstStamBinCallbackPrint(NULL, &g_uCallback, szExpect, sizeof(szExpect));
+                RTTESTI_CHECK_MSG(pSample->pszText && !strcmp(pSample->pszText, szExpect),
+                                  ("'%s' vs '%s'\n", pSample->pszText, szExpect));
+                continue;
+            }
+            default:
+                AssertFailed();
+        }
+        for (unsigned iValue = 0; iValue < TST_MAX_VALUES; iValue++)
+            RTTESTI_CHECK_MSG(pSample->au64[iValue] == au64[iValue],
+                              ("%s[%u]: %#RX64 vs %#RX64\n", g_aSamples[i].pszName, iValue, pSample->au64[iValue], au64[iValue]));
+
+        if (g_aSamples[i].enmType == STAMTYPE_HISTOGRAM)
+        {
+            RTTESTI_CHECK_RETV(pSample->pau64Buckets);
+            for (unsigned iBucket = 0; iBucket < STAM_HISTOGRAM_BUCKETS; iBucket++)
+                RTTESTI_CHECK_MSG(pSample->pau64Buckets[iBucket] == g_Hist.aBuckets[iBucket],
+                                  ("bucket %u: %RU64 vs %RU64\n", iBucket, pSample->pau64Buckets[iBucket], g_Hist.aBuckets[iBucket]));
+        }
+    }
+
+    unsigned cDefined = 0;
+    for (uint32_t i = 0; i < pReader->cIds; i++)
+        cDefined += pReader->paSamples[i].fDefined;
+    RTTESTI_CHECK_MSG(cDefined == cRegistered, ("%u vs %u\n", cDefined, cRegistered));
+}
+
+
+/**
+ * Registers one of the test samples.
+ *
+ * @param   pVM         Pointer to the fake VM.
+ * @param   i           The g_aSamples index.
+ */
+static void tstStamBinRegister(PVM pVM, unsigned i)
+{
+    if (g_aSamples[i].enmType == STAMTYPE_CALLBACK)
+        RTTESTI_CHECK_RC_RETV(STAMR3RegisterCallback(pVM, g_aSamples[i].pvSample, STAMVISIBILITY_ALWAYS, STAMUNIT_NONE,
+                                                     NULL, tstStamBinCallbackPrint, "Callback sample.", "%s",
+                                                     g_aSamples[i].pszName), VINF_SUCCESS);
+    else
+        RTTESTI_CHECK_RC_RETV(STAMR3RegisterU(pVM->pUVM, g_aSamples[i].pvSample, g_aSamples[i].enmType, STAMVISIBILITY_ALWAYS,
+                                              g_aSamples[i].pszName, STAMUNIT_OCCURENCES, "Test sample."), VINF_SUCCESS);
+    g_aSamples[i].fRegistered = true;
+}
+
+
+/**
+ * Takes a frame and feeds it to the decoder.
+ *
+ * @returns Pointer to the frame header, NULL on failure.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pCtx        The binary snapshot context.
+ * @param   pReader     The decoder state.
+ * @param   fKeyFrame   Whether to request a key frame.
+ */
+static PCSTAMBINHDR tstStamBinTakeFrame(PUVM pUVM, PSTAMR3BINCTX pCtx, PTSTSTAMBINREADER pReader, bool fKeyFrame)
+{
+    const void *pvFrame = NULL;
+    size_t      cbFrame = 0;
+    RTTESTI_CHECK_RC_RET(STAMR3SnapshotBinary(pUVM, pCtx, fKeyFrame, &pvFrame, &cbFrame), VINF_SUCCESS, NULL);
+    size_t cbDecoded = 0;
+    RTTESTI_CHECK_RC_RET(tstStamBinDecodeFrame(pReader, pvFrame, cbFrame, &cbDecoded), VINF_SUCCESS, NULL);
+    RTTESTI_CHECK(cbDecoded == cbFrame);
+    return (PCSTAMBINHDR)pvFrame;
+}
+
+
+/**
+ * Round trips frames through the decoder while changing the samples.
+ *
+ * @param   pVM         Pointer to the fake VM.
+ */
+static void tstStamBinRoundTrip(PVM pVM)
+{
+    PUVM pUVM = pVM->pUVM;
+    RTTestISub("Round trip");
+
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aSamples) - 1; i++)
+        tstStamBinRegister(pVM, i);
+    g_Counter.c = 42;
+    g_u64       = UINT64_C(0xfedcba9876543210);
+    STAM_REL_PROFILE_ADD_PERIOD(&g_Profile, 1000);
+    STAMHistogramAdd(&g_Hist, 3);
+    STAMHistogramAdd(&g_Hist, 70000);
+
+    PSTAMR3BINCTX pCtx;
+    RTTESTI_CHECK_RC_RETV(STAMR3BinCtxCreate(pUVM, "/tstSTAMBin/*", &pCtx), VINF_SUCCESS);
+    TSTSTAMBINREADER Reader;
+    RT_ZERO(Reader);
+
+    /* The first frame is a key frame describing everything. */
+    PCSTAMBINHDR pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, false);
+    if (pHdr)
+    {
+        RTTESTI_CHECK(pHdr->fFlags & STAMBIN_F_KEYFRAME);
+        RTTESTI_CHECK(pHdr->iFrame == 0);
+        RTTESTI_CHECK(pHdr->cSchemas == RT_ELEMENTS(g_aSamples) - 1);
+    }
+    tstStamBinCheckValues(&Reader);
+
+    /* Nothing changed: only the callback is sent. */
+    pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, false);
+    if (pHdr)
+    {
+        RTTESTI_CHECK(!(pHdr->fFlags & STAMBIN_F_KEYFRAME));
+        RTTESTI_CHECK(pHdr->cSchemas == 0);
+        RTTESTI_CHECK_MSG(pHdr->cValues == 1, ("%u\n", pHdr->cValues));
+    }
+    tstStamBinCheckValues(&Reader);
+
+    /* Decreasing values produce negative deltas. */
+    g_Counter.c = 1;
+    g_u64 = 0;
+    g_Ratio.u32A = 7;
+    pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, false);
+    if (pHdr)
+        RTTESTI_CHECK_MSG(pHdr->cValues == 4, ("%u\n", pHdr->cValues));
+    tstStamBinCheckValues(&Reader);
+
+    /* A sample registered later gets its schema in a delta frame. */
+    tstStamBinRegister(pVM, RT_ELEMENTS(g_aSamples) - 1);
+    g_Late.c = 3;
+    pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, false);
+    if (pHdr)
+    {
+        RTTESTI_CHECK(!(pHdr->fFlags & STAMBIN_F_KEYFRAME));
+        RTTESTI_CHECK(pHdr->cSchemas == 1);
+    }
+    tstStamBinCheckValues(&Reader);
+
+    /* Random changes with the occasional key frame. */
+    for (unsigned iRound = 0; iRound < 256; iRound++)
+    {
+        uint32_t fChange = RTRandU32();
+        if (fChange & RT_BIT_32(0))
+            g_Counter.c += RTRandU32Ex(0, 1000);
+        if (fChange & RT_BIT_32(1))
+            g_u32 = RTRandU32();
+        if (fChange & RT_BIT_32(2))
+            g_u8 = (uint8_t)RTRandU32();
+        if (fChange & RT_BIT_32(3))
+            g_f = !g_f;
+        if (fChange & RT_BIT_32(4))
+            g_u64 = RTRandU64();
+        if (fChange & RT_BIT_32(5))
+            g_Ratio.u32B = RTRandU32();
+        if (fChange & RT_BIT_32(6))
+            STAM_REL_PROFILE_ADD_PERIOD(&g_Profile, RTRandU32Ex(1, 1000000));
+        if (fChange & RT_BIT_32(7))
+            for (unsigned i = RTRandU32Ex(1, 16); i > 0; i--)
+                STAMHistogramAdd(&g_Hist, RTRandU64Ex(0, RT_BIT_64(RTRandU32Ex(0, 48))));
+        if (fChange & RT_BIT_32(8))
+            g_uCallback++;
+
+        bool const fKeyFrame = iRound % 64 == 63;
+        pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, fKeyFrame);
+        if (!pHdr)
+            break;
+        RTTESTI_CHECK(RT_BOOL(pHdr->fFlags & STAMBIN_F_KEYFRAME) == fKeyFrame);
+        tstStamBinCheckValues(&Reader);
+    }
+
+    /* Deregistering forces a key frame so the reader drops the sample. */
+    RTTESTI_CHECK_RC(STAMR3Deregister(pUVM, "/tstSTAMBin/Ratio"), VINF_SUCCESS);
+    g_aSamples[5].fRegistered = false;
+    pHdr = tstStamBinTakeFrame(pUVM, pCtx, &Reader, false);
+    if (pHdr)
+        RTTESTI_CHECK(pHdr->fFlags & STAMBIN_F_KEYFRAME);
+    tstStamBinCheckValues(&Reader);
+
+    /* A lost delta frame must be detected. */
+    const void *pvFrame;
+    size_t      cbFrame;
+    g_Counter.c++;
+    RTTESTI_CHECK_RC(STAMR3SnapshotBinary(pUVM, pCtx, false, &pvFrame, &cbFrame), VINF_SUCCESS);
+    g_Counter.c++;
+    RTTESTI_CHECK_RC(STAMR3SnapshotBinary(pUVM, pCtx, false, &pvFrame, &cbFrame), VINF_SUCCESS);
+    RTTESTI_CHECK_RC(tstStamBinDecodeFrame(&Reader, pvFrame, cbFrame, NULL), VERR_WRONG_ORDER);
+
+    /* Truncated and corrupted frames are rejected. */
+    RTTESTI_CHECK_RC(STAMR3SnapshotBinary(pUVM, pCtx, true, &pvFrame, &cbFrame), VINF_SUCCESS);
+    RTTESTI_CHECK_RC(tstStamBinDecodeFrame(&Reader, pvFrame, cbFrame - 1, NULL), VERR_PARSE_ERROR);
+    uint8_t *pbCopy = (uint8_t *)RTMemDup(pvFrame, cbFrame);
+    if (pbCopy)
+    {
+        ((PSTAMBINHDR)pbCopy)->cbFrame -= 1;
+        RTTESTI_CHECK_RC(tstStamBinDecodeFrame(&Reader, pbCopy, cbFrame, NULL), VERR_PARSE_ERROR);
+        RTMemFree(pbCopy);
+    }
+    RTTESTI_CHECK_RC(tstStamBinDecodeFrame(&Reader, pvFrame, cbFrame, NULL), VINF_SUCCESS);
+    tstStamBinCheckValues(&Reader);
+
+    tstStamBinReaderDelete(&Reader);
+    STAMR3BinCtxDestroy(pCtx);
+    RTTESTI_CHECK_RC(STAMR3Deregister(pUVM, "/tstSTAMBin/*"), VINF_SUCCESS);
+}
+
+
+/**
+ * Runs the tests requiring a (fake) VM.
+ *
+ * @param   hTest       The test handle.
+ */
+static void doInVmmTests(RTTEST hTest)
+{
+    int rc = SUPR3Init(NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTTestSkipped(hTest, "SUPR3Init failed with rc=%Rrc",  rc);
+        return;
+    }
+
+    PVM pVM;
+    RTTESTI_CHECK_RC_RETV(SUPR3PageAlloc(RT_ALIGN_Z(sizeof(*pVM), PAGE_SIZE) >> PAGE_SHIFT, (void **)&pVM), VINF_SUCCESS);
+    PUVM pUVM = (PUVM)RTMemPageAllocZ(sizeof(*pUVM));
+    RTTESTI_CHECK_RETV(pUVM);
+    pUVM->u32Magic = UVM_MAGIC;
+    pUVM->pVM = pVM;
+    pVM->pUVM = pUVM;
+    pVM->pVMR3 = pVM;
+    pVM->enmVMState = VMSTATE_CREATED;
+
+    RTTESTI_CHECK_RC_RETV(STAMR3InitUVM(pUVM), VINF_SUCCESS);
+    tstStamBinRoundTrip(pVM);
+    STAMR3TermUVM(pUVM);
+}
+
+
+/**
+ * Dumps a file containing frames written by the sampler.
+ *
+ * @returns RTEXITCODE_SUCCESS or RTEXITCODE_FAILURE (error displayed).
+ * @param   pszFile     The file name.
+ */
+static RTEXITCODE tstStamBinDumpFile(const char *pszFile)
+{
+    void   *pvFile;
+    size_t  cbFile;
+    int rc = RTFileReadAll(pszFile, &pvFile, &cbFile);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("tstSTAMBin: Failed to read '%s': %Rrc\n", pszFile, rc);
+        return RTEXITCODE_FAILURE;
+    }
+
+    RTEXITCODE       rcExit = RTEXITCODE_SUCCESS;
+    TSTSTAMBINREADER Reader;
+    RT_ZERO(Reader);
+    size_t off = 0;
+    while (off < cbFile)
+    {
+        size_t cbFrame = 0;
+        rc = tstStamBinDecodeFrame(&Reader, (uint8_t const *)pvFile + off, cbFile - off, &cbFrame);
+        if (rc == VERR_WRONG_ORDER)
+        {
+            RTPrintf("%s: frame at %#zx out of sequence, skipping to the next key frame\n", pszFile, off);
+            off += cbFrame;
+            continue;
+        }
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("%s: bad frame at %#zx (truncated file?): %Rrc\n", pszFile, off, rc);
+            rcExit = RTEXITCODE_FAILURE;
+            break;
+        }
+
+        RTPrintf("frame #%u at %RU64 ns%s\n", Reader.Hdr.iFrame, Reader.Hdr.u64NanoTS,
+                 Reader.Hdr.fFlags & STAMBIN_F_KEYFRAME ? " (key frame)" : "");
+        for (uint32_t i = 0; i < Reader.cIds; i++)
+        {
+            PTSTSTAMBINSAMPLE pSample = &Reader.paSamples[i];
+            if (!pSample->fInFrame)
+                continue;
+            if (pSample->enmType == STAMTYPE_CALLBACK)
+                RTPrintf("  %-48s %s\n", pSample->pszName, pSample->pszText);
+            else
+            {
+                RTPrintf("  %-48s", pSample->pszName);
+                unsigned const cValues = tstStamBinValueCount(pSample->enmType);
+                for (unsigned iValue = 0; iValue < cValues; iValue++)
+                    RTPrintf(" %RU64", pSample->au64[iValue]);
+                RTPrintf(" %s\n", STAMR3GetUnit((STAMUNIT)pSample->enmUnit));
+            }
+        }
+        off += cbFrame;
+    }
+
+    tstStamBinReaderDelete(&Reader);
+    RTFileReadAllFree(pvFile, cbFile);
+    return rcExit;
+}
+
+
+/**
+ *  Entry point.
+ */
+extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
+{
+    NOREF(envp);
+    if (argc > 1)
+    {
+        RTR3InitExe(argc, &argv, 0);
+        RTEXITCODE rcExit = RTEXITCODE_SUCCESS;
+        for (int i = 1; i < argc; i++)
+            if (tstStamBinDumpFile(argv[i]) != RTEXITCODE_SUCCESS)
+                rcExit = RTEXITCODE_FAILURE;
+        return rcExit;
+    }
+
+    RTTEST hTest;
+    RTR3InitExeNoArguments(RTR3INIT_FLAGS_SUPLIB);
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstSTAMBin", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    doInVmmTests(hTest);
+
+    return RTTestSummaryAndDestroy(hTest);
+}
+
+
+#if !defined(VBOX_WITH_HARDENING) || !defined(RT_OS_WINDOWS)
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv, char **envp)
+{
+    return TrustedMain(argc, argv, envp);
+}
+#endif
+
@@ -47,6 +47,7 @@ from testdriver import reporter;
 from testdriver import base;
 from testdriver import vbox;
 from testdriver import vboxcon;
+from testdriver import vboxwrappers;
 
 def _ControllerTypeToName(eControllerType):
     """ Translate a controller type to a name. """
@@ -249,7 +250,7 @@ class tdStorageBenchmark(vbox.TestDriver):
         self.asVirtModes       = self.asVirtModesDef
         self.acCpusDef         = [1, 2,]
         self.acCpus            = self.acCpusDef;
-        self.asStorageCtrlsDef = ['AHCI', 'IDE', 'LsiLogicSAS', 'LsiLogic', 'BusLogic'];
+        self.asStorageCtrlsDef = ['AHCI', 'IDE', 'LsiLogicSAS', 'LsiLogic', 'BusLogic', 'VirtioBlk'];
         self.asStorageCtrls    = self.asStorageCtrlsDef;
         self.asDiskFormatsDef  = ['VDI', 'VMDK', 'VHD', 'QED', 'Parallels', 'QCOW', 'iSCSI'];
         self.asDiskFormats     = self.asDiskFormatsDef;
@@ -400,7 +401,7 @@ class tdStorageBenchmark(vbox.TestDriver):
     # Test execution helpers.
     #
 
-    def test1RunTestProgs(self, oSession, oTxsSession, fRc, sTestName):
+    def test1RunTestProgs(self, oSession, oTxsSession, fRc, sTestName, sGuestDisk = '/dev/vboxtest'):
         """
         Runs all the test programs on the test machine.
         """
@@ -410,13 +411,13 @@ class tdStorageBenchmark(vbox.TestDriver):
         reporter.testStart('mkfs.ext4');
         fRc = self.txsRunTest(oTxsSession, 'Create FS', 60000, \
             '/sbin/mkfs.ext4',
-                ('mkfs.ext4', '-F', '/dev/vboxtest'));
+                ('mkfs.ext4', '-F', sGuestDisk));
         reporter.testDone();
 
         reporter.testStart('mount');
         fRc = self.txsRunTest(oTxsSession, 'Mount FS', 30000, \
             '/bin/mount',
-                ('mount', '/dev/vboxtest', '/mnt'));
+                ('mount', sGuestDisk, '/mnt'));
         reporter.testDone();
 
         reporter.testStart('iozone');
@@ -455,7 +456,48 @@ class tdStorageBenchmark(vbox.TestDriver):
         reporter.testDone(not fRc);
         return fRc;
 
-    def test1OneCfg(self, sVmName, eStorageController, sDiskFormat, sDiskPath, cCpus, fHwVirt, fNestedPaging):
+    def test1SetVirtioBlkConfig(self, oSession, sDiskFormat, sDiskPath, fEnable):
+        """
+        Adds the virtio-blk device with the given disk to the VM configuration or
+        removes it again. There is no virtio-blk storage controller type in the API,
+        so the device is configured directly thru extra data.
+        """
+        sKeyBase = 'VBoxInternal/Devices/virtio-blk/0/';
+        asKeyValues = [
+            ('Trusted',                                 '1'),
+            ('LUN#0/Driver',                            'Block'),
+            ('LUN#0/Config/Type',                       'HardDisk'),
+            ('LUN#0/Config/Mountable',                  '0'),
+            ('LUN#0/AttachedDriver/Driver',             'VD'),
+            ('LUN#0/AttachedDriver/Config/Path',        sDiskPath),
+            ('LUN#0/AttachedDriver/Config/Format',      sDiskFormat),
+            ('LUN#0/AttachedDriver/Config/UseNewIo',    '1'),
+        ];
+
+        fRc = True;
+        for sKey, sValue in asKeyValues:
+            if not fEnable:
+                sValue = '';
+            fRc = oSession.setExtraData(sKeyBase + sKey, sValue) and fRc;
+        return fRc;
+
+    def test1CreateVirtioBlkHd(self, oSession, sDiskFormat, sDiskPath):
+        """
+        Creates the disk for the virtio-blk device and adds the device to the VM.
+        """
+        try:
+            oHd = oSession.oVBox.createHardDisk(sDiskFormat, sDiskPath);
+            oProgressCom = oHd.createBaseStorage(10*1024*1024*1024, (vboxcon.MediumVariant_Standard, ));
+            oProgress = vboxwrappers.ProgressWrapper(oProgressCom, self.oVBoxMgr, self, 'create disk %s' % (sDiskPath));
+            oProgress.wait();
+            oProgress.logResult();
+        except:
+            reporter.errorXcpt('failed to create hd "%s"' % (sDiskPath));
+            return False;
+        return self.test1SetVirtioBlkConfig(oSession, sDiskFormat, sDiskPath, True);
+
+    def test1OneCfg(self, sVmName, eStorageController, sDiskFormat, sDiskPath, cCpus, fHwVirt, fNestedPaging, \
+                    fVirtioBlk = False):
         """
         Runs the specified VM thru test #1.
 
@@ -469,10 +511,16 @@ class tdStorageBenchmark(vbox.TestDriver):
         oSession = self.openSession(oVM);
         if oSession is not None:
             # Attach HD
-            fRc = oSession.ensureControllerAttached(_ControllerTypeToName(eStorageController));
-            fRc = fRc and oSession.setStorageControllerType(eStorageController, _ControllerTypeToName(eStorageController));
+            if fVirtioBlk:
+                fRc = self.test1CreateVirtioBlkHd(oSession, sDiskFormat, sDiskPath);
+            else:
+                fRc = oSession.ensureControllerAttached(_ControllerTypeToName(eStorageController));
+                fRc = fRc and oSession.setStorageControllerType(eStorageController, \
+                                                                _ControllerTypeToName(eStorageController));
 
-            if sDiskFormat == "iSCSI":
+            if fVirtioBlk:
+                pass;
+            elif sDiskFormat == "iSCSI":
                 listNames = [];
                 listValues = [];
                 listValues = sDiskPath.split('|');
@@ -521,7 +569,8 @@ class tdStorageBenchmark(vbox.TestDriver):
                 # Fudge factor - Allow the guest to finish starting up.
                 self.sleep(5);
 
-                self.test1RunTestProgs(oSession, oTxsSession, fRc, 'Disk benchmark');
+                self.test1RunTestProgs(oSession, oTxsSession, fRc, 'Disk benchmark', \
+                                       '/dev/vda' if fVirtioBlk else '/dev/vboxtest');
 
                 # cleanup.
                 self.removeTask(oTxsSession);
@@ -529,7 +578,16 @@ class tdStorageBenchmark(vbox.TestDriver):
 
                 # Remove disk
                 oSession = self.openSession(oVM);
-                if oSession is not None:
+                if oSession is not None and fVirtioBlk:
+                    fRc = self.test1SetVirtioBlkConfig(oSession, sDiskFormat, sDiskPath, False) and fRc;
+                    try:
+                        oSession.saveSettings();
+                        self.oVBox.deleteHdByLocation(sDiskPath);
+                        oSession.close();
+                        oSession = None;
+                    except:
+                        reporter.errorXcpt('failed to delete disk %s of the virtio-blk device' % (sDiskPath));
+                elif oSession is not None:
                     try:
                         oSession.o.machine.detachDevice(_ControllerTypeToName(eStorageController), 1, 0);
 
@@ -572,10 +630,15 @@ class tdStorageBenchmark(vbox.TestDriver):
                 eStorageCtrl = vboxcon.StorageControllerType_BusLogic;
             else:
                 eStorageCtrl = None;
+            fVirtioBlk = sStorageCtrl == 'VirtioBlk';
 
             for sDiskFormat in self.asDiskFormats:
                 reporter.testStart('%s' % (sDiskFormat));
 
+                if sDiskFormat == "iSCSI" and fVirtioBlk:
+                    reporter.testDone(fSkipped = True); # The device is configured with a local image path.
+                    continue;
+
                 if sDiskFormat == "iSCSI":
                     asPaths = self.asIscsiTargets;
                 else:
@@ -605,7 +668,7 @@ class tdStorageBenchmark(vbox.TestDriver):
                             fHwVirt       = sVirtMode != 'raw';
                             fNestedPaging = sVirtMode == 'hwvirt-np';
                             fRc = self.test1OneCfg(sVmName, eStorageCtrl, sDiskFormat, sPath, \
-                                                   cCpus, fHwVirt, fNestedPaging)  and  fRc and True; # pychecker hack.
+                                                   cCpus, fHwVirt, fNestedPaging, fVirtioBlk)  and  fRc and True; # pychecker hack.
                             reporter.testDone();
 
                         reporter.testDone();